@@ -34,7 +34,6 @@ cd ../Backend
 #
 
 rm Kernel64.mach64
-rm Kernel64-Sandybridge.mach64
 rm output.map
 rm objects.list
 
@@ -33,7 +33,6 @@ rem Delete generated files
 rem
 
 del Kernel64.exe
-del Kernel64-Sandybridge.exe
 del output.map
 del objects.list
 
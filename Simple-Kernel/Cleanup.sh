@@ -34,7 +34,6 @@ cd ../Backend
 #
 
 rm Kernel64.elf
-rm Kernel64-Sandybridge.elf
 rm output.map
 rm objects.list
 
@@ -32,6 +32,13 @@
 //  b. CPU_ISR_MACRO (num) --> extern void CPU_ISR_pusher(num) --> set_interrupt_entry( (num), (uint64_t)CPU_ISR_pusher(num) ) --> CPU_ISR_handler()
 //  c. CPU_EXC_MACRO (num) --> extern void CPU_EXC_pusher(num) --> set_interrupt_entry( (num), (uint64_t)CPU_EXC_pusher(num) ) --> CPU_EXC_handler()
 //
+// For user-defined notifications whose handlers don't need SIMD (mark the handler and everything it calls with ISR_GPR_ONLY):
+//  d. FAST_ISR_MACRO (num) --> extern void Fast_ISR_pusher(num) --> set_interrupt_entry( (num), (uint64_t)Fast_ISR_pusher(num) ) --> "case (num):" in Fast_ISR_handler()
+//    >> These only save the caller-saved general registers and no extended state, so they're much cheaper than a. for interrupts that
+//       come in often. Pathway a. saves extended state with XSAVES or XSAVEOPT into a per-CPU area (see Setup_ISR_XSave()).
+//
+// All of these stubs time the handler call for ISR_Stats_Record() unless ISR_STATS is 0, see ISR_Stats.c.
+//
 // Note again that set_interrupt_entry() can be replaced by set_trap_entry() if desired. The difference is that traps don't clear IF in
 // %rflags, which allows maskable interrupts to trigger during other interrupts instead of double-faulting.
 //
@@ -94,6 +101,38 @@ typedef struct __attribute__ ((packed)) {
   UINT64 ss;
 } INTERRUPT_FRAME;
 
+// Structure for fast interrupts (FAST_ISR_MACRO), which only save caller-saved registers
+typedef struct __attribute__ ((packed)) {
+  // ISR identification number pushed by ISR.S
+  UINT64 isr_num;
+
+  // Register save pushed by ISR.S
+  UINT64 rax;
+  UINT64 rcx;
+  UINT64 rdx;
+  UINT64 rsi;
+  UINT64 rdi;
+  UINT64 r8;
+  UINT64 r9;
+  UINT64 r10;
+  UINT64 r11;
+
+  // Standard x86-64 interrupt stack frame
+  UINT64 rip;
+  UINT64 cs;
+  UINT64 rflags;
+  UINT64 rsp;
+  UINT64 ss;
+} FAST_INTERRUPT_FRAME;
+
+// Functions on the fast interrupt path get compiled without SIMD registers, since nothing saves them there. Clang doesn't have this
+// attribute; with Clang, build the files involved with -mgeneral-regs-only instead.
+#if defined(__GNUC__) && !defined(__clang__)
+#define ISR_GPR_ONLY __attribute__((target("general-regs-only")))
+#else
+#define ISR_GPR_ONLY
+#endif
+
 // All-in-one structure for exceptions
 typedef struct __attribute__ ((packed)) {
   // Register save pushed by ISR.S
@@ -255,13 +294,13 @@ extern void CPU_ISR_pusher31();
 // User-Defined Interrupts
 //
 
-// By default everything is set to USER_ISR_MACRO.
+// By default everything is set to USER_ISR_MACRO, except for the FAST_ISR_MACRO ones.
 
 extern void User_ISR_pusher32();
-extern void User_ISR_pusher33();
+extern void Fast_ISR_pusher33(); // PMU_VECTOR
 extern void User_ISR_pusher34();
 extern void User_ISR_pusher35();
-extern void User_ISR_pusher36();
+extern void Fast_ISR_pusher36(); // SERIAL_VECTOR
 extern void User_ISR_pusher37();
 extern void User_ISR_pusher38();
 extern void User_ISR_pusher39();
@@ -480,6 +519,6 @@ extern void User_ISR_pusher251();
 extern void User_ISR_pusher252();
 extern void User_ISR_pusher253();
 extern void User_ISR_pusher254();
-extern void User_ISR_pusher255();
+extern void Fast_ISR_pusher255(); // Local APIC spurious interrupt
 
 #endif /* _ISR_H */
@@ -428,6 +428,43 @@ typedef struct {
 // Support structure definitions and declarations
 //
 
+// Locks and lock-free rings, see Sync.c
+typedef struct {
+  union {
+    volatile UINT64       Tickets;                 // Both halves at once, for Ticket_Trylock()
+    struct {
+      volatile UINT32     Owner;                   // Ticket that holds the lock
+      volatile UINT32     Next;                    // Next ticket to hand out
+    };
+  };
+} __attribute__((aligned(64))) TICKET_LOCK;
+
+typedef struct _MCS_NODE {
+  struct _MCS_NODE * volatile Next;                // CPU waiting behind this one
+  volatile UINT64         Locked;                  // 1 until the CPU ahead hands over the lock
+} __attribute__((aligned(64))) MCS_NODE;
+
+typedef struct {
+  MCS_NODE * volatile     Tail;                    // Last CPU in line, NULL = free
+} __attribute__((aligned(64))) MCS_LOCK;
+
+typedef struct {
+  volatile UINT64         Sequence;                // Odd while a write is in progress
+  TICKET_LOCK             Writer;                  // Serializes writers, on its own cache line
+} __attribute__((aligned(64))) SEQLOCK;
+
+typedef struct {
+  volatile UINT64         Sequence;                // Position it's free for, or that position + 1 once it holds a value
+  UINT64                  Value;
+} RING_SLOT;
+
+typedef struct {
+  UINT64                  Mask;                    // Capacity - 1
+  RING_SLOT              *Slots;
+  volatile UINT64         Tail __attribute__((aligned(64))); // Next position to claim; shared by producers
+  volatile UINT64         Head __attribute__((aligned(64))); // Next position to pop; consumer's cache line
+} __attribute__((aligned(64))) MPSC_RING;
+
 // For memory functions, like malloc and friends in Memory.c
 typedef struct {
   UINTN                   MemMapSize;              // Size of the memory map (LP->Memory_Map_Size)
@@ -437,6 +474,171 @@ typedef struct {
   UINT32                  Pad;                     // Pad to multiple of 64 bits
 } GLOBAL_MEMORY_INFO_STRUCT;
 
+// Runtime page mapping, see VMM.c
+#define VMM_READ_ONLY  (1ULL << 0) // Without this pages are read/write
+#define VMM_NO_EXECUTE (1ULL << 1) // Only takes effect if IA32_EFER.NXE is on
+#define VMM_GLOBAL     (1ULL << 2) // Kept in the TLB across CR3 writes
+#define VMM_TYPE(pat)  (((uint64_t)(pat) & 0x7) << 8) // PAT_WB (the default without this), PAT_WT, PAT_UC_MINUS, PAT_UC, or PAT_WC
+
+typedef struct {
+  UINT64                  Levels;                  // 4 or 5 paging levels, 0 until Setup_VMM() has run
+  UINT64                  Page_1GB;                // 1 if 1GB pages are supported
+  UINT64                  PCID;                    // 1 if CR4.PCIDE is on
+  UINT64                  INVPCID;                 // 1 if the INVPCID instruction is supported
+  UINT64                  NX;                      // 1 if IA32_EFER.NXE is on, so VMM_NO_EXECUTE works
+  volatile UINT64         Lock;                    // Held by map_range(), unmap_range(), and protect_range()
+  volatile UINT64         Shootdown_Pending;       // CPUs that haven't flushed for the current shootdown yet
+  UINT64                  Table_Pages;             // Page tables currently allocated from malloc4k()
+  UINT64                  Splits;                  // Large pages broken into smaller ones
+  UINT64                  Merges;                  // Tables folded back into large pages
+  UINT64                  Shootdowns;              // Flush NMIs sent to other CPUs
+} GLOBAL_VMM_STRUCT;
+
+// Demand-paged virtual memory, see Vmalloc_Reserve() in VMM.c
+#define VMALLOC_MAX_AREAS   256
+#define VMALLOC_LARGE_PAGES (1ULL << 16) // Vmalloc_Reserve() flag: back the area 2MB at a time with 2MB pages
+
+typedef struct {
+  UINT64                  Base;
+  UINT64                  Size;                    // Bytes, a multiple of 4kB (2MB with VMALLOC_LARGE_PAGES)
+  UINT64                  Flags;                   // VMM_* bits for the pages, plus VMALLOC_LARGE_PAGES
+  UINT64                  Committed;               // Pages backed so far
+} VMALLOC_AREA;
+
+typedef struct {
+  UINT64                  Base;                    // Reservations come from [Base, End), 0 until Setup_VMM() has run
+  UINT64                  End;
+  UINT64                  Large_Threshold;         // Vmalloc() reservations at least this big get VMALLOC_LARGE_PAGES, 0 = never
+  volatile UINT64         Lock;                    // Held while Areas changes and while a fault is being backed
+  UINT64                  Count;                   // Areas in use
+  UINT64                  Committed_Pages;         // Pages backing all areas
+  UINT64                  Faults;                  // Faults that VMM_Page_Fault() backed with a 4kB page
+  UINT64                  Large_Faults;            // ...and with a 2MB page
+  VMALLOC_AREA            Areas[VMALLOC_MAX_AREAS]; // Sorted by Base
+} GLOBAL_VMALLOC_STRUCT;
+
+// Boot options from the second line of Kernel64.txt (LP->Kernel_Options), see Parse_Kernel_Options() in System.c
+typedef struct {
+  UINT64                  No_Zero_Verify;          // "noverify": ZeroAllConventionalMemory() trusts its stores and doesn't read memory back
+  UINT64                  Lazy_Zero;               // "lazyzero": kernel_main() calls StartBackgroundZeroing() instead of ZeroAllConventionalMemory()
+  UINT64                  Benchmark;               // "bench" or "bench=N": kernel_main() runs Run_Memory_Benchmarks()
+  UINT64                  Benchmark_Max_Size;      // Largest buffer size to benchmark in bytes (from "bench=N", N in MB), 0 = default
+  UINT64                  Shadow_Framebuffer;      // "shadowfb": draw into RAM copies of the framebuffers, see Setup_Shadow_Framebuffers()
+  UINT64                  Deferred_Console;        // "deferprintf" or "deferprintf=N": printf() queues text for Console_Flush(), see Console.c
+  UINT64                  Console_CPU;             // AP that draws the deferred console (from "deferprintf=N"), 0 = the BSP flushes it in batches
+  UINT64                  Mirror_Console;          // "mirror": every GPU shows a copy of printf's screen, see Setup_Mirror_Heads()
+  UINT64                  Serial_Console;          // "serial", "serial=N", or "serialonly": printf's text also goes out a COM port, see Serial.c
+  UINT64                  Serial_Port;             // COM port number (from "serial=N"), 0 = the first one found
+  UINT64                  Serial_Only;             // "serialonly": printf's text only goes to the COM port, not the screen
+  UINT64                  Task_Workers;            // "workers=N": APs handed to the task scheduler at boot, see Task_Start_Worker()
+  UINT64                  Vmalloc_Large;           // "vmlarge" or "vmlarge=N": Vmalloc() reservations of at least N MB (default 2) use 2MB pages
+  UINT64                  Bulk_Min;                // Smallest bulk_copy()/bulk_fill() job in bytes that gets split across APs (from "bulkmin=N", N in MB), 0 = default
+} GLOBAL_KERNEL_OPTIONS_STRUCT;
+
+// Memory benchmark results, see Run_Memory_Benchmarks() in Benchmark.c. This is laid out so that it can be dumped as-is and parsed
+// elsewhere: a header, then Count entries of Entry_Size bytes each.
+#define BENCHMARK_MAGIC 0x48434E42 // "BNCH"
+#define BENCHMARK_VERSION 1
+
+#define BENCHMARK_KIND_MEMCPY  0
+#define BENCHMARK_KIND_MEMMOVE 1
+#define BENCHMARK_KIND_MEMSET  2
+#define BENCHMARK_KIND_MEMCMP  3
+
+#define BENCHMARK_CASE_ALIGNED          0 // Destination and source 4kB-aligned
+#define BENCHMARK_CASE_DEST_UNALIGNED   1 // Destination 1 byte past 4kB alignment
+#define BENCHMARK_CASE_SRC_UNALIGNED    2 // Source 1 byte past 4kB alignment
+#define BENCHMARK_CASE_OVERLAP_FORWARD  3 // Destination = source - size/2
+#define BENCHMARK_CASE_OVERLAP_BACKWARD 4 // Destination = source + size/2
+
+typedef struct {
+  char                    Name[32];
+  UINT64                  Size;                    // Bytes per call
+  UINT64                  Iterations;              // Calls per timed sample
+  UINT64                  Ticks;                   // TSC ticks for the fastest sample, timing overhead removed
+  UINT32                  Kind;                    // BENCHMARK_KIND_*
+  UINT32                  Case;                    // BENCHMARK_CASE_*
+  UINT32                  Milli_Bytes_Per_Tick;    // Bytes per TSC tick * 1000
+  UINT32                  MB_Per_Second;           // 0 if the TSC frequency is unknown
+} BENCHMARK_ENTRY;
+
+typedef struct {
+  UINT32                  Magic;                   // BENCHMARK_MAGIC
+  UINT16                  Version;                 // BENCHMARK_VERSION
+  UINT16                  Entry_Size;              // sizeof(BENCHMARK_ENTRY)
+  UINT64                  Count;                   // Number of entries that follow
+  UINT64                  Capacity;                // Room for this many entries
+  UINT64                  TSC_MHz;                 // Used for MB_Per_Second
+  UINT64                  Max_Size;                // Largest size that was tested
+  UINT64                  Features;                // AVX_Mem_Dispatch.Features at the time
+  BENCHMARK_ENTRY         Entries[];
+} BENCHMARK_RESULTS;
+
+// Parallel copies and fills, see Bulk.c
+#define BULK_CHUNK_SHIFT  21                       // Jobs get split at 2MB-aligned destination addresses...
+#define BULK_CHUNK_SIZE   (1ULL << BULK_CHUNK_SHIFT)
+#define BULK_MIN_DEFAULT  (8ULL << 20)             // ...if they're at least 8MB, or whatever the "bulkmin" kernel option says
+#define BULK_MAX_SEGMENTS 16
+
+#define BULK_STREAM (1ULL << 0) // Use streaming stores no matter the size, instead of only above AVX_Mem_Dispatch.NT_Threshold
+#define BULK_VERIFY (1ULL << 1) // Read each chunk back afterwards, see bulk_wait()
+
+// A run of chunks with their destination on the same node
+typedef struct {
+  UINT64                  First;                   // Chunk number
+  UINT64                  Count;
+  UINT64                  Node;                    // NUMA_NO_NODE = no preference
+  volatile UINT64         Next;                    // Next chunk to claim, relative to First. Ends up past Count once they're all claimed.
+} BULK_SEGMENT;
+
+// Completion handle for bulk_copy_async() and bulk_fill_async(). Everything in it is set up by those.
+typedef struct {
+  UINT8                  *Dest;
+  UINT8                  *Src;                     // NULL for fills
+  UINT64                  Size;
+  UINT64                  Value;                   // Fill byte
+  UINT64                  Flags;                   // BULK_STREAM, BULK_VERIFY
+  UINT64                  Chunk_Shift;             // Chunk size is 1 << Chunk_Shift, smaller than BULK_CHUNK_SIZE for short-distance overlapping moves
+  UINT64                  Chunk_Base;              // Dest rounded down to the chunk size
+  UINT64                  Chunk_Count;
+  UINT64                  Reverse;                 // 1 = chunk 0 is the highest one, for overlapping moves with Dest above Src
+  UINT64                  Wave_Chunks;             // Overlapping moves: chunks per wave, else 0
+  UINT64                  Segment_Count;
+  volatile UINT64         Done;                    // Chunks finished
+  volatile UINT64         Workers;                 // APs that might still touch this handle
+  volatile UINT64         Failed;                  // With BULK_VERIFY, the address of a chunk that didn't read back right, else 0
+  BULK_SEGMENT            Segments[BULK_MAX_SEGMENTS];
+} __attribute__((aligned(64))) BULK_HANDLE;
+
+// Free list links for the page allocator in Memory.c, stored at the start of each free block
+typedef struct _BUDDY_FREE_BLOCK {
+  struct _BUDDY_FREE_BLOCK  *Next;
+  struct _BUDDY_FREE_BLOCK  *Prev;
+} BUDDY_FREE_BLOCK;
+
+// Small allocations in Memory.c come from 16kB slabs, each holding objects of one size class
+#define SLAB_CLASSES 16
+#define SLAB_MAGAZINE_SIZE 8
+
+// Slab header, at the 16kB-aligned base of each slab. The objects start right after it.
+typedef struct _SLAB_HEADER {
+  struct _SLAB_HEADER  *Next;       // Other slabs of this size class that have room
+  struct _SLAB_HEADER  *Prev;
+  void                 *FreeList;   // Freed objects, each one's first 8 bytes point to the next
+  UINT32                Magic;      // SLAB_MAGIC, for catching bad pointers passed to free()
+  UINT16                Class;      // Index into the size class table
+  UINT16                ObjectSize;
+  UINT16                Capacity;   // Objects that fit in this slab
+  UINT16                Unused;     // Objects from the end of the slab that have never been handed out
+  UINT16                InUse;      // Objects handed out (includes ones sitting in per-CPU magazines)
+} __attribute__((aligned(64))) SLAB_HEADER; // 64 bytes, so objects after it stay 64-byte aligned
+
+// Per-CPU cache of free objects for one size class, so most small allocations and frees never touch a slab
+typedef struct {
+  UINT64                Count;
+  void                 *Objects[SLAB_MAGAZINE_SIZE];
+} SLAB_MAGAZINE;
+
 // For printf
 typedef struct {
 	EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE  defaultGPU;       // Default EFI GOP output device from GPUArray (should be GPUArray[0] if there's only 1)
@@ -452,6 +654,209 @@ typedef struct {
   UINT32                             textscrollmode;   // What to do when a newline goes off the bottom of the screen: 0 = scroll entire screen, 1 = wrap around to the top
 } GLOBAL_PRINT_INFO_STRUCT;
 
+// Shadow framebuffers, see Setup_Shadow_Framebuffers() in Display.c
+#define MAX_SHADOW_FRAMEBUFFERS 8
+
+// A RAM copy of one GPU framebuffer. Its Base replaces FrameBufferBase in the GPU's GPUArray entry (and in Global_Print_Info if that's
+// the same GPU), so everything in Display.c draws into RAM. Changed areas are written out by Shadow_Flush().
+typedef struct {
+  EFI_PHYSICAL_ADDRESS               Hardware_Base;  // The real framebuffer
+  EFI_PHYSICAL_ADDRESS               Buffer;         // Start of the RAM buffer, which is two screens tall so that scrolling can move Base
+  UINT64                             Buffer_Size;    // In bytes
+  EFI_PHYSICAL_ADDRESS               Base;           // Top left pixel of the screen in Buffer, i.e. the shadowed FrameBufferBase
+  EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE *GPU_Entry;      // The GPUArray entry being shadowed
+  UINT32                             Pitch;          // PixelsPerScanLine
+  UINT32                             Width;          // HorizontalResolution
+  UINT32                             Height;         // VerticalResolution
+  UINT32                             Dirty;          // 1 if the rectangle below hasn't been flushed yet
+  UINT32                             Dirty_Left;
+  UINT32                             Dirty_Top;
+  UINT32                             Dirty_Right;    // Exclusive
+  UINT32                             Dirty_Bottom;   // Exclusive
+} SHADOW_FRAMEBUFFER_STRUCT;
+
+// A screen that shows a copy of a shadowed screen, see Setup_Mirror_Heads() in Display.c
+#define MIRROR_COPY           0 // Same pixel format
+#define MIRROR_SWAP_RED_BLUE  1 // RGB <-> BGR
+#define MIRROR_BITMASK        2 // Anything else, channel by channel
+
+typedef struct {
+  EFI_PHYSICAL_ADDRESS               Hardware_Base;  // The mirror's framebuffer
+  EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE *GPU_Entry;      // The mirror's GPUArray entry
+  UINT32                            *Column_Map;     // Source column for each of the mirror's columns, NULL if not Scaled
+  UINT32                             Pitch;          // PixelsPerScanLine
+  UINT32                             Width;          // HorizontalResolution
+  UINT32                             Height;         // VerticalResolution
+  UINT32                             Scaled;         // 1 if the resolution differs from the source's
+  UINT32                             Conversion;     // MIRROR_COPY, MIRROR_SWAP_RED_BLUE, or MIRROR_BITMASK
+  UINT8                              Source_Shift[3]; // Red, green, blue bit positions in a source pixel
+  UINT8                              Source_Bits[3];  // ...and their widths
+  UINT8                              Dest_Shift[3];   // Same for a mirror pixel
+  UINT8                              Dest_Bits[3];
+} MIRROR_HEAD_STRUCT;
+
+typedef struct {
+  UINT64                             Count;
+  SHADOW_FRAMEBUFFER_STRUCT          Framebuffers[MAX_SHADOW_FRAMEBUFFERS];
+  UINT64                             Mirror_Source;  // Index in Framebuffers of the screen that the mirrors copy
+  UINT64                             Mirror_Count;
+  MIRROR_HEAD_STRUCT                 Mirrors[MAX_SHADOW_FRAMEBUFFERS];
+} GLOBAL_SHADOW_INFO_STRUCT;
+
+// A prepared drawing target for Render_Text_Span() and the other Render_ functions, see Render_Target_Init() in Display.c
+typedef struct {
+  UINT32                            *Base;           // Top left pixel, i.e. FrameBufferBase (or its shadow) when this was set up
+  UINT64                             Pitch;          // PixelsPerScanLine
+  UINT32                             Width;          // HorizontalResolution
+  UINT32                             Height;         // VerticalResolution
+  EFI_GRAPHICS_PIXEL_FORMAT          PixelFormat;
+  const EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE *GPU;      // Where the above came from, for Shadow_Mark_Dirty()
+} RENDER_TARGET;
+
+// Deferred console for printf, see Console.c
+#define CONSOLE_RING_SIZE (1 << 16) // Bytes, must be a power of 2
+#define CONSOLE_CHUNK_SIZE 256      // Longest record; longer printf() output is split into several
+
+// Where queued text goes, see Console_Set_Sinks()
+#define CONSOLE_SINK_FRAMEBUFFER 0x1
+#define CONSOLE_SINK_SERIAL      0x2
+
+typedef struct {
+  volatile UINT64                    Deferred;         // 1 = printf() queues text here, 0 = printf() draws immediately
+  volatile UINT64                    Head;             // Bytes reserved by writers so far (the next record goes at Head & (CONSOLE_RING_SIZE - 1))
+  volatile UINT64                    Tail;             // Bytes drawn and freed so far
+  volatile UINT64                    Drawing;          // 1 while a CPU is drawing queued text
+  volatile UINT64                    Dropped;          // Bytes of text lost to a full ring
+  UINT64                             Dropped_Reported; // Dropped as of the last "bytes dropped" message
+  UINT64                             Renderer_CPU;     // AP running Console_Start_Renderer()'s loop, 0 if none
+  volatile UINT64                    Sinks;            // CONSOLE_SINK_* bits
+  UINT8                              Ring[CONSOLE_RING_SIZE]; // Records: a UINT32 header (length | ready bit) and then the text, 4-byte aligned
+} __attribute__((aligned(64))) GLOBAL_CONSOLE_STRUCT;
+
+// Serial console, see Serial.c
+#define SERIAL_RING_SIZE (1 << 16) // Bytes, must be a power of 2
+#define SERIAL_VECTOR 0x24         // IDT vector the UART's IRQ gets routed to
+
+typedef struct {
+  UINT64                             Port;             // 16550 I/O base, 0 = no serial console
+  UINT64                             IRQ;              // ISA IRQ (4 for COM1 and COM3, 3 for COM2 and COM4)
+  UINT64                             FIFO_Size;        // Bytes that can be written per THR-empty, 1 for a UART without a working FIFO
+  volatile UINT64                    Interrupts;       // 1 once THR-empty interrupts refill the FIFO, 0 = only Serial_Write() and Serial_Poll() do
+  volatile UINT64                    Polled;           // 1 after Serial_Panic(): Serial_Write() waits for its text to go out
+  volatile UINT64                    Head;             // Bytes queued so far (the next byte goes at Head & (SERIAL_RING_SIZE - 1))
+  volatile UINT64                    Tail;             // Bytes written to the UART so far
+  volatile UINT64                    Sending;          // 1 while a CPU is filling the FIFO
+  volatile UINT64                    Dropped;          // Bytes lost to a full ring
+  UINT8                              Ring[SERIAL_RING_SIZE];
+} __attribute__((aligned(64))) GLOBAL_SERIAL_STRUCT;
+
+// TSC clocksource, see Clock.c
+#define CLOCK_SOURCE_GUESS    0   // Nothing to go by, 5000 MHz is assumed (too high just makes delays too long)
+#define CLOCK_SOURCE_CPUID_15 1   // Exact, from the crystal frequency and the TSC/crystal ratio
+#define CLOCK_SOURCE_HPET     2   // Calibrated against the HPET
+#define CLOCK_SOURCE_PM_TIMER 3   // Calibrated against the ACPI PM timer
+#define CLOCK_SOURCE_CPUID_16 4   // Base frequency, which is the TSC frequency to within a fraction of a percent
+
+#define CLOCK_SHIFT 32            // Fractional bits in the multipliers below
+
+typedef struct {
+  UINT64                             Source;           // CLOCK_SOURCE_*
+  UINT64                             TSC_Hz;
+  UINT64                             Invariant;        // 1 if the TSC runs at a constant rate in every P-, C-, and T-state
+  UINT64                             Base_TSC;         // now_ns() counts from here
+  UINT64                             NS_Mult;          // ns = (ticks * NS_Mult) >> CLOCK_SHIFT
+  UINT64                             Tick_Mult;        // ticks = (ns * Tick_Mult) >> CLOCK_SHIFT
+} GLOBAL_CLOCK_STRUCT;
+
+// Local APIC timer and timer wheel, see Timer.c
+#define TIMER_VECTOR 0x20         // IDT vector for the BSP's local APIC timer
+#define TIMER_TICK_US 1000        // Wheel resolution
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS 4      // Reach is TIMER_WHEEL_SLOTS^TIMER_WHEEL_LEVELS ticks, later timers get re-placed as they come closer
+
+#define TIMER_MODE_NONE         0 // No timer interrupts, Timer_Sleep_us() spins
+#define TIMER_MODE_TSC_DEADLINE 1
+#define TIMER_MODE_ONE_SHOT     2
+
+typedef struct TIMER_LINK {
+  struct TIMER_LINK                 *Next;
+  struct TIMER_LINK                 *Prev;
+} TIMER_LINK;
+
+typedef struct {
+  TIMER_LINK                         Link;             // Must be first; Next is NULL while not armed
+  UINT64                             Expires;          // Tick it's due on
+  UINT64                             Period;           // Ticks between expiries, 0 = one-shot
+  void                             (*Function)(void * arg); // Called on the BSP in interrupt context
+  void                              *Argument;
+} TIMER;
+
+typedef struct {
+  UINT64                             Mode;             // TIMER_MODE_*
+  UINT64                             TSC_Per_Tick;
+  UINT64                             LAPIC_Per_Tick;   // Local APIC timer counts per tick at divide-by-1, for one-shot mode
+  UINT64                             Base_TSC;         // TSC at tick 0
+  UINT64                             Wheel_Tick;       // Next tick to handle
+  UINT64                             Armed;            // Timers in the wheel
+  TICKET_LOCK                        Lock;             // Taken with interrupts off, see timer_lock()
+  TIMER_LINK                         Slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS]; // Circular lists, each slot is its own list head
+} __attribute__((aligned(64))) GLOBAL_TIMER_STRUCT;
+
+// Performance counters, see PMU.c
+#define PMU_VECTOR 0x21           // IDT vector for counter overflow interrupts (sampling)
+
+#define PMU_VENDOR_NONE  0        // No usable performance counters
+#define PMU_VENDOR_INTEL 1
+#define PMU_VENDOR_AMD   2
+
+// Named events for PMU_Begin() and PMU_Start_Sampling()
+#define PMU_EVENT_CYCLES        0 // Core cycles while not halted
+#define PMU_EVENT_INSTRUCTIONS  1 // Instructions retired
+#define PMU_EVENT_LLC_MISSES    2 // Last level cache misses (Intel only; AMD's L3 has its own PMU)
+#define PMU_EVENT_BRANCH_MISSES 3 // Mispredicted branches retired
+#define PMU_EVENT_DTLB_MISSES   4 // Data TLB misses that needed a page walk (model-specific: Intel family 6, AMD family 17h+)
+#define PMU_EVENTS              5
+
+#define PMU_MAX_EVENTS     8      // Events per PMU_MEASUREMENT
+#define PMU_MAX_GP         16     // General purpose counters used at most
+#define PMU_COUNTER_FIXED  32     // Counter numbers at or above this are Intel fixed counters (matches IA32_PERF_GLOBAL_CTRL)
+#define PMU_COUNTER_NONE   0xFF   // Event didn't get a counter
+
+typedef struct {
+  UINT64                             Vendor;           // PMU_VENDOR_*
+  UINT64                             Version;          // Intel architectural PMU version, 2 for AMD PerfMonV2, 1 for older AMD
+  UINT64                             Family;           // CPU family, for the model-specific events
+  UINT64                             GP_Counters;      // General purpose counters
+  UINT64                             GP_Mask;          // Counter width as a mask
+  UINT64                             Fixed_Counters;   // Intel fixed counters
+  UINT64                             Fixed_Mask;
+  UINT64                             Arch_Events;      // Intel architectural events that exist, as CPUID 0xA bits (set = available)
+  UINT64                             Global_Ctrl;      // 1 if there's a global enable MSR (Intel v2+, AMD PerfMonV2)
+  UINT64                             AMD_Core_Ext;     // 1 if AMD's PerfCtrExtCore MSRs (0xC0010200+) are there
+
+  volatile UINT64                    Sample_Active;    // 1 between PMU_Start_Sampling() and PMU_Stop_Sampling()
+  UINT64                             Sample_CPU;       // CPU index doing the sampling
+  UINT64                             Sample_Counter;
+  UINT64                             Sample_Period;    // Events per sample
+  UINT64                            *Sample_Buffer;    // Interrupted %rip for each sample
+  UINT64                             Sample_Capacity;
+  volatile UINT64                    Sample_Count;
+  volatile UINT64                    Sample_Dropped;   // Samples that didn't fit
+} GLOBAL_PMU_STRUCT;
+
+// One begin/end measurement on one CPU, see PMU_Begin()
+typedef struct {
+  UINT64                             Count;            // Events in the arrays below
+  UINT64                             CPU;              // CPU index it was started on, and has to end on
+  UINT64                             Event[PMU_MAX_EVENTS];   // PMU_EVENT_*
+  UINT64                             Counter[PMU_MAX_EVENTS]; // Counter used, PMU_COUNTER_NONE if the event isn't being counted
+  UINT64                             Start[PMU_MAX_EVENTS];
+  UINT64                             Value[PMU_MAX_EVENTS];   // Events counted, set by PMU_End()
+  UINT64                             Start_TSC;
+  UINT64                             TSC;              // TSC ticks between PMU_Begin() and PMU_End()
+} PMU_MEASUREMENT;
+
 // Intel Architecture Manual Vol. 3A, Fig. 3-11 (Pseudo-Descriptor Formats)
 typedef struct __attribute__ ((packed)) {
   UINT16 Limit; // Limit + 1 = size, since limit + base = the last valid address
@@ -581,12 +986,369 @@ typedef struct __attribute__((packed)) {
   uint64_t          Entry[1]; // Size of XSDT is determined by "Length," and each entry is 8 bytes
 } XSDT_STRUCT; // Signature is "XSDT"
 
+typedef struct __attribute__((packed)) {
+  SDT_HEADER_STRUCT SDTHeader;
+  uint32_t          Entry[1]; // Size of RSDT is determined by "Length," and each entry is 4 bytes
+} RSDT_STRUCT; // Signature is "RSDT"
+
+// ACPI Specification 6.2A, section 5.2.12 (Multiple APIC Description Table (MADT))
+typedef struct __attribute__((packed)) {
+  SDT_HEADER_STRUCT SDTHeader;
+  uint32_t          LocalApicAddress; // 32-bit xAPIC MMIO base (IA32_APIC_BASE MSR has the real one)
+  uint32_t          Flags; // Bit 0: PCAT_COMPAT (system also has dual 8259s)
+} MADT_STRUCT; // Signature is "APIC", variable-length interrupt controller structures follow up to "Length"
+
+typedef struct __attribute__((packed)) {
+  uint8_t   Type;
+  uint8_t   Length;
+} MADT_ENTRY_HEADER_STRUCT; // Common to all interrupt controller structures
+
+typedef struct __attribute__((packed)) {
+  uint8_t   Type; // 0
+  uint8_t   Length; // 8
+  uint8_t   ACPIProcessorUID;
+  uint8_t   APICID;
+  uint32_t  Flags; // Bit 0: Enabled, Bit 1: Online Capable
+} MADT_LOCAL_APIC_STRUCT;
+
+typedef struct __attribute__((packed)) {
+  uint8_t   Type; // 9
+  uint8_t   Length; // 16
+  uint16_t  Reserved;
+  uint32_t  X2APICID;
+  uint32_t  Flags; // Same as MADT_LOCAL_APIC_STRUCT
+  uint32_t  ACPIProcessorUID;
+} MADT_LOCAL_X2APIC_STRUCT;
+
+typedef struct __attribute__((packed)) {
+  uint8_t   Type; // 1
+  uint8_t   Length; // 12
+  uint8_t   IOAPICID;
+  uint8_t   Reserved;
+  uint32_t  IOAPICAddress; // MMIO base
+  uint32_t  GlobalSystemInterruptBase; // GSI of this I/O APIC's first redirection entry
+} MADT_IO_APIC_STRUCT;
+
+typedef struct __attribute__((packed)) {
+  uint8_t   Type; // 2
+  uint8_t   Length; // 10
+  uint8_t   Bus; // 0 = ISA
+  uint8_t   Source; // ISA IRQ
+  uint32_t  GlobalSystemInterrupt; // What the IRQ is actually wired to
+  uint16_t  Flags; // Bits 1:0: polarity (00 = bus default, 01 = active high, 11 = active low), bits 3:2: trigger mode (same, edge/level)
+} MADT_INTERRUPT_SOURCE_OVERRIDE_STRUCT;
+
+// ACPI Specification 6.2A, section 5.2.3.2 (Generic Address Structure (GAS))
+typedef struct __attribute__((packed)) {
+  uint8_t   AddressSpaceID; // 0 = memory, 1 = I/O port
+  uint8_t   RegisterBitWidth;
+  uint8_t   RegisterBitOffset;
+  uint8_t   AccessSize;
+  uint64_t  Address;
+} ACPI_GAS_STRUCT;
+
+// IA-PC HPET Specification 1.0a, section 3.2.4 (The ACPI 2.0 HPET Description Table (HPET))
+typedef struct __attribute__((packed)) {
+  SDT_HEADER_STRUCT SDTHeader;
+  uint32_t          EventTimerBlockID;
+  ACPI_GAS_STRUCT   BaseAddress; // Always memory space
+  uint8_t           HPETNumber;
+  uint16_t          MinimumTick;
+  uint8_t           PageProtection;
+} HPET_TABLE_STRUCT; // Signature is "HPET"
+
+// ACPI Specification 6.2A, section 5.2.16 (System Resource Affinity Table (SRAT)). Entries follow this header, and start with the
+// same type and length bytes as MADT entries.
+typedef struct __attribute__((packed)) {
+  SDT_HEADER_STRUCT SDTHeader;
+  uint32_t          Reserved1; // Must be 1
+  uint64_t          Reserved2;
+} SRAT_STRUCT; // Signature is "SRAT"
+
+// Type 0
+typedef struct __attribute__((packed)) {
+  uint8_t   Type;
+  uint8_t   Length; // 16
+  uint8_t   ProximityDomainLow;
+  uint8_t   APICID;
+  uint32_t  Flags; // Bit 0 = enabled
+  uint8_t   LocalSAPICEID;
+  uint8_t   ProximityDomainHigh[3];
+  uint32_t  ClockDomain;
+} SRAT_LOCAL_APIC_AFFINITY_STRUCT;
+
+// Type 1
+typedef struct __attribute__((packed)) {
+  uint8_t   Type;
+  uint8_t   Length; // 40
+  uint32_t  ProximityDomain;
+  uint16_t  Reserved1;
+  uint64_t  BaseAddress;
+  uint64_t  RangeLength;
+  uint32_t  Reserved2;
+  uint32_t  Flags; // Bit 0 = enabled, bit 1 = hot-pluggable, bit 2 = non-volatile
+  uint64_t  Reserved3;
+} SRAT_MEMORY_AFFINITY_STRUCT;
+
+// Type 2
+typedef struct __attribute__((packed)) {
+  uint8_t   Type;
+  uint8_t   Length; // 24
+  uint16_t  Reserved1;
+  uint32_t  ProximityDomain;
+  uint32_t  X2APICID;
+  uint32_t  Flags; // Bit 0 = enabled
+  uint32_t  ClockDomain;
+  uint32_t  Reserved2;
+} SRAT_LOCAL_X2APIC_AFFINITY_STRUCT;
+
+// ACPI Specification 6.2A, section 5.2.17 (System Locality Information Table (SLIT))
+typedef struct __attribute__((packed)) {
+  SDT_HEADER_STRUCT SDTHeader;
+  uint64_t          Localities;
+  uint8_t           Entry[1]; // Localities x Localities distances, row = from, column = to, in proximity domain order. 10 = local.
+} SLIT_STRUCT; // Signature is "SLIT"
+
+// FADT fields used by Setup_Clock() (ACPI Specification 6.2A, section 5.2.9), as byte offsets since only a few are needed
+#define FADT_PM_TMR_BLK   76  // uint32_t, I/O port of the ACPI PM timer
+#define FADT_FLAGS        112 // uint32_t
+#define FADT_X_PM_TMR_BLK 208 // ACPI_GAS_STRUCT, ACPI 2.0+
+
+#define FADT_FLAG_TMR_VAL_EXT      (1 << 8)  // PM timer is 32 bits instead of 24
+#define FADT_FLAG_HW_REDUCED_ACPI  (1 << 20) // No PM timer
+
+// For ACPI table lookup in ACPI.c
+typedef struct {
+  RSDP_20_STRUCT *RSDP;     // RSDP_10_Section is always valid, the rest only if RSDP_10_Section.Revision >= 2
+  XSDT_STRUCT    *XSDT;     // NULL if there's only an RSDT (ACPI 1.0)
+  RSDT_STRUCT    *RSDT;     // Only used if XSDT is NULL
+  UINT64          Revision; // 1 for ACPI 1.0 (RSDT), 2 for ACPI 2.0+ (XSDT)
+} GLOBAL_ACPI_INFO_STRUCT;
+
+// NUMA topology from the SRAT and SLIT, see NUMA.c
+#define NUMA_MAX_NODES  16
+#define NUMA_MAX_RANGES 64
+#define NUMA_MAX_CPUS   256
+#define NUMA_NO_NODE    ~0ULL
+
+// Where a CPU's page allocations come from, see NUMA_Set_Policy()
+#define NUMA_POLICY_LOCAL      0 // This CPU's node first, then the closest ones
+#define NUMA_POLICY_INTERLEAVE 1 // Each allocation from the next node in turn
+
+typedef struct {
+  UINT64                  Base;
+  UINT64                  End;                   // Exclusive
+  UINT64                  Node;
+} NUMA_RANGE;
+
+typedef struct {
+  UINT64                  Nodes;                 // Always at least 1
+  UINT32                  Domain[NUMA_MAX_NODES]; // ACPI proximity domain of each node
+  UINT8                   Distance[NUMA_MAX_NODES][NUMA_MAX_NODES]; // SLIT distances, 10 = local
+  UINT8                   Fallback[NUMA_MAX_NODES][NUMA_MAX_NODES]; // Each node's nodes from closest to farthest, itself first
+  UINT64                  Range_Count;           // 0 without an SRAT
+  NUMA_RANGE              Ranges[NUMA_MAX_RANGES]; // Sorted by Base, not overlapping
+  UINT64                  CPU_Count;
+  UINT32                  CPU_APIC_ID[NUMA_MAX_CPUS];
+  UINT8                   CPU_Node[NUMA_MAX_CPUS];
+  volatile UINT64         Interleave_Next;       // For NUMA_POLICY_INTERLEAVE
+} GLOBAL_NUMA_STRUCT;
+
+// SMP Structures
+// Max number of logical CPUs (BSP included) that Setup_SMP() will start
+#define MAX_CPUS 64
+
+// Interrupt stats, see ISR_Stats.c. Set ISR_STATS to 0 (e.g. with -DISR_STATS=0, which ISR.S needs to see too) to take the timing out
+// of the ISR.S entry stubs.
+#ifndef ISR_STATS
+#define ISR_STATS 1
+#endif
+
+// Handler times go in power-of-2 buckets of TSC ticks: bucket n counts times in [2^n, 2^(n+1)), and the last one everything longer
+#define ISR_STAT_BUCKETS 26
+
+// One per vector per CPU
+typedef struct {
+  UINT64                  Count;
+  UINT64                  Total_Cycles;          // TSC ticks from the ISR.S stub calling the handler to the handler returning
+  UINT64                  Max_Cycles;
+  UINT32                  Histogram[ISR_STAT_BUCKETS];
+} __attribute__((aligned(64))) ISR_STAT;
+
+typedef struct {
+  volatile UINT64         Enabled;               // ISR_Stats_Record() does nothing when this is 0
+  UINT64                  Start_TSC;             // When counting started, for rates
+  ISR_STAT               *Stats;                 // 256 per CPU, in CPU index order
+} GLOBAL_ISR_STATS_STRUCT;
+
+// What User_ISR_handler() saves extended state with
+#define ISR_XSAVE    0
+#define ISR_XSAVEOPT 1
+#define ISR_XSAVES   2
+
+// One per logical CPU, each CPU's IA32_GS_BASE points to its own, and %gs:0 holds the Self pointer. See SMP.c.
+typedef struct _PER_CPU_STRUCT {
+  struct _PER_CPU_STRUCT *Self;                  // Must be first, as get_cpu_data() reads it from %gs:0
+  UINT64                  CPU_Index;             // Index into Global_Per_CPU_Data; 0 is always the BSP
+  UINT32                  APIC_ID;               // Local APIC ID (x2APIC ID in x2APIC mode)
+  UINT32                  ACPI_UID;              // ACPI processor UID from the MADT
+  volatile UINT64         Online;                // Set to 1 by the CPU itself once it's running in the kernel
+  UINT64                  Stack_Top;             // Initial %rsp
+
+  // Work mailbox, see SMP_Run_On_CPU()
+  void          (* volatile Work_Function)(void * arg);
+  void           * volatile Work_Argument;
+  volatile UINT64         Work_Sequence;         // Goes up by 2 each time work is posted, and is odd while a post is in progress
+  volatile UINT64         Work_Done;             // Set to Work_Sequence once the posted work has finished
+
+  UINT64                  GDT[5];                // Copy of MinimalGDT with this CPU's TSS base patched in (unused by the BSP)
+  TSS64_STRUCT            TSS;                   // This CPU's TSS with its own IST stacks (unused by the BSP)
+
+  SLAB_MAGAZINE           Slab_Magazines[SLAB_CLASSES]; // See SlabAllocate() in Memory.c
+
+  UINT8                  *ISR_XSave_Area;        // Where User_ISR_handler() saves extended state, see Setup_ISR_XSave()
+  UINT64                  ISR_XSave_Instruction; // ISR_XSAVE, ISR_XSAVEOPT, or ISR_XSAVES
+  ISR_STAT               *ISR_Stats;             // This CPU's 256 vectors in Global_ISR_Stats.Stats
+  UINT64                  PMU_Counters_Used;     // Bit n = counter n is taken, see PMU_Begin()
+  volatile UINT64         TLB_Shootdown;         // Set when another CPU needs this one to flush its TLB, see VMM_Shootdown_NMI()
+  UINT64                  NUMA_Node;             // This CPU's node, see NUMA.c
+  UINT64                  NUMA_Policy;           // NUMA_POLICY_LOCAL or NUMA_POLICY_INTERLEAVE, see NUMA_Set_Policy()
+  UINT8                  *PF_XSave_Area;         // Where PF_EXC_handler() saves extended state, see Setup_ISR_XSave()
+} __attribute__((aligned(64))) PER_CPU_STRUCT;
+
+// System-wide SMP info. The BSP_ values are captured once by Setup_SMP() and copied by each AP in AP_Main().
+typedef struct {
+  UINT64                  Number_of_CPUs;        // Logical CPUs that have a Global_Per_CPU_Data entry (BSP included)
+  volatile UINT64         Online_CPUs;           // Logical CPUs currently running (BSP included)
+  UINT64                  BSP_APIC_ID;
+  UINT64                  x2APIC;                // 1 = local APICs are in x2APIC (MSR) mode, 0 = xAPIC (MMIO) mode
+  UINT64                  LAPIC_Base;            // xAPIC MMIO base, unused in x2APIC mode
+  UINT64                  BSP_CR0;
+  UINT64                  BSP_CR3;
+  UINT64                  BSP_CR4;
+  UINT64                  BSP_EFER;
+  UINT64                  BSP_XCR0;
+  UINT64                  BSP_PAT;               // IA32_PAT as programmed by Setup_Paging()
+  DT_STRUCT               BSP_IDTR;              // All CPUs share this IDT
+  UINT64                  TSC_MHz;               // TSC frequency found by Setup_Clock(), rounded to the nearest MHz
+} GLOBAL_SMP_INFO_STRUCT;
+
+// Cooperative tasks, see Task.c
+typedef struct _TASK {
+  struct _TASK           *Next;                  // Run queue link
+  UINT64                  RSP;                   // Saved stack pointer while switched out
+  void                  (*Function)(void * arg);
+  void                   *Argument;
+  UINT64                  Pages;                 // Size of the malloc4k() block this heads (TASK, XSAVE area, stack), 0 for boot tasks
+  volatile UINT64         State;
+  volatile UINT64         Done;                  // Set once the task has finished and its stack is free, see Task_Join()
+  UINT64                  CPU;                   // CPU it last ran on
+  UINT8                  *XSave_Area;            // 64-byte aligned
+} __attribute__((aligned(64))) TASK;
+
+typedef struct {
+  volatile UINT64         Lock;
+  TASK                   *Head;                  // Ready tasks, oldest first
+  TASK                   *Tail;
+  volatile UINT64         Count;
+  TASK                   *Current;               // Running on this CPU, NULL if this CPU doesn't run tasks
+  TASK                   *Previous;              // Just switched away from, until the next task has finished switching in
+  TASK                    Boot_Task;             // Whatever this CPU was running before its first switch
+} __attribute__((aligned(64))) TASK_QUEUE;
+
+typedef struct {
+  volatile UINT64         Ready;                 // 1 once Setup_Scheduler() has run
+  UINT64                  XSave_Size;            // Bytes per XSAVE area, a multiple of 64
+  UINT64                  XSave_Instruction;     // What saves extended state on a switch (XSAVE, XSAVEOPT, or XSAVEC)
+  volatile UINT64         Queued;                // Tasks queued so far, what idle workers watch with MONITOR/MWAIT
+  TASK_QUEUE              Queues[MAX_CPUS];      // Indexed like Global_Per_CPU_Data
+} GLOBAL_SCHEDULER_STRUCT;
+
+// Layout of the data block at the end of the AP startup trampoline (startup/AP_Trampoline.S)
+typedef struct __attribute__((packed)) {
+  UINT64 GDT[3];          // Null, code, data
+  UINT16 GDTR_Limit;
+  UINT32 GDTR_Base;       // Linear address of GDT above
+  UINT16 Pad0;
+  UINT32 LongMode_Offset; // Linear address of AP_Trampoline_LongMode
+  UINT16 LongMode_Selector;
+  UINT16 Pad1;
+  UINT32 CR3;             // Outermost page table copy, must be below 4GB
+  UINT32 CR4;
+  UINT32 EFER;
+  UINT32 CR0;
+  UINT64 Stack;           // Initial %rsp for the AP
+  UINT64 Argument;        // Passed to Entry in %rdi
+  UINT64 Entry;           // 64-bit C entry point
+} AP_TRAMPOLINE_DATA_STRUCT;
+
+// Trace Structures
+// Events recorded by TRACE_BEGIN/TRACE_END/TRACE_MARK, see Trace.c. Must be a power of 2.
+#define TRACE_RING_SIZE 1024
+
+#define TRACE_EVENT_BEGIN 0
+#define TRACE_EVENT_END   1
+#define TRACE_EVENT_MARK  2
+
+typedef struct {
+  const char *            Name;                  // Must stay valid until printed, so normally a string literal
+  UINT64                  TSC;                   // From RDTSCP
+  UINT32                  CPU;                   // IA32_TSC_AUX, which holds the CPU index once Setup_Per_CPU_Data()/AP_Main() have run
+  UINT32                  Type;                  // TRACE_EVENT_*
+} TRACE_EVENT;
+
+typedef struct {
+  volatile UINT64         Enabled;               // Probes do nothing when this is 0
+  volatile UINT64         Next;                  // Total events recorded so far; the slot of the next one is Next & (TRACE_RING_SIZE - 1)
+  TRACE_EVENT             Events[TRACE_RING_SIZE];
+} __attribute__((aligned(64))) GLOBAL_TRACE_STRUCT;
+
+// Set TRACE_PROBES to 0 (e.g. with -DTRACE_PROBES=0) to compile all probes out. Otherwise a probe with tracing disabled at runtime is
+// just a load and a not-taken branch.
+#ifndef TRACE_PROBES
+#define TRACE_PROBES 1
+#endif
+
+#if TRACE_PROBES
+#define TRACE_BEGIN(name) do { if(__builtin_expect(Global_Trace.Enabled, 0)) { Trace_Event(name, TRACE_EVENT_BEGIN); } } while(0)
+#define TRACE_END(name)   do { if(__builtin_expect(Global_Trace.Enabled, 0)) { Trace_Event(name, TRACE_EVENT_END); } } while(0)
+#define TRACE_MARK(name)  do { if(__builtin_expect(Global_Trace.Enabled, 0)) { Trace_Event(name, TRACE_EVENT_MARK); } } while(0)
+#else
+#define TRACE_BEGIN(name) do { } while(0)
+#define TRACE_END(name)   do { } while(0)
+#define TRACE_MARK(name)  do { } while(0)
+#endif
+
+// PAT entries set up by Setup_Paging(), for Set_Memory_Type()
+#define PAT_WB        0
+#define PAT_WT        1
+#define PAT_UC_MINUS  2
+#define PAT_UC        3
+#define PAT_WC        4
+
 //----------------------------------------------------------------------------------------------------------------------------------
 // Global Variables
 //----------------------------------------------------------------------------------------------------------------------------------
 
 extern GLOBAL_MEMORY_INFO_STRUCT Global_Memory_Info;
+extern GLOBAL_VMM_STRUCT Global_VMM;
+extern GLOBAL_VMALLOC_STRUCT Global_Vmalloc;
+extern GLOBAL_NUMA_STRUCT Global_NUMA;
+extern GLOBAL_KERNEL_OPTIONS_STRUCT Global_Kernel_Options;
+extern BENCHMARK_RESULTS * Global_Benchmark_Results;
 extern GLOBAL_PRINT_INFO_STRUCT Global_Print_Info;
+extern GLOBAL_SHADOW_INFO_STRUCT Global_Shadow_Info;
+extern GLOBAL_CONSOLE_STRUCT Global_Console;
+extern GLOBAL_SERIAL_STRUCT Global_Serial;
+extern GLOBAL_CLOCK_STRUCT Global_Clock;
+extern GLOBAL_TIMER_STRUCT Global_Timer;
+extern GLOBAL_PMU_STRUCT Global_PMU;
+extern GLOBAL_SCHEDULER_STRUCT Global_Scheduler;
+extern GLOBAL_ACPI_INFO_STRUCT Global_ACPI_Info;
+extern GLOBAL_SMP_INFO_STRUCT Global_SMP_Info;
+extern PER_CPU_STRUCT Global_Per_CPU_Data[MAX_CPUS];
+extern GLOBAL_TRACE_STRUCT Global_Trace;
+extern GLOBAL_ISR_STATS_STRUCT Global_ISR_Stats;
 
 // Because kernel_main() is a naked function and can't have local variables that would require stack space...
 extern unsigned char swapped_image[];
@@ -602,6 +1364,7 @@ extern char Manufacturer_ID[];
 
 // Initialization-related functions (System.c)
 void System_Init(LOADER_PARAMS * LP);
+void Parse_Kernel_Options(LOADER_PARAMS * LP);
 
 uint64_t get_tick(void);
 void HaCF(void); // Note: this is at the very bottom of System.c
@@ -612,8 +1375,8 @@ uint8_t Hypervisor_check(void);
 uint8_t read_perfs_initial(uint64_t * perfs);
 uint64_t get_CPU_freq(uint64_t * perfs, uint8_t avg_or_measure);
 
-uint32_t portio_rw(uint16_t port_address, uint32_t data, int size, int rw);
-uint64_t msr_rw(uint64_t msr, uint64_t data, int rw);
+ISR_GPR_ONLY uint32_t portio_rw(uint16_t port_address, uint32_t data, int size, int rw);
+ISR_GPR_ONLY uint64_t msr_rw(uint64_t msr, uint64_t data, int rw);
 uint32_t vmxcsr_rw(uint32_t data, int rw);
 uint32_t mxcsr_rw(uint32_t data, int rw);
 uint64_t control_register_rw(int crX, uint64_t in_out, int rw);
@@ -631,7 +1394,9 @@ void set_tsr(uint16_t tsr_data);
 
 void Setup_MinimalGDT(void);
 void Setup_IDT(void);
-void Setup_Paging(void);
+uint8_t Setup_ISR_XSave(void);
+void Setup_Paging(LOADER_PARAMS * LP);
+void Set_Memory_Type(EFI_PHYSICAL_ADDRESS base, uint64_t size, uint64_t pat_index);
 
 char * Get_Brandstring(uint32_t * brandstring); // "brandstring" must be a 48-byte array
 char * Get_Manufacturer_ID(char * Manufacturer_ID); // "Manufacturer_ID" must be a 13-byte array
@@ -639,6 +1404,7 @@ void cpu_features(uint64_t rax_value, uint64_t rcx_value);
 
  // For interrupt handling
 void User_ISR_handler(INTERRUPT_FRAME * i_frame);
+ISR_GPR_ONLY void Fast_ISR_handler(FAST_INTERRUPT_FRAME * i_frame);
 void CPU_ISR_handler(INTERRUPT_FRAME * i_frame);
 void CPU_EXC_handler(EXCEPTION_FRAME * e_frame);
 
@@ -685,6 +1451,31 @@ void Print_All_CRs_and_Some_Major_CPU_Features(void);
 void Print_Loader_Params(LOADER_PARAMS * LP);
 void Print_Segment_Registers(void);
 
+// Synchronization functions (Sync.c)
+void Ticket_Lock(TICKET_LOCK * lock);
+uint8_t Ticket_Trylock(TICKET_LOCK * lock);
+void Ticket_Unlock(TICKET_LOCK * lock);
+uint64_t Ticket_Lock_IRQ_Save(TICKET_LOCK * lock);
+void Ticket_Unlock_IRQ_Restore(TICKET_LOCK * lock, uint64_t rflags);
+
+void MCS_Lock(MCS_LOCK * lock, MCS_NODE * node);
+uint8_t MCS_Trylock(MCS_LOCK * lock, MCS_NODE * node);
+void MCS_Unlock(MCS_LOCK * lock, MCS_NODE * node);
+uint64_t MCS_Lock_IRQ_Save(MCS_LOCK * lock, MCS_NODE * node);
+void MCS_Unlock_IRQ_Restore(MCS_LOCK * lock, MCS_NODE * node, uint64_t rflags);
+
+uint64_t Seqlock_Read_Begin(SEQLOCK * lock);
+uint8_t Seqlock_Read_Retry(SEQLOCK * lock, uint64_t start);
+void Seqlock_Write_Begin(SEQLOCK * lock);
+void Seqlock_Write_End(SEQLOCK * lock);
+uint64_t Seqlock_Write_Begin_IRQ_Save(SEQLOCK * lock);
+void Seqlock_Write_End_IRQ_Restore(SEQLOCK * lock, uint64_t rflags);
+
+uint8_t MPSC_Init(MPSC_RING * ring, RING_SLOT * slots, uint64_t capacity);
+uint8_t MPSC_Push(MPSC_RING * ring, uint64_t value);
+uint8_t MPSC_Pop(MPSC_RING * ring, uint64_t * value);
+uint8_t MPSC_Ready(MPSC_RING * ring);
+
 // Memory-related functions (Memory.c)
 uint8_t VerifyZeroMem(size_t NumBytes, uint64_t BaseAddr); // BaseAddr is a 64-bit unsigned int whose value is the memory address to verify
 uint64_t GetMaxMappedPhysicalAddress(void);
@@ -695,19 +1486,28 @@ uint64_t GuessInstalledSystemRam(void);
 void print_system_memmap(void);
 EFI_MEMORY_DESCRIPTOR * Set_Identity_VMAP(EFI_RUNTIME_SERVICES * RTServices);
 void Setup_MemMap(void);
+EFI_MEMORY_DESCRIPTOR * MemMap_Find(EFI_PHYSICAL_ADDRESS address);
 void ReclaimEfiBootServicesMemory(void);
 void ReclaimEfiLoaderCodeMemory(void);
 void MergeContiguousConventionalMemory(void);
 EFI_PHYSICAL_ADDRESS ZeroAllConventionalMemory(void);
+EFI_PHYSICAL_ADDRESS ZeroMemoryRange(EFI_PHYSICAL_ADDRESS base, uint64_t size, uint8_t verify);
+uint8_t StartBackgroundZeroing(void);
 EFI_PHYSICAL_ADDRESS pagetable_alloc(uint64_t pagetables_size);
 
-  // For physical addresses
+  // For physical addresses. These all return MALLOC_FAILED, not NULL, when there's no room.
+#define MALLOC_FAILED ((void*)~0ULL)
+
 __attribute__((malloc)) void * malloc(size_t numbytes);
 
 __attribute__((malloc)) void * malloc16(size_t numbytes);
 __attribute__((malloc)) void * malloc32(size_t numbytes);
 __attribute__((malloc)) void * malloc64(size_t numbytes);
 __attribute__((malloc)) void * malloc4k(size_t pages);
+__attribute__((malloc)) void * malloc4k_zeroed(size_t pages);
+__attribute__((malloc)) void * malloc_node(size_t numbytes, uint64_t node);
+void free(void * address);
+void freepages(void * address, size_t pages);
 
 EFI_PHYSICAL_ADDRESS ActuallyFreeAddress(size_t pages, EFI_PHYSICAL_ADDRESS OldAddress);
 EFI_PHYSICAL_ADDRESS ActuallyFreeAddressByPage(size_t pages, EFI_PHYSICAL_ADDRESS OldAddress);
@@ -716,47 +1516,96 @@ EFI_PHYSICAL_ADDRESS AllocateFreeAddressBy16Bytes(size_t numbytes, EFI_PHYSICAL_
 EFI_PHYSICAL_ADDRESS AllocateFreeAddressBy32Bytes(size_t numbytes, EFI_PHYSICAL_ADDRESS OldAddress);
 EFI_PHYSICAL_ADDRESS AllocateFreeAddressBy64Bytes(size_t numbytes, EFI_PHYSICAL_ADDRESS OldAddress);
 
-  // For virtual addresses
+  // Page allocator
+void Setup_Page_Allocator(void);
+uint8_t Page_Allocator_Ready(void);
+EFI_PHYSICAL_ADDRESS BuddyAllocatePages(size_t pages, EFI_PHYSICAL_ADDRESS OldAddress);
+EFI_PHYSICAL_ADDRESS BuddyAllocateZeroedPages(size_t pages, EFI_PHYSICAL_ADDRESS OldAddress);
+void BuddyFreePages(EFI_PHYSICAL_ADDRESS address, size_t pages);
+EFI_PHYSICAL_ADDRESS BuddyFindFreePages(size_t pages, EFI_PHYSICAL_ADDRESS OldAddress);
+uint64_t BuddyFreePageCount(void);
+uint64_t BuddyFreeNodePageCount(uint64_t node);
+uint64_t BuddyCleanPageCount(void);
+EFI_PHYSICAL_ADDRESS BuddyZeroFreePages(uint8_t verify);
+uint64_t BuddyZeroDirtyPages(uint64_t max_pages);
+
+  // Slab allocator
+EFI_PHYSICAL_ADDRESS SlabAllocate(size_t numbytes, size_t alignment);
+void SlabFree(EFI_PHYSICAL_ADDRESS address);
+
+  // For virtual addresses, demand-paged (see Vmalloc_Reserve() in VMM.c)
 __attribute__((malloc)) void * Vmalloc(size_t numbytes);
 
 __attribute__((malloc)) void * Vmalloc16(size_t numbytes);
 __attribute__((malloc)) void * Vmalloc32(size_t numbytes);
 __attribute__((malloc)) void * Vmalloc64(size_t numbytes);
 __attribute__((malloc)) void * Vmalloc4k(size_t pages);
-
-EFI_VIRTUAL_ADDRESS VActuallyFreeAddress(size_t pages, EFI_VIRTUAL_ADDRESS OldAddress);
-EFI_VIRTUAL_ADDRESS VActuallyFreeAddressByPage(size_t pages, EFI_VIRTUAL_ADDRESS OldAddress);
-EFI_VIRTUAL_ADDRESS VAllocateFreeAddressByPage(size_t pages, EFI_VIRTUAL_ADDRESS OldAddress);
-EFI_VIRTUAL_ADDRESS VAllocateFreeAddressBy16Bytes(size_t numbytes, EFI_VIRTUAL_ADDRESS OldAddress);
-EFI_VIRTUAL_ADDRESS VAllocateFreeAddressBy32Bytes(size_t numbytes, EFI_VIRTUAL_ADDRESS OldAddress);
-EFI_VIRTUAL_ADDRESS VAllocateFreeAddressBy64Bytes(size_t numbytes, EFI_VIRTUAL_ADDRESS OldAddress);
+void Vfree(void * address);
+
+// Parallel memory functions (Bulk.c)
+void bulk_copy_async(BULK_HANDLE * handle, void * dest, const void * src, uint64_t size, uint64_t flags);
+void bulk_fill_async(BULK_HANDLE * handle, void * dest, uint8_t value, uint64_t size, uint64_t flags);
+uint8_t bulk_poll(BULK_HANDLE * handle);
+uint64_t bulk_wait(BULK_HANDLE * handle);
+void * bulk_copy(void * dest, const void * src, uint64_t size);
+void * bulk_fill(void * dest, uint8_t value, uint64_t size);
+
+// Paging-related functions (VMM.c)
+void Setup_VMM(void);
+uint8_t map_range(uint64_t virt, EFI_PHYSICAL_ADDRESS phys, uint64_t size, uint64_t flags);
+uint8_t unmap_range(uint64_t virt, uint64_t size);
+uint8_t protect_range(uint64_t virt, uint64_t size, uint64_t flags);
+EFI_PHYSICAL_ADDRESS virt_to_phys(uint64_t virt);
+ISR_GPR_ONLY uint8_t VMM_Shootdown_NMI(void);
+
+void * Vmalloc_Reserve(uint64_t size, uint64_t flags);
+uint8_t Vmalloc_Release(void * address);
+uint8_t VMM_Page_Fault(uint64_t address, uint64_t error_code);
 
 // Drawing-related functions (Display.c)
-void Blackscreen(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU);
-void Colorscreen(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU, UINT32 color);
+void Blackscreen(const EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE * GPU);
+void Colorscreen(const EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE * GPU, UINT32 color);
 
 void Resetdefaultcolorscreen(void);
 void Resetdefaultscreen(void);
 
-void single_pixel(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU, UINT32 x, UINT32 y, UINT32 color);
+void single_pixel(const EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE * GPU, UINT32 x, UINT32 y, UINT32 color);
+
+void Setup_Shadow_Framebuffers(GPU_CONFIG * GPU_Configs);
+void Setup_Mirror_Heads(GPU_CONFIG * GPU_Configs);
+void Shadow_Mark_Dirty(const EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE * GPU, UINT32 x, UINT32 y, UINT32 width, UINT32 height);
+void Shadow_Flush(const EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE * GPU);
+void Shadow_Flush_All(void);
+void Scroll_Framebuffer(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE * GPU, UINT64 lines, UINT64 kept_lines);
 
-void bitmap_anywhere_scaled(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU, const unsigned char * bitmap, UINT32 height, UINT32 width, UINT32 font_color, UINT32 highlight_color, UINT32 x, UINT32 y, UINT32 scale);
-void Output_render_bitmap(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU, const unsigned char * bitmap, UINT32 height, UINT32 width, UINT32 font_color, UINT32 highlight_color, UINT32 x, UINT32 y, UINT32 scale, UINT32 index);
+void bitmap_anywhere_scaled(const EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE * GPU, const unsigned char * bitmap, UINT32 height, UINT32 width, UINT32 font_color, UINT32 highlight_color, UINT32 x, UINT32 y, UINT32 scale);
+void Output_render_bitmap(const EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE * GPU, const unsigned char * bitmap, UINT32 height, UINT32 width, UINT32 font_color, UINT32 highlight_color, UINT32 x, UINT32 y, UINT32 scale, UINT32 index);
+void Output_render_vector(const EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE * GPU, UINT32 x_init, UINT32 y_init, UINT32 x_final, UINT32 y_final, UINT32 color, UINT32 scale);
+
+void Render_Fill_Rect(RENDER_TARGET * target, INT32 x, INT32 y, UINT32 width, UINT32 height, UINT32 color);
+void Render_Rect_Outline(RENDER_TARGET * target, INT32 x, INT32 y, UINT32 width, UINT32 height, UINT32 thickness, UINT32 color);
+void Render_Line(RENDER_TARGET * target, INT32 x0, INT32 y0, INT32 x1, INT32 y1, UINT32 color);
+void Render_Blit(RENDER_TARGET * target, const UINT32 * src, UINT64 src_pitch, UINT32 width, UINT32 height, INT32 x, INT32 y);
+void Render_Blit_Alpha(RENDER_TARGET * target, const UINT32 * src, UINT64 src_pitch, UINT32 width, UINT32 height, INT32 x, INT32 y);
+void Render_Expand_1bpp(RENDER_TARGET * target, const unsigned char * src, UINT64 src_pitch, UINT32 width, UINT32 height, INT32 x, INT32 y, UINT32 font_color, UINT32 highlight_color);
 
 void bitmap_bitswap(const unsigned char * bitmap, UINT32 height, UINT32 width, unsigned char * output);
 void bitmap_bitreverse(const unsigned char * bitmap, UINT32 height, UINT32 width, unsigned char * output);
 void bitmap_bytemirror(const unsigned char * bitmap, UINT32 height, UINT32 width, unsigned char * output);
 
 // Text-related functions (Display.c)
-void Initialize_Global_Printf_Defaults(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU);
+void Initialize_Global_Printf_Defaults(const EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE * GPU);
+
+void single_char(const EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE * GPU, int character, UINT32 height, UINT32 width, UINT32 font_color, UINT32 highlight_color);
+void single_char_anywhere(const EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE * GPU, int character, UINT32 height, UINT32 width, UINT32 font_color, UINT32 highlight_color, UINT32 x, UINT32 y);
+void single_char_anywhere_scaled(const EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE * GPU, int character, UINT32 height, UINT32 width, UINT32 font_color, UINT32 highlight_color, UINT32 x, UINT32 y, UINT32 scale);
 
-void single_char(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU, int character, UINT32 height, UINT32 width, UINT32 font_color, UINT32 highlight_color);
-void single_char_anywhere(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU, int character, UINT32 height, UINT32 width, UINT32 font_color, UINT32 highlight_color, UINT32 x, UINT32 y);
-void single_char_anywhere_scaled(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU, int character, UINT32 height, UINT32 width, UINT32 font_color, UINT32 highlight_color, UINT32 x, UINT32 y, UINT32 scale);
+void string_anywhere_scaled(const EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE * GPU, const char * string, UINT32 height, UINT32 width, UINT32 font_color, UINT32 highlight_color, UINT32 x, UINT32 y, UINT32 scale);
+void formatted_string_anywhere_scaled(const EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE * GPU, UINT32 height, UINT32 width, UINT32 font_color, UINT32 highlight_color, UINT32 x, UINT32 y, UINT32 scale, const char * string, ...);
+void Output_render_text(const EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE * GPU, int character, UINT32 height, UINT32 width, UINT32 font_color, UINT32 highlight_color, UINT32 x, UINT32 y, UINT32 scale, UINT32 index);
 
-void string_anywhere_scaled(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU, const char * string, UINT32 height, UINT32 width, UINT32 font_color, UINT32 highlight_color, UINT32 x, UINT32 y, UINT32 scale);
-void formatted_string_anywhere_scaled(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU, UINT32 height, UINT32 width, UINT32 font_color, UINT32 highlight_color, UINT32 x, UINT32 y, UINT32 scale, const char * string, ...);
-void Output_render_text(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU, int character, UINT32 height, UINT32 width, UINT32 font_color, UINT32 highlight_color, UINT32 x, UINT32 y, UINT32 scale, UINT32 index);
+void Render_Target_Init(RENDER_TARGET * target, const EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE * GPU);
+void Render_Text_Span(RENDER_TARGET * target, const char * string, UINT64 length, UINT32 height, UINT32 width, UINT32 font_color, UINT32 highlight_color, UINT32 x, UINT32 y, UINT32 scale);
 
 // Printf-related functions (Print.c)
 int snprintf(char *str, size_t size, const char *format, ...);
@@ -768,9 +1617,109 @@ int vsprintf(char *buf, const char *cfmt, va_list ap);
 int printf(const char *fmt, ...);
 int vprintf(const char *fmt, va_list ap);
 int kvprintf(char const *fmt, void (*func)(int, void*), void *arg, int radix, va_list ap);
+void print_direct(const char * string, uint64_t length);
 
 void print_utf16_as_utf8(CHAR16 * strung, UINT64 size);
 char * UCS2_to_UTF8(CHAR16 * strang, UINT64 size);
 
+// Console-related functions (Console.c)
+void Console_Set_Deferred(uint64_t deferred);
+int Console_vprintf(const char * fmt, va_list ap);
+void Console_Flush(void);
+void Console_Panic(void);
+void Console_Set_Sinks(uint64_t sinks);
+uint8_t Console_Start_Renderer(uint64_t cpu_index);
+
+// Serial-related functions (Serial.c)
+uint8_t Setup_Serial(uint64_t com_number);
+uint8_t Serial_Start_Interrupts(void);
+void Serial_Write(const char * text, uint64_t length);
+void Serial_Poll(void);
+ISR_GPR_ONLY void Serial_Interrupt(void);
+void Serial_Panic(void);
+
+// Clock-related functions (Clock.c)
+void Setup_Clock(void);
+uint64_t now_ns(void);
+void delay_us(uint64_t microseconds);
+uint64_t cycles_to_ns(uint64_t cycles);
+uint64_t ns_to_cycles(uint64_t ns);
+
+// Timer-related functions (Timer.c)
+uint8_t Setup_Timer(void);
+void Timer_Init(TIMER * timer, void (*function)(void * arg), void * arg);
+void Timer_Arm(TIMER * timer, uint64_t delay_us, uint64_t period_us);
+uint8_t Timer_Cancel(TIMER * timer);
+void Timer_Sleep_us(uint64_t microseconds);
+void Timer_Interrupt(void);
+
+// Task-related functions (Task.c)
+uint8_t Setup_Scheduler(void);
+uint8_t Task_Start_Worker(uint64_t cpu_index);
+TASK * Task_Spawn(void (*function)(void * arg), void * arg, uint64_t stack_pages);
+uint8_t Task_Yield(void);
+void Task_Exit(void);
+void Task_Join(TASK * task);
+void Task_Sleep_us(uint64_t microseconds);
+TASK * Task_Current(void);
+
+// Performance counter-related functions (PMU.c)
+uint8_t Setup_PMU(void);
+uint64_t PMU_Begin(PMU_MEASUREMENT * measurement, const uint64_t * events, uint64_t count);
+void PMU_End(PMU_MEASUREMENT * measurement);
+void PMU_Print(const char * name, PMU_MEASUREMENT * measurement);
+uint8_t PMU_Start_Sampling(uint64_t event, uint64_t period, uint64_t * buffer, uint64_t capacity);
+uint64_t PMU_Stop_Sampling(void);
+ISR_GPR_ONLY void PMU_Interrupt(FAST_INTERRUPT_FRAME * i_frame);
+
+// Benchmark-related functions (Benchmark.c)
+BENCHMARK_RESULTS * Run_Memory_Benchmarks(uint64_t max_size);
+
+// Trace-related functions (Trace.c)
+void Trace_Event(const char * name, uint32_t type);
+void Trace_Enable(uint64_t enable);
+uint64_t Trace_Ticks_To_ns(uint64_t ticks);
+void Trace_Print_Timeline(void);
+
+// Interrupt stats-related functions (ISR_Stats.c)
+uint8_t Setup_ISR_Stats(void);
+ISR_GPR_ONLY void ISR_Stats_Record(uint64_t isr_num, uint64_t cycles);
+void ISR_Stats_Enable(uint64_t enable);
+void ISR_Stats_Reset(void);
+void ISR_Stats_Print(uint64_t per_cpu);
+
+// ACPI-related functions (ACPI.c)
+void ACPI_Init(LOADER_PARAMS * LP);
+SDT_HEADER_STRUCT * ACPI_Find_Table(const char * signature, uint64_t instance);
+
+// NUMA-related functions (NUMA.c)
+void Setup_NUMA(void);
+uint64_t NUMA_Node_Of_APIC(uint32_t apic_id);
+uint64_t NUMA_Node_Of_Address(EFI_PHYSICAL_ADDRESS address);
+uint64_t NUMA_Current_Node(void);
+void NUMA_Set_Policy(uint64_t policy);
+void NUMA_Print(void);
+
+// Multiprocessor-related functions (SMP.c)
+void Setup_Per_CPU_Data(void);
+void Setup_SMP(void);
+
+ISR_GPR_ONLY uint32_t lapic_rw(uint32_t reg, uint32_t data, int rw);
+void lapic_send_ipi(uint32_t apic_id, uint32_t icr_low);
+uint8_t IOAPIC_Route_ISA_IRQ(uint8_t irq, uint8_t vector);
+uint32_t get_apic_id(void);
+ISR_GPR_ONLY PER_CPU_STRUCT * get_cpu_data(void);
+uint64_t get_cpu_index(void);
+
+uint8_t SMP_Run_On_CPU(uint64_t cpu_index, void (*func)(void * arg), void * arg);
+uint8_t SMP_Try_Run_On_CPU(uint64_t cpu_index, void (*func)(void * arg), void * arg);
+void SMP_Wait_On_CPU(uint64_t cpu_index);
+
+  // These are in startup/AP_Trampoline.S
+extern unsigned char AP_Trampoline_Start[];
+extern unsigned char AP_Trampoline_LongMode[];
+extern unsigned char AP_Trampoline_Data[];
+extern unsigned char AP_Trampoline_End[];
+
 // Don't remove this #endif
 #endif /* _Kernel64_H */
@@ -0,0 +1,119 @@
+//==================================================================================================================================
+//  Simple Kernel: ACPI Table Functions
+//==================================================================================================================================
+//
+// Version 0.z
+//
+// Author:
+//  KNNSpeed
+//
+// Source Code:
+//  https://github.com/KNNSpeed/Simple-Kernel
+//
+// This file contains functions for finding ACPI tables (MADT, FADT, HPET, SRAT, etc.) from the RSDP that UEFI passes in via the
+// system configuration tables.
+//
+// ACPI tables live in EfiACPIReclaimMemory and EfiACPIMemoryNVS, neither of which gets reclaimed by this kernel, so pointers to them
+// stay valid forever.
+//
+
+#include "Kernel64.h"
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// ACPI_Init: Find the RSDP and Root Table
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Look through the UEFI configuration tables for the ACPI 2.0+ RSDP, falling back to the ACPI 1.0 RSDP if there isn't one, and store
+// what was found in Global_ACPI_Info. This needs to run before anything uses ACPI_Find_Table().
+//
+
+void ACPI_Init(LOADER_PARAMS * LP)
+{
+  RSDP_20_STRUCT * RSDP_20 = NULL;
+  RSDP_20_STRUCT * RSDP_10 = NULL;
+
+  for(uint64_t i = 0; i < LP->Number_of_ConfigTables; i++)
+  {
+    if(!(AVX_memcmp(&LP->ConfigTables[i].VendorGuid, &Acpi20TableGuid, 16, 0)))
+    {
+      RSDP_20 = (RSDP_20_STRUCT *)LP->ConfigTables[i].VendorTable;
+    }
+    else if(!(AVX_memcmp(&LP->ConfigTables[i].VendorGuid, &Acpi10TableGuid, 16, 0)))
+    {
+      RSDP_10 = (RSDP_20_STRUCT *)LP->ConfigTables[i].VendorTable;
+    }
+  }
+
+  if((RSDP_20 != NULL) && (RSDP_20->RSDP_10_Section.Revision >= 2) && (RSDP_20->XSDTAddress != 0))
+  {
+    Global_ACPI_Info.RSDP = RSDP_20;
+    Global_ACPI_Info.XSDT = (XSDT_STRUCT *)RSDP_20->XSDTAddress;
+    Global_ACPI_Info.RSDT = (RSDT_STRUCT *)(uint64_t)RSDP_20->RSDP_10_Section.RSDTAddress;
+    Global_ACPI_Info.Revision = 2;
+  }
+  else if((RSDP_20 != NULL) || (RSDP_10 != NULL))
+  {
+    // An ACPI 2.0 GUID with a revision 0 RSDP is technically wrong, but the RSDT in it is still usable
+    Global_ACPI_Info.RSDP = (RSDP_20 != NULL) ? RSDP_20 : RSDP_10;
+    Global_ACPI_Info.XSDT = NULL;
+    Global_ACPI_Info.RSDT = (RSDT_STRUCT *)(uint64_t)Global_ACPI_Info.RSDP->RSDP_10_Section.RSDTAddress;
+    Global_ACPI_Info.Revision = 1;
+  }
+  else
+  {
+    printf("ACPI_Init: No RSDP found.\r\n");
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// ACPI_Find_Table: Find an ACPI Table by Signature
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Search the XSDT (or RSDT on ACPI 1.0 systems) for a table with the given 4-character signature, e.g. "APIC" for the MADT or "FACP"
+// for the FADT. Some tables (like SSDTs) can appear more than once, so 'instance' selects which one: 0 is the first, 1 is the
+// second, etc.
+//
+// Returns a pointer to the table's header, or NULL if there isn't one.
+//
+
+SDT_HEADER_STRUCT * ACPI_Find_Table(const char * signature, uint64_t instance)
+{
+  if(Global_ACPI_Info.XSDT != NULL)
+  {
+    XSDT_STRUCT * xsdt = Global_ACPI_Info.XSDT;
+    uint64_t entries = (xsdt->SDTHeader.Length - sizeof(SDT_HEADER_STRUCT)) >> 3;
+
+    for(uint64_t i = 0; i < entries; i++)
+    {
+      SDT_HEADER_STRUCT * table = (SDT_HEADER_STRUCT *)xsdt->Entry[i];
+      if((table != NULL) && !(AVX_memcmp(table->Signature, signature, 4, 0)))
+      {
+        if(instance == 0)
+        {
+          return table;
+        }
+        instance--;
+      }
+    }
+  }
+  else if(Global_ACPI_Info.RSDT != NULL)
+  {
+    RSDT_STRUCT * rsdt = Global_ACPI_Info.RSDT;
+    uint64_t entries = (rsdt->SDTHeader.Length - sizeof(SDT_HEADER_STRUCT)) >> 2;
+
+    for(uint64_t i = 0; i < entries; i++)
+    {
+      SDT_HEADER_STRUCT * table = (SDT_HEADER_STRUCT *)(uint64_t)rsdt->Entry[i];
+      if((table != NULL) && !(AVX_memcmp(table->Signature, signature, 4, 0)))
+      {
+        if(instance == 0)
+        {
+          return table;
+        }
+        instance--;
+      }
+    }
+  }
+
+  return NULL;
+}
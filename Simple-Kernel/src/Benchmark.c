@@ -0,0 +1,582 @@
+//==================================================================================================================================
+//  Simple Kernel: Memory Benchmarks
+//==================================================================================================================================
+//
+// Version 0.z
+//
+// Author:
+//  KNNSpeed
+//
+// Source Code:
+//  https://github.com/KNNSpeed/Simple-Kernel
+//
+// This file contains a benchmark suite for the memcpy/memmove/memset/memcmp family in the startup folder: every individual variant
+// that the build has (scalar, SSE, AVX, AVX-512; unaligned, aligned, and aligned streaming), the _large helpers, and the AVX_*
+// dispatchers along with each of their dispatch targets.
+//
+// Each one is timed over power-of-4 sizes from 64 bytes up to the biggest buffer that can be allocated (1GB at most), with aligned,
+// misaligned destination, misaligned source, and (for the functions that support it) overlapping buffers. Timing uses get_tick()
+// fenced with CPUID on both sides, and the fastest of several samples is kept.
+//
+// It's started by kernel_main() when the "bench" kernel option is given (see Parse_Kernel_Options() in System.c), since it takes a
+// while. "bench=N" limits the biggest size to N MB.
+//
+// NOTE: Functions that need aligned pointers (the _a and _as variants) are only run on aligned buffers. The 4B memset functions are
+// in that group too, since they can only be misaligned by a multiple of 4 bytes.
+//
+
+#include "Kernel64.h"
+
+typedef void (*bench_function)(void * dest, void * src, size_t numbytes);
+
+typedef struct {
+  const char *    Name;
+  bench_function  Function;
+  uint64_t        Unit;     // The function's "len" argument counts multiples of this many bytes
+  uint32_t        Kind;     // BENCHMARK_KIND_*
+  uint32_t        Flags;    // BENCH_FLAG_*
+} BENCH_VARIANT;
+
+#define BENCH_FLAG_ALIGNED_ONLY     (1 << 0)
+#define BENCH_FLAG_OVERLAP_FORWARD  (1 << 1) // Handles dest < src overlap
+#define BENCH_FLAG_OVERLAP_BACKWARD (1 << 2) // Handles dest > src overlap
+#define BENCH_FLAG_NEEDS_AVX512F    (1 << 3)
+#define BENCH_FLAG_NEEDS_AVX512BW   (1 << 4)
+#define BENCH_FLAG_NEEDS_AVX2       (1 << 5)
+
+#define BENCH_MAX_VARIANTS 320
+#define BENCH_MIN_SIZE 64
+#define BENCH_DEFAULT_MAX_SIZE (1ULL << 30) // 1GB, the biggest block the page allocator has
+#define BENCH_MIN_BUFFER_SIZE (1ULL << 20)
+#define BENCH_BATCH_BYTES (1ULL << 18) // Small sizes get called in a loop until at least this many bytes have been processed
+#define BENCH_SAMPLES 5
+#define BENCH_LARGE_SAMPLES 2 // For sizes >= BENCH_LARGE_SIZE
+#define BENCH_LARGE_SIZE (1ULL << 26)
+#define BENCH_CASES 5
+
+#define BENCH_ALLOC_FAILED(address) ((address) == MALLOC_FAILED)
+
+static BENCH_VARIANT bench_variants[BENCH_MAX_VARIANTS] __attribute__((aligned(64))) = {0};
+static uint64_t bench_variant_count = 0;
+static volatile int bench_sink = 0; // memcmp results go here so the calls can't be thrown away
+
+static void bench_register_all(void);
+static void bench_add(const char * name, bench_function function, uint64_t unit, uint32_t kind, uint32_t flags);
+static uint64_t bench_tick_start(void);
+static uint64_t bench_tick_end(void);
+static uint64_t bench_overhead(void);
+static const char * bench_size_string(uint64_t size, char * buffer);
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  Variant Lists
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// X(function, unit, flags) for copies/moves/compares, and X(function, unit, flags, value) for sets. Each list is expanded twice: once
+// to make a wrapper with the common bench_function signature, and once in bench_register_all() to add it to bench_variants.
+//
+
+#define U 0
+#define A BENCH_FLAG_ALIGNED_ONLY
+
+#define BENCH_MEMCPY_BASE(X) \
+  X(memcpy, 1, U) X(memcpy_16bit, 2, U) X(memcpy_32bit, 4, U) X(memcpy_64bit, 8, U) \
+  X(memcpy_128bit_u, 16, U) X(memcpy_128bit_32B_u, 32, U) X(memcpy_128bit_64B_u, 64, U) X(memcpy_128bit_128B_u, 128, U) X(memcpy_128bit_256B_u, 256, U) \
+  X(memcpy_128bit_a, 16, A) X(memcpy_128bit_32B_a, 32, A) X(memcpy_128bit_64B_a, 64, A) X(memcpy_128bit_128B_a, 128, A) X(memcpy_128bit_256B_a, 256, A) \
+  X(memcpy_128bit_as, 16, A) X(memcpy_128bit_32B_as, 32, A) X(memcpy_128bit_64B_as, 64, A) X(memcpy_128bit_128B_as, 128, A) X(memcpy_128bit_256B_as, 256, A) \
+  X(memcpy_large, 1, U) X(memcpy_large_a, 1, A) X(memcpy_large_as, 1, A) \
+  X(AVX_memcpy, 1, U) X(AVX_memcpy_native, 1, U) X(AVX_memcpy_erms, 1, U) X(AVX_memcpy_avx512, 1, BENCH_FLAG_NEEDS_AVX512F)
+
+#define BENCH_MEMMOVE_BASE(X) \
+  X(memmove, 1, U) X(memmove_16bit, 2, U) X(memmove_32bit, 4, U) X(memmove_64bit, 8, U) \
+  X(memmove_128bit_u, 16, U) X(memmove_128bit_32B_u, 32, U) X(memmove_128bit_64B_u, 64, U) X(memmove_128bit_128B_u, 128, U) X(memmove_128bit_256B_u, 256, U) \
+  X(memmove_128bit_a, 16, A) X(memmove_128bit_32B_a, 32, A) X(memmove_128bit_64B_a, 64, A) X(memmove_128bit_128B_a, 128, A) X(memmove_128bit_256B_a, 256, A) \
+  X(memmove_128bit_as, 16, A) X(memmove_128bit_32B_as, 32, A) X(memmove_128bit_64B_as, 64, A) X(memmove_128bit_128B_as, 128, A) X(memmove_128bit_256B_as, 256, A) \
+  X(memmove_large, 1, BENCH_FLAG_OVERLAP_FORWARD) X(memmove_large_a, 1, A) X(memmove_large_as, 1, A) \
+  X(memmove_large_reverse, 1, BENCH_FLAG_OVERLAP_BACKWARD) X(memmove_large_reverse_a, 1, A) X(memmove_large_reverse_as, 1, A) \
+  X(AVX_memmove, 1, BENCH_FLAG_OVERLAP_FORWARD | BENCH_FLAG_OVERLAP_BACKWARD) \
+  X(AVX_memmove_native, 1, BENCH_FLAG_OVERLAP_FORWARD | BENCH_FLAG_OVERLAP_BACKWARD) \
+  X(AVX_memmove_erms, 1, BENCH_FLAG_OVERLAP_FORWARD | BENCH_FLAG_OVERLAP_BACKWARD) \
+  X(AVX_memmove_avx512, 1, BENCH_FLAG_OVERLAP_FORWARD | BENCH_FLAG_OVERLAP_BACKWARD | BENCH_FLAG_NEEDS_AVX512F)
+
+#define BENCH_MEMSET_BASE(X) \
+  X(memset, 1, U, (uint8_t)0x5A) X(memset_16bit, 2, U, (uint16_t)0x5A5A) X(memset_32bit, 4, U, (uint32_t)0x5A5A5A5A) X(memset_64bit, 8, U, (uint64_t)0x5A5A5A5A5A5A5A5A) \
+  X(memset_128bit_u, 16, U, _mm_set1_epi8(0x5A)) X(memset_128bit_32B_u, 32, U, _mm_set1_epi8(0x5A)) X(memset_128bit_64B_u, 64, U, _mm_set1_epi8(0x5A)) \
+  X(memset_128bit_128B_u, 128, U, _mm_set1_epi8(0x5A)) X(memset_128bit_256B_u, 256, U, _mm_set1_epi8(0x5A)) \
+  X(memset_128bit_a, 16, A, _mm_set1_epi8(0x5A)) X(memset_128bit_32B_a, 32, A, _mm_set1_epi8(0x5A)) X(memset_128bit_64B_a, 64, A, _mm_set1_epi8(0x5A)) \
+  X(memset_128bit_128B_a, 128, A, _mm_set1_epi8(0x5A)) X(memset_128bit_256B_a, 256, A, _mm_set1_epi8(0x5A)) \
+  X(memset_128bit_as, 16, A, _mm_set1_epi8(0x5A)) X(memset_128bit_32B_as, 32, A, _mm_set1_epi8(0x5A)) X(memset_128bit_64B_as, 64, A, _mm_set1_epi8(0x5A)) \
+  X(memset_128bit_128B_as, 128, A, _mm_set1_epi8(0x5A)) X(memset_128bit_256B_as, 256, A, _mm_set1_epi8(0x5A)) \
+  X(memset_large, 1, U, (uint8_t)0x5A) X(memset_large_a, 1, A, (uint8_t)0x5A) X(memset_large_as, 1, A, (uint8_t)0x5A) \
+  X(memset_large_4B, 4, A, (uint32_t)0x5A5A5A5A) X(memset_large_4B_a, 4, A, (uint32_t)0x5A5A5A5A) X(memset_large_4B_as, 4, A, (uint32_t)0x5A5A5A5A) \
+  X(AVX_memset_4B, 4, A, (uint32_t)0x5A5A5A5A) \
+  X(AVX_memset, 1, U, (uint8_t)0x5A) X(AVX_memset_native, 1, U, (uint8_t)0x5A) X(AVX_memset_erms, 1, U, (uint8_t)0x5A) \
+  X(AVX_memset_avx512, 1, BENCH_FLAG_NEEDS_AVX512F, (uint8_t)0x5A)
+
+#define BENCH_MEMCMP_BASE(X) \
+  X(memcmp, 1, U) X(memcmp_eq, 1, U) X(memcmp_16bit, 2, U) X(memcmp_16bit_eq, 2, U) \
+  X(memcmp_32bit, 4, U) X(memcmp_32bit_eq, 4, U) X(memcmp_64bit, 8, U) X(memcmp_64bit_eq, 8, U) \
+  X(memcmp_128bit_u, 16, U) X(memcmp_128bit_eq_u, 16, U) X(memcmp_128bit_a, 16, A) X(memcmp_128bit_eq_a, 16, A) \
+  X(memcmp_large, 1, U) X(memcmp_large_eq, 1, U) X(memcmp_large_a, 1, A) X(memcmp_large_eq_a, 1, A)
+
+#ifdef __AVX__
+#define BENCH_MEMCPY_AVX(X) \
+  X(memcpy_256bit_u, 32, U) X(memcpy_256bit_64B_u, 64, U) X(memcpy_256bit_128B_u, 128, U) X(memcpy_256bit_256B_u, 256, U) X(memcpy_256bit_512B_u, 512, U) \
+  X(memcpy_256bit_a, 32, A) X(memcpy_256bit_64B_a, 64, A) X(memcpy_256bit_128B_a, 128, A) X(memcpy_256bit_256B_a, 256, A) X(memcpy_256bit_512B_a, 512, A)
+#define BENCH_MEMMOVE_AVX(X) \
+  X(memmove_256bit_u, 32, U) X(memmove_256bit_64B_u, 64, U) X(memmove_256bit_128B_u, 128, U) X(memmove_256bit_256B_u, 256, U) X(memmove_256bit_512B_u, 512, U) \
+  X(memmove_256bit_a, 32, A) X(memmove_256bit_64B_a, 64, A) X(memmove_256bit_128B_a, 128, A) X(memmove_256bit_256B_a, 256, A) X(memmove_256bit_512B_a, 512, A)
+#define BENCH_MEMSET_AVX(X) \
+  X(memset_256bit_u, 32, U, _mm256_set1_epi8(0x5A)) X(memset_256bit_64B_u, 64, U, _mm256_set1_epi8(0x5A)) X(memset_256bit_128B_u, 128, U, _mm256_set1_epi8(0x5A)) \
+  X(memset_256bit_256B_u, 256, U, _mm256_set1_epi8(0x5A)) X(memset_256bit_512B_u, 512, U, _mm256_set1_epi8(0x5A)) \
+  X(memset_256bit_a, 32, A, _mm256_set1_epi8(0x5A)) X(memset_256bit_64B_a, 64, A, _mm256_set1_epi8(0x5A)) X(memset_256bit_128B_a, 128, A, _mm256_set1_epi8(0x5A)) \
+  X(memset_256bit_256B_a, 256, A, _mm256_set1_epi8(0x5A)) X(memset_256bit_512B_a, 512, A, _mm256_set1_epi8(0x5A)) \
+  X(memset_256bit_as, 32, A, _mm256_set1_epi8(0x5A)) X(memset_256bit_64B_as, 64, A, _mm256_set1_epi8(0x5A)) X(memset_256bit_128B_as, 128, A, _mm256_set1_epi8(0x5A)) \
+  X(memset_256bit_256B_as, 256, A, _mm256_set1_epi8(0x5A)) X(memset_256bit_512B_as, 512, A, _mm256_set1_epi8(0x5A))
+#else
+#define BENCH_MEMCPY_AVX(X)
+#define BENCH_MEMMOVE_AVX(X)
+#define BENCH_MEMSET_AVX(X)
+#endif
+
+#ifdef __AVX2__
+#define BENCH_MEMCPY_AVX2(X) \
+  X(memcpy_256bit_as, 32, A) X(memcpy_256bit_64B_as, 64, A) X(memcpy_256bit_128B_as, 128, A) X(memcpy_256bit_256B_as, 256, A) X(memcpy_256bit_512B_as, 512, A)
+#define BENCH_MEMMOVE_AVX2(X) \
+  X(memmove_256bit_as, 32, A) X(memmove_256bit_64B_as, 64, A) X(memmove_256bit_128B_as, 128, A) X(memmove_256bit_256B_as, 256, A) X(memmove_256bit_512B_as, 512, A)
+#define BENCH_MEMCMP_AVX2(X) \
+  X(memcmp_256bit_u, 32, U) X(memcmp_256bit_eq_u, 32, U) X(memcmp_256bit_a, 32, A) X(memcmp_256bit_eq_a, 32, A)
+#else
+#define BENCH_MEMCPY_AVX2(X)
+#define BENCH_MEMMOVE_AVX2(X)
+#define BENCH_MEMCMP_AVX2(X)
+#endif
+
+#ifdef __AVX512F__
+#define BENCH_MEMCPY_AVX512(X) \
+  X(memcpy_512bit_u, 64, U) X(memcpy_512bit_128B_u, 128, U) X(memcpy_512bit_256B_u, 256, U) X(memcpy_512bit_512B_u, 512, U) \
+  X(memcpy_512bit_1kB_u, 1024, U) X(memcpy_512bit_2kB_u, 2048, U) X(memcpy_512bit_4kB_u, 4096, U) \
+  X(memcpy_512bit_a, 64, A) X(memcpy_512bit_128B_a, 128, A) X(memcpy_512bit_256B_a, 256, A) X(memcpy_512bit_512B_a, 512, A) \
+  X(memcpy_512bit_1kB_a, 1024, A) X(memcpy_512bit_2kB_a, 2048, A) X(memcpy_512bit_4kB_a, 4096, A) \
+  X(memcpy_512bit_as, 64, A) X(memcpy_512bit_128B_as, 128, A) X(memcpy_512bit_256B_as, 256, A) X(memcpy_512bit_512B_as, 512, A) \
+  X(memcpy_512bit_1kB_as, 1024, A) X(memcpy_512bit_2kB_as, 2048, A) X(memcpy_512bit_4kB_as, 4096, A)
+#define BENCH_MEMMOVE_AVX512(X) \
+  X(memmove_512bit_u, 64, U) X(memmove_512bit_128B_u, 128, U) X(memmove_512bit_256B_u, 256, U) X(memmove_512bit_512B_u, 512, U) \
+  X(memmove_512bit_1kB_u, 1024, U) X(memmove_512bit_2kB_u, 2048, U) X(memmove_512bit_4kB_u, 4096, U) \
+  X(memmove_512bit_a, 64, A) X(memmove_512bit_128B_a, 128, A) X(memmove_512bit_256B_a, 256, A) X(memmove_512bit_512B_a, 512, A) \
+  X(memmove_512bit_1kB_a, 1024, A) X(memmove_512bit_2kB_a, 2048, A) X(memmove_512bit_4kB_a, 4096, A) \
+  X(memmove_512bit_as, 64, A) X(memmove_512bit_128B_as, 128, A) X(memmove_512bit_256B_as, 256, A) X(memmove_512bit_512B_as, 512, A) \
+  X(memmove_512bit_1kB_as, 1024, A) X(memmove_512bit_2kB_as, 2048, A) X(memmove_512bit_4kB_as, 4096, A)
+#define BENCH_MEMSET_AVX512(X) \
+  X(memset_512bit_u, 64, U, _mm512_set1_epi8(0x5A)) X(memset_512bit_128B_u, 128, U, _mm512_set1_epi8(0x5A)) X(memset_512bit_256B_u, 256, U, _mm512_set1_epi8(0x5A)) \
+  X(memset_512bit_512B_u, 512, U, _mm512_set1_epi8(0x5A)) X(memset_512bit_1kB_u, 1024, U, _mm512_set1_epi8(0x5A)) X(memset_512bit_2kB_u, 2048, U, _mm512_set1_epi8(0x5A)) \
+  X(memset_512bit_4kB_u, 4096, U, _mm512_set1_epi8(0x5A)) \
+  X(memset_512bit_a, 64, A, _mm512_set1_epi8(0x5A)) X(memset_512bit_128B_a, 128, A, _mm512_set1_epi8(0x5A)) X(memset_512bit_256B_a, 256, A, _mm512_set1_epi8(0x5A)) \
+  X(memset_512bit_512B_a, 512, A, _mm512_set1_epi8(0x5A)) X(memset_512bit_1kB_a, 1024, A, _mm512_set1_epi8(0x5A)) X(memset_512bit_2kB_a, 2048, A, _mm512_set1_epi8(0x5A)) \
+  X(memset_512bit_4kB_a, 4096, A, _mm512_set1_epi8(0x5A)) \
+  X(memset_512bit_as, 64, A, _mm512_set1_epi8(0x5A)) X(memset_512bit_128B_as, 128, A, _mm512_set1_epi8(0x5A)) X(memset_512bit_256B_as, 256, A, _mm512_set1_epi8(0x5A)) \
+  X(memset_512bit_512B_as, 512, A, _mm512_set1_epi8(0x5A)) X(memset_512bit_1kB_as, 1024, A, _mm512_set1_epi8(0x5A)) X(memset_512bit_2kB_as, 2048, A, _mm512_set1_epi8(0x5A)) \
+  X(memset_512bit_4kB_as, 4096, A, _mm512_set1_epi8(0x5A))
+#define BENCH_MEMCMP_AVX512(X) \
+  X(memcmp_512bit_u, 64, U) X(memcmp_512bit_eq_u, 64, U) X(memcmp_512bit_a, 64, A) X(memcmp_512bit_eq_a, 64, A)
+#else
+#define BENCH_MEMCPY_AVX512(X)
+#define BENCH_MEMMOVE_AVX512(X)
+#define BENCH_MEMSET_AVX512(X)
+#define BENCH_MEMCMP_AVX512(X)
+#endif
+
+#define BENCH_MEMCPY_ALL(X) BENCH_MEMCPY_BASE(X) BENCH_MEMCPY_AVX(X) BENCH_MEMCPY_AVX2(X) BENCH_MEMCPY_AVX512(X)
+#define BENCH_MEMMOVE_ALL(X) BENCH_MEMMOVE_BASE(X) BENCH_MEMMOVE_AVX(X) BENCH_MEMMOVE_AVX2(X) BENCH_MEMMOVE_AVX512(X)
+#define BENCH_MEMSET_ALL(X) BENCH_MEMSET_BASE(X) BENCH_MEMSET_AVX(X) BENCH_MEMSET_AVX512(X)
+#define BENCH_MEMCMP_ALL(X) BENCH_MEMCMP_BASE(X) BENCH_MEMCMP_AVX2(X) BENCH_MEMCMP_AVX512(X)
+
+// Wrappers
+#define BENCH_COPY_WRAPPER(function, unit, flags) \
+  static void bench_##function(void * dest, void * src, size_t numbytes) { function(dest, src, numbytes / (unit)); }
+#define BENCH_SET_WRAPPER(function, unit, flags, value) \
+  static void bench_##function(void * dest, void * src __attribute__((unused)), size_t numbytes) { function(dest, value, numbytes / (unit)); }
+#define BENCH_CMP_WRAPPER(function, unit, flags) \
+  static void bench_##function(void * dest, void * src, size_t numbytes) { bench_sink = function(dest, src, numbytes / (unit)); }
+
+BENCH_MEMCPY_ALL(BENCH_COPY_WRAPPER)
+BENCH_MEMMOVE_ALL(BENCH_COPY_WRAPPER)
+BENCH_MEMSET_ALL(BENCH_SET_WRAPPER)
+BENCH_MEMCMP_ALL(BENCH_CMP_WRAPPER)
+
+// These don't fit the lists
+static void bench_memset_zeroes(void * dest, void * src __attribute__((unused)), size_t numbytes) { memset_zeroes(dest, numbytes); }
+static void bench_memset_zeroes_a(void * dest, void * src __attribute__((unused)), size_t numbytes) { memset_zeroes_a(dest, numbytes); }
+static void bench_memset_zeroes_as(void * dest, void * src __attribute__((unused)), size_t numbytes) { memset_zeroes_as(dest, numbytes); }
+static void bench_AVX_memcmp(void * dest, void * src, size_t numbytes) { bench_sink = AVX_memcmp(dest, src, numbytes, 1); }
+static void bench_AVX_memcmp_eq(void * dest, void * src, size_t numbytes) { bench_sink = AVX_memcmp(dest, src, numbytes, 0); }
+static void bench_AVX_memcmp_native(void * dest, void * src, size_t numbytes) { bench_sink = AVX_memcmp_native(dest, src, numbytes, 1); }
+static void bench_AVX_memcmp_native_eq(void * dest, void * src, size_t numbytes) { bench_sink = AVX_memcmp_native(dest, src, numbytes, 0); }
+static void bench_AVX_memcmp_avx2(void * dest, void * src, size_t numbytes) { bench_sink = AVX_memcmp_avx2(dest, src, numbytes, 1); }
+static void bench_AVX_memcmp_avx2_eq(void * dest, void * src, size_t numbytes) { bench_sink = AVX_memcmp_avx2(dest, src, numbytes, 0); }
+static void bench_AVX_memcmp_avx512(void * dest, void * src, size_t numbytes) { bench_sink = AVX_memcmp_avx512(dest, src, numbytes, 1); }
+static void bench_AVX_memcmp_avx512_eq(void * dest, void * src, size_t numbytes) { bench_sink = AVX_memcmp_avx512(dest, src, numbytes, 0); }
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  Run_Memory_Benchmarks: Time the Memory Functions
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Run every variant over every size and case, print a table, and return the same results in machine-readable form (also stored in
+// Global_Benchmark_Results). max_size is in bytes, 0 means BENCH_DEFAULT_MAX_SIZE.
+//
+// Returns NULL if the test buffers couldn't be allocated. The results buffer is allocated with malloc4k() and left allocated.
+//
+// Bytes per tick and MB/s use TSC ticks, which run at a constant rate regardless of the actual core clock (so they're "bytes per
+// reference cycle"). Only the bytes written are counted, e.g. a 4kB memcpy is 4kB, not 8kB.
+//
+
+BENCHMARK_RESULTS * Run_Memory_Benchmarks(uint64_t max_size)
+{
+  if((max_size == 0) || (max_size > BENCH_DEFAULT_MAX_SIZE))
+  {
+    max_size = BENCH_DEFAULT_MAX_SIZE;
+  }
+
+  // Round down to a power of 2
+  uint64_t buffer_size = 1ULL << (63 - __builtin_clzll(max_size));
+  if(buffer_size < BENCH_MIN_BUFFER_SIZE)
+  {
+    buffer_size = BENCH_MIN_BUFFER_SIZE;
+  }
+
+  // Get the biggest two buffers that are available
+  void * src_buffer = NULL;
+  void * dest_buffer = NULL;
+
+  while(buffer_size >= BENCH_MIN_BUFFER_SIZE)
+  {
+    src_buffer = malloc4k(buffer_size >> 12);
+    if(!BENCH_ALLOC_FAILED(src_buffer))
+    {
+      dest_buffer = malloc4k(buffer_size >> 12);
+      if(!BENCH_ALLOC_FAILED(dest_buffer))
+      {
+        break;
+      }
+      freepages(src_buffer, buffer_size >> 12);
+    }
+    buffer_size >>= 1;
+  }
+
+  if(buffer_size < BENCH_MIN_BUFFER_SIZE)
+  {
+    printf("Run_Memory_Benchmarks: Not enough free memory for the test buffers.\r\n");
+    return NULL;
+  }
+
+  bench_register_all();
+
+  uint64_t number_of_sizes = 0;
+  for(uint64_t size = BENCH_MIN_SIZE; size <= buffer_size; size <<= 2)
+  {
+    number_of_sizes++;
+  }
+
+  uint64_t capacity = bench_variant_count * number_of_sizes * BENCH_CASES;
+  uint64_t results_pages = EFI_SIZE_TO_PAGES(sizeof(BENCHMARK_RESULTS) + capacity * sizeof(BENCHMARK_ENTRY));
+  BENCHMARK_RESULTS * results = malloc4k(results_pages);
+
+  if(BENCH_ALLOC_FAILED(results))
+  {
+    printf("Run_Memory_Benchmarks: No room for the results buffer, only printing them.\r\n");
+    results = NULL;
+  }
+  else
+  {
+    results->Magic = BENCHMARK_MAGIC;
+    results->Version = BENCHMARK_VERSION;
+    results->Entry_Size = sizeof(BENCHMARK_ENTRY);
+    results->Count = 0;
+    results->Capacity = capacity;
+    results->TSC_MHz = Global_SMP_Info.TSC_MHz;
+    results->Max_Size = buffer_size;
+    results->Features = AVX_Mem_Dispatch.Features;
+  }
+
+  uint64_t overhead = bench_overhead();
+  uint64_t tsc_mhz = Global_SMP_Info.TSC_MHz;
+
+  // Not static: a static table of pointers would need relocating
+  const char * case_names[BENCH_CASES] = {"aligned", "dest+1", "src+1", "ovl-fwd", "ovl-back"};
+  char size_string[16];
+
+  printf("Memory benchmarks: %qu variants, 64B - %s, TSC %qu MHz, timing overhead %qu ticks\r\n", bench_variant_count, bench_size_string(buffer_size, size_string), tsc_mhz, overhead);
+  printf("%-26s %-6s %-8s %14s %10s %10s\r\n", "Function", "Size", "Case", "Ticks/call", "B/tick", "GB/s");
+
+  // Fill the source with something that isn't all zeroes
+  AVX_memset(src_buffer, 0xA5, buffer_size);
+
+  for(uint64_t v = 0; v < bench_variant_count; v++)
+  {
+    BENCH_VARIANT * variant = &bench_variants[v];
+
+    if((variant->Flags & BENCH_FLAG_NEEDS_AVX2) && !(AVX_Mem_Dispatch.Features & AVX_MEM_FEATURE_AVX2))
+    {
+      continue;
+    }
+    if((variant->Flags & BENCH_FLAG_NEEDS_AVX512F) && !(AVX_Mem_Dispatch.Features & AVX_MEM_FEATURE_AVX512F))
+    {
+      continue;
+    }
+    if((variant->Flags & BENCH_FLAG_NEEDS_AVX512BW) && !(AVX_Mem_Dispatch.Features & AVX_MEM_FEATURE_AVX512BW))
+    {
+      continue;
+    }
+
+    for(uint64_t size = BENCH_MIN_SIZE; size <= buffer_size; size <<= 2)
+    {
+      if(size < variant->Unit)
+      {
+        continue;
+      }
+
+      for(uint32_t test_case = 0; test_case < BENCH_CASES; test_case++)
+      {
+        char * dest = (char*)dest_buffer;
+        char * src = (char*)src_buffer;
+
+        switch(test_case)
+        {
+          case BENCHMARK_CASE_ALIGNED:
+            break;
+
+          case BENCHMARK_CASE_DEST_UNALIGNED:
+          case BENCHMARK_CASE_SRC_UNALIGNED:
+            if((variant->Flags & BENCH_FLAG_ALIGNED_ONLY) || (size == buffer_size))
+            {
+              continue;
+            }
+            if(test_case == BENCHMARK_CASE_DEST_UNALIGNED)
+            {
+              dest++;
+            }
+            else if(variant->Kind != BENCHMARK_KIND_MEMSET) // Sets don't have a source
+            {
+              src++;
+            }
+            else
+            {
+              continue;
+            }
+            break;
+
+          case BENCHMARK_CASE_OVERLAP_FORWARD:
+            if(!(variant->Flags & BENCH_FLAG_OVERLAP_FORWARD) || ((size + (size >> 1)) > buffer_size))
+            {
+              continue;
+            }
+            dest = (char*)src_buffer;
+            src = dest + (size >> 1);
+            break;
+
+          case BENCHMARK_CASE_OVERLAP_BACKWARD:
+            if(!(variant->Flags & BENCH_FLAG_OVERLAP_BACKWARD) || ((size + (size >> 1)) > buffer_size))
+            {
+              continue;
+            }
+            dest = (char*)src_buffer + (size >> 1);
+            break;
+        }
+
+        if(variant->Kind == BENCHMARK_KIND_MEMCMP)
+        {
+          // Worst case for a compare: equal all the way to the end
+          AVX_memcpy(dest, src, size);
+        }
+
+        uint64_t iterations = BENCH_BATCH_BYTES / size;
+        if(iterations == 0)
+        {
+          iterations = 1;
+        }
+        uint64_t samples = (size >= BENCH_LARGE_SIZE) ? BENCH_LARGE_SAMPLES : BENCH_SAMPLES;
+        uint64_t best = ~0ULL;
+
+        for(uint64_t sample = 0; sample < samples; sample++)
+        {
+          uint64_t start = bench_tick_start();
+          for(uint64_t i = 0; i < iterations; i++)
+          {
+            variant->Function(dest, src, size);
+          }
+          uint64_t end = bench_tick_end();
+
+          uint64_t ticks = end - start;
+          ticks = (ticks > overhead) ? (ticks - overhead) : 1;
+          if(ticks < best)
+          {
+            best = ticks;
+          }
+        }
+
+        uint64_t bytes = size * iterations;
+        uint64_t milli_bytes_per_tick = (bytes * 1000) / best;
+        uint64_t mb_per_second = tsc_mhz ? ((bytes * tsc_mhz) / best) : 0;
+
+        printf("%-26s %-6s %-8s %14qu %6qu.%03qu %6qu.%03qu\r\n", variant->Name, bench_size_string(size, size_string), case_names[test_case], best / iterations,
+                                                              milli_bytes_per_tick / 1000, milli_bytes_per_tick % 1000, mb_per_second / 1000, mb_per_second % 1000);
+
+        if((results != NULL) && (results->Count < results->Capacity))
+        {
+          BENCHMARK_ENTRY * entry = &results->Entries[results->Count];
+          AVX_memset(entry, 0, sizeof(BENCHMARK_ENTRY));
+
+          uint64_t n = 0;
+          for(; (n < sizeof(entry->Name) - 1) && (variant->Name[n] != '\0'); n++)
+          {
+            entry->Name[n] = variant->Name[n];
+          }
+
+          entry->Size = size;
+          entry->Iterations = iterations;
+          entry->Ticks = best;
+          entry->Kind = variant->Kind;
+          entry->Case = test_case;
+          entry->Milli_Bytes_Per_Tick = (uint32_t)milli_bytes_per_tick;
+          entry->MB_Per_Second = (uint32_t)mb_per_second;
+          results->Count++;
+        }
+      }
+    }
+  }
+
+  freepages(dest_buffer, buffer_size >> 12);
+  freepages(src_buffer, buffer_size >> 12);
+
+  if(results != NULL)
+  {
+    printf("Benchmark results: %qu entries of %qu bytes at %#qx\r\n", results->Count, (uint64_t)results->Entry_Size, (uint64_t)results);
+  }
+
+  Global_Benchmark_Results = results;
+  return results;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  bench_register_all: Build the Variant Table
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// This is done at runtime instead of with a static initializer, since a static table of function pointers would need relocating by
+// the bootloader.
+//
+
+#define BENCH_COPY_ADD(function, unit, flags) bench_add(#function, bench_##function, unit, BENCHMARK_KIND_MEMCPY, flags);
+#define BENCH_MOVE_ADD(function, unit, flags) bench_add(#function, bench_##function, unit, BENCHMARK_KIND_MEMMOVE, flags);
+#define BENCH_SET_ADD(function, unit, flags, value) bench_add(#function, bench_##function, unit, BENCHMARK_KIND_MEMSET, flags);
+#define BENCH_CMP_ADD(function, unit, flags) bench_add(#function, bench_##function, unit, BENCHMARK_KIND_MEMCMP, flags);
+
+static void bench_register_all(void)
+{
+  bench_variant_count = 0;
+
+  BENCH_MEMCPY_ALL(BENCH_COPY_ADD)
+  BENCH_MEMMOVE_ALL(BENCH_MOVE_ADD)
+  BENCH_MEMSET_ALL(BENCH_SET_ADD)
+  bench_add("memset_zeroes", bench_memset_zeroes, 1, BENCHMARK_KIND_MEMSET, U);
+  bench_add("memset_zeroes_a", bench_memset_zeroes_a, 1, BENCHMARK_KIND_MEMSET, A);
+  bench_add("memset_zeroes_as", bench_memset_zeroes_as, 1, BENCHMARK_KIND_MEMSET, A);
+  BENCH_MEMCMP_ALL(BENCH_CMP_ADD)
+  bench_add("AVX_memcmp", bench_AVX_memcmp, 1, BENCHMARK_KIND_MEMCMP, U);
+  bench_add("AVX_memcmp (eq)", bench_AVX_memcmp_eq, 1, BENCHMARK_KIND_MEMCMP, U);
+  bench_add("AVX_memcmp_native", bench_AVX_memcmp_native, 1, BENCHMARK_KIND_MEMCMP, U);
+  bench_add("AVX_memcmp_native (eq)", bench_AVX_memcmp_native_eq, 1, BENCHMARK_KIND_MEMCMP, U);
+  bench_add("AVX_memcmp_avx2", bench_AVX_memcmp_avx2, 1, BENCHMARK_KIND_MEMCMP, BENCH_FLAG_NEEDS_AVX2);
+  bench_add("AVX_memcmp_avx2 (eq)", bench_AVX_memcmp_avx2_eq, 1, BENCHMARK_KIND_MEMCMP, BENCH_FLAG_NEEDS_AVX2);
+  bench_add("AVX_memcmp_avx512", bench_AVX_memcmp_avx512, 1, BENCHMARK_KIND_MEMCMP, BENCH_FLAG_NEEDS_AVX512BW);
+  bench_add("AVX_memcmp_avx512 (eq)", bench_AVX_memcmp_avx512_eq, 1, BENCHMARK_KIND_MEMCMP, BENCH_FLAG_NEEDS_AVX512BW);
+}
+
+#undef U
+#undef A
+
+static void bench_add(const char * name, bench_function function, uint64_t unit, uint32_t kind, uint32_t flags)
+{
+  if(bench_variant_count < BENCH_MAX_VARIANTS)
+  {
+    bench_variants[bench_variant_count].Name = name;
+    bench_variants[bench_variant_count].Function = function;
+    bench_variants[bench_variant_count].Unit = unit;
+    bench_variants[bench_variant_count].Kind = kind;
+    bench_variants[bench_variant_count].Flags = flags;
+    bench_variant_count++;
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  bench_tick_start, bench_tick_end: Serialized get_tick()
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// CPUID before the start tick keeps earlier work from leaking into the timed region. RDTSCP (what get_tick() uses) at the end waits
+// for everything before it to finish, and CPUID after it keeps later work from starting early.
+//
+
+static uint64_t bench_tick_start(void)
+{
+  uint64_t rax = 0;
+  asm volatile("cpuid"
+               : "+a" (rax) // Outputs
+               : // Inputs
+               : "%rbx", "%rcx", "%rdx", "memory" // Clobbers
+              );
+
+  return get_tick();
+}
+
+static uint64_t bench_tick_end(void)
+{
+  uint64_t tick = get_tick();
+
+  uint64_t rax = 0;
+  asm volatile("cpuid"
+               : "+a" (rax) // Outputs
+               : // Inputs
+               : "%rbx", "%rcx", "%rdx", "memory" // Clobbers
+              );
+
+  return tick;
+}
+
+// Cost of an empty start/end pair
+static uint64_t bench_overhead(void)
+{
+  uint64_t best = ~0ULL;
+
+  for(uint64_t i = 0; i < 32; i++)
+  {
+    uint64_t start = bench_tick_start();
+    uint64_t end = bench_tick_end();
+    if((end - start) < best)
+    {
+      best = end - start;
+    }
+  }
+
+  return best;
+}
+
+// 64 -> "64B", 4096 -> "4kB", etc. Sizes here are always powers of 2.
+static const char * bench_size_string(uint64_t size, char * buffer)
+{
+  if(size >= (1ULL << 30))
+  {
+    sprintf(buffer, "%quGB", size >> 30);
+  }
+  else if(size >= (1ULL << 20))
+  {
+    sprintf(buffer, "%quMB", size >> 20);
+  }
+  else if(size >= (1ULL << 10))
+  {
+    sprintf(buffer, "%qukB", size >> 10);
+  }
+  else
+  {
+    sprintf(buffer, "%quB", size);
+  }
+
+  return buffer;
+}
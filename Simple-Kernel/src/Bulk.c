@@ -0,0 +1,490 @@
+//==================================================================================================================================
+//  Simple Kernel: Parallel Bulk Memory Operations
+//==================================================================================================================================
+//
+// Version 0.z
+//
+// Author:
+//  KNNSpeed
+//
+// Source Code:
+//  https://github.com/KNNSpeed/Simple-Kernel
+//
+// This file contains bulk_copy_async() and bulk_fill_async(), which split big AVX_memmove()/AVX_memset() jobs across whichever APs
+// are idle, and bulk_poll()/bulk_wait() to find out when they're done. bulk_copy() and bulk_fill() are the synchronous versions.
+//
+// A job is cut into chunks at BULK_CHUNK_SIZE-aligned destination addresses, so every chunk (other than the first and last) is whole
+// pages and never straddles a 2MB page. Each idle AP gets posted bulk_ap_worker() with SMP_Try_Run_On_CPU(), and every worker, including
+// a CPU in bulk_wait(), keeps claiming chunks until there are none left. APs running tasks or the deferred console never finish their
+// posted work, so they never look idle and never get used.
+//
+// With more than one NUMA node, chunks are grouped into runs whose destination is on the same node, and workers take chunks from their
+// own node's runs before helping with anyone else's. APs on the nodes that have the most chunks get posted first.
+//
+// Overlapping moves are done in waves: each wave covers at most as many bytes as the distance between source and destination, so no
+// chunk in a wave reads anything another one in the same wave writes, and a wave only starts once every earlier one has finished.
+// Waves go up from the bottom when the destination is below the source, and down from the top otherwise, just like AVX_memmove().
+//
+// Jobs smaller than the "bulkmin" kernel option (BULK_MIN_DEFAULT if not given), jobs posted before the APs are up, and jobs that no
+// AP is free for just run on the calling CPU before bulk_copy_async()/bulk_fill_async() returns.
+//
+
+#include "Kernel64.h"
+
+static void bulk_start(BULK_HANDLE * handle);
+static void bulk_split(BULK_HANDLE * handle);
+static uint64_t bulk_post(BULK_HANDLE * handle);
+static void bulk_ap_worker(void * arg);
+static void bulk_work(BULK_HANDLE * handle, uint64_t node);
+static uint64_t bulk_claim(BULK_HANDLE * handle, uint64_t node);
+static void bulk_chunk(BULK_HANDLE * handle, uint64_t chunk);
+static void bulk_run(BULK_HANDLE * handle, uint64_t offset, uint64_t length, uint8_t overlap);
+static uint8_t bulk_filled(const uint8_t * dest, uint8_t value, uint64_t length);
+static uint64_t bulk_node_of(uint64_t address);
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// bulk_copy_async: Start a Parallel memmove
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Start copying 'size' bytes from 'src' to 'dest' with AVX_memmove() semantics, so the two can overlap. 'handle' has to stay valid
+// and untouched until bulk_poll() returns 1 or bulk_wait() returns. Neither buffer should be touched until then, either.
+//
+// flags: BULK_STREAM to always use streaming stores, BULK_VERIFY to read each chunk back. Overlapping moves that get split into waves
+//        are verified too, since each chunk is checked before the next wave can overwrite its source, but ones too small or too
+//        close together for that run as a single AVX_memmove() that overwrites part of its own source, so those aren't verified.
+//
+
+void bulk_copy_async(BULK_HANDLE * handle, void * dest, const void * src, uint64_t size, uint64_t flags)
+{
+  handle->Dest = (uint8_t*)dest;
+  handle->Src = (uint8_t*)src;
+  handle->Size = size;
+  handle->Value = 0;
+  handle->Flags = flags;
+
+  bulk_start(handle);
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// bulk_fill_async: Start a Parallel memset
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Start setting 'size' bytes at 'dest' to 'value'. Same rules as bulk_copy_async().
+//
+
+void bulk_fill_async(BULK_HANDLE * handle, void * dest, uint8_t value, uint64_t size, uint64_t flags)
+{
+  handle->Dest = (uint8_t*)dest;
+  handle->Src = NULL;
+  handle->Size = size;
+  handle->Value = value;
+  handle->Flags = flags;
+
+  bulk_start(handle);
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// bulk_poll: Check Whether a Bulk Job Is Done
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Returns 1 once every chunk of the job has been done and no AP is looking at 'handle' anymore, else 0. Doesn't do any of the work.
+//
+
+uint8_t bulk_poll(BULK_HANDLE * handle)
+{
+  return (__atomic_load_n(&handle->Done, __ATOMIC_ACQUIRE) == handle->Chunk_Count) && (__atomic_load_n(&handle->Workers, __ATOMIC_ACQUIRE) == 0);
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// bulk_wait: Finish a Bulk Job
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Help with whatever chunks haven't been claimed yet, then wait for the APs to finish theirs. Returns 0, or with BULK_VERIFY, the
+// address of a chunk that didn't read back the way it should have.
+//
+
+uint64_t bulk_wait(BULK_HANDLE * handle)
+{
+  if(__atomic_load_n(&handle->Done, __ATOMIC_ACQUIRE) != handle->Chunk_Count)
+  {
+    bulk_work(handle, get_cpu_data()->NUMA_Node);
+  }
+
+  while(!bulk_poll(handle))
+  {
+    asm volatile("pause");
+  }
+
+  return handle->Failed;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// bulk_copy: Parallel memmove
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// bulk_copy_async() and bulk_wait() in one go. Returns 'dest', like AVX_memmove().
+//
+
+void * bulk_copy(void * dest, const void * src, uint64_t size)
+{
+  BULK_HANDLE handle;
+
+  bulk_copy_async(&handle, dest, src, size, 0);
+  bulk_wait(&handle);
+
+  return dest;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// bulk_fill: Parallel memset
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// bulk_fill_async() and bulk_wait() in one go. Returns 'dest', like AVX_memset().
+//
+
+void * bulk_fill(void * dest, uint8_t value, uint64_t size)
+{
+  BULK_HANDLE handle;
+
+  bulk_fill_async(&handle, dest, value, size, 0);
+  bulk_wait(&handle);
+
+  return dest;
+}
+
+// Cut a job into chunks and hand it out, or just do it if it isn't worth splitting up
+static void bulk_start(BULK_HANDLE * handle)
+{
+  uint64_t min_size = Global_Kernel_Options.Bulk_Min ? Global_Kernel_Options.Bulk_Min : BULK_MIN_DEFAULT;
+  uint64_t shift = BULK_CHUNK_SHIFT;
+  uint64_t distance = 0;
+  uint8_t overlap = 0;
+
+  handle->Reverse = 0;
+  handle->Wave_Chunks = 0;
+  handle->Chunk_Count = 0;
+  handle->Segment_Count = 0;
+  handle->Done = 0;
+  handle->Workers = 0;
+  handle->Failed = 0;
+
+  if((handle->Size == 0) || (handle->Src == handle->Dest))
+  {
+    return; // Nothing to do, so it's already done
+  }
+
+  if(handle->Src != NULL)
+  {
+    distance = (handle->Dest > handle->Src) ? (uint64_t)(handle->Dest - handle->Src) : (uint64_t)(handle->Src - handle->Dest);
+    if(distance < handle->Size)
+    {
+      overlap = 1;
+      handle->Reverse = (handle->Dest > handle->Src);
+
+      // At least 2 chunks per wave, or there's nothing to run side by side
+      if((distance >> 1) >= EFI_PAGE_SIZE)
+      {
+        uint64_t wave_shift = 63 - __builtin_clzll(distance >> 1);
+        if(wave_shift < shift)
+        {
+          shift = wave_shift;
+        }
+      }
+    }
+  }
+
+  if((Global_SMP_Info.Online_CPUs < 2) || (handle->Size < min_size) || (overlap && ((distance >> 1) < EFI_PAGE_SIZE)))
+  {
+    bulk_run(handle, 0, handle->Size, overlap);
+    handle->Chunk_Count = 1;
+    handle->Done = 1;
+    return;
+  }
+
+  uint64_t mask = (1ULL << shift) - 1;
+  handle->Chunk_Shift = shift;
+  handle->Chunk_Base = (uint64_t)handle->Dest & ~mask;
+  handle->Chunk_Count = ((uint64_t)handle->Dest + handle->Size - handle->Chunk_Base + mask) >> shift;
+  if(overlap)
+  {
+    handle->Wave_Chunks = distance >> shift;
+  }
+
+  bulk_split(handle);
+
+  if(bulk_post(handle) == 0)
+  {
+    // No AP to give it to
+    bulk_run(handle, 0, handle->Size, overlap);
+    handle->Done = handle->Chunk_Count;
+  }
+}
+
+// Group chunks into runs with their destination on the same node. Without NUMA, or for overlapping moves, there's just one run.
+static void bulk_split(BULK_HANDLE * handle)
+{
+  if((Global_NUMA.Nodes < 2) || handle->Wave_Chunks)
+  {
+    handle->Segments[0].First = 0;
+    handle->Segments[0].Count = handle->Chunk_Count;
+    handle->Segments[0].Node = NUMA_NO_NODE;
+    handle->Segments[0].Next = 0;
+    handle->Segment_Count = 1;
+    return;
+  }
+
+  for(uint64_t chunk = 0; chunk < handle->Chunk_Count; chunk++)
+  {
+    uint64_t address = handle->Chunk_Base + (chunk << handle->Chunk_Shift);
+    if(address < (uint64_t)handle->Dest)
+    {
+      address = (uint64_t)handle->Dest;
+    }
+
+    uint64_t node = bulk_node_of(address);
+    BULK_SEGMENT * last = handle->Segment_Count ? &handle->Segments[handle->Segment_Count - 1] : NULL;
+
+    if((last != NULL) && (last->Node == node))
+    {
+      last->Count++;
+    }
+    else if(handle->Segment_Count < BULK_MAX_SEGMENTS)
+    {
+      BULK_SEGMENT * segment = &handle->Segments[handle->Segment_Count];
+      segment->First = chunk;
+      segment->Count = 1;
+      segment->Node = node;
+      segment->Next = 0;
+      handle->Segment_Count++;
+    }
+    else if(last != NULL)
+    {
+      // Out of runs: the last one takes everything that's left, for whoever gets to it
+      last->Count++;
+      last->Node = NUMA_NO_NODE;
+    }
+  }
+}
+
+// Post bulk_ap_worker() to idle APs, ones on the nodes that have chunks first. Returns how many got it.
+static uint64_t bulk_post(BULK_HANDLE * handle)
+{
+  uint64_t node_chunks[NUMA_MAX_NODES] = {0};
+  uint64_t self = get_cpu_index();
+  uint64_t wanted = handle->Chunk_Count;
+  uint64_t posted = 0;
+
+  if(handle->Wave_Chunks && (handle->Wave_Chunks < wanted))
+  {
+    wanted = handle->Wave_Chunks; // Any more would only wait for the next wave
+  }
+
+  for(uint64_t i = 0; i < handle->Segment_Count; i++)
+  {
+    if(handle->Segments[i].Node < NUMA_MAX_NODES)
+    {
+      node_chunks[handle->Segments[i].Node] += handle->Segments[i].Count;
+    }
+  }
+
+  // SMP_Try_Run_On_CPU() never waits, so an AP that another CPU posts to first (or that got busy since the check below) just gets
+  // skipped, and an interrupted bulk job on this CPU can't deadlock a nested one
+  for(uint64_t pass = 0; pass < 2; pass++)
+  {
+    for(uint64_t cpu = 1; (cpu < Global_SMP_Info.Number_of_CPUs) && (posted < wanted); cpu++)
+    {
+      PER_CPU_STRUCT * cpu_data = &Global_Per_CPU_Data[cpu];
+
+      if((cpu == self) || !cpu_data->Online || (__atomic_load_n(&cpu_data->Work_Done, __ATOMIC_ACQUIRE) != __atomic_load_n(&cpu_data->Work_Sequence, __ATOMIC_ACQUIRE)))
+      {
+        continue;
+      }
+
+      // First pass: only APs on a node with chunks left over for them. Second pass: anyone idle.
+      if(pass == 0)
+      {
+        if((cpu_data->NUMA_Node >= NUMA_MAX_NODES) || (node_chunks[cpu_data->NUMA_Node] == 0))
+        {
+          continue;
+        }
+        node_chunks[cpu_data->NUMA_Node]--;
+      }
+
+      __atomic_add_fetch(&handle->Workers, 1, __ATOMIC_RELEASE);
+      if(SMP_Try_Run_On_CPU(cpu, bulk_ap_worker, handle))
+      {
+        posted++;
+      }
+      else
+      {
+        __atomic_sub_fetch(&handle->Workers, 1, __ATOMIC_RELEASE);
+      }
+    }
+  }
+
+  return posted;
+}
+
+// What APs run. The decrement of Workers is the last time the AP touches 'handle'.
+static void bulk_ap_worker(void * arg)
+{
+  BULK_HANDLE * handle = (BULK_HANDLE*)arg;
+
+  bulk_work(handle, get_cpu_data()->NUMA_Node);
+  __atomic_sub_fetch(&handle->Workers, 1, __ATOMIC_RELEASE);
+}
+
+// Do chunks until there aren't any left to claim
+static void bulk_work(BULK_HANDLE * handle, uint64_t node)
+{
+  uint64_t chunk;
+
+  while((chunk = bulk_claim(handle, node)) != ~0ULL)
+  {
+    bulk_chunk(handle, chunk);
+  }
+}
+
+// Claim the next chunk, from a run on 'node' if there are any left. Returns ~0ULL once everything's been claimed.
+static uint64_t bulk_claim(BULK_HANDLE * handle, uint64_t node)
+{
+  for(uint64_t pass = 0; pass < 2; pass++)
+  {
+    for(uint64_t i = 0; i < handle->Segment_Count; i++)
+    {
+      BULK_SEGMENT * segment = &handle->Segments[i];
+
+      if(((pass == 0) && (segment->Node != node)) || (__atomic_load_n(&segment->Next, __ATOMIC_RELAXED) >= segment->Count))
+      {
+        continue;
+      }
+
+      // Next can go past Count when a few CPUs race for the last chunk, which is fine
+      uint64_t index = __atomic_fetch_add(&segment->Next, 1, __ATOMIC_RELAXED);
+      if(index < segment->Count)
+      {
+        return segment->First + index;
+      }
+    }
+  }
+
+  return ~0ULL;
+}
+
+// Do one chunk. Chunk numbers go in the order that waves have to happen in.
+static void bulk_chunk(BULK_HANDLE * handle, uint64_t chunk)
+{
+  if(handle->Wave_Chunks)
+  {
+    // Chunks are claimed in order from a single run, so the first Done chunks are exactly the ones from earlier waves
+    uint64_t wave_start = chunk - (chunk % handle->Wave_Chunks);
+    while(__atomic_load_n(&handle->Done, __ATOMIC_ACQUIRE) < wave_start)
+    {
+      asm volatile("pause");
+    }
+  }
+
+  uint64_t position = handle->Reverse ? (handle->Chunk_Count - 1 - chunk) : chunk;
+  uint64_t dest = (uint64_t)handle->Dest;
+  uint64_t start = handle->Chunk_Base + (position << handle->Chunk_Shift);
+  uint64_t end = start + (1ULL << handle->Chunk_Shift);
+
+  if(start < dest)
+  {
+    start = dest;
+  }
+  if(end > dest + handle->Size)
+  {
+    end = dest + handle->Size;
+  }
+
+  bulk_run(handle, start - dest, end - start, 0);
+
+  __atomic_add_fetch(&handle->Done, 1, __ATOMIC_RELEASE);
+}
+
+// Copy or fill 'length' bytes at 'offset' into the job, and verify them if asked to
+static void bulk_run(BULK_HANDLE * handle, uint64_t offset, uint64_t length, uint8_t overlap)
+{
+  uint8_t * dest = handle->Dest + offset;
+  uint8_t stream = (handle->Flags & BULK_STREAM) || (handle->Size > AVX_Mem_Dispatch.NT_Threshold); // Goes by the whole job, not the chunk
+  uint8_t failed = 0;
+
+  if(handle->Src != NULL)
+  {
+    uint8_t * src = handle->Src + offset;
+
+    if(overlap)
+    {
+      AVX_memmove(dest, src, length);
+      return;
+    }
+
+    if(stream && ((((uint64_t)dest | (uint64_t)src) & 63) == 0))
+    {
+      memcpy_large_as(dest, src, length);
+    }
+    else
+    {
+      AVX_memcpy(dest, src, length);
+    }
+
+    failed = (handle->Flags & BULK_VERIFY) && AVX_memcmp(dest, src, length, 0);
+  }
+  else
+  {
+    if(stream && (((uint64_t)dest & 63) == 0))
+    {
+      if(handle->Value == 0)
+      {
+        memset_zeroes_as(dest, length);
+      }
+      else
+      {
+        memset_large_as(dest, (uint8_t)handle->Value, length);
+      }
+    }
+    else
+    {
+      AVX_memset(dest, (uint8_t)handle->Value, length);
+    }
+
+    failed = (handle->Flags & BULK_VERIFY) && !bulk_filled(dest, (uint8_t)handle->Value, length);
+  }
+
+  if(failed)
+  {
+    __atomic_store_n(&handle->Failed, (uint64_t)dest, __ATOMIC_RELAXED);
+  }
+}
+
+// Returns 1 if all 'length' bytes at 'dest' are 'value'. Past the first 64, every byte has to match the one 64 bytes before it.
+static uint8_t bulk_filled(const uint8_t * dest, uint8_t value, uint64_t length)
+{
+  if(value == 0)
+  {
+    return AVX_is_all_zero(dest, length);
+  }
+
+  uint64_t head = (length < 64) ? length : 64;
+  for(uint64_t i = 0; i < head; i++)
+  {
+    if(dest[i] != value)
+    {
+      return 0;
+    }
+  }
+
+  return (length <= 64) || (AVX_memcmp(dest + 64, dest, length - 64, 0) == 0);
+}
+
+// Node of the memory at a kernel address, NUMA_NO_NODE for Vmalloc() memory, which might not even be backed yet
+static uint64_t bulk_node_of(uint64_t address)
+{
+  if((address >= Global_Vmalloc.Base) && (address < Global_Vmalloc.End))
+  {
+    return NUMA_NO_NODE;
+  }
+
+  return NUMA_Node_Of_Address(address);
+}
@@ -0,0 +1,331 @@
+//==================================================================================================================================
+//  Simple Kernel: TSC Clocksource
+//==================================================================================================================================
+//
+// Version 0.z
+//
+// Author:
+//  KNNSpeed
+//
+// Source Code:
+//  https://github.com/KNNSpeed/Simple-Kernel
+//
+// This file finds out how fast the TSC runs and turns TSC ticks into time. In order of preference, the frequency comes from:
+//  1. CPUID leaf 0x15, when it gives the crystal frequency as well as the TSC/crystal ratio (exact)
+//  2. Counting TSC ticks over CLOCK_CALIBRATION_US of the HPET, found via the ACPI HPET table
+//  3. The same against the ACPI PM timer, found via the FADT
+//  4. CPUID leaf 0x16's base frequency
+// and if none of those work, 5000 MHz is assumed so that delays are at least long enough.
+//
+// Conversions use 32.32 fixed-point multipliers worked out once here, so now_ns(), delay_us(), cycles_to_ns(), and ns_to_cycles() are
+// a multiply and a shift with no division. The product is 128 bits wide, so they don't overflow for any 64-bit input.
+//
+// The TSC should be invariant (CPUID 0x80000007 %rdx bit 8) for any of this to mean much; Setup_Clock() says so if it isn't.
+//
+
+#include "Kernel64.h"
+
+// How long to count TSC ticks against the HPET or PM timer. 20ms of a 3.58MHz PM timer is good to about 15ppm.
+#define CLOCK_CALIBRATION_US 20000
+
+#define PM_TIMER_HZ 3579545
+
+static volatile uint64_t * clock_hpet = NULL; // HPET register block
+static uint64_t clock_hpet_32bit = 0;
+static uint16_t clock_pm_port = 0;
+static uint64_t clock_pm_mask = 0;
+
+static uint64_t clock_cpuid_15(void);
+static uint64_t clock_cpuid_16(void);
+static uint64_t clock_find_hpet(void);
+static uint64_t clock_find_pm_timer(void);
+static uint64_t clock_read_hpet(void);
+static uint64_t clock_read_pm_timer(void);
+static uint64_t clock_calibrate(uint64_t (*read)(void), uint64_t frequency, uint64_t mask);
+static uint64_t clock_rdtsc(void);
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Setup_Clock: Find the TSC Frequency
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Fill in Global_Clock and Global_SMP_Info.TSC_MHz. Needs ACPI_Init() and Setup_Paging() (for the HPET's MMIO), and has to run
+// before anything uses TSC_MHz, which starts with Setup_SMP().
+//
+
+void Setup_Clock(void)
+{
+  uint64_t rdx = 0;
+  asm volatile("cpuid"
+               : "=d" (rdx) // Outputs
+               : "a" (0x80000007) // The value to put into %rax
+               : "%rbx", "%rcx" // CPUID clobbers all not-explicitly-used abcd registers
+             );
+  Global_Clock.Invariant = (rdx >> 8) & 1;
+
+  uint64_t hz = clock_cpuid_15();
+  uint64_t source = CLOCK_SOURCE_CPUID_15;
+
+  if(hz == 0)
+  {
+    uint64_t hpet_hz = clock_find_hpet();
+    if(hpet_hz)
+    {
+      hz = clock_calibrate(clock_read_hpet, hpet_hz, clock_hpet_32bit ? 0xFFFFFFFFULL : ~0ULL);
+      source = CLOCK_SOURCE_HPET;
+    }
+  }
+
+  if((hz == 0) && clock_find_pm_timer())
+  {
+    hz = clock_calibrate(clock_read_pm_timer, PM_TIMER_HZ, clock_pm_mask);
+    source = CLOCK_SOURCE_PM_TIMER;
+  }
+
+  if(hz == 0)
+  {
+    hz = clock_cpuid_16();
+    source = CLOCK_SOURCE_CPUID_16;
+  }
+
+  if(hz == 0)
+  {
+    hz = 5000000000ULL;
+    source = CLOCK_SOURCE_GUESS;
+  }
+
+  Global_Clock.Source = source;
+  Global_Clock.TSC_Hz = hz;
+
+  // Split up so that nothing overflows: 10^9 << 32 fits in 64 bits, and so does anything under 10^9 shifted by 32
+  Global_Clock.NS_Mult = (1000000000ULL << CLOCK_SHIFT) / hz;
+  Global_Clock.Tick_Mult = ((hz / 1000000000ULL) << CLOCK_SHIFT) + (((hz % 1000000000ULL) << CLOCK_SHIFT) / 1000000000ULL);
+
+  Global_Clock.Base_TSC = clock_rdtsc();
+  Global_SMP_Info.TSC_MHz = (hz + 500000) / 1000000;
+
+  static const char * const source_names[] = {"assumed", "CPUID 0x15", "HPET", "ACPI PM timer", "CPUID 0x16"};
+  printf("Clock: TSC %qu.%06qu MHz (%s)%s\r\n", hz / 1000000, hz % 1000000, source_names[source], Global_Clock.Invariant ? "" : ", not invariant");
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// now_ns: Nanoseconds Since Setup_Clock()
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Uses RDTSCP (see get_tick()), so earlier instructions have finished before the timestamp is taken.
+//
+
+uint64_t now_ns(void)
+{
+  return cycles_to_ns(get_tick() - Global_Clock.Base_TSC);
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// delay_us: Spin for a While
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Busy-wait with PAUSE for at least 'microseconds'. Use Timer_Sleep_us() or Task_Sleep_us() for anything long, which can halt or run
+// other tasks instead.
+//
+
+void delay_us(uint64_t microseconds)
+{
+  uint64_t start = get_tick();
+  uint64_t ticks = ns_to_cycles(microseconds * 1000);
+
+  while((get_tick() - start) < ticks)
+  {
+    asm volatile("pause");
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// cycles_to_ns, ns_to_cycles: Convert Between TSC Ticks and Time
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Both return 0 before Setup_Clock() has run.
+//
+
+uint64_t cycles_to_ns(uint64_t cycles)
+{
+  return (uint64_t)(((unsigned __int128)cycles * Global_Clock.NS_Mult) >> CLOCK_SHIFT);
+}
+
+uint64_t ns_to_cycles(uint64_t ns)
+{
+  return (uint64_t)(((unsigned __int128)ns * Global_Clock.Tick_Mult) >> CLOCK_SHIFT);
+}
+
+// Exact TSC frequency from CPUID leaf 0x15, or 0 if it doesn't give the crystal frequency
+static uint64_t clock_cpuid_15(void)
+{
+  uint64_t rax = 0, rbx = 0, rcx = 0, rdx = 0;
+
+  asm volatile("cpuid"
+               : "=a" (rax), "=b" (rbx), "=c" (rcx), "=d" (rdx) // Outputs
+               : "a" (0x00), "c" (0x00) // The values to put into %rax and %rcx
+               : // No clobbers
+             );
+  if(rax < 0x15)
+  {
+    return 0;
+  }
+
+  asm volatile("cpuid"
+               : "=a" (rax), "=b" (rbx), "=c" (rcx), "=d" (rdx) // Outputs
+               : "a" (0x15), "c" (0x00) // The values to put into %rax and %rcx
+               : // No clobbers
+             );
+  if((rax == 0) || (rbx == 0) || (rcx == 0))
+  {
+    return 0;
+  }
+
+  return (rcx * rbx) / rax; // Crystal Hz * TSC/crystal ratio
+}
+
+// Base frequency from CPUID leaf 0x16 in Hz, or 0 if there isn't one
+static uint64_t clock_cpuid_16(void)
+{
+  uint64_t rax = 0, rbx = 0, rcx = 0, rdx = 0;
+
+  asm volatile("cpuid"
+               : "=a" (rax), "=b" (rbx), "=c" (rcx), "=d" (rdx) // Outputs
+               : "a" (0x00), "c" (0x00) // The values to put into %rax and %rcx
+               : // No clobbers
+             );
+  if(rax < 0x16)
+  {
+    return 0;
+  }
+
+  asm volatile("cpuid"
+               : "=a" (rax), "=b" (rbx), "=c" (rcx), "=d" (rdx) // Outputs
+               : "a" (0x16), "c" (0x00) // The values to put into %rax and %rcx
+               : // No clobbers
+             );
+  return (rax & 0xFFFF) * 1000000;
+}
+
+// Find the HPET, start its main counter if firmware didn't, and return its frequency (0 if there's no usable HPET)
+static uint64_t clock_find_hpet(void)
+{
+  HPET_TABLE_STRUCT * table = (HPET_TABLE_STRUCT *)ACPI_Find_Table("HPET", 0);
+  if((table == NULL) || (table->BaseAddress.AddressSpaceID != 0) || (table->BaseAddress.Address == 0))
+  {
+    return 0;
+  }
+
+  clock_hpet = (volatile uint64_t *)table->BaseAddress.Address;
+
+  uint64_t capabilities = clock_hpet[0]; // General Capabilities and ID
+  uint64_t period_fs = capabilities >> 32; // Femtoseconds per tick, at most 100ns
+  if((period_fs == 0) || (period_fs > 100000000))
+  {
+    return 0;
+  }
+  clock_hpet_32bit = !(capabilities & (1 << 13)); // COUNT_SIZE_CAP
+
+  clock_hpet[0x10 / 8] |= 1; // General Configuration: ENABLE_CNF
+
+  return 1000000000000000ULL / period_fs;
+}
+
+// Find the ACPI PM timer's I/O port, returns 1 if there is one
+static uint64_t clock_find_pm_timer(void)
+{
+  uint8_t * fadt = (uint8_t *)ACPI_Find_Table("FACP", 0);
+  if(fadt == NULL)
+  {
+    return 0;
+  }
+
+  uint32_t length = ((SDT_HEADER_STRUCT *)fadt)->Length;
+  uint32_t flags = *(uint32_t *)&fadt[FADT_FLAGS];
+  if(flags & FADT_FLAG_HW_REDUCED_ACPI)
+  {
+    return 0;
+  }
+
+  uint64_t port = *(uint32_t *)&fadt[FADT_PM_TMR_BLK];
+  if(length >= FADT_X_PM_TMR_BLK + sizeof(ACPI_GAS_STRUCT))
+  {
+    ACPI_GAS_STRUCT * x_pm_tmr = (ACPI_GAS_STRUCT *)&fadt[FADT_X_PM_TMR_BLK];
+    if((x_pm_tmr->AddressSpaceID == 1) && x_pm_tmr->Address)
+    {
+      port = x_pm_tmr->Address;
+    }
+  }
+
+  if((port == 0) || (port > 0xFFFF))
+  {
+    return 0;
+  }
+
+  clock_pm_port = (uint16_t)port;
+  clock_pm_mask = (flags & FADT_FLAG_TMR_VAL_EXT) ? 0xFFFFFFFFULL : 0xFFFFFFULL;
+  return 1;
+}
+
+// HPET main counter
+static uint64_t clock_read_hpet(void)
+{
+  if(clock_hpet_32bit)
+  {
+    return ((volatile uint32_t *)clock_hpet)[0xF0 / 4];
+  }
+  return clock_hpet[0xF0 / 8];
+}
+
+// ACPI PM timer
+static uint64_t clock_read_pm_timer(void)
+{
+  return portio_rw(clock_pm_port, 0, 4, 0) & clock_pm_mask;
+}
+
+// TSC frequency measured against a reference counter running at 'frequency' Hz, which wraps at 'mask'. Returns 0 if the reference
+// counter doesn't seem to be counting.
+static uint64_t clock_calibrate(uint64_t (*read)(void), uint64_t frequency, uint64_t mask)
+{
+  uint64_t target = (frequency * CLOCK_CALIBRATION_US) / 1000000;
+
+  // Start right on an edge of the reference counter, so that its resolution doesn't matter much
+  uint64_t spins = 0;
+  uint64_t first = read();
+  uint64_t start = first;
+  while(start == first)
+  {
+    start = read();
+    if(++spins > 10000000)
+    {
+      return 0;
+    }
+  }
+  uint64_t tsc_start = clock_rdtsc();
+
+  uint64_t elapsed = 0;
+  uint64_t tsc_end = tsc_start;
+  while(elapsed < target)
+  {
+    elapsed = (read() - start) & mask;
+    tsc_end = clock_rdtsc();
+
+    if((tsc_end - tsc_start) > 50000000000ULL) // 10 seconds even at 5 GHz
+    {
+      return 0;
+    }
+  }
+
+  return ((tsc_end - tsc_start) * frequency) / elapsed;
+}
+
+// Read the TSC
+static uint64_t clock_rdtsc(void)
+{
+  uint64_t high = 0, low = 0;
+  asm volatile("rdtsc"
+               : "=a" (low), "=d" (high) // Outputs
+               : // Inputs
+               : // Clobbers
+              );
+  return (high << 32) | low;
+}
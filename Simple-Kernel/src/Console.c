@@ -0,0 +1,409 @@
+//==================================================================================================================================
+//  Simple Kernel: Deferred Console
+//==================================================================================================================================
+//
+// Version 0.z
+//
+// Author:
+//  KNNSpeed
+//
+// Source Code:
+//  https://github.com/KNNSpeed/Simple-Kernel
+//
+// This file contains the deferred console: when it's on, printf() formats into Global_Console's byte ring instead of drawing, and the
+// text gets drawn later in batches by Console_Flush(). That can be called from anywhere, like an idle loop or a timer tick, or one AP
+// can be dedicated to it with Console_Start_Renderer().
+//
+// Writers never wait on each other or on drawing. Each printf() reserves space for a record (a 4-byte header plus the text) with a
+// compare-and-swap on Global_Console.Head, copies its text in, and then publishes the record by setting the header's ready bit. Flushing
+// draws records in order until it reaches one that isn't ready yet, then zeroes them and advances Global_Console.Tail to free up the
+// space. Only one CPU draws at a time; a Console_Flush() that finds another CPU drawing just returns.
+//
+// If the ring is full, printf() tries to flush it itself, and if it can't (e.g. it interrupted a flush) the text is dropped and counted
+// in Global_Console.Dropped. Exception handlers call Console_Panic(), which draws what's queued and switches printf() back to drawing
+// directly so that panic messages always make it to the screen.
+//
+// Flushed text goes to the framebuffer, the serial console (Serial.c), or both, depending on Console_Set_Sinks(). With the serial
+// sink on, printf() queues here even when the console isn't deferred, and then flushes right away.
+//
+
+#include "Kernel64.h"
+
+// Header bit 31 marks a record as complete, bits 30:0 are the text length
+#define CONSOLE_RECORD_READY 0x80000000U
+
+// How long Console_Panic() waits for another CPU to finish drawing before drawing anyway
+#define CONSOLE_PANIC_SPINS (1ULL << 24)
+
+// Local formatting buffer for Console_vprintf(). Text longer than this gets queued as multiple records.
+typedef struct {
+  uint64_t length;
+  char     text[CONSOLE_CHUNK_SIZE];
+} CONSOLE_CHUNK;
+
+static void console_putchar(int output_character, void * arg);
+static uint8_t console_write(const char * text, uint64_t length);
+static void console_copy_in(uint64_t offset, const char * text, uint64_t length);
+static void console_draw_queued(void);
+static void console_emit(const char * text, uint64_t length);
+static void console_renderer(void * arg);
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Console_Set_Deferred: Turn the Deferred Console On or Off
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// deferred: 1 to have printf() queue text for Console_Flush(), 0 to have printf() draw immediately. Turning it off draws anything still
+// queued first.
+//
+
+void Console_Set_Deferred(uint64_t deferred)
+{
+  if(deferred)
+  {
+    __atomic_store_n(&Global_Console.Deferred, 1, __ATOMIC_RELEASE);
+  }
+  else
+  {
+    __atomic_store_n(&Global_Console.Deferred, 0, __ATOMIC_RELEASE);
+
+    // A dedicated renderer stops on its own once it sees this
+    if(Global_Console.Renderer_CPU)
+    {
+      SMP_Wait_On_CPU(Global_Console.Renderer_CPU);
+      Global_Console.Renderer_CPU = 0;
+    }
+
+    Console_Flush();
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Console_Set_Sinks: Choose Where Text Goes
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// sinks: CONSOLE_SINK_FRAMEBUFFER, CONSOLE_SINK_SERIAL, or both. The serial sink needs Setup_Serial() to have found a port, and
+// without any sink printf() would go nowhere, so both of those cases fall back to the framebuffer.
+//
+
+void Console_Set_Sinks(uint64_t sinks)
+{
+  if((sinks & CONSOLE_SINK_SERIAL) && (Global_Serial.Port == 0))
+  {
+    printf("Console_Set_Sinks: No serial port has been set up.\r\n");
+    sinks &= ~(uint64_t)CONSOLE_SINK_SERIAL;
+  }
+
+  if((sinks & (CONSOLE_SINK_FRAMEBUFFER | CONSOLE_SINK_SERIAL)) == 0)
+  {
+    sinks = CONSOLE_SINK_FRAMEBUFFER;
+  }
+
+  __atomic_store_n(&Global_Console.Sinks, sinks, __ATOMIC_RELEASE);
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Console_vprintf: Queue Formatted Text
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// printf() and vprintf() call this when Global_Console.Deferred is set or the serial sink is on. Formats into a stack buffer, then
+// copies that into the ring. Flushes afterwards if the console isn't deferred.
+//
+// Returns the number of characters formatted, like printf()
+//
+
+int Console_vprintf(const char * fmt, va_list ap)
+{
+  CONSOLE_CHUNK chunk;
+  chunk.length = 0;
+
+  int retval = kvprintf(fmt, console_putchar, &chunk, 10, ap);
+
+  if(chunk.length)
+  {
+    console_write(chunk.text, chunk.length);
+  }
+
+  if(!Global_Console.Deferred)
+  {
+    Console_Flush();
+  }
+
+  return retval;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Console_Flush: Draw Queued Text
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Draw every complete record in the ring, oldest first, and then flush the shadow framebuffer if there is one. Safe to call from any
+// CPU at any time; if another CPU is already drawing this returns right away. The drawing CPU looks at the ring once more after it
+// lets go, and goes again if a record was published in the meantime, so text whose Console_Flush() returned early still gets drawn
+// without waiting for the next printf().
+//
+
+void Console_Flush(void)
+{
+  do
+  {
+    if(__atomic_exchange_n(&Global_Console.Drawing, 1, __ATOMIC_ACQUIRE))
+    {
+      return; // Whoever has it will check again before they're done
+    }
+
+    console_draw_queued();
+
+    __atomic_store_n(&Global_Console.Drawing, 0, __ATOMIC_RELEASE);
+
+    // A writer publishes its header and then tries for Drawing, so after letting go, either it sees Drawing free or this sees its header
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  } while(__atomic_load_n((uint32_t*)&Global_Console.Ring[__atomic_load_n(&Global_Console.Tail, __ATOMIC_ACQUIRE) & (CONSOLE_RING_SIZE - 1)], __ATOMIC_ACQUIRE) & CONSOLE_RECORD_READY);
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Console_Panic: Fall Back to Drawing Directly
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// For exception handlers and anything else that may not return. printf() draws immediately after this, and what was queued before it
+// gets drawn now so that the screen shows everything in order. If another CPU is in the middle of drawing, this waits a little while
+// for it and then draws anyway, since that CPU might be the one that crashed.
+//
+
+void Console_Panic(void)
+{
+  __atomic_store_n(&Global_Console.Deferred, 0, __ATOMIC_RELEASE);
+
+  for(uint64_t spins = 0; __atomic_load_n(&Global_Console.Drawing, __ATOMIC_ACQUIRE) && (spins < CONSOLE_PANIC_SPINS); spins++)
+  {
+    asm volatile("pause");
+  }
+
+  __atomic_store_n(&Global_Console.Drawing, 1, __ATOMIC_RELEASE);
+  Serial_Panic(); // Before drawing, so that what gets drawn next waits to go out too
+  console_draw_queued();
+  __atomic_store_n(&Global_Console.Drawing, 0, __ATOMIC_RELEASE);
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Console_Start_Renderer: Dedicate an AP to Drawing the Console
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Turn on the deferred console and have the AP at Global_Per_CPU_Data[cpu_index] flush it whenever there's new text, sleeping with
+// MONITOR/MWAIT in between if available. The AP goes back to idling once the deferred console is turned off.
+//
+// Returns 1 if the AP is now drawing, or 0 if it isn't an online AP (the console is still deferred then, so something else has to
+// call Console_Flush()).
+//
+
+uint8_t Console_Start_Renderer(uint64_t cpu_index)
+{
+  Console_Set_Deferred(1);
+
+  Global_Console.Renderer_CPU = cpu_index;
+  if(!SMP_Run_On_CPU(cpu_index, console_renderer, NULL))
+  {
+    Global_Console.Renderer_CPU = 0;
+    printf("Console_Start_Renderer: CPU %qu isn't an online AP.\r\n", cpu_index);
+    return 0;
+  }
+
+  return 1;
+}
+
+// kvprintf() output goes into the chunk, which gets queued whenever it fills up
+static void console_putchar(int output_character, void * arg)
+{
+  CONSOLE_CHUNK * chunk = (CONSOLE_CHUNK*)arg;
+
+  chunk->text[chunk->length++] = (char)output_character;
+
+  if(chunk->length == CONSOLE_CHUNK_SIZE)
+  {
+    console_write(chunk->text, chunk->length);
+    chunk->length = 0;
+  }
+}
+
+// Queue one record. Returns 1 if it was queued, 0 if it was dropped.
+static uint8_t console_write(const char * text, uint64_t length)
+{
+  uint64_t record_size = (4 + length + 3) & ~3ULL; // Keeps headers 4-byte aligned, so they never wrap around the end of the ring
+  uint64_t head;
+
+  for(uint64_t attempt = 0; ; attempt++)
+  {
+    head = __atomic_load_n(&Global_Console.Head, __ATOMIC_ACQUIRE);
+    uint64_t tail = __atomic_load_n(&Global_Console.Tail, __ATOMIC_ACQUIRE);
+
+    if((head + record_size - tail) > CONSOLE_RING_SIZE)
+    {
+      if(attempt == 0)
+      {
+        // Full: this stalls, but only for as long as it takes to draw what's already queued
+        Console_Flush();
+        continue;
+      }
+
+      __atomic_add_fetch(&Global_Console.Dropped, length, __ATOMIC_RELAXED);
+      return 0;
+    }
+
+    if(__atomic_compare_exchange_n(&Global_Console.Head, &head, head + record_size, 1, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+    {
+      break;
+    }
+  }
+
+  console_copy_in((head + 4) & (CONSOLE_RING_SIZE - 1), text, length);
+
+  // Publish
+  __atomic_store_n((uint32_t*)&Global_Console.Ring[head & (CONSOLE_RING_SIZE - 1)], (uint32_t)length | CONSOLE_RECORD_READY, __ATOMIC_RELEASE);
+
+  return 1;
+}
+
+// Copy into the ring at 'offset', wrapping around the end if needed
+static void console_copy_in(uint64_t offset, const char * text, uint64_t length)
+{
+  uint64_t first = CONSOLE_RING_SIZE - offset;
+  if(first > length)
+  {
+    first = length;
+  }
+
+  AVX_memcpy(&Global_Console.Ring[offset], (void*)text, first);
+  if(length > first)
+  {
+    AVX_memcpy(&Global_Console.Ring[0], (void*)(text + first), length - first);
+  }
+}
+
+// Draw complete records and free their space. The caller must own Global_Console.Drawing.
+static void console_draw_queued(void)
+{
+  uint64_t tail = Global_Console.Tail;
+  uint64_t drew = 0;
+
+  while(1)
+  {
+    uint64_t offset = tail & (CONSOLE_RING_SIZE - 1);
+    uint32_t header = __atomic_load_n((uint32_t*)&Global_Console.Ring[offset], __ATOMIC_ACQUIRE);
+
+    if(!(header & CONSOLE_RECORD_READY))
+    {
+      break; // Empty, or the next writer isn't done yet
+    }
+
+    uint64_t length = header & ~CONSOLE_RECORD_READY;
+    uint64_t record_size = (4 + length + 3) & ~3ULL;
+    uint64_t text_offset = (offset + 4) & (CONSOLE_RING_SIZE - 1);
+
+    uint64_t first = CONSOLE_RING_SIZE - text_offset;
+    if(first > length)
+    {
+      first = length;
+    }
+
+    console_emit((const char*)&Global_Console.Ring[text_offset], first);
+    if(length > first)
+    {
+      console_emit((const char*)&Global_Console.Ring[0], length - first);
+    }
+
+    // Zero the whole record, since any part of it could be read as a header on a later pass around the ring
+    uint64_t first_zero = CONSOLE_RING_SIZE - offset;
+    if(first_zero > record_size)
+    {
+      first_zero = record_size;
+    }
+    AVX_memset(&Global_Console.Ring[offset], 0, first_zero);
+    if(record_size > first_zero)
+    {
+      AVX_memset(&Global_Console.Ring[0], 0, record_size - first_zero);
+    }
+
+    tail += record_size;
+    __atomic_store_n(&Global_Console.Tail, tail, __ATOMIC_RELEASE);
+    drew = 1;
+  }
+
+  uint64_t dropped = __atomic_load_n(&Global_Console.Dropped, __ATOMIC_RELAXED);
+  if(dropped != Global_Console.Dropped_Reported)
+  {
+    char message[64];
+    int message_length = snprintf(message, sizeof(message), "[console: %qu bytes dropped]\r\n", dropped - Global_Console.Dropped_Reported);
+    console_emit(message, (uint64_t)message_length);
+    Global_Console.Dropped_Reported = dropped;
+    drew = 1;
+  }
+
+  if(drew && (Global_Console.Sinks & CONSOLE_SINK_FRAMEBUFFER))
+  {
+    Shadow_Flush(&Global_Print_Info.defaultGPU);
+  }
+}
+
+// Send flushed text to each sink that's on
+static void console_emit(const char * text, uint64_t length)
+{
+  uint64_t sinks = __atomic_load_n(&Global_Console.Sinks, __ATOMIC_ACQUIRE);
+
+  if(sinks & CONSOLE_SINK_FRAMEBUFFER)
+  {
+    print_direct(text, length);
+  }
+  if(sinks & CONSOLE_SINK_SERIAL)
+  {
+    Serial_Write(text, length);
+  }
+}
+
+// Console_Start_Renderer()'s AP loop
+static void console_renderer(void * arg)
+{
+  (void)arg;
+
+  uint64_t rcx = 0;
+  asm volatile("cpuid"
+               : "=c" (rcx) // Outputs
+               : "a" (0x01) // The value to put into %rax
+               : "%rbx", "%rdx" // CPUID clobbers all not-explicitly-used abcd registers
+             );
+  uint8_t has_mwait = (rcx & (1 << 3)) ? 1 : 0;
+
+  while(__atomic_load_n(&Global_Console.Deferred, __ATOMIC_ACQUIRE))
+  {
+    Console_Flush();
+
+    // Without its interrupt, the serial console only moves when someone pushes it
+    if(Global_Serial.Port && !Global_Serial.Interrupts && (Global_Serial.Head != Global_Serial.Tail))
+    {
+      Serial_Poll();
+      asm volatile("pause");
+    }
+    else if(has_mwait)
+    {
+      // Deferred and Head share a cache line, so a write to either one wakes this up
+      asm volatile("monitor"
+                   : // No outputs
+                   : "a" (&Global_Console.Head), "c" (0), "d" (0) // Inputs
+                   : // No clobbers
+                 );
+      // Re-check after arming the monitor, or text queued in between would wait for the next wakeup
+      if(Global_Console.Deferred && (Global_Console.Head == Global_Console.Tail))
+      {
+        asm volatile("mwait"
+                     : // No outputs
+                     : "a" (0), "c" (0) // C1, no extensions
+                     : // No clobbers
+                   );
+      }
+    }
+    else
+    {
+      asm volatile("pause");
+    }
+  }
+
+  // Whatever came in just before the console was turned off
+  Console_Flush();
+}
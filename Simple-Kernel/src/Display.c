@@ -19,6 +19,44 @@
 // Set the default font with this
 #define SYSTEMFONT font8x8_basic // Must be set up in UTF-8
 
+// Glyph cache for Output_render_text(): every possible 8-bit font row, expanded to pixels for one (font_color, highlight_color, scale)
+#define GLYPH_CACHE_MAX_SCALE 16
+#define GLYPH_CACHE_ROW_PIXELS (8 * GLYPH_CACHE_MAX_SCALE)
+
+static UINT32 glyph_cache_rows[256][GLYPH_CACHE_ROW_PIXELS] __attribute__((aligned(64))) = {{0}};
+static UINT32 glyph_cache_font_color = 0;
+static UINT32 glyph_cache_highlight_color = 0;
+static UINT32 glyph_cache_scale = 0; // 0 = nothing cached
+
+static void glyph_cache_build(UINT32 font_color, UINT32 highlight_color, UINT32 scale);
+static void glyph_row_blit(UINT32 * dest, const UINT32 * src, UINT32 pixels, UINT32 transparent);
+static void glyph_row_blit_avx2(UINT32 * dest, const UINT32 * src, UINT32 pixels, UINT32 transparent);
+
+static UINT8 render_clip(const RENDER_TARGET * target, INT64 * x, INT64 * y, UINT64 * width, UINT64 * height, UINT64 * skip_x, UINT64 * skip_y);
+static UINT8 render_outcode(const RENDER_TARGET * target, INT64 x, INT64 y);
+static UINT8 render_clip_line(const RENDER_TARGET * target, INT64 * x0, INT64 * y0, INT64 * x1, INT64 * y1);
+static inline UINT32 blend_pixel(UINT32 dest, UINT32 src);
+static void blend_span(UINT32 * dest, const UINT32 * src, UINT64 pixels);
+static void expand_span(UINT32 * dest, const unsigned char * bits, UINT64 first_bit, UINT64 pixels, UINT32 font_color, UINT32 highlight_color);
+static UINT64 blend_span_avx2(UINT32 * dest, const UINT32 * src, UINT64 pixels);
+static UINT64 expand_span_avx2(UINT32 * dest, const unsigned char * bits, UINT64 first_bit, UINT64 pixels, UINT32 font_color, UINT32 highlight_color);
+
+static UINT64 bitswap_avx2(const unsigned char * bitmap, UINT64 total, unsigned char * output);
+static UINT64 bitreverse_avx2(const unsigned char * bitmap, UINT64 total, unsigned char * output);
+static UINT64 bytemirror_lanes_avx2(const unsigned char * bitmap, UINT64 total, UINT32 row_iterator, unsigned char * output);
+static UINT64 bytemirror_ends_avx2(const unsigned char * in, unsigned char * out, UINT64 row_bytes);
+
+static SHADOW_FRAMEBUFFER_STRUCT * shadow_find(EFI_PHYSICAL_ADDRESS frame_buffer_base);
+static SHADOW_FRAMEBUFFER_STRUCT * shadow_setup(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE * entry, uint64_t gpu);
+static void shadow_remove(SHADOW_FRAMEBUFFER_STRUCT * fb);
+static void shadow_stream_span(UINT32 * dest, const UINT32 * src, UINT64 pixels);
+
+static void mirror_channel_layout(EFI_GRAPHICS_OUTPUT_MODE_INFORMATION * info, UINT8 * shift, UINT8 * bits);
+static void mirror_blit(MIRROR_HEAD_STRUCT * head, SHADOW_FRAMEBUFFER_STRUCT * fb);
+static UINT32 mirror_convert_pixel(MIRROR_HEAD_STRUCT * head, UINT32 pixel);
+static void mirror_swap_span(UINT32 * dest, const UINT32 * src, UINT64 pixels);
+static UINT64 mirror_swap_span_avx2(UINT32 * dest, const UINT32 * src, UINT64 pixels);
+
 //----------------------------------------------------------------------------------------------------------------------------------
 // Initialize_Global_Printf_Defaults: Set Up Printf
 //----------------------------------------------------------------------------------------------------------------------------------
@@ -26,10 +64,10 @@
 // Initialize printf and bind it to a specific GPU framebuffer.
 //
 
-void Initialize_Global_Printf_Defaults(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU)
+void Initialize_Global_Printf_Defaults(const EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE * GPU)
 {
   // Set global default print information--needed for printf
-  Global_Print_Info.defaultGPU = GPU;
+  Global_Print_Info.defaultGPU = *GPU;
   Global_Print_Info.height = 8; // Character font height (height*scale should not exceed VerticalResolution--it should still work, but it might be really messy and bizarrely cut off)
   Global_Print_Info.width = 8; // Character font width (in bits) (width*scale should not exceed HorizontalResolution, same reason as above)
   Global_Print_Info.font_color = 0x00FFFFFF; // Default font color -- TODO: Use EFI Pixel Info
@@ -80,18 +118,18 @@ void Initialize_Global_Printf_Defaults(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU)
 // string: printf-style string
 //
 
-void formatted_string_anywhere_scaled(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU, UINT32 height, UINT32 width, UINT32 font_color, UINT32 highlight_color, UINT32 x, UINT32 y, UINT32 scale, const char * string, ...)
+void formatted_string_anywhere_scaled(const EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE * GPU, UINT32 height, UINT32 width, UINT32 font_color, UINT32 highlight_color, UINT32 x, UINT32 y, UINT32 scale, const char * string, ...)
 {
   // Height in number of bytes and width in number of bits, per character where "character" is an array of bytes, e.g. { 0x3E, 0x63, 0x7B, 0x7B, 0x7B, 0x03, 0x1E, 0x00}, which is U+0040 (@). This is an 8x8 '@' sign.
-  if(height > GPU.Info->VerticalResolution || width > GPU.Info->HorizontalResolution)
+  if(height > GPU->Info->VerticalResolution || width > GPU->Info->HorizontalResolution)
   {
     Colorscreen(GPU, 0x00FF0000); // Need some kind of error indicator (makes screen red)
   } // Could use an instruction like ARM's USAT to truncate values
-  else if(x > GPU.Info->HorizontalResolution || y > GPU.Info->VerticalResolution)
+  else if(x > GPU->Info->HorizontalResolution || y > GPU->Info->VerticalResolution)
   {
     Colorscreen(GPU, 0x0000FF00); // Makes screen green
   }
-  else if ((y + scale*height) > GPU.Info->VerticalResolution || (x + scale*width) > GPU.Info->HorizontalResolution)
+  else if ((y + scale*height) > GPU->Info->VerticalResolution || (x + scale*width) > GPU->Info->HorizontalResolution)
   {
     Colorscreen(GPU, 0x000000FF); // Makes screen blue
   }
@@ -119,7 +157,7 @@ void Resetdefaultscreen(void)
   Global_Print_Info.x = 0;
   Global_Print_Info.y = 0;
   Global_Print_Info.index = 0;
-  Blackscreen(Global_Print_Info.defaultGPU);
+  Blackscreen(&Global_Print_Info.defaultGPU);
 }
 
 //----------------------------------------------------------------------------------------------------------------------------------
@@ -135,7 +173,7 @@ void Resetdefaultcolorscreen(void)
   Global_Print_Info.x = 0;
   Global_Print_Info.y = 0;
   Global_Print_Info.index = 0;
-  Colorscreen(Global_Print_Info.defaultGPU, Global_Print_Info.background_color);
+  Colorscreen(&Global_Print_Info.defaultGPU, Global_Print_Info.background_color);
 }
 
 //----------------------------------------------------------------------------------------------------------------------------------
@@ -145,7 +183,7 @@ void Resetdefaultcolorscreen(void)
 // Wipe the visible portion of the screen buffer to black
 //
 
-void Blackscreen(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU)
+void Blackscreen(const EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE * GPU)
 {
   Colorscreen(GPU, 0x00000000);
 }
@@ -157,36 +195,37 @@ void Blackscreen(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU)
 // Wipe the visible portion of the screen buffer to a specified color
 //
 
-void Colorscreen(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU, UINT32 color)
+void Colorscreen(const EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE * GPU, UINT32 color)
 {
   Global_Print_Info.background_color = color;
 
-  AVX_memset_4B((EFI_PHYSICAL_ADDRESS*)GPU.FrameBufferBase, color, GPU.Info->VerticalResolution * GPU.Info->PixelsPerScanLine);
+  AVX_memset_4B((EFI_PHYSICAL_ADDRESS*)GPU->FrameBufferBase, color, GPU->Info->VerticalResolution * GPU->Info->PixelsPerScanLine);
+  Shadow_Mark_Dirty(GPU, 0, 0, GPU->Info->HorizontalResolution, GPU->Info->VerticalResolution);
 /*  // This could work, too, if writing to the offscreen area is undesired. It'll probably be a little slower than a contiguous AVX_memset_4B, however.
-  for (row = 0; row < GPU.Info->VerticalResolution; row++)
+  for (row = 0; row < GPU->Info->VerticalResolution; row++)
   {
     // Per UEFI Spec 2.7 Errata A, framebuffer address 0 coincides with the top leftmost pixel. i.e. screen padding is only HorizontalResolution + porch.
-    AVX_memset_4B((EFI_PHYSICAL_ADDRESS*)(GPU.FrameBufferBase + 4 * GPU.Info->PixelsPerScanLine * row), color, GPU.Info->HorizontalResolution); // The thing at FrameBufferBase is an address pointing to UINT32s. FrameBufferBase itself is a 64-bit number.
+    AVX_memset_4B((EFI_PHYSICAL_ADDRESS*)(GPU->FrameBufferBase + 4 * GPU->Info->PixelsPerScanLine * row), color, GPU->Info->HorizontalResolution); // The thing at FrameBufferBase is an address pointing to UINT32s. FrameBufferBase itself is a 64-bit number.
   }
 */
 
 /* // Old version (non-AVX)
   UINT32 row, col;
-  UINT32 backporch = GPU.Info->PixelsPerScanLine - GPU.Info->HorizontalResolution; // The area offscreen is the back porch. Sometimes it's 0.
+  UINT32 backporch = GPU->Info->PixelsPerScanLine - GPU->Info->HorizontalResolution; // The area offscreen is the back porch. Sometimes it's 0.
 
-  for (row = 0; row < GPU.Info->VerticalResolution; row++)
+  for (row = 0; row < GPU->Info->VerticalResolution; row++)
   {
-    for (col = 0; col < (GPU.Info->PixelsPerScanLine - backporch); col++) // Per UEFI Spec 2.7 Errata A, framebuffer address 0 coincides with the top leftmost pixel. i.e. screen padding is only HorizontalResolution + porch.
+    for (col = 0; col < (GPU->Info->PixelsPerScanLine - backporch); col++) // Per UEFI Spec 2.7 Errata A, framebuffer address 0 coincides with the top leftmost pixel. i.e. screen padding is only HorizontalResolution + porch.
     {
-      *(UINT32*)(GPU.FrameBufferBase + 4 * (GPU.Info->PixelsPerScanLine * row + col)) = color; // The thing at FrameBufferBase is an address pointing to UINT32s. FrameBufferBase itself is a 64-bit number.
+      *(UINT32*)(GPU->FrameBufferBase + 4 * (GPU->Info->PixelsPerScanLine * row + col)) = color; // The thing at FrameBufferBase is an address pointing to UINT32s. FrameBufferBase itself is a 64-bit number.
     }
   }
 */
 
 /* // Leaving this here for posterity. The framebuffer size might be a fair bit larger than the visible area (possibly for scrolling support? Regardless, some are just the size of the native resolution).
-  for(UINTN i = 0; i < GPU.FrameBufferSize; i+=4) //32 bpp == 4 Bpp
+  for(UINTN i = 0; i < GPU->FrameBufferSize; i+=4) //32 bpp == 4 Bpp
   {
-    *(UINT32*)(GPU.FrameBufferBase + i) = color; // FrameBufferBase is a 64-bit address that points to UINT32s.
+    *(UINT32*)(GPU->FrameBufferBase + i) = color; // FrameBufferBase is a 64-bit address that points to UINT32s.
   }
 */
 }
@@ -197,300 +236,1676 @@ void Colorscreen(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU, UINT32 color)
 //
 // Set a specified pixel, in (x,y) coordinates from the top left of the screen (0,0), to a specified color
 //
+// Pixels outside the visible area are dropped. For anything bigger than a pixel, the Render_ functions below are much faster than
+// calling this in a loop.
+//
 
-// Screen turns red if a pixel is put outside the visible area.
-void single_pixel(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU, UINT32 x, UINT32 y, UINT32 color)
+void single_pixel(const EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE * GPU, UINT32 x, UINT32 y, UINT32 color)
 {
-  if(y > GPU.Info->VerticalResolution || x > GPU.Info->HorizontalResolution) // Need some kind of error indicator (makes screen red)
+  if(y >= GPU->Info->VerticalResolution || x >= GPU->Info->HorizontalResolution)
   {
-    Colorscreen(GPU, 0x00FF0000);
+    return;
   }
 
-  *(UINT32*)(GPU.FrameBufferBase + (y * GPU.Info->PixelsPerScanLine + x) * 4) = color;
+  *(UINT32*)(GPU->FrameBufferBase + (y * GPU->Info->PixelsPerScanLine + x) * 4) = color;
+  Shadow_Mark_Dirty(GPU, x, y, 1, 1);
 //  Output_render(GPU, 0x01, 1, 1, color, 0xFF000000, x, y, 1, 0); // Make highlight transparent to skip that part of output render (transparent = no highlight)
 }
 
 //----------------------------------------------------------------------------------------------------------------------------------
-// single_char: Color a Single Character
+// Setup_Shadow_Framebuffers: Draw Into RAM Instead of Video Memory
 //----------------------------------------------------------------------------------------------------------------------------------
 //
-// Print a single character of the default font (set at the top of this file) at the top left of the screen (0,0) and at a specified
-// font color and highlight color
+// Give each GPU framebuffer a RAM back buffer and point its GPUArray entry's FrameBufferBase (and Global_Print_Info's, if it's the same
+// GPU) at it. Everything in this file then draws into RAM, and Shadow_Flush() copies the rectangle that changed since the last flush
+// to the real framebuffer with streaming stores. printf() flushes when it's done.
 //
-// character: 'a' or 'b' (with single quotes), for example
-// height and width: height (bytes) and width (bits) of the font character; there is no automatic way of getting this information for weird font sizes (e.g. 17 bits wide), sorry.
-// font_color: font color
-// highlight_color: highlight/background color for the string's characters (it's called highlight color in word processors)
+// Framebuffer memory is usually uncached or write-combining, so reading it back (like scrolling with memmove does) is extremely slow.
+// With a back buffer, nothing ever reads from video memory again, and scrolling just moves Base down the buffer (which is two screens
+// tall) instead of moving the whole screen; see Scroll_Framebuffer().
+//
+// This needs the page allocator. GPUs whose buffer can't be allocated keep drawing to video memory directly. Anything that keeps its
+// own copy of a GPU's EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE struct (instead of using the GPUArray entry or Global_Print_Info) will draw to
+// a stale Base once the screen has scrolled.
 //
 
-void single_char(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU, int character, UINT32 height, UINT32 width, UINT32 font_color, UINT32 highlight_color)
+void Setup_Shadow_Framebuffers(GPU_CONFIG * GPU_Configs)
 {
-  // Assuming "character" is an array of bytes, e.g. { 0x3E, 0x63, 0x7B, 0x7B, 0x7B, 0x03, 0x1E, 0x00}, which would be U+0040 (@) -- an 8x8 '@' sign.
-  if(height > GPU.Info->VerticalResolution || width > GPU.Info->HorizontalResolution)
+  for(uint64_t gpu = 0; (gpu < GPU_Configs->NumberOfFrameBuffers) && (Global_Shadow_Info.Count < MAX_SHADOW_FRAMEBUFFERS); gpu++)
   {
-    Colorscreen(GPU, 0x00FF0000); // Need some kind of error indicator (makes screen red)
-  } // Could use an instruction like ARM's USAT to truncate values
-
-  Output_render_text(GPU, character, height, width, font_color, highlight_color, 0, 0, 1, 0);
+    shadow_setup(&GPU_Configs->GPUArray[gpu], gpu);
+  }
 }
 
 //----------------------------------------------------------------------------------------------------------------------------------
-// single_char_anywhere: Color a Single Character Anywhere
+// Setup_Mirror_Heads: Show printf's Screen on Every GPU
 //----------------------------------------------------------------------------------------------------------------------------------
 //
-// Print a single character of the default font (set at the top of this file), at (x,y) coordinates from the top left of the screen
-// (0,0), using a specified font color and highlight color
+// Make every other GPU in GPU_Configs show a copy of printf's screen. Text is only drawn once, into the shadow framebuffer of printf's
+// GPU (which gets one here if Setup_Shadow_Framebuffers() hasn't already made it), and each Shadow_Flush() of that screen also copies
+// the dirty rectangle to every mirror, converting pixel formats (from PixelFormat/PixelInformation) and scaling to the mirror's
+// resolution with nearest-neighbor sampling as needed. Mirrors are written straight to video memory and never read back.
 //
-// character: 'a' or 'b' (with single quotes), for example
-// height and width: height (bytes) and width (bits) of the font character; there is no automatic way of getting this information for weird font sizes (e.g. 17 bits wide), sorry.
-// font_color: font color
-// highlight_color: highlight/background color for the string's characters (it's called highlight color in word processors)
-// x and y: coordinate positions of the top leftmost pixel of the string
+// Scaling down drops some scanlines and columns, so small text may be hard to read on a mirror that's much smaller than the source.
+// GPUs without a linear framebuffer (PixelBltOnly) are skipped. A mirror's own shadow framebuffer, if it had one, is freed, and its
+// GPUArray entry points at video memory again, since nothing drawn into that buffer would ever make it on screen.
 //
 
-void single_char_anywhere(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU, int character, UINT32 height, UINT32 width, UINT32 font_color, UINT32 highlight_color, UINT32 x, UINT32 y)
+void Setup_Mirror_Heads(GPU_CONFIG * GPU_Configs)
 {
-  // Assuming "character" is an array of bytes, e.g. { 0x3E, 0x63, 0x7B, 0x7B, 0x7B, 0x03, 0x1E, 0x00}, which would be U+0040 (@) -- an 8x8 '@' sign.
-  if(height > GPU.Info->VerticalResolution || width > GPU.Info->HorizontalResolution)
+  if(GPU_Configs->NumberOfFrameBuffers < 2)
   {
-    Colorscreen(GPU, 0x00FF0000); // Need some kind of error indicator (makes screen red)
-  } // Could use an instruction like ARM's USAT to truncate values
-  else if(x > GPU.Info->HorizontalResolution || y > GPU.Info->VerticalResolution)
+    printf("Setup_Mirror_Heads: Only one GPU, nothing to mirror to.\r\n");
+    return;
+  }
+
+  SHADOW_FRAMEBUFFER_STRUCT * source = shadow_find(Global_Print_Info.defaultGPU.FrameBufferBase);
+  if(source == NULL)
   {
-    Colorscreen(GPU, 0x0000FF00); // Makes screen green
+    for(uint64_t gpu = 0; gpu < GPU_Configs->NumberOfFrameBuffers; gpu++)
+    {
+      if(GPU_Configs->GPUArray[gpu].FrameBufferBase == Global_Print_Info.defaultGPU.FrameBufferBase)
+      {
+        source = shadow_setup(&GPU_Configs->GPUArray[gpu], gpu);
+        break;
+      }
+    }
+
+    if(source == NULL)
+    {
+      printf("Setup_Mirror_Heads: printf's GPU needs a shadow framebuffer to be mirrored, and it couldn't get one.\r\n");
+      return;
+    }
   }
-  else if ((y + height) > GPU.Info->VerticalResolution || (x + width) > GPU.Info->HorizontalResolution)
+
+  UINT8 source_shift[3], source_bits[3];
+  mirror_channel_layout(source->GPU_Entry->Info, source_shift, source_bits);
+
+  Global_Shadow_Info.Mirror_Count = 0;
+
+  for(uint64_t gpu = 0; (gpu < GPU_Configs->NumberOfFrameBuffers) && (Global_Shadow_Info.Mirror_Count < MAX_SHADOW_FRAMEBUFFERS); gpu++)
   {
-    Colorscreen(GPU, 0x000000FF); // Makes screen blue
+    EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE * entry = &GPU_Configs->GPUArray[gpu];
+
+    if(entry == source->GPU_Entry)
+    {
+      continue;
+    }
+    if(entry->Info->PixelFormat >= PixelBltOnly)
+    {
+      printf("Setup_Mirror_Heads: GPU %qu has no framebuffer to mirror to.\r\n", gpu);
+      continue;
+    }
+
+    MIRROR_HEAD_STRUCT * head = &Global_Shadow_Info.Mirrors[Global_Shadow_Info.Mirror_Count];
+
+    // Mirrors get written directly, so a shadowed one's buffer goes away once it's set up
+    SHADOW_FRAMEBUFFER_STRUCT * own_shadow = shadow_find(entry->FrameBufferBase);
+    head->Hardware_Base = own_shadow ? own_shadow->Hardware_Base : entry->FrameBufferBase;
+    head->GPU_Entry = entry;
+    head->Pitch = entry->Info->PixelsPerScanLine;
+    head->Width = entry->Info->HorizontalResolution;
+    head->Height = entry->Info->VerticalResolution;
+    head->Scaled = (head->Width != source->Width) || (head->Height != source->Height);
+    head->Column_Map = NULL;
+
+    if(head->Scaled)
+    {
+      UINT32 * column_map = (UINT32*)malloc4k(EFI_SIZE_TO_PAGES((UINT64)head->Width * 4));
+      if(column_map == MALLOC_FAILED)
+      {
+        printf("Setup_Mirror_Heads: Not enough memory to scale to GPU %qu.\r\n", gpu);
+        continue;
+      }
+
+      for(UINT32 column = 0; column < head->Width; column++)
+      {
+        column_map[column] = (UINT32)(((UINT64)column * source->Width) / head->Width);
+      }
+      head->Column_Map = column_map;
+    }
+
+    UINT8 dest_shift[3], dest_bits[3];
+    mirror_channel_layout(entry->Info, dest_shift, dest_bits);
+
+    for(UINT64 channel = 0; channel < 3; channel++)
+    {
+      head->Source_Shift[channel] = source_shift[channel];
+      head->Source_Bits[channel] = source_bits[channel];
+      head->Dest_Shift[channel] = dest_shift[channel];
+      head->Dest_Bits[channel] = dest_bits[channel];
+    }
+
+    if((dest_shift[0] == source_shift[0]) && (dest_shift[1] == source_shift[1]) && (dest_shift[2] == source_shift[2]) &&
+       (dest_bits[0] == source_bits[0]) && (dest_bits[1] == source_bits[1]) && (dest_bits[2] == source_bits[2]))
+    {
+      head->Conversion = MIRROR_COPY;
+    }
+    else if((source_bits[0] == 8) && (source_bits[1] == 8) && (source_bits[2] == 8) && (dest_bits[0] == 8) && (dest_bits[1] == 8) && (dest_bits[2] == 8) &&
+            (source_shift[1] == 8) && (dest_shift[1] == 8) && (dest_shift[0] == source_shift[2]) && (dest_shift[2] == source_shift[0]) &&
+            (((source_shift[0] == 0) && (source_shift[2] == 16)) || ((source_shift[0] == 16) && (source_shift[2] == 0))))
+    {
+      head->Conversion = MIRROR_SWAP_RED_BLUE; // RGB <-> BGR, the usual case
+    }
+    else
+    {
+      head->Conversion = MIRROR_BITMASK;
+    }
+
+    if(own_shadow)
+    {
+      shadow_remove(own_shadow);
+      if(source > own_shadow)
+      {
+        source--; // Moved down a slot
+      }
+    }
+
+    Global_Shadow_Info.Mirror_Count++;
   }
 
-  Output_render_text(GPU, character, height, width, font_color, highlight_color, x, y, 1, 0);
+  Global_Shadow_Info.Mirror_Source = source - Global_Shadow_Info.Framebuffers;
+
+  // Paint every mirror with what's on screen now
+  EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE source_GPU = *source->GPU_Entry;
+  source_GPU.FrameBufferBase = source->Base;
+  Shadow_Mark_Dirty(&source_GPU, 0, 0, source->Width, source->Height);
+  Shadow_Flush(&source_GPU);
 }
 
 //----------------------------------------------------------------------------------------------------------------------------------
-// single_char_anywhere_scaled: Color a Single Character Anywhere with Scaling
+// Shadow_Mark_Dirty: Record a Changed Area
 //----------------------------------------------------------------------------------------------------------------------------------
 //
-// Print a single character of the default font (set at the top of this file), at (x,y) coordinates from the top left of the screen
-// (0,0), using a specified font color, highlight color, and scale factor
-//
-// character: 'a' or 'b' (with single quotes), for example
-// height and width: height (bytes) and width (bits) of the font character; there is no automatic way of getting this information for weird font sizes (e.g. 17 bits wide), sorry.
-// font_color: font color
-// highlight_color: highlight/background color for the string's characters (it's called highlight color in word processors)
-// x and y: coordinate positions of the top leftmost pixel of the string
-// scale: integer font scaling factor >= 1
+// Grow GPU's dirty rectangle to include the given one, which gets clipped to the screen. Does nothing if GPU isn't shadowed. Every
+// drawing function in this file calls this; code that writes to FrameBufferBase itself needs to as well.
 //
 
-void single_char_anywhere_scaled(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU, int character, UINT32 height, UINT32 width, UINT32 font_color, UINT32 highlight_color, UINT32 x, UINT32 y, UINT32 scale)
+void Shadow_Mark_Dirty(const EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE * GPU, UINT32 x, UINT32 y, UINT32 width, UINT32 height)
 {
-  // Assuming "character" is an array of bytes, e.g. { 0x3E, 0x63, 0x7B, 0x7B, 0x7B, 0x03, 0x1E, 0x00}, which would be U+0040 (@) -- an 8x8 '@' sign.
-  if(height > GPU.Info->VerticalResolution || width > GPU.Info->HorizontalResolution)
+  if(Global_Shadow_Info.Count == 0)
   {
-    Colorscreen(GPU, 0x00FF0000); // Need some kind of error indicator (makes screen red)
-  } // Could use an instruction like ARM's USAT to truncate values
-  else if(x > GPU.Info->HorizontalResolution || y > GPU.Info->VerticalResolution)
-  {
-    Colorscreen(GPU, 0x0000FF00); // Makes screen green
+    return;
   }
-  else if ((y + scale*height) > GPU.Info->VerticalResolution || (x + scale*width) > GPU.Info->HorizontalResolution)
+
+  SHADOW_FRAMEBUFFER_STRUCT * fb = shadow_find(GPU->FrameBufferBase);
+  if((fb == NULL) || (x >= fb->Width) || (y >= fb->Height))
   {
-    Colorscreen(GPU, 0x000000FF); // Makes screen blue
+    return;
   }
 
-  Output_render_text(GPU, character, height, width, font_color, highlight_color, x, y, scale, 0);
+  UINT32 right = ((UINT64)x + width > fb->Width) ? fb->Width : x + width;
+  UINT32 bottom = ((UINT64)y + height > fb->Height) ? fb->Height : y + height;
+
+  if(!fb->Dirty)
+  {
+    fb->Dirty_Left = x;
+    fb->Dirty_Top = y;
+    fb->Dirty_Right = right;
+    fb->Dirty_Bottom = bottom;
+    fb->Dirty = 1;
+  }
+  else
+  {
+    if(x < fb->Dirty_Left)
+    {
+      fb->Dirty_Left = x;
+    }
+    if(y < fb->Dirty_Top)
+    {
+      fb->Dirty_Top = y;
+    }
+    if(right > fb->Dirty_Right)
+    {
+      fb->Dirty_Right = right;
+    }
+    if(bottom > fb->Dirty_Bottom)
+    {
+      fb->Dirty_Bottom = bottom;
+    }
+  }
 }
 
 //----------------------------------------------------------------------------------------------------------------------------------
-// string_anywhere_scaled: Color a String Anywhere with Scaling
+// Shadow_Flush: Update the Screen
 //----------------------------------------------------------------------------------------------------------------------------------
 //
-// Print a string of the default font (set at the top of this file), at (x,y) coordinates from the top left of the screen
-// (0,0), using a specified font color, highlight color, and scale factor
-//
-// string: "a string like this" (no formatting specifiers -- use formatted_string_anywhere_scaled() for that instead)
-// height and width: height (bytes) and width (bits) of the string's font characters; there is no automatic way of getting this information for weird font sizes (e.g. 17 bits wide), sorry.
-// font_color: font color
-// highlight_color: highlight/background color for the string's characters (it's called highlight color in word processors)
-// x and y: coordinate positions of the top leftmost pixel of the string
-// scale: integer font scaling factor >= 1
-//
-// NOTE: literal strings in C are automatically null-terminated. i.e. "hi" is actually 3 characters long.
-// This function allows direct output of a pre-made string, either a hardcoded one or one made via sprintf.
+// Copy GPU's dirty rectangle from its shadow buffer to the real framebuffer, one scanline span at a time, with streaming stores. Does
+// nothing if GPU isn't shadowed or nothing has changed. Shadow_Flush_All() does this for every shadowed GPU.
 //
 
-void string_anywhere_scaled(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU, const char * string, UINT32 height, UINT32 width, UINT32 font_color, UINT32 highlight_color, UINT32 x, UINT32 y, UINT32 scale)
+void Shadow_Flush(const EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE * GPU)
 {
-  if(height > GPU.Info->VerticalResolution || width > GPU.Info->HorizontalResolution)
-  {
-    Colorscreen(GPU, 0x00FF0000); // Need some kind of error indicator (makes screen red)
-  } // Could use an instruction like ARM's USAT to truncate values
-  else if(x > GPU.Info->HorizontalResolution || y > GPU.Info->VerticalResolution)
+  if(Global_Shadow_Info.Count == 0)
   {
-    Colorscreen(GPU, 0x0000FF00); // Makes screen green
+    return;
   }
-  else if ((y + scale*height) > GPU.Info->VerticalResolution || (x + scale*width) > GPU.Info->HorizontalResolution)
+
+  SHADOW_FRAMEBUFFER_STRUCT * fb = shadow_find(GPU->FrameBufferBase);
+  if((fb == NULL) || !fb->Dirty)
   {
-    Colorscreen(GPU, 0x000000FF); // Makes screen blue
+    return;
   }
 
-  //mapping: x*4 + y*4*(PixelsPerScanLine), x is column number, y is row number; every 4*PixelsPerScanLine bytes is a new row
-  // y max is VerticalResolution, x max is HorizontalResolution, 'x4' is the LFB expansion, since 1 bit input maps to 4 bytes output
+  UINT64 span = fb->Dirty_Right - fb->Dirty_Left;
+  UINT32 * src = (UINT32*)fb->Base + (UINT64)fb->Dirty_Top * fb->Pitch + fb->Dirty_Left;
+  UINT32 * dest = (UINT32*)fb->Hardware_Base + (UINT64)fb->Dirty_Top * fb->Pitch + fb->Dirty_Left;
 
-  // A 2x scale should turn 1 pixel into a square of 2x2 pixels
-// iterate through characters in string
-// start while
-  uint32_t index = 0;
-  while(string[index] != '\0') // for char in string until \0
+  for(UINT32 row = fb->Dirty_Top; row < fb->Dirty_Bottom; row++)
   {
-    // match the character to the font, using UTF-8.
-    // This would expect a font array to include everything in the UTF-8 character set... Or just use the most common ones.
-    Output_render_text(GPU, string[index], height, width, font_color, highlight_color, x, y, scale, index);
-    index++;
-  } // end while
-} // end function
-
-//----------------------------------------------------------------------------------------------------------------------------------
-// Output_render_text: Render a Character to the Screen
-//----------------------------------------------------------------------------------------------------------------------------------
-//
-// This function draws a character of the default font on the screen, given the following parameters:
-//
-// character: 'a' or 'b' (with single quotes), for example
-// height and width: height (bytes) and width (bits) of the font character; there is no automatic way of getting this information for weird font sizes (e.g. 17 bits wide), sorry.
-// font_color: font color
-// highlight_color: highlight/background color for the string's characters (it's called highlight color in word processors)
-// x and y: coordinate positions of the top leftmost pixel of the string
-// scale: integer font scaling factor >= 1
-// index: mainly for strings, it's for keeping track of which character in the string is being output
-//
+    shadow_stream_span(dest, src, span);
+    src += fb->Pitch;
+    dest += fb->Pitch;
+  }
 
-void Output_render_text(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU, int character, UINT32 height, UINT32 width, UINT32 font_color, UINT32 highlight_color, UINT32 x, UINT32 y, UINT32 scale, UINT32 index)
-{
-  // Compact ceiling function, so that size doesn't need to be passed in
-  // This should be faster than a divide followed by a mod
-  uint32_t row_iterator = width >> 3;
-  if((width & 0x7) != 0)
+  // Same rectangle to every mirror, still from RAM
+  if(Global_Shadow_Info.Mirror_Count && (fb == &Global_Shadow_Info.Framebuffers[Global_Shadow_Info.Mirror_Source]))
   {
-    row_iterator++;
-  } // Width should never be zero, so the iterator will always be at least 1
-  uint32_t i;
+    for(UINT64 i = 0; i < Global_Shadow_Info.Mirror_Count; i++)
+    {
+      mirror_blit(&Global_Shadow_Info.Mirrors[i], fb);
+    }
+  }
+  _mm_sfence();
 
-  for(uint32_t row = 0; row < height; row++) // for number of rows in the character of the fontarray
+  fb->Dirty = 0;
+}
+
+void Shadow_Flush_All(void)
+{
+  for(uint64_t i = 0; i < Global_Shadow_Info.Count; i++)
   {
-    i = 0;
-    for (uint32_t bit = 0; bit < width; bit++) // for bit in column
-    {
-      if(((bit & 0x7) == 0 ) && (bit > 0))
-      {
-        i++;
-      }
-      // if a 1, output NOTE: There's gotta be a better way to do this.
-//      if( character[row*row_iterator + i] & (1 << (7 - (bit & 0x7))) )
-      if((SYSTEMFONT[character][row*row_iterator + i] >> (bit & 0x7)) & 0x1)
-      {
-        // start scale here
-        for(uint32_t b = 0; b < scale; b++)
-        {
-          for(uint32_t a = 0; a < scale; a++)
-          {
-            *(UINT32*)(GPU.FrameBufferBase + ((y*GPU.Info->PixelsPerScanLine + x) + scale*(row*GPU.Info->PixelsPerScanLine + bit) + (b*GPU.Info->PixelsPerScanLine + a) + scale * index * width)*4) = font_color;
-          }
-        } //end scale here
-      } //end if
-      else // if a 0, background or skip (set highlight_color to 0xFF000000 for transparency)
-      {
-        // start scale here
-        for(uint32_t b = 0; b < scale; b++)
-        {
-          for(uint32_t a = 0; a < scale; a++)
-          {
-            if(highlight_color != 0xFF000000) // Transparency "color"
-            {
-              *(UINT32*)(GPU.FrameBufferBase + ((y*GPU.Info->PixelsPerScanLine + x) + scale*(row*GPU.Info->PixelsPerScanLine + bit) + (b*GPU.Info->PixelsPerScanLine + a) + scale * index * width)*4) = highlight_color;
-            }
-          }
-        } //end scale here
-      } // end else
-    } // end bit in column
-  } // end byte in row
+    EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU = *Global_Shadow_Info.Framebuffers[i].GPU_Entry;
+    GPU.FrameBufferBase = Global_Shadow_Info.Framebuffers[i].Base;
+    Shadow_Flush(&GPU);
+  }
 }
 
 //----------------------------------------------------------------------------------------------------------------------------------
-// bitmap_anywhere_scaled: Color a Single Bitmap Anywhere with Scaling
+// Scroll_Framebuffer: Scroll the Screen Up
 //----------------------------------------------------------------------------------------------------------------------------------
 //
-// Print a single, single-color bitmapped character at (x,y) coordinates from the top left of the screen (0,0) using a specified font
-// color, highlight color, and scale factor
-//
-// bitmap: a bitmapped image formatted like a font character
-// height and width: height (bytes) and width (bits) of the bitmap; there is no automatic way of getting this information for weird font sizes (e.g. 17 bits wide), sorry.
-// font_color: font color
-// highlight_color: highlight/background color for the string's characters (it's called highlight color in word processors)
-// x and y: coordinate positions of the top leftmost pixel of the string
-// scale: font scale factor
+// Move the contents of the screen up by 'lines' scanlines. Scanlines from kept_lines to the bottom of the screen keep what they had
+// before, so callers can fill them in, just like the AVX_memmove() this replaces:
 //
-// This function allows for printing of individual characters not in the default font, making it like single_char_anywhere, but for
-// non-font characters and similarly-formatted images. Just pass in an appropriately-formatted array of bytes as the "bitmap" pointer.
+//  AVX_memmove(FrameBufferBase, FrameBufferBase + lines * pitch, kept_lines * pitch)
 //
-// Note that single_char_anywhere_scaled() takes 'a' or 'b', this would take something like character_array['a'] instead.
+// That memmove is still what happens if GPU isn't shadowed. If it is, Base just moves down the shadow buffer by 'lines', and the
+// screen's only moved back to the top of the buffer when Base runs out of room (once every screen height or so). GPU, the shadowed
+// GPUArray entry, and Global_Print_Info get the new FrameBufferBase. The whole screen is marked dirty. Moves go through bulk_copy(),
+// so a big enough screen gets moved by all idle CPUs.
 //
 
-void bitmap_anywhere_scaled(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU, const unsigned char * bitmap, UINT32 height, UINT32 width, UINT32 font_color, UINT32 highlight_color, UINT32 x, UINT32 y, UINT32 scale)
+void Scroll_Framebuffer(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE * GPU, UINT64 lines, UINT64 kept_lines)
 {
-  // Assuming "bitmap" is an array of bytes, e.g. { 0x3E, 0x63, 0x7B, 0x7B, 0x7B, 0x03, 0x1E, 0x00}, which would be U+0040 (@) -- an 8x8 '@' sign.
-  if(height > GPU.Info->VerticalResolution || width > GPU.Info->HorizontalResolution)
+  UINT64 pitch_bytes = (UINT64)GPU->Info->PixelsPerScanLine * 4;
+  SHADOW_FRAMEBUFFER_STRUCT * fb = (Global_Shadow_Info.Count != 0) ? shadow_find(GPU->FrameBufferBase) : NULL;
+
+  if(fb == NULL)
   {
-    Colorscreen(GPU, 0x00FF0000); // Need some kind of error indicator (makes screen red)
-  } // Could use an instruction like ARM's USAT to truncate values
-  else if(x > GPU.Info->HorizontalResolution || y > GPU.Info->VerticalResolution)
+    bulk_copy((EFI_PHYSICAL_ADDRESS*)GPU->FrameBufferBase, (EFI_PHYSICAL_ADDRESS*)(GPU->FrameBufferBase + lines * pitch_bytes), kept_lines * pitch_bytes);
+    return;
+  }
+
+  UINT64 height = fb->Height;
+  if(lines > height)
   {
-    Colorscreen(GPU, 0x0000FF00); // Makes screen green
+    lines = height;
   }
-  else if ((y + scale*height) > GPU.Info->VerticalResolution || (x + scale*width) > GPU.Info->HorizontalResolution)
+  if(kept_lines > height)
   {
-    Colorscreen(GPU, 0x000000FF); // Makes screen blue
+    kept_lines = height;
   }
 
-  Output_render_bitmap(GPU, bitmap, height, width, font_color, highlight_color, x, y, scale, 0);
-}
+  EFI_PHYSICAL_ADDRESS old_base = fb->Base;
+  EFI_PHYSICAL_ADDRESS new_base = old_base + lines * pitch_bytes;
 
+  if(new_base + height * pitch_bytes > fb->Buffer + fb->Buffer_Size)
+  {
+    // Out of room: put the part of the screen that's staying on screen at the top of the buffer
+    bulk_copy((EFI_PHYSICAL_ADDRESS*)fb->Buffer, (EFI_PHYSICAL_ADDRESS*)new_base, (height - lines) * pitch_bytes);
+    new_base = fb->Buffer;
+  }
 
-//----------------------------------------------------------------------------------------------------------------------------------
-// Output_render_bitmap: Render a Single-Color Bitmap to the Screen
-//----------------------------------------------------------------------------------------------------------------------------------
-//
-// This function draws a bitmapped character, given the following parameters:
-//
-// bitmap: a bitmapped image formatted like a font character
-// height and width: height (bytes) and width (bits) of the bitmap; there is no automatic way of getting this information for weird font sizes (e.g. 17 bits wide), sorry.
-// font_color: font color
-// highlight_color: highlight/background color for the string's characters (it's called highlight color in word processors)
-// x and y: coordinate positions of the top leftmost pixel of the string
-// scale: integer font scaling factor >= 1
-// index: mainly for strings, it's for keeping track of which character in the string is being output
-//
-// This is essentially the same thing as Output_render_text(), but for bitmaps that are not part of the default font.
-//
-// Note that single_char_anywhere_scaled() takes 'a' or 'b', this would take something like character_array['a'] instead.
-//
-
-void Output_render_bitmap(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU, const unsigned char * bitmap, UINT32 height, UINT32 width, UINT32 font_color, UINT32 highlight_color, UINT32 x, UINT32 y, UINT32 scale, UINT32 index)
-{
-  // Compact ceiling function, so that size doesn't need to be passed in
-  // This should be faster than a divide followed by a mod
-  uint32_t row_iterator = width >> 3;
-  if((width & 0x7) != 0)
+  // Old scanline r is now at r - lines. Scanlines past kept_lines need to show what they did before, same as with the memmove.
+  if((kept_lines >= lines) && (kept_lines < height))
   {
-    row_iterator++;
-  } // Width should never be zero, so the iterator will always be at least 1
-  uint32_t i;
+    bulk_copy((EFI_PHYSICAL_ADDRESS*)(new_base + kept_lines * pitch_bytes), (EFI_PHYSICAL_ADDRESS*)(new_base + (kept_lines - lines) * pitch_bytes), (height - kept_lines) * pitch_bytes);
+  }
 
-  for(uint32_t row = 0; row < height; row++) // for number of rows in the character of the fontarray
+  fb->Base = new_base;
+  GPU->FrameBufferBase = new_base;
+  if(fb->GPU_Entry->FrameBufferBase == old_base)
   {
-    i = 0;
-    for (uint32_t bit = 0; bit < width; bit++) // for bit in column
-    {
+    fb->GPU_Entry->FrameBufferBase = new_base;
+  }
+  if(Global_Print_Info.defaultGPU.FrameBufferBase == old_base)
+  {
+    Global_Print_Info.defaultGPU.FrameBufferBase = new_base;
+  }
+
+  fb->Dirty_Left = 0;
+  fb->Dirty_Top = 0;
+  fb->Dirty_Right = fb->Width;
+  fb->Dirty_Bottom = fb->Height;
+  fb->Dirty = 1;
+}
+
+// Find the shadow framebuffer that a FrameBufferBase points into, NULL if none
+static SHADOW_FRAMEBUFFER_STRUCT * shadow_find(EFI_PHYSICAL_ADDRESS frame_buffer_base)
+{
+  for(uint64_t i = 0; i < Global_Shadow_Info.Count; i++)
+  {
+    SHADOW_FRAMEBUFFER_STRUCT * fb = &Global_Shadow_Info.Framebuffers[i];
+    if((frame_buffer_base >= fb->Buffer) && (frame_buffer_base < fb->Buffer + fb->Buffer_Size))
+    {
+      return fb;
+    }
+  }
+
+  return NULL;
+}
+
+// Give one GPU a shadow framebuffer, see Setup_Shadow_Framebuffers(). Returns NULL if there isn't enough memory.
+static SHADOW_FRAMEBUFFER_STRUCT * shadow_setup(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE * entry, uint64_t gpu)
+{
+  if(Global_Shadow_Info.Count >= MAX_SHADOW_FRAMEBUFFERS)
+  {
+    return NULL;
+  }
+
+  uint64_t screen_size = (uint64_t)entry->Info->PixelsPerScanLine * entry->Info->VerticalResolution * 4;
+  uint64_t pages = EFI_SIZE_TO_PAGES(2 * screen_size);
+
+  void * buffer = malloc4k(pages);
+  if(buffer == MALLOC_FAILED)
+  {
+    printf("Setup_Shadow_Framebuffers: Not enough memory for GPU %qu's shadow framebuffer (%qu bytes).\r\n", gpu, 2 * screen_size);
+    return NULL;
+  }
+
+  SHADOW_FRAMEBUFFER_STRUCT * fb = &Global_Shadow_Info.Framebuffers[Global_Shadow_Info.Count];
+
+  fb->Hardware_Base = entry->FrameBufferBase;
+  fb->Buffer = (EFI_PHYSICAL_ADDRESS)buffer;
+  fb->Buffer_Size = pages << EFI_PAGE_SHIFT;
+  fb->Base = fb->Buffer;
+  fb->GPU_Entry = entry;
+  fb->Pitch = entry->Info->PixelsPerScanLine;
+  fb->Width = entry->Info->HorizontalResolution;
+  fb->Height = entry->Info->VerticalResolution;
+  fb->Dirty = 0;
+
+  // Start from what's on screen now. This is the last time video memory gets read.
+  bulk_copy(buffer, (void*)fb->Hardware_Base, screen_size);
+
+  if(Global_Print_Info.defaultGPU.FrameBufferBase == fb->Hardware_Base)
+  {
+    Global_Print_Info.defaultGPU.FrameBufferBase = fb->Base;
+  }
+  entry->FrameBufferBase = fb->Base;
+
+  Global_Shadow_Info.Count++;
+
+  return fb;
+}
+
+// Take a GPU off shadowing: point its GPUArray entry back at video memory, free its buffer, and close up the gap in Framebuffers.
+// Anything pointing into Framebuffers past 'fb' moves down one slot.
+static void shadow_remove(SHADOW_FRAMEBUFFER_STRUCT * fb)
+{
+  fb->GPU_Entry->FrameBufferBase = fb->Hardware_Base;
+  if((Global_Print_Info.defaultGPU.FrameBufferBase >= fb->Buffer) && (Global_Print_Info.defaultGPU.FrameBufferBase < fb->Buffer + fb->Buffer_Size))
+  {
+    Global_Print_Info.defaultGPU.FrameBufferBase = fb->Hardware_Base;
+  }
+
+  freepages((void*)fb->Buffer, fb->Buffer_Size >> EFI_PAGE_SHIFT);
+
+  uint64_t index = fb - Global_Shadow_Info.Framebuffers;
+  for(uint64_t i = index + 1; i < Global_Shadow_Info.Count; i++)
+  {
+    Global_Shadow_Info.Framebuffers[i - 1] = Global_Shadow_Info.Framebuffers[i];
+  }
+  Global_Shadow_Info.Count--;
+}
+
+// Copy pixels to video memory with streaming stores. The caller needs to sfence when it's done.
+static void shadow_stream_span(UINT32 * dest, const UINT32 * src, UINT64 pixels)
+{
+  // Pixels are 4-byte aligned, so get dest to 32 bytes one pixel at a time
+  while(pixels && ((UINT64)dest & 31))
+  {
+    _mm_stream_si32((int*)dest++, *(const int*)src++);
+    pixels--;
+  }
+
+  for(; pixels >= 8; pixels -= 8)
+  {
+    _mm256_stream_si256((__m256i*)dest, _mm256_loadu_si256((const __m256i*)src));
+    dest += 8;
+    src += 8;
+  }
+
+  while(pixels--)
+  {
+    _mm_stream_si32((int*)dest++, *(const int*)src++);
+  }
+}
+
+// Bit position and width of the red, green, and blue channels (in that order) of a GOP mode's 32-bit pixels
+static void mirror_channel_layout(EFI_GRAPHICS_OUTPUT_MODE_INFORMATION * info, UINT8 * shift, UINT8 * bits)
+{
+  if(info->PixelFormat == PixelRedGreenBlueReserved8BitPerColor)
+  {
+    shift[0] = 0;
+    shift[1] = 8;
+    shift[2] = 16;
+    bits[0] = bits[1] = bits[2] = 8;
+  }
+  else if(info->PixelFormat == PixelBlueGreenRedReserved8BitPerColor)
+  {
+    shift[0] = 16;
+    shift[1] = 8;
+    shift[2] = 0;
+    bits[0] = bits[1] = bits[2] = 8;
+  }
+  else // PixelBitMask
+  {
+    UINT32 masks[3] = {info->PixelInformation.RedMask, info->PixelInformation.GreenMask, info->PixelInformation.BlueMask};
+
+    for(UINT64 channel = 0; channel < 3; channel++)
+    {
+      shift[channel] = masks[channel] ? (UINT8)__builtin_ctz(masks[channel]) : 0;
+      bits[channel] = (UINT8)__builtin_popcount(masks[channel]);
+    }
+  }
+}
+
+// Copy fb's dirty rectangle to a mirror
+static void mirror_blit(MIRROR_HEAD_STRUCT * head, SHADOW_FRAMEBUFFER_STRUCT * fb)
+{
+  if(!head->Scaled)
+  {
+    UINT64 span = fb->Dirty_Right - fb->Dirty_Left;
+    UINT32 * src = (UINT32*)fb->Base + (UINT64)fb->Dirty_Top * fb->Pitch + fb->Dirty_Left;
+    UINT32 * dest = (UINT32*)head->Hardware_Base + (UINT64)fb->Dirty_Top * head->Pitch + fb->Dirty_Left;
+
+    for(UINT32 row = fb->Dirty_Top; row < fb->Dirty_Bottom; row++)
+    {
+      if(head->Conversion == MIRROR_COPY)
+      {
+        shadow_stream_span(dest, src, span);
+      }
+      else if(head->Conversion == MIRROR_SWAP_RED_BLUE)
+      {
+        mirror_swap_span(dest, src, span);
+      }
+      else
+      {
+        for(UINT64 column = 0; column < span; column++)
+        {
+          dest[column] = mirror_convert_pixel(head, src[column]);
+        }
+      }
+      src += fb->Pitch;
+      dest += head->Pitch;
+    }
+
+    return;
+  }
+
+  // Nearest neighbor: mirror pixel (x, y) shows source pixel (x * source width / mirror width, y * source height / mirror height), so
+  // these are the mirror columns and rows that land inside the dirty rectangle.
+  UINT32 left = (UINT32)(((UINT64)fb->Dirty_Left * head->Width + fb->Width - 1) / fb->Width);
+  UINT32 right = (UINT32)(((UINT64)fb->Dirty_Right * head->Width + fb->Width - 1) / fb->Width);
+  UINT32 top = (UINT32)(((UINT64)fb->Dirty_Top * head->Height + fb->Height - 1) / fb->Height);
+  UINT32 bottom = (UINT32)(((UINT64)fb->Dirty_Bottom * head->Height + fb->Height - 1) / fb->Height);
+
+  for(UINT32 row = top; row < bottom; row++)
+  {
+    UINT32 * src = (UINT32*)fb->Base + (((UINT64)row * fb->Height) / head->Height) * fb->Pitch;
+    UINT32 * dest = (UINT32*)head->Hardware_Base + (UINT64)row * head->Pitch;
+
+    if(head->Conversion == MIRROR_COPY)
+    {
+      for(UINT32 column = left; column < right; column++)
+      {
+        dest[column] = src[head->Column_Map[column]];
+      }
+    }
+    else
+    {
+      for(UINT32 column = left; column < right; column++)
+      {
+        dest[column] = mirror_convert_pixel(head, src[head->Column_Map[column]]);
+      }
+    }
+  }
+}
+
+// Convert one pixel from the source's format to the mirror's
+static UINT32 mirror_convert_pixel(MIRROR_HEAD_STRUCT * head, UINT32 pixel)
+{
+  if(head->Conversion == MIRROR_COPY)
+  {
+    return pixel;
+  }
+
+  if(head->Conversion == MIRROR_SWAP_RED_BLUE)
+  {
+    return (pixel & 0xFF00FF00) | ((pixel >> 16) & 0xFF) | ((pixel & 0xFF) << 16);
+  }
+
+  UINT32 converted = 0;
+  for(UINT64 channel = 0; channel < 3; channel++)
+  {
+    if((head->Source_Bits[channel] == 0) || (head->Dest_Bits[channel] == 0))
+    {
+      continue;
+    }
+
+    UINT32 value = (pixel >> head->Source_Shift[channel]) & ((1U << head->Source_Bits[channel]) - 1);
+
+    // Keep the most significant bits when narrowing, and replicate them into the new ones when widening
+    if(head->Dest_Bits[channel] < head->Source_Bits[channel])
+    {
+      value >>= head->Source_Bits[channel] - head->Dest_Bits[channel];
+    }
+    else if(head->Dest_Bits[channel] > head->Source_Bits[channel])
+    {
+      UINT32 widened = 0;
+      for(INT32 filled = head->Dest_Bits[channel]; filled > 0; filled -= head->Source_Bits[channel])
+      {
+        widened |= (filled >= head->Source_Bits[channel]) ? (value << (filled - head->Source_Bits[channel])) : (value >> (head->Source_Bits[channel] - filled));
+      }
+      value = widened;
+    }
+
+    converted |= value << head->Dest_Shift[channel];
+  }
+
+  return converted;
+}
+
+// Same as shadow_stream_span(), but swapping the red and blue bytes of each pixel on the way
+static void mirror_swap_span(UINT32 * dest, const UINT32 * src, UINT64 pixels)
+{
+  const __m128i swap = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+
+  while(pixels && ((UINT64)dest & 31))
+  {
+    UINT32 pixel = *src++;
+    _mm_stream_si32((int*)dest++, (int)((pixel & 0xFF00FF00) | ((pixel >> 16) & 0xFF) | ((pixel & 0xFF) << 16)));
+    pixels--;
+  }
+
+  if(AVX_Mem_Dispatch.Features & AVX_MEM_FEATURE_AVX2)
+  {
+    UINT64 done = mirror_swap_span_avx2(dest, src, pixels);
+    dest += done;
+    src += done;
+    pixels -= done;
+  }
+
+  for(; pixels >= 4; pixels -= 4)
+  {
+    _mm_stream_si128((__m128i*)dest, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)src), swap));
+    dest += 4;
+    src += 4;
+  }
+
+  while(pixels--)
+  {
+    UINT32 pixel = *src++;
+    _mm_stream_si32((int*)dest++, (int)((pixel & 0xFF00FF00) | ((pixel >> 16) & 0xFF) | ((pixel & 0xFF) << 16)));
+  }
+}
+
+// The bulk of mirror_swap_span() for CPUs with AVX2, 8 pixels at a time. dest has to be 32-byte aligned. Returns how many pixels it
+// did.
+static __attribute__((target("avx2"))) UINT64 mirror_swap_span_avx2(UINT32 * dest, const UINT32 * src, UINT64 pixels)
+{
+  const __m256i swap = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15, 2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+  UINT64 done = 0;
+
+  for(; done + 8 <= pixels; done += 8)
+  {
+    _mm256_stream_si256((__m256i*)(dest + done), _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(src + done)), swap));
+  }
+
+  return done;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// single_char: Color a Single Character
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Print a single character of the default font (set at the top of this file) at the top left of the screen (0,0) and at a specified
+// font color and highlight color
+//
+// character: 'a' or 'b' (with single quotes), for example
+// height and width: height (bytes) and width (bits) of the font character; there is no automatic way of getting this information for weird font sizes (e.g. 17 bits wide), sorry.
+// font_color: font color
+// highlight_color: highlight/background color for the string's characters (it's called highlight color in word processors)
+//
+
+void single_char(const EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE * GPU, int character, UINT32 height, UINT32 width, UINT32 font_color, UINT32 highlight_color)
+{
+  // Assuming "character" is an array of bytes, e.g. { 0x3E, 0x63, 0x7B, 0x7B, 0x7B, 0x03, 0x1E, 0x00}, which would be U+0040 (@) -- an 8x8 '@' sign.
+  if(height > GPU->Info->VerticalResolution || width > GPU->Info->HorizontalResolution)
+  {
+    Colorscreen(GPU, 0x00FF0000); // Need some kind of error indicator (makes screen red)
+  } // Could use an instruction like ARM's USAT to truncate values
+
+  Output_render_text(GPU, character, height, width, font_color, highlight_color, 0, 0, 1, 0);
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// single_char_anywhere: Color a Single Character Anywhere
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Print a single character of the default font (set at the top of this file), at (x,y) coordinates from the top left of the screen
+// (0,0), using a specified font color and highlight color
+//
+// character: 'a' or 'b' (with single quotes), for example
+// height and width: height (bytes) and width (bits) of the font character; there is no automatic way of getting this information for weird font sizes (e.g. 17 bits wide), sorry.
+// font_color: font color
+// highlight_color: highlight/background color for the string's characters (it's called highlight color in word processors)
+// x and y: coordinate positions of the top leftmost pixel of the string
+//
+
+void single_char_anywhere(const EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE * GPU, int character, UINT32 height, UINT32 width, UINT32 font_color, UINT32 highlight_color, UINT32 x, UINT32 y)
+{
+  // Assuming "character" is an array of bytes, e.g. { 0x3E, 0x63, 0x7B, 0x7B, 0x7B, 0x03, 0x1E, 0x00}, which would be U+0040 (@) -- an 8x8 '@' sign.
+  if(height > GPU->Info->VerticalResolution || width > GPU->Info->HorizontalResolution)
+  {
+    Colorscreen(GPU, 0x00FF0000); // Need some kind of error indicator (makes screen red)
+  } // Could use an instruction like ARM's USAT to truncate values
+  else if(x > GPU->Info->HorizontalResolution || y > GPU->Info->VerticalResolution)
+  {
+    Colorscreen(GPU, 0x0000FF00); // Makes screen green
+  }
+  else if ((y + height) > GPU->Info->VerticalResolution || (x + width) > GPU->Info->HorizontalResolution)
+  {
+    Colorscreen(GPU, 0x000000FF); // Makes screen blue
+  }
+
+  Output_render_text(GPU, character, height, width, font_color, highlight_color, x, y, 1, 0);
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// single_char_anywhere_scaled: Color a Single Character Anywhere with Scaling
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Print a single character of the default font (set at the top of this file), at (x,y) coordinates from the top left of the screen
+// (0,0), using a specified font color, highlight color, and scale factor
+//
+// character: 'a' or 'b' (with single quotes), for example
+// height and width: height (bytes) and width (bits) of the font character; there is no automatic way of getting this information for weird font sizes (e.g. 17 bits wide), sorry.
+// font_color: font color
+// highlight_color: highlight/background color for the string's characters (it's called highlight color in word processors)
+// x and y: coordinate positions of the top leftmost pixel of the string
+// scale: integer font scaling factor >= 1
+//
+
+void single_char_anywhere_scaled(const EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE * GPU, int character, UINT32 height, UINT32 width, UINT32 font_color, UINT32 highlight_color, UINT32 x, UINT32 y, UINT32 scale)
+{
+  // Assuming "character" is an array of bytes, e.g. { 0x3E, 0x63, 0x7B, 0x7B, 0x7B, 0x03, 0x1E, 0x00}, which would be U+0040 (@) -- an 8x8 '@' sign.
+  if(height > GPU->Info->VerticalResolution || width > GPU->Info->HorizontalResolution)
+  {
+    Colorscreen(GPU, 0x00FF0000); // Need some kind of error indicator (makes screen red)
+  } // Could use an instruction like ARM's USAT to truncate values
+  else if(x > GPU->Info->HorizontalResolution || y > GPU->Info->VerticalResolution)
+  {
+    Colorscreen(GPU, 0x0000FF00); // Makes screen green
+  }
+  else if ((y + scale*height) > GPU->Info->VerticalResolution || (x + scale*width) > GPU->Info->HorizontalResolution)
+  {
+    Colorscreen(GPU, 0x000000FF); // Makes screen blue
+  }
+
+  Output_render_text(GPU, character, height, width, font_color, highlight_color, x, y, scale, 0);
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// string_anywhere_scaled: Color a String Anywhere with Scaling
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Print a string of the default font (set at the top of this file), at (x,y) coordinates from the top left of the screen
+// (0,0), using a specified font color, highlight color, and scale factor
+//
+// string: "a string like this" (no formatting specifiers -- use formatted_string_anywhere_scaled() for that instead)
+// height and width: height (bytes) and width (bits) of the string's font characters; there is no automatic way of getting this information for weird font sizes (e.g. 17 bits wide), sorry.
+// font_color: font color
+// highlight_color: highlight/background color for the string's characters (it's called highlight color in word processors)
+// x and y: coordinate positions of the top leftmost pixel of the string
+// scale: integer font scaling factor >= 1
+//
+// NOTE: literal strings in C are automatically null-terminated. i.e. "hi" is actually 3 characters long.
+// This function allows direct output of a pre-made string, either a hardcoded one or one made via sprintf.
+//
+
+void string_anywhere_scaled(const EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE * GPU, const char * string, UINT32 height, UINT32 width, UINT32 font_color, UINT32 highlight_color, UINT32 x, UINT32 y, UINT32 scale)
+{
+  if(height > GPU->Info->VerticalResolution || width > GPU->Info->HorizontalResolution)
+  {
+    Colorscreen(GPU, 0x00FF0000); // Need some kind of error indicator (makes screen red)
+  } // Could use an instruction like ARM's USAT to truncate values
+  else if(x > GPU->Info->HorizontalResolution || y > GPU->Info->VerticalResolution)
+  {
+    Colorscreen(GPU, 0x0000FF00); // Makes screen green
+  }
+  else if ((y + scale*height) > GPU->Info->VerticalResolution || (x + scale*width) > GPU->Info->HorizontalResolution)
+  {
+    Colorscreen(GPU, 0x000000FF); // Makes screen blue
+  }
+
+  // The whole string is drawn one scanline at a time, see Render_Text_Span()
+  RENDER_TARGET target;
+  Render_Target_Init(&target, GPU);
+
+  uint64_t length = AVX_strlen(string);
+
+  Render_Text_Span(&target, string, length, height, width, font_color, highlight_color, x, y, scale);
+} // end function
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Output_render_text: Render a Character to the Screen
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// This function draws a character of the default font on the screen, given the following parameters:
+//
+// character: 'a' or 'b' (with single quotes), for example
+// height and width: height (bytes) and width (bits) of the font character; there is no automatic way of getting this information for weird font sizes (e.g. 17 bits wide), sorry.
+// font_color: font color
+// highlight_color: highlight/background color for the string's characters (it's called highlight color in word processors)
+// x and y: coordinate positions of the top leftmost pixel of the string
+// scale: integer font scaling factor >= 1
+// index: mainly for strings, it's for keeping track of which character in the string is being output
+//
+// Up to GLYPH_CACHE_MAX_SCALE, rows are copied out of a cache holding every possible font byte already expanded into scale x 8 pixels
+// of font_color and highlight_color, so drawing a glyph row is just a few vector stores per scanline. Transparent highlights
+// (0xFF000000) use masked stores. The cache is rebuilt whenever the colors or scale passed in differ from what it holds, which also
+// covers changes to Global_Print_Info, and larger scales use the original per-pixel loop.
+//
+
+void Output_render_text(const EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE * GPU, int character, UINT32 height, UINT32 width, UINT32 font_color, UINT32 highlight_color, UINT32 x, UINT32 y, UINT32 scale, UINT32 index)
+{
+  // Compact ceiling function, so that size doesn't need to be passed in
+  // This should be faster than a divide followed by a mod
+  uint32_t row_iterator = width >> 3;
+  if((width & 0x7) != 0)
+  {
+    row_iterator++;
+  } // Width should never be zero, so the iterator will always be at least 1
+  uint32_t i;
+
+  Shadow_Mark_Dirty(GPU, x + scale*index*width, y, scale*width, scale*height);
+
+  // A font color of 0xFF000000 would look transparent to the masked stores, so leave that to the slow path
+  if((scale <= GLYPH_CACHE_MAX_SCALE) && (font_color != 0xFF000000))
+  {
+    if((scale != glyph_cache_scale) || (font_color != glyph_cache_font_color) || (highlight_color != glyph_cache_highlight_color))
+    {
+      glyph_cache_build(font_color, highlight_color, scale);
+    }
+
+    UINT32 transparent = (highlight_color == 0xFF000000);
+    UINT64 pitch = GPU->Info->PixelsPerScanLine;
+    UINT32 * glyph_origin = (UINT32*)GPU->FrameBufferBase + (UINT64)y*pitch + x + (UINT64)scale*index*width;
+    UINT32 last_bits = (width & 0x7) ? (width & 0x7) : 8;
+
+    for(uint32_t row = 0; row < height; row++)
+    {
+      const unsigned char * font_row = &SYSTEMFONT[character][row*row_iterator];
+      UINT32 * line = glyph_origin + (UINT64)row*scale*pitch;
+
+      for(uint32_t b = 0; b < scale; b++)
+      {
+        for(i = 0; i < row_iterator; i++)
+        {
+          UINT32 bits = (i == row_iterator - 1) ? last_bits : 8;
+          glyph_row_blit(line + i*8*scale, glyph_cache_rows[font_row[i]], bits*scale, transparent);
+        }
+        line += pitch;
+      }
+    }
+
+    return;
+  }
+
+  for(uint32_t row = 0; row < height; row++) // for number of rows in the character of the fontarray
+  {
+    i = 0;
+    for (uint32_t bit = 0; bit < width; bit++) // for bit in column
+    {
+      if(((bit & 0x7) == 0 ) && (bit > 0))
+      {
+        i++;
+      }
+      // if a 1, output NOTE: There's gotta be a better way to do this.
+//      if( character[row*row_iterator + i] & (1 << (7 - (bit & 0x7))) )
+      if((SYSTEMFONT[character][row*row_iterator + i] >> (bit & 0x7)) & 0x1)
+      {
+        // start scale here
+        for(uint32_t b = 0; b < scale; b++)
+        {
+          for(uint32_t a = 0; a < scale; a++)
+          {
+            *(UINT32*)(GPU->FrameBufferBase + ((y*GPU->Info->PixelsPerScanLine + x) + scale*(row*GPU->Info->PixelsPerScanLine + bit) + (b*GPU->Info->PixelsPerScanLine + a) + scale * index * width)*4) = font_color;
+          }
+        } //end scale here
+      } //end if
+      else // if a 0, background or skip (set highlight_color to 0xFF000000 for transparency)
+      {
+        // start scale here
+        for(uint32_t b = 0; b < scale; b++)
+        {
+          for(uint32_t a = 0; a < scale; a++)
+          {
+            if(highlight_color != 0xFF000000) // Transparency "color"
+            {
+              *(UINT32*)(GPU->FrameBufferBase + ((y*GPU->Info->PixelsPerScanLine + x) + scale*(row*GPU->Info->PixelsPerScanLine + bit) + (b*GPU->Info->PixelsPerScanLine + a) + scale * index * width)*4) = highlight_color;
+            }
+          }
+        } //end scale here
+      } // end else
+    } // end bit in column
+  } // end byte in row
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Render_Target_Init: Prepare a GPU for Span Rendering
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Fill in a RENDER_TARGET from a GPU's mode information, so that Render_Text_Span() doesn't have to look everything up through
+// GPU->Info again for each string. The GPU is referenced, not copied, so it needs to outlive the target. Set the target up again if
+// the GPU's FrameBufferBase changes, e.g. after Setup_Shadow_Framebuffers().
+//
+
+void Render_Target_Init(RENDER_TARGET * target, const EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE * GPU)
+{
+  target->Base = (UINT32*)GPU->FrameBufferBase;
+  target->Pitch = GPU->Info->PixelsPerScanLine;
+  target->Width = GPU->Info->HorizontalResolution;
+  target->Height = GPU->Info->VerticalResolution;
+  target->PixelFormat = GPU->Info->PixelFormat;
+  target->GPU = GPU;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Render_Text_Span: Render a Run of Characters
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Draw 'length' characters of the default font side by side on one line, starting at (x,y). Unlike calling Output_render_text() for
+// each character, this goes one scanline at a time across the whole run, so the framebuffer gets written front to back in long
+// sequential stretches instead of in a character-sized box at a time, and the dirty rectangle is only updated once.
+//
+// target: set up with Render_Target_Init()
+// string: characters to draw; '\0' isn't special here, so this can draw part of a larger buffer
+// height and width: height (bytes) and width (bits) of the font characters
+// font_color: font color
+// highlight_color: highlight/background color for the characters (0xFF000000 for transparent)
+// x and y: coordinate positions of the top leftmost pixel of the first character
+// scale: integer font scaling factor >= 1
+//
+// Characters that would go past the right edge of the screen, and rows past the bottom, are clipped off. Scales above
+// GLYPH_CACHE_MAX_SCALE and a font color of 0xFF000000 fall back to Output_render_text() for each character.
+//
+
+void Render_Text_Span(RENDER_TARGET * target, const char * string, UINT64 length, UINT32 height, UINT32 width, UINT32 font_color, UINT32 highlight_color, UINT32 x, UINT32 y, UINT32 scale)
+{
+  UINT64 char_pixels = (UINT64)width * scale;
+
+  if((length == 0) || (char_pixels == 0) || (x >= target->Width) || (y >= target->Height))
+  {
+    return;
+  }
+
+  UINT64 fits = (target->Width - x) / char_pixels;
+  if(length > fits)
+  {
+    length = fits;
+  }
+
+  if(length == 0)
+  {
+    return;
+  }
+
+  if((scale > GLYPH_CACHE_MAX_SCALE) || (font_color == 0xFF000000))
+  {
+    for(UINT64 index = 0; index < length; index++)
+    {
+      Output_render_text(target->GPU, (unsigned char)string[index], height, width, font_color, highlight_color, x, y, scale, (UINT32)index);
+    }
+    return;
+  }
+
+  if((scale != glyph_cache_scale) || (font_color != glyph_cache_font_color) || (highlight_color != glyph_cache_highlight_color))
+  {
+    glyph_cache_build(font_color, highlight_color, scale);
+  }
+
+  uint32_t row_iterator = width >> 3;
+  if((width & 0x7) != 0)
+  {
+    row_iterator++;
+  }
+
+  UINT32 transparent = (highlight_color == 0xFF000000);
+  UINT32 last_bits = (width & 0x7) ? (width & 0x7) : 8;
+  UINT64 rows = (UINT64)height * scale;
+  if(y + rows > target->Height)
+  {
+    rows = target->Height - y;
+  }
+
+  Shadow_Mark_Dirty(target->GPU, x, y, (UINT32)(length * char_pixels), (UINT32)rows);
+
+  UINT32 * line = target->Base + (UINT64)y*target->Pitch + x;
+
+  for(UINT64 scanline = 0; scanline < rows; scanline++)
+  {
+    uint32_t font_row_offset = (uint32_t)(scanline / scale) * row_iterator;
+    UINT32 * pixel = line;
+
+    for(UINT64 index = 0; index < length; index++)
+    {
+      const unsigned char * font_row = &SYSTEMFONT[(unsigned char)string[index]][font_row_offset];
+
+      for(uint32_t i = 0; i < row_iterator; i++)
+      {
+        UINT32 bits = (i == row_iterator - 1) ? last_bits : 8;
+        glyph_row_blit(pixel, glyph_cache_rows[font_row[i]], bits*scale, transparent);
+        pixel += bits*scale;
+      }
+    }
+
+    line += target->Pitch;
+  }
+}
+
+// Expand all 256 possible font bytes into rows of pixels. Bit 0 is the leftmost pixel, same as Output_render_text().
+static void glyph_cache_build(UINT32 font_color, UINT32 highlight_color, UINT32 scale)
+{
+  for(uint32_t pattern = 0; pattern < 256; pattern++)
+  {
+    UINT32 * pixel = glyph_cache_rows[pattern];
+
+    for(uint32_t bit = 0; bit < 8; bit++)
+    {
+      UINT32 color = ((pattern >> bit) & 0x1) ? font_color : highlight_color;
+      for(uint32_t a = 0; a < scale; a++)
+      {
+        *pixel++ = color;
+      }
+    }
+  }
+
+  glyph_cache_font_color = font_color;
+  glyph_cache_highlight_color = highlight_color;
+  glyph_cache_scale = scale;
+}
+
+// Copy 'pixels' pixels of one cached row to the screen, skipping 0xFF000000 pixels if transparent. src is a glyph_cache_rows entry,
+// which is always readable up to GLYPH_CACHE_ROW_PIXELS even if pixels is less than that.
+static void glyph_row_blit(UINT32 * dest, const UINT32 * src, UINT32 pixels, UINT32 transparent)
+{
+  if(AVX_Mem_Dispatch.Features & AVX_MEM_FEATURE_AVX2)
+  {
+    glyph_row_blit_avx2(dest, src, pixels, transparent);
+    return;
+  }
+
+  for(UINT32 i = 0; i < pixels; i++)
+  {
+    if(!transparent || (src[i] != 0xFF000000))
+    {
+      dest[i] = src[i];
+    }
+  }
+}
+
+// glyph_row_blit() for CPUs with AVX2. The tail is done with a masked store instead of one pixel at a time.
+static __attribute__((target("avx2"))) void glyph_row_blit_avx2(UINT32 * dest, const UINT32 * src, UINT32 pixels, UINT32 transparent)
+{
+  const __m256i marker = _mm256_set1_epi32((int)0xFF000000);
+  const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  UINT32 i = 0;
+
+  for(; i + 8 <= pixels; i += 8)
+  {
+    __m256i row = _mm256_load_si256((const __m256i*)(src + i));
+    if(transparent)
+    {
+      __m256i keep = _mm256_xor_si256(_mm256_cmpeq_epi32(row, marker), _mm256_set1_epi32(-1));
+      _mm256_maskstore_epi32((int*)(dest + i), keep, row);
+    }
+    else
+    {
+      _mm256_storeu_si256((__m256i*)(dest + i), row);
+    }
+  }
+
+  if(i < pixels)
+  {
+    __m256i row = _mm256_load_si256((const __m256i*)(src + i));
+    __m256i keep = _mm256_cmpgt_epi32(_mm256_set1_epi32(pixels - i), lanes);
+    if(transparent)
+    {
+      keep = _mm256_andnot_si256(_mm256_cmpeq_epi32(row, marker), keep);
+    }
+    _mm256_maskstore_epi32((int*)(dest + i), keep, row);
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Render_Fill_Rect: Fill a Rectangle
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Fill a width x height rectangle whose top left pixel is at (x,y) with a color. Like the rest of the Render_ functions, the
+// rectangle can hang off any edge of the screen (x and y can be negative), and only the visible part gets drawn.
+//
+// target: set up with Render_Target_Init()
+// x and y: coordinate positions of the top leftmost pixel of the rectangle
+// width and height: size of the rectangle in pixels
+// color: fill color
+//
+
+void Render_Fill_Rect(RENDER_TARGET * target, INT32 x, INT32 y, UINT32 width, UINT32 height, UINT32 color)
+{
+  INT64 left = x;
+  INT64 top = y;
+  UINT64 columns = width;
+  UINT64 rows = height;
+  UINT64 skip_x, skip_y;
+
+  if(!render_clip(target, &left, &top, &columns, &rows, &skip_x, &skip_y))
+  {
+    return;
+  }
+
+  Shadow_Mark_Dirty(target->GPU, (UINT32)left, (UINT32)top, (UINT32)columns, (UINT32)rows);
+
+  UINT32 * line = target->Base + (UINT64)top*target->Pitch + left;
+
+  if(columns == target->Pitch)
+  {
+    AVX_memset_4B(line, color, columns*rows); // Whole scanlines are one contiguous block
+  }
+  else if(columns < 8)
+  {
+    // Narrow things like vertical lines aren't worth setting up a vector loop for
+    for(UINT64 row = 0; row < rows; row++)
+    {
+      for(UINT64 column = 0; column < columns; column++)
+      {
+        line[column] = color;
+      }
+      line += target->Pitch;
+    }
+  }
+  else
+  {
+    for(UINT64 row = 0; row < rows; row++)
+    {
+      AVX_memset_4B(line, color, columns);
+      line += target->Pitch;
+    }
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Render_Rect_Outline: Draw a Rectangle's Outline
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Draw the border of a width x height rectangle whose top left pixel is at (x,y), thickness pixels wide, on the inside of the
+// rectangle. A border too thick to leave anything in the middle just fills the rectangle.
+//
+
+void Render_Rect_Outline(RENDER_TARGET * target, INT32 x, INT32 y, UINT32 width, UINT32 height, UINT32 thickness, UINT32 color)
+{
+  if((thickness == 0) || (width == 0) || (height == 0))
+  {
+    return;
+  }
+
+  if(((UINT64)thickness*2 >= width) || ((UINT64)thickness*2 >= height))
+  {
+    Render_Fill_Rect(target, x, y, width, height, color);
+    return;
+  }
+
+  // Top and bottom go all the way across, so that each scanline only gets drawn once
+  Render_Fill_Rect(target, x, y, width, thickness, color);
+  Render_Fill_Rect(target, x, (INT32)((INT64)y + height - thickness), width, thickness, color);
+  Render_Fill_Rect(target, x, (INT32)((INT64)y + thickness), thickness, height - 2*thickness, color);
+  Render_Fill_Rect(target, (INT32)((INT64)x + width - thickness), (INT32)((INT64)y + thickness), thickness, height - 2*thickness, color);
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Render_Line: Draw a Line
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Draw a 1-pixel line from (x0,y0) to (x1,y1), including both ends. Horizontal and vertical lines are just thin rectangles, and
+// anything else is a Bresenham line.
+//
+// Lines are clipped to the screen (Cohen-Sutherland) before drawing, so a line that's mostly off the screen doesn't cost any more
+// than the part that's on it. Since the clipped ends get rounded to whole pixels, a clipped line can be off by a pixel from what
+// the unclipped line would have drawn where it crosses the edge.
+//
+
+void Render_Line(RENDER_TARGET * target, INT32 x0, INT32 y0, INT32 x1, INT32 y1, UINT32 color)
+{
+  // The far end of a span covering all of INT32 is way off the screen anyway, so it's fine that its length gets cut to fit a UINT32
+  if(y0 == y1)
+  {
+    INT64 left = (x0 < x1) ? x0 : x1;
+    INT64 length = ((x0 < x1) ? x1 : x0) - left + 1;
+    Render_Fill_Rect(target, (INT32)left, y0, (length > 0xFFFFFFFF) ? 0xFFFFFFFF : (UINT32)length, 1, color);
+    return;
+  }
+  if(x0 == x1)
+  {
+    INT64 top = (y0 < y1) ? y0 : y1;
+    INT64 length = ((y0 < y1) ? y1 : y0) - top + 1;
+    Render_Fill_Rect(target, x0, (INT32)top, 1, (length > 0xFFFFFFFF) ? 0xFFFFFFFF : (UINT32)length, color);
+    return;
+  }
+
+  INT64 ax = x0, ay = y0, bx = x1, by = y1;
+
+  if(!render_clip_line(target, &ax, &ay, &bx, &by))
+  {
+    return;
+  }
+
+  INT64 dx = (bx > ax) ? (bx - ax) : (ax - bx);
+  INT64 dy = (by > ay) ? (by - ay) : (ay - by);
+  INT64 step_x = (bx > ax) ? 1 : -1;
+  INT64 step_y = (by > ay) ? (INT64)target->Pitch : -(INT64)target->Pitch;
+
+  Shadow_Mark_Dirty(target->GPU, (UINT32)((ax < bx) ? ax : bx), (UINT32)((ay < by) ? ay : by), (UINT32)dx + 1, (UINT32)dy + 1);
+
+  UINT32 * pixel = target->Base + (UINT64)ay*target->Pitch + ax;
+  INT64 error = dx - dy;
+
+  for(INT64 count = ((dx > dy) ? dx : dy) + 1; count > 0; count--)
+  {
+    *pixel = color;
+
+    INT64 error2 = error * 2;
+    if(error2 > -dy)
+    {
+      error -= dy;
+      pixel += step_x;
+    }
+    if(error2 < dx)
+    {
+      error += dx;
+      pixel += step_y;
+    }
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Render_Blit: Copy an Image to the Screen
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Copy a width x height 32bpp image to (x,y), clipped to the screen. The image needs to be in the screen's pixel format already
+// (see target->PixelFormat), and src_pitch is the number of pixels from the start of one of its rows to the next.
+//
+
+void Render_Blit(RENDER_TARGET * target, const UINT32 * src, UINT64 src_pitch, UINT32 width, UINT32 height, INT32 x, INT32 y)
+{
+  INT64 left = x;
+  INT64 top = y;
+  UINT64 columns = width;
+  UINT64 rows = height;
+  UINT64 skip_x, skip_y;
+
+  if(!render_clip(target, &left, &top, &columns, &rows, &skip_x, &skip_y))
+  {
+    return;
+  }
+
+  Shadow_Mark_Dirty(target->GPU, (UINT32)left, (UINT32)top, (UINT32)columns, (UINT32)rows);
+
+  UINT32 * line = target->Base + (UINT64)top*target->Pitch + left;
+  src += skip_y*src_pitch + skip_x;
+
+  for(UINT64 row = 0; row < rows; row++)
+  {
+    AVX_memcpy(line, (void*)src, columns*4);
+    line += target->Pitch;
+    src += src_pitch;
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Render_Blit_Alpha: Blend an Image onto the Screen
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Same as Render_Blit(), but each pixel's top byte is its alpha (0 = invisible, 255 = opaque), and the image goes on top of what's
+// already there (source-over): dest = src*alpha + dest*(255 - alpha), per channel, divided by 255 with rounding. The screen's own
+// top byte, which GOP calls reserved, gets the combined alpha.
+//
+// Runs of 8 fully opaque or fully invisible pixels are just copied or skipped, so sprites with hard edges cost about as much as
+// Render_Blit().
+//
+
+void Render_Blit_Alpha(RENDER_TARGET * target, const UINT32 * src, UINT64 src_pitch, UINT32 width, UINT32 height, INT32 x, INT32 y)
+{
+  INT64 left = x;
+  INT64 top = y;
+  UINT64 columns = width;
+  UINT64 rows = height;
+  UINT64 skip_x, skip_y;
+
+  if(!render_clip(target, &left, &top, &columns, &rows, &skip_x, &skip_y))
+  {
+    return;
+  }
+
+  Shadow_Mark_Dirty(target->GPU, (UINT32)left, (UINT32)top, (UINT32)columns, (UINT32)rows);
+
+  UINT32 * line = target->Base + (UINT64)top*target->Pitch + left;
+  src += skip_y*src_pitch + skip_x;
+
+  for(UINT64 row = 0; row < rows; row++)
+  {
+    blend_span(line, src, columns);
+    line += target->Pitch;
+    src += src_pitch;
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Render_Expand_1bpp: Draw a 1-Bit Image
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Draw a width x height 1bpp image at (x,y), with 1 bits in font_color and 0 bits in highlight_color (0xFF000000 for transparent).
+// Bits are in the same order as the font and bitmap_anywhere_scaled(): bit 0 of each byte is the leftmost pixel. src_pitch is the
+// number of bytes from the start of one row to the next, which is usually (width + 7)/8.
+//
+// This expands 8 pixels at a time straight from the bits, so unlike Render_Text_Span() there's no cache to build first, and any
+// font_color and highlight_color are fine. There's no scaling, though.
+//
+
+void Render_Expand_1bpp(RENDER_TARGET * target, const unsigned char * src, UINT64 src_pitch, UINT32 width, UINT32 height, INT32 x, INT32 y, UINT32 font_color, UINT32 highlight_color)
+{
+  INT64 left = x;
+  INT64 top = y;
+  UINT64 columns = width;
+  UINT64 rows = height;
+  UINT64 skip_x, skip_y;
+
+  if(!render_clip(target, &left, &top, &columns, &rows, &skip_x, &skip_y))
+  {
+    return;
+  }
+
+  Shadow_Mark_Dirty(target->GPU, (UINT32)left, (UINT32)top, (UINT32)columns, (UINT32)rows);
+
+  UINT32 * line = target->Base + (UINT64)top*target->Pitch + left;
+  src += skip_y*src_pitch;
+
+  for(UINT64 row = 0; row < rows; row++)
+  {
+    expand_span(line, src, skip_x, columns, font_color, highlight_color);
+    line += target->Pitch;
+    src += src_pitch;
+  }
+}
+
+// Clip a rectangle to the target. Returns 0 if none of it is visible, otherwise x, y, width, and height become the visible part and
+// skip_x and skip_y say how far into the rectangle that part starts.
+static UINT8 render_clip(const RENDER_TARGET * target, INT64 * x, INT64 * y, UINT64 * width, UINT64 * height, UINT64 * skip_x, UINT64 * skip_y)
+{
+  INT64 right = *x + (INT64)*width;
+  INT64 bottom = *y + (INT64)*height;
+  INT64 left = (*x < 0) ? 0 : *x;
+  INT64 top = (*y < 0) ? 0 : *y;
+
+  if(right > (INT64)target->Width)
+  {
+    right = target->Width;
+  }
+  if(bottom > (INT64)target->Height)
+  {
+    bottom = target->Height;
+  }
+
+  if((left >= right) || (top >= bottom))
+  {
+    return 0;
+  }
+
+  *skip_x = (UINT64)(left - *x);
+  *skip_y = (UINT64)(top - *y);
+  *x = left;
+  *y = top;
+  *width = (UINT64)(right - left);
+  *height = (UINT64)(bottom - top);
+
+  return 1;
+}
+
+// Cohen-Sutherland outcodes
+#define CLIP_LEFT   0x1
+#define CLIP_RIGHT  0x2
+#define CLIP_TOP    0x4
+#define CLIP_BOTTOM 0x8
+
+static UINT8 render_outcode(const RENDER_TARGET * target, INT64 x, INT64 y)
+{
+  UINT8 code = 0;
+
+  if(x < 0)
+  {
+    code |= CLIP_LEFT;
+  }
+  else if(x >= (INT64)target->Width)
+  {
+    code |= CLIP_RIGHT;
+  }
+
+  if(y < 0)
+  {
+    code |= CLIP_TOP;
+  }
+  else if(y >= (INT64)target->Height)
+  {
+    code |= CLIP_BOTTOM;
+  }
+
+  return code;
+}
+
+// Clip the line from (x0,y0) to (x1,y1) to the target. Returns 0 if none of it is visible. Coordinates come from INT32s, but their
+// differences multiplied together can need more than 64 bits, hence the __int128s.
+static UINT8 render_clip_line(const RENDER_TARGET * target, INT64 * x0, INT64 * y0, INT64 * x1, INT64 * y1)
+{
+  UINT8 code0 = render_outcode(target, *x0, *y0);
+  UINT8 code1 = render_outcode(target, *x1, *y1);
+  INT64 max_x = (INT64)target->Width - 1;
+  INT64 max_y = (INT64)target->Height - 1;
+
+  while(code0 | code1)
+  {
+    if(code0 & code1)
+    {
+      return 0; // Both ends are off the same side
+    }
+
+    UINT8 code = code0 ? code0 : code1;
+    INT64 x, y;
+
+    if(code & CLIP_TOP)
+    {
+      x = *x0 + (INT64)((__int128)(*x1 - *x0) * (0 - *y0) / (*y1 - *y0));
+      y = 0;
+    }
+    else if(code & CLIP_BOTTOM)
+    {
+      x = *x0 + (INT64)((__int128)(*x1 - *x0) * (max_y - *y0) / (*y1 - *y0));
+      y = max_y;
+    }
+    else if(code & CLIP_LEFT)
+    {
+      y = *y0 + (INT64)((__int128)(*y1 - *y0) * (0 - *x0) / (*x1 - *x0));
+      x = 0;
+    }
+    else // CLIP_RIGHT
+    {
+      y = *y0 + (INT64)((__int128)(*y1 - *y0) * (max_x - *x0) / (*x1 - *x0));
+      x = max_x;
+    }
+
+    if(code == code0)
+    {
+      *x0 = x;
+      *y0 = y;
+      code0 = render_outcode(target, x, y);
+    }
+    else
+    {
+      *x1 = x;
+      *y1 = y;
+      code1 = render_outcode(target, x, y);
+    }
+  }
+
+  return 1;
+}
+
+// Source-over for one pixel, see Render_Blit_Alpha(). Forcing the source's alpha byte to 255 before blending makes the same formula
+// give the right alpha for the result, too.
+static inline UINT32 blend_pixel(UINT32 dest, UINT32 src)
+{
+  UINT32 alpha = src >> 24;
+  UINT32 opaque_src = src | 0xFF000000;
+  UINT32 result = 0;
+
+  for(UINT32 shift = 0; shift < 32; shift += 8)
+  {
+    UINT32 blended = ((opaque_src >> shift) & 0xFF) * alpha + ((dest >> shift) & 0xFF) * (255 - alpha) + 128;
+    result |= ((blended + (blended >> 8)) >> 8) << shift; // Divide by 255, rounded
+  }
+
+  return result;
+}
+
+static void blend_span(UINT32 * dest, const UINT32 * src, UINT64 pixels)
+{
+  UINT64 i = 0;
+
+  if(AVX_Mem_Dispatch.Features & AVX_MEM_FEATURE_AVX2)
+  {
+    i = blend_span_avx2(dest, src, pixels);
+  }
+
+  for(; i < pixels; i++)
+  {
+    UINT32 alpha = src[i] >> 24;
+    if(alpha == 0xFF)
+    {
+      dest[i] = src[i];
+    }
+    else if(alpha)
+    {
+      dest[i] = blend_pixel(dest[i], src[i]);
+    }
+  }
+}
+
+// Expand 'pixels' bits of a 1bpp row, starting 'first_bit' bits in, to 32bpp. Never reads past the byte holding the last bit.
+static void expand_span(UINT32 * dest, const unsigned char * bits, UINT64 first_bit, UINT64 pixels, UINT32 font_color, UINT32 highlight_color)
+{
+  UINT32 transparent = (highlight_color == 0xFF000000);
+  UINT64 i = 0;
+
+  if(AVX_Mem_Dispatch.Features & AVX_MEM_FEATURE_AVX2)
+  {
+    i = expand_span_avx2(dest, bits, first_bit, pixels, font_color, highlight_color);
+  }
+
+  for(; i < pixels; i++)
+  {
+    UINT64 bit = first_bit + i;
+    if((bits[bit >> 3] >> (bit & 0x7)) & 0x1)
+    {
+      dest[i] = font_color;
+    }
+    else if(!transparent)
+    {
+      dest[i] = highlight_color;
+    }
+  }
+}
+
+// The bulk of blend_span() for CPUs with AVX2, 8 pixels at a time. Returns how many pixels it did; blend_span() does the rest.
+static __attribute__((target("avx2"))) UINT64 blend_span_avx2(UINT32 * dest, const UINT32 * src, UINT64 pixels)
+{
+  UINT64 i = 0;
+  const __m256i alpha_mask = _mm256_set1_epi32((int)0xFF000000);
+  const __m256i max = _mm256_set1_epi16(255);
+  const __m256i round = _mm256_set1_epi16(128);
+  const __m256i zero = _mm256_setzero_si256();
+
+  for(; i + 8 <= pixels; i += 8)
+  {
+    __m256i s = _mm256_loadu_si256((const __m256i_u*)(src + i));
+    __m256i alpha_bits = _mm256_and_si256(s, alpha_mask);
+
+    if(_mm256_testz_si256(alpha_bits, alpha_mask))
+    {
+      continue; // All invisible
+    }
+    if((unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi32(alpha_bits, alpha_mask)) == 0xFFFFFFFF)
+    {
+      _mm256_storeu_si256((__m256i_u*)(dest + i), s); // All opaque
+      continue;
+    }
+
+    __m256i d = _mm256_loadu_si256((const __m256i_u*)(dest + i));
+    __m256i opaque_s = _mm256_or_si256(s, alpha_mask);
+
+    // 16 bits per channel, 2 pixels per 128-bit lane in each half
+    __m256i s_lo = _mm256_unpacklo_epi8(opaque_s, zero);
+    __m256i s_hi = _mm256_unpackhi_epi8(opaque_s, zero);
+    __m256i d_lo = _mm256_unpacklo_epi8(d, zero);
+    __m256i d_hi = _mm256_unpackhi_epi8(d, zero);
+
+    // Copy each pixel's alpha (word 3 of its 4) to all 4 of its words
+    __m256i a_lo = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(_mm256_unpacklo_epi8(s, zero), 0xFF), 0xFF);
+    __m256i a_hi = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(_mm256_unpackhi_epi8(s, zero), 0xFF), 0xFF);
+
+    // Max is 255*255 + 128, which still fits in an unsigned 16 bits
+    __m256i t_lo = _mm256_add_epi16(_mm256_add_epi16(_mm256_mullo_epi16(s_lo, a_lo), _mm256_mullo_epi16(d_lo, _mm256_sub_epi16(max, a_lo))), round);
+    __m256i t_hi = _mm256_add_epi16(_mm256_add_epi16(_mm256_mullo_epi16(s_hi, a_hi), _mm256_mullo_epi16(d_hi, _mm256_sub_epi16(max, a_hi))), round);
+
+    t_lo = _mm256_srli_epi16(_mm256_add_epi16(t_lo, _mm256_srli_epi16(t_lo, 8)), 8);
+    t_hi = _mm256_srli_epi16(_mm256_add_epi16(t_hi, _mm256_srli_epi16(t_hi, 8)), 8);
+
+    _mm256_storeu_si256((__m256i_u*)(dest + i), _mm256_packus_epi16(t_lo, t_hi));
+  }
+
+  return i;
+}
+
+// The bulk of expand_span() for CPUs with AVX2, 8 pixels at a time. Returns how many pixels it did; expand_span() does the rest.
+static __attribute__((target("avx2"))) UINT64 expand_span_avx2(UINT32 * dest, const unsigned char * bits, UINT64 first_bit, UINT64 pixels, UINT32 font_color, UINT32 highlight_color)
+{
+  UINT32 transparent = (highlight_color == 0xFF000000);
+  UINT64 i = 0;
+  const __m256i bit_select = _mm256_setr_epi32(0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80);
+  const __m256i font = _mm256_set1_epi32((int)font_color);
+  const __m256i highlight = _mm256_set1_epi32((int)highlight_color);
+
+  for(; i + 8 <= pixels; i += 8)
+  {
+    UINT64 bit = first_bit + i;
+    UINT32 byte = bits[bit >> 3];
+    if(bit & 0x7)
+    {
+      byte = (byte | ((UINT32)bits[(bit >> 3) + 1] << 8)) >> (bit & 0x7); // The 8 bits straddle two bytes, both of them in the row
+    }
+
+    __m256i on = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32((int)byte), bit_select), bit_select);
+
+    if(transparent)
+    {
+      _mm256_maskstore_epi32((int*)(dest + i), on, font);
+    }
+    else
+    {
+      _mm256_storeu_si256((__m256i_u*)(dest + i), _mm256_blendv_epi8(highlight, font, on));
+    }
+  }
+
+  return i;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// bitmap_anywhere_scaled: Color a Single Bitmap Anywhere with Scaling
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Print a single, single-color bitmapped character at (x,y) coordinates from the top left of the screen (0,0) using a specified font
+// color, highlight color, and scale factor
+//
+// bitmap: a bitmapped image formatted like a font character
+// height and width: height (bytes) and width (bits) of the bitmap; there is no automatic way of getting this information for weird font sizes (e.g. 17 bits wide), sorry.
+// font_color: font color
+// highlight_color: highlight/background color for the string's characters (it's called highlight color in word processors)
+// x and y: coordinate positions of the top leftmost pixel of the string
+// scale: font scale factor
+//
+// This function allows for printing of individual characters not in the default font, making it like single_char_anywhere, but for
+// non-font characters and similarly-formatted images. Just pass in an appropriately-formatted array of bytes as the "bitmap" pointer.
+//
+// Note that single_char_anywhere_scaled() takes 'a' or 'b', this would take something like character_array['a'] instead.
+//
+
+void bitmap_anywhere_scaled(const EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE * GPU, const unsigned char * bitmap, UINT32 height, UINT32 width, UINT32 font_color, UINT32 highlight_color, UINT32 x, UINT32 y, UINT32 scale)
+{
+  // Assuming "bitmap" is an array of bytes, e.g. { 0x3E, 0x63, 0x7B, 0x7B, 0x7B, 0x03, 0x1E, 0x00}, which would be U+0040 (@) -- an 8x8 '@' sign.
+  if(height > GPU->Info->VerticalResolution || width > GPU->Info->HorizontalResolution)
+  {
+    Colorscreen(GPU, 0x00FF0000); // Need some kind of error indicator (makes screen red)
+  } // Could use an instruction like ARM's USAT to truncate values
+  else if(x > GPU->Info->HorizontalResolution || y > GPU->Info->VerticalResolution)
+  {
+    Colorscreen(GPU, 0x0000FF00); // Makes screen green
+  }
+  else if ((y + scale*height) > GPU->Info->VerticalResolution || (x + scale*width) > GPU->Info->HorizontalResolution)
+  {
+    Colorscreen(GPU, 0x000000FF); // Makes screen blue
+  }
+
+  Output_render_bitmap(GPU, bitmap, height, width, font_color, highlight_color, x, y, scale, 0);
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Output_render_bitmap: Render a Single-Color Bitmap to the Screen
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// This function draws a bitmapped character, given the following parameters:
+//
+// bitmap: a bitmapped image formatted like a font character
+// height and width: height (bytes) and width (bits) of the bitmap; there is no automatic way of getting this information for weird font sizes (e.g. 17 bits wide), sorry.
+// font_color: font color
+// highlight_color: highlight/background color for the string's characters (it's called highlight color in word processors)
+// x and y: coordinate positions of the top leftmost pixel of the string
+// scale: integer font scaling factor >= 1
+// index: mainly for strings, it's for keeping track of which character in the string is being output
+//
+// This is essentially the same thing as Output_render_text(), but for bitmaps that are not part of the default font.
+//
+// Note that single_char_anywhere_scaled() takes 'a' or 'b', this would take something like character_array['a'] instead.
+//
+
+void Output_render_bitmap(const EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE * GPU, const unsigned char * bitmap, UINT32 height, UINT32 width, UINT32 font_color, UINT32 highlight_color, UINT32 x, UINT32 y, UINT32 scale, UINT32 index)
+{
+  // Compact ceiling function, so that size doesn't need to be passed in
+  // This should be faster than a divide followed by a mod
+  uint32_t row_iterator = width >> 3;
+  if((width & 0x7) != 0)
+  {
+    row_iterator++;
+  } // Width should never be zero, so the iterator will always be at least 1
+  uint32_t i;
+
+  Shadow_Mark_Dirty(GPU, x + scale*index*width, y, scale*width, scale*height);
+
+  for(uint32_t row = 0; row < height; row++) // for number of rows in the character of the fontarray
+  {
+    i = 0;
+    for (uint32_t bit = 0; bit < width; bit++) // for bit in column
+    {
       if(((bit & 0x7) == 0 ) && (bit > 0))
       {
         i++;
@@ -504,7 +1919,7 @@ void Output_render_bitmap(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU, const unsigned
         {
           for(uint32_t a = 0; a < scale; a++)
           {
-            *(UINT32*)(GPU.FrameBufferBase + ((y*GPU.Info->PixelsPerScanLine + x) + scale*(row*GPU.Info->PixelsPerScanLine + bit) + (b*GPU.Info->PixelsPerScanLine + a) + scale * index * width)*4) = font_color;
+            *(UINT32*)(GPU->FrameBufferBase + ((y*GPU->Info->PixelsPerScanLine + x) + scale*(row*GPU->Info->PixelsPerScanLine + bit) + (b*GPU->Info->PixelsPerScanLine + a) + scale * index * width)*4) = font_color;
           }
         } //end scale here
       } //end if
@@ -517,7 +1932,7 @@ void Output_render_bitmap(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU, const unsigned
           {
             if(highlight_color != 0xFF000000) // Transparency "color"
             {
-              *(UINT32*)(GPU.FrameBufferBase + ((y*GPU.Info->PixelsPerScanLine + x) + scale*(row*GPU.Info->PixelsPerScanLine + bit) + (b*GPU.Info->PixelsPerScanLine + a) + scale * index * width)*4) = highlight_color;
+              *(UINT32*)(GPU->FrameBufferBase + ((y*GPU->Info->PixelsPerScanLine + x) + scale*(row*GPU->Info->PixelsPerScanLine + bit) + (b*GPU->Info->PixelsPerScanLine + a) + scale * index * width)*4) = highlight_color;
             }
           }
         } //end scale here
@@ -526,15 +1941,41 @@ void Output_render_bitmap(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU, const unsigned
   } // end byte in row
 }
 
-// TODO: Finish/optimize bitmap renderers first.
-// Maybe combine output renders into one with a 't' 'b' or 'v' mode.
-// This could use AVX
-/*
-void Output_render_vector(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU, UINT32 x_init, UINT32 y_init, UINT32 x_final, UINT32 y_final, UINT32 color, UINT32 scale)
+//----------------------------------------------------------------------------------------------------------------------------------
+// Output_render_vector: Render a Line to the Screen
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Draw a line from (x_init,y_init) to (x_final,y_final), scale pixels thick. Thick lines are made of scale side-by-side
+// Render_Line()s, offset up and down for lines that are more horizontal than vertical, and left and right otherwise.
+//
+
+void Output_render_vector(const EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE * GPU, UINT32 x_init, UINT32 y_init, UINT32 x_final, UINT32 y_final, UINT32 color, UINT32 scale)
 {
+  if(scale == 0)
+  {
+    return;
+  }
+
+  RENDER_TARGET target;
+  Render_Target_Init(&target, GPU);
 
+  INT64 dx = (INT64)x_final - x_init;
+  INT64 dy = (INT64)y_final - y_init;
+  UINT8 mostly_horizontal = ((dx < 0 ? -dx : dx) >= (dy < 0 ? -dy : dy));
+  INT64 first = -(INT64)((scale - 1) >> 1); // Centered on the requested line, with any extra pixel going down or right
+
+  for(INT64 offset = first; offset < first + scale; offset++)
+  {
+    if(mostly_horizontal)
+    {
+      Render_Line(&target, (INT32)x_init, (INT32)(y_init + offset), (INT32)x_final, (INT32)(y_final + offset), color);
+    }
+    else
+    {
+      Render_Line(&target, (INT32)(x_init + offset), (INT32)y_init, (INT32)(x_final + offset), (INT32)y_final, color);
+    }
+  }
 }
-*/
 
 //----------------------------------------------------------------------------------------------------------------------------------
 // bitmap_bitswap: Swap Bitmap Bits
@@ -545,6 +1986,8 @@ void Output_render_vector(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU, UINT32 x_init,
 // bitmap: an array of bytes
 // height and width: height (bytes) and width (bits) of the bitmap; there is no automatic way of getting this information for weird font sizes (e.g. 17 bits wide), sorry.
 //
+// 32 bytes at a time with AVX2. bitmap and output can be the same array.
+//
 
 void bitmap_bitswap(const unsigned char * bitmap, UINT32 height, UINT32 width, unsigned char * output)
 {
@@ -554,12 +1997,36 @@ void bitmap_bitswap(const unsigned char * bitmap, UINT32 height, UINT32 width, u
     row_iterator++;
   } // Width should never be zero, so the iterator will always be at least 1
 
-  for(uint32_t iter = 0; iter < height*row_iterator; iter++) // Flip one byte at a time
+  UINT64 total = (UINT64)height*row_iterator;
+  UINT64 iter = 0;
+
+  if(AVX_Mem_Dispatch.Features & AVX_MEM_FEATURE_AVX2)
+  {
+    iter = bitswap_avx2(bitmap, total, output);
+  }
+
+  for(; iter < total; iter++) // Whatever's left, one byte at a time
   {
     output[iter] = (((bitmap[iter] >> 4) & 0xF) | ((bitmap[iter] & 0xF) << 4));
   }
 }
 
+// The bulk of bitmap_bitswap() for CPUs with AVX2, 32 bytes at a time. Returns how many bytes it did.
+static __attribute__((target("avx2"))) UINT64 bitswap_avx2(const unsigned char * bitmap, UINT64 total, unsigned char * output)
+{
+  UINT64 iter = 0;
+  const __m256i low_nibbles = _mm256_set1_epi8(0x0F);
+
+  for(; iter + 32 <= total; iter += 32)
+  {
+    __m256i bytes = _mm256_loadu_si256((const __m256i_u*)(bitmap + iter));
+    __m256i swapped = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(bytes, 4), low_nibbles), _mm256_slli_epi16(_mm256_and_si256(bytes, low_nibbles), 4));
+    _mm256_storeu_si256((__m256i_u*)(output + iter), swapped);
+  }
+
+  return iter;
+}
+
 //----------------------------------------------------------------------------------------------------------------------------------
 // bitmap_bitreverse: Reverse Bitmap Bits
 //----------------------------------------------------------------------------------------------------------------------------------
@@ -571,6 +2038,13 @@ void bitmap_bitswap(const unsigned char * bitmap, UINT32 height, UINT32 width, u
 // bitmap: an array of bytes
 // height and width: height (bytes) and width (bits) of the bitmap; there is no automatic way of getting this information for weird font sizes (e.g. 17 bits wide), sorry.
 //
+// A byte's reverse is the reverse of its low nibble moved up, ORed with the reverse of its high nibble moved down. Both of those are
+// 16-entry lookup tables, which is exactly what vpshufb does 32 bytes at a time. bitmap and output can be the same array.
+//
+
+// bit_reverse_low[n] is n reversed and moved to the high nibble, bit_reverse_high[n] is n reversed
+static const UINT8 bit_reverse_low[16] __attribute__((aligned(16))) = {0x00, 0x80, 0x40, 0xC0, 0x20, 0xA0, 0x60, 0xE0, 0x10, 0x90, 0x50, 0xD0, 0x30, 0xB0, 0x70, 0xF0};
+static const UINT8 bit_reverse_high[16] __attribute__((aligned(16))) = {0x0, 0x8, 0x4, 0xC, 0x2, 0xA, 0x6, 0xE, 0x1, 0x9, 0x5, 0xD, 0x3, 0xB, 0x7, 0xF};
 
 void bitmap_bitreverse(const unsigned char * bitmap, UINT32 height, UINT32 width, unsigned char * output)
 {
@@ -580,17 +2054,37 @@ void bitmap_bitreverse(const unsigned char * bitmap, UINT32 height, UINT32 width
     row_iterator++;
   } // Width should never be zero, so the iterator will always be at least 1
 
-  for(uint32_t iter = 0; iter < height*row_iterator; iter++) // Invert one byte at a time
+  UINT64 total = (UINT64)height*row_iterator;
+  UINT64 iter = 0;
+
+  if(AVX_Mem_Dispatch.Features & AVX_MEM_FEATURE_AVX2)
   {
-    output[iter] = 0;
-    for(uint32_t bit = 0; bit < 8; bit++)
-    {
-      if( bitmap[iter] & (1 << (7 - bit)) )
-      {
-        output[iter] += (1 << bit);
-      }
-    }
+    iter = bitreverse_avx2(bitmap, total, output);
+  }
+
+  for(; iter < total; iter++) // Same thing with the tables, one byte at a time
+  {
+    output[iter] = bit_reverse_low[bitmap[iter] & 0xF] | bit_reverse_high[bitmap[iter] >> 4];
+  }
+}
+
+// The bulk of bitmap_bitreverse() for CPUs with AVX2, 32 bytes at a time. Returns how many bytes it did.
+static __attribute__((target("avx2"))) UINT64 bitreverse_avx2(const unsigned char * bitmap, UINT64 total, unsigned char * output)
+{
+  UINT64 iter = 0;
+  const __m256i low_nibbles = _mm256_set1_epi8(0x0F);
+  const __m256i reverse_low = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i*)bit_reverse_low));
+  const __m256i reverse_high = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i*)bit_reverse_high));
+
+  for(; iter + 32 <= total; iter += 32)
+  {
+    __m256i bytes = _mm256_loadu_si256((const __m256i_u*)(bitmap + iter));
+    __m256i low = _mm256_shuffle_epi8(reverse_low, _mm256_and_si256(bytes, low_nibbles));
+    __m256i high = _mm256_shuffle_epi8(reverse_high, _mm256_and_si256(_mm256_srli_epi16(bytes, 4), low_nibbles));
+    _mm256_storeu_si256((__m256i_u*)(output + iter), _mm256_or_si256(low, high));
   }
+
+  return iter;
 }
 
 //----------------------------------------------------------------------------------------------------------------------------------
@@ -602,6 +2096,10 @@ void bitmap_bitreverse(const unsigned char * bitmap, UINT32 height, UINT32 width
 // bitmap: a rectangular array of bytes
 // height and width: height (bytes) and width (bits) of the bitmap; there is no automatic way of getting this information for weird font sizes (e.g. 17 bits wide), sorry.
 //
+// Rows of 2, 4, 8, or 16 bytes fit evenly in a 128-bit lane, so for those one vpshufb mirrors every row in 32 bytes at once. Longer
+// rows get mirrored 32 bytes from each end at a time with vpshufb + vpermq, with stores that never cross into the next row, and
+// whatever's left in the middle goes byte by byte. bitmap and output can be the same array.
+//
 
 void bitmap_bytemirror(const unsigned char * bitmap, UINT32 height, UINT32 width, unsigned char * output) // Width in bits, height in bytes
 {
@@ -611,33 +2109,88 @@ void bitmap_bytemirror(const unsigned char * bitmap, UINT32 height, UINT32 width
     row_iterator++;
   } // Width should never be zero, so the iterator will always be at least 1
 
-  uint32_t iter, parallel_iter;
-  if(row_iterator & 0x01)
-  {// Odd number of bytes per row
-    for(iter = 0, parallel_iter = row_iterator - 1; (iter + (row_iterator >> 1) + 1) < height*row_iterator; iter++, parallel_iter--) // Mirror one byte at a time
-    {
-      if(iter == parallel_iter) // Integer divide, (iter%row_iterator == row_iterator/2 - 1)
-      {
-        iter += (row_iterator >> 1) + 1; // Hop the middle byte
-        parallel_iter = iter + row_iterator - 1;
-      }
+  UINT64 total = (UINT64)height*row_iterator;
+  UINT64 done = 0; // Bytes finished by the lane-sized path, always a whole number of rows
+  UINT8 avx2 = ((AVX_Mem_Dispatch.Features & AVX_MEM_FEATURE_AVX2) != 0);
 
-      output[iter] = bitmap[parallel_iter]; // parallel_iter must mirror iter
-      output[parallel_iter] = bitmap[iter];
-    }
+  if(avx2 && (row_iterator <= 16) && ((row_iterator & (row_iterator - 1)) == 0) && (row_iterator > 1))
+  {
+    done = bytemirror_lanes_avx2(bitmap, total, row_iterator, output);
   }
-  else
-  {// Even number of bytes per row
-    for(iter = 0, parallel_iter = row_iterator - 1; (iter + (row_iterator >> 1)) < height*row_iterator; iter++, parallel_iter--) // Mirror one byte at a time
+
+  for(UINT64 row_start = done; row_start < total; row_start += row_iterator)
+  {
+    const unsigned char * in = bitmap + row_start;
+    unsigned char * out = output + row_start;
+    UINT64 front = 0;
+    UINT64 back = row_iterator; // [front, back) is what's left to mirror in this row
+
+    if(avx2 && (row_iterator >= 64))
     {
-      if(iter - 1 == parallel_iter) // Integer divide, (iter%row_iterator == row_iterator/2 - 1)
-      {
-        iter += (row_iterator >> 1); // Skip to the next row to swap
-        parallel_iter = iter + row_iterator - 1; // Appropriately position parallel_iter based on iter
-      }
+      front = bytemirror_ends_avx2(in, out, row_iterator);
+      back -= front;
+    }
+
+    while(back - front >= 2) // Mirror one byte at a time
+    {
+      unsigned char left = in[front];
+      unsigned char right = in[back - 1];
+      out[front] = right;
+      out[back - 1] = left;
+      front++;
+      back--;
+    }
 
-      output[iter] = bitmap[parallel_iter]; // Parallel_iter must mirror iter
-      output[parallel_iter] = bitmap[iter];
+    if(back - front == 1)
+    {
+      out[front] = in[front]; // Middle byte of an odd-length row stays put
     }
   }
 }
+
+// The lane-sized path of bitmap_bytemirror() for CPUs with AVX2, for rows of 2, 4, 8, or 16 bytes. Returns how many bytes it did,
+// which is always a whole number of rows.
+static __attribute__((target("avx2"))) UINT64 bytemirror_lanes_avx2(const unsigned char * bitmap, UINT64 total, UINT32 row_iterator, unsigned char * output)
+{
+  UINT64 done = 0;
+
+  // Byte j of each lane comes from the mirrored byte in the same row
+  UINT8 mirror[16] __attribute__((aligned(16)));
+  for(uint32_t j = 0; j < 16; j++)
+  {
+    mirror[j] = (UINT8)((j & ~(row_iterator - 1)) + (row_iterator - 1 - (j & (row_iterator - 1))));
+  }
+  const __m256i mirror_rows = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i*)mirror));
+
+  for(; done + 32 <= total; done += 32)
+  {
+    __m256i bytes = _mm256_loadu_si256((const __m256i_u*)(bitmap + done));
+    _mm256_storeu_si256((__m256i_u*)(output + done), _mm256_shuffle_epi8(bytes, mirror_rows));
+  }
+
+  return done;
+}
+
+// Mirror a row 32 bytes from each end at a time for bitmap_bytemirror(), until fewer than 64 bytes are left in the middle. Returns
+// how many bytes it did at each end.
+static __attribute__((target("avx2"))) UINT64 bytemirror_ends_avx2(const unsigned char * in, unsigned char * out, UINT64 row_bytes)
+{
+  const __m256i reverse_lane = _mm256_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+  UINT64 front = 0;
+  UINT64 back = row_bytes;
+
+  // Both 32-byte ends are loaded before either is stored, so this works in place
+  while(back - front >= 64)
+  {
+    __m256i head = _mm256_loadu_si256((const __m256i_u*)(in + front));
+    __m256i tail = _mm256_loadu_si256((const __m256i_u*)(in + back - 32));
+    head = _mm256_permute4x64_epi64(_mm256_shuffle_epi8(head, reverse_lane), 0x4E); // Reverse within lanes, then swap lanes
+    tail = _mm256_permute4x64_epi64(_mm256_shuffle_epi8(tail, reverse_lane), 0x4E);
+    _mm256_storeu_si256((__m256i_u*)(out + front), tail);
+    _mm256_storeu_si256((__m256i_u*)(out + back - 32), head);
+    front += 32;
+    back -= 32;
+  }
+
+  return front;
+}
@@ -99,6 +99,153 @@ typedef struct {
 */
 GLOBAL_PRINT_INFO_STRUCT Global_Print_Info = {0};
 
+/*
+// A RAM copy of one GPU framebuffer. Its Base replaces FrameBufferBase in the GPU's GPUArray entry (and in Global_Print_Info if that's
+// the same GPU), so everything in Display.c draws into RAM. Changed areas are written out by Shadow_Flush().
+typedef struct {
+  EFI_PHYSICAL_ADDRESS               Hardware_Base;  // The real framebuffer
+  EFI_PHYSICAL_ADDRESS               Buffer;         // Start of the RAM buffer, which is two screens tall so that scrolling can move Base
+  UINT64                             Buffer_Size;    // In bytes
+  EFI_PHYSICAL_ADDRESS               Base;           // Top left pixel of the screen in Buffer, i.e. the shadowed FrameBufferBase
+  EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE *GPU_Entry;      // The GPUArray entry being shadowed
+  UINT32                             Pitch;          // PixelsPerScanLine
+  UINT32                             Width;          // HorizontalResolution
+  UINT32                             Height;         // VerticalResolution
+  UINT32                             Dirty;          // 1 if the rectangle below hasn't been flushed yet
+  UINT32                             Dirty_Left;
+  UINT32                             Dirty_Top;
+  UINT32                             Dirty_Right;    // Exclusive
+  UINT32                             Dirty_Bottom;   // Exclusive
+} SHADOW_FRAMEBUFFER_STRUCT;
+
+// A screen that shows a copy of a shadowed screen, see Setup_Mirror_Heads() in Display.c
+typedef struct {
+  EFI_PHYSICAL_ADDRESS               Hardware_Base;  // The mirror's framebuffer
+  EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE *GPU_Entry;      // The mirror's GPUArray entry
+  UINT32                            *Column_Map;     // Source column for each of the mirror's columns, NULL if not Scaled
+  UINT32                             Pitch;          // PixelsPerScanLine
+  UINT32                             Width;          // HorizontalResolution
+  UINT32                             Height;         // VerticalResolution
+  UINT32                             Scaled;         // 1 if the resolution differs from the source's
+  UINT32                             Conversion;     // MIRROR_COPY, MIRROR_SWAP_RED_BLUE, or MIRROR_BITMASK
+  UINT8                              Source_Shift[3]; // Red, green, blue bit positions in a source pixel
+  UINT8                              Source_Bits[3];  // ...and their widths
+  UINT8                              Dest_Shift[3];   // Same for a mirror pixel
+  UINT8                              Dest_Bits[3];
+} MIRROR_HEAD_STRUCT;
+
+typedef struct {
+  UINT64                             Count;
+  SHADOW_FRAMEBUFFER_STRUCT          Framebuffers[MAX_SHADOW_FRAMEBUFFERS];
+  UINT64                             Mirror_Source;  // Index in Framebuffers of the screen that the mirrors copy
+  UINT64                             Mirror_Count;
+  MIRROR_HEAD_STRUCT                 Mirrors[MAX_SHADOW_FRAMEBUFFERS];
+} GLOBAL_SHADOW_INFO_STRUCT;
+*/
+GLOBAL_SHADOW_INFO_STRUCT Global_Shadow_Info = {0};
+
+/*
+// Deferred console for printf, see Console.c
+typedef struct {
+  volatile UINT64                    Deferred;         // 1 = printf() queues text here, 0 = printf() draws immediately
+  volatile UINT64                    Head;             // Bytes reserved by writers so far (the next record goes at Head & (CONSOLE_RING_SIZE - 1))
+  volatile UINT64                    Tail;             // Bytes drawn and freed so far
+  volatile UINT64                    Drawing;          // 1 while a CPU is drawing queued text
+  volatile UINT64                    Dropped;          // Bytes of text lost to a full ring
+  UINT64                             Dropped_Reported; // Dropped as of the last "bytes dropped" message
+  UINT64                             Renderer_CPU;     // AP running Console_Start_Renderer()'s loop, 0 if none
+  volatile UINT64                    Sinks;            // CONSOLE_SINK_* bits
+  UINT8                              Ring[CONSOLE_RING_SIZE]; // Records: a UINT32 header (length | ready bit) and then the text, 4-byte aligned
+} __attribute__((aligned(64))) GLOBAL_CONSOLE_STRUCT;
+*/
+GLOBAL_CONSOLE_STRUCT Global_Console = {.Sinks = CONSOLE_SINK_FRAMEBUFFER};
+
+/*
+// Serial console, see Serial.c
+typedef struct {
+  UINT64                             Port;             // 16550 I/O base, 0 = no serial console
+  UINT64                             IRQ;              // ISA IRQ (4 for COM1 and COM3, 3 for COM2 and COM4)
+  UINT64                             FIFO_Size;        // Bytes that can be written per THR-empty, 1 for a UART without a working FIFO
+  volatile UINT64                    Interrupts;       // 1 once THR-empty interrupts refill the FIFO, 0 = only Serial_Write() and Serial_Poll() do
+  volatile UINT64                    Polled;           // 1 after Serial_Panic(): Serial_Write() waits for its text to go out
+  volatile UINT64                    Head;             // Bytes queued so far (the next byte goes at Head & (SERIAL_RING_SIZE - 1))
+  volatile UINT64                    Tail;             // Bytes written to the UART so far
+  volatile UINT64                    Sending;          // 1 while a CPU is filling the FIFO
+  volatile UINT64                    Dropped;          // Bytes lost to a full ring
+  UINT8                              Ring[SERIAL_RING_SIZE];
+} __attribute__((aligned(64))) GLOBAL_SERIAL_STRUCT;
+*/
+GLOBAL_SERIAL_STRUCT Global_Serial = {0};
+
+/*
+// TSC clocksource, see Clock.c
+typedef struct {
+  UINT64                             Source;           // CLOCK_SOURCE_*
+  UINT64                             TSC_Hz;
+  UINT64                             Invariant;        // 1 if the TSC runs at a constant rate in every P-, C-, and T-state
+  UINT64                             Base_TSC;         // now_ns() counts from here
+  UINT64                             NS_Mult;          // ns = (ticks * NS_Mult) >> CLOCK_SHIFT
+  UINT64                             Tick_Mult;        // ticks = (ns * Tick_Mult) >> CLOCK_SHIFT
+} GLOBAL_CLOCK_STRUCT;
+*/
+GLOBAL_CLOCK_STRUCT Global_Clock = {0};
+
+/*
+// Local APIC timer and timer wheel, see Timer.c
+typedef struct TIMER_LINK {
+  struct TIMER_LINK                 *Next;
+  struct TIMER_LINK                 *Prev;
+} TIMER_LINK;
+
+typedef struct {
+  TIMER_LINK                         Link;             // Must be first; Next is NULL while not armed
+  UINT64                             Expires;          // Tick it's due on
+  UINT64                             Period;           // Ticks between expiries, 0 = one-shot
+  void                             (*Function)(void * arg); // Called on the BSP in interrupt context
+  void                              *Argument;
+} TIMER;
+
+typedef struct {
+  UINT64                             Mode;             // TIMER_MODE_*
+  UINT64                             TSC_Per_Tick;
+  UINT64                             LAPIC_Per_Tick;   // Local APIC timer counts per tick at divide-by-1, for one-shot mode
+  UINT64                             Base_TSC;         // TSC at tick 0
+  UINT64                             Wheel_Tick;       // Next tick to handle
+  UINT64                             Armed;            // Timers in the wheel
+  TICKET_LOCK                        Lock;             // Taken with interrupts off, see timer_lock()
+  TIMER_LINK                         Slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS]; // Circular lists, each slot is its own list head
+} __attribute__((aligned(64))) GLOBAL_TIMER_STRUCT;
+*/
+GLOBAL_TIMER_STRUCT Global_Timer = {0};
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Performance Counters
+//----------------------------------------------------------------------------------------------------------------------------------
+/*
+typedef struct {
+  UINT64                             Vendor;           // PMU_VENDOR_*
+  UINT64                             Version;          // Intel architectural PMU version, 2 for AMD PerfMonV2, 1 for older AMD
+  UINT64                             Family;           // CPU family, for the model-specific events
+  UINT64                             GP_Counters;      // General purpose counters
+  UINT64                             GP_Mask;          // Counter width as a mask
+  UINT64                             Fixed_Counters;   // Intel fixed counters
+  UINT64                             Fixed_Mask;
+  UINT64                             Arch_Events;      // Intel architectural events that exist, as CPUID 0xA bits (set = available)
+  UINT64                             Global_Ctrl;      // 1 if there's a global enable MSR (Intel v2+, AMD PerfMonV2)
+  UINT64                             AMD_Core_Ext;     // 1 if AMD's PerfCtrExtCore MSRs (0xC0010200+) are there
+
+  volatile UINT64                    Sample_Active;    // 1 between PMU_Start_Sampling() and PMU_Stop_Sampling()
+  UINT64                             Sample_CPU;       // CPU index doing the sampling
+  UINT64                             Sample_Counter;
+  UINT64                             Sample_Period;    // Events per sample
+  UINT64                            *Sample_Buffer;    // Interrupted %rip for each sample
+  UINT64                             Sample_Capacity;
+  volatile UINT64                    Sample_Count;
+  volatile UINT64                    Sample_Dropped;   // Samples that didn't fit
+} GLOBAL_PMU_STRUCT;
+*/
+GLOBAL_PMU_STRUCT Global_PMU = {0};
+
 //----------------------------------------------------------------------------------------------------------------------------------
 // Memory
 //----------------------------------------------------------------------------------------------------------------------------------
@@ -114,6 +261,228 @@ typedef struct {
 */
 GLOBAL_MEMORY_INFO_STRUCT Global_Memory_Info = {0};
 
+/*
+// Runtime page mapping, see VMM.c
+#define VMM_READ_ONLY  (1ULL << 0) // Without this pages are read/write
+#define VMM_NO_EXECUTE (1ULL << 1) // Only takes effect if IA32_EFER.NXE is on
+#define VMM_GLOBAL     (1ULL << 2) // Kept in the TLB across CR3 writes
+#define VMM_TYPE(pat)  (((uint64_t)(pat) & 0x7) << 8) // PAT_WB (the default without this), PAT_WT, PAT_UC_MINUS, PAT_UC, or PAT_WC
+
+typedef struct {
+  UINT64                  Levels;                  // 4 or 5 paging levels, 0 until Setup_VMM() has run
+  UINT64                  Page_1GB;                // 1 if 1GB pages are supported
+  UINT64                  PCID;                    // 1 if CR4.PCIDE is on
+  UINT64                  INVPCID;                 // 1 if the INVPCID instruction is supported
+  UINT64                  NX;                      // 1 if IA32_EFER.NXE is on, so VMM_NO_EXECUTE works
+  volatile UINT64         Lock;                    // Held by map_range(), unmap_range(), and protect_range()
+  volatile UINT64         Shootdown_Pending;       // CPUs that haven't flushed for the current shootdown yet
+  UINT64                  Table_Pages;             // Page tables currently allocated from malloc4k()
+  UINT64                  Splits;                  // Large pages broken into smaller ones
+  UINT64                  Merges;                  // Tables folded back into large pages
+  UINT64                  Shootdowns;              // Flush NMIs sent to other CPUs
+} GLOBAL_VMM_STRUCT;
+*/
+GLOBAL_VMM_STRUCT Global_VMM = {0};
+
+/*
+// Demand-paged virtual memory, see Vmalloc_Reserve() in VMM.c
+#define VMALLOC_MAX_AREAS   256
+#define VMALLOC_LARGE_PAGES (1ULL << 16) // Vmalloc_Reserve() flag: back the area 2MB at a time with 2MB pages
+
+typedef struct {
+  UINT64                  Base;
+  UINT64                  Size;                    // Bytes, a multiple of 4kB (2MB with VMALLOC_LARGE_PAGES)
+  UINT64                  Flags;                   // VMM_* bits for the pages, plus VMALLOC_LARGE_PAGES
+  UINT64                  Committed;               // Pages backed so far
+} VMALLOC_AREA;
+
+typedef struct {
+  UINT64                  Base;                    // Reservations come from [Base, End), 0 until Setup_VMM() has run
+  UINT64                  End;
+  UINT64                  Large_Threshold;         // Vmalloc() reservations at least this big get VMALLOC_LARGE_PAGES, 0 = never
+  volatile UINT64         Lock;                    // Held while Areas changes and while a fault is being backed
+  UINT64                  Count;                   // Areas in use
+  UINT64                  Committed_Pages;         // Pages backing all areas
+  UINT64                  Faults;                  // Faults that VMM_Page_Fault() backed with a 4kB page
+  UINT64                  Large_Faults;            // ...and with a 2MB page
+  VMALLOC_AREA            Areas[VMALLOC_MAX_AREAS]; // Sorted by Base
+} GLOBAL_VMALLOC_STRUCT;
+*/
+GLOBAL_VMALLOC_STRUCT Global_Vmalloc = {0};
+
+/*
+// NUMA topology from the SRAT and SLIT, see NUMA.c
+#define NUMA_MAX_NODES  16
+#define NUMA_MAX_RANGES 64
+#define NUMA_MAX_CPUS   256
+#define NUMA_NO_NODE    ~0ULL
+
+// Where a CPU's page allocations come from, see NUMA_Set_Policy()
+#define NUMA_POLICY_LOCAL      0 // This CPU's node first, then the closest ones
+#define NUMA_POLICY_INTERLEAVE 1 // Each allocation from the next node in turn
+
+typedef struct {
+  UINT64                  Base;
+  UINT64                  End;                   // Exclusive
+  UINT64                  Node;
+} NUMA_RANGE;
+
+typedef struct {
+  UINT64                  Nodes;                 // Always at least 1
+  UINT32                  Domain[NUMA_MAX_NODES]; // ACPI proximity domain of each node
+  UINT8                   Distance[NUMA_MAX_NODES][NUMA_MAX_NODES]; // SLIT distances, 10 = local
+  UINT8                   Fallback[NUMA_MAX_NODES][NUMA_MAX_NODES]; // Each node's nodes from closest to farthest, itself first
+  UINT64                  Range_Count;           // 0 without an SRAT
+  NUMA_RANGE              Ranges[NUMA_MAX_RANGES]; // Sorted by Base, not overlapping
+  UINT64                  CPU_Count;
+  UINT32                  CPU_APIC_ID[NUMA_MAX_CPUS];
+  UINT8                   CPU_Node[NUMA_MAX_CPUS];
+  volatile UINT64         Interleave_Next;       // For NUMA_POLICY_INTERLEAVE
+} GLOBAL_NUMA_STRUCT;
+*/
+GLOBAL_NUMA_STRUCT Global_NUMA = {0};
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Kernel Options
+//----------------------------------------------------------------------------------------------------------------------------------
+/*
+// Boot options from the second line of Kernel64.txt (LP->Kernel_Options), see Parse_Kernel_Options() in System.c
+typedef struct {
+  UINT64                  No_Zero_Verify;          // "noverify": ZeroAllConventionalMemory() trusts its stores and doesn't read memory back
+  UINT64                  Lazy_Zero;               // "lazyzero": kernel_main() calls StartBackgroundZeroing() instead of ZeroAllConventionalMemory()
+  UINT64                  Benchmark;               // "bench" or "bench=N": kernel_main() runs Run_Memory_Benchmarks()
+  UINT64                  Benchmark_Max_Size;      // Largest buffer size to benchmark in bytes (from "bench=N", N in MB), 0 = default
+  UINT64                  Shadow_Framebuffer;      // "shadowfb": draw into RAM copies of the framebuffers, see Setup_Shadow_Framebuffers()
+  UINT64                  Deferred_Console;        // "deferprintf" or "deferprintf=N": printf() queues text for Console_Flush(), see Console.c
+  UINT64                  Console_CPU;             // AP that draws the deferred console (from "deferprintf=N"), 0 = the BSP flushes it in batches
+  UINT64                  Mirror_Console;          // "mirror": every GPU shows a copy of printf's screen, see Setup_Mirror_Heads()
+  UINT64                  Serial_Console;          // "serial", "serial=N", or "serialonly": printf's text also goes out a COM port, see Serial.c
+  UINT64                  Serial_Port;             // COM port number (from "serial=N"), 0 = the first one found
+  UINT64                  Serial_Only;             // "serialonly": printf's text only goes to the COM port, not the screen
+  UINT64                  Task_Workers;            // "workers=N": APs handed to the task scheduler at boot, see Task_Start_Worker()
+  UINT64                  Vmalloc_Large;           // "vmlarge" or "vmlarge=N": Vmalloc() reservations of at least N MB (default 2) use 2MB pages
+  UINT64                  Bulk_Min;                // Smallest bulk_copy()/bulk_fill() job in bytes that gets split across APs (from "bulkmin=N", N in MB), 0 = default
+} GLOBAL_KERNEL_OPTIONS_STRUCT;
+*/
+GLOBAL_KERNEL_OPTIONS_STRUCT Global_Kernel_Options = {0};
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Benchmarks
+//----------------------------------------------------------------------------------------------------------------------------------
+/*
+typedef struct {
+  UINT32                  Magic;                   // BENCHMARK_MAGIC
+  UINT16                  Version;                 // BENCHMARK_VERSION
+  UINT16                  Entry_Size;              // sizeof(BENCHMARK_ENTRY)
+  UINT64                  Count;                   // Number of entries that follow
+  UINT64                  Capacity;                // Room for this many entries
+  UINT64                  TSC_MHz;                 // Used for MB_Per_Second
+  UINT64                  Max_Size;                // Largest size that was tested
+  UINT64                  Features;                // AVX_Mem_Dispatch.Features at the time
+  BENCHMARK_ENTRY         Entries[];
+} BENCHMARK_RESULTS;
+*/
+BENCHMARK_RESULTS * Global_Benchmark_Results = NULL; // Set by Run_Memory_Benchmarks()
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// ACPI
+//----------------------------------------------------------------------------------------------------------------------------------
+/*
+// For ACPI table lookup in ACPI.c
+typedef struct {
+  RSDP_20_STRUCT *RSDP;     // RSDP_10_Section is always valid, the rest only if RSDP_10_Section.Revision >= 2
+  XSDT_STRUCT    *XSDT;     // NULL if there's only an RSDT (ACPI 1.0)
+  RSDT_STRUCT    *RSDT;     // Only used if XSDT is NULL
+  UINT64          Revision; // 1 for ACPI 1.0 (RSDT), 2 for ACPI 2.0+ (XSDT)
+} GLOBAL_ACPI_INFO_STRUCT;
+*/
+GLOBAL_ACPI_INFO_STRUCT Global_ACPI_Info = {0};
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// SMP
+//----------------------------------------------------------------------------------------------------------------------------------
+/*
+// System-wide SMP info. The BSP_ values are captured once by Setup_SMP() and copied by each AP in AP_Main().
+typedef struct {
+  UINT64                  Number_of_CPUs;        // Logical CPUs that have a Global_Per_CPU_Data entry (BSP included)
+  volatile UINT64         Online_CPUs;           // Logical CPUs currently running (BSP included)
+  UINT64                  BSP_APIC_ID;
+  UINT64                  x2APIC;                // 1 = local APICs are in x2APIC (MSR) mode, 0 = xAPIC (MMIO) mode
+  UINT64                  LAPIC_Base;            // xAPIC MMIO base, unused in x2APIC mode
+  UINT64                  BSP_CR0;
+  UINT64                  BSP_CR3;
+  UINT64                  BSP_CR4;
+  UINT64                  BSP_EFER;
+  UINT64                  BSP_XCR0;
+  UINT64                  BSP_PAT;               // IA32_PAT as programmed by Setup_Paging()
+  DT_STRUCT               BSP_IDTR;              // All CPUs share this IDT
+  UINT64                  TSC_MHz;               // TSC frequency found by Setup_Clock(), rounded to the nearest MHz
+} GLOBAL_SMP_INFO_STRUCT;
+*/
+GLOBAL_SMP_INFO_STRUCT Global_SMP_Info = {0};
+
+// One PER_CPU_STRUCT for each logical CPU, see Kernel64.h for the struct
+__attribute__((aligned(64))) PER_CPU_STRUCT Global_Per_CPU_Data[MAX_CPUS] = {0};
+
+/*
+// Cooperative tasks, see Task.c
+typedef struct _TASK {
+  struct _TASK           *Next;                  // Run queue link
+  UINT64                  RSP;                   // Saved stack pointer while switched out
+  void                  (*Function)(void * arg);
+  void                   *Argument;
+  UINT64                  Pages;                 // Size of the malloc4k() block this heads (TASK, XSAVE area, stack), 0 for boot tasks
+  volatile UINT64         State;
+  volatile UINT64         Done;                  // Set once the task has finished and its stack is free, see Task_Join()
+  UINT64                  CPU;                   // CPU it last ran on
+  UINT8                  *XSave_Area;            // 64-byte aligned
+} __attribute__((aligned(64))) TASK;
+
+typedef struct {
+  volatile UINT64         Lock;
+  TASK                   *Head;                  // Ready tasks, oldest first
+  TASK                   *Tail;
+  volatile UINT64         Count;
+  TASK                   *Current;               // Running on this CPU, NULL if this CPU doesn't run tasks
+  TASK                   *Previous;              // Just switched away from, until the next task has finished switching in
+  TASK                    Boot_Task;             // Whatever this CPU was running before its first switch
+} __attribute__((aligned(64))) TASK_QUEUE;
+
+typedef struct {
+  volatile UINT64         Ready;                 // 1 once Setup_Scheduler() has run
+  UINT64                  XSave_Size;            // Bytes per XSAVE area, a multiple of 64
+  UINT64                  XSave_Instruction;     // What saves extended state on a switch (XSAVE, XSAVEOPT, or XSAVEC)
+  volatile UINT64         Queued;                // Tasks queued so far, what idle workers watch with MONITOR/MWAIT
+  TASK_QUEUE              Queues[MAX_CPUS];      // Indexed like Global_Per_CPU_Data
+} GLOBAL_SCHEDULER_STRUCT;
+*/
+__attribute__((aligned(64))) GLOBAL_SCHEDULER_STRUCT Global_Scheduler = {0};
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Tracing
+//----------------------------------------------------------------------------------------------------------------------------------
+/*
+typedef struct {
+  volatile UINT64         Enabled;               // Probes do nothing when this is 0
+  volatile UINT64         Next;                  // Total events recorded so far; the slot of the next one is Next & (TRACE_RING_SIZE - 1)
+  TRACE_EVENT             Events[TRACE_RING_SIZE];
+} __attribute__((aligned(64))) GLOBAL_TRACE_STRUCT;
+*/
+
+// Enabled from the start so that System_Init() gets recorded
+GLOBAL_TRACE_STRUCT Global_Trace = {.Enabled = 1};
+
+/*
+typedef struct {
+  volatile UINT64         Enabled;               // ISR_Stats_Record() does nothing when this is 0
+  UINT64                  Start_TSC;             // When counting started, for rates
+  ISR_STAT               *Stats;                 // 256 per CPU, in CPU index order
+} GLOBAL_ISR_STATS_STRUCT;
+*/
+
+// Only enabled by Setup_ISR_Stats(), since recording needs per-CPU data
+GLOBAL_ISR_STATS_STRUCT Global_ISR_Stats = {0};
+
 //----------------------------------------------------------------------------------------------------------------------------------
 // Misc
 //----------------------------------------------------------------------------------------------------------------------------------
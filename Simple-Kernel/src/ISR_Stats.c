@@ -0,0 +1,245 @@
+//==================================================================================================================================
+//  Simple Kernel: Interrupt Stats
+//==================================================================================================================================
+//
+// Version 0.z
+//
+// Author:
+//  KNNSpeed
+//
+// Source Code:
+//  https://github.com/KNNSpeed/Simple-Kernel
+//
+// This file contains per-vector interrupt counters: how often each IDT vector fires on each CPU, how long its handler takes (total
+// and max), and a log2 histogram of handler times. It's meant for spotting interrupt storms and slow handlers.
+//
+// The ISR.S entry stubs take a TSC timestamp just before calling the C handler and another just after it returns, then pass the
+// difference to ISR_Stats_Record(). So the times cover the handler itself, including its XSAVE/XRSTOR, but not the register pushes
+// and pops in the stub. Each CPU has its own ISR_STAT for each vector, so recording doesn't need atomics or a lock. A vector that
+// interrupts itself (e.g. a page fault in the page fault handler) can lose a count.
+//
+// Recording is a no-op until Setup_ISR_Stats() allocates the counters, and when turned off with ISR_Stats_Enable(0). Build with
+// ISR_STATS set to 0 to take the timestamps out of the stubs entirely.
+//
+
+#include "Kernel64.h"
+
+static uint64_t isr_stats_rdtsc(void);
+static void isr_stats_print_row(uint64_t isr_num, int64_t cpu, ISR_STAT * stat, uint64_t elapsed);
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Setup_ISR_Stats: Allocate Per-CPU Interrupt Counters
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Needs Setup_SMP() to have run, since recording finds its counters through the per-CPU data. Turns recording on and returns 1 on
+// success.
+//
+
+uint8_t Setup_ISR_Stats(void)
+{
+#if ISR_STATS
+  uint64_t cpus = Global_SMP_Info.Number_of_CPUs;
+  uint64_t size = cpus * 256 * sizeof(ISR_STAT);
+
+  ISR_STAT * stats = malloc4k(EFI_SIZE_TO_PAGES(size));
+  if(stats == MALLOC_FAILED)
+  {
+    printf("Setup_ISR_Stats: Not enough memory for interrupt stats.\r\n");
+    return 0;
+  }
+  AVX_memset(stats, 0, size);
+
+  for(uint64_t cpu = 0; cpu < cpus; cpu++)
+  {
+    Global_Per_CPU_Data[cpu].ISR_Stats = stats + cpu * 256;
+  }
+
+  Global_ISR_Stats.Stats = stats;
+  Global_ISR_Stats.Start_TSC = isr_stats_rdtsc();
+  __atomic_store_n(&Global_ISR_Stats.Enabled, 1, __ATOMIC_RELEASE);
+
+  return 1;
+#else
+  return 0;
+#endif
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// ISR_Stats_Record: Count One Interrupt
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Called by the ISR.S entry stubs after the handler returns, on every vector, so this has to stay GPR-only and short.
+//
+// isr_num: The vector that fired
+// cycles: TSC ticks the handler took
+//
+
+ISR_GPR_ONLY void ISR_Stats_Record(uint64_t isr_num, uint64_t cycles)
+{
+  if(__builtin_expect(Global_ISR_Stats.Enabled == 0, 0))
+  {
+    return;
+  }
+
+  ISR_STAT * stat = &get_cpu_data()->ISR_Stats[isr_num & 0xFF];
+
+  stat->Count++;
+  stat->Total_Cycles += cycles;
+  if(cycles > stat->Max_Cycles)
+  {
+    stat->Max_Cycles = cycles;
+  }
+
+  uint64_t bucket = 63 - __builtin_clzll(cycles | 1);
+  if(bucket >= ISR_STAT_BUCKETS)
+  {
+    bucket = ISR_STAT_BUCKETS - 1;
+  }
+  stat->Histogram[bucket]++;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// ISR_Stats_Enable: Turn Recording On or Off
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// enable: 1 to record, 0 to stop. Doesn't do anything before Setup_ISR_Stats() has run.
+//
+
+void ISR_Stats_Enable(uint64_t enable)
+{
+  if(Global_ISR_Stats.Stats)
+  {
+    Global_ISR_Stats.Enabled = enable;
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// ISR_Stats_Reset: Clear All Counters
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Zero every CPU's counters and restart the clock for rates. Interrupts being recorded on other CPUs at the same time may survive
+// the reset.
+//
+
+void ISR_Stats_Reset(void)
+{
+  if(Global_ISR_Stats.Stats == NULL)
+  {
+    return;
+  }
+
+  AVX_memset(Global_ISR_Stats.Stats, 0, Global_SMP_Info.Number_of_CPUs * 256 * sizeof(ISR_STAT));
+  Global_ISR_Stats.Start_TSC = isr_stats_rdtsc();
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// ISR_Stats_Print: Print Interrupt Counters
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Print a line for each vector that has fired since Setup_ISR_Stats() or the last ISR_Stats_Reset(), with its count, rate, average
+// and max handler time, and its nonzero histogram buckets as "log2:count". Times are in TSC ticks.
+//
+// per_cpu: 0 to add up all CPUs, 1 for a line per CPU (and vector) instead
+//
+
+void ISR_Stats_Print(uint64_t per_cpu)
+{
+  if(Global_ISR_Stats.Stats == NULL)
+  {
+    printf("ISR_Stats_Print: Interrupt stats aren't set up.\r\n");
+    return;
+  }
+
+  uint64_t elapsed = isr_stats_rdtsc() - Global_ISR_Stats.Start_TSC;
+  uint64_t elapsed_ns = Trace_Ticks_To_ns(elapsed);
+  uint64_t cpus = Global_SMP_Info.Number_of_CPUs;
+
+  printf("Interrupt stats over %qu.%03qu ms:\r\n", elapsed_ns / 1000000, (elapsed_ns / 1000) % 1000);
+  printf("%4s %4s %12s %10s %10s %10s  %s\r\n", "Vec", "CPU", "Count", "Rate/s", "Avg", "Max", "Histogram (log2 ticks:count)");
+
+  uint64_t printed = 0;
+  for(uint64_t isr_num = 0; isr_num < 256; isr_num++)
+  {
+    if(per_cpu)
+    {
+      for(uint64_t cpu = 0; cpu < cpus; cpu++)
+      {
+        ISR_STAT * stat = &Global_Per_CPU_Data[cpu].ISR_Stats[isr_num];
+        if(stat->Count)
+        {
+          isr_stats_print_row(isr_num, (int64_t)cpu, stat, elapsed);
+          printed++;
+        }
+      }
+    }
+    else
+    {
+      // Snapshot the sum, since the counters keep changing underneath
+      ISR_STAT sum = {0};
+      for(uint64_t cpu = 0; cpu < cpus; cpu++)
+      {
+        ISR_STAT * stat = &Global_Per_CPU_Data[cpu].ISR_Stats[isr_num];
+        sum.Count += stat->Count;
+        sum.Total_Cycles += stat->Total_Cycles;
+        if(stat->Max_Cycles > sum.Max_Cycles)
+        {
+          sum.Max_Cycles = stat->Max_Cycles;
+        }
+        for(uint64_t bucket = 0; bucket < ISR_STAT_BUCKETS; bucket++)
+        {
+          sum.Histogram[bucket] += stat->Histogram[bucket];
+        }
+      }
+
+      if(sum.Count)
+      {
+        isr_stats_print_row(isr_num, -1, &sum, elapsed);
+        printed++;
+      }
+    }
+  }
+
+  if(printed == 0)
+  {
+    printf("No interrupts recorded.\r\n");
+  }
+}
+
+// Read the TSC
+static uint64_t isr_stats_rdtsc(void)
+{
+  uint64_t high = 0, low = 0;
+  asm volatile("rdtsc"
+               : "=a" (low), "=d" (high) // Outputs
+               : // Inputs
+               : // Clobbers
+              );
+  return (high << 32) | low;
+}
+
+// One line of ISR_Stats_Print(), cpu is -1 for a sum over all CPUs
+static void isr_stats_print_row(uint64_t isr_num, int64_t cpu, ISR_STAT * stat, uint64_t elapsed)
+{
+  uint64_t count = stat->Count;
+  uint64_t elapsed_us = Trace_Ticks_To_ns(elapsed) / 1000;
+  uint64_t rate = elapsed_us ? (count * 1000000) / elapsed_us : 0;
+
+  if(cpu < 0)
+  {
+    printf("%4qu %4s ", isr_num, "all");
+  }
+  else
+  {
+    printf("%4qu %4qu ", isr_num, (uint64_t)cpu);
+  }
+  printf("%12qu %10qu %10qu %10qu ", count, rate, stat->Total_Cycles / count, stat->Max_Cycles);
+
+  for(uint64_t bucket = 0; bucket < ISR_STAT_BUCKETS; bucket++)
+  {
+    if(stat->Histogram[bucket])
+    {
+      printf(" %qu%s:%u", bucket, (bucket == ISR_STAT_BUCKETS - 1) ? "+" : "", stat->Histogram[bucket]);
+    }
+  }
+  printf("\r\n");
+}
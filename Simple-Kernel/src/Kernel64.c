@@ -188,7 +188,11 @@ __attribute__((naked)) void kernel_main(LOADER_PARAMS * LP) // Loader Parameters
   bitmap_bitreverse(load_image2, 24, 27, swapped_image);
   for(UINT64 k = 0; k < LP->GPU_Configs->NumberOfFrameBuffers; k++) // Multi-GPU support!
   {
-    bitmap_anywhere_scaled(LP->GPU_Configs->GPUArray[k], swapped_image, 24, 27, 0x0000FFFF, 0xFF000000, ((LP->GPU_Configs->GPUArray[k].Info->HorizontalResolution - 5*27) >>  1), ((LP->GPU_Configs->GPUArray[k].Info->VerticalResolution - 5*24) >> 1), 5);
+    if(Global_Shadow_Info.Mirror_Count && (LP->GPU_Configs->GPUArray[k].Info != Global_Print_Info.defaultGPU.Info))
+    {
+      continue; // Mirrored GPUs get a copy of printf's screen instead
+    }
+    bitmap_anywhere_scaled(&LP->GPU_Configs->GPUArray[k], swapped_image, 24, 27, 0x0000FFFF, 0xFF000000, ((LP->GPU_Configs->GPUArray[k].Info->HorizontalResolution - 5*27) >>  1), ((LP->GPU_Configs->GPUArray[k].Info->VerticalResolution - 5*24) >> 1), 5);
   }
 
   Print_Loader_Params(LP);
@@ -202,8 +206,27 @@ __attribute__((naked)) void kernel_main(LOADER_PARAMS * LP) // Loader Parameters
 
   print_system_memmap();
   printf("Total EfiConventionalMemory: %llu\r\n", GetFreeSystemRam());
+  Console_Flush(); // With "deferprintf", output is drawn at points like these (this does nothing otherwise)
+
+  if(Global_Kernel_Options.Lazy_Zero)
+  {
+    StartBackgroundZeroing();
+  }
+  else
+  {
+    TRACE_BEGIN("ZeroAllConventionalMemory");
+    ZeroAllConventionalMemory();
+    TRACE_END("ZeroAllConventionalMemory");
+  }
+
+  Trace_Print_Timeline();
+  Console_Flush();
 
-  ZeroAllConventionalMemory();
+  if(Global_Kernel_Options.Benchmark)
+  {
+    Run_Memory_Benchmarks(Global_Kernel_Options.Benchmark_Max_Size);
+    Console_Flush();
+  }
 
 /*
   printf("Avg CPU freq: %qu\r\n", get_CPU_freq(NULL, 0));
@@ -228,99 +251,24 @@ __attribute__((naked)) void kernel_main(LOADER_PARAMS * LP) // Loader Parameters
 
 //  Print_All_CRs_and_Some_Major_CPU_Features(); // The output from this will fill up a 768 vertical resolution screen with an 8 height font set to scale factor 1.
 
-  // ASM so that GCC doesn't mess with this loop. This is about as optimized this can get.
-  asm volatile("movl $1, %%eax\n\t" // Loop ends on overflow
-                "Loop0:\n\t"
-                "addl $1, %%eax\n\t"
-                "testl %%eax, %%eax\n\t"
-                "jne Loop0\n\t" // Count to 2^32, which is about 1 second at 4 GHz. 2^64 is... still insanely long.
-                : // no outputs
-                : // no inputs
-                : // no clobbers
-              );
+  Timer_Sleep_us(6000000); // 6 seconds
 
-  asm volatile("movl $1, %%eax\n\t" // Loop ends on overflow
-                "Loop7:\n\t"
-                "addl $1, %%eax\n\t"
-                "testl %%eax, %%eax\n\t"
-                "jne Loop7\n\t" // Count to 2^32, which is about 1 second at 4 GHz. 2^64 is... still insanely long.
-                : // no outputs
-                : // no inputs
-                : // no clobbers
-              );
+  Colorscreen(&LP->GPU_Configs->GPUArray[0], 0x000000FF); // Blue in BGRX (X = reserved, technically an "empty alpha channel" for 32-bit memory alignment)
+  single_char(&LP->GPU_Configs->GPUArray[0], '?', 8, 8, 0x00FFFFFF, 0x00000000);
+  single_char_anywhere(&LP->GPU_Configs->GPUArray[0], '!', 8, 8, 0x00FFFFFF, 0xFF000000, (LP->GPU_Configs->GPUArray[0].Info->HorizontalResolution >> 2), LP->GPU_Configs->GPUArray[0].Info->VerticalResolution/3);
+  single_char_anywhere_scaled(&LP->GPU_Configs->GPUArray[0], 'H', 8, 8, 0x00FFFFFF, 0xFF000000, 10, 10, 5);
+  string_anywhere_scaled(&LP->GPU_Configs->GPUArray[0], "Is it soup?", 8, 8, 0x00FFFFFF, 0x00000000, 10, 10, 1);
 
-  asm volatile("movl $1, %%eax\n\t" // Loop ends on overflow
-                "Loop8:\n\t"
-                "addl $1, %%eax\n\t"
-                "testl %%eax, %%eax\n\t"
-                "jne Loop8\n\t" // Count to 2^32, which is about 1 second at 4 GHz. 2^64 is... still insanely long.
-                : // no outputs
-                : // no inputs
-                : // no clobbers
-              );
+  Timer_Sleep_us(1000000); // 1 second
 
-  asm volatile("movl $1, %%eax\n\t" // Loop ends on overflow
-                "Loop9:\n\t"
-                "addl $1, %%eax\n\t"
-                "testl %%eax, %%eax\n\t"
-                "jne Loop9\n\t" // Count to 2^32, which is about 1 second at 4 GHz. 2^64 is... still insanely long.
-                : // no outputs
-                : // no inputs
-                : // no clobbers
-              );
+  Colorscreen(&LP->GPU_Configs->GPUArray[0], 0x0000FF00); // Green in BGRX (X = reserved, technically an "empty alpha channel" for 32-bit memory alignment)
+  single_char(&LP->GPU_Configs->GPUArray[0], 'A', 8, 8, 0x00FFFFFF, 0x00000000);
+  single_char_anywhere(&LP->GPU_Configs->GPUArray[0], '!', 8, 8, 0x00FFFFFF, 0xFF000000, (LP->GPU_Configs->GPUArray[0].Info->HorizontalResolution >> 2), LP->GPU_Configs->GPUArray[0].Info->VerticalResolution/3);
+  string_anywhere_scaled(&LP->GPU_Configs->GPUArray[0], "Is it really soup?", 8, 8, 0x00FFFFFF, 0x00000000, 50, 50, 3);
 
-  asm volatile("movl $1, %%eax\n\t" // Loop ends on overflow
-                "Loop10:\n\t"
-                "addl $1, %%eax\n\t"
-                "testl %%eax, %%eax\n\t"
-                "jne Loop10\n\t" // Count to 2^32, which is about 1 second at 4 GHz. 2^64 is... still insanely long.
-                : // no outputs
-                : // no inputs
-                : // no clobbers
-              );
+  Timer_Sleep_us(1000000); // 1 second
 
-  asm volatile("movl $1, %%eax\n\t" // Loop ends on overflow
-                "Loop11:\n\t"
-                "addl $1, %%eax\n\t"
-                "testl %%eax, %%eax\n\t"
-                "jne Loop11\n\t" // Count to 2^32, which is about 1 second at 4 GHz. 2^64 is... still insanely long.
-                : // no outputs
-                : // no inputs
-                : // no clobbers
-              );
-
-  Colorscreen(LP->GPU_Configs->GPUArray[0], 0x000000FF); // Blue in BGRX (X = reserved, technically an "empty alpha channel" for 32-bit memory alignment)
-  single_char(LP->GPU_Configs->GPUArray[0], '?', 8, 8, 0x00FFFFFF, 0x00000000);
-  single_char_anywhere(LP->GPU_Configs->GPUArray[0], '!', 8, 8, 0x00FFFFFF, 0xFF000000, (LP->GPU_Configs->GPUArray[0].Info->HorizontalResolution >> 2), LP->GPU_Configs->GPUArray[0].Info->VerticalResolution/3);
-  single_char_anywhere_scaled(LP->GPU_Configs->GPUArray[0], 'H', 8, 8, 0x00FFFFFF, 0xFF000000, 10, 10, 5);
-  string_anywhere_scaled(LP->GPU_Configs->GPUArray[0], "Is it soup?", 8, 8, 0x00FFFFFF, 0x00000000, 10, 10, 1);
-
-  // ASM so that GCC doesn't mess with this loop. This is about as optimized this can get.
-  asm volatile("movl $1, %%eax\n\t" // Loop ends on overflow
-                "Loop1:\n\t"
-                "addl $1, %%eax\n\t"
-                "jnz Loop1\n\t" // Count to 2^32, which is about 1 second at 4 GHz. 2^64 is... still insanely long.
-                : // no outputs
-                : // no inputs
-                : // no clobbers
-              );
-
-  Colorscreen(LP->GPU_Configs->GPUArray[0], 0x0000FF00); // Green in BGRX (X = reserved, technically an "empty alpha channel" for 32-bit memory alignment)
-  single_char(LP->GPU_Configs->GPUArray[0], 'A', 8, 8, 0x00FFFFFF, 0x00000000);
-  single_char_anywhere(LP->GPU_Configs->GPUArray[0], '!', 8, 8, 0x00FFFFFF, 0xFF000000, (LP->GPU_Configs->GPUArray[0].Info->HorizontalResolution >> 2), LP->GPU_Configs->GPUArray[0].Info->VerticalResolution/3);
-  string_anywhere_scaled(LP->GPU_Configs->GPUArray[0], "Is it really soup?", 8, 8, 0x00FFFFFF, 0x00000000, 50, 50, 3);
-
-  // ASM so that GCC doesn't mess with this loop. This is about as optimized this can get.
-  asm volatile("movl $1, %%eax\n\t" // Loop ends on overflow
-                "Loop2:\n\t"
-                "addl $1, %%eax\n\t"
-                "jnz Loop2\n\t" // Count to 2^32, which is about 1 second at 4 GHz. 2^64 is... still insanely long.
-                : // no outputs
-                : // no inputs
-                : // no clobbers
-              );
-
-  Colorscreen(LP->GPU_Configs->GPUArray[0], 0x00FF0000); // Red in BGRX (X = reserved, technically an "empty alpha channel" for 32-bit memory alignment)
+  Colorscreen(&LP->GPU_Configs->GPUArray[0], 0x00FF0000); // Red in BGRX (X = reserved, technically an "empty alpha channel" for 32-bit memory alignment)
   printf("PRINTF!! 0x%qx", LP->GPU_Configs->GPUArray[0].FrameBufferBase);
   printf("Whup %s\r\nOh.\r\n", "Yo%%nk");
 
@@ -332,60 +280,28 @@ __attribute__((naked)) void kernel_main(LOADER_PARAMS * LP) // Loader Parameters
   printf("Hello this is a sentence how far does it go before it wraps around?\nA\nB\nC\nD\nE\nF\nG\nH\nI\nJ\nK\nL\nM\nN\nO\nP\nQ\nR\nS\nT\nU\nV\nW\nX\nY\nZ\nYAY");
   printf("Hello this is a sentence how far does it go before it wraps around?\nA\nB\nC\nD\nE\nF\nG\nH\nI\nJ\nK\nL\nM\nN\nO\nP\nQ\nR\nS\nT\nU\nV\nW\nX\nY\nZ\nYAY");
 // The VLA in these causes a page fault in ELF-format
-  formatted_string_anywhere_scaled(LP->GPU_Configs->GPUArray[0], 8, 8, 0x00FFFFFF, 0x00000000, 0,  LP->GPU_Configs->GPUArray[0].Info->VerticalResolution/2, 2, "FORMATTED STRING!! %#x", Global_Print_Info.index);
-  formatted_string_anywhere_scaled(LP->GPU_Configs->GPUArray[0], 8, 8, 0x00FFFFFF, 0x00000000, 0,  LP->GPU_Configs->GPUArray[0].Info->VerticalResolution/4, 2, "FORMATTED %s STRING!! %s", "Heyo!", "Heyz!");
+  formatted_string_anywhere_scaled(&LP->GPU_Configs->GPUArray[0], 8, 8, 0x00FFFFFF, 0x00000000, 0,  LP->GPU_Configs->GPUArray[0].Info->VerticalResolution/2, 2, "FORMATTED STRING!! %#x", Global_Print_Info.index);
+  formatted_string_anywhere_scaled(&LP->GPU_Configs->GPUArray[0], 8, 8, 0x00FFFFFF, 0x00000000, 0,  LP->GPU_Configs->GPUArray[0].Info->VerticalResolution/4, 2, "FORMATTED %s STRING!! %s", "Heyo!", "Heyz!");
   printf("This printf shouldn't move due to formatted string invocation.");
-  single_char(LP->GPU_Configs->GPUArray[0], '2', 8, 8, 0x00FFFFFF, 0xFF000000);
+  single_char(&LP->GPU_Configs->GPUArray[0], '2', 8, 8, 0x00FFFFFF, 0xFF000000);
 
-  // ASM so that GCC doesn't mess with this loop. This is about as optimized this can get.
-  asm volatile("movl $1, %%eax\n\t" // Loop ends on overflow
-                "Loop3:\n\t"
-                "addl $1, %%eax\n\t"
-                "jnz Loop3\n\t" // Count to 2^32, which is about 1 second at 4 GHz. 2^64 is... still insanely long.
-                : // no outputs
-                : // no inputs
-                : // no clobbers
-              );
-
-  asm volatile("movl $1, %%eax\n\t" // Loop ends on overflow
-                "Loop5:\n\t"
-                "addl $1, %%eax\n\t"
-                "jnz Loop5\n\t" // Count to 2^32, which is about 1 second at 4 GHz. 2^64 is... still insanely long.
-                : // no outputs
-                : // no inputs
-                : // no clobbers
-              );
-
-  asm volatile("movl $1, %%eax\n\t" // Loop ends on overflow
-                "Loop6:\n\t"
-                "addl $1, %%eax\n\t"
-                "jnz Loop6\n\t" // Count to 2^32, which is about 1 second at 4 GHz. 2^64 is... still insanely long.
-                : // no outputs
-                : // no inputs
-                : // no clobbers
-              );
+  Timer_Sleep_us(3000000); // 3 seconds
 
-  Blackscreen(LP->GPU_Configs->GPUArray[0]); // X in BGRX (X = reserved, technically an "empty alpha channel" for 32-bit memory alignment)
-  single_pixel(LP->GPU_Configs->GPUArray[0], LP->GPU_Configs->GPUArray[0].Info->HorizontalResolution >> 2, LP->GPU_Configs->GPUArray[0].Info->VerticalResolution >> 2, 0x00FFFFFF);
-  single_char(LP->GPU_Configs->GPUArray[0], '@', 8, 8, 0x00FFFFFF, 0x00000000);
-  single_char_anywhere(LP->GPU_Configs->GPUArray[0], '!', 8, 8, 0x00FFFFFF, 0xFF000000, 512, 512);
-  single_char_anywhere_scaled(LP->GPU_Configs->GPUArray[0], 'I', 8, 8, 0x00FFFFFF, 0xFF000000, 10, 10, 2);
-  string_anywhere_scaled(LP->GPU_Configs->GPUArray[0], "OMG it's actually soup! I don't believe it!!", 8, 8, 0x00FFFFFF, 0x00000000, 0, LP->GPU_Configs->GPUArray[0].Info->VerticalResolution/2, 2);
+  Blackscreen(&LP->GPU_Configs->GPUArray[0]); // X in BGRX (X = reserved, technically an "empty alpha channel" for 32-bit memory alignment)
+  single_pixel(&LP->GPU_Configs->GPUArray[0], LP->GPU_Configs->GPUArray[0].Info->HorizontalResolution >> 2, LP->GPU_Configs->GPUArray[0].Info->VerticalResolution >> 2, 0x00FFFFFF);
+  single_char(&LP->GPU_Configs->GPUArray[0], '@', 8, 8, 0x00FFFFFF, 0x00000000);
+  single_char_anywhere(&LP->GPU_Configs->GPUArray[0], '!', 8, 8, 0x00FFFFFF, 0xFF000000, 512, 512);
+  single_char_anywhere_scaled(&LP->GPU_Configs->GPUArray[0], 'I', 8, 8, 0x00FFFFFF, 0xFF000000, 10, 10, 2);
+  string_anywhere_scaled(&LP->GPU_Configs->GPUArray[0], "OMG it's actually soup! I don't believe it!!", 8, 8, 0x00FFFFFF, 0x00000000, 0, LP->GPU_Configs->GPUArray[0].Info->VerticalResolution/2, 2);
 
-  // ASM so that GCC doesn't mess with this loop. This is about as optimized this can get.
-  asm volatile("movl $1, %%eax\n\t" // Loop ends on overflow
-                "Loop4:\n\t"
-                "addl $1, %%eax\n\t"
-                "jnz Loop4\n\t" // Count to 2^32, which is about 1 second at 4 GHz. 2^64 is... still insanely long.
-                : // no outputs
-                : // no inputs
-                : // no clobbers
-              );
+  Timer_Sleep_us(1000000); // 1 second
 
   // For shutdown, need to know if system is ACPI hardware-reduced or using legacy ACPI. There's a flag in FADT.
   Global_Print_Info.scale = 1; // Output scale for systemfont used by printf
   Global_Print_Info.textscrollmode = Global_Print_Info.height*Global_Print_Info.scale; // Readjust quick scrolling
 
+  ISR_Stats_Print(0); // Mostly timer ticks from the sleeps above
+
   // Search for ACPI tables
   uint8_t RSDPfound = 0;
   uint64_t RSDP_index = 0;
@@ -19,13 +19,52 @@
 // AVX_memset zeroes things.
 
 // TODO: malloc--it's based on ActuallyFreeAddress/ByPage
-// Also: calloc, realloc, and (free, freepages, vfree, vfreepages)
+// Also: calloc, realloc, and (vfree, vfreepages)
+
+static EFI_PHYSICAL_ADDRESS claim_conventional_pages(size_t numpages, uint32_t type, EFI_PHYSICAL_ADDRESS min_address);
+static EFI_PHYSICAL_ADDRESS buddy_allocate(size_t pages, EFI_PHYSICAL_ADDRESS OldAddress, uint64_t node, uint8_t zeroed);
+static void buddy_free_block(uint64_t frame, uint64_t order, uint8_t clean);
+static void buddy_free_range(uint64_t frame, uint64_t frames, uint8_t clean);
+static uint64_t buddy_alloc_block(uint64_t order, uint64_t min_frame, uint64_t node, uint8_t clean);
+static uint64_t buddy_order_for(uint64_t pages);
+static uint64_t buddy_span(uint64_t frame, uint64_t * span_start, uint64_t * span_end);
+static void buddy_list_push(uint64_t frame, uint64_t order, uint64_t node, uint8_t clean);
+static void buddy_list_remove(uint64_t frame, uint64_t order, uint64_t node);
+static void buddy_lock_take(void);
+static uint8_t buddy_lock_try(void);
+static void buddy_lock_release(void);
+static void buddy_drain_deferred(void);
+static void buddy_mark_slab(EFI_PHYSICAL_ADDRESS address, uint8_t slab);
+static uint8_t buddy_is_slab(EFI_PHYSICAL_ADDRESS address);
+static uint64_t slab_class_for(size_t numbytes, size_t alignment);
+static EFI_PHYSICAL_ADDRESS slab_take(uint64_t class);
+static void slab_give(void * object);
+static void slab_list_push(SLAB_HEADER * slab);
+static void slab_list_remove(SLAB_HEADER * slab);
+static void memmap_swap(uint64_t a, uint64_t b);
+static EFI_PHYSICAL_ADDRESS memmap_start(uint64_t index);
+static void memmap_sort(void);
+static void zero_background_task(void * arg);
+static void zero_progress_start(uint64_t total);
+static void zero_progress(uint64_t bytes);
+static void memmap_recount(void);
+static void memmap_account(uint32_t type, int64_t pages);
+static void memmap_move_pages(uint32_t from, uint32_t to, uint64_t pages);
+static void memmap_set_type(EFI_MEMORY_DESCRIPTOR * Piece, uint32_t type);
+
+// Memory map bookkeeping, see "Memory Map Index" below
+#define MEMMAP_COUNTED_TYPES (EfiMaxMemoryType + 7) // Same as the number of entries in mem_types[]
+
+static uint8_t memmap_indexed = 0; // Set once Setup_MemMap() has sorted the map and counted pages
+static uint64_t memmap_type_pages[MEMMAP_COUNTED_TYPES + 1] = {0}; // Pages of each type; the last slot is for OEM/OSV-defined types
+static SEQLOCK memmap_totals_lock = {0}; // Covers memmap_type_pages[], so the GetXRam() functions never see a move half-done
 
 //----------------------------------------------------------------------------------------------------------------------------------
 //  malloc: Allocate Physical Memory with Alignment
 //----------------------------------------------------------------------------------------------------------------------------------
 //
-// Dynamically allocate physical memory aligned to the nearest suitable address alignment value
+// Dynamically allocate physical memory aligned to the nearest suitable address alignment value. Returns MALLOC_FAILED (~0ULL) if
+// there's no room, like everything else in the malloc4k() family.
 //
 
 __attribute__((malloc)) void * malloc(size_t numbytes)
@@ -50,31 +89,72 @@ __attribute__((malloc)) void * malloc(size_t numbytes)
 }
 
 //----------------------------------------------------------------------------------------------------------------------------------
-//  vmalloc: Allocate Virtual Memory with Alignment
+//  free: Free Physical Memory
 //----------------------------------------------------------------------------------------------------------------------------------
 //
-// Dynamically allocate virtual memory aligned to the nearest suitable address alignment value
+// Give back memory from malloc16(), malloc32(), malloc64(), or a malloc() of less than 4096 bytes. Anything bigger came from
+// malloc4k() and needs freepages() instead.
 //
 
-__attribute__((malloc)) void * Vmalloc(size_t numbytes)
+void free(void * address)
 {
-  if(numbytes <= 16)
-  {
-    return Vmalloc16(numbytes); // 16-byte aligned
-  }
-  else if(numbytes <= 32)
+  if(address == NULL)
   {
-    return Vmalloc32(numbytes); // 32-byte aligned
+    return;
   }
-  else if(numbytes < 4096)
+
+  SlabFree((EFI_PHYSICAL_ADDRESS)address);
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  freepages: Free Physical Pages
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Give back 'pages' pages starting at 'address', which should have come from malloc4k(). The page count must be the same one that
+// was passed to malloc4k(), since the page allocator doesn't store allocation sizes.
+//
+
+void freepages(void * address, size_t pages)
+{
+  BuddyFreePages((EFI_PHYSICAL_ADDRESS)address, pages);
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  Vmalloc: Reserve Demand-Paged Virtual Memory
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Set aside 'numbytes' of virtual memory that only gets backed by physical pages as it's touched, see Vmalloc_Reserve() in VMM.c.
+// Reservations of at least Global_Vmalloc.Large_Threshold bytes (the "vmlarge" kernel option) get backed 2MB at a time. Returns NULL
+// if there's no room. Give it back with Vfree().
+//
+
+__attribute__((malloc)) void * Vmalloc(size_t numbytes)
+{
+  uint64_t flags = 0;
+
+  if(Global_Vmalloc.Large_Threshold && (numbytes >= Global_Vmalloc.Large_Threshold))
   {
-    return Vmalloc64(numbytes); // 64-byte aligned
+    flags = VMALLOC_LARGE_PAGES;
   }
-  else // >= 4096
+
+  return Vmalloc_Reserve(numbytes, flags);
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  Vfree: Free Demand-Paged Virtual Memory
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Give back a reservation from Vmalloc() or VmallocX(), along with whatever physical pages ended up backing it.
+//
+
+void Vfree(void * address)
+{
+  if(address == NULL)
   {
-    size_t numbytes_to_pages = EFI_SIZE_TO_PAGES(numbytes);
-    return Vmalloc4k(numbytes_to_pages);
+    return;
   }
+
+  Vmalloc_Release(address);
 }
 
 //----------------------------------------------------------------------------------------------------------------------------------
@@ -86,6 +166,11 @@ __attribute__((malloc)) void * Vmalloc(size_t numbytes)
 // Note that the 16, 32, and 64-byte alignment versions take the total number of bytes to allocate, but the 4k version requires the
 // number of sets of 4k bytes (a.k.a. the number of pages, in UEFI parlance).
 //
+// Once the page allocator is set up, the 16, 32, and 64-byte versions come from the slab allocator (see SlabAllocate()), and the 4k
+// version comes from the page allocator (see BuddyAllocatePages()).
+//
+// All of them return MALLOC_FAILED (~0ULL) if there's no room. 0 is a valid physical address, so NULL can't be used for that.
+//
 
 __attribute__((malloc)) void * malloc16(size_t numbytes)
 {
@@ -123,6 +208,34 @@ __attribute__((malloc)) void * malloc4k(size_t pages)
   return (void*)new_buffer;
 }
 
+//----------------------------------------------------------------------------------------------------------------------------------
+//  malloc4k_zeroed: Allocate Zeroed Physical Pages
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// malloc4k(), but the pages are all zeroes. With the page allocator this takes already-zeroed pages when there are any (see
+// BuddyAllocateZeroedPages()), so it's usually cheaper than malloc4k() and a memset. Returns MALLOC_FAILED if there's no room.
+//
+
+__attribute__((malloc)) void * malloc4k_zeroed(size_t pages)
+{
+  EFI_PHYSICAL_ADDRESS new_buffer;
+
+  if(Page_Allocator_Ready())
+  {
+    new_buffer = BuddyAllocateZeroedPages(pages, 0);
+  }
+  else
+  {
+    new_buffer = AllocateFreeAddressByPage(pages, 0);
+    if(new_buffer != ~0ULL)
+    {
+      AVX_memset((void*)new_buffer, 0, EFI_PAGES_TO_SIZE(pages));
+    }
+  }
+
+  return (void*)new_buffer;
+}
+
 //----------------------------------------------------------------------------------------------------------------------------------
 //  VmallocX: Allocate Virtual Memory Aligned to X Bytes
 //----------------------------------------------------------------------------------------------------------------------------------
@@ -132,41 +245,28 @@ __attribute__((malloc)) void * malloc4k(size_t pages)
 // Note that the 16, 32, and 64-byte alignment versions take the total number of bytes to allocate, but the 4k version requires the
 // number of sets of 4k bytes (a.k.a. the number of pages, in UEFI parlance).
 //
+// These all come from Vmalloc(), whose reservations always start on a page boundary, so each one takes at least a 4kB page once it's
+// touched. Small allocations that are used right away are better off with mallocX.
+//
 
 __attribute__((malloc)) void * Vmalloc16(size_t numbytes)
 {
-  EFI_VIRTUAL_ADDRESS new_buffer = 0; // Make this 0x100000000 to only operate above 4GB
-
-  new_buffer = VAllocateFreeAddressBy16Bytes(numbytes, new_buffer);
-
-  return (void*)new_buffer;
+  return Vmalloc(numbytes);
 }
 
 __attribute__((malloc)) void * Vmalloc32(size_t numbytes)
 {
-  EFI_VIRTUAL_ADDRESS new_buffer = 0; // Make this 0x100000000 to only operate above 4GB
-
-  new_buffer = VAllocateFreeAddressBy32Bytes(numbytes, new_buffer);
-
-  return (void*)new_buffer;
+  return Vmalloc(numbytes);
 }
 
 __attribute__((malloc)) void * Vmalloc64(size_t numbytes)
 {
-  EFI_VIRTUAL_ADDRESS new_buffer = 0; // Make this 0x100000000 to only operate above 4GB
-
-  new_buffer = VAllocateFreeAddressBy64Bytes(numbytes, new_buffer);
-
-  return (void*)new_buffer;
+  return Vmalloc(numbytes);
 }
 
 __attribute__((malloc)) void * Vmalloc4k(size_t pages)
 {
-  EFI_VIRTUAL_ADDRESS new_buffer = 0; // Make this 0x100000000 to only operate above 4GB
-
-  new_buffer = VAllocateFreeAddressByPage(pages, new_buffer);
-
-  return (void*)new_buffer;
+  return Vmalloc(EFI_PAGES_TO_SIZE(pages));
 }
 
 //----------------------------------------------------------------------------------------------------------------------------------
@@ -175,17 +275,13 @@ __attribute__((malloc)) void * Vmalloc4k(size_t pages)
 //
 // Return 0 if desired section of memory is zeroed (for use in "if" statements)
 //
+// This is AVX_is_all_zero() with the result flipped, which ORs together four vectors at a time and checks them with one vptest, so it
+// runs at about memory bandwidth.
+//
 
 uint8_t VerifyZeroMem(size_t NumBytes, uint64_t BaseAddr) // BaseAddr is a 64-bit unsigned int whose value is the memory address
 {
-  for(size_t i = 0; i < NumBytes; i++)
-  {
-    if(*(uint8_t*)(BaseAddr + i) != 0)
-    {
-      return 1;
-    }
-  }
-  return 0;
+  return !AVX_is_all_zero((const void*)BaseAddr, NumBytes);
 }
 
 //----------------------------------------------------------------------------------------------------------------------------------
@@ -204,6 +300,17 @@ uint64_t GetMaxMappedPhysicalAddress(void)
   EFI_MEMORY_DESCRIPTOR * Piece;
   uint64_t current_address = 0, max_address = 0;
 
+  if(memmap_indexed)
+  {
+    // Sorted map, so the last entry ends the highest
+    if(Global_Memory_Info.MemMapSize == 0)
+    {
+      return 0;
+    }
+    Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize - Global_Memory_Info.MemMapDescriptorSize);
+    return Piece->PhysicalStart + EFI_PAGES_TO_SIZE(Piece->NumberOfPages);
+  }
+
   // Go through the system memory map, adding the page sizes to PhysicalStart. Returns the largest number found, which should be the maximum addressable memory location based on installed RAM size.
   for(Piece = Global_Memory_Info.MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
   {
@@ -230,6 +337,30 @@ uint64_t GetVisibleSystemRam(void)
   EFI_MEMORY_DESCRIPTOR * Piece;
   uint64_t running_total = 0;
 
+  if(memmap_indexed)
+  {
+    uint64_t start;
+    do
+    {
+      start = Seqlock_Read_Begin(&memmap_totals_lock);
+      running_total = 0;
+      for(uint32_t type = 0; type <= MEMMAP_COUNTED_TYPES; type++)
+      {
+        if(
+            (type != EfiMemoryMappedIO) &&
+            (type != EfiMemoryMappedIOPortSpace) &&
+            (type != EfiPalCode) &&
+            (type != EfiPersistentMemory) &&
+            (type != EfiMaxMemoryType)
+          )
+        {
+          running_total += EFI_PAGES_TO_SIZE(memmap_type_pages[type]);
+        }
+      }
+    } while(Seqlock_Read_Retry(&memmap_totals_lock, start));
+    return running_total;
+  }
+
   for(Piece = Global_Memory_Info.MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
   {
     if(
@@ -251,7 +382,7 @@ uint64_t GetVisibleSystemRam(void)
 //  GetFreeSystemRam: Calculate Total Free System RAM
 //----------------------------------------------------------------------------------------------------------------------------------
 //
-// Calculates the total EfiConventionalMemory from the UEFI system memory map.
+// Calculates the total EfiConventionalMemory from the UEFI system memory map, plus whatever is free in the page allocator.
 //
 
 uint64_t GetFreeSystemRam(void)
@@ -259,6 +390,17 @@ uint64_t GetFreeSystemRam(void)
   EFI_MEMORY_DESCRIPTOR * Piece;
   uint64_t running_total = 0;
 
+  if(memmap_indexed)
+  {
+    uint64_t start;
+    do
+    {
+      start = Seqlock_Read_Begin(&memmap_totals_lock);
+      running_total = memmap_type_pages[EfiConventionalMemory];
+    } while(Seqlock_Read_Retry(&memmap_totals_lock, start));
+    return EFI_PAGES_TO_SIZE(running_total + BuddyFreePageCount());
+  }
+
   for(Piece = Global_Memory_Info.MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
   {
     if(Piece->Type == EfiConventionalMemory)
@@ -267,6 +409,8 @@ uint64_t GetFreeSystemRam(void)
     }
   }
 
+  running_total += EFI_PAGES_TO_SIZE(BuddyFreePageCount());
+
   return running_total;
 }
 
@@ -282,6 +426,17 @@ uint64_t GetFreePersistentRam(void)
   EFI_MEMORY_DESCRIPTOR * Piece;
   uint64_t running_total = 0;
 
+  if(memmap_indexed)
+  {
+    uint64_t start;
+    do
+    {
+      start = Seqlock_Read_Begin(&memmap_totals_lock);
+      running_total = memmap_type_pages[EfiPersistentMemory];
+    } while(Seqlock_Read_Retry(&memmap_totals_lock, start));
+    return EFI_PAGES_TO_SIZE(running_total);
+  }
+
   for(Piece = Global_Memory_Info.MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
   {
     if(Piece->Type == EfiPersistentMemory)
@@ -338,7 +493,7 @@ typedef struct {
 // This is a file scope global variable, which lets it be declared static. This prevents a stack overflow that could arise if it were
 // local to its function of use. Static arrays defined like this can actually be made very large, but they cannot be accessed by any
 // functions that are not explicitly defined in this file. It cannot be passed as an argument to outside functions, either.
-static const char mem_types[20][27] = {
+static const char mem_types[MEMMAP_COUNTED_TYPES][27] = {
     "EfiReservedMemoryType     ",
     "EfiLoaderCode             ",
     "EfiLoaderData             ",
@@ -358,7 +513,9 @@ static const char mem_types[20][27] = {
     "malloc                    ", // EfiMaxMemoryType + 1
     "vmalloc                   ", // EfiMaxMemoryType + 2
     "MemMap                    ", // EfiMaxMemoryType + 3
-    "PageTables                "  // EfiMaxMemoryType + 4
+    "PageTables                ", // EfiMaxMemoryType + 4
+    "PagePool                  ", // EfiMaxMemoryType + 5
+    "PagePoolMap               "  // EfiMaxMemoryType + 6
 };
 
 void print_system_memmap(void)
@@ -413,6 +570,10 @@ EFI_MEMORY_DESCRIPTOR * Set_Identity_VMAP(EFI_RUNTIME_SERVICES * RTServices)
 //
 // Take UEFI's memory map and modify it to include the memory map's location. This prepares it for use with mallocX.
 //
+// This also sorts the map by physical address and counts up the pages of each memory type, which MemMap_Find(), the GetXRam()
+// functions, and MergeContiguousConventionalMemory() rely on. Everything that edits the map afterwards keeps it sorted and keeps the
+// counts up to date.
+//
 
 void Setup_MemMap(void)
 {
@@ -513,97 +674,289 @@ void Setup_MemMap(void)
       // Done modifying new map.
     }
   }
+
+  // Firmware doesn't have to report the map in order, but everything from here on out wants it sorted
+  memmap_sort();
+  memmap_recount();
+  memmap_indexed = 1;
 }
 
 //----------------------------------------------------------------------------------------------------------------------------------
-//  pagetable_alloc: Allocate Memory for Page Tables
+//  Memory Map Index: Sorted Lookups and Page Counts
 //----------------------------------------------------------------------------------------------------------------------------------
 //
-// Returns a 4k-aligned address of a region of size 'pagetable_size' specified for use by page tables
+// After Setup_MemMap(), the memory map is kept sorted by PhysicalStart, and memmap_type_pages[] holds the total number of pages of
+// each memory type. Anything that changes an entry's type or moves pages between entries reports it through memmap_set_type() or
+// memmap_move_pages(), so the GetXRam() functions never need to walk the map. The counts are under memmap_totals_lock, a seqlock,
+// since they're read far more often than they change.
 //
-// EFI_PHYSICAL_ADDRESS is just a uint64_t.
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  MemMap_Find: Find the Memory Map Entry Containing an Address
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Returns a pointer to the descriptor whose physical range contains 'address', or NULL if no entry does. This is a binary search once
+// Setup_MemMap() has sorted the map, and a plain scan before then.
 //
 
-EFI_PHYSICAL_ADDRESS pagetable_alloc(uint64_t pagetables_size)
+EFI_MEMORY_DESCRIPTOR * MemMap_Find(EFI_PHYSICAL_ADDRESS address)
 {
-  // All this does is take some EfiConventionalMemory and add one entry to the map
-
   EFI_MEMORY_DESCRIPTOR * Piece;
-  size_t numpages = EFI_SIZE_TO_PAGES(pagetables_size);
 
-  EFI_PHYSICAL_ADDRESS pagetable_address = ActuallyFreeAddress(numpages, 0); // This will only give addresses at the base of a chunk of EfiConventionalMemory
-  if(pagetable_address == ~0ULL)
+  if(!memmap_indexed)
   {
-    printf("Not enough space for page tables. Unsafe to continue.\r\n");
-    HaCF();
+    for(Piece = Global_Memory_Info.MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
+    {
+      if((address >= Piece->PhysicalStart) && (address < (Piece->PhysicalStart + EFI_PAGES_TO_SIZE(Piece->NumberOfPages))))
+      {
+        return Piece;
+      }
+    }
+    return NULL;
   }
-  else
+
+  uint64_t low = 0;
+  uint64_t high = Global_Memory_Info.MemMapSize / Global_Memory_Info.MemMapDescriptorSize;
+
+  while(low < high)
   {
-    // Zero out the destination
-    AVX_memset((void*)pagetable_address, 0, numpages << EFI_PAGE_SHIFT);
+    uint64_t middle = (low + high) >> 1;
+    Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + middle * Global_Memory_Info.MemMapDescriptorSize);
 
-    // Get a pointer for the descriptor corresponding to the address (scan the memory map to find it)
-    for(Piece = Global_Memory_Info.MemMap; (uint8_t*)Piece < ((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
+    if(address < Piece->PhysicalStart)
     {
-      if(Piece->PhysicalStart == pagetable_address)
-      { // Found it, Piece holds the spot now. Also, we know it's at the base of Piece->PhysicalStart of an EfiConventionalMemory area because we put it there with ActuallyFreeAddress.
-        break;
-      }
+      high = middle;
+    }
+    else if(address >= (Piece->PhysicalStart + EFI_PAGES_TO_SIZE(Piece->NumberOfPages)))
+    {
+      low = middle + 1;
     }
+    else
+    {
+      return Piece;
+    }
+  }
 
-    if((uint8_t*)Piece == ((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize)) // This will be true if the loop didn't break
+  return NULL;
+}
+
+// Swap two memory map entries. Descriptor sizes are always a multiple of 8 bytes.
+static void memmap_swap(uint64_t a, uint64_t b)
+{
+  uint64_t * first = (uint64_t*)((uint8_t*)Global_Memory_Info.MemMap + a * Global_Memory_Info.MemMapDescriptorSize);
+  uint64_t * second = (uint64_t*)((uint8_t*)Global_Memory_Info.MemMap + b * Global_Memory_Info.MemMapDescriptorSize);
+
+  for(uint64_t i = 0; i < (Global_Memory_Info.MemMapDescriptorSize >> 3); i++)
+  {
+    uint64_t temp = first[i];
+    first[i] = second[i];
+    second[i] = temp;
+  }
+}
+
+static EFI_PHYSICAL_ADDRESS memmap_start(uint64_t index)
+{
+  return ((EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + index * Global_Memory_Info.MemMapDescriptorSize))->PhysicalStart;
+}
+
+// Heapsort the memory map by PhysicalStart, in place
+static void memmap_sort(void)
+{
+  uint64_t entries = Global_Memory_Info.MemMapSize / Global_Memory_Info.MemMapDescriptorSize;
+
+  // Build a max-heap, then repeatedly move the largest remaining entry to the end
+  for(uint64_t end = entries, start = entries >> 1; end > 1; )
+  {
+    if(start > 0)
     {
-      printf("Pagetable area not found. Unsafe to continue.\r\n");
-      HaCF();
+      start--;
     }
     else
     {
-      // Mark the new area as PageTables (it's currently EfiConventionalMemory)
-      if(Piece->NumberOfPages == numpages) // Trivial case: The new space descriptor is just the right size and needs no splitting; saves a memory descriptor so MemMapSize doesn't need to be increased
+      end--;
+      memmap_swap(0, end);
+    }
+
+    // Sift down from 'start'
+    uint64_t root = start;
+    while(((root << 1) + 1) < end)
+    {
+      uint64_t child = (root << 1) + 1;
+      if(((child + 1) < end) && (memmap_start(child) < memmap_start(child + 1)))
       {
-        Piece->Type = EfiMaxMemoryType + 4; // Special PageTables type
-        // Nothng to do for Pad, PhysicalStart, VirtualStart, NumberOfPages, and Attribute
+        child++;
+      }
+
+      if(memmap_start(root) < memmap_start(child))
+      {
+        memmap_swap(root, child);
+        root = child;
       }
-      else // Need to insert a memmap descriptor. Thanks to the way ActuallyFreeAddress works we know the area is at the base of the EfiConventionalMemory descriptor
+      else
       {
-        // TODO: IMPORTANT: this needs to account for if the MemMap needs to be moved (call an update_memmap function based on "old setup_memmap")
+        break;
+      }
+    }
+  }
+}
 
-        // Make a temporary descriptor to hold current piece's values, but modified for PageTables
-        EFI_MEMORY_DESCRIPTOR new_descriptor_temp;
-        new_descriptor_temp.Type = EfiMaxMemoryType + 4; // Special PageTables type
-        new_descriptor_temp.Pad = Piece->Pad;
-        new_descriptor_temp.PhysicalStart = Piece->PhysicalStart;
-        new_descriptor_temp.VirtualStart = Piece->VirtualStart;
-        new_descriptor_temp.NumberOfPages = numpages;
-        new_descriptor_temp.Attribute = Piece->Attribute;
+// Count up the pages of each type from scratch
+static void memmap_recount(void)
+{
+  EFI_MEMORY_DESCRIPTOR * Piece;
 
-        // Modify this EfiConventionalMemory descriptor (shrink it) to reflect its new values
-        Piece->PhysicalStart += (numpages << EFI_PAGE_SHIFT);
-        Piece->VirtualStart += (numpages << EFI_PAGE_SHIFT);
-        Piece->NumberOfPages -= numpages;
+  Seqlock_Write_Begin(&memmap_totals_lock);
 
-        // Move (copy) the whole memmap that's above this piece (including this freshly modified piece) from this piece to one MemMapDescriptorSize over
-        AVX_memmove((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize, Piece, ((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize) - (uint8_t*)Piece); // Pointer math to get size
+  AVX_memset(memmap_type_pages, 0, sizeof(memmap_type_pages));
 
-        // Insert the new piece (by overwriting the now-duplicated entry with new values)
-        // I.e. turn this piece into what was stored in the temporary descriptor above
-        Piece->Type = new_descriptor_temp.Type;
-        Piece->Pad = new_descriptor_temp.Pad;
-        Piece->PhysicalStart = new_descriptor_temp.PhysicalStart;
-        Piece->VirtualStart = new_descriptor_temp.VirtualStart;
-        Piece->NumberOfPages = new_descriptor_temp.NumberOfPages;
-        Piece->Attribute = new_descriptor_temp.Attribute;
+  for(Piece = Global_Memory_Info.MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
+  {
+    memmap_account(Piece->Type, Piece->NumberOfPages);
+  }
 
-        // Update Global_Memory_Info with new MemMap size
-        Global_Memory_Info.MemMapSize += Global_Memory_Info.MemMapDescriptorSize;
-      }
-      // Done modifying map.
+  Seqlock_Write_End(&memmap_totals_lock);
+}
+
+// Add (or, with negative 'pages', subtract) pages to the count for 'type'. Call inside a memmap_totals_lock write.
+static void memmap_account(uint32_t type, int64_t pages)
+{
+  if(type >= MEMMAP_COUNTED_TYPES)
+  {
+    type = MEMMAP_COUNTED_TYPES;
+  }
+
+  memmap_type_pages[type] += pages;
+}
+
+// Move pages from one type's count to another's
+static void memmap_move_pages(uint32_t from, uint32_t to, uint64_t pages)
+{
+  Seqlock_Write_Begin(&memmap_totals_lock);
+  memmap_account(from, -(int64_t)pages);
+  memmap_account(to, pages);
+  Seqlock_Write_End(&memmap_totals_lock);
+}
+
+// Change an entry's type and move its pages over to the new type's count
+static void memmap_set_type(EFI_MEMORY_DESCRIPTOR * Piece, uint32_t type)
+{
+  memmap_move_pages(Piece->Type, type, Piece->NumberOfPages);
+  Piece->Type = type;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  pagetable_alloc: Allocate Memory for Page Tables
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Returns a 4k-aligned address of a region of size 'pagetable_size' specified for use by page tables
+//
+// EFI_PHYSICAL_ADDRESS is just a uint64_t.
+//
+
+EFI_PHYSICAL_ADDRESS pagetable_alloc(uint64_t pagetables_size)
+{
+  size_t numpages = EFI_SIZE_TO_PAGES(pagetables_size);
+  EFI_PHYSICAL_ADDRESS pagetable_address;
+
+  if(Page_Allocator_Ready())
+  {
+    // Once the page allocator owns free memory, page tables come from there
+    pagetable_address = BuddyAllocatePages(numpages, 0);
+    if(pagetable_address == ~0ULL)
+    {
+      printf("Not enough space for page tables. Unsafe to continue.\r\n");
+      HaCF();
+    }
+    AVX_memset((void*)pagetable_address, 0, numpages << EFI_PAGE_SHIFT);
+  }
+  else
+  {
+    pagetable_address = claim_conventional_pages(numpages, EfiMaxMemoryType + 4, 0); // Special PageTables type
+    if(pagetable_address == ~0ULL)
+    {
+      printf("Not enough space for page tables. Unsafe to continue.\r\n");
+      HaCF();
     }
   }
 
   return pagetable_address;
 }
 
+// Take 'numpages' pages of EfiConventionalMemory at or above 'min_address', zero them, and mark them as 'type' in the memory map.
+// Returns the base address, or ~0ULL if there's no room.
+static EFI_PHYSICAL_ADDRESS claim_conventional_pages(size_t numpages, uint32_t type, EFI_PHYSICAL_ADDRESS min_address)
+{
+  // All this does is take some EfiConventionalMemory and add one entry to the map
+
+  EFI_MEMORY_DESCRIPTOR * Piece;
+
+  EFI_PHYSICAL_ADDRESS claimed_address = ActuallyFreeAddress(numpages, min_address); // This will only give addresses at the base of a chunk of EfiConventionalMemory
+  if(claimed_address == ~0ULL)
+  {
+#ifdef MEMORY_CHECK_INFO
+    printf("No EfiConventionalMemory area big enough to claim...\r\n");
+#endif
+    return ~0ULL;
+  }
+
+  // Zero out the destination
+  AVX_memset((void*)claimed_address, 0, numpages << EFI_PAGE_SHIFT);
+
+  // Get a pointer for the descriptor corresponding to the address. We know it's at the base of Piece->PhysicalStart of an
+  // EfiConventionalMemory area because ActuallyFreeAddress put it there.
+  Piece = MemMap_Find(claimed_address);
+
+  if((Piece == NULL) || (Piece->PhysicalStart != claimed_address) || (Piece->Type != EfiConventionalMemory))
+  {
+    printf("Claimed area not found. Unsafe to continue.\r\n");
+    HaCF();
+  }
+
+  // Mark the new area as 'type' (it's currently EfiConventionalMemory)
+  if(Piece->NumberOfPages == numpages) // Trivial case: The new space descriptor is just the right size and needs no splitting; saves a memory descriptor so MemMapSize doesn't need to be increased
+  {
+    memmap_set_type(Piece, type);
+    // Nothng to do for Pad, PhysicalStart, VirtualStart, NumberOfPages, and Attribute
+  }
+  else // Need to insert a memmap descriptor. Thanks to the way ActuallyFreeAddress works we know the area is at the base of the EfiConventionalMemory descriptor
+  {
+    // TODO: IMPORTANT: this needs to account for if the MemMap needs to be moved (call an update_memmap function based on "old setup_memmap")
+
+    // Make a temporary descriptor to hold current piece's values, but modified for the new type
+    EFI_MEMORY_DESCRIPTOR new_descriptor_temp;
+    new_descriptor_temp.Type = type;
+    new_descriptor_temp.Pad = Piece->Pad;
+    new_descriptor_temp.PhysicalStart = Piece->PhysicalStart;
+    new_descriptor_temp.VirtualStart = Piece->VirtualStart;
+    new_descriptor_temp.NumberOfPages = numpages;
+    new_descriptor_temp.Attribute = Piece->Attribute;
+
+    // Modify this EfiConventionalMemory descriptor (shrink it) to reflect its new values
+    Piece->PhysicalStart += (numpages << EFI_PAGE_SHIFT);
+    Piece->VirtualStart += (numpages << EFI_PAGE_SHIFT);
+    Piece->NumberOfPages -= numpages;
+
+    // Move (copy) the whole memmap that's above this piece (including this freshly modified piece) from this piece to one MemMapDescriptorSize over
+    AVX_memmove((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize, Piece, ((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize) - (uint8_t*)Piece); // Pointer math to get size
+
+    // Insert the new piece (by overwriting the now-duplicated entry with new values)
+    // I.e. turn this piece into what was stored in the temporary descriptor above
+    Piece->Type = new_descriptor_temp.Type;
+    Piece->Pad = new_descriptor_temp.Pad;
+    Piece->PhysicalStart = new_descriptor_temp.PhysicalStart;
+    Piece->VirtualStart = new_descriptor_temp.VirtualStart;
+    Piece->NumberOfPages = new_descriptor_temp.NumberOfPages;
+    Piece->Attribute = new_descriptor_temp.Attribute;
+
+    // Update Global_Memory_Info with new MemMap size
+    Global_Memory_Info.MemMapSize += Global_Memory_Info.MemMapDescriptorSize;
+
+    memmap_move_pages(EfiConventionalMemory, type, numpages);
+  }
+  // Done modifying map.
+
+  return claimed_address;
+}
 
 //----------------------------------------------------------------------------------------------------------------------------------
 //  ActuallyFreeAddress: Find A Free Physical Memory Address, Bottom-Up
@@ -660,6 +1013,12 @@ EFI_PHYSICAL_ADDRESS ActuallyFreeAddressByPage(size_t pages, EFI_PHYSICAL_ADDRES
   EFI_PHYSICAL_ADDRESS PhysicalEnd;
   EFI_PHYSICAL_ADDRESS DiscoveredAddress;
 
+  if(Page_Allocator_Ready())
+  {
+    // Free pages live in the page allocator now, so look there. Nothing gets allocated.
+    return BuddyFindFreePages(pages, OldAddress);
+  }
+
   // Multiply NumberOfPages by EFI_PAGE_SIZE to get the end address... which should just be the start of the next section.
   // Check for EfiConventionalMemory in the map
   for(Piece = Global_Memory_Info.MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
@@ -714,6 +1073,12 @@ EFI_PHYSICAL_ADDRESS AllocateFreeAddressByPage(size_t pages, EFI_PHYSICAL_ADDRES
   EFI_PHYSICAL_ADDRESS PhysicalEnd;
   EFI_PHYSICAL_ADDRESS DiscoveredAddress;
 
+  if(Page_Allocator_Ready())
+  {
+    // The page allocator splits blocks itself, so none of the memory map juggling below is needed
+    return BuddyAllocatePages(pages, OldAddress);
+  }
+
   // Multiply NumberOfPages by EFI_PAGE_SIZE to get the end address... which should just be the start of the next section.
   // Check for EfiConventionalMemory in the map
   for(Piece = Global_Memory_Info.MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
@@ -742,7 +1107,7 @@ EFI_PHYSICAL_ADDRESS AllocateFreeAddressByPage(size_t pages, EFI_PHYSICAL_ADDRES
         // Check if we even need to make room...
         if(Piece->NumberOfPages - pages == 0)
         { // Nope. Just change this chunk to malloc type.
-          Piece->Type = EfiMaxMemoryType + 1;
+          memmap_set_type(Piece, EfiMaxMemoryType + 1);
           // Done here.
         }
         else
@@ -825,7 +1190,14 @@ EFI_PHYSICAL_ADDRESS AllocateFreeAddressBy16Bytes(size_t numbytes, EFI_PHYSICAL_
   EFI_MEMORY_DESCRIPTOR * Piece;
   EFI_PHYSICAL_ADDRESS PhysicalEnd;
   EFI_PHYSICAL_ADDRESS DiscoveredAddress;
-  size_t num_16_bytes = numbytes >> 4;
+
+  if(Page_Allocator_Ready())
+  {
+    // Small allocations come from slabs once there's a page allocator to get them from
+    return SlabAllocate(numbytes, 16);
+  }
+
+  size_t num_16_bytes = numbytes >> 4;
   if(numbytes & 0xF)
   { // This might "waste" up to 15 bytes, but alignment makes it worthwhile.
     num_16_bytes++;
@@ -884,6 +1256,13 @@ EFI_PHYSICAL_ADDRESS AllocateFreeAddressBy32Bytes(size_t numbytes, EFI_PHYSICAL_
   EFI_MEMORY_DESCRIPTOR * Piece;
   EFI_PHYSICAL_ADDRESS PhysicalEnd;
   EFI_PHYSICAL_ADDRESS DiscoveredAddress;
+
+  if(Page_Allocator_Ready())
+  {
+    // Small allocations come from slabs once there's a page allocator to get them from
+    return SlabAllocate(numbytes, 32);
+  }
+
   size_t num_32_bytes = numbytes >> 5;
   if(numbytes & 0x1F)
   { // This might "waste" up to 31 bytes, but alignment makes it worthwhile.
@@ -943,6 +1322,13 @@ EFI_PHYSICAL_ADDRESS AllocateFreeAddressBy64Bytes(size_t numbytes, EFI_PHYSICAL_
   EFI_MEMORY_DESCRIPTOR * Piece;
   EFI_PHYSICAL_ADDRESS PhysicalEnd;
   EFI_PHYSICAL_ADDRESS DiscoveredAddress;
+
+  if(Page_Allocator_Ready())
+  {
+    // Small allocations come from slabs once there's a page allocator to get them from
+    return SlabAllocate(numbytes, 64);
+  }
+
   size_t num_64_bytes = numbytes >> 6;
   if(numbytes & 0x3F)
   { // This might "waste" up to 63 bytes, but alignment makes it worthwhile.
@@ -987,597 +1373,1480 @@ EFI_PHYSICAL_ADDRESS AllocateFreeAddressBy64Bytes(size_t numbytes, EFI_PHYSICAL_
 }
 
 //----------------------------------------------------------------------------------------------------------------------------------
-//  VActuallyFreeAddress: Find A Free Virtual Memory Address, Bottom-Up
+//  ReclaimEfiBootServicesMemory: Convert EfiBootServicesCode and EfiBootServicesData to EfiConventionalMemory
 //----------------------------------------------------------------------------------------------------------------------------------
 //
-// Returns the next EfiConventionalMemory area that is > the supplied OldAddress.
+// After calling ExitBootServices(), EfiBootServicesCode and EfiBootServicesData are supposed to become free memory. This is not
+// always the case (see: https://mjg59.dreamwidth.org/11235.html), but this function exists because the UEFI Specification (2.7A)
+// states that it really should be free.
 //
-// pages: number of pages needed
-// OldAddress: An baseline address to search bottom-up from
+// Calling this function more than once won't do anything other than just waste some CPU time.
 //
 
-EFI_VIRTUAL_ADDRESS VActuallyFreeAddress(size_t pages, EFI_VIRTUAL_ADDRESS OldAddress)
+void ReclaimEfiBootServicesMemory(void)
 {
-//  EFI_STATUS memmap_status;
   EFI_MEMORY_DESCRIPTOR * Piece;
 
-  // Multiply NumberOfPages by EFI_PAGE_SIZE to get the end address... which should just be the start of the next section.
-  // Check for EfiConventionalMemory in the map
+  // Check for Boot Services leftovers in the map
   for(Piece = Global_Memory_Info.MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
   {
-    // Within each compatible EfiConventionalMemory, look for space
-    if((Piece->Type == EfiConventionalMemory) && (Piece->NumberOfPages >= pages) && (Piece->VirtualStart >= OldAddress))
+    if((Piece->Type == EfiBootServicesCode) || (Piece->Type == EfiBootServicesData))
     {
-      break;
+      memmap_set_type(Piece, EfiConventionalMemory); // Convert to EfiConventionalMemory
     }
   }
+  // Done.
 
-  // Loop ended without a DiscoveredAddress
-  if(Piece >= (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize))
+  MergeContiguousConventionalMemory();
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  ReclaimEfiLoaderCodeMemory: Convert EfiLoaderCode to EfiConventionalMemory
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// After calling ExitBootServices(), it is up to the OS to decide what to do with EfiLoaderCode (and EfiLoaderData, though that's
+// used to store all the Loader Params that this kernel actively uses). This function reclaims that memory as free.
+//
+// Calling this function more than once won't do anything other than just waste some CPU time.
+//
+
+void ReclaimEfiLoaderCodeMemory(void)
+{
+  EFI_MEMORY_DESCRIPTOR * Piece;
+
+  // Check for Loader Code (the boot loader that booted this kernel) leftovers in the map
+  for(Piece = Global_Memory_Info.MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
   {
-    // Return address -1, which will cause AllocatePages to fail
-#ifdef MEMORY_CHECK_INFO
-    printf("No more free virtual addresses...\r\n");
-#endif
-    return ~0ULL;
+    if(Piece->Type == EfiLoaderCode)
+    {
+      memmap_set_type(Piece, EfiConventionalMemory); // Convert to EfiConventionalMemory
+    }
   }
+  // Done.
 
-  return Piece->VirtualStart;
+  MergeContiguousConventionalMemory();
 }
 
 //----------------------------------------------------------------------------------------------------------------------------------
-//  VActuallyFreeAddressByPage: Find A Free Virtual Memory Address, Bottom-Up, The Hard Way
+//  MergeContiguousConventionalMemory: Merge Adjacent EfiConventionalMemory Entries
 //----------------------------------------------------------------------------------------------------------------------------------
 //
-// Returns the next 4kB page address marked as available (EfiConventionalMemory) that is > the supplied OldAddress.
+// Merge adjacent EfiConventionalMemory locations that are listed as separate entries. This can only work with physical addresses.
+// It's main uses are during calls to free() and Setup_MemMap(), where this function acts to clean up the memory map.
 //
-// pages: number of pages needed
-// OldAddress: An baseline address to search bottom-up from
+// The map is sorted by Setup_MemMap(), so this is a single pass that packs the map down as it goes.
+//
+// This function also contains the logic necessary to shrink the memory map's own descriptor to reclaim extra space.
 //
 
-EFI_VIRTUAL_ADDRESS VActuallyFreeAddressByPage(size_t pages, EFI_VIRTUAL_ADDRESS OldAddress)
+void MergeContiguousConventionalMemory(void)
 {
-//  EFI_STATUS memmap_status;
   EFI_MEMORY_DESCRIPTOR * Piece;
-  EFI_VIRTUAL_ADDRESS VirtualEnd;
-  EFI_VIRTUAL_ADDRESS DiscoveredAddress;
+  EFI_MEMORY_DESCRIPTOR * Merged;
+  EFI_MEMORY_DESCRIPTOR * MemMapEnd = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize);
+  size_t numpages = 1;
 
-  // Multiply NumberOfPages by EFI_PAGE_SIZE to get the end address... which should just be the start of the next section.
-  // Check for EfiConventionalMemory in the map
-  for(Piece = Global_Memory_Info.MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
+  if(Global_Memory_Info.MemMapSize == 0)
   {
-    // Within each compatible EfiConventionalMemory, look for space
-    if((Piece->Type == EfiConventionalMemory) && (Piece->NumberOfPages >= pages))
+    return;
+  }
+
+  // The map is sorted, so mergeable entries are always next to each other. Merged is the last entry that's being kept, and entries
+  // that don't get merged into it are packed in right after it.
+  Merged = Global_Memory_Info.MemMap;
+  if(Merged->Type == EfiMaxMemoryType + 3)
+  { // Get the reported size of the memmap, we'll need it later to see if free space can be reclaimed
+    numpages = Merged->NumberOfPages;
+  }
+
+  for(Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Merged + Global_Memory_Info.MemMapDescriptorSize); Piece < MemMapEnd; Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
+  {
+    if((Merged->Type == EfiConventionalMemory) && (Piece->Type == EfiConventionalMemory) && ((Merged->PhysicalStart + (Merged->NumberOfPages << EFI_PAGE_SHIFT)) == Piece->PhysicalStart))
     {
-      VirtualEnd = Piece->VirtualStart + (Piece->NumberOfPages << EFI_PAGE_SHIFT) - 1; // Get the end of this range
-      // (pages*EFI_PAGE_SIZE) or (pages << EFI_PAGE_SHIFT) gives the size the kernel would take up in memory
-      if((OldAddress >= Piece->VirtualStart) && ((OldAddress + (pages << EFI_PAGE_SHIFT)) < VirtualEnd)) // Bounds check on OldAddress
+      // Add this entry's pages to Merged and drop this entry.
+      Merged->NumberOfPages += Piece->NumberOfPages;
+    }
+    else
+    {
+      Merged = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Merged + Global_Memory_Info.MemMapDescriptorSize);
+      if(Merged != Piece)
       {
-        // Return the next available page's address in the range. We need to go page-by-page for the really buggy systems.
-        DiscoveredAddress = OldAddress + EFI_PAGE_SIZE; // Left shift EFI_PAGE_SIZE by 1 or 2 to check every 0x10 or 0x100 pages (must also modify the above VirtualEnd bound check)
-        break;
-        // If VirtualEnd == OldAddress, we need to go to the next EfiConventionalMemory range
+        AVX_memmove(Merged, Piece, Global_Memory_Info.MemMapDescriptorSize);
       }
-      else if(Piece->VirtualStart > OldAddress) // Try a new range
+
+      if(Merged->Type == EfiMaxMemoryType + 3)
       {
-        DiscoveredAddress = Piece->VirtualStart;
-        break;
+        numpages = Merged->NumberOfPages;
       }
     }
   }
 
-  // Loop ended without a DiscoveredAddress
-  if(Piece >= (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize))
+  // Update Global_Memory_Info and zero out the entries that used to be at the end
+  size_t merged_size = ((uint8_t*)Merged + Global_Memory_Info.MemMapDescriptorSize) - (uint8_t*)Global_Memory_Info.MemMap;
+  AVX_memset((uint8_t*)Global_Memory_Info.MemMap + merged_size, 0, Global_Memory_Info.MemMapSize - merged_size);
+  Global_Memory_Info.MemMapSize = merged_size;
+
+  size_t numpages2 = (Global_Memory_Info.MemMapSize + EFI_PAGE_MASK) >> EFI_PAGE_SHIFT; // How much space does the new map take?
+
+  // After all that, maybe some space can be reclaimed. Let's see what we can do...
+  if(numpages2 < numpages)
   {
-    // Return address -1, which will cause AllocatePages to fail
-#ifdef MEMORY_CHECK_INFO
-    printf("No more free virtual addresses by 4kB page...\r\n");
-#endif
-    return ~0ULL;
+    // Re-find memmap entry, since the memmap layout has changed.
+    for(Piece = Global_Memory_Info.MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
+    {
+      if(Piece->Type == EfiMaxMemoryType + 3) // Found it.
+      {
+        // Is the next piece an EfiConventionalMemory type?
+        if( ((EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))->Type == EfiConventionalMemory ) // Remember... sizeof(EFI_MEMORY_DESCRIPTOR) != MemMapDescriptorSize :/
+        { // Yes, we can reclaim without requiring a new entry
+          size_t freedpages = numpages - numpages2;
+
+          // Modify MemMap's entry
+          Piece->NumberOfPages = numpages2;
+          memmap_move_pages(Piece->Type, EfiConventionalMemory, freedpages);
+
+          // Modify adjacent EfiConventionalMemory's entry
+          ((EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))->NumberOfPages += freedpages;
+          ((EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))->PhysicalStart -= (freedpages << EFI_PAGE_SHIFT);
+          ((EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))->VirtualStart -= (freedpages << EFI_PAGE_SHIFT);
+
+          // Done. Nice.
+        }
+        // No, we need a new entry, which will require a new page if the last entry is on a page edge or would spill over a page edge. Better to be safe then sorry!
+        // First, maybe there's room for another descriptor in the last page
+        else if((Global_Memory_Info.MemMapSize + Global_Memory_Info.MemMapDescriptorSize) <= (numpages2 << EFI_PAGE_SHIFT))
+        { // Yes, we can reclaim and fit in another descriptor
+
+          // Make a temporary descriptor to hold current MemMap entry's values
+          EFI_MEMORY_DESCRIPTOR new_descriptor_temp;
+          new_descriptor_temp.Type = Piece->Type; // Special memmap type
+          new_descriptor_temp.Pad = Piece->Pad;
+          new_descriptor_temp.PhysicalStart = Piece->PhysicalStart;
+          new_descriptor_temp.VirtualStart = Piece->VirtualStart;
+          new_descriptor_temp.NumberOfPages = numpages2; // New size of MemMap entry
+          new_descriptor_temp.Attribute = Piece->Attribute;
+
+          // Modify the descriptor-to-move
+          Piece->Type = EfiConventionalMemory;
+          // No pad change
+          Piece->PhysicalStart += (numpages2 << EFI_PAGE_SHIFT);
+          Piece->VirtualStart += (numpages2 << EFI_PAGE_SHIFT);
+          Piece->NumberOfPages = numpages - numpages2;
+          // No attribute change
+
+          // Move (copy) the whole memmap that's above this piece (including this freshly modified piece) from this piece to one MemMapDescriptorSize over
+          AVX_memmove((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize, Piece, ((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize) - (uint8_t*)Piece); // Pointer math to get size
+
+          // Insert the new piece (by overwriting the now-duplicated entry with new values)
+          // I.e. turn this piece into what was stored in the temporary descriptor above
+          Piece->Type = new_descriptor_temp.Type;
+          Piece->Pad = new_descriptor_temp.Pad;
+          Piece->PhysicalStart = new_descriptor_temp.PhysicalStart;
+          Piece->VirtualStart = new_descriptor_temp.VirtualStart;
+          Piece->NumberOfPages = new_descriptor_temp.NumberOfPages;
+          Piece->Attribute = new_descriptor_temp.Attribute;
+
+          // Update Global_Memory_Info MemMap size
+          Global_Memory_Info.MemMapSize += Global_Memory_Info.MemMapDescriptorSize;
+
+          memmap_move_pages(Piece->Type, EfiConventionalMemory, numpages - numpages2);
+
+          // Done
+        }
+        // No, it would spill over to a new page
+        else // MemMap is always put at the base of an EfiConventionalMemory region after Setup_MemMap
+        {
+          // Do we have more than a descriptor's worth of pages reclaimable?
+          size_t pages_per_memory_descriptor = (Global_Memory_Info.MemMapDescriptorSize + EFI_PAGE_MASK) >> EFI_PAGE_SHIFT;
+
+          if((numpages2 + pages_per_memory_descriptor) < numpages)
+          { // Yes, so we can hang on to one [set] of them and make a new EfiConventionalMemory entry for the rest.
+            size_t freedpages = numpages - numpages2 - pages_per_memory_descriptor;
+
+            // Make a temporary descriptor to hold current MemMap entry's values
+            EFI_MEMORY_DESCRIPTOR new_descriptor_temp;
+            new_descriptor_temp.Type = Piece->Type; // Special memmap type
+            new_descriptor_temp.Pad = Piece->Pad;
+            new_descriptor_temp.PhysicalStart = Piece->PhysicalStart;
+            new_descriptor_temp.VirtualStart = Piece->VirtualStart;
+            new_descriptor_temp.NumberOfPages = numpages2 + pages_per_memory_descriptor; // New size of MemMap entry
+            new_descriptor_temp.Attribute = Piece->Attribute;
+
+            // Modify the descriptor-to-move
+            Piece->Type = EfiConventionalMemory;
+            // No pad change
+            Piece->PhysicalStart += ((numpages2 + pages_per_memory_descriptor) << EFI_PAGE_SHIFT);
+            Piece->VirtualStart += ((numpages2 + pages_per_memory_descriptor) << EFI_PAGE_SHIFT);
+            Piece->NumberOfPages = freedpages;
+            // No attribute change
+
+            // Move (copy) the whole memmap that's above this piece (including this freshly modified piece) from this piece to one MemMapDescriptorSize over
+            AVX_memmove((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize, Piece, ((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize) - (uint8_t*)Piece); // Pointer math to get size
+
+            // Insert the new piece (by overwriting the now-duplicated entry with new values)
+            // I.e. turn this piece into what was stored in the temporary descriptor above
+            Piece->Type = new_descriptor_temp.Type;
+            Piece->Pad = new_descriptor_temp.Pad;
+            Piece->PhysicalStart = new_descriptor_temp.PhysicalStart;
+            Piece->VirtualStart = new_descriptor_temp.VirtualStart;
+            Piece->NumberOfPages = new_descriptor_temp.NumberOfPages;
+            Piece->Attribute = new_descriptor_temp.Attribute;
+
+            // Update Global_Memory_Info MemMap size
+            Global_Memory_Info.MemMapSize += Global_Memory_Info.MemMapDescriptorSize;
+
+            memmap_move_pages(Piece->Type, EfiConventionalMemory, freedpages);
+          }
+          // No, only 1 [set of] page(s) was reclaimable and adding another entry would spill over. So don't do anything then and hang on to the extra empty page(s).
+        }
+        // All done. There's only one MemMap entry so we can break out of the loop now.
+        break;
+      }
+    }
   }
 
-  return DiscoveredAddress;
+  // Done
 }
 
 //----------------------------------------------------------------------------------------------------------------------------------
-//  VAllocateFreeAddressByPage: Allocate A Free Virtual Memory Address, Bottom-Up, The Hard Way
+//  ZeroAllConventionalMemory: Zero Out ALL EfiConventionalMemory
 //----------------------------------------------------------------------------------------------------------------------------------
 //
-// Returns the next 4kB page address marked as available (EfiConventionalMemory) that is > the supplied OldAddress.
+// This function goes through the memory map and zeroes out all EfiConventionalMemory areas, as well as all free memory in the page
+// allocator (see BuddyZeroFreePages()). Returns 0 on success, else returns the base physical address of the last region that could
+// not be completely zeroed.
 //
-// pages: number of pages needed
-// OldAddress: An baseline address to search bottom-up from
+// Zeroing uses streaming stores spread across all idle CPUs (see ZeroMemoryRange()), and everything gets read back afterwards to
+// check that it worked unless the "noverify" kernel option is set. Progress is printed every 10%.
+//
+// USE WITH CAUTION!!
+// Firmware bugs like this could really cause problems with this function: https://mjg59.dreamwidth.org/11235.html
+//
+// Also, buggy firmware that uses Boot Service memory when invoking runtime services will fail to work after this function if
+// ReclaimEfiBootServicesMemory() has been used beforehand.
 //
 
-EFI_VIRTUAL_ADDRESS VAllocateFreeAddressByPage(size_t pages, EFI_VIRTUAL_ADDRESS OldAddress)
+EFI_PHYSICAL_ADDRESS ZeroAllConventionalMemory(void)
 {
-//  EFI_STATUS memmap_status;
   EFI_MEMORY_DESCRIPTOR * Piece;
-  EFI_VIRTUAL_ADDRESS VirtualEnd;
-  EFI_VIRTUAL_ADDRESS DiscoveredAddress;
+  EFI_PHYSICAL_ADDRESS exit_value = 0;
+  uint8_t verify = !Global_Kernel_Options.No_Zero_Verify;
+  uint64_t total = GetFreeSystemRam();
 
-  // Multiply NumberOfPages by EFI_PAGE_SIZE to get the end address... which should just be the start of the next section.
-  // Check for EfiConventionalMemory in the map
+  zero_progress_start(total);
+
+  // Check for EfiConventionalMemory
   for(Piece = Global_Memory_Info.MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
   {
-    // Within each compatible EfiConventionalMemory, look for space
-    if((Piece->Type == EfiConventionalMemory) && (Piece->NumberOfPages >= pages))
+    if(Piece->Type == EfiConventionalMemory)
     {
-      VirtualEnd = Piece->VirtualStart + (Piece->NumberOfPages << EFI_PAGE_SHIFT) - 1; // Get the end of this range
-      // (pages*EFI_PAGE_SIZE) or (pages << EFI_PAGE_SHIFT) gives the size the kernel would take up in memory
-      if((OldAddress >= Piece->VirtualStart) && ((OldAddress + (pages << EFI_PAGE_SHIFT)) < VirtualEnd)) // Bounds check on OldAddress
-      {
-        // Return the next available page's address in the range. We need to go page-by-page for the really buggy systems.
-        DiscoveredAddress = OldAddress + EFI_PAGE_SIZE; // Left shift EFI_PAGE_SIZE by 1 or 2 to check every 0x10 or 0x100 pages (must also modify the above VirtualEnd bound check)
-        break;
-        // If VirtualEnd == OldAddress, we need to go to the next EfiConventionalMemory range
-      }
-      else if(Piece->VirtualStart > OldAddress) // Try a new range
+      if(ZeroMemoryRange(Piece->PhysicalStart, EFI_PAGES_TO_SIZE(Piece->NumberOfPages), verify))
       {
-        DiscoveredAddress = Piece->VirtualStart;
-        break;
+        printf("Area Not Zeroed! Base Physical Address: %#qx, Pages: %llu\r\n", Piece->PhysicalStart, Piece->NumberOfPages);
+        exit_value = Piece->PhysicalStart;
       }
+      zero_progress(EFI_PAGES_TO_SIZE(Piece->NumberOfPages));
     }
   }
 
-  // Loop ended without a DiscoveredAddress
-  if(Piece >= (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize))
+  // Free memory that's in the page allocator counts, too
+  if(Page_Allocator_Ready())
   {
-    // Return address -1, which will cause AllocatePages to fail
-#ifdef MEMORY_CHECK_INFO
-    printf("No more free virtual addresses by 4kB page...\r\n");
-#endif
-    return ~0ULL;
+    EFI_PHYSICAL_ADDRESS pool_exit_value = BuddyZeroFreePages(verify);
+    if(pool_exit_value)
+    {
+      exit_value = pool_exit_value;
+    }
   }
 
-  return DiscoveredAddress;
+  printf("Zeroed %llu MB of free memory with %llu CPU(s)%s\r\n", total >> 20, (Global_SMP_Info.Online_CPUs > 1) ? Global_SMP_Info.Online_CPUs : 1ULL, verify ? "." : ", not verified (noverify).");
+
+  // Done.
+  return exit_value;
 }
 
 //----------------------------------------------------------------------------------------------------------------------------------
-//  VAllocateFreeAddressBy16Bytes: Allocate A Free Virtual Memory Address, Bottom-Up, 16-Byte Aligned
+//  ZeroMemoryRange: Zero a Physical Memory Range with All CPUs
 //----------------------------------------------------------------------------------------------------------------------------------
 //
-// Returns the next 16-byte aligned address marked as available (EfiConventionalMemory) that is > the supplied OldAddress.
-//
-// numbytes: total number of bytes needed
-// OldAddress: An baseline address to search bottom-up from
+// Zero 'size' bytes at 'base' with streaming stores, splitting the work across every idle CPU with bulk_fill_async() if the range is
+// big enough to be worth waking them up for. 'base' and 'size' both need to be multiples of 64 bytes. If 'verify' is 1, each CPU
+// reads its own part back afterwards. Returns 0 on success, else the base address of a part that didn't read back as all zeroes.
 //
 
-EFI_VIRTUAL_ADDRESS VAllocateFreeAddressBy16Bytes(size_t numbytes, EFI_VIRTUAL_ADDRESS OldAddress)
+EFI_PHYSICAL_ADDRESS ZeroMemoryRange(EFI_PHYSICAL_ADDRESS base, uint64_t size, uint8_t verify)
 {
-//  EFI_STATUS memmap_status;
-  EFI_MEMORY_DESCRIPTOR * Piece;
-  EFI_VIRTUAL_ADDRESS VirtualEnd;
-  EFI_VIRTUAL_ADDRESS DiscoveredAddress;
-  size_t num_16_bytes = numbytes >> 4;
-  if(numbytes & 0xF)
-  { // This might "waste" up to 15 bytes, but alignment makes it worthwhile.
-    num_16_bytes++;
+  BULK_HANDLE handle;
+
+  bulk_fill_async(&handle, (void*)base, 0, size, BULK_STREAM | (verify ? BULK_VERIFY : 0));
+  return bulk_wait(&handle);
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  StartBackgroundZeroing: Zero Free Memory Lazily
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// The alternative to ZeroAllConventionalMemory() at boot: start a task that keeps calling BuddyZeroDirtyPages() a few MB at a time,
+// yielding in between and sleeping while there's nothing dirty left. It runs on an AP in the background if there are task workers
+// (the "workers=N" kernel option), or on the BSP whenever kernel_main() yields or waits otherwise. Either way, boot doesn't have to
+// wait for all of RAM to be zeroed, and malloc4k_zeroed() just zeroes its own pages until the clean pool catches up.
+//
+// Only page allocator memory gets zeroed this way, not EfiConventionalMemory below 1MB. Returns 1 if the task is running (including
+// from an earlier call), 0 if it couldn't be started.
+//
+// Requires: Setup_Scheduler() and Setup_Page_Allocator()
+//
+
+#define ZERO_BACKGROUND_PAGES 1024 // 4MB per Task_Yield()
+#define ZERO_BACKGROUND_IDLE_US 100000 // How long to sleep when everything's clean
+
+static TASK * zero_background = NULL;
+
+uint8_t StartBackgroundZeroing(void)
+{
+  if(zero_background != NULL)
+  {
+    return 1;
   }
 
-  // Multiply NumberOfPages by EFI_PAGE_SIZE to get the size of each piece... which should just give the start of the next section when added to VirtualStart.
-  for(Piece = Global_Memory_Info.MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
+  if(!Page_Allocator_Ready())
   {
-    // Check for EfiConventionalMemory in the map, and if it's big enough
-    if((Piece->Type == EfiConventionalMemory) && ((Piece->NumberOfPages << EFI_PAGE_SHIFT) >= num_16_bytes))
-    { // Found a range big enough.
-      // Get the end of this range for bounds checking
-      VirtualEnd = Piece->VirtualStart + (Piece->NumberOfPages << EFI_PAGE_SHIFT) - 1;
-      // num_x_bytes * x gives total size to allocate for array
-      if((OldAddress >= Piece->VirtualStart) && ((OldAddress + (num_16_bytes << 4)) < VirtualEnd)) // Bounds check on OldAddress
-      {
-        // OldAddress + offset is [still] in-bounds, so return the next available x-byte aligned address in the range.
-        DiscoveredAddress = OldAddress + num_16_bytes; // Left shift num_x_bytes by 1 or 2 to check every 0x10 or 0x100 sets of bytes (must also modify the above VirtualEnd bound check)
-        break;
-        // If we would run over VirtualEnd, we need to go to the next EfiConventionalMemory range
-      }
-      else if(Piece->VirtualStart > OldAddress) // Turns out the nearest compatible VirtualStart is > OldAddress. Use that, then.
-      {
-        DiscoveredAddress = Piece->VirtualStart;
-        break;
-      }
+    printf("StartBackgroundZeroing: The page allocator isn't set up.\r\n");
+    return 0;
+  }
+
+  zero_background = Task_Spawn(zero_background_task, NULL, 0);
+  if(zero_background == NULL)
+  {
+    printf("StartBackgroundZeroing: Couldn't start the zeroing task.\r\n");
+    return 0;
+  }
+
+  printf("Zeroing %llu MB of free memory in the background.\r\n", EFI_PAGES_TO_SIZE(BuddyFreePageCount() - BuddyCleanPageCount()) >> 20);
+  return 1;
+}
+
+// StartBackgroundZeroing()'s task, which never exits
+static void zero_background_task(void * arg)
+{
+  (void)arg;
+
+  for(;;)
+  {
+    if(BuddyZeroDirtyPages(ZERO_BACKGROUND_PAGES))
+    {
+      Task_Yield();
+    }
+    else
+    {
+      Task_Sleep_us(ZERO_BACKGROUND_IDLE_US);
     }
   }
+}
 
-  // Loop ended without a DiscoveredAddress
-  if(Piece >= (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize))
+// Progress reporting for ZeroAllConventionalMemory(): one line every 10%, instead of one per range
+static uint64_t zero_progress_total = 0;
+static uint64_t zero_progress_done = 0;
+static uint64_t zero_progress_next = 0;
+
+static void zero_progress_start(uint64_t total)
+{
+  zero_progress_total = total;
+  zero_progress_done = 0;
+  zero_progress_next = 10;
+}
+
+static void zero_progress(uint64_t bytes)
+{
+  if(zero_progress_total == 0)
   {
-    // Return address -1, which will cause AllocatePages to fail
-#ifdef MEMORY_CHECK_INFO
-    printf("No more free virtual addresses by 16 bytes...\r\n");
-#endif
-    return ~0ULL;
+    return;
   }
 
-  return DiscoveredAddress;
+  zero_progress_done += bytes;
+  uint64_t percent = zero_progress_done / ((zero_progress_total / 100) + 1);
+
+  if(percent >= zero_progress_next)
+  {
+    printf("Zeroing free memory... %llu%%\r\n", percent);
+    zero_progress_next = (percent - (percent % 10)) + 10;
+  }
 }
 
 //----------------------------------------------------------------------------------------------------------------------------------
-//  VAllocateFreeAddressBy32Bytes: Allocate A Free Virtual Memory Address, Bottom-Up, 32-Byte Aligned
+//  Page Allocator: Binary Buddy System for Physical Pages
 //----------------------------------------------------------------------------------------------------------------------------------
 //
-// Returns the next 32-byte aligned address marked as available (EfiConventionalMemory) that is > the supplied OldAddress.
+// Once Setup_Page_Allocator() has run, all EfiConventionalMemory at or above 1MB belongs to a binary buddy allocator instead of the
+// memory map. Free memory is kept as power-of-2 sized blocks of 4kB pages, from order 0 (4kB) up to BUDDY_MAX_ORDER (1GB), and each
+// block is aligned to its own size in physical memory. Every order has a doubly-linked free list whose links are stored in the first
+// 16 bytes of each free block, so allocating and freeing are O(number of orders) instead of a walk over the memory map.
 //
-// numbytes: total number of bytes needed
-// OldAddress: An baseline address to search bottom-up from
+// A block's buddy is the other half of the next-larger block it was split from, which is just frame ^ (1 << order). Whether the buddy
+// is free, and of the same order, is looked up in a frame map that has one byte per 4kB page of the pool's span: BUDDY_FRAME_FREE |
+// order on the first page of a free block, BUDDY_FRAME_SLAB on the first page of a slab (see "Slab Allocator" below), and 0 everywhere
+// else. The frame map has its own "PagePoolMap" memory map entry, and the
+// pool itself shows up as "PagePool" entries so that print_system_memmap() still shows where everything is.
+//
+// Memory below 1MB stays EfiConventionalMemory, since some things need it specifically (like the AP startup trampoline in SMP.c).
+//
+// On NUMA systems each node has its own set of free lists. Blocks never cross an SRAT memory range boundary (see buddy_span()), so
+// every free block is entirely on one node, and BuddyAllocatePages() picks which node's lists to take from (see NUMA.c).
+//
+// Free blocks are also either dirty (anything could be in them) or clean (all zeroes apart from the free list links), with separate
+// lists for each, and BUDDY_FRAME_CLEAN in the frame map for clean ones. Freed pages are always dirty. They get cleaned by
+// BuddyZeroFreePages() all at once, or a bit at a time by BuddyZeroDirtyPages() (see StartBackgroundZeroing()), and
+// BuddyAllocateZeroedPages() takes clean blocks first so that it usually has nothing to zero. Everything else takes dirty blocks
+// first to leave the clean ones for it.
+//
+// The free lists are shared by all CPUs, so they're protected by buddy_lock, an MCS lock (see Sync.c) so that CPUs waiting on it each
+// spin on their own node instead of all hammering one line. Frees don't wait for it, though: if it's held, BuddyFreePages() queues
+// the block on buddy_deferred_frees and returns, and whoever has the lock puts it back on the free lists before letting go.
+//
+
+#define BUDDY_MAX_ORDER 18 // 4kB << 18 = 1GB
+#define BUDDY_FRAME_FREE 0x80 // Frame map flag marking the first page of a free block, low bits hold the block's order
+#define BUDDY_FRAME_CLEAN 0x40 // Frame map flag marking a free block as all zeroes, apart from its free list links
+#define BUDDY_FRAME_SLAB 0x20 // Frame map flag marking an allocated block as a slab, so free() can tell before reading its header
+#define BUDDY_MIN_ADDRESS 0x100000 // 1MB
+#define BUDDY_ZERO_CHUNK_ORDER 9 // BuddyZeroDirtyPages() zeroes at most 2MB at a time, so buddy_lock is never held for long
+#define BUDDY_DEFERRED_FREES 256 // Frees that can be queued while buddy_lock is busy; must be a power of 2
+
+static BUDDY_FREE_BLOCK * buddy_free_lists[NUMA_MAX_NODES][2][BUDDY_MAX_ORDER + 1] = {{{NULL}}}; // [node][1 = clean][order]
+static uint64_t buddy_node_free_pages[NUMA_MAX_NODES] = {0};
+static uint64_t buddy_clean_pages = 0;
+static MCS_LOCK buddy_lock = {0};
+static MCS_NODE buddy_lock_nodes[MAX_CPUS] = {{0}}; // Indexed by CPU index; buddy_lock is never taken twice on one CPU
+static RING_SLOT buddy_deferred_slots[BUDDY_DEFERRED_FREES] = {{0}};
+static MPSC_RING buddy_deferred_frees = {0}; // Addresses of blocks BuddyFreePages() didn't wait for, with the page count in the block's first 8 bytes
+static uint8_t * buddy_frame_map = NULL; // NULL until Setup_Page_Allocator() is done
+static uint64_t buddy_base_frame = 0; // Page frame number (physical address >> 12) of the first page covered by the frame map
+static uint64_t buddy_frames = 0; // Number of pages covered by the frame map
+static uint64_t buddy_free_pages = 0;
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  Setup_Page_Allocator: Hand Free Memory to the Page Allocator
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Build the frame map and free lists from the EfiConventionalMemory above 1MB, and mark those areas as PagePool in the memory map. Run
+// this after ReclaimEfiBootServicesMemory() and ReclaimEfiLoaderCodeMemory() so that the reclaimed memory ends up in the pool, too,
+// and after Setup_NUMA() so that it lands on the right nodes.
 //
 
-EFI_VIRTUAL_ADDRESS VAllocateFreeAddressBy32Bytes(size_t numbytes, EFI_VIRTUAL_ADDRESS OldAddress)
+void Setup_Page_Allocator(void)
 {
-//  EFI_STATUS memmap_status;
   EFI_MEMORY_DESCRIPTOR * Piece;
-  EFI_VIRTUAL_ADDRESS VirtualEnd;
-  EFI_VIRTUAL_ADDRESS DiscoveredAddress;
-  size_t num_32_bytes = numbytes >> 5;
-  if(numbytes & 0x1F)
-  { // This might "waste" up to 31 bytes, but alignment makes it worthwhile.
-    num_32_bytes++;
+  uint64_t first_frame = ~0ULL;
+  uint64_t last_frame = 0;
+
+  if(Page_Allocator_Ready())
+  {
+    return;
   }
 
-  // Multiply NumberOfPages by EFI_PAGE_SIZE to get the size of each piece... which should just give the start of the next section when added to VirtualStart.
+  // Find the span of EfiConventionalMemory above 1MB
   for(Piece = Global_Memory_Info.MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
   {
-    // Check for EfiConventionalMemory in the map, and if it's big enough
-    if((Piece->Type == EfiConventionalMemory) && ((Piece->NumberOfPages << EFI_PAGE_SHIFT) >= num_32_bytes))
-    { // Found a range big enough.
-      // Get the end of this range for bounds checking
-      VirtualEnd = Piece->VirtualStart + (Piece->NumberOfPages << EFI_PAGE_SHIFT) - 1;
-      // num_x_bytes * x gives total size to allocate for array
-      if((OldAddress >= Piece->VirtualStart) && ((OldAddress + (num_32_bytes << 5)) < VirtualEnd)) // Bounds check on OldAddress
+    if((Piece->Type == EfiConventionalMemory) && (Piece->PhysicalStart >= BUDDY_MIN_ADDRESS))
+    {
+      uint64_t start_frame = Piece->PhysicalStart >> EFI_PAGE_SHIFT;
+
+      if(start_frame < first_frame)
       {
-        // OldAddress + offset is [still] in-bounds, so return the next available x-byte aligned address in the range.
-        DiscoveredAddress = OldAddress + num_32_bytes; // Left shift num_x_bytes by 1 or 2 to check every 0x10 or 0x100 sets of bytes (must also modify the above VirtualEnd bound check)
-        break;
-        // If we would run over VirtualEnd, we need to go to the next EfiConventionalMemory range
+        first_frame = start_frame;
       }
-      else if(Piece->VirtualStart > OldAddress) // Turns out the nearest compatible VirtualStart is > OldAddress. Use that, then.
+      if((start_frame + Piece->NumberOfPages) > last_frame)
       {
-        DiscoveredAddress = Piece->VirtualStart;
-        break;
+        last_frame = start_frame + Piece->NumberOfPages;
       }
     }
   }
 
-  // Loop ended without a DiscoveredAddress
-  if(Piece >= (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize))
+  if(first_frame == ~0ULL)
   {
-    // Return address -1, which will cause AllocatePages to fail
-#ifdef MEMORY_CHECK_INFO
-    printf("No more free virtual addresses by 32 bytes...\r\n");
-#endif
-    return ~0ULL;
+    printf("Setup_Page_Allocator: No EfiConventionalMemory above 1MB.\r\n");
+    return;
   }
 
-  return DiscoveredAddress;
+  // One byte per page, comes pre-zeroed
+  EFI_PHYSICAL_ADDRESS frame_map_address = claim_conventional_pages(EFI_SIZE_TO_PAGES(last_frame - first_frame), EfiMaxMemoryType + 6, BUDDY_MIN_ADDRESS); // Special PagePoolMap type
+  if(frame_map_address == ~0ULL)
+  {
+    printf("Setup_Page_Allocator: Not enough space for the frame map.\r\n");
+    return;
+  }
+
+  MPSC_Init(&buddy_deferred_frees, buddy_deferred_slots, BUDDY_DEFERRED_FREES);
+
+  buddy_frame_map = (uint8_t*)frame_map_address;
+  buddy_base_frame = first_frame;
+  buddy_frames = last_frame - first_frame;
+
+  // Now move everything that's left over into the pool
+  for(Piece = Global_Memory_Info.MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
+  {
+    if((Piece->Type == EfiConventionalMemory) && (Piece->PhysicalStart >= BUDDY_MIN_ADDRESS))
+    {
+      memmap_set_type(Piece, EfiMaxMemoryType + 5); // Special PagePool type
+      buddy_free_range(Piece->PhysicalStart >> EFI_PAGE_SHIFT, Piece->NumberOfPages, 0);
+    }
+  }
 }
 
 //----------------------------------------------------------------------------------------------------------------------------------
-//  VAllocateFreeAddressBy64Bytes: Allocate A Free Virtual Memory Address, Bottom-Up, 64-Byte Aligned
+//  Page_Allocator_Ready: Check if the Page Allocator Is Set Up
 //----------------------------------------------------------------------------------------------------------------------------------
 //
-// Returns the next 64-byte aligned address marked as available (EfiConventionalMemory) that is > the supplied OldAddress.
+// Returns 1 once Setup_Page_Allocator() has succeeded, 0 before then.
 //
-// numbytes: total number of bytes needed
-// OldAddress: An baseline address to search bottom-up from
+
+uint8_t Page_Allocator_Ready(void)
+{
+  return (buddy_frame_map != NULL);
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  BuddyAllocatePages: Allocate Physical Pages from the Page Allocator
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Returns the 4kB-aligned physical address of 'pages' contiguous pages, or ~0ULL if there's no room. Requests get rounded up to a
+// power of 2 internally, but the unused pages at the end are given right back, so no memory is lost to rounding. A single allocation
+// can be at most 1GB (2^BUDDY_MAX_ORDER pages).
+//
+// Pages come from the calling CPU's NUMA node if it has room, or from the next node in turn if the CPU's policy is
+// NUMA_POLICY_INTERLEAVE (see NUMA_Set_Policy()). Otherwise the other nodes are tried from closest to farthest.
+//
+// pages: number of pages needed
+// OldAddress: Only return blocks at or above this address, or pass 0 to take whatever block is on hand (fastest)
 //
 
-EFI_VIRTUAL_ADDRESS VAllocateFreeAddressBy64Bytes(size_t numbytes, EFI_VIRTUAL_ADDRESS OldAddress)
+EFI_PHYSICAL_ADDRESS BuddyAllocatePages(size_t pages, EFI_PHYSICAL_ADDRESS OldAddress)
 {
-//  EFI_STATUS memmap_status;
-  EFI_MEMORY_DESCRIPTOR * Piece;
-  EFI_VIRTUAL_ADDRESS VirtualEnd;
-  EFI_VIRTUAL_ADDRESS DiscoveredAddress;
-  size_t num_64_bytes = numbytes >> 6;
-  if(numbytes & 0x3F)
-  { // This might "waste" up to 63 bytes, but alignment makes it worthwhile.
-    num_64_bytes++;
+  return buddy_allocate(pages, OldAddress, NUMA_NO_NODE, 0);
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  BuddyAllocateZeroedPages: Allocate Zeroed Physical Pages from the Page Allocator
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Same as BuddyAllocatePages(), except that the pages are all zeroes. Clean blocks are taken first, which only need their free list
+// links cleared, and a dirty block only gets zeroed (with bulk_fill(), so big ones are split across idle CPUs) when a node has no clean
+// block big enough.
+//
+
+EFI_PHYSICAL_ADDRESS BuddyAllocateZeroedPages(size_t pages, EFI_PHYSICAL_ADDRESS OldAddress)
+{
+  return buddy_allocate(pages, OldAddress, NUMA_NO_NODE, 1);
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  BuddyFreePages: Return Physical Pages to the Page Allocator
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Free 'pages' pages starting at 'address'. The range doesn't have to be something BuddyAllocatePages() returned in one go: it gets
+// split into aligned blocks, and each one is merged with its buddy as far up as possible.
+//
+
+void BuddyFreePages(EFI_PHYSICAL_ADDRESS address, size_t pages)
+{
+  uint64_t frame = address >> EFI_PAGE_SHIFT;
+
+  if((!Page_Allocator_Ready()) || (pages == 0))
+  {
+    return;
   }
 
-  // Multiply NumberOfPages by EFI_PAGE_SIZE to get the size of each piece... which should just give the start of the next section when added to VirtualStart.
-  for(Piece = Global_Memory_Info.MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
+  if((address & EFI_PAGE_MASK) || (frame < buddy_base_frame) || ((frame + pages) > (buddy_base_frame + buddy_frames)))
   {
-    // Check for EfiConventionalMemory in the map, and if it's big enough
-    if((Piece->Type == EfiConventionalMemory) && ((Piece->NumberOfPages << EFI_PAGE_SHIFT) >= num_64_bytes))
-    { // Found a range big enough.
-      // Get the end of this range for bounds checking
-      VirtualEnd = Piece->VirtualStart + (Piece->NumberOfPages << EFI_PAGE_SHIFT) - 1;
-      // num_x_bytes * x gives total size to allocate for array
-      if((OldAddress >= Piece->VirtualStart) && ((OldAddress + (num_64_bytes << 6)) < VirtualEnd)) // Bounds check on OldAddress
-      {
-        // OldAddress + offset is [still] in-bounds, so return the next available x-byte aligned address in the range.
-        DiscoveredAddress = OldAddress + num_64_bytes; // Left shift num_x_bytes by 1 or 2 to check every 0x10 or 0x100 sets of bytes (must also modify the above VirtualEnd bound check)
-        break;
-        // If we would run over VirtualEnd, we need to go to the next EfiConventionalMemory range
-      }
-      else if(Piece->VirtualStart > OldAddress) // Turns out the nearest compatible VirtualStart is > OldAddress. Use that, then.
+    printf("BuddyFreePages: %#qx (%llu pages) is not in the page pool.\r\n", address, pages);
+    return;
+  }
+
+  if(!buddy_lock_try())
+  {
+    // Leave it for whoever has the lock rather than waiting. Checking the frame map without the lock is fine here: if this block is
+    // allocated, nobody else can be freeing it, and if it's free, writing the page count into it would wreck its free list links.
+    if(!(__atomic_load_n(&buddy_frame_map[frame - buddy_base_frame], __ATOMIC_RELAXED) & BUDDY_FRAME_FREE))
+    {
+      *(uint64_t*)address = pages;
+      if(MPSC_Push(&buddy_deferred_frees, address))
       {
-        DiscoveredAddress = Piece->VirtualStart;
-        break;
+        // The holder might have let go before the push landed, in which case the queue needs draining here
+        if(buddy_lock_try())
+        {
+          buddy_lock_release();
+        }
+        return;
       }
     }
+
+    buddy_lock_take(); // Queue's full (or it's a double free, which gets reported below)
   }
 
-  // Loop ended without a DiscoveredAddress
-  if(Piece >= (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize))
+  if(buddy_frame_map[frame - buddy_base_frame] & BUDDY_FRAME_FREE)
   {
-    // Return address -1, which will cause AllocatePages to fail
-#ifdef MEMORY_CHECK_INFO
-    printf("No more free virtual addresses by 64 bytes...\r\n");
-#endif
-    return ~0ULL;
+    buddy_lock_release();
+    printf("BuddyFreePages: %#qx is already free.\r\n", address);
+    return;
   }
 
-  return DiscoveredAddress;
+  buddy_free_range(frame, pages, 0);
+
+  buddy_lock_release();
 }
 
 //----------------------------------------------------------------------------------------------------------------------------------
-//  ReclaimEfiBootServicesMemory: Convert EfiBootServicesCode and EfiBootServicesData to EfiConventionalMemory
+//  BuddyFindFreePages: Find Free Physical Pages in the Page Allocator
 //----------------------------------------------------------------------------------------------------------------------------------
 //
-// After calling ExitBootServices(), EfiBootServicesCode and EfiBootServicesData are supposed to become free memory. This is not
-// always the case (see: https://mjg59.dreamwidth.org/11235.html), but this function exists because the UEFI Specification (2.7A)
-// states that it really should be free.
-//
-// Calling this function more than once won't do anything other than just waste some CPU time.
+// Returns the lowest address > OldAddress of a free block that can hold 'pages' pages, or ~0ULL if there isn't one. Nothing gets
+// allocated; this is the page allocator version of ActuallyFreeAddressByPage().
 //
 
-void ReclaimEfiBootServicesMemory(void)
+EFI_PHYSICAL_ADDRESS BuddyFindFreePages(size_t pages, EFI_PHYSICAL_ADDRESS OldAddress)
 {
-  EFI_MEMORY_DESCRIPTOR * Piece;
+  EFI_PHYSICAL_ADDRESS DiscoveredAddress = ~0ULL;
 
-  // Check for Boot Services leftovers in the map
-  for(Piece = Global_Memory_Info.MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
+  if((!Page_Allocator_Ready()) || (pages == 0))
   {
-    if((Piece->Type == EfiBootServicesCode) || (Piece->Type == EfiBootServicesData))
+    return ~0ULL;
+  }
+
+  buddy_lock_take();
+
+  for(uint64_t node = 0; node < Global_NUMA.Nodes; node++)
+  {
+    for(uint64_t clean = 0; clean <= 1; clean++)
     {
-      Piece->Type = EfiConventionalMemory; // Convert to EfiConventionalMemory
+      for(uint64_t order = buddy_order_for(pages); order <= BUDDY_MAX_ORDER; order++)
+      {
+        for(BUDDY_FREE_BLOCK * block = buddy_free_lists[node][clean][order]; block != NULL; block = block->Next)
+        {
+          if(((EFI_PHYSICAL_ADDRESS)block > OldAddress) && ((EFI_PHYSICAL_ADDRESS)block < DiscoveredAddress))
+          {
+            DiscoveredAddress = (EFI_PHYSICAL_ADDRESS)block;
+          }
+        }
+      }
     }
   }
-  // Done.
 
-  MergeContiguousConventionalMemory();
+  buddy_lock_release();
+
+  return DiscoveredAddress;
 }
 
 //----------------------------------------------------------------------------------------------------------------------------------
-//  ReclaimEfiLoaderCodeMemory: Convert EfiLoaderCode to EfiConventionalMemory
+//  BuddyFreePageCount: Number of Free Pages in the Page Allocator
 //----------------------------------------------------------------------------------------------------------------------------------
 //
-// After calling ExitBootServices(), it is up to the OS to decide what to do with EfiLoaderCode (and EfiLoaderData, though that's
-// used to store all the Loader Params that this kernel actively uses). This function reclaims that memory as free.
+// This is kept up to date on every allocation and free, so it costs nothing to call.
 //
-// Calling this function more than once won't do anything other than just waste some CPU time.
+
+uint64_t BuddyFreePageCount(void)
+{
+  return buddy_free_pages;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  BuddyFreeNodePageCount: Number of Free Pages on a NUMA Node
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Like BuddyFreePageCount(), but only counting one node's free lists. Returns 0 for nodes that don't exist.
 //
 
-void ReclaimEfiLoaderCodeMemory(void)
+uint64_t BuddyFreeNodePageCount(uint64_t node)
 {
-  EFI_MEMORY_DESCRIPTOR * Piece;
+  if(node >= NUMA_MAX_NODES)
+  {
+    return 0;
+  }
 
-  // Check for Loader Code (the boot loader that booted this kernel) leftovers in the map
-  for(Piece = Global_Memory_Info.MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
+  return buddy_node_free_pages[node];
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  BuddyCleanPageCount: Number of Already-Zeroed Free Pages in the Page Allocator
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// How many of BuddyFreePageCount()'s pages are in clean blocks, which BuddyAllocateZeroedPages() can hand out without zeroing them
+//
+
+uint64_t BuddyCleanPageCount(void)
+{
+  return buddy_clean_pages;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  malloc_node: Allocate Physical Memory on a NUMA Node
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Allocate 'numbytes' bytes, rounded up to whole 4kB pages, from one NUMA node's free memory only. Unlike malloc4k() there's no
+// falling back to other nodes, so this returns MALLOC_FAILED if the node doesn't have room (or doesn't exist). Give the memory back with
+// freepages(address, EFI_SIZE_TO_PAGES(numbytes)).
+//
+
+__attribute__((malloc)) void * malloc_node(size_t numbytes, uint64_t node)
+{
+  if(node >= Global_NUMA.Nodes)
   {
-    if(Piece->Type == EfiLoaderCode)
-    {
-      Piece->Type = EfiConventionalMemory; // Convert to EfiConventionalMemory
-    }
+    return MALLOC_FAILED;
   }
-  // Done.
 
-  MergeContiguousConventionalMemory();
+  return (void*)buddy_allocate(EFI_SIZE_TO_PAGES(numbytes), 0, node, 0);
 }
 
 //----------------------------------------------------------------------------------------------------------------------------------
-//  MergeContiguousConventionalMemory: Merge Adjacent EfiConventionalMemory Entries
+//  BuddyZeroFreePages: Zero Out All Free Page Allocator Memory
 //----------------------------------------------------------------------------------------------------------------------------------
 //
-// Merge adjacent EfiConventionalMemory locations that are listed as separate entries. This can only work with physical addresses.
-// It's main uses are during calls to free() and Setup_MemMap(), where this function acts to clean up the memory map.
+// The page allocator version of ZeroAllConventionalMemory(). Dirty blocks are taken off the free lists one at a time, zeroed with
+// ZeroMemoryRange() without holding buddy_lock, and put back clean, the same way BuddyZeroDirtyPages() does it. Other CPUs can keep
+// allocating and freeing the whole time.
+// Returns 0 on success, else returns the address of the last block that could not be zeroed.
 //
-// This function also contains the logic necessary to shrink the memory map's own descriptor to reclaim extra space.
+// verify: 1 to read the memory back afterwards, 0 to trust the stores
 //
 
-void MergeContiguousConventionalMemory(void)
+EFI_PHYSICAL_ADDRESS BuddyZeroFreePages(uint8_t verify)
 {
-  EFI_MEMORY_DESCRIPTOR * Piece;
-  EFI_MEMORY_DESCRIPTOR * Piece2;
-  EFI_PHYSICAL_ADDRESS PhysicalEnd;
-  size_t numpages = 1;
+  EFI_PHYSICAL_ADDRESS exit_value = 0;
+  BUDDY_FREE_BLOCK * failed_blocks = NULL; // Kept off the dirty lists until the end, so they don't get picked again
 
-  for(Piece = Global_Memory_Info.MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
+  // Clean blocks are already done
+  zero_progress(EFI_PAGES_TO_SIZE(__atomic_load_n(&buddy_clean_pages, __ATOMIC_RELAXED)));
+
+  for(uint64_t node = 0; node < Global_NUMA.Nodes; node++)
   {
-    // Within each EfiConventionalMemory, check adjacents
-    if(Piece->Type == EfiConventionalMemory)
+    for(uint64_t order = BUDDY_MAX_ORDER + 1; order > 0; )
     {
-      PhysicalEnd = Piece->PhysicalStart + (Piece->NumberOfPages << EFI_PAGE_SHIFT); // Get the end of this range, which may be the start of another range
-
-      // See if PhysicalEnd matches any PhysicalStart of EfiConventionalMemory
+      order--;
+      uint64_t block_size = EFI_PAGES_TO_SIZE(1ULL << order);
 
-      for(Piece2 = Global_Memory_Info.MemMap; Piece2 < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece2 = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece2 + Global_Memory_Info.MemMapDescriptorSize))
+      for(;;)
       {
-        if( (Piece2->Type == EfiConventionalMemory) && (PhysicalEnd == Piece2->PhysicalStart) )
+        buddy_lock_take();
+
+        BUDDY_FREE_BLOCK * block = buddy_free_lists[node][0][order];
+        if(block == NULL)
         {
-          // Found one.
-          // Add this entry's pages to Piece and delete this entry.
-          Piece->NumberOfPages += Piece2-> NumberOfPages;
+          buddy_lock_release();
+          break;
+        }
 
-          AVX_memset(Piece2, 0, Global_Memory_Info.MemMapDescriptorSize);
-          AVX_memmove(Piece2, (uint8_t*)Piece2 + Global_Memory_Info.MemMapDescriptorSize, ((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize) - ((uint8_t*)Piece2 + Global_Memory_Info.MemMapDescriptorSize));
+        uint64_t frame = (uint64_t)block >> EFI_PAGE_SHIFT;
+        buddy_list_remove(frame, order, node);
+        buddy_free_pages -= (1ULL << order);
+        buddy_node_free_pages[node] -= (1ULL << order);
 
-          // Update Global_Memory_Info
-          Global_Memory_Info.MemMapSize -= Global_Memory_Info.MemMapDescriptorSize;
+        buddy_lock_release();
 
-          // Zero out the entry that used to be at the end
-          AVX_memset((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize, 0, Global_Memory_Info.MemMapDescriptorSize);
+        if(ZeroMemoryRange((EFI_PHYSICAL_ADDRESS)block, block_size, verify))
+        {
+          printf("Area Not Zeroed! Base Physical Address: %#qx, Pages: %llu\r\n", (uint64_t)block, 1ULL << order);
+          exit_value = (EFI_PHYSICAL_ADDRESS)block;
 
-          // Decrement Piece2 one descriptor to check this one again, since after modification there may be more to merge
-          Piece2 = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece2 - Global_Memory_Info.MemMapDescriptorSize);
-          // Refresh PhysicalEnd with the new size
-          PhysicalEnd = Piece->PhysicalStart + (Piece->NumberOfPages << EFI_PAGE_SHIFT);
+          block->Prev = (BUDDY_FREE_BLOCK*)order; // Remembered for putting it back below
+          block->Next = failed_blocks;
+          failed_blocks = block;
         }
-      } // End inner for loop
-
-    }
-    else if(Piece->Type == EfiMaxMemoryType + 3)
-    { // Get the reported size of the memmap, we'll need it later to see if free space can be reclaimed
-      numpages = Piece->NumberOfPages;
+        else
+        {
+          buddy_lock_take();
+          buddy_free_range(frame, 1ULL << order, 1);
+          buddy_lock_release();
+        }
+        zero_progress(block_size);
+      }
     }
   }
 
-  size_t numpages2 = (Global_Memory_Info.MemMapSize + EFI_PAGE_MASK) >> EFI_PAGE_SHIFT; // How much space does the new map take?
+  // Whatever couldn't be zeroed goes back as dirty
+  while(failed_blocks != NULL)
+  {
+    BUDDY_FREE_BLOCK * block = failed_blocks;
+    uint64_t order = (uint64_t)block->Prev;
+    failed_blocks = block->Next;
 
-  // After all that, maybe some space can be reclaimed. Let's see what we can do...
-  if(numpages2 < numpages)
+    buddy_lock_take();
+    buddy_free_range((uint64_t)block >> EFI_PAGE_SHIFT, 1ULL << order, 0);
+    buddy_lock_release();
+  }
+
+  return exit_value;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  BuddyZeroDirtyPages: Zero Some Dirty Free Pages
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Zero up to 'max_pages' pages' worth of dirty free blocks and put them back as clean ones, for BuddyAllocateZeroedPages(). Blocks
+// are taken off the free lists while they're being zeroed, so other CPUs can keep allocating in the meantime. Dirty blocks on this
+// CPU's node go first. This can be called from any CPU, and is meant to be run whenever there's nothing better to do; see
+// StartBackgroundZeroing().
+//
+// Returns how many pages got zeroed: 0 means there were no dirty pages left.
+//
+
+uint64_t BuddyZeroDirtyPages(uint64_t max_pages)
+{
+  uint64_t zeroed = 0;
+
+  if(!Page_Allocator_Ready())
   {
-    // Re-find memmap entry, since the memmap layout has changed.
-    for(Piece = Global_Memory_Info.MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
+    return 0;
+  }
+
+  uint64_t local = (Global_NUMA.Nodes > 1) ? get_cpu_data()->NUMA_Node : 0;
+
+  while(zeroed < max_pages)
+  {
+    // Biggest chunk that fits in what's left
+    uint64_t want = 63 - __builtin_clzll(max_pages - zeroed);
+    if(want > BUDDY_ZERO_CHUNK_ORDER)
     {
-      if(Piece->Type == EfiMaxMemoryType + 3) // Found it.
+      want = BUDDY_ZERO_CHUNK_ORDER;
+    }
+
+    uint64_t frame = ~0ULL;
+    uint64_t order = 0;
+    uint64_t node = 0;
+
+    buddy_lock_take();
+
+    for(uint64_t attempt = 0; (attempt < Global_NUMA.Nodes) && (frame == ~0ULL); attempt++)
+    {
+      node = (Global_NUMA.Nodes > 1) ? Global_NUMA.Fallback[local][attempt] : 0;
+
+      // Smaller chunks if nothing dirty is that big
+      for(order = want + 1; (order > 0) && (frame == ~0ULL); )
       {
-        // Is the next piece an EfiConventionalMemory type?
-        if( ((EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))->Type == EfiConventionalMemory ) // Remember... sizeof(EFI_MEMORY_DESCRIPTOR) != MemMapDescriptorSize :/
-        { // Yes, we can reclaim without requiring a new entry
-          size_t freedpages = numpages - numpages2;
+        order--;
+        frame = buddy_alloc_block(order, 0, node, 0);
+      }
+    }
 
-          // Modify MemMap's entry
-          Piece->NumberOfPages = numpages2;
+    if(frame == ~0ULL)
+    {
+      buddy_lock_release();
+      break;
+    }
+    buddy_free_pages -= (1ULL << order);
+    buddy_node_free_pages[node] -= (1ULL << order);
 
-          // Modify adjacent EfiConventionalMemory's entry
-          ((EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))->NumberOfPages += freedpages;
-          ((EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))->PhysicalStart -= (freedpages << EFI_PAGE_SHIFT);
-          ((EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))->VirtualStart -= (freedpages << EFI_PAGE_SHIFT);
+    buddy_lock_release();
 
-          // Done. Nice.
-        }
-        // No, we need a new entry, which will require a new page if the last entry is on a page edge or would spill over a page edge. Better to be safe then sorry!
-        // First, maybe there's room for another descriptor in the last page
-        else if((Global_Memory_Info.MemMapSize + Global_Memory_Info.MemMapDescriptorSize) <= (numpages2 << EFI_PAGE_SHIFT))
-        { // Yes, we can reclaim and fit in another descriptor
+    memset_zeroes_as((void*)(frame << EFI_PAGE_SHIFT), EFI_PAGES_TO_SIZE(1ULL << order)); // Streaming stores, since nobody is about to read these
 
-          // Make a temporary descriptor to hold current MemMap entry's values
-          EFI_MEMORY_DESCRIPTOR new_descriptor_temp;
-          new_descriptor_temp.Type = Piece->Type; // Special memmap type
-          new_descriptor_temp.Pad = Piece->Pad;
-          new_descriptor_temp.PhysicalStart = Piece->PhysicalStart;
-          new_descriptor_temp.VirtualStart = Piece->VirtualStart;
-          new_descriptor_temp.NumberOfPages = numpages2; // New size of MemMap entry
-          new_descriptor_temp.Attribute = Piece->Attribute;
+    buddy_lock_take();
+    buddy_free_range(frame, 1ULL << order, 1);
+    buddy_lock_release();
 
-          // Modify the descriptor-to-move
-          Piece->Type = EfiConventionalMemory;
-          // No pad change
-          Piece->PhysicalStart += (numpages2 << EFI_PAGE_SHIFT);
-          Piece->VirtualStart += (numpages2 << EFI_PAGE_SHIFT);
-          Piece->NumberOfPages = numpages - numpages2;
-          // No attribute change
+    zeroed += (1ULL << order);
+  }
 
-          // Move (copy) the whole memmap that's above this piece (including this freshly modified piece) from this piece to one MemMapDescriptorSize over
-          AVX_memmove((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize, Piece, ((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize) - (uint8_t*)Piece); // Pointer math to get size
+  return zeroed;
+}
 
-          // Insert the new piece (by overwriting the now-duplicated entry with new values)
-          // I.e. turn this piece into what was stored in the temporary descriptor above
-          Piece->Type = new_descriptor_temp.Type;
-          Piece->Pad = new_descriptor_temp.Pad;
-          Piece->PhysicalStart = new_descriptor_temp.PhysicalStart;
-          Piece->VirtualStart = new_descriptor_temp.VirtualStart;
-          Piece->NumberOfPages = new_descriptor_temp.NumberOfPages;
-          Piece->Attribute = new_descriptor_temp.Attribute;
+// BuddyAllocatePages(), BuddyAllocateZeroedPages(), and malloc_node(). node is NUMA_NO_NODE to go by the calling CPU's NUMA policy and
+// fall back to other nodes, or a node number to only take from that one.
+static EFI_PHYSICAL_ADDRESS buddy_allocate(size_t pages, EFI_PHYSICAL_ADDRESS OldAddress, uint64_t node, uint8_t zeroed)
+{
+  if((!Page_Allocator_Ready()) || (pages == 0))
+  {
+    return ~0ULL;
+  }
 
-          // Update Global_Memory_Info MemMap size
-          Global_Memory_Info.MemMapSize += Global_Memory_Info.MemMapDescriptorSize;
+  uint64_t order = buddy_order_for(pages);
+  if(order > BUDDY_MAX_ORDER)
+  {
+#ifdef MEMORY_CHECK_INFO
+    printf("BuddyAllocatePages: %llu pages is more than the 1GB allocation limit.\r\n", pages);
+#endif
+    return ~0ULL;
+  }
 
-          // Done
-        }
-        // No, it would spill over to a new page
-        else // MemMap is always put at the base of an EfiConventionalMemory region after Setup_MemMap
-        {
-          // Do we have more than a descriptor's worth of pages reclaimable?
-          size_t pages_per_memory_descriptor = (Global_Memory_Info.MemMapDescriptorSize + EFI_PAGE_MASK) >> EFI_PAGE_SHIFT;
+  uint64_t preferred = 0;
+  uint64_t nodes = Global_NUMA.Nodes;
+  if(node != NUMA_NO_NODE)
+  {
+    preferred = node;
+    nodes = 1;
+  }
+  else if(Global_NUMA.Nodes > 1)
+  {
+    PER_CPU_STRUCT * cpu = get_cpu_data();
+    if(cpu->NUMA_Policy == NUMA_POLICY_INTERLEAVE)
+    {
+      preferred = __atomic_fetch_add(&Global_NUMA.Interleave_Next, 1, __ATOMIC_RELAXED) % Global_NUMA.Nodes;
+    }
+    else
+    {
+      preferred = cpu->NUMA_Node;
+    }
+  }
 
-          if((numpages2 + pages_per_memory_descriptor) < numpages)
-          { // Yes, so we can hang on to one [set] of them and make a new EfiConventionalMemory entry for the rest.
-            size_t freedpages = numpages - numpages2 - pages_per_memory_descriptor;
+  uint64_t frame = ~0ULL;
+  uint8_t clean = 0;
 
-            // Make a temporary descriptor to hold current MemMap entry's values
-            EFI_MEMORY_DESCRIPTOR new_descriptor_temp;
-            new_descriptor_temp.Type = Piece->Type; // Special memmap type
-            new_descriptor_temp.Pad = Piece->Pad;
-            new_descriptor_temp.PhysicalStart = Piece->PhysicalStart;
-            new_descriptor_temp.VirtualStart = Piece->VirtualStart;
-            new_descriptor_temp.NumberOfPages = numpages2 + pages_per_memory_descriptor; // New size of MemMap entry
-            new_descriptor_temp.Attribute = Piece->Attribute;
+  buddy_lock_take();
 
-            // Modify the descriptor-to-move
-            Piece->Type = EfiConventionalMemory;
-            // No pad change
-            Piece->PhysicalStart += ((numpages2 + pages_per_memory_descriptor) << EFI_PAGE_SHIFT);
-            Piece->VirtualStart += ((numpages2 + pages_per_memory_descriptor) << EFI_PAGE_SHIFT);
-            Piece->NumberOfPages = freedpages;
-            // No attribute change
+  for(uint64_t attempt = 0; (attempt < nodes) && (frame == ~0ULL); attempt++)
+  {
+    node = (Global_NUMA.Nodes > 1) ? Global_NUMA.Fallback[preferred][attempt] : 0;
 
-            // Move (copy) the whole memmap that's above this piece (including this freshly modified piece) from this piece to one MemMapDescriptorSize over
-            AVX_memmove((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize, Piece, ((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize) - (uint8_t*)Piece); // Pointer math to get size
+    // Zeroed allocations would rather have a clean block, and everything else would rather leave the clean blocks for them
+    clean = zeroed;
+    frame = buddy_alloc_block(order, EFI_SIZE_TO_PAGES(OldAddress), node, clean);
+    if(frame == ~0ULL)
+    {
+      clean = !zeroed;
+      frame = buddy_alloc_block(order, EFI_SIZE_TO_PAGES(OldAddress), node, clean);
+    }
+  }
 
-            // Insert the new piece (by overwriting the now-duplicated entry with new values)
-            // I.e. turn this piece into what was stored in the temporary descriptor above
-            Piece->Type = new_descriptor_temp.Type;
-            Piece->Pad = new_descriptor_temp.Pad;
-            Piece->PhysicalStart = new_descriptor_temp.PhysicalStart;
-            Piece->VirtualStart = new_descriptor_temp.VirtualStart;
-            Piece->NumberOfPages = new_descriptor_temp.NumberOfPages;
-            Piece->Attribute = new_descriptor_temp.Attribute;
+  if(frame == ~0ULL)
+  {
+    buddy_lock_release();
+#ifdef MEMORY_CHECK_INFO
+    printf("No more free physical addresses by 4kB page...\r\n");
+#endif
+    return ~0ULL;
+  }
+  buddy_free_pages -= (1ULL << order);
+  buddy_node_free_pages[node] -= (1ULL << order);
 
-            // Update Global_Memory_Info MemMap size
-            Global_Memory_Info.MemMapSize += Global_Memory_Info.MemMapDescriptorSize;
-          }
-          // No, only 1 [set of] page(s) was reclaimable and adding another entry would spill over. So don't do anything then and hang on to the extra empty page(s).
-        }
-        // All done. There's only one MemMap entry so we can break out of the loop now.
-        break;
+  // Give back the part that rounding up to a power of 2 added, which is as clean as the rest of the block was
+  if((1ULL << order) > pages)
+  {
+    buddy_free_range(frame + pages, (1ULL << order) - pages, clean);
+  }
+
+  buddy_lock_release();
+
+  if(zeroed)
+  {
+    if(clean)
+    {
+      // Only the free list links were left
+      BUDDY_FREE_BLOCK * block = (BUDDY_FREE_BLOCK*)(frame << EFI_PAGE_SHIFT);
+      block->Next = NULL;
+      block->Prev = NULL;
+    }
+    else
+    {
+      // This also runs from VMM_Page_Fault() with Global_Vmalloc.Lock held, which is fine: bulk_post() never waits for a busy AP, the
+      // APs it does post to only write this identity-mapped block (so they can't fault on Vmalloc() memory and need that lock), and
+      // bulk_wait() does any chunks no AP took.
+      bulk_fill((void*)(frame << EFI_PAGE_SHIFT), 0, EFI_PAGES_TO_SIZE(pages));
+    }
+  }
+
+  return frame << EFI_PAGE_SHIFT;
+}
+
+// Push a free block onto its node's clean or dirty free list for its order and mark it free in the frame map
+static void buddy_list_push(uint64_t frame, uint64_t order, uint64_t node, uint8_t clean)
+{
+  BUDDY_FREE_BLOCK * block = (BUDDY_FREE_BLOCK*)(frame << EFI_PAGE_SHIFT);
+
+  block->Prev = NULL;
+  block->Next = buddy_free_lists[node][clean][order];
+  if(block->Next != NULL)
+  {
+    block->Next->Prev = block;
+  }
+  buddy_free_lists[node][clean][order] = block;
+
+  buddy_frame_map[frame - buddy_base_frame] = BUDDY_FRAME_FREE | (clean ? BUDDY_FRAME_CLEAN : 0) | order;
+  if(clean)
+  {
+    buddy_clean_pages += (1ULL << order);
+  }
+}
+
+// Take a free block off of whichever of its node's free lists it's on and mark it used in the frame map
+static void buddy_list_remove(uint64_t frame, uint64_t order, uint64_t node)
+{
+  BUDDY_FREE_BLOCK * block = (BUDDY_FREE_BLOCK*)(frame << EFI_PAGE_SHIFT);
+  uint8_t clean = (buddy_frame_map[frame - buddy_base_frame] & BUDDY_FRAME_CLEAN) ? 1 : 0;
+
+  if(block->Prev != NULL)
+  {
+    block->Prev->Next = block->Next;
+  }
+  else
+  {
+    buddy_free_lists[node][clean][order] = block->Next;
+  }
+  if(block->Next != NULL)
+  {
+    block->Next->Prev = block->Prev;
+  }
+
+  buddy_frame_map[frame - buddy_base_frame] = 0;
+  if(clean)
+  {
+    buddy_clean_pages -= (1ULL << order);
+  }
+}
+
+// Free one aligned block, merging it with its buddy for as long as the buddy is also free and the merged block stays within the
+// block's NUMA range. Blocks only merge with buddies in the same state, clean with clean and dirty with dirty, so freeing one dirty page
+// can't turn a big clean block dirty and undo the zeroing that went into it. Once the dirty part gets zeroed, it's freed clean and
+// merges the rest of the way up. Doesn't touch the free page counts.
+static void buddy_free_block(uint64_t frame, uint64_t order, uint8_t clean)
+{
+  uint64_t span_start, span_end;
+  uint64_t node = buddy_span(frame, &span_start, &span_end);
+
+  if(span_start < buddy_base_frame)
+  {
+    span_start = buddy_base_frame;
+  }
+  if(span_end > (buddy_base_frame + buddy_frames))
+  {
+    span_end = buddy_base_frame + buddy_frames;
+  }
+
+  while(order < BUDDY_MAX_ORDER)
+  {
+    uint64_t buddy = frame ^ (1ULL << order);
+    uint64_t merged = frame & ~(1ULL << order); // Merged block starts at the lower of the two
+
+    if((merged < span_start) || ((merged + (2ULL << order)) > span_end))
+    {
+      break;
+    }
+
+    uint8_t buddy_entry = buddy_frame_map[buddy - buddy_base_frame];
+    if((buddy_entry & ~BUDDY_FRAME_CLEAN) != (BUDDY_FRAME_FREE | order))
+    {
+      break;
+    }
+    if(((buddy_entry & BUDDY_FRAME_CLEAN) != 0) != (clean != 0))
+    {
+      break;
+    }
+
+    buddy_list_remove(buddy, order, node);
+    if(clean)
+    {
+      // The upper half's first 16 bytes end up in the middle of the merged block, which has to be all zeroes to stay clean
+      BUDDY_FREE_BLOCK * upper = (BUDDY_FREE_BLOCK*)((merged + (1ULL << order)) << EFI_PAGE_SHIFT);
+      upper->Next = NULL;
+      upper->Prev = NULL;
+    }
+    frame = merged;
+    order++;
+  }
+
+  buddy_list_push(frame, order, node, clean);
+}
+
+// Free an arbitrary run of pages by breaking it into the largest aligned blocks that fit, without crossing NUMA range boundaries
+static void buddy_free_range(uint64_t frame, uint64_t frames, uint8_t clean)
+{
+  buddy_free_pages += frames;
+
+  while(frames)
+  {
+    uint64_t span_start, span_end;
+    uint64_t node = buddy_span(frame, &span_start, &span_end);
+    uint64_t chunk = frames;
+
+    if((span_end - frame) < chunk)
+    {
+      chunk = span_end - frame;
+    }
+    buddy_node_free_pages[node] += chunk;
+    frames -= chunk;
+
+    while(chunk)
+    {
+      uint64_t order = 63 - __builtin_clzll(chunk); // Largest block that fits in what's left...
+      uint64_t alignment = __builtin_ctzll(frame); // ...and that 'frame' is aligned to. Frame 0 is below 1MB, so it never gets here.
+
+      if(alignment < order)
+      {
+        order = alignment;
+      }
+      if(order > BUDDY_MAX_ORDER)
+      {
+        order = BUDDY_MAX_ORDER;
       }
+
+      buddy_free_block(frame, order, clean);
+      frame += (1ULL << order);
+      chunk -= (1ULL << order);
     }
   }
+}
 
-  // Done
+// Get a block of exactly 2^order pages from one node's clean or dirty lists, starting at or above min_frame, splitting a larger one if
+// needed. Returns its frame, or ~0ULL.
+static uint64_t buddy_alloc_block(uint64_t order, uint64_t min_frame, uint64_t node, uint8_t clean)
+{
+  for(uint64_t current_order = order; current_order <= BUDDY_MAX_ORDER; current_order++)
+  {
+    BUDDY_FREE_BLOCK * block = buddy_free_lists[node][clean][current_order];
+
+    if(min_frame)
+    {
+      while((block != NULL) && (((uint64_t)block >> EFI_PAGE_SHIFT) < min_frame))
+      {
+        block = block->Next;
+      }
+    }
+
+    if(block != NULL)
+    {
+      uint64_t frame = (uint64_t)block >> EFI_PAGE_SHIFT;
+      buddy_list_remove(frame, current_order, node);
+
+      // Split down to the requested size, putting the upper halves back
+      while(current_order > order)
+      {
+        current_order--;
+        buddy_list_push(frame + (1ULL << current_order), current_order, node, clean);
+      }
+
+      return frame;
+    }
+  }
+
+  return ~0ULL;
+}
+
+// Smallest order whose block size holds 'pages' pages
+static uint64_t buddy_order_for(uint64_t pages)
+{
+  if(pages <= 1)
+  {
+    return 0;
+  }
+
+  return 64 - __builtin_clzll(pages - 1);
+}
+
+// NUMA node of the SRAT memory range holding 'frame', and that range's first and last + 1 frames. Frames outside every range count as
+// node 0, with the gap between ranges as their span. Without an SRAT, everything is one node 0 span.
+static uint64_t buddy_span(uint64_t frame, uint64_t * span_start, uint64_t * span_end)
+{
+  uint64_t low = 0;
+  uint64_t high = Global_NUMA.Range_Count;
+
+  // First range that ends after 'frame'
+  while(low < high)
+  {
+    uint64_t middle = (low + high) >> 1;
+    if((Global_NUMA.Ranges[middle].End >> EFI_PAGE_SHIFT) <= frame)
+    {
+      low = middle + 1;
+    }
+    else
+    {
+      high = middle;
+    }
+  }
+
+  if((low < Global_NUMA.Range_Count) && ((Global_NUMA.Ranges[low].Base >> EFI_PAGE_SHIFT) <= frame))
+  {
+    *span_start = Global_NUMA.Ranges[low].Base >> EFI_PAGE_SHIFT;
+    *span_end = Global_NUMA.Ranges[low].End >> EFI_PAGE_SHIFT;
+    return Global_NUMA.Ranges[low].Node;
+  }
+
+  *span_start = (low > 0) ? (Global_NUMA.Ranges[low - 1].End >> EFI_PAGE_SHIFT) : 0;
+  *span_end = (low < Global_NUMA.Range_Count) ? (Global_NUMA.Ranges[low].Base >> EFI_PAGE_SHIFT) : ~0ULL;
+  return 0;
+}
+
+// buddy_lock is only ever taken by allocation code, never by interrupt handlers, so it doesn't need to turn interrupts off. Taking it
+// also puts back any frees that were queued while it was held, so that allocations can use them.
+static void buddy_lock_take(void)
+{
+  MCS_Lock(&buddy_lock, &buddy_lock_nodes[get_cpu_index()]);
+  buddy_drain_deferred();
+}
+
+// Returns 1 if buddy_lock was free and is now held
+static uint8_t buddy_lock_try(void)
+{
+  return MCS_Trylock(&buddy_lock, &buddy_lock_nodes[get_cpu_index()]);
+}
+
+// Puts back queued frees before letting go. A free queued just as the lock is released would otherwise sit there until the next time
+// someone takes it, so this checks again afterwards and goes around if it can get the lock back.
+static void buddy_lock_release(void)
+{
+  MCS_NODE * node = &buddy_lock_nodes[get_cpu_index()];
+
+  do
+  {
+    buddy_drain_deferred();
+    MCS_Unlock(&buddy_lock, node);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST); // The unlock has to be visible before the queue is checked, see BuddyFreePages()
+  } while(MPSC_Ready(&buddy_deferred_frees) && MCS_Trylock(&buddy_lock, node));
+}
+
+// Free everything in buddy_deferred_frees. Call with buddy_lock held, which makes this CPU the queue's only consumer.
+static void buddy_drain_deferred(void)
+{
+  uint64_t address;
+
+  while(MPSC_Pop(&buddy_deferred_frees, &address))
+  {
+    uint64_t frame = address >> EFI_PAGE_SHIFT;
+    if(buddy_frame_map[frame - buddy_base_frame] & BUDDY_FRAME_FREE)
+    {
+      printf("BuddyFreePages: %#qx is already free.\r\n", address); // Freed twice, and both got queued
+      continue;
+    }
+    buddy_free_range(frame, *(uint64_t*)address, 0);
+  }
+}
+
+// Set or clear BUDDY_FRAME_SLAB for the allocated block at 'address'. Nothing else writes an allocated block's frame map entry.
+static void buddy_mark_slab(EFI_PHYSICAL_ADDRESS address, uint8_t slab)
+{
+  __atomic_store_n(&buddy_frame_map[(address >> EFI_PAGE_SHIFT) - buddy_base_frame], slab ? BUDDY_FRAME_SLAB : 0, __ATOMIC_RELAXED);
+}
+
+// Whether 'address' is in the page pool and is the start of a slab
+static uint8_t buddy_is_slab(EFI_PHYSICAL_ADDRESS address)
+{
+  uint64_t frame = address >> EFI_PAGE_SHIFT;
+
+  if((!Page_Allocator_Ready()) || (frame < buddy_base_frame) || (frame >= (buddy_base_frame + buddy_frames)))
+  {
+    return 0;
+  }
+
+  return (__atomic_load_n(&buddy_frame_map[frame - buddy_base_frame], __ATOMIC_RELAXED) == BUDDY_FRAME_SLAB);
 }
 
 //----------------------------------------------------------------------------------------------------------------------------------
-//  ZeroAllConventionalMemory: Zero Out ALL EfiConventionalMemory
+//  Slab Allocator: Size Classes for Small Allocations
 //----------------------------------------------------------------------------------------------------------------------------------
 //
-// This function goes through the memory map and zeroes out all EfiConventionalMemory areas. Returns 0 on success, else returns the
-// base physical address of the last region that could not be completely zeroed.
+// Once the page allocator is up, malloc16(), malloc32(), and malloc64() hand out objects from 16kB slabs instead of walking the memory
+// map. Each slab is a naturally-aligned set of 4 pages from the page allocator, holding a SLAB_HEADER followed by objects of a single
+// size class. Since slabs are aligned to their own size, free() finds an object's slab header by masking off the low bits of its
+// address, so no size needs to be passed in. That address only gets read once the frame map says a slab starts there (see
+// BUDDY_FRAME_SLAB), since masking a pointer from malloc4k() that isn't 16kB-aligned lands in someone else's pages.
 //
-// USE WITH CAUTION!!
-// Firmware bugs like this could really cause problems with this function: https://mjg59.dreamwidth.org/11235.html
+// In a slab, freed objects go onto a singly-linked free list stored inside the objects themselves, and objects that have never been
+// used are handed out from the end of the slab rather than being strung onto the list ahead of time. Slabs with room are kept on a
+// per-class list. A slab that becomes completely empty is given back to the page allocator, unless it's the only one with room.
 //
-// Also, buggy firmware that uses Boot Service memory when invoking runtime services will fail to work after this function if
-// ReclaimEfiBootServicesMemory() has been used beforehand.
+// On top of that, each CPU has a small magazine of free objects per size class in its PER_CPU_STRUCT. Allocations and frees only go
+// to the slabs when a magazine runs empty or fills up, and then they move half a magazine's worth at a time, under that class's lock
+// in slab_locks[]. Classes don't share a lock, so CPUs refilling different classes don't get in each other's way. A class lock can be
+// held while taking buddy_lock, but not the other way around.
+//
+// The size classes are all multiples of 16 bytes, and the header is 64 bytes, so an object's alignment is set by its class size.
+// mallocX therefore just picks the smallest class that's a multiple of X.
 //
 
-EFI_PHYSICAL_ADDRESS ZeroAllConventionalMemory(void)
+#define SLAB_SIZE (EFI_PAGE_SIZE << 2) // 16kB
+#define SLAB_MAGIC 0x42414C53 // "SLAB"
+
+static const uint16_t slab_class_sizes[SLAB_CLASSES] = {16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048, 3072, 4096};
+
+static SLAB_HEADER * slab_partial_lists[SLAB_CLASSES] = {NULL}; // Slabs that have at least one free object
+static TICKET_LOCK slab_locks[SLAB_CLASSES] = {{{0}}}; // One per class, covering its partial list and its slabs' free lists
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  SlabAllocate: Allocate a Small Object
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Returns the address of 'numbytes' bytes aligned to 'alignment' (16, 32, or 64), or ~0ULL if there's no room. Anything bigger than
+// the largest size class comes straight from the page allocator instead, which means it must be freed with freepages(), not free().
+//
+
+EFI_PHYSICAL_ADDRESS SlabAllocate(size_t numbytes, size_t alignment)
 {
-  EFI_MEMORY_DESCRIPTOR * Piece;
-  EFI_PHYSICAL_ADDRESS exit_value = 0;
+  uint64_t class = slab_class_for(numbytes, alignment);
 
-  // Check for EfiConventionalMemory
-  for(Piece = Global_Memory_Info.MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
+  if(class == SLAB_CLASSES) // Too big for a slab
   {
-    if(Piece->Type == EfiConventionalMemory)
-    {
-      AVX_memset((void *)Piece->PhysicalStart, 0, EFI_PAGES_TO_SIZE(Piece->NumberOfPages));
+    return BuddyAllocatePages(EFI_SIZE_TO_PAGES(numbytes), 0);
+  }
 
-      if(VerifyZeroMem(EFI_PAGES_TO_SIZE(Piece->NumberOfPages), Piece->PhysicalStart))
-      {
-        printf("Area Not Zeroed! Base Physical Address: %#qx, Pages: %llu\r\n", Piece->PhysicalStart, Piece->NumberOfPages);
-        exit_value = Piece->PhysicalStart;
-      }
-      else
+  SLAB_MAGAZINE * magazine = &get_cpu_data()->Slab_Magazines[class];
+
+  if(magazine->Count == 0)
+  {
+    // Refill half of the magazine
+    Ticket_Lock(&slab_locks[class]);
+    while(magazine->Count < (SLAB_MAGAZINE_SIZE >> 1))
+    {
+      EFI_PHYSICAL_ADDRESS object = slab_take(class);
+      if(object == ~0ULL)
       {
-        printf("Zeroed! Base Physical Address: %#qx, Pages: %llu\r\n", Piece->PhysicalStart, Piece->NumberOfPages);
+        break;
       }
+      magazine->Objects[magazine->Count++] = (void*)object;
+    }
+    Ticket_Unlock(&slab_locks[class]);
+
+    if(magazine->Count == 0)
+    {
+#ifdef MEMORY_CHECK_INFO
+      printf("No more free physical addresses for %hu-byte objects...\r\n", slab_class_sizes[class]);
+#endif
+      return ~0ULL;
     }
   }
-  // Done.
-  return exit_value;
+
+  return (EFI_PHYSICAL_ADDRESS)magazine->Objects[--magazine->Count];
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  SlabFree: Free a Small Object
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Give back an object that came from SlabAllocate(). Addresses that don't belong to a slab get reported and otherwise ignored.
+//
+
+void SlabFree(EFI_PHYSICAL_ADDRESS address)
+{
+  SLAB_HEADER * slab = (SLAB_HEADER*)(address & ~(EFI_PHYSICAL_ADDRESS)(SLAB_SIZE - 1));
+
+  // Objects are never at the very start of a slab, that's where the header is
+  if(((address & (SLAB_SIZE - 1)) < sizeof(SLAB_HEADER)) || (!buddy_is_slab((EFI_PHYSICAL_ADDRESS)slab)) || (slab->Magic != SLAB_MAGIC) || (((address - (EFI_PHYSICAL_ADDRESS)(slab + 1)) % slab->ObjectSize) != 0))
+  {
+    printf("SlabFree: %#qx was not allocated by malloc16/32/64.\r\n", address);
+    return;
+  }
+
+  SLAB_MAGAZINE * magazine = &get_cpu_data()->Slab_Magazines[slab->Class];
+
+  if(magazine->Count == SLAB_MAGAZINE_SIZE)
+  {
+    // Full magazine, so give half of it back to the slabs
+    Ticket_Lock(&slab_locks[slab->Class]);
+    while(magazine->Count > (SLAB_MAGAZINE_SIZE >> 1))
+    {
+      slab_give(magazine->Objects[--magazine->Count]);
+    }
+    Ticket_Unlock(&slab_locks[slab->Class]);
+  }
+
+  magazine->Objects[magazine->Count++] = (void*)address;
+}
+
+// Smallest size class that fits 'numbytes' and is a multiple of 'alignment', or SLAB_CLASSES if none is big enough
+static uint64_t slab_class_for(size_t numbytes, size_t alignment)
+{
+  for(uint64_t class = 0; class < SLAB_CLASSES; class++)
+  {
+    if((slab_class_sizes[class] >= numbytes) && ((slab_class_sizes[class] & (alignment - 1)) == 0))
+    {
+      return class;
+    }
+  }
+
+  return SLAB_CLASSES;
+}
+
+// Take one object out of a slab of the given class, making a new slab if there aren't any with room. Call with the class lock held.
+static EFI_PHYSICAL_ADDRESS slab_take(uint64_t class)
+{
+  SLAB_HEADER * slab = slab_partial_lists[class];
+  void * object;
+
+  if(slab == NULL)
+  {
+    EFI_PHYSICAL_ADDRESS slab_address = BuddyAllocatePages(SLAB_SIZE >> EFI_PAGE_SHIFT, 0); // A power of 2, so it's aligned to its size
+    if(slab_address == ~0ULL)
+    {
+      return ~0ULL;
+    }
+    buddy_mark_slab(slab_address, 1);
+
+    slab = (SLAB_HEADER*)slab_address;
+    slab->FreeList = NULL;
+    slab->Magic = SLAB_MAGIC;
+    slab->Class = class;
+    slab->ObjectSize = slab_class_sizes[class];
+    slab->Capacity = (SLAB_SIZE - sizeof(SLAB_HEADER)) / slab->ObjectSize;
+    slab->Unused = slab->Capacity;
+    slab->InUse = 0;
+    slab_list_push(slab);
+  }
+
+  if(slab->FreeList != NULL)
+  {
+    object = slab->FreeList;
+    slab->FreeList = *(void**)object;
+  }
+  else
+  {
+    object = (uint8_t*)(slab + 1) + (uint64_t)(slab->Capacity - slab->Unused) * slab->ObjectSize;
+    slab->Unused--;
+  }
+  slab->InUse++;
+
+  if((slab->FreeList == NULL) && (slab->Unused == 0)) // Full now
+  {
+    slab_list_remove(slab);
+  }
+
+  return (EFI_PHYSICAL_ADDRESS)object;
+}
+
+// Put an object back into its slab. Call with its class lock held.
+static void slab_give(void * object)
+{
+  SLAB_HEADER * slab = (SLAB_HEADER*)((uint64_t)object & ~(uint64_t)(SLAB_SIZE - 1));
+  uint8_t was_full = (slab->FreeList == NULL) && (slab->Unused == 0);
+
+  *(void**)object = slab->FreeList;
+  slab->FreeList = object;
+  slab->InUse--;
+
+  if(was_full)
+  {
+    slab_list_push(slab);
+  }
+  else if((slab->InUse == 0) && ((slab->Next != NULL) || (slab->Prev != NULL))) // Empty, and not the only slab with room
+  {
+    slab_list_remove(slab);
+    slab->Magic = 0;
+    buddy_mark_slab((EFI_PHYSICAL_ADDRESS)slab, 0);
+    BuddyFreePages((EFI_PHYSICAL_ADDRESS)slab, SLAB_SIZE >> EFI_PAGE_SHIFT);
+  }
+}
+
+static void slab_list_push(SLAB_HEADER * slab)
+{
+  slab->Prev = NULL;
+  slab->Next = slab_partial_lists[slab->Class];
+  if(slab->Next != NULL)
+  {
+    slab->Next->Prev = slab;
+  }
+  slab_partial_lists[slab->Class] = slab;
+}
+
+static void slab_list_remove(SLAB_HEADER * slab)
+{
+  if(slab->Prev != NULL)
+  {
+    slab->Prev->Next = slab->Next;
+  }
+  else
+  {
+    slab_partial_lists[slab->Class] = slab->Next;
+  }
+  if(slab->Next != NULL)
+  {
+    slab->Next->Prev = slab->Prev;
+  }
+  slab->Next = NULL;
+  slab->Prev = NULL;
 }
 
 /*
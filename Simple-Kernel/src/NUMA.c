@@ -0,0 +1,405 @@
+//==================================================================================================================================
+//  Simple Kernel: NUMA Topology
+//==================================================================================================================================
+//
+// Version 0.z
+//
+// Author:
+//  KNNSpeed
+//
+// Source Code:
+//  https://github.com/KNNSpeed/Simple-Kernel
+//
+// This file contains functions for finding out which memory and which CPUs belong to which NUMA node, from the ACPI SRAT (System
+// Resource Affinity Table), and how far apart the nodes are, from the ACPI SLIT (System Locality Information Table).
+//
+// ACPI proximity domains can be any 32-bit number, so each one that shows up in the SRAT gets a node number from 0 up, in the order
+// they're found. Everything else uses node numbers. Memory ranges are kept sorted by address for NUMA_Node_Of_Address() and for the
+// page allocator, which keeps a separate set of free lists for each node and never merges blocks across a node boundary (see
+// "Page Allocator" in Memory.c).
+//
+// By default, page allocations come from the calling CPU's own node, and then from the next-closest nodes once that one runs out.
+// NUMA_Set_Policy() can switch a CPU over to taking turns between nodes instead, and malloc_node() asks for a specific node.
+//
+// Without an SRAT everything is node 0, which behaves exactly like there being no NUMA support at all.
+//
+
+#include "Kernel64.h"
+
+static uint64_t numa_node_for_domain(uint32_t domain);
+static void numa_add_range(uint64_t base, uint64_t length, uint64_t node);
+static void numa_sort_ranges(void);
+static void numa_set_distances(void);
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Setup_NUMA: Read the NUMA Topology
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Parse the SRAT and SLIT into Global_NUMA, and set the BSP's node. Setup_SMP() sets each AP's node with NUMA_Node_Of_APIC().
+//
+// Requires: ACPI_Init() and Setup_Per_CPU_Data(). This has to run before Setup_Page_Allocator(), since that sorts free memory by node.
+//
+
+void Setup_NUMA(void)
+{
+  SRAT_STRUCT * srat = (SRAT_STRUCT *)ACPI_Find_Table("SRAT", 0);
+
+  Global_NUMA.Nodes = 0;
+  Global_NUMA.Range_Count = 0;
+  Global_NUMA.CPU_Count = 0;
+
+  if(srat != NULL)
+  {
+    // Same type and length header as the MADT's entries
+    uint8_t * entry = (uint8_t*)srat + sizeof(SRAT_STRUCT);
+    uint8_t * srat_end = (uint8_t*)srat + srat->SDTHeader.Length;
+
+    while((entry + sizeof(MADT_ENTRY_HEADER_STRUCT)) <= srat_end)
+    {
+      MADT_ENTRY_HEADER_STRUCT * header = (MADT_ENTRY_HEADER_STRUCT *)entry;
+      if((header->Length < sizeof(MADT_ENTRY_HEADER_STRUCT)) || ((entry + header->Length) > srat_end))
+      {
+        printf("Setup_NUMA: Malformed SRAT entry.\r\n");
+        break;
+      }
+
+      uint32_t domain = 0, apic_id = 0, flags = 0;
+      uint8_t is_cpu = 0;
+
+      if((header->Type == 0) && (header->Length >= sizeof(SRAT_LOCAL_APIC_AFFINITY_STRUCT))) // Processor Local APIC Affinity
+      {
+        SRAT_LOCAL_APIC_AFFINITY_STRUCT * lapic = (SRAT_LOCAL_APIC_AFFINITY_STRUCT *)entry;
+        domain = lapic->ProximityDomainLow | ((uint32_t)lapic->ProximityDomainHigh[0] << 8) | ((uint32_t)lapic->ProximityDomainHigh[1] << 16) | ((uint32_t)lapic->ProximityDomainHigh[2] << 24);
+        apic_id = lapic->APICID;
+        flags = lapic->Flags;
+        is_cpu = 1;
+      }
+      else if((header->Type == 2) && (header->Length >= sizeof(SRAT_LOCAL_X2APIC_AFFINITY_STRUCT))) // Processor Local x2APIC Affinity
+      {
+        SRAT_LOCAL_X2APIC_AFFINITY_STRUCT * x2apic = (SRAT_LOCAL_X2APIC_AFFINITY_STRUCT *)entry;
+        domain = x2apic->ProximityDomain;
+        apic_id = x2apic->X2APICID;
+        flags = x2apic->Flags;
+        is_cpu = 1;
+      }
+      else if((header->Type == 1) && (header->Length >= sizeof(SRAT_MEMORY_AFFINITY_STRUCT))) // Memory Affinity
+      {
+        SRAT_MEMORY_AFFINITY_STRUCT * memory = (SRAT_MEMORY_AFFINITY_STRUCT *)entry;
+        if((memory->Flags & 1) && memory->RangeLength)
+        {
+          uint64_t node = numa_node_for_domain(memory->ProximityDomain);
+          if(node != NUMA_NO_NODE)
+          {
+            numa_add_range(memory->BaseAddress, memory->RangeLength, node);
+          }
+        }
+      }
+
+      entry += header->Length;
+
+      if(is_cpu && (flags & 1))
+      {
+        uint64_t node = numa_node_for_domain(domain);
+        if((node != NUMA_NO_NODE) && (Global_NUMA.CPU_Count < NUMA_MAX_CPUS))
+        {
+          Global_NUMA.CPU_APIC_ID[Global_NUMA.CPU_Count] = apic_id;
+          Global_NUMA.CPU_Node[Global_NUMA.CPU_Count] = (uint8_t)node;
+          Global_NUMA.CPU_Count++;
+        }
+      }
+    }
+  }
+
+  if(Global_NUMA.Nodes == 0)
+  {
+    // No SRAT, or nothing usable in it: one node with everything
+    Global_NUMA.Nodes = 1;
+    Global_NUMA.Domain[0] = 0;
+    Global_NUMA.Range_Count = 0;
+    Global_NUMA.CPU_Count = 0;
+  }
+
+  numa_sort_ranges();
+  numa_set_distances();
+
+  Global_Per_CPU_Data[0].NUMA_Node = NUMA_Node_Of_APIC(Global_Per_CPU_Data[0].APIC_ID);
+
+  if(Global_NUMA.Nodes > 1)
+  {
+    printf("NUMA: %qu nodes, %qu memory ranges, BSP is on node %qu.\r\n", Global_NUMA.Nodes, Global_NUMA.Range_Count, Global_Per_CPU_Data[0].NUMA_Node);
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// NUMA_Node_Of_APIC: Find a CPU's Node
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Returns the node of the CPU with the given (x2)APIC ID, or 0 if the SRAT doesn't list it.
+//
+
+uint64_t NUMA_Node_Of_APIC(uint32_t apic_id)
+{
+  for(uint64_t cpu = 0; cpu < Global_NUMA.CPU_Count; cpu++)
+  {
+    if(Global_NUMA.CPU_APIC_ID[cpu] == apic_id)
+    {
+      return Global_NUMA.CPU_Node[cpu];
+    }
+  }
+
+  return 0;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// NUMA_Node_Of_Address: Find the Node a Physical Address Is On
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Returns the node of the SRAT memory range that holds 'address', or NUMA_NO_NODE if none does. Without an SRAT, everything is node 0.
+//
+
+uint64_t NUMA_Node_Of_Address(EFI_PHYSICAL_ADDRESS address)
+{
+  if(Global_NUMA.Range_Count == 0)
+  {
+    return 0;
+  }
+
+  // Binary search, since the ranges are sorted and don't overlap
+  uint64_t low = 0;
+  uint64_t high = Global_NUMA.Range_Count;
+  while(low < high)
+  {
+    uint64_t middle = (low + high) >> 1;
+    if(address < Global_NUMA.Ranges[middle].Base)
+    {
+      high = middle;
+    }
+    else if(address >= Global_NUMA.Ranges[middle].End)
+    {
+      low = middle + 1;
+    }
+    else
+    {
+      return Global_NUMA.Ranges[middle].Node;
+    }
+  }
+
+  return NUMA_NO_NODE;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// NUMA_Current_Node: Get This CPU's Node
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Returns the node of the calling CPU
+//
+
+uint64_t NUMA_Current_Node(void)
+{
+  return get_cpu_data()->NUMA_Node;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// NUMA_Set_Policy: Choose Where This CPU's Allocations Come From
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Set the node policy for page allocations made on the calling CPU (which includes new slabs for malloc16/32/64()). malloc_node()
+// ignores this.
+//
+// policy: NUMA_POLICY_LOCAL (the default) or NUMA_POLICY_INTERLEAVE
+//
+
+void NUMA_Set_Policy(uint64_t policy)
+{
+  if(policy > NUMA_POLICY_INTERLEAVE)
+  {
+    printf("NUMA_Set_Policy: Unknown policy %qu.\r\n", policy);
+    return;
+  }
+
+  get_cpu_data()->NUMA_Policy = policy;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// NUMA_Print: Print the NUMA Topology
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Print each node's proximity domain, free memory, and distances to the other nodes, followed by the memory ranges.
+//
+
+void NUMA_Print(void)
+{
+  printf("NUMA nodes: %qu\r\n", Global_NUMA.Nodes);
+
+  for(uint64_t node = 0; node < Global_NUMA.Nodes; node++)
+  {
+    uint64_t cpus = 0;
+    for(uint64_t cpu = 0; cpu < Global_SMP_Info.Number_of_CPUs; cpu++)
+    {
+      if(Global_Per_CPU_Data[cpu].NUMA_Node == node)
+      {
+        cpus++;
+      }
+    }
+
+    printf("Node %qu (domain %qu): %qu CPUs, %qu MB free, distances:", node, Global_NUMA.Domain[node], cpus, EFI_PAGES_TO_SIZE(BuddyFreeNodePageCount(node)) >> 20);
+    for(uint64_t other = 0; other < Global_NUMA.Nodes; other++)
+    {
+      printf(" %hhu", Global_NUMA.Distance[node][other]);
+    }
+    printf("\r\n");
+  }
+
+  for(uint64_t range = 0; range < Global_NUMA.Range_Count; range++)
+  {
+    printf("  %#018qx-%#018qx: node %qu\r\n", Global_NUMA.Ranges[range].Base, Global_NUMA.Ranges[range].End - 1, Global_NUMA.Ranges[range].Node);
+  }
+}
+
+// Node number for an ACPI proximity domain, assigning the next free one if it's new. NUMA_NO_NODE if there are too many domains.
+static uint64_t numa_node_for_domain(uint32_t domain)
+{
+  for(uint64_t node = 0; node < Global_NUMA.Nodes; node++)
+  {
+    if(Global_NUMA.Domain[node] == domain)
+    {
+      return node;
+    }
+  }
+
+  if(Global_NUMA.Nodes >= NUMA_MAX_NODES)
+  {
+    printf("Setup_NUMA: More than NUMA_MAX_NODES (%u) proximity domains, ignoring domain %u.\r\n", NUMA_MAX_NODES, domain);
+    return NUMA_NO_NODE;
+  }
+
+  Global_NUMA.Domain[Global_NUMA.Nodes] = domain;
+  return Global_NUMA.Nodes++;
+}
+
+// Add an SRAT memory range, rounded inward to whole pages
+static void numa_add_range(uint64_t base, uint64_t length, uint64_t node)
+{
+  uint64_t end = (base + length) & ~EFI_PAGE_MASK;
+  base = (base + EFI_PAGE_MASK) & ~EFI_PAGE_MASK;
+
+  if(end <= base)
+  {
+    return;
+  }
+
+  if(Global_NUMA.Range_Count >= NUMA_MAX_RANGES)
+  {
+    printf("Setup_NUMA: More than NUMA_MAX_RANGES (%u) memory ranges, ignoring %#qx-%#qx.\r\n", NUMA_MAX_RANGES, base, end - 1);
+    return;
+  }
+
+  Global_NUMA.Ranges[Global_NUMA.Range_Count].Base = base;
+  Global_NUMA.Ranges[Global_NUMA.Range_Count].End = end;
+  Global_NUMA.Ranges[Global_NUMA.Range_Count].Node = node;
+  Global_NUMA.Range_Count++;
+}
+
+// Sort the memory ranges by base address and merge neighbors on the same node, so each node boundary is a range boundary
+static void numa_sort_ranges(void)
+{
+  NUMA_RANGE * ranges = Global_NUMA.Ranges;
+
+  // Insertion sort, there are only a handful
+  for(uint64_t i = 1; i < Global_NUMA.Range_Count; i++)
+  {
+    NUMA_RANGE current = ranges[i];
+    uint64_t j = i;
+    while((j > 0) && (ranges[j - 1].Base > current.Base))
+    {
+      ranges[j] = ranges[j - 1];
+      j--;
+    }
+    ranges[j] = current;
+  }
+
+  uint64_t kept = 0;
+  for(uint64_t i = 0; i < Global_NUMA.Range_Count; i++)
+  {
+    if((kept > 0) && (ranges[kept - 1].Node == ranges[i].Node) && (ranges[kept - 1].End >= ranges[i].Base))
+    {
+      if(ranges[i].End > ranges[kept - 1].End)
+      {
+        ranges[kept - 1].End = ranges[i].End;
+      }
+    }
+    else if((kept > 0) && (ranges[kept - 1].End > ranges[i].Base))
+    {
+      // Overlapping ranges on different nodes are a firmware bug: the first one wins
+      if(ranges[i].End > ranges[kept - 1].End)
+      {
+        ranges[kept] = ranges[i];
+        ranges[kept].Base = ranges[kept - 1].End;
+        kept++;
+      }
+    }
+    else
+    {
+      ranges[kept++] = ranges[i];
+    }
+  }
+  Global_NUMA.Range_Count = kept;
+}
+
+// Fill in the distance matrix from the SLIT (or 10 local, 20 remote without one) and each node's fallback order
+static void numa_set_distances(void)
+{
+  SLIT_STRUCT * slit = (SLIT_STRUCT *)ACPI_Find_Table("SLIT", 0);
+  uint64_t localities = 0;
+
+  if(slit != NULL)
+  {
+    localities = slit->Localities;
+    if((sizeof(SDT_HEADER_STRUCT) + sizeof(uint64_t) + localities * localities) > slit->SDTHeader.Length)
+    {
+      printf("Setup_NUMA: SLIT is too short, ignoring it.\r\n");
+      localities = 0;
+    }
+  }
+
+  for(uint64_t from = 0; from < Global_NUMA.Nodes; from++)
+  {
+    for(uint64_t to = 0; to < Global_NUMA.Nodes; to++)
+    {
+      uint64_t from_domain = Global_NUMA.Domain[from];
+      uint64_t to_domain = Global_NUMA.Domain[to];
+
+      if((from_domain < localities) && (to_domain < localities))
+      {
+        Global_NUMA.Distance[from][to] = slit->Entry[from_domain * localities + to_domain];
+      }
+      else
+      {
+        Global_NUMA.Distance[from][to] = (from == to) ? 10 : 20;
+      }
+    }
+  }
+
+  // Selection sort each node's row by distance, with the node itself always first
+  for(uint64_t from = 0; from < Global_NUMA.Nodes; from++)
+  {
+    uint8_t taken[NUMA_MAX_NODES] = {0};
+
+    Global_NUMA.Fallback[from][0] = (uint8_t)from;
+    taken[from] = 1;
+
+    for(uint64_t slot = 1; slot < Global_NUMA.Nodes; slot++)
+    {
+      uint64_t best = NUMA_NO_NODE;
+      for(uint64_t to = 0; to < Global_NUMA.Nodes; to++)
+      {
+        if((!taken[to]) && ((best == NUMA_NO_NODE) || (Global_NUMA.Distance[from][to] < Global_NUMA.Distance[from][best])))
+        {
+          best = to;
+        }
+      }
+      Global_NUMA.Fallback[from][slot] = (uint8_t)best;
+      taken[best] = 1;
+    }
+  }
+}
@@ -0,0 +1,668 @@
+//==================================================================================================================================
+//  Simple Kernel: Performance Counters
+//==================================================================================================================================
+//
+// Version 0.z
+//
+// Author:
+//  KNNSpeed
+//
+// Source Code:
+//  https://github.com/KNNSpeed/Simple-Kernel
+//
+// This file contains a small performance monitoring layer over the core PMU: detection of the counters (CPUID leaf 0xA on Intel,
+// 0x80000001 and 0x80000022 on AMD), named events, begin/end measurements, and %rip sampling from counter overflow interrupts.
+//
+// A measurement counts up to PMU_MAX_EVENTS events on the CPU that starts it:
+//
+//  uint64_t events[2] = {PMU_EVENT_CYCLES, PMU_EVENT_INSTRUCTIONS};
+//  PMU_MEASUREMENT m;
+//  PMU_Begin(&m, events, 2);
+//  ...code to measure...
+//  PMU_End(&m);
+//  PMU_Print("Loop", &m);
+//
+// On Intel, cycles and instructions go on fixed counters when there are any, so they don't use up general purpose counters. Counters
+// are handed out per CPU, so measurements can nest as long as there are counters left; events that don't get one are reported as not
+// counted. Don't yield (see Task.c) between PMU_Begin() and PMU_End(), since the task could come back on another CPU.
+//
+// Sampling programs one general purpose counter to overflow every 'period' events and records the interrupted %rip into a buffer.
+// The overflow interrupt is a maskable one (PMU_VECTOR, on the fast ISR path), so code that runs with interrupts off doesn't get
+// sampled, and only CPUs with interrupts on (normally just the BSP) can sample at all.
+//
+// The counters count in both ring 0 and ring 3, which are the same thing here. Nothing is virtualized, so in a VM this only works if
+// the hypervisor exposes a PMU.
+//
+
+#include "Kernel64.h"
+
+#define PMU_EVTSEL_USR (1ULL << 16)
+#define PMU_EVTSEL_OS  (1ULL << 17)
+#define PMU_EVTSEL_INT (1ULL << 20)
+#define PMU_EVTSEL_EN  (1ULL << 22)
+
+// Event encodings for each PMU_EVENT_*
+typedef struct {
+  const char * Name;
+  uint8_t      Intel_Event;
+  uint8_t      Intel_Umask;
+  uint8_t      Intel_Arch_Bit;  // CPUID 0xA %rbx bit, 0xFF = not architectural (only used on family 6)
+  uint8_t      Intel_Fixed;     // Fixed counter that counts it, 0xFF = none
+  uint8_t      AMD_Event;
+  uint8_t      AMD_Umask;
+  uint8_t      AMD_Min_Family;  // 0 = always available, 0xFF = never
+  uint8_t      Reserved;
+} PMU_EVENT_INFO;
+
+static const PMU_EVENT_INFO pmu_events[PMU_EVENTS] = {
+  // PMU_EVENT_CYCLES: UnHalted Core Cycles / CPU Clocks not Halted
+  {"cycles",        0x3C, 0x00, 0,    1,    0x76, 0x00, 0,    0},
+  // PMU_EVENT_INSTRUCTIONS: Instructions Retired / Retired Instructions
+  {"instructions",  0xC0, 0x00, 1,    0,    0xC0, 0x00, 0,    0},
+  // PMU_EVENT_LLC_MISSES: LLC Misses
+  {"LLC misses",    0x2E, 0x41, 4,    0xFF, 0x00, 0x00, 0xFF, 0},
+  // PMU_EVENT_BRANCH_MISSES: Branch Misses Retired / Retired Branch Instructions Mispredicted
+  {"branch misses", 0xC5, 0x00, 6,    0xFF, 0xC3, 0x00, 0,    0},
+  // PMU_EVENT_DTLB_MISSES: DTLB_LOAD_MISSES.WALK_COMPLETED (Haswell through Skylake) / L1 DTLB Miss, L2 DTLB Miss (Zen)
+  {"dTLB misses",   0x08, 0x0E, 0xFF, 0xFF, 0x45, 0xF0, 0x17, 0}
+};
+
+static uint8_t pmu_event_available(uint64_t event);
+static uint64_t pmu_claim(PER_CPU_STRUCT * cpu, uint64_t event, uint8_t gp_only);
+static void pmu_program(uint64_t counter, uint64_t event, uint64_t interrupt);
+static void pmu_release(PER_CPU_STRUCT * cpu, uint64_t counter);
+static uint64_t pmu_read(uint64_t counter);
+ISR_GPR_ONLY static uint64_t pmu_evtsel_msr(uint64_t counter);
+ISR_GPR_ONLY static uint64_t pmu_counter_msr(uint64_t counter);
+static void pmu_global_enable(uint64_t counter, uint64_t enable);
+ISR_GPR_ONLY static void pmu_clear_overflow(uint64_t counter);
+static uint64_t pmu_rdtsc(void);
+static uint64_t pmu_width_mask(uint64_t bits);
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Setup_PMU: Find the Performance Counters
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Fill in Global_PMU from CPUID. The counters themselves are only programmed by PMU_Begin() and PMU_Start_Sampling(). Returns 1 if
+// there are counters to use, 0 otherwise.
+//
+
+uint8_t Setup_PMU(void)
+{
+  uint64_t rax = 0, rbx = 0, rcx = 0, rdx = 0;
+
+  asm volatile("cpuid"
+               : "=a" (rax), "=b" (rbx), "=c" (rcx), "=d" (rdx) // Outputs
+               : "a" (0x00), "c" (0x00) // The values to put into %rax and %rcx
+               : // No clobbers
+             );
+  uint64_t max_leaf = rax;
+  uint64_t vendor = rbx; // "Genu" or "Auth"
+
+  asm volatile("cpuid"
+               : "=a" (rax), "=b" (rbx), "=c" (rcx), "=d" (rdx) // Outputs
+               : "a" (0x01), "c" (0x00) // The values to put into %rax and %rcx
+               : // No clobbers
+             );
+  Global_PMU.Family = (rax >> 8) & 0xF;
+  if(Global_PMU.Family == 0xF)
+  {
+    Global_PMU.Family += (rax >> 20) & 0xFF;
+  }
+
+  if((vendor == 0x756E6547) && (max_leaf >= 0x0A)) // Intel
+  {
+    // Architectural Performance Monitoring Leaf
+    asm volatile("cpuid"
+                 : "=a" (rax), "=b" (rbx), "=c" (rcx), "=d" (rdx) // Outputs
+                 : "a" (0x0A), "c" (0x00) // The values to put into %rax and %rcx
+                 : // No clobbers
+               );
+
+    uint64_t version = rax & 0xFF;
+    uint64_t counters = (rax >> 8) & 0xFF;
+    if((version == 0) || (counters == 0))
+    {
+      printf("Setup_PMU: No architectural performance counters.\r\n");
+      return 0;
+    }
+
+    Global_PMU.Version = version;
+    Global_PMU.GP_Counters = (counters > PMU_MAX_GP) ? PMU_MAX_GP : counters;
+    Global_PMU.GP_Mask = pmu_width_mask((rax >> 16) & 0xFF);
+
+    // %rbx bits are set for events that *don't* exist, and only the first %rax[31:24] of them mean anything
+    uint64_t event_bits = (rax >> 24) & 0xFF;
+    if(event_bits > 32)
+    {
+      event_bits = 32;
+    }
+    Global_PMU.Arch_Events = ~rbx & ((1ULL << event_bits) - 1);
+
+    if(version >= 2)
+    {
+      Global_PMU.Fixed_Counters = rdx & 0x1F;
+      if(Global_PMU.Fixed_Counters > 3)
+      {
+        Global_PMU.Fixed_Counters = 3; // Only the first 3 have fixed meanings that this knows about
+      }
+      if(Global_PMU.Fixed_Counters)
+      {
+        Global_PMU.Fixed_Mask = pmu_width_mask((rdx >> 5) & 0xFF);
+      }
+      Global_PMU.Global_Ctrl = 1;
+    }
+
+    Global_PMU.Vendor = PMU_VENDOR_INTEL;
+  }
+  else if(vendor == 0x68747541) // AMD
+  {
+    asm volatile("cpuid"
+                 : "=a" (rax), "=b" (rbx), "=c" (rcx), "=d" (rdx) // Outputs
+                 : "a" (0x80000000), "c" (0x00) // The values to put into %rax and %rcx
+                 : // No clobbers
+               );
+    uint64_t max_extended = rax;
+
+    Global_PMU.GP_Counters = 4; // Legacy PERF_CTL0-3
+    Global_PMU.Version = 1;
+    if(max_extended >= 0x80000001)
+    {
+      asm volatile("cpuid"
+                   : "=a" (rax), "=b" (rbx), "=c" (rcx), "=d" (rdx) // Outputs
+                   : "a" (0x80000001), "c" (0x00) // The values to put into %rax and %rcx
+                   : // No clobbers
+                 );
+      if(rcx & (1 << 23)) // PerfCtrExtCore
+      {
+        Global_PMU.AMD_Core_Ext = 1;
+        Global_PMU.GP_Counters = 6;
+      }
+    }
+    if(max_extended >= 0x80000022)
+    {
+      // Extended Performance Monitoring and Debug
+      asm volatile("cpuid"
+                   : "=a" (rax), "=b" (rbx), "=c" (rcx), "=d" (rdx) // Outputs
+                   : "a" (0x80000022), "c" (0x00) // The values to put into %rax and %rcx
+                   : // No clobbers
+                 );
+      if(rax & 0x1) // PerfMonV2
+      {
+        Global_PMU.Version = 2;
+        Global_PMU.Global_Ctrl = 1;
+        if(rbx & 0xF)
+        {
+          Global_PMU.GP_Counters = rbx & 0xF;
+        }
+      }
+    }
+    Global_PMU.GP_Mask = pmu_width_mask(48);
+
+    Global_PMU.Vendor = PMU_VENDOR_AMD;
+  }
+  else
+  {
+    printf("Setup_PMU: Unknown CPU vendor, no performance counters.\r\n");
+    return 0;
+  }
+
+  printf("PMU: %s v%qu, %qu general purpose counters", (Global_PMU.Vendor == PMU_VENDOR_INTEL) ? "Intel" : "AMD", Global_PMU.Version, Global_PMU.GP_Counters);
+  if(Global_PMU.Fixed_Counters)
+  {
+    printf(" + %qu fixed", Global_PMU.Fixed_Counters);
+  }
+  printf(", events:");
+  for(uint64_t event = 0; event < PMU_EVENTS; event++)
+  {
+    if(pmu_event_available(event))
+    {
+      printf(" %s", pmu_events[event].Name);
+    }
+  }
+  printf("\r\n");
+  return 1;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// PMU_Begin: Start Counting Events
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Start counting 'count' events (PMU_EVENT_*, at most PMU_MAX_EVENTS) on the calling CPU. All of them start counting before any of
+// them get read, so the setup itself gets counted a little; compare against an empty measurement if that matters.
+//
+// Returns the number of events that got a counter. The others are left out of the count, with PMU_COUNTER_NONE as their counter.
+//
+
+uint64_t PMU_Begin(PMU_MEASUREMENT * measurement, const uint64_t * events, uint64_t count)
+{
+  PER_CPU_STRUCT * cpu = get_cpu_data();
+
+  if(count > PMU_MAX_EVENTS)
+  {
+    count = PMU_MAX_EVENTS;
+  }
+  measurement->Count = count;
+  measurement->CPU = cpu->CPU_Index;
+
+  uint64_t counted = 0;
+  for(uint64_t i = 0; i < count; i++)
+  {
+    measurement->Event[i] = events[i];
+    measurement->Value[i] = 0;
+    measurement->Counter[i] = pmu_claim(cpu, events[i], 0);
+
+    if(measurement->Counter[i] != PMU_COUNTER_NONE)
+    {
+      pmu_program(measurement->Counter[i], events[i], 0);
+      counted++;
+    }
+  }
+
+  for(uint64_t i = 0; i < count; i++)
+  {
+    if(measurement->Counter[i] != PMU_COUNTER_NONE)
+    {
+      measurement->Start[i] = pmu_read(measurement->Counter[i]);
+    }
+  }
+  measurement->Start_TSC = pmu_rdtsc();
+
+  return counted;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// PMU_End: Stop Counting Events
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Read the counters started by PMU_Begin() into measurement->Value and give them back. Has to be called on the same CPU as
+// PMU_Begin().
+//
+
+void PMU_End(PMU_MEASUREMENT * measurement)
+{
+  uint64_t end_tsc = pmu_rdtsc();
+
+  PER_CPU_STRUCT * cpu = get_cpu_data();
+  if(cpu->CPU_Index != measurement->CPU)
+  {
+    printf("PMU_End: Started on CPU %qu but ended on CPU %qu.\r\n", measurement->CPU, cpu->CPU_Index);
+    return;
+  }
+
+  for(uint64_t i = 0; i < measurement->Count; i++)
+  {
+    if(measurement->Counter[i] != PMU_COUNTER_NONE)
+    {
+      uint64_t mask = (measurement->Counter[i] >= PMU_COUNTER_FIXED) ? Global_PMU.Fixed_Mask : Global_PMU.GP_Mask;
+      measurement->Value[i] = (pmu_read(measurement->Counter[i]) - measurement->Start[i]) & mask;
+    }
+  }
+  measurement->TSC = end_tsc - measurement->Start_TSC;
+
+  for(uint64_t i = 0; i < measurement->Count; i++)
+  {
+    if(measurement->Counter[i] != PMU_COUNTER_NONE)
+    {
+      pmu_release(cpu, measurement->Counter[i]);
+    }
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// PMU_Print: Print a Measurement
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Print each event's count from PMU_End(), per TSC tick too, plus instructions per cycle if both were counted.
+//
+
+void PMU_Print(const char * name, PMU_MEASUREMENT * measurement)
+{
+  uint64_t cycles = 0, instructions = 0;
+
+  printf("%s: %qu TSC ticks on CPU %qu\r\n", name, measurement->TSC, measurement->CPU);
+  for(uint64_t i = 0; i < measurement->Count; i++)
+  {
+    uint64_t event = measurement->Event[i];
+    const char * event_name = (event < PMU_EVENTS) ? pmu_events[event].Name : "unknown event";
+
+    if(measurement->Counter[i] == PMU_COUNTER_NONE)
+    {
+      printf("  %-14s (not counted)\r\n", event_name);
+      continue;
+    }
+
+    printf("  %-14s %qu\r\n", event_name, measurement->Value[i]);
+    if(event == PMU_EVENT_CYCLES)
+    {
+      cycles = measurement->Value[i];
+    }
+    else if(event == PMU_EVENT_INSTRUCTIONS)
+    {
+      instructions = measurement->Value[i];
+    }
+  }
+
+  if(cycles && instructions)
+  {
+    uint64_t ipc_100 = (instructions * 100) / cycles;
+    printf("  IPC %qu.%02qu\r\n", ipc_100 / 100, ipc_100 % 100);
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// PMU_Start_Sampling: Sample %rip Every N Events
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Take an overflow interrupt every 'period' occurrences of 'event' on the calling CPU, and store the interrupted %rip in 'buffer'
+// until 'capacity' samples have been taken; later ones just get counted in Global_PMU.Sample_Dropped. One CPU can sample at a time.
+//
+// period: 1 to 2^31 - 1 (Intel's legacy counter MSRs only take 32-bit writes)
+//
+// Returns 1 if sampling started, 0 otherwise.
+//
+
+uint8_t PMU_Start_Sampling(uint64_t event, uint64_t period, uint64_t * buffer, uint64_t capacity)
+{
+  if((period == 0) || (period >= (1ULL << 31)) || (buffer == NULL))
+  {
+    printf("PMU_Start_Sampling: Invalid arguments.\r\n");
+    return 0;
+  }
+
+  if(Global_PMU.Sample_Active)
+  {
+    printf("PMU_Start_Sampling: Already sampling on CPU %qu.\r\n", Global_PMU.Sample_CPU);
+    return 0;
+  }
+
+  if((!Global_SMP_Info.x2APIC) && (Global_SMP_Info.LAPIC_Base == 0))
+  {
+    printf("PMU_Start_Sampling: The local APIC isn't set up.\r\n");
+    return 0;
+  }
+
+  PER_CPU_STRUCT * cpu = get_cpu_data();
+  uint64_t counter = pmu_claim(cpu, event, 1);
+  if(counter == PMU_COUNTER_NONE)
+  {
+    printf("PMU_Start_Sampling: No counter for %s.\r\n", (event < PMU_EVENTS) ? pmu_events[event].Name : "that event");
+    return 0;
+  }
+
+  Global_PMU.Sample_CPU = cpu->CPU_Index;
+  Global_PMU.Sample_Counter = counter;
+  Global_PMU.Sample_Period = period;
+  Global_PMU.Sample_Buffer = buffer;
+  Global_PMU.Sample_Capacity = capacity;
+  Global_PMU.Sample_Count = 0;
+  Global_PMU.Sample_Dropped = 0;
+  __atomic_store_n(&Global_PMU.Sample_Active, 1, __ATOMIC_RELEASE);
+
+  lapic_rw(0x340, PMU_VECTOR, 1); // LVT Performance Monitoring Counters: fixed delivery, unmasked
+
+  msr_rw(pmu_counter_msr(counter), (0 - period) & Global_PMU.GP_Mask, 1);
+  pmu_program(counter, event, 1);
+
+  return 1;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// PMU_Stop_Sampling: Stop Sampling
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Has to be called on the CPU that called PMU_Start_Sampling(). Returns the number of samples in the buffer.
+//
+
+uint64_t PMU_Stop_Sampling(void)
+{
+  if(Global_PMU.Sample_Active == 0)
+  {
+    return 0;
+  }
+
+  PER_CPU_STRUCT * cpu = get_cpu_data();
+  if(cpu->CPU_Index != Global_PMU.Sample_CPU)
+  {
+    printf("PMU_Stop_Sampling: Sampling is on CPU %qu, not this one.\r\n", Global_PMU.Sample_CPU);
+    return 0;
+  }
+
+  pmu_release(cpu, Global_PMU.Sample_Counter);
+  lapic_rw(0x340, (1 << 16) | PMU_VECTOR, 1); // Masked
+  pmu_clear_overflow(Global_PMU.Sample_Counter);
+
+  __atomic_store_n(&Global_PMU.Sample_Active, 0, __ATOMIC_RELEASE);
+
+  if(Global_PMU.Sample_Dropped)
+  {
+    printf("PMU_Stop_Sampling: %qu samples didn't fit.\r\n", Global_PMU.Sample_Dropped);
+  }
+  return Global_PMU.Sample_Count;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// PMU_Interrupt: Counter Overflow Interrupt
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Called by Fast_ISR_handler() for PMU_VECTOR. Records a sample and reloads the counter. The caller sends the EOI.
+//
+
+ISR_GPR_ONLY void PMU_Interrupt(FAST_INTERRUPT_FRAME * i_frame)
+{
+  if(Global_PMU.Sample_Active)
+  {
+    uint64_t count = Global_PMU.Sample_Count;
+    if(count < Global_PMU.Sample_Capacity)
+    {
+      Global_PMU.Sample_Buffer[count] = i_frame->rip;
+      Global_PMU.Sample_Count = count + 1;
+    }
+    else
+    {
+      Global_PMU.Sample_Dropped++;
+    }
+
+    uint64_t counter = Global_PMU.Sample_Counter;
+    msr_rw(pmu_counter_msr(counter), (0 - Global_PMU.Sample_Period) & Global_PMU.GP_Mask, 1);
+    pmu_clear_overflow(counter);
+  }
+
+  lapic_rw(0x340, PMU_VECTOR, 1); // Delivering the interrupt masked the LVT entry
+}
+
+// Whether this CPU can count an event
+static uint8_t pmu_event_available(uint64_t event)
+{
+  if(event >= PMU_EVENTS)
+  {
+    return 0;
+  }
+
+  const PMU_EVENT_INFO * info = &pmu_events[event];
+  if(Global_PMU.Vendor == PMU_VENDOR_INTEL)
+  {
+    if(info->Intel_Arch_Bit == 0xFF)
+    {
+      return Global_PMU.Family == 6;
+    }
+    return (Global_PMU.Arch_Events >> info->Intel_Arch_Bit) & 1;
+  }
+  else if(Global_PMU.Vendor == PMU_VENDOR_AMD)
+  {
+    return (info->AMD_Min_Family != 0xFF) && (Global_PMU.Family >= info->AMD_Min_Family);
+  }
+  return 0;
+}
+
+// Find a free counter for an event on this CPU and mark it used. Fixed counters come first unless gp_only is set.
+static uint64_t pmu_claim(PER_CPU_STRUCT * cpu, uint64_t event, uint8_t gp_only)
+{
+  if(!pmu_event_available(event))
+  {
+    return PMU_COUNTER_NONE;
+  }
+
+  uint64_t fixed = pmu_events[event].Intel_Fixed;
+  if((!gp_only) && (Global_PMU.Vendor == PMU_VENDOR_INTEL) && (fixed < Global_PMU.Fixed_Counters))
+  {
+    uint64_t counter = PMU_COUNTER_FIXED + fixed;
+    if((cpu->PMU_Counters_Used & (1ULL << counter)) == 0)
+    {
+      cpu->PMU_Counters_Used |= 1ULL << counter;
+      return counter;
+    }
+  }
+
+  for(uint64_t counter = 0; counter < Global_PMU.GP_Counters; counter++)
+  {
+    if((cpu->PMU_Counters_Used & (1ULL << counter)) == 0)
+    {
+      cpu->PMU_Counters_Used |= 1ULL << counter;
+      return counter;
+    }
+  }
+
+  return PMU_COUNTER_NONE;
+}
+
+// Set a claimed counter counting
+static void pmu_program(uint64_t counter, uint64_t event, uint64_t interrupt)
+{
+  if(counter >= PMU_COUNTER_FIXED)
+  {
+    // IA32_FIXED_CTR_CTRL has 4 bits per counter: ring 0, ring 3, AnyThread, PMI
+    uint64_t shift = (counter - PMU_COUNTER_FIXED) * 4;
+    uint64_t control = msr_rw(0x38D, 0, 0);
+    control = (control & ~(0xFULL << shift)) | ((interrupt ? 0xBULL : 0x3ULL) << shift);
+    msr_rw(0x38D, control, 1);
+  }
+  else
+  {
+    const PMU_EVENT_INFO * info = &pmu_events[event];
+    uint64_t select = PMU_EVTSEL_USR | PMU_EVTSEL_OS | PMU_EVTSEL_EN | (interrupt ? PMU_EVTSEL_INT : 0);
+    if(Global_PMU.Vendor == PMU_VENDOR_INTEL)
+    {
+      select |= info->Intel_Event | ((uint64_t)info->Intel_Umask << 8);
+    }
+    else
+    {
+      select |= info->AMD_Event | ((uint64_t)info->AMD_Umask << 8);
+    }
+    msr_rw(pmu_evtsel_msr(counter), select, 1);
+  }
+
+  pmu_global_enable(counter, 1);
+}
+
+// Stop a counter and give it back
+static void pmu_release(PER_CPU_STRUCT * cpu, uint64_t counter)
+{
+  pmu_global_enable(counter, 0);
+
+  if(counter >= PMU_COUNTER_FIXED)
+  {
+    uint64_t shift = (counter - PMU_COUNTER_FIXED) * 4;
+    msr_rw(0x38D, msr_rw(0x38D, 0, 0) & ~(0xFULL << shift), 1);
+  }
+  else
+  {
+    msr_rw(pmu_evtsel_msr(counter), 0, 1);
+  }
+
+  cpu->PMU_Counters_Used &= ~(1ULL << counter);
+}
+
+// Read a counter with RDPMC, which is cheaper than RDMSR
+static uint64_t pmu_read(uint64_t counter)
+{
+  uint64_t high = 0, low = 0;
+  uint64_t index = (counter >= PMU_COUNTER_FIXED) ? ((1ULL << 30) | (counter - PMU_COUNTER_FIXED)) : counter;
+
+  asm volatile("rdpmc"
+               : "=a" (low), "=d" (high) // Outputs
+               : "c" (index) // Inputs
+               : // Clobbers
+              );
+  return (high << 32) | low;
+}
+
+// Event select MSR of a general purpose counter
+ISR_GPR_ONLY static uint64_t pmu_evtsel_msr(uint64_t counter)
+{
+  if(Global_PMU.Vendor == PMU_VENDOR_INTEL)
+  {
+    return 0x186 + counter; // IA32_PERFEVTSELx
+  }
+  if(Global_PMU.AMD_Core_Ext)
+  {
+    return 0xC0010200 + counter * 2; // PERF_CTLx, interleaved with PERF_CTRx
+  }
+  return 0xC0010000 + counter; // Legacy PERF_CTL0-3
+}
+
+// Count MSR of a general purpose counter
+ISR_GPR_ONLY static uint64_t pmu_counter_msr(uint64_t counter)
+{
+  if(Global_PMU.Vendor == PMU_VENDOR_INTEL)
+  {
+    return 0xC1 + counter; // IA32_PMCx, writes are the low 32 bits sign-extended
+  }
+  if(Global_PMU.AMD_Core_Ext)
+  {
+    return 0xC0010201 + counter * 2;
+  }
+  return 0xC0010004 + counter; // Legacy PERF_CTR0-3
+}
+
+// Set or clear a counter's bit in the global control MSR, if there is one. Intel's bit numbers are what PMU_COUNTER_FIXED is based on.
+static void pmu_global_enable(uint64_t counter, uint64_t enable)
+{
+  if(!Global_PMU.Global_Ctrl)
+  {
+    return;
+  }
+
+  uint64_t msr = (Global_PMU.Vendor == PMU_VENDOR_INTEL) ? 0x38F : 0xC0000301; // IA32_PERF_GLOBAL_CTRL, PerfCntrGlobalCtl
+  uint64_t control = msr_rw(msr, 0, 0);
+  if(enable)
+  {
+    control |= 1ULL << counter;
+  }
+  else
+  {
+    control &= ~(1ULL << counter);
+  }
+  msr_rw(msr, control, 1);
+}
+
+// Clear a counter's overflow status bit, where there is one
+ISR_GPR_ONLY static void pmu_clear_overflow(uint64_t counter)
+{
+  if(Global_PMU.Global_Ctrl)
+  {
+    msr_rw((Global_PMU.Vendor == PMU_VENDOR_INTEL) ? 0x390 : 0xC0000302, 1ULL << counter, 1); // IA32_PERF_GLOBAL_OVF_CTRL, PerfCntrGlobalStatusClr
+  }
+}
+
+// Read the TSC
+static uint64_t pmu_rdtsc(void)
+{
+  uint64_t high = 0, low = 0;
+  asm volatile("rdtsc"
+               : "=a" (low), "=d" (high) // Outputs
+               : // Inputs
+               : // Clobbers
+              );
+  return (high << 32) | low;
+}
+
+// Mask for a counter that's 'bits' wide, treating a nonsense width as 64
+static uint64_t pmu_width_mask(uint64_t bits)
+{
+  if((bits == 0) || (bits >= 64))
+  {
+    return ~0ULL;
+  }
+  return (1ULL << bits) - 1;
+}
@@ -75,11 +75,16 @@
 // Comment out this definition to use the "old" method.
 #define NEW_QUICK_SCROLL
 
-static size_t strlen(const char *s);
 static inline int imax(int a, int b);
 static void  printf_putchar(int ch, void *arg);
 static char *ksprintn(char *nbuf, uintmax_t num, int base, int *len, int upper);
 static void  snprintf_func(int ch, void *arg);
+static uint8_t print_lock_take(uint64_t *rflags);
+static void  print_lock_release(uint8_t taken, uint64_t rflags);
+
+// Global_Print_Info's cursor and the framebuffer it draws to are shared by every CPU, so drawing text takes print_lock
+static TICKET_LOCK print_lock = {0};
+static volatile uint64_t print_lock_owner = ~0ULL; // CPU index holding print_lock
 
 #define NBBY    8               /* number of bits in a byte */
 
@@ -96,14 +101,6 @@ struct snprintf_arg {
 	size_t	remain;
 };
 
-static size_t strlen(const char *s)
-{
-	size_t l = 0;
-	while (*s++)
-		l++;
-	return l;
-}
-
 static inline int imax(int a, int b)
 {
 	return (a > b ? a : b);
@@ -161,7 +158,7 @@ int kvprintf(char const *fmt, void (*func)(int, void*), void *arg, int radix, va
 #define PCHAR(c) {int cc=(c); if (func) (*func)(cc,arg); else *d++ = cc; retval++; }
 	char nbuf[MAXNBUF];
 	char *d;
-	const char *p, *percent, *q;
+	const char *p, *percent, *q, *fmt_end;
 	unsigned char *up;
 	int ch, n;
 	uintmax_t num;
@@ -184,15 +181,31 @@ int kvprintf(char const *fmt, void (*func)(int, void*), void *arg, int radix, va
 	if (radix < 2 || radix > 36)
 		radix = 10;
 
+	/*
+	 * Literal text is found with AVX_memchr() instead of a byte at a
+	 * time. A format ending in a lone '%' leaves fmt past the end.
+	 */
+	fmt_end = fmt + AVX_strlen(fmt);
+
 	for (;;) {
 		padc = ' ';
 		width = 0;
-		while ((ch = (unsigned char)*fmt++) != '%' || stop) {
-			if (ch == '\0')
-				return (retval);
-			PCHAR(ch);
+		if (fmt >= fmt_end)
+			return (retval);
+		percent = stop ? NULL : AVX_memchr(fmt, '%', fmt_end - fmt);
+		n = (percent ? percent : fmt_end) - fmt;
+		if (func) {
+			while (n--)
+				PCHAR(*fmt++);
+		} else {
+			AVX_memcpy(d, (void *)fmt, n);
+			d += n;
+			fmt += n;
+			retval += n;
 		}
-		percent = fmt - 1;
+		if (percent == NULL)
+			return (retval);
+		fmt++;
 		qflag = 0; lflag = 0; ladjust = 0; sharpflag = 0; neg = 0;
 		sign = 0; dot = 0; bconv = 0; dwidth = 0; upper = 0;
 		cflag = 0; hflag = 0; jflag = 0; tflag = 0; zflag = 0;
@@ -331,18 +344,23 @@ reswitch:	switch (ch = (unsigned char)*fmt++) {
 			if (p == NULL)
 				p = "(null)";
 			if (!dot)
-				n = strlen (p);
+				n = AVX_strlen(p);
 			else
-				for (n = 0; n < dwidth && p[n]; n++)
-					continue;
+				n = (dwidth > 0) ? AVX_strnlen(p, dwidth) : 0;
 
 			width -= n;
 
 			if (!ladjust && width > 0)
 				while (width--)
 					PCHAR(padc);
-			while (n--)
-				PCHAR(*p++);
+			if (func) {
+				while (n--)
+					PCHAR(*p++);
+			} else {
+				AVX_memcpy(d, (void *)p, n);
+				d += n;
+				retval += n;
+			}
 			if (ladjust && width > 0)
 				while (width--)
 					PCHAR(padc);
@@ -603,7 +621,7 @@ static void printf_putchar(int output_character, void *arglist) // Character is
 					uint64_t min_scroll_size = arg->y + 2*arg->height*arg->scale - arg->defaultGPU.Info->VerticalResolution;
 					arg->y = arg->defaultGPU.Info->VerticalResolution - arg->height * arg->scale;
 
-					AVX_memmove((EFI_PHYSICAL_ADDRESS*)arg->defaultGPU.FrameBufferBase, (EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + arg->defaultGPU.Info->PixelsPerScanLine * 4 * min_scroll_size), (arg->defaultGPU.Info->VerticalResolution - min_scroll_size) * arg->defaultGPU.Info->PixelsPerScanLine*4);
+					Scroll_Framebuffer(&arg->defaultGPU, min_scroll_size, arg->defaultGPU.Info->VerticalResolution - min_scroll_size);
 					if(arg->background_color != 0xFF000000)
 					{
 						AVX_memset_4B((EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + (arg->defaultGPU.Info->VerticalResolution - min_scroll_size) * arg->defaultGPU.Info->PixelsPerScanLine * 4), arg->background_color, (arg->defaultGPU.Info->VerticalResolution - min_scroll_size) * arg->defaultGPU.Info->PixelsPerScanLine);
@@ -611,7 +629,7 @@ static void printf_putchar(int output_character, void *arglist) // Character is
 #else
 					// Old way (gap of background color below the bottommost text line, but no partial scroll up top--the topmost line goes away; VerticalResolution % (height * scale) == 0 fonts don't have to worry if all text on screen is the same size)
 					// Qualitative test results: This can scroll a 4K screen framebuffer (31MB) extremely quickly :D (Interestingly enough, the standard memmove in memmove.c can also do it pretty quickly since GCC vectorizes it.)
-					AVX_memmove((EFI_PHYSICAL_ADDRESS*)arg->defaultGPU.FrameBufferBase, (EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + arg->defaultGPU.Info->PixelsPerScanLine * 4 * arg->height * arg->scale), arg->y * arg->defaultGPU.Info->PixelsPerScanLine*4);
+					Scroll_Framebuffer(&arg->defaultGPU, arg->height * arg->scale, arg->y);
 					if(arg->background_color != 0xFF000000)
 					{
 						AVX_memset_4B((EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + arg->y * arg->defaultGPU.Info->PixelsPerScanLine * 4), arg->background_color, (arg->defaultGPU.Info->VerticalResolution - arg->y) * arg->defaultGPU.Info->PixelsPerScanLine);
@@ -624,6 +642,7 @@ static void printf_putchar(int output_character, void *arglist) // Character is
 					if(arg->background_color != 0xFF000000)
 					{
 						AVX_memset_4B((EFI_PHYSICAL_ADDRESS*)arg->defaultGPU.FrameBufferBase, arg->background_color, arg->defaultGPU.Info->VerticalResolution * arg->defaultGPU.Info->PixelsPerScanLine);
+						Shadow_Mark_Dirty(&arg->defaultGPU, 0, 0, arg->defaultGPU.Info->HorizontalResolution, arg->defaultGPU.Info->VerticalResolution);
 					}
 				}
 				else // Smooth scroll
@@ -635,11 +654,12 @@ static void printf_putchar(int output_character, void *arglist) // Character is
 
 					for(uint64_t smooth = 0; smooth < min_scroll_size; smooth += arg->textscrollmode) // Random: (smooth --> 0) is the same as ((smooth--) > 0); It may not be obvious that they're the same at first glance.
 					{
-						AVX_memmove((EFI_PHYSICAL_ADDRESS*)arg->defaultGPU.FrameBufferBase, (EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + arg->defaultGPU.Info->PixelsPerScanLine * 4 * arg->textscrollmode), (arg->defaultGPU.Info->VerticalResolution - arg->textscrollmode - smooth) * arg->defaultGPU.Info->PixelsPerScanLine * 4);
+						Scroll_Framebuffer(&arg->defaultGPU, arg->textscrollmode, arg->defaultGPU.Info->VerticalResolution - arg->textscrollmode - smooth);
 						if(arg->background_color != 0xFF000000)
 						{
 							AVX_memset_4B((EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + (arg->defaultGPU.Info->VerticalResolution - arg->textscrollmode - smooth) * arg->defaultGPU.Info->PixelsPerScanLine * 4), arg->background_color, arg->textscrollmode*arg->defaultGPU.Info->PixelsPerScanLine);
 						}
+						Shadow_Flush(&arg->defaultGPU); // So that smooth scrolling is still smooth with a shadow framebuffer
 					}
 				}
 			}
@@ -653,7 +673,7 @@ static void printf_putchar(int output_character, void *arglist) // Character is
 			break;
 		case '\a': // BEL
 			// *BEEP* -- there's no output hardware for this yet...
-			Colorscreen(arg->defaultGPU, 0x00FFFFFF); // So make the screen white instead.
+			Colorscreen(&arg->defaultGPU, 0x00FFFFFF); // So make the screen white instead.
 			break;
 		case '\b': // Backspace (non-destructive, though it can be used to overwrite since it just moves the cursor back one)
 			if(arg->index != 0)
@@ -681,7 +701,7 @@ static void printf_putchar(int output_character, void *arglist) // Character is
 						uint64_t min_scroll_size = arg->y + 2*arg->height*arg->scale - arg->defaultGPU.Info->VerticalResolution;
 						arg->y = arg->defaultGPU.Info->VerticalResolution - arg->height * arg->scale;
 
-						AVX_memmove((EFI_PHYSICAL_ADDRESS*)arg->defaultGPU.FrameBufferBase, (EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + arg->defaultGPU.Info->PixelsPerScanLine * 4 * min_scroll_size), (arg->defaultGPU.Info->VerticalResolution - min_scroll_size) * arg->defaultGPU.Info->PixelsPerScanLine*4);
+						Scroll_Framebuffer(&arg->defaultGPU, min_scroll_size, arg->defaultGPU.Info->VerticalResolution - min_scroll_size);
 						if(arg->background_color != 0xFF000000)
 						{
 							AVX_memset_4B((EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + (arg->defaultGPU.Info->VerticalResolution - min_scroll_size) * arg->defaultGPU.Info->PixelsPerScanLine * 4), arg->background_color, (arg->defaultGPU.Info->VerticalResolution - min_scroll_size) * arg->defaultGPU.Info->PixelsPerScanLine);
@@ -689,7 +709,7 @@ static void printf_putchar(int output_character, void *arglist) // Character is
 #else
 						// Old way (gap of background color below the bottommost text line, but no partial scroll up top--the topmost line goes away; VerticalResolution % (height * scale) == 0 fonts don't have to worry if all text on screen is the same size)
 						// Qualitative test results: This can scroll a 4K screen framebuffer (31MB) extremely quickly :D (Interestingly enough, the standard memmove in memmove.c can also do it pretty quickly since GCC vectorizes it.)
-						AVX_memmove((EFI_PHYSICAL_ADDRESS*)arg->defaultGPU.FrameBufferBase, (EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + arg->defaultGPU.Info->PixelsPerScanLine * 4 * arg->height * arg->scale), arg->y * arg->defaultGPU.Info->PixelsPerScanLine*4);
+						Scroll_Framebuffer(&arg->defaultGPU, arg->height * arg->scale, arg->y);
 						if(arg->background_color != 0xFF000000)
 						{
 							AVX_memset_4B((EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + arg->y * arg->defaultGPU.Info->PixelsPerScanLine * 4), arg->background_color, (arg->defaultGPU.Info->VerticalResolution - arg->y) * arg->defaultGPU.Info->PixelsPerScanLine);
@@ -702,6 +722,7 @@ static void printf_putchar(int output_character, void *arglist) // Character is
 						if(arg->background_color != 0xFF000000)
 						{
 							AVX_memset_4B((EFI_PHYSICAL_ADDRESS*)arg->defaultGPU.FrameBufferBase, arg->background_color, arg->defaultGPU.Info->VerticalResolution * arg->defaultGPU.Info->PixelsPerScanLine);
+							Shadow_Mark_Dirty(&arg->defaultGPU, 0, 0, arg->defaultGPU.Info->HorizontalResolution, arg->defaultGPU.Info->VerticalResolution);
 						}
 					}
 					else // Smooth scroll
@@ -713,11 +734,12 @@ static void printf_putchar(int output_character, void *arglist) // Character is
 
 						for(uint64_t smooth = 0; smooth < min_scroll_size; smooth += arg->textscrollmode) // Random: (smooth --> 0) is the same as ((smooth--) > 0); It may not be obvious that they're the same at first glance.
 						{
-							AVX_memmove((EFI_PHYSICAL_ADDRESS*)arg->defaultGPU.FrameBufferBase, (EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + arg->defaultGPU.Info->PixelsPerScanLine * 4 * arg->textscrollmode), (arg->defaultGPU.Info->VerticalResolution - arg->textscrollmode - smooth) * arg->defaultGPU.Info->PixelsPerScanLine * 4);
+							Scroll_Framebuffer(&arg->defaultGPU, arg->textscrollmode, arg->defaultGPU.Info->VerticalResolution - arg->textscrollmode - smooth);
 							if(arg->background_color != 0xFF000000)
 							{
 								AVX_memset_4B((EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + (arg->defaultGPU.Info->VerticalResolution - arg->textscrollmode - smooth) * arg->defaultGPU.Info->PixelsPerScanLine * 4), arg->background_color, arg->textscrollmode*arg->defaultGPU.Info->PixelsPerScanLine);
 							}
+							Shadow_Flush(&arg->defaultGPU); // So that smooth scrolling is still smooth with a shadow framebuffer
 						}
 					}
 				}
@@ -742,7 +764,7 @@ static void printf_putchar(int output_character, void *arglist) // Character is
 					uint64_t min_scroll_size = arg->y + 2*arg->height*arg->scale - arg->defaultGPU.Info->VerticalResolution;
 					arg->y = arg->defaultGPU.Info->VerticalResolution - arg->height * arg->scale;
 
-					AVX_memmove((EFI_PHYSICAL_ADDRESS*)arg->defaultGPU.FrameBufferBase, (EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + arg->defaultGPU.Info->PixelsPerScanLine * 4 * min_scroll_size), (arg->defaultGPU.Info->VerticalResolution - min_scroll_size) * arg->defaultGPU.Info->PixelsPerScanLine*4);
+					Scroll_Framebuffer(&arg->defaultGPU, min_scroll_size, arg->defaultGPU.Info->VerticalResolution - min_scroll_size);
 					if(arg->background_color != 0xFF000000)
 					{
 						AVX_memset_4B((EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + (arg->defaultGPU.Info->VerticalResolution - min_scroll_size) * arg->defaultGPU.Info->PixelsPerScanLine * 4), arg->background_color, (arg->defaultGPU.Info->VerticalResolution - min_scroll_size) * arg->defaultGPU.Info->PixelsPerScanLine);
@@ -750,7 +772,7 @@ static void printf_putchar(int output_character, void *arglist) // Character is
 #else
 					// Old way (gap of background color below the bottommost text line, but no partial scroll up top--the topmost line goes away; VerticalResolution % (height * scale) == 0 fonts don't have to worry if all text on screen is the same size)
 					// Qualitative test results: This can scroll a 4K screen framebuffer (31MB) extremely quickly :D (Interestingly enough, the standard memmove in memmove.c can also do it pretty quickly since GCC vectorizes it.)
-					AVX_memmove((EFI_PHYSICAL_ADDRESS*)arg->defaultGPU.FrameBufferBase, (EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + arg->defaultGPU.Info->PixelsPerScanLine * 4 * arg->height * arg->scale), arg->y * arg->defaultGPU.Info->PixelsPerScanLine*4);
+					Scroll_Framebuffer(&arg->defaultGPU, arg->height * arg->scale, arg->y);
 					if(arg->background_color != 0xFF000000)
 					{
 						AVX_memset_4B((EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + arg->y * arg->defaultGPU.Info->PixelsPerScanLine * 4), arg->background_color, (arg->defaultGPU.Info->VerticalResolution - arg->y) * arg->defaultGPU.Info->PixelsPerScanLine);
@@ -763,6 +785,7 @@ static void printf_putchar(int output_character, void *arglist) // Character is
 					if(arg->background_color != 0xFF000000)
 					{
 						AVX_memset_4B((EFI_PHYSICAL_ADDRESS*)arg->defaultGPU.FrameBufferBase, arg->background_color, arg->defaultGPU.Info->VerticalResolution * arg->defaultGPU.Info->PixelsPerScanLine);
+						Shadow_Mark_Dirty(&arg->defaultGPU, 0, 0, arg->defaultGPU.Info->HorizontalResolution, arg->defaultGPU.Info->VerticalResolution);
 					}
 				}
 				else // Smooth scroll
@@ -774,11 +797,12 @@ static void printf_putchar(int output_character, void *arglist) // Character is
 
 					for(uint64_t smooth = 0; smooth < min_scroll_size; smooth += arg->textscrollmode) // Random: (smooth --> 0) is the same as ((smooth--) > 0); It may not be obvious that they're the same at first glance.
 					{
-						AVX_memmove((EFI_PHYSICAL_ADDRESS*)arg->defaultGPU.FrameBufferBase, (EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + arg->defaultGPU.Info->PixelsPerScanLine * 4 * arg->textscrollmode), (arg->defaultGPU.Info->VerticalResolution - arg->textscrollmode - smooth) * arg->defaultGPU.Info->PixelsPerScanLine * 4);
+						Scroll_Framebuffer(&arg->defaultGPU, arg->textscrollmode, arg->defaultGPU.Info->VerticalResolution - arg->textscrollmode - smooth);
 						if(arg->background_color != 0xFF000000)
 						{
 							AVX_memset_4B((EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + (arg->defaultGPU.Info->VerticalResolution - arg->textscrollmode - smooth) * arg->defaultGPU.Info->PixelsPerScanLine * 4), arg->background_color, arg->textscrollmode*arg->defaultGPU.Info->PixelsPerScanLine);
 						}
+						Shadow_Flush(&arg->defaultGPU); // So that smooth scrolling is still smooth with a shadow framebuffer
 					}
 				}
 			}
@@ -790,7 +814,7 @@ static void printf_putchar(int output_character, void *arglist) // Character is
 		case '\t': // Tab
 			for(int tabspaces = 0; tabspaces < 8; tabspaces++) // Just do the default output actions 8 times with a space character. Tab stops are 8 characters across.
 			{ // But why not just do arg->index += 8? Because then the highlight won't propagate.
-				Output_render_text(arg->defaultGPU, ' ', arg->height, arg->width, arg->font_color, arg->highlight_color, arg->x, arg->y, arg->scale, arg->index);
+				Output_render_text(&arg->defaultGPU, ' ', arg->height, arg->width, arg->font_color, arg->highlight_color, arg->x, arg->y, arg->scale, arg->index);
 		//  	Output_render(Global_Print_Info.defaultGPU, output_character, Global_Print_Info.height, Global_Print_Info.width, Global_Print_Info.font_color, Global_Print_Info.highlight_color, Global_Print_Info.x, Global_Print_Info.y, Global_Print_Info.scale, Global_Print_Info.index);
 
 				arg->index++; // Increment global character index
@@ -813,7 +837,7 @@ static void printf_putchar(int output_character, void *arglist) // Character is
 							uint64_t min_scroll_size = arg->y + 2*arg->height*arg->scale - arg->defaultGPU.Info->VerticalResolution;
 							arg->y = arg->defaultGPU.Info->VerticalResolution - arg->height * arg->scale;
 
-							AVX_memmove((EFI_PHYSICAL_ADDRESS*)arg->defaultGPU.FrameBufferBase, (EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + arg->defaultGPU.Info->PixelsPerScanLine * 4 * min_scroll_size), (arg->defaultGPU.Info->VerticalResolution - min_scroll_size) * arg->defaultGPU.Info->PixelsPerScanLine*4);
+							Scroll_Framebuffer(&arg->defaultGPU, min_scroll_size, arg->defaultGPU.Info->VerticalResolution - min_scroll_size);
 							if(arg->background_color != 0xFF000000)
 							{
 								AVX_memset_4B((EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + (arg->defaultGPU.Info->VerticalResolution - min_scroll_size) * arg->defaultGPU.Info->PixelsPerScanLine * 4), arg->background_color, (arg->defaultGPU.Info->VerticalResolution - min_scroll_size) * arg->defaultGPU.Info->PixelsPerScanLine);
@@ -821,7 +845,7 @@ static void printf_putchar(int output_character, void *arglist) // Character is
 #else
 							// Old way (gap of background color below the bottommost text line, but no partial scroll up top--the topmost line goes away; VerticalResolution % (height * scale) == 0 fonts don't have to worry if all text on screen is the same size)
 							// Qualitative test results: This can scroll a 4K screen framebuffer (31MB) extremely quickly :D (Interestingly enough, the standard memmove in memmove.c can also do it pretty quickly since GCC vectorizes it.)
-							AVX_memmove((EFI_PHYSICAL_ADDRESS*)arg->defaultGPU.FrameBufferBase, (EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + arg->defaultGPU.Info->PixelsPerScanLine * 4 * arg->height * arg->scale), arg->y * arg->defaultGPU.Info->PixelsPerScanLine*4);
+							Scroll_Framebuffer(&arg->defaultGPU, arg->height * arg->scale, arg->y);
 							if(arg->background_color != 0xFF000000)
 							{
 								AVX_memset_4B((EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + arg->y * arg->defaultGPU.Info->PixelsPerScanLine * 4), arg->background_color, (arg->defaultGPU.Info->VerticalResolution - arg->y) * arg->defaultGPU.Info->PixelsPerScanLine);
@@ -834,6 +858,7 @@ static void printf_putchar(int output_character, void *arglist) // Character is
 							if(arg->background_color != 0xFF000000)
 							{
 								AVX_memset_4B((EFI_PHYSICAL_ADDRESS*)arg->defaultGPU.FrameBufferBase, arg->background_color, arg->defaultGPU.Info->VerticalResolution * arg->defaultGPU.Info->PixelsPerScanLine);
+								Shadow_Mark_Dirty(&arg->defaultGPU, 0, 0, arg->defaultGPU.Info->HorizontalResolution, arg->defaultGPU.Info->VerticalResolution);
 							}
 						}
 						else // Smooth scroll
@@ -845,11 +870,12 @@ static void printf_putchar(int output_character, void *arglist) // Character is
 
 							for(uint64_t smooth = 0; smooth < min_scroll_size; smooth += arg->textscrollmode) // Random: (smooth --> 0) is the same as ((smooth--) > 0); It may not be obvious that they're the same at first glance.
 							{
-								AVX_memmove((EFI_PHYSICAL_ADDRESS*)arg->defaultGPU.FrameBufferBase, (EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + arg->defaultGPU.Info->PixelsPerScanLine * 4 * arg->textscrollmode), (arg->defaultGPU.Info->VerticalResolution - arg->textscrollmode - smooth) * arg->defaultGPU.Info->PixelsPerScanLine * 4);
+								Scroll_Framebuffer(&arg->defaultGPU, arg->textscrollmode, arg->defaultGPU.Info->VerticalResolution - arg->textscrollmode - smooth);
 								if(arg->background_color != 0xFF000000)
 								{
 									AVX_memset_4B((EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + (arg->defaultGPU.Info->VerticalResolution - arg->textscrollmode - smooth) * arg->defaultGPU.Info->PixelsPerScanLine * 4), arg->background_color, arg->textscrollmode*arg->defaultGPU.Info->PixelsPerScanLine);
 								}
+								Shadow_Flush(&arg->defaultGPU); // So that smooth scrolling is still smooth with a shadow framebuffer
 							}
 						}
 					}
@@ -861,7 +887,7 @@ static void printf_putchar(int output_character, void *arglist) // Character is
 			}
 			break;
 		default:
-			Output_render_text(arg->defaultGPU, output_character, arg->height, arg->width, arg->font_color, arg->highlight_color, arg->x, arg->y, arg->scale, arg->index);
+			Output_render_text(&arg->defaultGPU, output_character, arg->height, arg->width, arg->font_color, arg->highlight_color, arg->x, arg->y, arg->scale, arg->index);
 	//  	Output_render(Global_Print_Info.defaultGPU, output_character, Global_Print_Info.height, Global_Print_Info.width, Global_Print_Info.font_color, Global_Print_Info.highlight_color, Global_Print_Info.x, Global_Print_Info.y, Global_Print_Info.scale, Global_Print_Info.index);
 
 			arg->index++; // Increment global character index
@@ -884,7 +910,7 @@ static void printf_putchar(int output_character, void *arglist) // Character is
 						uint64_t min_scroll_size = arg->y + 2*arg->height*arg->scale - arg->defaultGPU.Info->VerticalResolution;
 						arg->y = arg->defaultGPU.Info->VerticalResolution - arg->height * arg->scale;
 
-						AVX_memmove((EFI_PHYSICAL_ADDRESS*)arg->defaultGPU.FrameBufferBase, (EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + arg->defaultGPU.Info->PixelsPerScanLine * 4 * min_scroll_size), (arg->defaultGPU.Info->VerticalResolution - min_scroll_size) * arg->defaultGPU.Info->PixelsPerScanLine*4);
+						Scroll_Framebuffer(&arg->defaultGPU, min_scroll_size, arg->defaultGPU.Info->VerticalResolution - min_scroll_size);
 						if(arg->background_color != 0xFF000000)
 						{
 							AVX_memset_4B((EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + (arg->defaultGPU.Info->VerticalResolution - min_scroll_size) * arg->defaultGPU.Info->PixelsPerScanLine * 4), arg->background_color, (arg->defaultGPU.Info->VerticalResolution - min_scroll_size) * arg->defaultGPU.Info->PixelsPerScanLine);
@@ -892,7 +918,7 @@ static void printf_putchar(int output_character, void *arglist) // Character is
 #else
 						// Old way (gap of background color below the bottommost text line, but no partial scroll up top--the topmost line goes away; VerticalResolution % (height * scale) == 0 fonts don't have to worry if all text on screen is the same size)
 						// Qualitative test results: This can scroll a 4K screen framebuffer (31MB) extremely quickly :D (Interestingly enough, the standard memmove in memmove.c can also do it pretty quickly since GCC vectorizes it.)
-						AVX_memmove((EFI_PHYSICAL_ADDRESS*)arg->defaultGPU.FrameBufferBase, (EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + arg->defaultGPU.Info->PixelsPerScanLine * 4 * arg->height * arg->scale), arg->y * arg->defaultGPU.Info->PixelsPerScanLine*4);
+						Scroll_Framebuffer(&arg->defaultGPU, arg->height * arg->scale, arg->y);
 						if(arg->background_color != 0xFF000000)
 						{
 							AVX_memset_4B((EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + arg->y * arg->defaultGPU.Info->PixelsPerScanLine * 4), arg->background_color, (arg->defaultGPU.Info->VerticalResolution - arg->y) * arg->defaultGPU.Info->PixelsPerScanLine);
@@ -905,6 +931,7 @@ static void printf_putchar(int output_character, void *arglist) // Character is
 						if(arg->background_color != 0xFF000000)
 						{
 							AVX_memset_4B((EFI_PHYSICAL_ADDRESS*)arg->defaultGPU.FrameBufferBase, arg->background_color, arg->defaultGPU.Info->VerticalResolution * arg->defaultGPU.Info->PixelsPerScanLine);
+							Shadow_Mark_Dirty(&arg->defaultGPU, 0, 0, arg->defaultGPU.Info->HorizontalResolution, arg->defaultGPU.Info->VerticalResolution);
 						}
 					}
 					else // Smooth scroll
@@ -916,11 +943,12 @@ static void printf_putchar(int output_character, void *arglist) // Character is
 
 						for(uint64_t smooth = 0; smooth < min_scroll_size; smooth += arg->textscrollmode) // Random: (smooth --> 0) is the same as ((smooth--) > 0); It may not be obvious that they're the same at first glance.
 						{
-							AVX_memmove((EFI_PHYSICAL_ADDRESS*)arg->defaultGPU.FrameBufferBase, (EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + arg->defaultGPU.Info->PixelsPerScanLine * 4 * arg->textscrollmode), (arg->defaultGPU.Info->VerticalResolution - arg->textscrollmode - smooth) * arg->defaultGPU.Info->PixelsPerScanLine * 4);
+							Scroll_Framebuffer(&arg->defaultGPU, arg->textscrollmode, arg->defaultGPU.Info->VerticalResolution - arg->textscrollmode - smooth);
 							if(arg->background_color != 0xFF000000)
 							{
 								AVX_memset_4B((EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + (arg->defaultGPU.Info->VerticalResolution - arg->textscrollmode - smooth) * arg->defaultGPU.Info->PixelsPerScanLine * 4), arg->background_color, arg->textscrollmode*arg->defaultGPU.Info->PixelsPerScanLine);
 							}
+							Shadow_Flush(&arg->defaultGPU); // So that smooth scrolling is still smooth with a shadow framebuffer
 						}
 					}
 				}
@@ -933,6 +961,32 @@ static void printf_putchar(int output_character, void *arglist) // Character is
 	}
 }
 
+// Take print_lock with interrupts off, unless this CPU already has it, which happens when an exception handler prints over a printf()
+// it interrupted. Returns 1 if the lock was taken, for print_lock_release().
+static uint8_t print_lock_take(uint64_t *rflags)
+{
+	uint64_t cpu = Global_SMP_Info.Number_of_CPUs ? get_cpu_index() : 0; // %gs isn't set up before Setup_Per_CPU_Data(), but then there's only the BSP
+
+	if(__atomic_load_n(&print_lock_owner, __ATOMIC_RELAXED) == cpu)
+	{
+		return 0;
+	}
+
+	*rflags = Ticket_Lock_IRQ_Save(&print_lock);
+	print_lock_owner = cpu;
+
+	return 1;
+}
+
+static void print_lock_release(uint8_t taken, uint64_t rflags)
+{
+	if(taken)
+	{
+		print_lock_owner = ~0ULL;
+		Ticket_Unlock_IRQ_Restore(&print_lock, rflags);
+	}
+}
+
 // Now we can define a real printf()!
 int printf(const char *fmt, ...)
 {
@@ -940,8 +994,7 @@ int printf(const char *fmt, ...)
 	int retval;
 
 	va_start(ap, fmt);
-	retval = kvprintf(fmt, printf_putchar, &Global_Print_Info, 10, ap); // The third argument is any arguments to be passed to putchar (e.g. &pca - putchar args)
-// retval = kvprintf(fmt, printf_putchar, NULL, 10, ap); // This could work, too (requires using similarly commented code in printf_putchar... Which would be somewhat of a hassle at this point. All those arg->whatever would need to be changed, too!!)
+	retval = vprintf(fmt, ap);
 	va_end(ap);
 
 	return (retval);
@@ -951,12 +1004,69 @@ int printf(const char *fmt, ...)
 int vprintf(const char *fmt, va_list ap)
 {
 	int retval;
+	uint64_t rflags = 0;
+
+	if(Global_Console.Deferred || (Global_Console.Sinks != CONSOLE_SINK_FRAMEBUFFER))
+	{
+		return (Console_vprintf(fmt, ap)); // Queues the text, see Console.c
+	}
+
+	uint8_t taken = print_lock_take(&rflags);
 
-	retval = kvprintf(fmt, printf_putchar, &Global_Print_Info, 10, ap);
+	retval = kvprintf(fmt, printf_putchar, &Global_Print_Info, 10, ap); // The third argument is any arguments to be passed to putchar (e.g. &pca - putchar args)
+// retval = kvprintf(fmt, printf_putchar, NULL, 10, ap); // This could work, too (requires using similarly commented code in printf_putchar... Which would be somewhat of a hassle at this point. All those arg->whatever would need to be changed, too!!)
+
+	Shadow_Flush(&Global_Print_Info.defaultGPU); // Does nothing without a shadow framebuffer
+
+	print_lock_release(taken, rflags);
 
 	return (retval);
 }
 
+// Draw already-formatted text, no matter what mode the console is in. This is how Console.c draws queued text.
+// Doesn't flush the shadow framebuffer, that's left to the caller so that a batch can be flushed all at once.
+// Runs of printable characters that fit on the current line are drawn together with Render_Text_Span(); control characters and the
+// character that wraps the line go through printf_putchar() as usual.
+void print_direct(const char * string, uint64_t length)
+{
+	GLOBAL_PRINT_INFO_STRUCT * arg = &Global_Print_Info;
+	RENDER_TARGET target;
+	uint64_t rflags = 0;
+
+	uint8_t taken = print_lock_take(&rflags);
+
+	uint64_t i = 0;
+	while(i < length)
+	{
+		Render_Target_Init(&target, &arg->defaultGPU); // Every time, since scrolling a shadow framebuffer moves FrameBufferBase
+
+		// Same wrap condition as printf_putchar(): the character drawn at index k wraps if (k + 1) * width * scale > HorizontalResolution - width * scale
+		uint64_t char_pixels = (uint64_t)arg->width * arg->scale;
+		uint64_t line_chars = (char_pixels && (target.Width >= char_pixels)) ? (target.Width - char_pixels) / char_pixels : 0;
+		uint64_t room = (line_chars > arg->index) ? line_chars - arg->index : 0;
+
+		uint64_t run = 0;
+		while((run < room) && (i + run < length) && ((unsigned char)string[i + run] >= 0x20) && ((unsigned char)string[i + run] != 0x7F) && ((unsigned char)string[i + run] != 0x85))
+		{
+			run++;
+		}
+
+		if(run)
+		{
+			Render_Text_Span(&target, &string[i], run, arg->height, arg->width, arg->font_color, arg->highlight_color, arg->x + arg->index * (uint32_t)char_pixels, arg->y, arg->scale);
+			arg->index += (uint32_t)run;
+			i += run;
+		}
+		else
+		{
+			printf_putchar((unsigned char)string[i], arg);
+			i++;
+		}
+	}
+
+	print_lock_release(taken, rflags);
+}
+
 // Likewise a real sprintf()!
 /*
  * Scaled down version of sprintf(3).
@@ -0,0 +1,833 @@
+//==================================================================================================================================
+//  Simple Kernel: Multiprocessor Initialization
+//==================================================================================================================================
+//
+// Version 0.z
+//
+// Author:
+//  KNNSpeed
+//
+// Source Code:
+//  https://github.com/KNNSpeed/Simple-Kernel
+//
+// This file contains functions for starting the application processors (APs) listed in the ACPI MADT, per-CPU data access, local
+// and I/O APIC access, and a simple way to hand work to an AP.
+//
+// Everything in System_Init() runs on the bootstrap processor (BSP). Setup_SMP() then wakes up each AP with the INIT-SIPI-SIPI
+// sequence (Intel Architecture Manual Vol. 3A, Section 8.4.4 MP Initialization Example). Each AP comes up through the trampoline in
+// startup/AP_Trampoline.S, lands in AP_Main(), loads its own GDT and TSS (with its own IST stacks), the shared IDT, the BSP's paging
+// and control register setup, and then idles until work gets posted to its mailbox with SMP_Run_On_CPU().
+//
+// Each CPU's IA32_GS_BASE MSR points to its own PER_CPU_STRUCT in Global_Per_CPU_Data, so get_cpu_data() works on any CPU once
+// Setup_Per_CPU_Data() (BSP) or AP_Main() (APs) has run.
+//
+// NOTE: APs don't print anything. printf isn't safe to call from more than one CPU at a time.
+//
+
+#include "Kernel64.h"
+
+static void AP_Main(PER_CPU_STRUCT * cpu);
+static void ap_segment_update(void);
+static void ap_idle_loop(PER_CPU_STRUCT * cpu);
+static EFI_PHYSICAL_ADDRESS find_trampoline_pages(void);
+static void setup_ap_descriptors(PER_CPU_STRUCT * cpu);
+static uint8_t start_ap(PER_CPU_STRUCT * cpu, EFI_PHYSICAL_ADDRESS trampoline_base);
+static uint32_t ioapic_rw(uint32_t base, uint32_t reg, uint32_t data, int rw);
+
+// Stack sizes defined in number of bytes, e.g. (1 << 12) is 4kiB. The BSP uses kernel_stack in Kernel64.c and the IST stacks in
+// System.c, so entry 0 of each of these is unused.
+#define AP_STACK_SIZE (1 << 16)
+#define AP_IST_STACK_SIZE (1 << 12)
+
+// Same IST assignments as Setup_IDT(): 1 = NMI, 2 = #DF, 3 = #MC, 4 = #BP
+#define AP_IST_STACKS 4
+
+// Ensuring 64-byte alignment for good measure, like the BSP's stacks
+__attribute__((aligned(64))) static volatile unsigned char AP_stacks[MAX_CPUS][AP_STACK_SIZE] = {0};
+__attribute__((aligned(64))) static volatile unsigned char AP_IST_stacks[MAX_CPUS][AP_IST_STACKS][AP_IST_STACK_SIZE] = {0};
+
+// The trampoline needs 2 pages below 1MB: 1 for the code and data, 1 for the outermost page table copy
+#define TRAMPOLINE_PAGES 2
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Setup_Per_CPU_Data: Set Up the BSP's Per-CPU Data
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Fill in the BSP's PER_CPU_STRUCT (always Global_Per_CPU_Data[0]) and point IA32_GS_BASE at it.
+//
+// This needs to go after Setup_MinimalGDT(), since reloading %gs there zeroes the GS base.
+//
+
+void Setup_Per_CPU_Data(void)
+{
+  PER_CPU_STRUCT * bsp = &Global_Per_CPU_Data[0];
+
+  bsp->Self = bsp;
+  bsp->CPU_Index = 0;
+  bsp->APIC_ID = get_apic_id();
+  bsp->Stack_Top = 0; // kernel_stack, which is static in Kernel64.c
+  bsp->Online = 1;
+
+  Global_SMP_Info.BSP_APIC_ID = bsp->APIC_ID;
+  Global_SMP_Info.Number_of_CPUs = 1;
+  Global_SMP_Info.Online_CPUs = 1;
+
+  msr_rw(0xC0000101, (uint64_t)bsp, 1); // IA32_GS_BASE
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Setup_SMP: Start Application Processors
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Start every enabled AP listed in the ACPI MADT, up to MAX_CPUS logical CPUs in total.
+//
+// Requires: ACPI_Init(), Setup_Per_CPU_Data(), Setup_IDT(), Setup_Paging(), and Setup_Clock(). It should also go after the EFI Boot Services memory
+// has been reclaimed, since that's where a lot of the free memory below 1MB usually is.
+//
+// The local APICs are switched to x2APIC mode if the CPU supports it, otherwise they're used in xAPIC mode through their MMIO
+// registers (which are covered by the identity map from Setup_Paging()).
+//
+
+void Setup_SMP(void)
+{
+  MADT_STRUCT * madt = (MADT_STRUCT *)ACPI_Find_Table("APIC", 0);
+  if(madt == NULL)
+  {
+    printf("Setup_SMP: No MADT, only the BSP will be used.\r\n");
+    return;
+  }
+
+  // Local APIC mode
+  uint64_t rcx = 0;
+  asm volatile("cpuid"
+               : "=c" (rcx) // Outputs
+               : "a" (0x01) // The value to put into %rax
+               : "%rbx", "%rdx" // CPUID clobbers all not-explicitly-used abcd registers
+             );
+
+  uint64_t apic_base_msr = msr_rw(0x1B, 0, 0); // IA32_APIC_BASE
+  if(rcx & (1 << 21)) // x2APIC supported
+  {
+    msr_rw(0x1B, apic_base_msr | (1 << 11) | (1 << 10), 1); // Global enable + x2APIC mode
+    Global_SMP_Info.x2APIC = 1;
+  }
+  else
+  {
+    msr_rw(0x1B, apic_base_msr | (1 << 11), 1); // Global enable
+    Global_SMP_Info.x2APIC = 0;
+  }
+  Global_SMP_Info.LAPIC_Base = apic_base_msr & 0x000FFFFFFFFFF000;
+
+  // Software-enable the BSP's local APIC (Spurious Interrupt Vector Register bit 8), spurious vector is 0xFF
+  lapic_rw(0xF0, lapic_rw(0xF0, 0, 0) | 0x1FF, 1);
+
+  // The APIC ID may read differently in x2APIC mode
+  Global_Per_CPU_Data[0].APIC_ID = get_apic_id();
+  Global_SMP_Info.BSP_APIC_ID = Global_Per_CPU_Data[0].APIC_ID;
+
+  // APs copy all of these
+  Global_SMP_Info.BSP_CR0 = control_register_rw(0, 0, 0);
+  Global_SMP_Info.BSP_CR3 = control_register_rw(3, 0, 0);
+  Global_SMP_Info.BSP_CR4 = control_register_rw(4, 0, 0);
+  Global_SMP_Info.BSP_EFER = msr_rw(0xC0000080, 0, 0);
+  Global_SMP_Info.BSP_PAT = msr_rw(0x277, 0, 0);
+  if(Global_SMP_Info.BSP_CR4 & (1 << 18)) // CR4.OSXSAVE
+  {
+    Global_SMP_Info.BSP_XCR0 = xcr_rw(0, 0, 0);
+  }
+  Global_SMP_Info.BSP_IDTR = get_idtr();
+
+  EFI_PHYSICAL_ADDRESS trampoline_base = find_trampoline_pages();
+  if(trampoline_base == ~0ULL)
+  {
+    printf("Setup_SMP: No free memory below 1MB for the AP trampoline, only the BSP will be used.\r\n");
+    return;
+  }
+
+  uint64_t trampoline_size = (uint64_t)AP_Trampoline_End - (uint64_t)AP_Trampoline_Start;
+  AVX_memcpy((void*)trampoline_base, AP_Trampoline_Start, trampoline_size);
+  // Outermost page table copy goes in the next page, since the AP can only load a 32-bit CR3 from real mode
+  AVX_memcpy((void*)(trampoline_base + 4096), (void*)(Global_SMP_Info.BSP_CR3 & ~0xFFFULL), 4096);
+
+  AP_TRAMPOLINE_DATA_STRUCT * data = (AP_TRAMPOLINE_DATA_STRUCT *)(trampoline_base + ((uint64_t)AP_Trampoline_Data - (uint64_t)AP_Trampoline_Start));
+  data->GDTR_Base = (uint32_t)((uint64_t)data->GDT);
+  data->LongMode_Offset = (uint32_t)(trampoline_base + ((uint64_t)AP_Trampoline_LongMode - (uint64_t)AP_Trampoline_Start));
+  data->CR3 = (uint32_t)(trampoline_base + 4096);
+  data->CR4 = (1 << 5) | (uint32_t)(Global_SMP_Info.BSP_CR4 & (1 << 12)); // PAE, LA57 (can only be set outside of 64-bit mode)
+  data->EFER = (1 << 8) | (uint32_t)(Global_SMP_Info.BSP_EFER & (1 << 11)); // LME, NXE
+  data->CR0 = (uint32_t)Global_SMP_Info.BSP_CR0; // Has PE and PG
+  data->Entry = (uint64_t)AP_Main;
+
+  // Walk the MADT's interrupt controller structures
+  uint8_t * entry = (uint8_t*)madt + sizeof(MADT_STRUCT);
+  uint8_t * madt_end = (uint8_t*)madt + madt->SDTHeader.Length;
+
+  while((entry + sizeof(MADT_ENTRY_HEADER_STRUCT)) <= madt_end)
+  {
+    MADT_ENTRY_HEADER_STRUCT * header = (MADT_ENTRY_HEADER_STRUCT *)entry;
+    if(header->Length < sizeof(MADT_ENTRY_HEADER_STRUCT))
+    {
+      printf("Setup_SMP: Malformed MADT entry.\r\n");
+      break;
+    }
+
+    uint32_t apic_id = 0, acpi_uid = 0, flags = 0;
+    uint8_t is_cpu = 0;
+
+    if(header->Type == 0) // Processor Local APIC
+    {
+      MADT_LOCAL_APIC_STRUCT * lapic = (MADT_LOCAL_APIC_STRUCT *)entry;
+      apic_id = lapic->APICID;
+      acpi_uid = lapic->ACPIProcessorUID;
+      flags = lapic->Flags;
+      is_cpu = 1;
+    }
+    else if(header->Type == 9) // Processor Local x2APIC
+    {
+      MADT_LOCAL_X2APIC_STRUCT * x2apic = (MADT_LOCAL_X2APIC_STRUCT *)entry;
+      apic_id = x2apic->X2APICID;
+      acpi_uid = x2apic->ACPIProcessorUID;
+      flags = x2apic->Flags;
+      is_cpu = 1;
+    }
+
+    entry += header->Length;
+
+    if((!is_cpu) || (!(flags & 1)) || (apic_id == Global_SMP_Info.BSP_APIC_ID))
+    {
+      continue; // Not a CPU, disabled, or it's this CPU
+    }
+
+    if((!Global_SMP_Info.x2APIC) && (apic_id > 0xFE))
+    {
+      printf("Setup_SMP: APIC ID %u needs x2APIC mode, skipping it.\r\n", apic_id);
+      continue;
+    }
+
+    // Some firmware lists a CPU as both types
+    uint8_t duplicate = 0;
+    for(uint64_t i = 0; i < Global_SMP_Info.Number_of_CPUs; i++)
+    {
+      if(Global_Per_CPU_Data[i].APIC_ID == apic_id)
+      {
+        duplicate = 1;
+        break;
+      }
+    }
+    if(duplicate)
+    {
+      continue;
+    }
+
+    if(Global_SMP_Info.Number_of_CPUs >= MAX_CPUS)
+    {
+      printf("Setup_SMP: More than MAX_CPUS (%u) CPUs, ignoring the rest.\r\n", MAX_CPUS);
+      break;
+    }
+
+    PER_CPU_STRUCT * cpu = &Global_Per_CPU_Data[Global_SMP_Info.Number_of_CPUs];
+    cpu->Self = cpu;
+    cpu->CPU_Index = Global_SMP_Info.Number_of_CPUs;
+    cpu->APIC_ID = apic_id;
+    cpu->ACPI_UID = acpi_uid;
+    cpu->NUMA_Node = NUMA_Node_Of_APIC(apic_id);
+    cpu->Stack_Top = (uint64_t)&AP_stacks[cpu->CPU_Index][AP_STACK_SIZE]; // %rsp is decremented before use
+    setup_ap_descriptors(cpu);
+
+    // The entry is used even if the AP fails to start so that its stack is never handed to another AP
+    Global_SMP_Info.Number_of_CPUs++;
+
+    data->Stack = cpu->Stack_Top;
+    data->Argument = (uint64_t)cpu;
+
+    if(!start_ap(cpu, trampoline_base))
+    {
+      printf("Setup_SMP: CPU with APIC ID %u did not start.\r\n", apic_id);
+    }
+  }
+
+  printf("SMP: %llu of %llu CPUs online (%s mode).\r\n", Global_SMP_Info.Online_CPUs, Global_SMP_Info.Number_of_CPUs, Global_SMP_Info.x2APIC ? "x2APIC" : "xAPIC");
+  // The trampoline pages are still EfiConventionalMemory, and are free for use again now that all the APs are in AP_Main().
+}
+
+// Per-AP GDT copy with its own TSS, and a TSS with its own IST stacks
+static void setup_ap_descriptors(PER_CPU_STRUCT * cpu)
+{
+  uint64_t tss64_addr = (uint64_t)&cpu->TSS;
+
+  // Same as MinimalGDT in System.c
+  cpu->GDT[0] = 0;
+  cpu->GDT[1] = 0x00af9a000000ffff;
+  cpu->GDT[2] = 0x00cf92000000ffff;
+  cpu->GDT[3] = 0x0080890000000067;
+  cpu->GDT[4] = 0;
+
+  ( (TSS_LDT_ENTRY_STRUCT*) &((GDT_ENTRY_STRUCT*)cpu->GDT)[3] )->BaseAddress1 = (uint16_t)tss64_addr;
+  ( (TSS_LDT_ENTRY_STRUCT*) &((GDT_ENTRY_STRUCT*)cpu->GDT)[3] )->BaseAddress2 = (uint8_t)(tss64_addr >> 16);
+  ( (TSS_LDT_ENTRY_STRUCT*) &((GDT_ENTRY_STRUCT*)cpu->GDT)[3] )->BaseAddress3 = (uint8_t)(tss64_addr >> 24);
+  ( (TSS_LDT_ENTRY_STRUCT*) &((GDT_ENTRY_STRUCT*)cpu->GDT)[3] )->BaseAddress4 = (uint32_t)(tss64_addr >> 32); // TSS is a double-sized entry
+
+  AVX_memset(&cpu->TSS, 0, sizeof(TSS64_STRUCT));
+
+  // IST pointers are stack tops, since %rsp is decremented before use
+  uint64_t ist_1 = (uint64_t)&AP_IST_stacks[cpu->CPU_Index][0][AP_IST_STACK_SIZE];
+  uint64_t ist_2 = (uint64_t)&AP_IST_stacks[cpu->CPU_Index][1][AP_IST_STACK_SIZE];
+  uint64_t ist_3 = (uint64_t)&AP_IST_stacks[cpu->CPU_Index][2][AP_IST_STACK_SIZE];
+  uint64_t ist_4 = (uint64_t)&AP_IST_stacks[cpu->CPU_Index][3][AP_IST_STACK_SIZE];
+
+  cpu->TSS.IST_1_low = (uint32_t)ist_1;
+  cpu->TSS.IST_1_high = (uint32_t)(ist_1 >> 32);
+
+  cpu->TSS.IST_2_low = (uint32_t)ist_2;
+  cpu->TSS.IST_2_high = (uint32_t)(ist_2 >> 32);
+
+  cpu->TSS.IST_3_low = (uint32_t)ist_3;
+  cpu->TSS.IST_3_high = (uint32_t)(ist_3 >> 32);
+
+  cpu->TSS.IST_4_low = (uint32_t)ist_4;
+  cpu->TSS.IST_4_high = (uint32_t)(ist_4 >> 32);
+
+  cpu->TSS.IO_Map_Base = sizeof(TSS64_STRUCT); // No I/O permission bitmap
+}
+
+// INIT-SIPI-SIPI, returns 1 once the AP is online or 0 if it didn't show up within 100ms
+static uint8_t start_ap(PER_CPU_STRUCT * cpu, EFI_PHYSICAL_ADDRESS trampoline_base)
+{
+  uint32_t sipi_vector = (uint32_t)(trampoline_base >> 12); // Page number below 1MB
+
+  lapic_send_ipi(cpu->APIC_ID, 0x00004500); // INIT, level assert
+  delay_us(10000); // 10ms
+
+  for(uint64_t sipi = 0; sipi < 2; sipi++)
+  {
+    lapic_send_ipi(cpu->APIC_ID, 0x00004600 | sipi_vector); // Startup IPI
+    delay_us(200); // 200us
+
+    if(cpu->Online)
+    {
+      return 1;
+    }
+  }
+
+  for(uint64_t wait = 0; wait < 1000; wait++)
+  {
+    if(cpu->Online)
+    {
+      return 1;
+    }
+    delay_us(100);
+  }
+
+  // Put it back into wait-for-SIPI so it can't pick up the next AP's trampoline data if it's just slow
+  lapic_send_ipi(cpu->APIC_ID, 0x00004500);
+  delay_us(10000);
+
+  return 0;
+}
+
+// Find TRAMPOLINE_PAGES free pages below 1MB, excluding page 0
+static EFI_PHYSICAL_ADDRESS find_trampoline_pages(void)
+{
+  EFI_MEMORY_DESCRIPTOR * Piece;
+
+  for(Piece = Global_Memory_Info.MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
+  {
+    if(Piece->Type == EfiConventionalMemory)
+    {
+      EFI_PHYSICAL_ADDRESS start = Piece->PhysicalStart;
+      EFI_PHYSICAL_ADDRESS end = Piece->PhysicalStart + (Piece->NumberOfPages << EFI_PAGE_SHIFT);
+
+      if(start < (1 << 12))
+      {
+        start = (1 << 12);
+      }
+      if(end > (1 << 20))
+      {
+        end = (1 << 20);
+      }
+
+      if((start < end) && ((end - start) >= (TRAMPOLINE_PAGES << EFI_PAGE_SHIFT)))
+      {
+        return start;
+      }
+    }
+  }
+
+  return ~0ULL;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// AP_Main: Application Processor Entry Point
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// The trampoline calls this on the AP's own stack, with a pointer to its PER_CPU_STRUCT.
+//
+
+static void AP_Main(PER_CPU_STRUCT * cpu)
+{
+  // The page tables' PAT bits assume the BSP's PAT layout (e.g. write-combining framebuffers), so that has to match first.
+  msr_rw(0x277, Global_SMP_Info.BSP_PAT, 1);
+  // Real page tables next, the trampoline's copy may get overwritten once this AP is online.
+  control_register_rw(3, Global_SMP_Info.BSP_CR3, 1);
+
+  control_register_rw(0, Global_SMP_Info.BSP_CR0, 1);
+  control_register_rw(4, Global_SMP_Info.BSP_CR4, 1); // OSFXSR, OSXMMEXCPT, OSXSAVE, PGE, etc.
+  if(Global_SMP_Info.BSP_CR4 & (1 << 18)) // CR4.OSXSAVE
+  {
+    xcr_rw(0, Global_SMP_Info.BSP_XCR0, 1); // Same AVX state as the BSP
+  }
+
+  // Own GDT and TSS (for own IST stacks), shared IDT
+  DT_STRUCT gdt_reg_data = {0};
+  gdt_reg_data.Limit = sizeof(cpu->GDT) - 1;
+  gdt_reg_data.BaseAddress = (uint64_t)cpu->GDT;
+  set_gdtr(gdt_reg_data);
+  set_tsr(0x18);
+  ap_segment_update();
+  set_idtr(Global_SMP_Info.BSP_IDTR);
+
+  // Segment reload zeroes the GS base, so this goes after it
+  msr_rw(0xC0000101, (uint64_t)cpu, 1); // IA32_GS_BASE
+  msr_rw(0xC0000103, cpu->CPU_Index, 1); // IA32_TSC_AUX, which RDTSCP returns in %ecx. Trace_Event() uses it as the CPU index.
+
+  // Local APIC: same mode as the BSP, software-enabled
+  uint64_t apic_base_msr = msr_rw(0x1B, 0, 0);
+  if(Global_SMP_Info.x2APIC)
+  {
+    msr_rw(0x1B, apic_base_msr | (1 << 11) | (1 << 10), 1);
+  }
+  else
+  {
+    msr_rw(0x1B, apic_base_msr | (1 << 11), 1);
+  }
+  lapic_rw(0xF0, lapic_rw(0xF0, 0, 0) | 0x1FF, 1);
+
+  __atomic_add_fetch(&Global_SMP_Info.Online_CPUs, 1, __ATOMIC_SEQ_CST);
+  __atomic_store_n(&cpu->Online, 1, __ATOMIC_RELEASE);
+
+  ap_idle_loop(cpu);
+}
+
+// Same trick as cs_update() in System.c, see that function for details. The offset is hardcoded to the size of the rest of the asm.
+static void ap_segment_update(void)
+{
+  asm volatile("mov $16, %%ax \n\t" // Data segment index
+               "mov %%ax, %%ds \n\t"
+               "mov %%ax, %%es \n\t"
+               "mov %%ax, %%fs \n\t"
+               "mov %%ax, %%gs \n\t"
+               "mov %%ax, %%ss \n\t"
+               "movq $8, %%rdx \n\t" // 64-bit code segment index
+               "leaq 4(%%rip), %%rax \n\t" // Points right after 'lretq'
+               "pushq %%rdx \n\t"
+               "pushq %%rax \n\t"
+               "lretq \n\t"
+               : // No outputs
+               : // No inputs
+               : "%rax", "%rdx", "memory" // Clobbers
+              );
+}
+
+// Whether there's no work ready to run in this CPU's mailbox
+static inline uint8_t mailbox_empty(PER_CPU_STRUCT * cpu)
+{
+  uint64_t sequence = __atomic_load_n(&cpu->Work_Sequence, __ATOMIC_ACQUIRE);
+
+  return (sequence & 1) || (__atomic_load_n(&cpu->Work_Done, __ATOMIC_ACQUIRE) == sequence);
+}
+
+// Wait for work with MONITOR/MWAIT if available, otherwise spin with PAUSE. Never returns.
+static void ap_idle_loop(PER_CPU_STRUCT * cpu)
+{
+  uint64_t rcx = 0;
+  asm volatile("cpuid"
+               : "=c" (rcx) // Outputs
+               : "a" (0x01) // The value to put into %rax
+               : "%rbx", "%rdx" // CPUID clobbers all not-explicitly-used abcd registers
+             );
+  uint8_t has_mwait = (rcx & (1 << 3)) ? 1 : 0;
+
+  while(1)
+  {
+    // An odd sequence means a poster has claimed the mailbox but hasn't finished filling it in yet
+    while(mailbox_empty(cpu))
+    {
+      if(has_mwait)
+      {
+        asm volatile("monitor"
+                     : // No outputs
+                     : "a" (&cpu->Work_Sequence), "c" (0), "d" (0) // Inputs
+                     : // No clobbers
+                   );
+        // Re-check after arming the monitor, or a post that happened in between would be missed until the next wakeup
+        if(mailbox_empty(cpu))
+        {
+          asm volatile("mwait"
+                       : // No outputs
+                       : "a" (0), "c" (0) // C1, no extensions
+                       : // No clobbers
+                     );
+        }
+      }
+      else
+      {
+        asm volatile("pause");
+      }
+    }
+
+    uint64_t sequence = __atomic_load_n(&cpu->Work_Sequence, __ATOMIC_ACQUIRE);
+    void (*func)(void *) = cpu->Work_Function;
+    void * arg = cpu->Work_Argument;
+
+    if(func != NULL)
+    {
+      func(arg);
+    }
+
+    __atomic_store_n(&cpu->Work_Done, sequence, __ATOMIC_RELEASE);
+  }
+}
+
+// Post func(arg) to an idle AP's mailbox. Work_Sequence is even while the mailbox is usable, so whoever moves it from the idle value
+// to the next odd one owns the mailbox until it stores the next even value. A failed CAS means someone else got there first.
+static uint8_t mailbox_post(PER_CPU_STRUCT * cpu, void (*func)(void * arg), void * arg)
+{
+  uint64_t sequence = __atomic_load_n(&cpu->Work_Sequence, __ATOMIC_ACQUIRE);
+
+  if((sequence & 1) || (__atomic_load_n(&cpu->Work_Done, __ATOMIC_ACQUIRE) != sequence))
+  {
+    return 0; // Busy, or being posted to
+  }
+
+  if(!__atomic_compare_exchange_n(&cpu->Work_Sequence, &sequence, sequence + 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+  {
+    return 0;
+  }
+
+  cpu->Work_Function = func;
+  cpu->Work_Argument = arg;
+  __atomic_store_n(&cpu->Work_Sequence, sequence + 2, __ATOMIC_RELEASE); // This write also wakes up MWAIT
+
+  return 1;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// SMP_Run_On_CPU: Post Work to an AP
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Have the AP at Global_Per_CPU_Data[cpu_index] call func(arg). This waits for any work previously posted to that AP to finish, but
+// it does not wait for this work to finish: use SMP_Wait_On_CPU() for that.
+//
+// Any number of CPUs can post to the same AP; the mailbox is claimed with a CAS, so each post runs exactly once. The work runs with
+// interrupts disabled on the AP's own stack.
+//
+// Returns 1 if the work was posted, or 0 if the CPU isn't an online AP (the BSP can't be posted to; just call func directly).
+//
+
+uint8_t SMP_Run_On_CPU(uint64_t cpu_index, void (*func)(void * arg), void * arg)
+{
+  if((cpu_index == 0) || (cpu_index >= Global_SMP_Info.Number_of_CPUs) || (!Global_Per_CPU_Data[cpu_index].Online))
+  {
+    return 0;
+  }
+
+  PER_CPU_STRUCT * cpu = &Global_Per_CPU_Data[cpu_index];
+
+  while(!mailbox_post(cpu, func, arg))
+  {
+    asm volatile("pause");
+  }
+
+  return 1;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// SMP_Try_Run_On_CPU: Post Work to an Idle AP
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Like SMP_Run_On_CPU(), but never waits: if the AP at Global_Per_CPU_Data[cpu_index] is still running earlier work, or another CPU
+// is posting to it at the same moment, this gives up instead.
+//
+// Returns 1 if the work was posted, or 0 if the AP was busy or the CPU isn't an online AP.
+//
+
+uint8_t SMP_Try_Run_On_CPU(uint64_t cpu_index, void (*func)(void * arg), void * arg)
+{
+  if((cpu_index == 0) || (cpu_index >= Global_SMP_Info.Number_of_CPUs) || (!Global_Per_CPU_Data[cpu_index].Online))
+  {
+    return 0;
+  }
+
+  return mailbox_post(&Global_Per_CPU_Data[cpu_index], func, arg);
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// SMP_Wait_On_CPU: Wait for Posted Work to Finish
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Spin until the AP at Global_Per_CPU_Data[cpu_index] has finished the work posted by SMP_Run_On_CPU().
+//
+
+void SMP_Wait_On_CPU(uint64_t cpu_index)
+{
+  if(cpu_index >= Global_SMP_Info.Number_of_CPUs)
+  {
+    return;
+  }
+
+  PER_CPU_STRUCT * cpu = &Global_Per_CPU_Data[cpu_index];
+
+  while(__atomic_load_n(&cpu->Work_Done, __ATOMIC_ACQUIRE) != __atomic_load_n(&cpu->Work_Sequence, __ATOMIC_ACQUIRE))
+  {
+    asm volatile("pause");
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// get_cpu_data: Get This CPU's Per-CPU Data
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Returns a pointer to the calling CPU's PER_CPU_STRUCT by way of the Self pointer at %gs:0
+//
+
+ISR_GPR_ONLY PER_CPU_STRUCT * get_cpu_data(void)
+{
+  PER_CPU_STRUCT * cpu = NULL;
+  asm volatile("movq %%gs:0, %[cpu]"
+               : [cpu] "=r" (cpu) // Outputs
+               : // No inputs
+               : // No clobbers
+             );
+  return cpu;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// get_cpu_index: Get This CPU's Index
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Returns the calling CPU's index into Global_Per_CPU_Data (0 for the BSP)
+//
+
+uint64_t get_cpu_index(void)
+{
+  uint64_t index = 0;
+  asm volatile("movq %%gs:%c[offset], %[index]"
+               : [index] "=r" (index) // Outputs
+               : [offset] "i" (offsetof(PER_CPU_STRUCT, CPU_Index)) // Inputs
+               : // No clobbers
+             );
+  return index;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// get_apic_id: Get This CPU's Local APIC ID
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Uses CPUID so that it works regardless of local APIC mode: leaf 0xB has the full 32-bit x2APIC ID, and leaf 1 has the 8-bit xAPIC
+// ID on CPUs without leaf 0xB.
+//
+
+uint32_t get_apic_id(void)
+{
+  uint64_t rax = 0, rbx = 0, rdx = 0;
+
+  asm volatile("cpuid"
+               : "=a" (rax) // Outputs
+               : "a" (0x00) // The value to put into %rax
+               : "%rbx", "%rcx", "%rdx" // CPUID clobbers all not-explicitly-used abcd registers
+             );
+
+  if(rax >= 0x0B)
+  {
+    asm volatile("cpuid"
+                 : "=b" (rbx), "=d" (rdx) // Outputs
+                 : "a" (0x0B), "c" (0x00) // The values to put into %rax and %rcx
+                 : // CPUID clobbers all not-explicitly-used abcd registers (all are used here)
+               );
+    if(rbx != 0) // Leaf 0xB is valid
+    {
+      return (uint32_t)rdx;
+    }
+  }
+
+  asm volatile("cpuid"
+               : "=b" (rbx) // Outputs
+               : "a" (0x01) // The value to put into %rax
+               : "%rcx", "%rdx" // CPUID clobbers all not-explicitly-used abcd registers
+             );
+
+  return (uint32_t)(rbx >> 24);
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// lapic_rw: Read/Write Local APIC Registers
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Read from or write to the calling CPU's local APIC
+//
+// reg: xAPIC MMIO register offset, e.g. 0xF0 for the Spurious Interrupt Vector Register. In x2APIC mode this is converted to the
+//      corresponding MSR (0x800 + (reg >> 4)).
+// rw: 0 = read, 1 = write
+// input data is ignored for reads
+//
+// Use lapic_send_ipi() for the ICR, since it's a single 64-bit register in x2APIC mode.
+//
+
+ISR_GPR_ONLY uint32_t lapic_rw(uint32_t reg, uint32_t data, int rw)
+{
+  if(Global_SMP_Info.x2APIC)
+  {
+    if(rw == 1) // Write
+    {
+      msr_rw(0x800 + (reg >> 4), data, 1);
+      return data;
+    }
+    return (uint32_t)msr_rw(0x800 + (reg >> 4), 0, 0);
+  }
+  else
+  {
+    volatile uint32_t * lapic_reg = (volatile uint32_t *)(Global_SMP_Info.LAPIC_Base + reg);
+    if(rw == 1) // Write
+    {
+      *lapic_reg = data;
+      return data;
+    }
+    return *lapic_reg;
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// lapic_send_ipi: Send an Interprocessor Interrupt
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Send an IPI to the CPU with the given APIC ID.
+//
+// icr_low: the low 32 bits of the Interrupt Command Register (vector, delivery mode, level, trigger mode, shorthand)
+//
+// In xAPIC mode this waits for the previous IPI's delivery status bit to clear before sending, and again after sending.
+//
+
+void lapic_send_ipi(uint32_t apic_id, uint32_t icr_low)
+{
+  if(Global_SMP_Info.x2APIC)
+  {
+    msr_rw(0x830, ((uint64_t)apic_id << 32) | icr_low, 1);
+  }
+  else
+  {
+    volatile uint32_t * icr_lo = (volatile uint32_t *)(Global_SMP_Info.LAPIC_Base + 0x300);
+    volatile uint32_t * icr_hi = (volatile uint32_t *)(Global_SMP_Info.LAPIC_Base + 0x310);
+
+    while(*icr_lo & (1 << 12)) // Delivery status: send pending
+    {
+      asm volatile("pause");
+    }
+
+    *icr_hi = apic_id << 24;
+    *icr_lo = icr_low; // Writing the low half sends it
+
+    while(*icr_lo & (1 << 12))
+    {
+      asm volatile("pause");
+    }
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// IOAPIC_Route_ISA_IRQ: Send a Legacy IRQ to the BSP
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Program the I/O APIC redirection entry for an ISA IRQ (e.g. 4 for COM1) so that it arrives at the BSP as 'vector', and unmask it.
+// The MADT's interrupt source overrides are checked first, since firmware may have wired the IRQ to a different global system
+// interrupt (GSI) or changed its polarity or trigger mode. Without an override, ISA IRQs are edge-triggered and active high.
+//
+// Requires: Setup_SMP(), for the BSP's APIC ID. Maskable interrupts still need to be turned on with Enable_Maskable_Interrupts().
+//
+// Returns 1 on success, or 0 if there's no MADT or no I/O APIC handling that GSI.
+//
+
+uint8_t IOAPIC_Route_ISA_IRQ(uint8_t irq, uint8_t vector)
+{
+  MADT_STRUCT * madt = (MADT_STRUCT *)ACPI_Find_Table("APIC", 0);
+  if(madt == NULL)
+  {
+    printf("IOAPIC_Route_ISA_IRQ: No MADT.\r\n");
+    return 0;
+  }
+
+  uint8_t * madt_end = (uint8_t*)madt + madt->SDTHeader.Length;
+  uint32_t gsi = irq;
+  uint32_t redirection_flags = 0; // Edge-triggered, active high
+
+  for(uint8_t * entry = (uint8_t*)madt + sizeof(MADT_STRUCT); (entry + sizeof(MADT_ENTRY_HEADER_STRUCT)) <= madt_end; entry += ((MADT_ENTRY_HEADER_STRUCT *)entry)->Length)
+  {
+    MADT_ENTRY_HEADER_STRUCT * header = (MADT_ENTRY_HEADER_STRUCT *)entry;
+    if(header->Length < sizeof(MADT_ENTRY_HEADER_STRUCT))
+    {
+      break;
+    }
+
+    if(header->Type == 2) // Interrupt Source Override
+    {
+      MADT_INTERRUPT_SOURCE_OVERRIDE_STRUCT * override = (MADT_INTERRUPT_SOURCE_OVERRIDE_STRUCT *)entry;
+      if((override->Bus == 0) && (override->Source == irq))
+      {
+        gsi = override->GlobalSystemInterrupt;
+        if((override->Flags & 0x3) == 0x3)
+        {
+          redirection_flags |= (1 << 13); // Active low
+        }
+        if(((override->Flags >> 2) & 0x3) == 0x3)
+        {
+          redirection_flags |= (1 << 15); // Level-triggered
+        }
+      }
+    }
+  }
+
+  for(uint8_t * entry = (uint8_t*)madt + sizeof(MADT_STRUCT); (entry + sizeof(MADT_ENTRY_HEADER_STRUCT)) <= madt_end; entry += ((MADT_ENTRY_HEADER_STRUCT *)entry)->Length)
+  {
+    MADT_ENTRY_HEADER_STRUCT * header = (MADT_ENTRY_HEADER_STRUCT *)entry;
+    if(header->Length < sizeof(MADT_ENTRY_HEADER_STRUCT))
+    {
+      break;
+    }
+
+    if(header->Type == 1) // I/O APIC
+    {
+      MADT_IO_APIC_STRUCT * io_apic = (MADT_IO_APIC_STRUCT *)entry;
+      uint32_t entries = ((ioapic_rw(io_apic->IOAPICAddress, 0x01, 0, 0) >> 16) & 0xFF) + 1; // IOAPICVER: Maximum Redirection Entry
+
+      if((gsi >= io_apic->GlobalSystemInterruptBase) && (gsi < io_apic->GlobalSystemInterruptBase + entries))
+      {
+        uint32_t reg = 0x10 + 2 * (gsi - io_apic->GlobalSystemInterruptBase);
+
+        // Fixed delivery, physical destination. Only 8-bit APIC IDs fit here without interrupt remapping, which the BSP's practically
+        // always is.
+        ioapic_rw(io_apic->IOAPICAddress, reg, (1 << 16), 1); // Masked while it's being changed
+        ioapic_rw(io_apic->IOAPICAddress, reg + 1, Global_SMP_Info.BSP_APIC_ID << 24, 1);
+        ioapic_rw(io_apic->IOAPICAddress, reg, vector | redirection_flags, 1);
+
+        return 1;
+      }
+    }
+  }
+
+  printf("IOAPIC_Route_ISA_IRQ: No I/O APIC for IRQ %u (GSI %u).\r\n", (uint32_t)irq, gsi);
+  return 0;
+}
+
+// Read or write an I/O APIC register through its index/data window
+static uint32_t ioapic_rw(uint32_t base, uint32_t reg, uint32_t data, int rw)
+{
+  volatile uint32_t * ioregsel = (volatile uint32_t *)(uint64_t)base;
+  volatile uint32_t * iowin = (volatile uint32_t *)((uint64_t)base + 0x10);
+
+  *ioregsel = reg;
+  if(rw == 1)
+  {
+    *iowin = data;
+    return data;
+  }
+  return *iowin;
+}
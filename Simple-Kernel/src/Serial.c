@@ -0,0 +1,406 @@
+//==================================================================================================================================
+//  Simple Kernel: Serial Console
+//==================================================================================================================================
+//
+// Version 0.z
+//
+// Author:
+//  KNNSpeed
+//
+// Source Code:
+//  https://github.com/KNNSpeed/Simple-Kernel
+//
+// This file contains a 16550 UART backend for the console, for running headless (e.g. over serial-over-LAN). With the
+// CONSOLE_SINK_SERIAL sink on, Console.c copies each printf() record it takes out of Global_Console's ring into Global_Serial's byte
+// ring with Serial_Write(), which never waits on the UART. The UART gets fed from that ring in bursts: whenever the transmit holding
+// register (THR) is empty, a whole FIFO's worth of bytes is written at once, so LSR only gets read once per burst instead of before
+// every byte.
+//
+// Once Serial_Start_Interrupts() has routed the UART's IRQ through the I/O APIC, the THR-empty interrupt refills the FIFO, and it's
+// only enabled while there's something left to send. Before that (or if there's no I/O APIC), Serial_Write() and Serial_Poll() push
+// one burst each time they're called and the rest waits in the ring.
+//
+// Only the CPU that's flushing the console (the one that owns Global_Console.Drawing) calls Serial_Write(), so the ring has a single
+// producer. Filling the FIFO is guarded by Global_Serial.Sending, so it has a single consumer at a time, too. Exception handlers go
+// through Console_Panic(), which calls Serial_Panic() to switch over to waiting for the UART so that nothing gets stuck in the ring.
+//
+
+#include "Kernel64.h"
+
+// 16550 register offsets from the I/O base
+#define UART_THR 0 // Transmit Holding Register (write), Receive Buffer Register (read), Divisor Latch low byte (DLAB = 1)
+#define UART_IER 1 // Interrupt Enable Register, Divisor Latch high byte (DLAB = 1)
+#define UART_IIR 2 // Interrupt Identification Register (read), FIFO Control Register (write)
+#define UART_LCR 3 // Line Control Register
+#define UART_MCR 4 // Modem Control Register
+#define UART_LSR 5 // Line Status Register
+#define UART_MSR 6 // Modem Status Register
+#define UART_SCR 7 // Scratch Register
+
+#define UART_LSR_THRE (1 << 5) // THR (and TX FIFO, if enabled) empty
+#define UART_IER_THRI (1 << 1) // Interrupt when THR is empty
+
+// 115200 baud, 8 data bits, no parity, 1 stop bit
+#define SERIAL_DIVISOR 1
+
+// How many times Serial_Panic() and polled writes check LSR for each burst before giving up on the UART
+#define SERIAL_PANIC_SPINS (1ULL << 20)
+
+static uint8_t serial_probe(uint16_t port);
+static uint64_t serial_fifo_size(uint16_t port);
+ISR_GPR_ONLY static void serial_fill_fifo(void);
+static void serial_drain(void);
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Setup_Serial: Find and Set Up a COM Port
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Probe the standard COM port addresses and program the one asked for as 115200 8N1 with its FIFOs on, TX interrupts off.
+//
+// com_number: 1-4 for COM1-COM4, or 0 for the first one that responds
+//
+// Only needs port I/O, so this can go early in System_Init(). Text queued before Serial_Start_Interrupts() goes out a burst at a time
+// as printf() gets called.
+//
+// Returns 1 if a port was set up, 0 if not (Global_Serial.Port stays 0 then)
+//
+
+uint8_t Setup_Serial(uint64_t com_number)
+{
+  uint16_t ports[4] = {0x3F8, 0x2F8, 0x3E8, 0x2E8};
+  uint8_t irqs[4] = {4, 3, 4, 3};
+
+  if(com_number > 4)
+  {
+    printf("Setup_Serial: There's no COM%qu.\r\n", com_number);
+    return 0;
+  }
+
+  for(uint64_t i = 0; i < 4; i++)
+  {
+    if(((com_number == 0) || (com_number == i + 1)) && serial_probe(ports[i]))
+    {
+      uint16_t port = ports[i];
+
+      portio_rw(port + UART_IER, 0x00, 1, 1); // No interrupts yet
+      portio_rw(port + UART_LCR, 0x80, 1, 1); // DLAB on
+      portio_rw(port + UART_THR, SERIAL_DIVISOR & 0xFF, 1, 1);
+      portio_rw(port + UART_IER, (SERIAL_DIVISOR >> 8) & 0xFF, 1, 1);
+      Global_Serial.FIFO_Size = serial_fifo_size(port); // Needs DLAB on for the 16750's 64-byte FIFO
+      portio_rw(port + UART_LCR, 0x03, 1, 1); // 8N1, DLAB off
+      portio_rw(port + UART_MCR, 0x0B, 1, 1); // DTR, RTS, and OUT2 (which gates the IRQ line on PCs)
+
+      // Clear anything pending
+      portio_rw(port + UART_LSR, 0, 1, 0);
+      portio_rw(port + UART_THR, 0, 1, 0);
+      portio_rw(port + UART_IIR, 0, 1, 0);
+      portio_rw(port + UART_MSR, 0, 1, 0);
+
+      Global_Serial.IRQ = irqs[i];
+      Global_Serial.Port = port; // Last, since Serial_Write() does nothing until this is set
+
+      printf("Serial console on COM%qu (port %#hx, %qu-byte FIFO).\r\n", i + 1, port, Global_Serial.FIFO_Size);
+      return 1;
+    }
+  }
+
+  if(com_number)
+  {
+    printf("Setup_Serial: COM%qu isn't there.\r\n", com_number);
+  }
+  else
+  {
+    printf("Setup_Serial: No COM ports found.\r\n");
+  }
+  return 0;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Serial_Start_Interrupts: Refill the FIFO from THR-Empty Interrupts
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Route the UART's IRQ to the BSP at SERIAL_VECTOR. Fast_ISR_handler() sends that vector to Serial_Interrupt().
+//
+// Requires: Setup_Serial() and Setup_SMP(). Maskable interrupts need to be turned on afterwards with Enable_Maskable_Interrupts().
+//
+// Returns 1 if the interrupt is hooked up, 0 if the serial console has to keep going by polling (see Serial_Poll())
+//
+
+uint8_t Serial_Start_Interrupts(void)
+{
+  if(Global_Serial.Port == 0)
+  {
+    return 0;
+  }
+
+  if(!IOAPIC_Route_ISA_IRQ((uint8_t)Global_Serial.IRQ, SERIAL_VECTOR))
+  {
+    printf("Serial_Start_Interrupts: Can't route IRQ %qu, the serial console will be polled.\r\n", Global_Serial.IRQ);
+    return 0;
+  }
+
+  __atomic_store_n(&Global_Serial.Interrupts, 1, __ATOMIC_RELEASE);
+  serial_fill_fifo(); // Turns on the THR-empty interrupt if anything's waiting
+
+  return 1;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Serial_Write: Queue Text for the COM Port
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Copy text into Global_Serial's ring and start sending it if the UART is idle. Doesn't wait for the UART, except after
+// Serial_Panic(). Text that doesn't fit in the ring is dropped and counted in Global_Serial.Dropped.
+//
+// Only one CPU at a time may call this; Console.c only calls it while it owns Global_Console.Drawing.
+//
+
+void Serial_Write(const char * text, uint64_t length)
+{
+  if(Global_Serial.Port == 0)
+  {
+    return;
+  }
+
+  uint64_t head = Global_Serial.Head;
+  uint64_t room = SERIAL_RING_SIZE - (head - __atomic_load_n(&Global_Serial.Tail, __ATOMIC_ACQUIRE));
+
+  if(length > room)
+  {
+    __atomic_add_fetch(&Global_Serial.Dropped, length - room, __ATOMIC_RELAXED);
+    length = room;
+  }
+
+  uint64_t offset = head & (SERIAL_RING_SIZE - 1);
+  uint64_t first = SERIAL_RING_SIZE - offset;
+  if(first > length)
+  {
+    first = length;
+  }
+
+  AVX_memcpy(&Global_Serial.Ring[offset], (void*)text, first);
+  if(length > first)
+  {
+    AVX_memcpy(&Global_Serial.Ring[0], (void*)(text + first), length - first);
+  }
+
+  __atomic_store_n(&Global_Serial.Head, head + length, __ATOMIC_RELEASE);
+
+  if(Global_Serial.Polled)
+  {
+    serial_drain();
+  }
+  else
+  {
+    serial_fill_fifo();
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Serial_Poll: Send a Burst Without Interrupts
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// If the UART's FIFO is empty, refill it from the ring. For idle loops when Serial_Start_Interrupts() couldn't hook up the IRQ;
+// harmless (if pointless) otherwise.
+//
+
+void Serial_Poll(void)
+{
+  if(Global_Serial.Port && (Global_Serial.Head != Global_Serial.Tail))
+  {
+    serial_fill_fifo();
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Serial_Interrupt: UART Interrupt Handler
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Called by Fast_ISR_handler() for SERIAL_VECTOR, which sends the local APIC's EOI afterwards. Handles everything the UART has pending:
+// THR empty refills the FIFO, and anything else (received bytes, line and modem status changes) just gets read to clear it.
+//
+
+ISR_GPR_ONLY void Serial_Interrupt(void)
+{
+  uint16_t port = (uint16_t)Global_Serial.Port;
+
+  for(uint64_t i = 0; i < 16; i++) // Bounded, in case something's stuck
+  {
+    uint32_t iir = portio_rw(port + UART_IIR, 0, 1, 0);
+    if(iir & 0x01) // Nothing pending
+    {
+      break;
+    }
+
+    switch((iir >> 1) & 0x07)
+    {
+      case 0: // Modem status
+        portio_rw(port + UART_MSR, 0, 1, 0);
+        break;
+      case 1: // THR empty (reading IIR cleared it)
+        serial_fill_fifo();
+        break;
+      case 2: // Received data
+      case 6: // Character timeout
+        portio_rw(port + UART_THR, 0, 1, 0);
+        break;
+      case 3: // Line status
+        portio_rw(port + UART_LSR, 0, 1, 0);
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Serial_Panic: Switch to Waiting on the UART
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// For exception handlers, via Console_Panic(). Sends everything in the ring now, and makes every later Serial_Write() wait until its
+// text is out, since interrupts may never come again. If another CPU is in the middle of filling the FIFO, this waits a little while
+// for it and then goes ahead anyway.
+//
+
+void Serial_Panic(void)
+{
+  if(Global_Serial.Port == 0)
+  {
+    return;
+  }
+
+  __atomic_store_n(&Global_Serial.Polled, 1, __ATOMIC_RELEASE);
+
+  for(uint64_t spins = 0; __atomic_load_n(&Global_Serial.Sending, __ATOMIC_ACQUIRE) && (spins < SERIAL_PANIC_SPINS); spins++)
+  {
+    asm volatile("pause");
+  }
+  __atomic_store_n(&Global_Serial.Sending, 0, __ATOMIC_RELEASE);
+
+  serial_drain();
+}
+
+// Check that there's a UART at 'port': the scratch register has to hold a value, and a byte sent in loopback mode has to come back
+static uint8_t serial_probe(uint16_t port)
+{
+  portio_rw(port + UART_SCR, 0x5A, 1, 1);
+  if(portio_rw(port + UART_SCR, 0, 1, 0) != 0x5A)
+  {
+    return 0;
+  }
+
+  portio_rw(port + UART_IER, 0x00, 1, 1);
+  portio_rw(port + UART_MCR, 0x1E, 1, 1); // Loopback, OUT1, OUT2, RTS
+  portio_rw(port + UART_THR, 0xAE, 1, 1);
+
+  // The byte takes about 87us to loop back at 115200 baud, or longer at whatever firmware set. Wait for it, but not forever.
+  for(uint64_t spins = 0; spins < SERIAL_PANIC_SPINS; spins++)
+  {
+    if(portio_rw(port + UART_LSR, 0, 1, 0) & 0x01) // Data ready
+    {
+      uint8_t looped = (portio_rw(port + UART_THR, 0, 1, 0) == 0xAE);
+      portio_rw(port + UART_MCR, 0x0B, 1, 1);
+      return looped;
+    }
+    asm volatile("pause");
+  }
+
+  portio_rw(port + UART_MCR, 0x0B, 1, 1);
+  return 0;
+}
+
+// Turn the FIFOs on and figure out how big the TX FIFO is from what IIR reports. Call with DLAB on.
+static uint64_t serial_fifo_size(uint16_t port)
+{
+  portio_rw(port + UART_IIR, 0xE7, 1, 1); // Enable + clear FIFOs, 64-byte mode if it's a 16750, RX trigger at 14 (56) bytes
+  uint32_t iir = portio_rw(port + UART_IIR, 0, 1, 0);
+
+  if((iir & 0xC0) != 0xC0)
+  {
+    // 8250/16450 (no FIFO), or an original 16550 (broken FIFO)
+    portio_rw(port + UART_IIR, 0x00, 1, 1);
+    return 1;
+  }
+
+  if(iir & 0x20)
+  {
+    return 64; // 16750
+  }
+
+  return 16;
+}
+
+// Write up to a FIFO's worth of queued bytes if the THR is empty, then turn the THR-empty interrupt on or off depending on whether
+// there's more. Returns right away if another CPU is already doing this.
+ISR_GPR_ONLY static void serial_fill_fifo(void)
+{
+  uint16_t port = (uint16_t)Global_Serial.Port;
+
+  while(1)
+  {
+    if(__atomic_exchange_n(&Global_Serial.Sending, 1, __ATOMIC_ACQUIRE))
+    {
+      return;
+    }
+
+    uint64_t tail = Global_Serial.Tail;
+    uint64_t head = __atomic_load_n(&Global_Serial.Head, __ATOMIC_ACQUIRE);
+
+    if((head != tail) && (portio_rw(port + UART_LSR, 0, 1, 0) & UART_LSR_THRE))
+    {
+      uint64_t burst = head - tail;
+      if(burst > Global_Serial.FIFO_Size)
+      {
+        burst = Global_Serial.FIFO_Size;
+      }
+
+      for(uint64_t i = 0; i < burst; i++)
+      {
+        portio_rw(port + UART_THR, Global_Serial.Ring[(tail + i) & (SERIAL_RING_SIZE - 1)], 1, 1);
+      }
+
+      tail += burst;
+      __atomic_store_n(&Global_Serial.Tail, tail, __ATOMIC_RELEASE);
+    }
+
+    if(Global_Serial.Interrupts)
+    {
+      // Turning THRI off and back on makes the UART re-check THR, so an interrupt that was already taken can't get lost
+      portio_rw(port + UART_IER, 0x00, 1, 1);
+      if(head != tail)
+      {
+        portio_rw(port + UART_IER, UART_IER_THRI, 1, 1);
+      }
+    }
+
+    __atomic_store_n(&Global_Serial.Sending, 0, __ATOMIC_RELEASE);
+
+    // Anything written while this CPU held Sending would otherwise wait for the next call
+    if(__atomic_load_n(&Global_Serial.Head, __ATOMIC_ACQUIRE) == head)
+    {
+      return;
+    }
+  }
+}
+
+// Send everything in the ring, waiting on LSR between bursts
+static void serial_drain(void)
+{
+  uint64_t spins = 0;
+
+  while((Global_Serial.Head != Global_Serial.Tail) && (spins < SERIAL_PANIC_SPINS))
+  {
+    uint64_t tail = Global_Serial.Tail;
+    serial_fill_fifo();
+
+    if(Global_Serial.Tail == tail)
+    {
+      asm volatile("pause");
+      spins++;
+    }
+    else
+    {
+      spins = 0;
+    }
+  }
+}
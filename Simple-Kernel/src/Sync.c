@@ -0,0 +1,465 @@
+//==================================================================================================================================
+//  Simple Kernel: Locks and Lock-Free Rings
+//==================================================================================================================================
+//
+// Version 0.z
+//
+// Author:
+//  KNNSpeed
+//
+// Source Code:
+//  https://github.com/KNNSpeed/Simple-Kernel
+//
+// This file contains the locks and rings that shared kernel data uses once there's more than one CPU running:
+//
+//  - TICKET_LOCK: A spinlock that hands itself out in the order it was asked for, so no CPU can be starved. Waiters all watch the same
+//    cache line, so it's for locks that are held briefly and not fought over by many CPUs at once.
+//  - MCS_LOCK: A queued spinlock. Each waiter spins on its own MCS_NODE, and the holder hands the lock straight to the next one in line,
+//    so a contended lock only costs one cache line transfer per handoff no matter how many CPUs are waiting.
+//  - SEQLOCK: For data that's read far more often than it's written. Readers never write anything; they read a sequence number, copy
+//    the data, and try again if the sequence number changed (or was odd, meaning a write was in progress). Writers take a ticket lock.
+//  - MPSC_RING: A bounded multiple-producer single-consumer queue of UINT64s, where each slot has its own sequence number so producers
+//    only need one compare-and-swap to claim a slot and never wait on each other.
+//
+// Every lock type and the ring indices are cache line-aligned, so two locks (or a lock and whatever it protects) never share a line.
+//
+// The _IRQ_Save versions turn off maskable interrupts on this CPU before taking the lock and return the old RFLAGS, which go back to
+// the matching _IRQ_Restore. Use those for anything that User_ISR_handler() might also take, otherwise an interrupt on a CPU holding
+// the lock would spin on it forever.
+//
+
+#include "Kernel64.h"
+
+static uint64_t sync_irq_save(void);
+static void sync_irq_restore(uint64_t rflags);
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Ticket_Lock: Take a Ticket Lock
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Spin until 'lock' is free, taking turns in order with any other CPUs waiting on it. The wait between checks grows with the number of
+// CPUs ahead in line, so that waiters far back don't keep pulling the line away from the holder.
+//
+
+void Ticket_Lock(TICKET_LOCK * lock)
+{
+  uint32_t ticket = __atomic_fetch_add(&lock->Next, 1, __ATOMIC_RELAXED);
+  uint32_t owner;
+
+  while((owner = __atomic_load_n(&lock->Owner, __ATOMIC_ACQUIRE)) != ticket)
+  {
+    for(uint32_t ahead = ticket - owner; ahead > 0; ahead--)
+    {
+      asm volatile("pause");
+    }
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Ticket_Trylock: Take a Ticket Lock If It's Free
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Returns 1 if the lock was taken, 0 if someone else has it or is waiting for it
+//
+
+uint8_t Ticket_Trylock(TICKET_LOCK * lock)
+{
+  uint64_t tickets = __atomic_load_n(&lock->Tickets, __ATOMIC_RELAXED);
+  uint32_t owner = (uint32_t)tickets;
+
+  if((uint32_t)(tickets >> 32) != owner)
+  {
+    return 0;
+  }
+
+  // Owner is the low half and Next is the high half, so this takes the next ticket only if nobody else has in the meantime
+  return __atomic_compare_exchange_n(&lock->Tickets, &tickets, tickets + (1ULL << 32), 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Ticket_Unlock: Release a Ticket Lock
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Let the next CPU in line have 'lock'. Only the holder writes Owner, so this is a plain store.
+//
+
+void Ticket_Unlock(TICKET_LOCK * lock)
+{
+  __atomic_store_n(&lock->Owner, lock->Owner + 1, __ATOMIC_RELEASE);
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Ticket_Lock_IRQ_Save: Take a Ticket Lock With Interrupts Off
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Ticket_Lock(), but with maskable interrupts turned off on this CPU first.
+//
+// Returns the RFLAGS to hand back to Ticket_Unlock_IRQ_Restore()
+//
+
+uint64_t Ticket_Lock_IRQ_Save(TICKET_LOCK * lock)
+{
+  uint64_t rflags = sync_irq_save();
+  Ticket_Lock(lock);
+  return rflags;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Ticket_Unlock_IRQ_Restore: Release a Ticket Lock Taken With Interrupts Off
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Ticket_Unlock(), and then turn interrupts back on if they were on when Ticket_Lock_IRQ_Save() returned 'rflags'.
+//
+
+void Ticket_Unlock_IRQ_Restore(TICKET_LOCK * lock, uint64_t rflags)
+{
+  Ticket_Unlock(lock);
+  sync_irq_restore(rflags);
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// MCS_Lock: Take an MCS Lock
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Join the end of the queue for 'lock' and spin on 'node' until the CPU ahead hands the lock over. 'node' belongs to the lock until
+// MCS_Unlock() is called with it, so it can't be on a stack that goes away in the meantime, and a CPU can't use the same node for two
+// locks at once.
+//
+
+void MCS_Lock(MCS_LOCK * lock, MCS_NODE * node)
+{
+  node->Next = NULL;
+  node->Locked = 1;
+
+  MCS_NODE * previous = __atomic_exchange_n(&lock->Tail, node, __ATOMIC_ACQ_REL);
+  if(previous == NULL)
+  {
+    return; // Nobody was holding it
+  }
+
+  __atomic_store_n(&previous->Next, node, __ATOMIC_RELEASE);
+
+  while(__atomic_load_n(&node->Locked, __ATOMIC_ACQUIRE))
+  {
+    asm volatile("pause");
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// MCS_Trylock: Take an MCS Lock If It's Free
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// 'node' isn't touched unless the lock looks free, so a CPU that already holds 'lock' with 'node' can call this (and get 0) without
+// breaking the queue behind it.
+//
+// Returns 1 if the lock was taken (release it with MCS_Unlock() and the same 'node'), 0 if it's held or there's a queue for it
+//
+
+uint8_t MCS_Trylock(MCS_LOCK * lock, MCS_NODE * node)
+{
+  MCS_NODE * expected = NULL;
+
+  if(__atomic_load_n(&lock->Tail, __ATOMIC_RELAXED) != NULL)
+  {
+    return 0;
+  }
+
+  node->Next = NULL;
+  node->Locked = 0;
+
+  return __atomic_compare_exchange_n(&lock->Tail, &expected, node, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// MCS_Unlock: Release an MCS Lock
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Hand 'lock' to the next CPU in the queue, or mark it free if there isn't one. 'node' is the one the lock was taken with.
+//
+
+void MCS_Unlock(MCS_LOCK * lock, MCS_NODE * node)
+{
+  MCS_NODE * next = __atomic_load_n(&node->Next, __ATOMIC_ACQUIRE);
+
+  if(next == NULL)
+  {
+    MCS_NODE * expected = node;
+    if(__atomic_compare_exchange_n(&lock->Tail, &expected, NULL, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+    {
+      return; // Nobody else was in line
+    }
+
+    // Someone's swapped themselves in as the tail, but hasn't linked up behind this node yet
+    while((next = __atomic_load_n(&node->Next, __ATOMIC_ACQUIRE)) == NULL)
+    {
+      asm volatile("pause");
+    }
+  }
+
+  __atomic_store_n(&next->Locked, 0, __ATOMIC_RELEASE);
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// MCS_Lock_IRQ_Save: Take an MCS Lock With Interrupts Off
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// MCS_Lock(), but with maskable interrupts turned off on this CPU first.
+//
+// Returns the RFLAGS to hand back to MCS_Unlock_IRQ_Restore()
+//
+
+uint64_t MCS_Lock_IRQ_Save(MCS_LOCK * lock, MCS_NODE * node)
+{
+  uint64_t rflags = sync_irq_save();
+  MCS_Lock(lock, node);
+  return rflags;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// MCS_Unlock_IRQ_Restore: Release an MCS Lock Taken With Interrupts Off
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// MCS_Unlock(), and then turn interrupts back on if they were on when MCS_Lock_IRQ_Save() returned 'rflags'.
+//
+
+void MCS_Unlock_IRQ_Restore(MCS_LOCK * lock, MCS_NODE * node, uint64_t rflags)
+{
+  MCS_Unlock(lock, node);
+  sync_irq_restore(rflags);
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Seqlock_Read_Begin: Start Reading Seqlocked Data
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Waits out any write in progress. Read the data, then call Seqlock_Read_Retry() with what this returned, and read it again if that
+// says to:
+//
+//  do
+//  {
+//    start = Seqlock_Read_Begin(&lock);
+//    copy = data;
+//  } while(Seqlock_Read_Retry(&lock, start));
+//
+// Returns the sequence number to pass to Seqlock_Read_Retry()
+//
+
+uint64_t Seqlock_Read_Begin(SEQLOCK * lock)
+{
+  uint64_t sequence;
+
+  while((sequence = __atomic_load_n(&lock->Sequence, __ATOMIC_ACQUIRE)) & 1)
+  {
+    asm volatile("pause");
+  }
+
+  return sequence;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Seqlock_Read_Retry: Check Whether Seqlocked Data Changed While Being Read
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Returns 1 if a writer got in since Seqlock_Read_Begin() returned 'start', meaning what was read may be torn and has to be read again,
+// or 0 if it's good
+//
+
+uint8_t Seqlock_Read_Retry(SEQLOCK * lock, uint64_t start)
+{
+  __atomic_thread_fence(__ATOMIC_ACQUIRE); // The data reads have to finish before the sequence number is checked
+  return __atomic_load_n(&lock->Sequence, __ATOMIC_RELAXED) != start;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Seqlock_Write_Begin: Start Changing Seqlocked Data
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Takes the writer lock and makes the sequence number odd, so readers know to wait. Keep the write short, since readers spin through it.
+//
+
+void Seqlock_Write_Begin(SEQLOCK * lock)
+{
+  Ticket_Lock(&lock->Writer);
+  __atomic_store_n(&lock->Sequence, lock->Sequence + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE); // Readers have to see the odd number before any of the new data
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Seqlock_Write_End: Finish Changing Seqlocked Data
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Makes the sequence number even again, publishing the new data, and releases the writer lock.
+//
+
+void Seqlock_Write_End(SEQLOCK * lock)
+{
+  __atomic_store_n(&lock->Sequence, lock->Sequence + 1, __ATOMIC_RELEASE);
+  Ticket_Unlock(&lock->Writer);
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Seqlock_Write_Begin_IRQ_Save: Start Changing Seqlocked Data With Interrupts Off
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Seqlock_Write_Begin(), but with maskable interrupts turned off on this CPU first. Needed if an interrupt handler on this CPU could
+// read the data, since it would otherwise spin forever waiting for the write it interrupted.
+//
+// Returns the RFLAGS to hand back to Seqlock_Write_End_IRQ_Restore()
+//
+
+uint64_t Seqlock_Write_Begin_IRQ_Save(SEQLOCK * lock)
+{
+  uint64_t rflags = sync_irq_save();
+  Seqlock_Write_Begin(lock);
+  return rflags;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Seqlock_Write_End_IRQ_Restore: Finish Changing Seqlocked Data With Interrupts Off
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Seqlock_Write_End(), and then turn interrupts back on if they were on when Seqlock_Write_Begin_IRQ_Save() returned 'rflags'.
+//
+
+void Seqlock_Write_End_IRQ_Restore(SEQLOCK * lock, uint64_t rflags)
+{
+  Seqlock_Write_End(lock);
+  sync_irq_restore(rflags);
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// MPSC_Init: Set Up a Multiple-Producer Single-Consumer Ring
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// slots: Storage for 'capacity' RING_SLOTs, which must be a power of 2
+//
+// Returns 1 on success, 0 if capacity isn't a power of 2
+//
+
+uint8_t MPSC_Init(MPSC_RING * ring, RING_SLOT * slots, uint64_t capacity)
+{
+  if((capacity == 0) || (capacity & (capacity - 1)))
+  {
+    return 0;
+  }
+
+  // A slot is free for the producer whose position matches its sequence number, and full for the consumer once that's 1 more
+  for(uint64_t i = 0; i < capacity; i++)
+  {
+    slots[i].Sequence = i;
+  }
+
+  ring->Mask = capacity - 1;
+  ring->Slots = slots;
+  ring->Tail = 0;
+  ring->Head = 0;
+
+  return 1;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// MPSC_Push: Add a Value to a Multiple-Producer Single-Consumer Ring
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Any number of CPUs can push at once. Interrupt handlers can push too, as long as the CPU they interrupted isn't the consumer.
+//
+// Returns 1 if 'value' was added, 0 if the ring is full
+//
+
+uint8_t MPSC_Push(MPSC_RING * ring, uint64_t value)
+{
+  uint64_t position = __atomic_load_n(&ring->Tail, __ATOMIC_RELAXED);
+  RING_SLOT * slot;
+
+  for(;;)
+  {
+    slot = &ring->Slots[position & ring->Mask];
+    int64_t difference = (int64_t)(__atomic_load_n(&slot->Sequence, __ATOMIC_ACQUIRE) - position);
+
+    if(difference == 0)
+    {
+      // The slot's free, so claim it. On failure, position gets updated to whatever Tail is now.
+      if(__atomic_compare_exchange_n(&ring->Tail, &position, position + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+      {
+        break;
+      }
+    }
+    else if(difference < 0)
+    {
+      return 0; // The consumer hasn't gotten to this slot's last value yet
+    }
+    else
+    {
+      position = __atomic_load_n(&ring->Tail, __ATOMIC_RELAXED); // Another producer took it
+    }
+  }
+
+  slot->Value = value;
+  __atomic_store_n(&slot->Sequence, position + 1, __ATOMIC_RELEASE);
+
+  return 1;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// MPSC_Pop: Take a Value From a Multiple-Producer Single-Consumer Ring
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Only one CPU at a time may pop from a given ring. Values come out in the order their slots were claimed, so a producer that's
+// claimed a slot but not filled it yet holds up everything behind it until it does.
+//
+// Returns 1 if a value was taken and stored in 'value', 0 if there's nothing ready
+//
+
+uint8_t MPSC_Pop(MPSC_RING * ring, uint64_t * value)
+{
+  uint64_t head = ring->Head;
+  RING_SLOT * slot = &ring->Slots[head & ring->Mask];
+
+  if(__atomic_load_n(&slot->Sequence, __ATOMIC_ACQUIRE) != head + 1)
+  {
+    return 0;
+  }
+
+  *value = slot->Value;
+  __atomic_store_n(&slot->Sequence, head + ring->Mask + 1, __ATOMIC_RELEASE); // Free for the producer one lap from now
+  __atomic_store_n(&ring->Head, head + 1, __ATOMIC_RELEASE);
+
+  return 1;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// MPSC_Ready: Check for a Value in a Multiple-Producer Single-Consumer Ring
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Returns 1 if MPSC_Pop() would get something right now, 0 if not. Anyone can call this, but only the consumer gets a firm answer; from
+// other CPUs it's a hint, since the consumer may be popping at the same time.
+//
+
+uint8_t MPSC_Ready(MPSC_RING * ring)
+{
+  uint64_t head = __atomic_load_n(&ring->Head, __ATOMIC_ACQUIRE);
+  return __atomic_load_n(&ring->Slots[head & ring->Mask].Sequence, __ATOMIC_ACQUIRE) == head + 1;
+}
+
+// Turn off maskable interrupts on this CPU. Returns the RFLAGS from before, for sync_irq_restore().
+static uint64_t sync_irq_save(void)
+{
+  uint64_t rflags = 0;
+  asm volatile("pushfq\n\t"
+               "popq %[flags]\n\t"
+               "cli"
+               : [flags] "=r" (rflags) // Outputs
+               : // No inputs
+               : "memory" // Clobbers
+             );
+  return rflags;
+}
+
+// Turn maskable interrupts back on if RFLAGS.IF was set in 'rflags'
+static void sync_irq_restore(uint64_t rflags)
+{
+  if(rflags & (1 << 9))
+  {
+    asm volatile("sti" : : : "memory");
+  }
+}
@@ -25,6 +25,12 @@ static void set_NMI_interrupt_entry(uint64_t isr_num, uint64_t isr_addr);
 static void set_DF_interrupt_entry(uint64_t isr_num, uint64_t isr_addr);
 static void set_MC_interrupt_entry(uint64_t isr_num, uint64_t isr_addr);
 static void set_BP_interrupt_entry(uint64_t isr_num, uint64_t isr_addr);
+static uint8_t kernel_option_match(const CHAR16 * token, uint64_t token_length, const char * name);
+static uint8_t kernel_option_value(const CHAR16 * token, uint64_t token_length, const char * name, uint64_t * value);
+static uint64_t paging_set_type(uint64_t * table, uint64_t level, uint64_t table_base, uint64_t base, uint64_t end, uint64_t pat_index);
+static uint64_t * paging_alloc_table(void);
+static void isr_xsave(uint8_t * area, uint64_t instruction);
+static void isr_xrstor(uint8_t * area, uint64_t instruction);
 
 //----------------------------------------------------------------------------------------------------------------------------------
 // System_Init: Initial Setup
@@ -35,6 +41,10 @@ static void set_BP_interrupt_entry(uint64_t isr_num, uint64_t isr_addr);
 
 void System_Init(LOADER_PARAMS * LP)
 {
+  // RDTSCP returns IA32_TSC_AUX in %ecx, which trace probes record as the CPU index. Firmware may have left anything in it.
+  msr_rw(0xC0000103, 0, 1);
+  TRACE_BEGIN("System_Init");
+
   // This memory initialization stuff needs to go first.
   Global_Memory_Info.MemMap = LP->Memory_Map;
   Global_Memory_Info.MemMapSize = LP->Memory_Map_Size;
@@ -43,20 +53,51 @@ void System_Init(LOADER_PARAMS * LP)
   // Apparently some systems won't totally leave you be without setting a virtual address map (https://www.spinics.net/lists/linux-efi/msg14108.html
   // and https://mjg59.dreamwidth.org/3244.html). Well, fine; identity map it now and fuhgetaboutit.
   // This will modify the memory map (but not its size), and set Global_Memory_Info.MemMap.
+  TRACE_BEGIN("Set_Identity_VMAP");
   if(Set_Identity_VMAP(LP->RTServices) == NULL)
   {
     Global_Memory_Info.MemMap = LP->Memory_Map; // No virtual addressing possible, evidently. Reset the map to how it was before.
   }
+  TRACE_END("Set_Identity_VMAP");
   // Don't merge any regions on the map until after SetVirtualAddressMap() has been called. After that call, it can be modified safely.
 
   // This function call is required to initialize printf. Set default GPU as GPU 0.
   // It can also be used to reset all global printf values and reassign a new default GPU at any time.
-  Initialize_Global_Printf_Defaults(LP->GPU_Configs->GPUArray[0]);
+  TRACE_BEGIN("Initialize_Global_Printf_Defaults");
+  Initialize_Global_Printf_Defaults(&LP->GPU_Configs->GPUArray[0]);
+  TRACE_END("Initialize_Global_Printf_Defaults");
   // Technically, printf is immediately usable now. I'd recommend waitng for AVX/SSE init just in case the compiler uses them when optimizing printf.
 
+  TRACE_BEGIN("Enable_AVX");
   Enable_AVX(); // ENABLING AVX ASAP
+  TRACE_END("Enable_AVX");
   // All good now.
 
+  // Boot options (this comes after AVX since the compiler is allowed to vectorize the parsing loop)
+  TRACE_BEGIN("Parse_Kernel_Options");
+  Parse_Kernel_Options(LP);
+  TRACE_END("Parse_Kernel_Options");
+
+  // Reported here rather than in Enable_AVX(), since "nt=" and "prefetch=" can override what it picked
+  printf("LLC: %qu kB shared by %qu, streaming above %qu kB, prefetch %qu bytes\r\n", AVX_Mem_Dispatch.LLC_Size >> 10, AVX_Mem_Dispatch.LLC_Sharing,
+                                                                                   AVX_Mem_Dispatch.NT_Threshold >> 10, AVX_Mem_Dispatch.Prefetch_Distance);
+
+  if(Global_Kernel_Options.Deferred_Console)
+  {
+    Console_Set_Deferred(1);
+  }
+
+  // Serial console, if asked for. It's only port I/O, so it can start this early; its interrupt gets hooked up after Setup_SMP().
+  if(Global_Kernel_Options.Serial_Console)
+  {
+    TRACE_BEGIN("Setup_Serial");
+    if(Setup_Serial(Global_Kernel_Options.Serial_Port))
+    {
+      Console_Set_Sinks(Global_Kernel_Options.Serial_Only ? CONSOLE_SINK_SERIAL : (CONSOLE_SINK_FRAMEBUFFER | CONSOLE_SINK_SERIAL));
+    }
+    TRACE_END("Setup_Serial");
+  }
+
   // I know this CR0.NE bit isn't always set by default. Set it.
   // Generate and handle exceptions in the modern way, per Intel SDM
   uint64_t cr0 = control_register_rw(0, 0, 0);
@@ -84,34 +125,325 @@ void System_Init(LOADER_PARAMS * LP)
   }
 
 // TODO: print memmap before and after to test malloc stuff
+  TRACE_BEGIN("print_system_memmap");
   print_system_memmap();
+  TRACE_END("print_system_memmap");
 
   // Make a replacement GDT since the UEFI one is in EFI Boot Services Memory.
   // Don't need anything fancy, just need one to exist somewhere (preferably in EfiLoaderData, which won't change with this software)
+  TRACE_BEGIN("Setup_MinimalGDT");
   Setup_MinimalGDT();
+  TRACE_END("Setup_MinimalGDT");
 
   // Set up IDT for interrupts
+  TRACE_BEGIN("Setup_IDT");
   Setup_IDT();
+  TRACE_END("Setup_IDT");
+
+  // Point GS base at the BSP's per-CPU data (needs to go after Setup_MinimalGDT(), which zeroes GS base along with %gs)
+  TRACE_BEGIN("Setup_Per_CPU_Data");
+  Setup_Per_CPU_Data();
+  TRACE_END("Setup_Per_CPU_Data");
+
+  // Find the ACPI tables (MADT, etc.)
+  TRACE_BEGIN("ACPI_Init");
+  ACPI_Init(LP);
+  TRACE_END("ACPI_Init");
+
+  // Find which memory and CPUs are on which NUMA node (needs ACPI, and has to go before Setup_Page_Allocator())
+  TRACE_BEGIN("Setup_NUMA");
+  Setup_NUMA();
+  TRACE_END("Setup_NUMA");
 
   // Set up the memory map for use with mallocX (X = 16, 32, 64)
+  TRACE_BEGIN("Setup_MemMap");
   Setup_MemMap();
+  TRACE_END("Setup_MemMap");
 
   // Set up paging structures (requires memory map to be set up)
-  Setup_Paging();
+  TRACE_BEGIN("Setup_Paging");
+  Setup_Paging(LP);
+  TRACE_END("Setup_Paging");
 
   // Reclaim Efi Boot Services memory now that GDT, IDT, and Paging have been set up
+  TRACE_BEGIN("ReclaimEfiBootServicesMemory");
   ReclaimEfiBootServicesMemory();
+  TRACE_END("ReclaimEfiBootServicesMemory");
 
   // Ditto for EfiLoaderCode, which is just where the bootloader was
+  TRACE_BEGIN("ReclaimEfiLoaderCodeMemory");
   ReclaimEfiLoaderCodeMemory();
+  TRACE_END("ReclaimEfiLoaderCodeMemory");
+
+  // Hand all free memory above 1MB to the page allocator (needs everything that's going to be reclaimed to be reclaimed)
+  TRACE_BEGIN("Setup_Page_Allocator");
+  Setup_Page_Allocator();
+  TRACE_END("Setup_Page_Allocator");
+
+  // Runtime page mapping (needs the page allocator for new tables, and has to go before Setup_SMP() so the APs get CR4.PCIDE)
+  TRACE_BEGIN("Setup_VMM");
+  Setup_VMM();
+  TRACE_END("Setup_VMM");
+
+  // RAM back buffers for the framebuffers, if asked for (needs the page allocator)
+  if(Global_Kernel_Options.Shadow_Framebuffer)
+  {
+    TRACE_BEGIN("Setup_Shadow_Framebuffers");
+    Setup_Shadow_Framebuffers(LP->GPU_Configs);
+    TRACE_END("Setup_Shadow_Framebuffers");
+  }
+
+  // Copies of printf's screen on every other GPU, if asked for (also needs the page allocator)
+  if(Global_Kernel_Options.Mirror_Console)
+  {
+    TRACE_BEGIN("Setup_Mirror_Heads");
+    Setup_Mirror_Heads(LP->GPU_Configs);
+    TRACE_END("Setup_Mirror_Heads");
+  }
 
   // HWP
+  TRACE_BEGIN("Enable_HWP");
   Enable_HWP();
+  TRACE_END("Enable_HWP");
+
+  // TSC frequency, for everything that tells time from here on (needs ACPI and paging, for the HPET)
+  TRACE_BEGIN("Setup_Clock");
+  Setup_Clock();
+  TRACE_END("Setup_Clock");
 
-  // Enable Maskable Interrupts TODO
-  // Exceptions and Non-Maskable Interrupts are always enabled.
-  // Enable_Maskable_Interrupts() here
+  // Start the other CPUs (needs GDT, IDT, paging, and reclaimed memory below 1MB for the AP trampoline)
+  TRACE_BEGIN("Setup_SMP");
+  Setup_SMP();
+  TRACE_END("Setup_SMP");
 
+  // Hand the deferred console to its own core, if asked for (needs the APs running)
+  if(Global_Kernel_Options.Console_CPU)
+  {
+    Console_Start_Renderer(Global_Kernel_Options.Console_CPU);
+  }
+  Console_Flush(); // Does nothing if the console isn't deferred
+
+  // Let THR-empty interrupts feed the serial console (needs the local APIC, which Setup_SMP() sets up)
+  if(Global_Serial.Port)
+  {
+    Serial_Start_Interrupts();
+  }
+
+  // Local APIC timer and timer wheel (also needs Setup_SMP(), for the local APIC mode)
+  Setup_Timer();
+
+  // Cooperative tasks, with kernel_main() as the BSP's boot task. APs only join in if asked to, since that takes them away from
+  // SMP_Run_On_CPU().
+  if(Setup_Scheduler())
+  {
+    uint64_t workers = 0;
+    for(uint64_t cpu = 1; (cpu < Global_SMP_Info.Number_of_CPUs) && (workers < Global_Kernel_Options.Task_Workers); cpu++)
+    {
+      if((cpu != Global_Kernel_Options.Console_CPU) && Task_Start_Worker(cpu))
+      {
+        workers++;
+      }
+    }
+  }
+
+  // Cheaper extended state saves for User_ISR_handler()
+  Setup_ISR_XSave();
+
+  // Per-vector interrupt counts and handler times
+  Setup_ISR_Stats();
+
+  // Performance counters
+  Setup_PMU();
+
+  // Enable Maskable Interrupts
+  // Exceptions and Non-Maskable Interrupts are always enabled. Maskable ones only go to the BSP, and only once something has been
+  // routed to it.
+  if(Global_Serial.Interrupts || Global_Timer.Mode)
+  {
+    Enable_Maskable_Interrupts();
+  }
+
+  TRACE_END("System_Init");
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Parse_Kernel_Options: Read Boot Options
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// The second line of Kernel64.txt gets passed in as LP->Kernel_Options, a UTF-16 string. This splits it into words (separated by
+// spaces, tabs, or commas) and sets the matching fields in Global_Kernel_Options. Unknown words are ignored.
+//
+// Options:
+//  noverify - ZeroAllConventionalMemory() trusts its streaming stores and skips reading memory back
+//  lazyzero - Don't zero all free memory at boot; zero it in the background instead and zero on demand (StartBackgroundZeroing())
+//  nt=N - AVX_memcpy/memmove/memset switch to streaming stores above N kB instead of the CPUID-derived threshold
+//  prefetch=N - Prefetch N bytes ahead in copy loops instead of the CPUID-derived distance
+//  bench - Run the memory benchmarks (Benchmark.c) after memory has been zeroed
+//  bench=N - Same, but with N MB as the largest size instead of 1GB
+//  shadowfb - Draw into RAM copies of the framebuffers and only write changed areas to the real ones (Setup_Shadow_Framebuffers())
+//  deferprintf - printf() only queues text, which gets drawn in batches (Console.c). Output from a hang, as opposed to a crash, may
+//                never make it to the screen with this.
+//  deferprintf=N - Same, but AP number N draws the text as it comes in once Setup_SMP() has started it
+//  mirror - Draw printf's text once and copy it to every other GPU's screen, converting format and resolution (Setup_Mirror_Heads())
+//  serial - Also send printf's text out the first COM port found, interrupt-driven once the APIC is up (Serial.c)
+//  serial=N - Same, but on COMN (1-4)
+//  serialonly - Send printf's text out the first COM port found instead of drawing it, for running headless
+//  workers=N - Have N APs run cooperative tasks alongside the BSP (Task.c)
+//  bulkmin=N - Split bulk_copy()/bulk_fill() jobs of at least N MB across idle APs instead of 8 MB (Bulk.c)
+//
+
+void Parse_Kernel_Options(LOADER_PARAMS * LP)
+{
+  if(LP->Kernel_Options == NULL)
+  {
+    return;
+  }
+
+  uint64_t length = LP->Kernel_Options_Size >> 1; // Size is in bytes
+  uint64_t token_start = 0;
+
+  for(uint64_t i = 0; i <= length; i++)
+  {
+    CHAR16 character = (i < length) ? LP->Kernel_Options[i] : 0;
+
+    if((character == 0) || (character == ' ') || (character == '\t') || (character == ',') || (character == '\r') || (character == '\n'))
+    {
+      if(i > token_start)
+      {
+        const CHAR16 * token = &LP->Kernel_Options[token_start];
+        uint64_t token_length = i - token_start;
+
+        uint64_t value = 0;
+
+        if(kernel_option_match(token, token_length, "noverify"))
+        {
+          Global_Kernel_Options.No_Zero_Verify = 1;
+        }
+        else if(kernel_option_match(token, token_length, "lazyzero"))
+        {
+          Global_Kernel_Options.Lazy_Zero = 1;
+        }
+        else if(kernel_option_value(token, token_length, "nt=", &value))
+        {
+          AVX_Mem_Dispatch.NT_Threshold = value << 10; // In kB
+        }
+        else if(kernel_option_value(token, token_length, "prefetch=", &value))
+        {
+          AVX_Mem_Dispatch.Prefetch_Distance = value;
+        }
+        else if(kernel_option_match(token, token_length, "bench"))
+        {
+          Global_Kernel_Options.Benchmark = 1;
+        }
+        else if(kernel_option_value(token, token_length, "bench=", &value))
+        {
+          Global_Kernel_Options.Benchmark = 1;
+          Global_Kernel_Options.Benchmark_Max_Size = value << 20; // In MB
+        }
+        else if(kernel_option_match(token, token_length, "shadowfb"))
+        {
+          Global_Kernel_Options.Shadow_Framebuffer = 1;
+        }
+        else if(kernel_option_match(token, token_length, "mirror"))
+        {
+          Global_Kernel_Options.Mirror_Console = 1;
+        }
+        else if(kernel_option_match(token, token_length, "deferprintf"))
+        {
+          Global_Kernel_Options.Deferred_Console = 1;
+        }
+        else if(kernel_option_value(token, token_length, "deferprintf=", &value))
+        {
+          Global_Kernel_Options.Deferred_Console = 1;
+          Global_Kernel_Options.Console_CPU = value;
+        }
+        else if(kernel_option_match(token, token_length, "serial"))
+        {
+          Global_Kernel_Options.Serial_Console = 1;
+        }
+        else if(kernel_option_value(token, token_length, "serial=", &value))
+        {
+          Global_Kernel_Options.Serial_Console = 1;
+          Global_Kernel_Options.Serial_Port = value;
+        }
+        else if(kernel_option_match(token, token_length, "serialonly"))
+        {
+          Global_Kernel_Options.Serial_Console = 1;
+          Global_Kernel_Options.Serial_Only = 1;
+        }
+        else if(kernel_option_value(token, token_length, "workers=", &value))
+        {
+          Global_Kernel_Options.Task_Workers = value;
+        }
+        else if(kernel_option_match(token, token_length, "vmlarge"))
+        {
+          Global_Kernel_Options.Vmalloc_Large = 2;
+        }
+        else if(kernel_option_value(token, token_length, "vmlarge=", &value))
+        {
+          Global_Kernel_Options.Vmalloc_Large = value;
+        }
+        else if(kernel_option_value(token, token_length, "bulkmin=", &value))
+        {
+          Global_Kernel_Options.Bulk_Min = value << 20; // In MB
+        }
+      }
+
+      if(character == 0)
+      {
+        break;
+      }
+      token_start = i + 1;
+    }
+  }
+}
+
+// Compare a UTF-16 word against an ASCII option name
+static uint8_t kernel_option_match(const CHAR16 * token, uint64_t token_length, const char * name)
+{
+  uint64_t i = 0;
+
+  for(; (i < token_length) && (name[i] != '\0'); i++)
+  {
+    if(token[i] != (CHAR16)name[i])
+    {
+      return 0;
+    }
+  }
+
+  return (i == token_length) && (name[i] == '\0');
+}
+
+// Match a "name=number" word, where 'name' includes the '='. The number is decimal.
+static uint8_t kernel_option_value(const CHAR16 * token, uint64_t token_length, const char * name, uint64_t * value)
+{
+  uint64_t i = 0;
+
+  for(; name[i] != '\0'; i++)
+  {
+    if((i == token_length) || (token[i] != (CHAR16)name[i]))
+    {
+      return 0;
+    }
+  }
+
+  if(i == token_length)
+  {
+    return 0; // Nothing after the '='
+  }
+
+  uint64_t number = 0;
+  for(; i < token_length; i++)
+  {
+    if((token[i] < '0') || (token[i] > '9'))
+    {
+      return 0;
+    }
+    number = number * 10 + (token[i] - '0');
+  }
+
+  *value = number;
+  return 1;
 }
 
 //----------------------------------------------------------------------------------------------------------------------------------
@@ -140,6 +472,9 @@ uint64_t get_tick(void)
 // Check for AVX/AVX512 support and enable it. Needed in order to use AVX functions like AVX_memmove, AVX_memcpy, AVX_memset, and
 // AVX_memcmp
 //
+// This also binds those functions to the fastest implementations available (see memdispatch.c). The kernel itself is only built
+// for AVX, so the same image runs on any CPU with AVX and still gets to use AVX2 and AVX-512 where they're there.
+//
 
 void Enable_AVX(void)
 {
@@ -195,7 +530,7 @@ void Enable_AVX(void)
 
             if((xcr0 & 0xE7) == 0xE7)
             { // AVX512 sucessfully enabled
-              Colorscreen(Global_Print_Info.defaultGPU, Global_Print_Info.background_color); // We can use SSE/AVX/AVX512-optimized functions now!
+              Colorscreen(&Global_Print_Info.defaultGPU, Global_Print_Info.background_color); // We can use SSE/AVX/AVX512-optimized functions now!
               printf("AVX512 enabled.\r\n");
               // All done here.
             }
@@ -264,7 +599,7 @@ void Enable_AVX(void)
           }
           else
           {
-            Colorscreen(Global_Print_Info.defaultGPU, Global_Print_Info.background_color); // We can use SSE/AVX-optimized functions now! But not AVX512 ones.
+            Colorscreen(&Global_Print_Info.defaultGPU, Global_Print_Info.background_color); // We can use SSE/AVX-optimized functions now! But not AVX512 ones.
             printf("AVX/AVX2 enabled.\r\n");
             printf("AVX512 not supported.\r\n");
           }
@@ -367,7 +702,7 @@ void Enable_AVX(void)
 
                 if((xcr0 & 0xE7) == 0xE7)
                 { // AVX512 successfully enabled.
-                  Colorscreen(Global_Print_Info.defaultGPU, Global_Print_Info.background_color); // We can use SSE/AVX/AVX512-optimized functions now!
+                  Colorscreen(&Global_Print_Info.defaultGPU, Global_Print_Info.background_color); // We can use SSE/AVX/AVX512-optimized functions now!
                   printf("AVX512 enabled.\r\n");
                   // All done here.
                 }
@@ -436,7 +771,7 @@ void Enable_AVX(void)
               }
               else
               {
-                Colorscreen(Global_Print_Info.defaultGPU, Global_Print_Info.background_color); // We can use SSE/AVX-optimized functions now! Just not AVX512 ones.
+                Colorscreen(&Global_Print_Info.defaultGPU, Global_Print_Info.background_color); // We can use SSE/AVX-optimized functions now! Just not AVX512 ones.
                 printf("AVX/AVX2 enabled.\r\n");
                 printf("AVX512 not supported.\r\n");
               }
@@ -509,6 +844,11 @@ void Enable_AVX(void)
       }
     }
   }
+
+  // XCR0 is final now, so AVX_memcpy & co. can be pointed at the fastest versions this CPU can run
+  AVX_Mem_Bind();
+  printf("Memory functions: %s%s\r\n", (AVX_Mem_Dispatch.Features & AVX_MEM_FEATURE_AVX512F) ? "AVX512" : "native",
+                                        (AVX_Mem_Dispatch.Features & AVX_MEM_FEATURE_ERMS) ? " + ERMS" : "");
 }
 
 //----------------------------------------------------------------------------------------------------------------------------------
@@ -518,9 +858,21 @@ void Enable_AVX(void)
 // Exceptions and Non-Maskable Interrupts are always enabled.
 // This is needed for things like keyboard input.
 //
+// Only interrupts that have been routed somewhere on purpose should come in after this, so the legacy 8259 PICs get masked (the I/O
+// APIC is used instead, see IOAPIC_Route_ISA_IRQ()), and so does the local APIC timer in case firmware left it running, unless
+// Setup_Timer() has taken it over.
+//
 
 void Enable_Maskable_Interrupts(void)
 {
+  portio_rw(0x21, 0xFF, 1, 1); // Master 8259
+  portio_rw(0xA1, 0xFF, 1, 1); // Slave 8259
+
+  if(Global_Timer.Mode == TIMER_MODE_NONE)
+  {
+    lapic_rw(0x320, lapic_rw(0x320, 0, 0) | (1 << 16), 1); // LVT Timer, which firmware often uses for its own tick
+  }
+
   uint64_t rflags = control_register_rw('f', 0, 0);
   if(rflags & (1 << 9))
   {
@@ -871,7 +1223,7 @@ uint64_t get_CPU_freq(uint64_t * perfs, uint8_t avg_or_measure)
 // input data is ignored on reads
 //
 
-uint32_t portio_rw(uint16_t port_address, uint32_t data, int size, int rw)
+ISR_GPR_ONLY uint32_t portio_rw(uint16_t port_address, uint32_t data, int size, int rw)
 {
   if(size == 1)
   {
@@ -885,11 +1237,13 @@ uint32_t portio_rw(uint16_t port_address, uint32_t data, int size, int rw)
     }
     else // Read
     {
+      uint8_t value = 0;
       asm volatile("inb %[address], %[value]"
-                    : // No outputs
-                    : [value] "a" ((uint8_t)data), [address] "d" (port_address)
+                    : [value] "=a" (value) // Outputs
+                    : [address] "d" (port_address) // Inputs
                     : // No clobbers
                   );
+      data = value;
     }
   }
   else if(size == 2)
@@ -904,11 +1258,13 @@ uint32_t portio_rw(uint16_t port_address, uint32_t data, int size, int rw)
     }
     else // Read
     {
+      uint16_t value = 0;
       asm volatile("inw %[address], %[value]"
-                    : // No outputs
-                    : [value] "a" ((uint16_t)data), [address] "d" (port_address)
+                    : [value] "=a" (value) // Outputs
+                    : [address] "d" (port_address) // Inputs
                     : // No clobbers
                   );
+      data = value;
     }
   }
   else if(size == 4)
@@ -923,11 +1279,13 @@ uint32_t portio_rw(uint16_t port_address, uint32_t data, int size, int rw)
     }
     else // Read
     {
+      uint32_t value = 0;
       asm volatile("inl %[address], %[value]"
-                    : // No outputs
-                    : [value] "a" (data), [address] "d" (port_address)
+                    : [value] "=a" (value) // Outputs
+                    : [address] "d" (port_address) // Inputs
                     : // No clobbers
                   );
+      data = value;
     }
   }
   else
@@ -949,7 +1307,7 @@ uint32_t portio_rw(uint16_t port_address, uint32_t data, int size, int rw)
 // input data is ignored for reads
 //
 
-uint64_t msr_rw(uint64_t msr, uint64_t data, int rw)
+ISR_GPR_ONLY uint64_t msr_rw(uint64_t msr, uint64_t data, int rw)
 {
   uint64_t high = 0, low = 0;
 
@@ -1545,17 +1903,17 @@ void Setup_IDT(void)
   // There is some good documentation on 64-bit stack switching in the Linux kernel docs:
   // https://www.kernel.org/doc/Documentation/x86/kernel-stacks
 
-  tss64.IST_1_low = (uint32_t) ((uint64_t)NMI_stack);
-  tss64.IST_1_high = (uint32_t) ( ((uint64_t)NMI_stack) >> 32 );
+  tss64.IST_1_low = (uint32_t) ((uint64_t)&NMI_stack[NMI_STACK_SIZE]); // %rsp is decremented before use, so IST pointers are stack tops
+  tss64.IST_1_high = (uint32_t) ( ((uint64_t)&NMI_stack[NMI_STACK_SIZE]) >> 32 );
 
-  tss64.IST_2_low = (uint32_t) ((uint64_t)DF_stack);
-  tss64.IST_2_high = (uint32_t) ( ((uint64_t)DF_stack) >> 32 );
+  tss64.IST_2_low = (uint32_t) ((uint64_t)&DF_stack[DF_STACK_SIZE]); // %rsp is decremented before use, so IST pointers are stack tops
+  tss64.IST_2_high = (uint32_t) ( ((uint64_t)&DF_stack[DF_STACK_SIZE]) >> 32 );
 
-  tss64.IST_3_low = (uint32_t) ((uint64_t)MC_stack);
-  tss64.IST_3_high = (uint32_t) ( ((uint64_t)MC_stack) >> 32 );
+  tss64.IST_3_low = (uint32_t) ((uint64_t)&MC_stack[MC_STACK_SIZE]); // %rsp is decremented before use, so IST pointers are stack tops
+  tss64.IST_3_high = (uint32_t) ( ((uint64_t)&MC_stack[MC_STACK_SIZE]) >> 32 );
 
-  tss64.IST_4_low = (uint32_t) ((uint64_t)BP_stack);
-  tss64.IST_4_high = (uint32_t) ( ((uint64_t)BP_stack) >> 32 );
+  tss64.IST_4_low = (uint32_t) ((uint64_t)&BP_stack[BP_STACK_SIZE]); // %rsp is decremented before use, so IST pointers are stack tops
+  tss64.IST_4_high = (uint32_t) ( ((uint64_t)&BP_stack[BP_STACK_SIZE]) >> 32 );
 
   // Set up ISRs per ISR.S layout
 
@@ -1620,10 +1978,10 @@ void Setup_IDT(void)
   // By default everything is set to USER_ISR_MACRO.
 
   set_interrupt_entry(32, (uint64_t)User_ISR_pusher32);
-  set_interrupt_entry(33, (uint64_t)User_ISR_pusher33);
+  set_interrupt_entry(33, (uint64_t)Fast_ISR_pusher33); // PMU_VECTOR
   set_interrupt_entry(34, (uint64_t)User_ISR_pusher34);
   set_interrupt_entry(35, (uint64_t)User_ISR_pusher35);
-  set_interrupt_entry(36, (uint64_t)User_ISR_pusher36);
+  set_interrupt_entry(36, (uint64_t)Fast_ISR_pusher36); // SERIAL_VECTOR
   set_interrupt_entry(37, (uint64_t)User_ISR_pusher37);
   set_interrupt_entry(38, (uint64_t)User_ISR_pusher38);
   set_interrupt_entry(39, (uint64_t)User_ISR_pusher39);
@@ -1842,7 +2200,7 @@ void Setup_IDT(void)
   set_interrupt_entry(252, (uint64_t)User_ISR_pusher252);
   set_interrupt_entry(253, (uint64_t)User_ISR_pusher253);
   set_interrupt_entry(254, (uint64_t)User_ISR_pusher254);
-  set_interrupt_entry(255, (uint64_t)User_ISR_pusher255);
+  set_interrupt_entry(255, (uint64_t)Fast_ISR_pusher255); // Local APIC spurious interrupt
 
   //
   // Gotta love spreadsheet macros for this kind of stuff.
@@ -2016,6 +2374,13 @@ static void set_BP_interrupt_entry(uint64_t isr_num, uint64_t isr_addr)
 // which is why they can allocate 4kB memory even though Setup_Paging() sets up 1GB pages. That's important to keep in mind when making
 // any changes.
 //
+// Memory types:
+// IA32_PAT is programmed here with entries 0-3 left at their power-on defaults (so PCD/PWT mean what they always have) and entry 4 set
+// to write-combining. Then every EfiMemoryMappedIO/EfiMemoryMappedIOPortSpace range in the memory map is made UC, and every framebuffer
+// in LP->GPU_Configs is made WC, which is much faster for the streaming writes that drawing and shadow framebuffer flushes do. WC in the
+// PAT also wins over a UC MTRR, which is what firmware usually sets for the framebuffer aperture. Large pages only get split (1GB into
+// 2MB, 2MB into 4kB) where one of these ranges starts or ends inside of them, so the rest of RAM stays in the biggest pages available.
+//
 
 // The outermost table (e.g. PML4, PML5) will always take up 4kB, so it can be defined statically like this.
 __attribute__((aligned(4096))) static uint64_t outermost_table[512] = {0};
@@ -2028,7 +2393,23 @@ __attribute__((aligned(4096))) static uint64_t outermost_table[512] = {0};
 // Page tables are all the same size...
 #define PAGE_TABLE_SIZE 512*8
 
-void Setup_Paging(void)
+// PA0 = WB, PA1 = WT, PA2 = UC-, PA3 = UC (the defaults), PA4 = WC, PA5 = WT, PA6 = UC-, PA7 = UC
+#define PAT_VALUE 0x0007040100070406ULL
+
+// PAT/PCD/PWT bits in a page table entry, for 1GB/2MB pages and for 4kB pages
+#define PAGE_TYPE_BITS_LARGE ((1ULL << 12) | (1ULL << 4) | (1ULL << 3))
+#define PAGE_TYPE_BITS_4K ((1ULL << 7) | (1ULL << 4) | (1ULL << 3))
+
+// Address bits of a page table entry
+#define PAGE_ADDRESS_MASK 0x000FFFFFFFFFF000ULL
+
+// Tables made by splitting large pages come from here. Each range can split at most one 1GB and one 2MB page at each end.
+#define PAGE_SPLITS_PER_RANGE 4
+static uint64_t * split_table_pool = NULL;
+static uint64_t split_tables_left = 0;
+static uint8_t split_tables_on_demand = 0; // Take tables from pagetable_alloc() one at a time instead of from the pool
+
+void Setup_Paging(LOADER_PARAMS * LP)
 {
   // Disable global pages since we're going to overhaul the page table and don't want anything lingering from UEFI
   // Disable CR4.PGE
@@ -2323,6 +2704,67 @@ void Setup_Paging(void)
     } // PML4
   }
 
+  // Set memory types before the new tables go live, so that nothing gets cached with the wrong type
+  uint64_t rdx_pat = 0;
+  asm volatile("cpuid"
+               : "=d" (rdx_pat) // Outputs
+               : "a" (0x01) // The value to put into %rax
+               : "%rbx", "%rcx" // CPUID clobbers these
+              );
+
+  if(rdx_pat & (1 << 16))
+  {
+    // Room for any splits first, since claiming memory adds entries to the memory map
+    uint64_t ranges = LP->GPU_Configs->NumberOfFrameBuffers;
+    EFI_MEMORY_DESCRIPTOR * Piece;
+    for(Piece = Global_Memory_Info.MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
+    {
+      if((Piece->Type == EfiMemoryMappedIO) || (Piece->Type == EfiMemoryMappedIOPortSpace))
+      {
+        ranges++;
+      }
+    }
+    split_tables_left = ranges * PAGE_SPLITS_PER_RANGE;
+    split_table_pool = (uint64_t*)pagetable_alloc(split_tables_left * PAGE_TABLE_SIZE);
+
+    // See Intel SDM Volume 3A, Section 11.12.4 (Programming the PAT)
+    asm volatile("wbinvd" : : : "memory");
+    msr_rw(0x277, PAT_VALUE, 1);
+
+    uint64_t levels = (control_register_rw(4, 0, 0) & (1 << 12)) ? 5 : 4; // CR4.LA57
+
+    // MMIO first so that a framebuffer inside of an MMIO range still ends up WC
+    for(Piece = Global_Memory_Info.MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
+    {
+      if((Piece->Type == EfiMemoryMappedIO) || (Piece->Type == EfiMemoryMappedIOPortSpace))
+      {
+        if(paging_set_type(outermost_table, levels, 0, Piece->PhysicalStart, Piece->PhysicalStart + EFI_PAGES_TO_SIZE(Piece->NumberOfPages), PAT_UC))
+        {
+          printf("MMIO range %#qx-%#qx isn't fully mapped.\r\n", Piece->PhysicalStart, Piece->PhysicalStart + EFI_PAGES_TO_SIZE(Piece->NumberOfPages) - 1);
+        }
+      }
+    }
+
+    for(uint64_t gpu = 0; gpu < LP->GPU_Configs->NumberOfFrameBuffers; gpu++)
+    {
+      EFI_PHYSICAL_ADDRESS fb_base = LP->GPU_Configs->GPUArray[gpu].FrameBufferBase & ~0xFFFULL;
+      EFI_PHYSICAL_ADDRESS fb_end = (LP->GPU_Configs->GPUArray[gpu].FrameBufferBase + LP->GPU_Configs->GPUArray[gpu].FrameBufferSize + 0xFFF) & ~0xFFFULL;
+
+      if(paging_set_type(outermost_table, levels, 0, fb_base, fb_end, PAT_WC))
+      {
+        printf("GPU %qu's framebuffer (%#qx-%#qx) isn't fully mapped.\r\n", gpu, fb_base, fb_end - 1);
+      }
+      else
+      {
+        printf("GPU %qu's framebuffer is write-combining.\r\n", gpu);
+      }
+    }
+  }
+  else
+  {
+    printf("PAT is not supported, framebuffers keep their firmware memory types.\r\n");
+  }
+
   control_register_rw(3, (uint64_t)outermost_table, 1);
   // Certain hypervisors like Hyper-V will crash right here if less than 4GB is allocated to the VM. Actually, it appears to be 3968MB or less, as Hyper-V mysteriously adds 2-128MB on top of memory allocated via settings.
   // In Windows Event Viewer, Hyper-V-Worker will throw one of these errors:
@@ -2345,6 +2787,142 @@ void Setup_Paging(void)
   }
 }
 
+//----------------------------------------------------------------------------------------------------------------------------------
+// Set_Memory_Type: Change the Memory Type of a Physical Range
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Set the PAT memory type of an identity-mapped range in the page tables made by Setup_Paging(), splitting large pages at the edges of
+// the range if needed. Caches are only flushed on the calling CPU, so it's meant for use before Setup_SMP() starts the APs.
+//
+// Once Setup_VMM() has run this goes through protect_range(), so split tables come from the page allocator and get given back when
+// the range's type matches its neighbors again, and other CPUs' TLBs get flushed too. That also sets the range back to read/write,
+// executable, and not global, which is how Setup_Paging() maps everything. Before then, each split table is claimed only when it's
+// needed, since nothing can give tables from pagetable_alloc() back.
+//
+// base: Physical address of the range, rounded down to 4kB
+// size: Size of the range in bytes, rounded up to 4kB
+// pat_index: PAT_WB, PAT_WT, PAT_UC_MINUS, PAT_UC, or PAT_WC
+//
+
+void Set_Memory_Type(EFI_PHYSICAL_ADDRESS base, uint64_t size, uint64_t pat_index)
+{
+  EFI_PHYSICAL_ADDRESS end = (base + size + 0xFFF) & ~0xFFFULL;
+  base &= ~0xFFFULL;
+
+  if(Global_VMM.Levels)
+  {
+    protect_range(base, end - base, VMM_TYPE(pat_index)); // This flushes TLBs and reports its own errors
+    asm volatile("wbinvd" : : : "memory");
+    return;
+  }
+
+  split_tables_left = 0;
+  split_tables_on_demand = 1;
+
+  uint64_t levels = (control_register_rw(4, 0, 0) & (1 << 12)) ? 5 : 4; // CR4.LA57
+  if(paging_set_type(outermost_table, levels, 0, base, end, pat_index))
+  {
+    printf("Set_Memory_Type: %#qx-%#qx isn't fully mapped.\r\n", base, end - 1);
+  }
+
+  split_tables_on_demand = 0;
+
+  // The old type may still be in the TLB and caches
+  control_register_rw(3, control_register_rw(3, 0, 0), 1);
+  asm volatile("wbinvd" : : : "memory");
+}
+
+// Apply PAT entry 'pat_index' to [base, end) in a table at 'level' (5 = PML5 ... 1 = PT) that maps from 'table_base'.
+// Returns 1 if part of the range isn't mapped.
+static uint64_t paging_set_type(uint64_t * table, uint64_t level, uint64_t table_base, uint64_t base, uint64_t end, uint64_t pat_index)
+{
+  uint64_t shift = 12 + 9 * (level - 1);
+  uint64_t entry_size = 1ULL << shift;
+  uint64_t missing = 0;
+
+  // PAT index bit 0 is PWT, bit 1 is PCD, and bit 2 is PAT
+  uint64_t type_bits_4k = ((pat_index & 1) << 3) | ((pat_index & 2) << 3) | ((pat_index & 4) << 5);
+  uint64_t type_bits_large = ((pat_index & 1) << 3) | ((pat_index & 2) << 3) | ((pat_index & 4) << 10);
+
+  for(uint64_t index = (base - table_base) >> shift; index < 512; index++)
+  {
+    uint64_t entry_base = table_base + (index << shift);
+    if(entry_base >= end)
+    {
+      break;
+    }
+
+    uint64_t entry = table[index];
+    if(!(entry & 0x1)) // Not present
+    {
+      missing = 1;
+      continue;
+    }
+
+    if(level == 1)
+    {
+      table[index] = (entry & ~PAGE_TYPE_BITS_4K) | type_bits_4k;
+      continue;
+    }
+
+    EFI_PHYSICAL_ADDRESS start = (base > entry_base) ? base : entry_base;
+    EFI_PHYSICAL_ADDRESS stop = (end < (entry_base + entry_size)) ? end : (entry_base + entry_size);
+
+    if(entry & (1 << 7)) // 1GB or 2MB page
+    {
+      if((start == entry_base) && (stop == (entry_base + entry_size)))
+      {
+        table[index] = (entry & ~PAGE_TYPE_BITS_LARGE) | type_bits_large;
+        continue;
+      }
+
+      // Only part of this page changes, so it needs to become 512 smaller ones with the same flags
+      uint64_t * split = paging_alloc_table();
+      if(split == NULL)
+      {
+        printf("Out of tables for splitting large pages.\r\n");
+        return 1;
+      }
+
+      uint64_t flags = entry & 0x8000000000001FFFULL; // NX and the low 13 bits, which include PAT for large pages
+      uint64_t child_size = entry_size >> 9;
+      for(uint64_t child = 0; child < 512; child++)
+      {
+        if(level == 2)
+        {
+          // 4kB pages have no PS bit, and their PAT bit is bit 7
+          split[child] = (entry_base + (child << 12)) | (flags & ~((1ULL << 12) | (1ULL << 7))) | ((flags & (1ULL << 12)) >> 5);
+        }
+        else
+        {
+          split[child] = (entry_base + child * child_size) | flags;
+        }
+      }
+
+      table[index] = (uint64_t)split | 0x3; // Flags: NX[63] = 0, A[5] = 0, PCD[4] = 0, PWT[3] = 0, U/S[2] = 0, R/W[1] = 1, P[0] = 1.
+    }
+
+    missing |= paging_set_type((uint64_t*)(table[index] & PAGE_ADDRESS_MASK), level - 1, entry_base, start, stop, pat_index);
+  }
+
+  return missing;
+}
+
+// Hand out one zeroed 4kB table from split_table_pool (or pagetable_alloc(), see split_tables_on_demand), or NULL if it's empty
+static uint64_t * paging_alloc_table(void)
+{
+  if(split_tables_left == 0)
+  {
+    return split_tables_on_demand ? (uint64_t*)pagetable_alloc(PAGE_TABLE_SIZE) : NULL;
+  }
+
+  uint64_t * table = split_table_pool;
+  split_table_pool += 512;
+  split_tables_left--;
+
+  return table;
+}
+
 //----------------------------------------------------------------------------------------------------------------------------------
 // Get_Brandstring: Read CPU Brand String
 //----------------------------------------------------------------------------------------------------------------------------------
@@ -2896,6 +3474,84 @@ __attribute__((aligned(64))) static volatile unsigned char sx_xsave_space[XSAVE_
 // The problem with this malloc-style method is that getting the output asm correct so that [m] in "xsave %[m]" comes out right is much more cumbersome.
 // The implemented static way merely needs to have the STACK_SIZE increased if something like AVX-1024 ever happens (and the 0xE7 masks will need to be updated,
 // but that's true no matter what).
+//
+// User_ISR_handler() is the exception: it runs often (timer ticks) and can run on any CPU, so it gets per-CPU areas from Setup_ISR_XSave() and
+// passes the address in a register instead. user_xsave_space is only used before that. PF_EXC_handler() gets per-CPU areas the same way, since
+// it backs Vmalloc() pages for whichever CPU touches them first.
+
+static uint8_t isr_xsave_ready = 0;
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Setup_ISR_XSave: Per-CPU XSAVE Areas for User-Defined Interrupts
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Give every CPU its own XSAVE area for User_ISR_handler(), and pick the cheapest way to fill it:
+//  - XSAVES, which skips state that's in its initial configuration or hasn't changed since the last XRSTORS from the same area (it
+//    writes the compacted format, which AVX_regdump() can't read directly)
+//  - XSAVEOPT, which does the same but keeps the standard format
+//  - XSAVE otherwise
+//
+// Call after Setup_SMP() and before Enable_Maskable_Interrupts(). Returns 1 on success, 0 if User_ISR_handler() has to keep using the
+// single static area.
+//
+
+uint8_t Setup_ISR_XSave(void)
+{
+  uint64_t rax = 0, rbx = 0, rcx = 0, rdx = 0;
+
+  // CPUID leaf 0xD, sub-leaf 0: %rbx = standard-format XSAVE area size for what's enabled in XCR0. The compacted format is never bigger.
+  asm volatile("cpuid"
+               : "=a" (rax), "=b" (rbx), "=c" (rcx), "=d" (rdx) // Outputs
+               : "a" (0x0D), "c" (0x00) // The values to put into %rax and %rcx
+               : // No clobbers
+             );
+  uint64_t xsave_size = (rbx + 63) & ~63ULL;
+
+  // Sub-leaf 1: %rax bit 0 = XSAVEOPT, bit 3 = XSAVES/XRSTORS
+  asm volatile("cpuid"
+               : "=a" (rax), "=b" (rbx), "=c" (rcx), "=d" (rdx) // Outputs
+               : "a" (0x0D), "c" (0x01) // The values to put into %rax and %rcx
+               : // No clobbers
+             );
+
+  if((xsave_size == 0) || (xsave_size > XSAVE_SIZE))
+  {
+    printf("Setup_ISR_XSave: Unexpected XSAVE area size.\r\n");
+    return 0;
+  }
+
+  uint64_t instruction = ISR_XSAVE;
+  if(rax & 0x8)
+  {
+    instruction = ISR_XSAVES;
+  }
+  else if(rax & 0x1)
+  {
+    instruction = ISR_XSAVEOPT;
+  }
+
+  // Two areas per CPU: one for User_ISR_handler(), and one for PF_EXC_handler(), which backs Vmalloc() pages on any CPU
+  uint64_t cpus = Global_SMP_Info.Number_of_CPUs;
+  uint8_t * areas = malloc4k(EFI_SIZE_TO_PAGES(xsave_size * cpus * 2));
+  if(areas == MALLOC_FAILED)
+  {
+    printf("Setup_ISR_XSave: Not enough memory for XSAVE areas.\r\n");
+    return 0;
+  }
+  AVX_memset(areas, 0, xsave_size * cpus * 2); // XRSTOR(S) faults on a garbage XSAVE header
+
+  for(uint64_t cpu = 0; cpu < cpus; cpu++)
+  {
+    Global_Per_CPU_Data[cpu].ISR_XSave_Area = areas + cpu * xsave_size;
+    Global_Per_CPU_Data[cpu].PF_XSave_Area = areas + (cpus + cpu) * xsave_size;
+    Global_Per_CPU_Data[cpu].ISR_XSave_Instruction = instruction;
+  }
+
+  isr_xsave_ready = 1;
+
+  printf("Interrupts: %s, %qu-byte XSAVE areas.\r\n", (instruction == ISR_XSAVES) ? "XSAVES" : ((instruction == ISR_XSAVEOPT) ? "XSAVEOPT" : "XSAVE"), xsave_size);
+  return 1;
+}
 
 
 //
@@ -2907,12 +3563,17 @@ __attribute__((aligned(64))) static volatile unsigned char sx_xsave_space[XSAVE_
 
 void User_ISR_handler(INTERRUPT_FRAME * i_frame)
 {
-  // %rdx: Mask for xcr0 [63:32], %rax: Mask for xcr0 [31:0]
-  asm volatile ("xsave64 %[area]"
-                : // No outputs
-                : "a" (0xE7), "d" (0x00), [area] "m" (user_xsave_space) // Inputs
-                : "memory" // Clobbers
-              );
+  // Each CPU gets its own area once Setup_ISR_XSave() has run, since maskable interrupts can come in on more than one CPU at a time
+  uint8_t * area = (uint8_t*)user_xsave_space;
+  uint64_t instruction = ISR_XSAVE;
+  if(isr_xsave_ready)
+  {
+    PER_CPU_STRUCT * cpu = get_cpu_data();
+    area = cpu->ISR_XSave_Area;
+    instruction = cpu->ISR_XSave_Instruction;
+  }
+
+  isr_xsave(area, instruction);
 
   // OK, since xsave has been called we can now safely use AVX instructions in this interrupt--up until xrstor is called, at any rate.
   // Using an interrupt gate in the IDT means we won't get preempted now, either, which would wreck the xsave area.
@@ -2924,6 +3585,11 @@ void User_ISR_handler(INTERRUPT_FRAME * i_frame)
     // User-Defined Interrupts (32-255)
     //
 
+    case TIMER_VECTOR:
+      Timer_Interrupt();
+      lapic_rw(0xB0, 0, 1); // EOI
+      break;
+
 //    case 32: // Minimum allowed user-defined case number
 //    // Case 32 code
 //      break;
@@ -2939,17 +3605,49 @@ void User_ISR_handler(INTERRUPT_FRAME * i_frame)
     default:
       printf("User_ISR_handler: Unhandled Interrupt! IDT Entry: %#qu\r\n", i_frame->isr_num);
       ISR_regdump(i_frame);
+      if(area != (uint8_t*)user_xsave_space)
+      {
+        // XSAVES writes the compacted format and XSAVEOPT can leave parts of the area alone, so dump a plain XSAVE of the same state
+        isr_xrstor(area, instruction);
+        isr_xsave((uint8_t*)user_xsave_space, ISR_XSAVE);
+      }
       AVX_regdump((XSAVE_AREA_LAYOUT*)user_xsave_space);
       asm volatile("hlt");
       break;
   }
 
-  // %rdx: Mask for xcr0 [63:32], %rax: Mask for xcr0 [31:0]
-  asm volatile ("xrstor64 %[area]"
-                : // No outputs
-                : "a" (0xE7), "d" (0x00), [area] "m" (user_xsave_space) // Inputs
-                : "memory" // Clobbers
-              );
+  isr_xrstor(area, instruction);
+}
+
+//
+// Fast User-Defined Interrupts (no error code)
+//
+
+// These come in through FAST_ISR_MACRO, which only saves the caller-saved general purpose registers and skips XSAVE entirely. Everything
+// called from here has to be ISR_GPR_ONLY (or plain asm), since nothing has saved the vector registers. That rules out printf.
+
+ISR_GPR_ONLY void Fast_ISR_handler(FAST_INTERRUPT_FRAME * i_frame)
+{
+  switch(i_frame->isr_num)
+  {
+    case SERIAL_VECTOR:
+      Serial_Interrupt();
+      lapic_rw(0xB0, 0, 1); // EOI
+      break;
+
+    case PMU_VECTOR:
+      PMU_Interrupt(i_frame);
+      lapic_rw(0xB0, 0, 1); // EOI
+      break;
+
+    case 0xFF: // Local APIC spurious interrupt: nothing to do, and no EOI
+      break;
+
+    default:
+      // Can't print anything from here, so just acknowledge it. Vectors that need reporting should use USER_ISR_MACRO instead.
+      lapic_rw(0xB0, 0, 1); // EOI
+      break;
+  }
 }
 
 //
@@ -2997,6 +3695,7 @@ void CPU_EXC_handler(EXCEPTION_FRAME * e_frame)
   // OK, since xsave has been called we can now safely use AVX instructions in this interrupt--up until xrstor is called, at any rate.
   // Using an interrupt gate in the IDT means we won't get preempted now, either, which would wreck the xsave area.
 
+  Console_Panic(); // This isn't coming back, so make sure everything gets drawn
   printf("CPU_EXC_handler: Unhandled Exception! IDT Entry: %#qu, Error Code: %#qx\r\n", e_frame->isr_num, e_frame->error_code);
   EXC_regdump(e_frame);
   AVX_regdump((XSAVE_AREA_LAYOUT*)cpu_xsave_space);
@@ -3061,6 +3760,12 @@ void DB_ISR_handler(INTERRUPT_FRAME * i_frame) // Fault/Trap #DB: Debug Exceptio
 // Vector 2
 void NMI_ISR_handler(INTERRUPT_FRAME * i_frame) // NMI (Nonmaskable External Interrupt)
 {
+  // TLB shootdowns from VMM.c come in as NMIs, since those get through even with interrupts off
+  if(VMM_Shootdown_NMI())
+  {
+    return;
+  }
+
   // %rdx: Mask for xcr0 [63:32], %rax: Mask for xcr0 [31:0]
   asm volatile ("xsave64 %[area]"
                 : // No outputs
@@ -3343,14 +4048,27 @@ void GP_EXC_handler(EXCEPTION_FRAME * e_frame) // Fault #GP: General Protection
 // Vector 14
 void PF_EXC_handler(EXCEPTION_FRAME * e_frame) // Fault #PF: Page Fault
 {
-  // %rdx: Mask for xcr0 [63:32], %rax: Mask for xcr0 [31:0]
-  asm volatile ("xsave64 %[area]"
-                : // No outputs
-                : "a" (0xE7), "d" (0x00), [area] "m" (pf_xsave_space) // Inputs
-                : "memory" // Clobbers
-              );
-
   uint64_t cr2 = control_register_rw(2, 0, 0); // CR2 has the page fault linear address
+
+  // Vmalloc() memory faults on first touch on any CPU, so each CPU gets its own area once Setup_ISR_XSave() has run
+  uint8_t * area = (uint8_t*)pf_xsave_space;
+  uint64_t instruction = ISR_XSAVE;
+  if(isr_xsave_ready)
+  {
+    PER_CPU_STRUCT * cpu = get_cpu_data();
+    area = cpu->PF_XSave_Area;
+    instruction = cpu->ISR_XSave_Instruction;
+  }
+
+  isr_xsave(area, instruction);
+
+  // A first touch of a Vmalloc() page just gets the page backed, and then the faulting instruction runs again
+  if(VMM_Page_Fault(cr2, e_frame->error_code))
+  {
+    isr_xrstor(area, instruction);
+    return;
+  }
+
   uint64_t cr3 = control_register_rw(3, 0, 0); // CR3 has the page directory base (bottom 12 bits of address are assumed 0)
   printf("Fault #PF: Page Fault! IDT Entry: %#qu, Error Code: %#qx\r\n", e_frame->isr_num, e_frame->error_code);
   printf("CR2: %#qx\r\n", cr2);
@@ -3367,12 +4085,7 @@ void PF_EXC_handler(EXCEPTION_FRAME * e_frame) // Fault #PF: Page Fault
       break;
   }
 
-  // %rdx: Mask for xcr0 [63:32], %rax: Mask for xcr0 [31:0]
-  asm volatile ("xrstor64 %[area]"
-                : // No outputs
-                : "a" (0xE7), "d" (0x00), [area] "m" (pf_xsave_space) // Inputs
-                : "memory" // Clobbers
-              );
+  isr_xrstor(area, instruction);
 }
 
 // Vector 15 is reserved
@@ -3536,6 +4249,7 @@ void SX_EXC_handler(EXCEPTION_FRAME * e_frame) // Fault #SX: Security Exception
 
 void ISR_regdump(INTERRUPT_FRAME * i_frame)
 {
+  Console_Panic(); // Every special handler prints through here before halting, so draw anything queued by the deferred console
   printf("rax: %#qx, rbx: %#qx, rcx: %#qx, rdx: %#qx, rsi: %#qx, rdi: %#qx\r\n", i_frame->rax, i_frame->rbx, i_frame->rcx, i_frame->rdx, i_frame->rsi, i_frame->rdi);
   printf("r8: %#qx, r9: %#qx, r10: %#qx, r11: %#qx, r12: %#qx, r13: %#qx\r\n", i_frame->r8, i_frame->r9, i_frame->r10, i_frame->r11, i_frame->r12, i_frame->r13);
   printf("r14: %#qx, r15: %#qx, rbp: %#qx, rip: %#qx, cs: %#qx, rflags: %#qx\r\n", i_frame->r14, i_frame->r15, i_frame->rbp, i_frame->rip, i_frame->cs, i_frame->rflags);
@@ -3548,6 +4262,7 @@ void ISR_regdump(INTERRUPT_FRAME * i_frame)
 
 void EXC_regdump(EXCEPTION_FRAME * e_frame)
 {
+  Console_Panic(); // Same as in ISR_regdump()
   printf("rax: %#qx, rbx: %#qx, rcx: %#qx, rdx: %#qx, rsi: %#qx, rdi: %#qx\r\n", e_frame->rax, e_frame->rbx, e_frame->rcx, e_frame->rdx, e_frame->rsi, e_frame->rdi);
   printf("r8: %#qx, r9: %#qx, r10: %#qx, r11: %#qx, r12: %#qx, r13: %#qx\r\n", e_frame->r8, e_frame->r9, e_frame->r10, e_frame->r11, e_frame->r12, e_frame->r13);
   printf("r14: %#qx, r15: %#qx, rbp: %#qx, rip: %#qx, cs: %#qx, rflags: %#qx\r\n", e_frame->r14, e_frame->r15, e_frame->rbp, e_frame->rip, e_frame->cs, e_frame->rflags);
@@ -3714,3 +4429,53 @@ void HaCF(void)
     asm volatile("hlt");
   }
 }
+
+// Save extended state for User_ISR_handler(). %rdx: Mask for xcr0 [63:32], %rax: Mask for xcr0 [31:0]
+static void isr_xsave(uint8_t * area, uint64_t instruction)
+{
+  if(instruction == ISR_XSAVES)
+  {
+    asm volatile ("xsaves64 (%[area])"
+                  : // No outputs
+                  : "a" (0xE7), "d" (0x00), [area] "r" (area) // Inputs
+                  : "memory" // Clobbers
+                );
+  }
+  else if(instruction == ISR_XSAVEOPT)
+  {
+    asm volatile ("xsaveopt64 (%[area])"
+                  : // No outputs
+                  : "a" (0xE7), "d" (0x00), [area] "r" (area) // Inputs
+                  : "memory" // Clobbers
+                );
+  }
+  else
+  {
+    asm volatile ("xsave64 (%[area])"
+                  : // No outputs
+                  : "a" (0xE7), "d" (0x00), [area] "r" (area) // Inputs
+                  : "memory" // Clobbers
+                );
+  }
+}
+
+// Restore what isr_xsave() saved. XSAVES areas are compacted, so they need XRSTORS.
+static void isr_xrstor(uint8_t * area, uint64_t instruction)
+{
+  if(instruction == ISR_XSAVES)
+  {
+    asm volatile ("xrstors64 (%[area])"
+                  : // No outputs
+                  : "a" (0xE7), "d" (0x00), [area] "r" (area) // Inputs
+                  : "memory" // Clobbers
+                );
+  }
+  else
+  {
+    asm volatile ("xrstor64 (%[area])"
+                  : // No outputs
+                  : "a" (0xE7), "d" (0x00), [area] "r" (area) // Inputs
+                  : "memory" // Clobbers
+                );
+  }
+}
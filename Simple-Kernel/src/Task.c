@@ -0,0 +1,631 @@
+//==================================================================================================================================
+//  Simple Kernel: Cooperative Tasks
+//==================================================================================================================================
+//
+// Version 0.z
+//
+// Author:
+//  KNNSpeed
+//
+// Source Code:
+//  https://github.com/KNNSpeed/Simple-Kernel
+//
+// This file contains a small cooperative task runtime: tasks with their own malloc4k() stacks that run until they call Task_Yield(),
+// Task_Sleep_us(), Task_Join(), or return.
+//
+// A context switch pushes the callee-saved registers onto the old stack, switches %rsp, and pops them off the new one. Everything
+// else the ABI says a call may clobber is already dead at that point, except for extended state (MXCSR, x87 control word, and
+// anything a task keeps in vector registers across a yield), so that gets saved and restored with XSAVE like User_ISR_handler()
+// does, using XSAVEOPT or XSAVEC when available so that unchanged or unused state doesn't get written out. RFLAGS isn't switched:
+// whether interrupts are on is a property of the CPU (only the BSP takes them), not of the task.
+//
+// Each CPU running tasks has its own FIFO run queue in Global_Scheduler. Tasks get queued on the CPU that spawns them, and a CPU that
+// runs out of tasks steals from the others. Every CPU also has a boot task standing for the call chain that was running before it
+// started switching (kernel_main() on the BSP, the worker loop on APs); boot tasks never move to another CPU.
+//
+// A task is only put on a run queue once it's completely switched out, by whatever runs next on its CPU, so another CPU can never
+// steal a task whose registers are still being saved. The same goes for finished tasks, which only get marked done (and so can be
+// freed by Task_Join()) once their CPU is off their stack.
+//
+
+#include "Kernel64.h"
+
+#define TASK_STATE_READY   0
+#define TASK_STATE_RUNNING 1
+#define TASK_STATE_EXITING 2
+
+// Which instruction task_xsave() uses
+#define TASK_XSAVE         0
+#define TASK_XSAVEOPT      1
+#define TASK_XSAVEC        2
+
+#define TASK_DEFAULT_STACK_PAGES 16
+
+static void task_worker(void * arg);
+static void task_entry(void) __attribute__((noreturn));
+static void task_switch(TASK_QUEUE * queue, TASK * next);
+static void task_switch_stack(uint64_t * save_rsp, uint64_t new_rsp);
+static void task_finish_switch(void);
+static void task_enqueue(TASK_QUEUE * queue, TASK * task);
+static TASK * task_pick(TASK_QUEUE * queue);
+static TASK * task_dequeue(TASK_QUEUE * queue, uint8_t movable_only);
+static void task_xsave(void * area);
+static void task_xrstor(void * area);
+static void task_lock(volatile uint64_t * lock);
+static void task_unlock(volatile uint64_t * lock);
+static void task_sleep_done(void * arg);
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Setup_Scheduler: Set Up Run Queues
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Pick the XSAVE variant to switch with, allocate every CPU's boot task XSAVE area, and make kernel_main() the BSP's boot task. APs
+// only run tasks once they've been handed over with Task_Start_Worker().
+//
+// Requires: Setup_SMP() (for the CPU count), Enable_AVX() (for XSAVE), and Setup_Page_Allocator() (for malloc4k())
+//
+// Returns 1 on success, 0 on failure
+//
+
+uint8_t Setup_Scheduler(void)
+{
+  uint64_t rax = 0, rbx = 0, rcx = 0, rdx = 0;
+
+  // CPUID leaf 0xD, sub-leaf 0: %rbx = XSAVE area size for what's enabled in XCR0
+  asm volatile("cpuid"
+               : "=a" (rax), "=b" (rbx), "=c" (rcx), "=d" (rdx) // Outputs
+               : "a" (0x0D), "c" (0x00) // The values to put into %rax and %rcx
+               : // No clobbers
+             );
+  uint64_t xsave_size = rbx;
+
+  // Sub-leaf 1: %rax bit 0 = XSAVEOPT, bit 1 = XSAVEC
+  asm volatile("cpuid"
+               : "=a" (rax), "=b" (rbx), "=c" (rcx), "=d" (rdx) // Outputs
+               : "a" (0x0D), "c" (0x01) // The values to put into %rax and %rcx
+               : // No clobbers
+             );
+
+  if(xsave_size == 0)
+  {
+    printf("Setup_Scheduler: XSAVE isn't available.\r\n");
+    return 0;
+  }
+
+  // XSAVEOPT can skip state that hasn't changed since this area was restored, which is the usual case for a task that yields without
+  // touching vector registers. XSAVEC only skips state that's in its initial configuration.
+  if(rax & 0x1)
+  {
+    Global_Scheduler.XSave_Instruction = TASK_XSAVEOPT;
+  }
+  else if(rax & 0x2)
+  {
+    Global_Scheduler.XSave_Instruction = TASK_XSAVEC;
+  }
+  else
+  {
+    Global_Scheduler.XSave_Instruction = TASK_XSAVE;
+  }
+  Global_Scheduler.XSave_Size = (xsave_size + 63) & ~63ULL;
+
+  uint64_t cpus = Global_SMP_Info.Number_of_CPUs;
+  uint8_t * boot_areas = malloc4k(EFI_SIZE_TO_PAGES(Global_Scheduler.XSave_Size * cpus));
+  if(boot_areas == MALLOC_FAILED)
+  {
+    printf("Setup_Scheduler: Not enough memory for XSAVE areas.\r\n");
+    return 0;
+  }
+  AVX_memset(boot_areas, 0, Global_Scheduler.XSave_Size * cpus);
+
+  for(uint64_t cpu = 0; cpu < cpus; cpu++)
+  {
+    TASK * boot = &Global_Scheduler.Queues[cpu].Boot_Task;
+    boot->XSave_Area = boot_areas + cpu * Global_Scheduler.XSave_Size;
+    boot->State = TASK_STATE_RUNNING;
+    boot->CPU = cpu;
+  }
+
+  Global_Scheduler.Queues[0].Current = &Global_Scheduler.Queues[0].Boot_Task;
+  __atomic_store_n(&Global_Scheduler.Ready, 1, __ATOMIC_RELEASE);
+
+  uint64_t instruction = Global_Scheduler.XSave_Instruction;
+  printf("Tasks: %s, %qu-byte XSAVE areas.\r\n", (instruction == TASK_XSAVEOPT) ? "XSAVEOPT" : ((instruction == TASK_XSAVEC) ? "XSAVEC" : "XSAVE"), Global_Scheduler.XSave_Size);
+  return 1;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Task_Start_Worker: Run Tasks on an AP
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Hand the AP at Global_Per_CPU_Data[cpu_index] over to the scheduler. It runs and steals tasks from then on, and waits with
+// MONITOR/MWAIT (if available) when there aren't any, so it can't take work from SMP_Run_On_CPU() anymore.
+//
+// Returns 1 if the AP was started, 0 if it isn't an online AP or Setup_Scheduler() hasn't run
+//
+
+uint8_t Task_Start_Worker(uint64_t cpu_index)
+{
+  if(!Global_Scheduler.Ready)
+  {
+    printf("Task_Start_Worker: The scheduler isn't set up.\r\n");
+    return 0;
+  }
+
+  if(!SMP_Run_On_CPU(cpu_index, task_worker, NULL))
+  {
+    printf("Task_Start_Worker: CPU %qu isn't an online AP.\r\n", cpu_index);
+    return 0;
+  }
+
+  return 1;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Task_Spawn: Start a Task
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Make a task that calls function(arg) on a stack of stack_pages 4kB pages (TASK_DEFAULT_STACK_PAGES if 0), and queue it on this CPU.
+// It first runs when something yields to it, possibly on another CPU. Every task needs a Task_Join(), which frees it.
+//
+// Returns the task, or NULL if there wasn't enough memory or the scheduler isn't set up
+//
+
+TASK * Task_Spawn(void (*function)(void * arg), void * arg, uint64_t stack_pages)
+{
+  if(!Global_Scheduler.Ready)
+  {
+    printf("Task_Spawn: The scheduler isn't set up.\r\n");
+    return NULL;
+  }
+
+  if(stack_pages == 0)
+  {
+    stack_pages = TASK_DEFAULT_STACK_PAGES;
+  }
+
+  // One allocation: the TASK, then its XSAVE area, then the stack up to the end
+  uint64_t header_size = (sizeof(TASK) + 63) & ~63ULL;
+  uint64_t pages = EFI_SIZE_TO_PAGES(header_size + Global_Scheduler.XSave_Size) + stack_pages;
+  uint8_t * base = malloc4k(pages);
+  if(base == MALLOC_FAILED)
+  {
+    printf("Task_Spawn: Not enough memory for a %qu-page stack.\r\n", stack_pages);
+    return NULL;
+  }
+  AVX_memset(base, 0, header_size + Global_Scheduler.XSave_Size);
+
+  TASK * task = (TASK*)base;
+  task->Function = function;
+  task->Argument = arg;
+  task->Pages = pages;
+  task->State = TASK_STATE_READY;
+  task->XSave_Area = base + header_size;
+
+  // MXCSR gets loaded from the area even though the header marks SSE state as initial, so it needs the default value
+  ((XSAVE_AREA_LAYOUT*)task->XSave_Area)->mxcsr = 0x1F80;
+
+  // First switch pops 6 zeroed callee-saved registers and returns into task_entry(), with %rsp as if task_entry() had been called
+  uint64_t * stack_top = (uint64_t*)(base + (pages << EFI_PAGE_SHIFT));
+  stack_top[-1] = 0; // No return address
+  stack_top[-2] = (uint64_t)task_entry;
+  for(uint64_t i = 3; i <= 8; i++)
+  {
+    stack_top[-i] = 0;
+  }
+  task->RSP = (uint64_t)&stack_top[-8];
+
+  TASK_QUEUE * queue = &Global_Scheduler.Queues[get_cpu_index()];
+  if(queue->Current == NULL)
+  {
+    queue = &Global_Scheduler.Queues[0]; // CPUs that don't run tasks leave them to the BSP and the workers
+  }
+  task_enqueue(queue, task);
+
+  return task;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Task_Yield: Let Another Task Run
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Switch to the next task queued on this CPU, or one stolen from another CPU. The calling task goes to the back of this CPU's queue.
+//
+// Returns 1 if another task ran, 0 if there wasn't one (or this CPU doesn't run tasks)
+//
+
+uint8_t Task_Yield(void)
+{
+  if(!Global_Scheduler.Ready)
+  {
+    return 0;
+  }
+
+  TASK_QUEUE * queue = &Global_Scheduler.Queues[get_cpu_index()];
+  if(queue->Current == NULL)
+  {
+    return 0;
+  }
+
+  TASK * next = task_pick(queue);
+  if(next == NULL)
+  {
+    return 0;
+  }
+
+  queue->Current->State = TASK_STATE_READY;
+  task_switch(queue, next);
+
+  return 1;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Task_Exit: End the Current Task
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Same as returning from the task's function. Boot tasks can't exit.
+//
+
+void Task_Exit(void)
+{
+  TASK_QUEUE * queue = &Global_Scheduler.Queues[get_cpu_index()];
+  TASK * current = queue->Current;
+
+  if((current == NULL) || (current->Pages == 0))
+  {
+    printf("Task_Exit: Not in a task.\r\n");
+    return;
+  }
+
+  current->State = TASK_STATE_EXITING;
+
+  // This CPU's boot task isn't running, so it's queued here and there's always something to switch to
+  task_switch(queue, task_pick(queue));
+
+  // task_finish_switch() marks this task done once its stack is no longer in use, and it never gets switched back to
+  __builtin_unreachable();
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Task_Join: Wait for a Task to Finish
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Run other tasks until 'task' has finished, then free it. 'task' can't be used after this.
+//
+
+void Task_Join(TASK * task)
+{
+  while(!__atomic_load_n(&task->Done, __ATOMIC_ACQUIRE))
+  {
+    if(!Task_Yield())
+    {
+      asm volatile("pause");
+    }
+  }
+
+  freepages(task, task->Pages);
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Task_Sleep_us: Wait While Other Tasks Run
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Wait at least 'microseconds', running other tasks in the meantime. If there's nothing to run this falls back to Timer_Sleep_us()
+// for whatever time is left, so an idle BSP halts instead of spinning.
+//
+
+void Task_Sleep_us(uint64_t microseconds)
+{
+  if((Global_Timer.Mode == TIMER_MODE_NONE) || (microseconds < TIMER_TICK_US))
+  {
+    Timer_Sleep_us(microseconds);
+    return;
+  }
+
+  volatile uint64_t done = 0;
+  uint64_t end = get_tick() + microseconds * Global_SMP_Info.TSC_MHz;
+  TIMER timer;
+  Timer_Init(&timer, task_sleep_done, (void*)&done);
+  Timer_Arm(&timer, microseconds, 0);
+
+  while(!done)
+  {
+    if(!Task_Yield())
+    {
+      // Nothing else to do, so stop switching and just sleep
+      if(!Timer_Cancel(&timer))
+      {
+        // It already fired, but the BSP may still be on its way into task_sleep_done(), which writes to this stack frame
+        while(!__atomic_load_n(&done, __ATOMIC_ACQUIRE))
+        {
+          asm volatile("pause");
+        }
+        return;
+      }
+      uint64_t now = get_tick();
+      if(now < end)
+      {
+        Timer_Sleep_us((end - now + Global_SMP_Info.TSC_MHz - 1) / Global_SMP_Info.TSC_MHz);
+      }
+      return;
+    }
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Task_Current: Get the Running Task
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Returns the task running on this CPU (its boot task when nothing was spawned), or NULL if this CPU doesn't run tasks
+//
+
+TASK * Task_Current(void)
+{
+  if(!Global_Scheduler.Ready)
+  {
+    return NULL;
+  }
+
+  return Global_Scheduler.Queues[get_cpu_index()].Current;
+}
+
+// AP side of Task_Start_Worker(). This loop is the AP's boot task.
+static void task_worker(void * arg)
+{
+  (void)arg;
+
+  TASK_QUEUE * queue = &Global_Scheduler.Queues[get_cpu_index()];
+  queue->Current = &queue->Boot_Task;
+
+  uint64_t rcx = 0;
+  asm volatile("cpuid"
+               : "=c" (rcx) // Outputs
+               : "a" (0x01) // The value to put into %rax
+               : "%rbx", "%rdx" // CPUID clobbers all not-explicitly-used abcd registers
+             );
+  uint8_t has_mwait = (rcx & (1 << 3)) ? 1 : 0;
+
+  while(1)
+  {
+    uint64_t queued = __atomic_load_n(&Global_Scheduler.Queued, __ATOMIC_ACQUIRE);
+
+    if(!Task_Yield())
+    {
+      if(has_mwait)
+      {
+        asm volatile("monitor"
+                     : // No outputs
+                     : "a" (&Global_Scheduler.Queued), "c" (0), "d" (0) // Inputs
+                     : // No clobbers
+                   );
+        // Anything queued since the last look means there may be something to steal
+        if(Global_Scheduler.Queued == queued)
+        {
+          asm volatile("mwait"
+                       : // No outputs
+                       : "a" (0), "c" (0) // C1, no extensions
+                       : // No clobbers
+                     );
+        }
+      }
+      else
+      {
+        asm volatile("pause");
+      }
+    }
+  }
+}
+
+// Where every spawned task starts, on its own stack
+static void task_entry(void)
+{
+  task_finish_switch();
+
+  TASK * task = Global_Scheduler.Queues[get_cpu_index()].Current;
+  task_xrstor(task->XSave_Area);
+
+  task->Function(task->Argument);
+
+  Task_Exit();
+  __builtin_unreachable();
+}
+
+// Save the current task and run 'next'. Returns once something switches back to the current task, maybe on another CPU.
+static void task_switch(TASK_QUEUE * queue, TASK * next)
+{
+  TASK * current = queue->Current;
+
+  queue->Previous = current;
+  queue->Current = next;
+  next->State = TASK_STATE_RUNNING;
+  next->CPU = (uint64_t)(queue - Global_Scheduler.Queues);
+
+  task_xsave(current->XSave_Area);
+  task_switch_stack(&current->RSP, next->RSP);
+
+  // Back on this task's stack
+  task_finish_switch();
+  task_xrstor(current->XSave_Area);
+}
+
+// Push the callee-saved registers, save %rsp to *save_rsp (%rdi), load new_rsp (%rsi), and pop the new task's registers
+__attribute__((naked)) static void task_switch_stack(uint64_t * save_rsp __attribute__((unused)), uint64_t new_rsp __attribute__((unused)))
+{
+  asm volatile("pushq %%rbp\n\t"
+               "pushq %%rbx\n\t"
+               "pushq %%r12\n\t"
+               "pushq %%r13\n\t"
+               "pushq %%r14\n\t"
+               "pushq %%r15\n\t"
+               "movq %%rsp, (%%rdi)\n\t"
+               "movq %%rsi, %%rsp\n\t"
+               "popq %%r15\n\t"
+               "popq %%r14\n\t"
+               "popq %%r13\n\t"
+               "popq %%r12\n\t"
+               "popq %%rbx\n\t"
+               "popq %%rbp\n\t"
+               "retq"
+               : // No outputs
+               : // No inputs (they're already in %rdi and %rsi)
+               : // No clobbers
+             );
+}
+
+// Deal with the task this CPU just switched away from, now that nothing is using its stack
+static void task_finish_switch(void)
+{
+  TASK_QUEUE * queue = &Global_Scheduler.Queues[get_cpu_index()];
+  TASK * previous = queue->Previous;
+  queue->Previous = NULL;
+
+  if(previous->State == TASK_STATE_EXITING)
+  {
+    __atomic_store_n(&previous->Done, 1, __ATOMIC_RELEASE);
+  }
+  else
+  {
+    task_enqueue(queue, previous);
+  }
+}
+
+static void task_enqueue(TASK_QUEUE * queue, TASK * task)
+{
+  task->Next = NULL;
+
+  task_lock(&queue->Lock);
+  if(queue->Tail)
+  {
+    queue->Tail->Next = task;
+  }
+  else
+  {
+    queue->Head = task;
+  }
+  queue->Tail = task;
+  queue->Count++;
+  task_unlock(&queue->Lock);
+
+  __atomic_add_fetch(&Global_Scheduler.Queued, 1, __ATOMIC_RELEASE); // Also wakes up idle workers
+}
+
+// Next task for this CPU: its own queue first, then any other CPU's
+static TASK * task_pick(TASK_QUEUE * queue)
+{
+  TASK * next = task_dequeue(queue, 0);
+  if(next)
+  {
+    return next;
+  }
+
+  uint64_t cpus = Global_SMP_Info.Number_of_CPUs;
+  uint64_t self = (uint64_t)(queue - Global_Scheduler.Queues);
+
+  for(uint64_t i = 1; i < cpus; i++)
+  {
+    TASK_QUEUE * victim = &Global_Scheduler.Queues[(self + i) % cpus];
+
+    if(__atomic_load_n(&victim->Count, __ATOMIC_RELAXED)) // Skip empty queues without taking their locks
+    {
+      next = task_dequeue(victim, 1);
+      if(next)
+      {
+        return next;
+      }
+    }
+  }
+
+  return NULL;
+}
+
+// Take the first task off a queue. Thieves pass movable_only = 1 to skip that CPU's boot task.
+static TASK * task_dequeue(TASK_QUEUE * queue, uint8_t movable_only)
+{
+  task_lock(&queue->Lock);
+
+  TASK * previous = NULL;
+  TASK * task = queue->Head;
+  while(task && movable_only && (task->Pages == 0))
+  {
+    previous = task;
+    task = task->Next;
+  }
+
+  if(task)
+  {
+    if(previous)
+    {
+      previous->Next = task->Next;
+    }
+    else
+    {
+      queue->Head = task->Next;
+    }
+    if(queue->Tail == task)
+    {
+      queue->Tail = previous;
+    }
+    queue->Count--;
+  }
+
+  task_unlock(&queue->Lock);
+  return task;
+}
+
+static void task_xsave(void * area)
+{
+  // %rdx: Mask for xcr0 [63:32], %rax: Mask for xcr0 [31:0], same as User_ISR_handler()
+  if(Global_Scheduler.XSave_Instruction == TASK_XSAVEOPT)
+  {
+    asm volatile("xsaveopt64 (%[area])"
+                 : // No outputs
+                 : "a" (0xE7), "d" (0x00), [area] "r" (area) // Inputs
+                 : "memory" // Clobbers
+               );
+  }
+  else if(Global_Scheduler.XSave_Instruction == TASK_XSAVEC)
+  {
+    asm volatile("xsavec64 (%[area])"
+                 : // No outputs
+                 : "a" (0xE7), "d" (0x00), [area] "r" (area) // Inputs
+                 : "memory" // Clobbers
+               );
+  }
+  else
+  {
+    asm volatile("xsave64 (%[area])"
+                 : // No outputs
+                 : "a" (0xE7), "d" (0x00), [area] "r" (area) // Inputs
+                 : "memory" // Clobbers
+               );
+  }
+}
+
+// XRSTOR handles both the standard and compacted formats on its own
+static void task_xrstor(void * area)
+{
+  asm volatile("xrstor64 (%[area])"
+               : // No outputs
+               : "a" (0xE7), "d" (0x00), [area] "r" (area) // Inputs
+               : "memory" // Clobbers
+             );
+}
+
+// Run queue locks are only ever taken by task code, never by interrupt handlers, so they don't need to turn interrupts off
+static void task_lock(volatile uint64_t * lock)
+{
+  while(__atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE))
+  {
+    asm volatile("pause");
+  }
+}
+
+static void task_unlock(volatile uint64_t * lock)
+{
+  __atomic_store_n(lock, 0, __ATOMIC_RELEASE);
+}
+
+// Task_Sleep_us()'s timer callback
+static void task_sleep_done(void * arg)
+{
+  __atomic_store_n((volatile uint64_t*)arg, 1, __ATOMIC_RELEASE);
+}
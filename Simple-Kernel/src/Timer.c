@@ -0,0 +1,496 @@
+//==================================================================================================================================
+//  Simple Kernel: Timers
+//==================================================================================================================================
+//
+// Version 0.z
+//
+// Author:
+//  KNNSpeed
+//
+// Source Code:
+//  https://github.com/KNNSpeed/Simple-Kernel
+//
+// This file contains the BSP's local APIC timer setup and a hierarchical timer wheel on top of it, plus sleeping with HLT/MWAIT.
+//
+// The local APIC timer runs in TSC-deadline mode if the CPU has it, or in one-shot mode (calibrated against the TSC) otherwise. Either
+// way it's only armed while there are timers waiting, so an idle system takes no timer interrupts at all. While it is armed, it fires
+// once every TIMER_TICK_US, at tick boundaries measured from Global_Timer.Base_TSC; since the current tick is always worked out from
+// the TSC, late interrupts don't make the clock drift.
+//
+// The wheel has TIMER_WHEEL_LEVELS levels of TIMER_WHEEL_SLOTS slots each. Level 0 slots are one tick apart, level 1 slots are
+// TIMER_WHEEL_SLOTS ticks apart, and so on. A timer goes in the level that covers its expiry, and gets cascaded down a level each time
+// the level below wraps around, until it's in level 0 on the tick it expires. Slots are doubly-linked lists, so arming and cancelling
+// are O(1), and so is each tick apart from the occasional cascade.
+//
+// Timers can be armed and cancelled from any CPU (the wheel has a lock that also keeps interrupts off while it's held), but callbacks
+// always run on the BSP in interrupt context, with the lock released so that they can arm or cancel timers themselves.
+//
+
+#include "Kernel64.h"
+
+// How long to watch the local APIC timer count down when calibrating it
+#define TIMER_CALIBRATION_US 10000
+
+static uint64_t timer_lock(void);
+static void timer_unlock(uint64_t rflags);
+static uint64_t timer_now(void);
+static void timer_place(TIMER * timer);
+static void timer_unlink(TIMER * timer);
+static void timer_cascade(uint64_t level);
+static void timer_program(void);
+static void timer_wake(void * arg);
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Setup_Timer: Set Up the BSP's Local APIC Timer
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Pick TSC-deadline or one-shot mode, point the timer at TIMER_VECTOR (User_ISR_handler() sends that to Timer_Interrupt()), and set
+// up the wheel. The timer stays masked until something gets armed.
+//
+// Requires: Setup_SMP(), for the local APIC mode, and Setup_Clock(), for the TSC frequency. Maskable interrupts need to be turned on
+// afterwards with Enable_Maskable_Interrupts().
+//
+// Returns 1 if timer interrupts are available, 0 if not (if the TSC frequency is known, Timer_Arm() still works then, but nothing
+// will ever expire)
+//
+
+uint8_t Setup_Timer(void)
+{
+  for(uint64_t level = 0; level < TIMER_WHEEL_LEVELS; level++)
+  {
+    for(uint64_t slot = 0; slot < TIMER_WHEEL_SLOTS; slot++)
+    {
+      Global_Timer.Slots[level][slot].Next = &Global_Timer.Slots[level][slot];
+      Global_Timer.Slots[level][slot].Prev = &Global_Timer.Slots[level][slot];
+    }
+  }
+
+  if(Global_SMP_Info.TSC_MHz == 0)
+  {
+    printf("Setup_Timer: TSC frequency unknown, no timers.\r\n");
+    return 0;
+  }
+
+  Global_Timer.TSC_Per_Tick = Global_SMP_Info.TSC_MHz * TIMER_TICK_US;
+  Global_Timer.Base_TSC = get_tick();
+  Global_Timer.Wheel_Tick = 0;
+
+  if((!Global_SMP_Info.x2APIC) && (Global_SMP_Info.LAPIC_Base == 0))
+  {
+    printf("Setup_Timer: The local APIC isn't set up, no timer interrupts.\r\n");
+    return 0;
+  }
+
+  uint64_t rcx = 0;
+  asm volatile("cpuid"
+               : "=c" (rcx) // Outputs
+               : "a" (0x01), "c" (0x00) // The values to put into %rax and %rcx
+               : "%rbx", "%rdx" // CPUID clobbers all not-explicitly-used abcd registers
+             );
+
+  if(rcx & (1 << 24)) // TSC-deadline
+  {
+    lapic_rw(0x320, (1 << 16) | (2 << 17) | TIMER_VECTOR, 1); // LVT Timer: masked, TSC-deadline mode
+    Global_Timer.Mode = TIMER_MODE_TSC_DEADLINE;
+  }
+  else
+  {
+    // Time the local APIC timer against the TSC: divide by 1, count down from the top while masked
+    lapic_rw(0x3E0, 0x0B, 1); // Divide Configuration Register
+    lapic_rw(0x320, (1 << 16) | TIMER_VECTOR, 1); // LVT Timer: masked, one-shot mode
+
+    uint64_t start = get_tick();
+    lapic_rw(0x380, 0xFFFFFFFF, 1); // Initial Count
+    while((get_tick() - start) < Global_SMP_Info.TSC_MHz * TIMER_CALIBRATION_US)
+    {
+      asm volatile("pause");
+    }
+    uint64_t counted = 0xFFFFFFFF - lapic_rw(0x390, 0, 0); // Current Count
+    lapic_rw(0x380, 0, 1); // Stop
+
+    Global_Timer.LAPIC_Per_Tick = (counted * TIMER_TICK_US) / TIMER_CALIBRATION_US;
+    if(Global_Timer.LAPIC_Per_Tick == 0)
+    {
+      printf("Setup_Timer: The local APIC timer doesn't count, no timer interrupts.\r\n");
+      return 0;
+    }
+    Global_Timer.Mode = TIMER_MODE_ONE_SHOT;
+  }
+
+  printf("Timer: %s mode, %qu us ticks.\r\n", (Global_Timer.Mode == TIMER_MODE_TSC_DEADLINE) ? "TSC-deadline" : "one-shot", (uint64_t)TIMER_TICK_US);
+  return 1;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Timer_Init: Prepare a Timer
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Set up 'timer' to call function(arg) when it expires. Needs to be done once before the first Timer_Arm(); the timer must not be
+// armed while this is called.
+//
+
+void Timer_Init(TIMER * timer, void (*function)(void * arg), void * arg)
+{
+  timer->Link.Next = NULL;
+  timer->Link.Prev = NULL;
+  timer->Expires = 0;
+  timer->Period = 0;
+  timer->Function = function;
+  timer->Argument = arg;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Timer_Arm: Start a Timer
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Have 'timer' expire delay_us microseconds from now, rounded up to the next tick, and then every period_us microseconds after that
+// (also rounded up to whole ticks) if period_us isn't 0. Re-arming an armed timer moves it.
+//
+
+void Timer_Arm(TIMER * timer, uint64_t delay_us, uint64_t period_us)
+{
+  if(Global_Timer.TSC_Per_Tick == 0)
+  {
+    printf("Timer_Arm: Setup_Timer() hasn't found a TSC frequency.\r\n");
+    return;
+  }
+
+  uint64_t rflags = timer_lock();
+
+  if(timer->Link.Next)
+  {
+    timer_unlink(timer);
+    Global_Timer.Armed--;
+  }
+
+  uint64_t now = timer_now();
+  if(Global_Timer.Armed == 0)
+  {
+    Global_Timer.Wheel_Tick = now; // Nothing's in the wheel, so it can skip ahead without cascading
+  }
+
+  // First tick boundary at or after the deadline
+  uint64_t deadline = get_tick() + delay_us * Global_SMP_Info.TSC_MHz - Global_Timer.Base_TSC;
+  timer->Expires = (deadline + Global_Timer.TSC_Per_Tick - 1) / Global_Timer.TSC_Per_Tick;
+  timer->Period = (period_us + TIMER_TICK_US - 1) / TIMER_TICK_US;
+
+  timer_place(timer);
+  Global_Timer.Armed++;
+
+  if(Global_Timer.Armed == 1)
+  {
+    timer_program();
+  }
+
+  timer_unlock(rflags);
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Timer_Cancel: Stop a Timer
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Take 'timer' out of the wheel. Its callback may still be running on the BSP if it just expired; this doesn't wait for it.
+//
+// Returns 1 if the timer was armed, 0 if it wasn't
+//
+
+uint8_t Timer_Cancel(TIMER * timer)
+{
+  uint64_t rflags = timer_lock();
+  uint8_t was_armed = 0;
+
+  if(timer->Link.Next)
+  {
+    timer_unlink(timer);
+    Global_Timer.Armed--;
+    was_armed = 1;
+  }
+
+  timer_unlock(rflags);
+  return was_armed;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Timer_Sleep_us: Wait Without Spinning
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Wait at least 'microseconds'. On the BSP with interrupts on, this halts until a timer wakes it up; on other CPUs it waits with
+// MONITOR/MWAIT if available. Waits shorter than a tick, or without timer interrupts, fall back to watching the TSC.
+//
+
+void Timer_Sleep_us(uint64_t microseconds)
+{
+  if((Global_Timer.Mode == TIMER_MODE_NONE) || (microseconds < TIMER_TICK_US))
+  {
+    uint64_t start = get_tick();
+    while((get_tick() - start) < microseconds * Global_SMP_Info.TSC_MHz)
+    {
+      asm volatile("pause");
+    }
+    return;
+  }
+
+  uint64_t rflags = control_register_rw('f', 0, 0);
+  uint8_t can_halt = (rflags & (1 << 9)) && (get_cpu_index() == 0);
+
+  uint64_t rcx = 0;
+  asm volatile("cpuid"
+               : "=c" (rcx) // Outputs
+               : "a" (0x01) // The value to put into %rax
+               : "%rbx", "%rdx" // CPUID clobbers all not-explicitly-used abcd registers
+             );
+  uint8_t has_mwait = (rcx & (1 << 3)) ? 1 : 0;
+
+  volatile uint64_t done __attribute__((aligned(64))) = 0;
+  TIMER timer;
+  Timer_Init(&timer, timer_wake, (void*)&done);
+  Timer_Arm(&timer, microseconds, 0);
+
+  while(!done)
+  {
+    if(can_halt)
+    {
+      // STI only takes effect after the next instruction, so the wakeup can't slip in between the check and the HLT
+      asm volatile("cli" : : : "memory");
+      if(!done)
+      {
+        asm volatile("sti\n\t"
+                     "hlt"
+                     : // No outputs
+                     : // No inputs
+                     : "memory" // Clobbers
+                   );
+      }
+      else
+      {
+        asm volatile("sti" : : : "memory");
+      }
+    }
+    else if(has_mwait)
+    {
+      asm volatile("monitor"
+                   : // No outputs
+                   : "a" (&done), "c" (0), "d" (0) // Inputs
+                   : // No clobbers
+                 );
+      if(!done)
+      {
+        asm volatile("mwait"
+                     : // No outputs
+                     : "a" (0), "c" (0) // C1, no extensions
+                     : "memory" // Clobbers
+                   );
+      }
+    }
+    else
+    {
+      asm volatile("pause");
+    }
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Timer_Interrupt: Local APIC Timer Interrupt Handler
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Called by User_ISR_handler() for TIMER_VECTOR, which sends the local APIC's EOI afterwards. Runs every tick from the last one
+// handled up to now, calling the callbacks of whatever expired, and then sets the timer for the next tick if anything's left.
+//
+
+void Timer_Interrupt(void)
+{
+  uint64_t rflags = timer_lock();
+  uint64_t now = timer_now();
+
+  while((Global_Timer.Wheel_Tick <= now) && Global_Timer.Armed)
+  {
+    uint64_t tick = Global_Timer.Wheel_Tick;
+
+    // Level 0 wrapped: pull the next slot of each level down, stopping at the first level that didn't wrap too
+    if((tick & (TIMER_WHEEL_SLOTS - 1)) == 0)
+    {
+      for(uint64_t level = 1; level < TIMER_WHEEL_LEVELS; level++)
+      {
+        timer_cascade(level);
+        if(((tick >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1)) != 0)
+        {
+          break;
+        }
+      }
+    }
+
+    TIMER_LINK * slot = &Global_Timer.Slots[0][tick & (TIMER_WHEEL_SLOTS - 1)];
+    while(slot->Next != slot)
+    {
+      TIMER * timer = (TIMER*)slot->Next;
+      timer_unlink(timer);
+
+      if(timer->Period)
+      {
+        // Skip missed periods instead of firing a burst to catch up
+        timer->Expires += timer->Period;
+        if(timer->Expires <= tick)
+        {
+          timer->Expires = tick + timer->Period;
+        }
+        timer_place(timer);
+      }
+      else
+      {
+        Global_Timer.Armed--;
+      }
+
+      timer_unlock(rflags);
+      timer->Function(timer->Argument);
+      rflags = timer_lock();
+    }
+
+    Global_Timer.Wheel_Tick = tick + 1;
+  }
+
+  timer_program();
+  timer_unlock(rflags);
+}
+
+// Take the wheel lock with interrupts off on this CPU. Returns the RFLAGS to hand back to timer_unlock().
+static uint64_t timer_lock(void)
+{
+  return Ticket_Lock_IRQ_Save(&Global_Timer.Lock);
+}
+
+static void timer_unlock(uint64_t rflags)
+{
+  Ticket_Unlock_IRQ_Restore(&Global_Timer.Lock, rflags);
+}
+
+// Current tick, counted from Global_Timer.Base_TSC
+static uint64_t timer_now(void)
+{
+  return (get_tick() - Global_Timer.Base_TSC) / Global_Timer.TSC_Per_Tick;
+}
+
+// Put a timer in the slot that covers its expiry. Already-expired timers go in the slot for the tick being handled now.
+static void timer_place(TIMER * timer)
+{
+  uint64_t wheel_tick = Global_Timer.Wheel_Tick;
+  uint64_t expires = (timer->Expires < wheel_tick) ? wheel_tick : timer->Expires;
+  uint64_t level = 0;
+
+  // Lowest level where the expiry is less than a full turn ahead, counting in that level's slots. Counting by slots rather than ticks
+  // keeps timers out of the current slot of levels 1 and up, which has already been cascaded.
+  while((level < TIMER_WHEEL_LEVELS - 1) && (((expires >> (TIMER_WHEEL_BITS * level)) - (wheel_tick >> (TIMER_WHEEL_BITS * level))) >= TIMER_WHEEL_SLOTS))
+  {
+    level++;
+  }
+
+  // Past the top level's reach: park it in the top level's last slot, and it'll get placed again from its real expiry when that cascades
+  if(((expires >> (TIMER_WHEEL_BITS * level)) - (wheel_tick >> (TIMER_WHEEL_BITS * level))) >= TIMER_WHEEL_SLOTS)
+  {
+    expires = ((wheel_tick >> (TIMER_WHEEL_BITS * level)) + TIMER_WHEEL_SLOTS - 1) << (TIMER_WHEEL_BITS * level);
+  }
+
+  TIMER_LINK * slot = &Global_Timer.Slots[level][(expires >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1)];
+
+  timer->Link.Next = slot;
+  timer->Link.Prev = slot->Prev;
+  slot->Prev->Next = &timer->Link;
+  slot->Prev = &timer->Link;
+}
+
+static void timer_unlink(TIMER * timer)
+{
+  timer->Link.Prev->Next = timer->Link.Next;
+  timer->Link.Next->Prev = timer->Link.Prev;
+  timer->Link.Next = NULL;
+  timer->Link.Prev = NULL;
+}
+
+// Re-place every timer in the current slot of 'level', which moves each one down at least one level
+static void timer_cascade(uint64_t level)
+{
+  TIMER_LINK * slot = &Global_Timer.Slots[level][(Global_Timer.Wheel_Tick >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1)];
+
+  if(slot->Next == slot)
+  {
+    return;
+  }
+
+  // Detach the whole list first, since timers parked past the top level's reach land back in this same slot
+  TIMER_LINK * next = slot->Next;
+  slot->Prev->Next = NULL;
+  slot->Next = slot;
+  slot->Prev = slot;
+
+  while(next)
+  {
+    TIMER * timer = (TIMER*)next;
+    next = next->Next;
+    timer_place(timer);
+  }
+}
+
+// Set the local APIC timer for the next tick boundary, or stop it if the wheel is empty. Call with the lock held.
+// The timer is the BSP's, so other CPUs send the BSP a TIMER_VECTOR IPI instead; Timer_Interrupt() then handles whatever's due and
+// reprograms it from there.
+static void timer_program(void)
+{
+  if(Global_Timer.Mode == TIMER_MODE_NONE)
+  {
+    return;
+  }
+
+  if(get_cpu_index() != 0)
+  {
+    lapic_send_ipi((uint32_t)Global_SMP_Info.BSP_APIC_ID, 0x00004000 | TIMER_VECTOR); // Fixed delivery
+    return;
+  }
+
+  if(Global_Timer.Armed == 0)
+  {
+    if(Global_Timer.Mode == TIMER_MODE_TSC_DEADLINE)
+    {
+      msr_rw(0x6E0, 0, 1); // IA32_TSC_DEADLINE: 0 disarms it
+    }
+    else
+    {
+      lapic_rw(0x380, 0, 1);
+    }
+    lapic_rw(0x320, lapic_rw(0x320, 0, 0) | (1 << 16), 1); // Masked
+    return;
+  }
+
+  uint64_t deadline = Global_Timer.Base_TSC + Global_Timer.Wheel_Tick * Global_Timer.TSC_Per_Tick;
+
+  lapic_rw(0x320, lapic_rw(0x320, 0, 0) & ~(1U << 16), 1); // Unmasked
+
+  if(Global_Timer.Mode == TIMER_MODE_TSC_DEADLINE)
+  {
+    // Intel SDM Vol. 3A, Section 10.5.4.1: the LVT write has to land before the deadline does
+    asm volatile("mfence" : : : "memory");
+    msr_rw(0x6E0, deadline, 1); // A deadline that's already passed fires right away
+  }
+  else
+  {
+    uint64_t now = get_tick();
+    uint64_t count = 1;
+    if(deadline > now)
+    {
+      count = ((deadline - now) * Global_Timer.LAPIC_Per_Tick) / Global_Timer.TSC_Per_Tick;
+      if(count == 0)
+      {
+        count = 1;
+      }
+      else if(count > 0xFFFFFFFF)
+      {
+        count = 0xFFFFFFFF;
+      }
+    }
+    lapic_rw(0x380, (uint32_t)count, 1);
+  }
+}
+
+// Timer_Sleep_us()'s callback
+static void timer_wake(void * arg)
+{
+  __atomic_store_n((volatile uint64_t*)arg, 1, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,266 @@
+//==================================================================================================================================
+//  Simple Kernel: Trace Probes
+//==================================================================================================================================
+//
+// Version 0.z
+//
+// Author:
+//  KNNSpeed
+//
+// Source Code:
+//  https://github.com/KNNSpeed/Simple-Kernel
+//
+// This file contains a lightweight trace facility: named begin/end/mark probes (the TRACE_BEGIN, TRACE_END, and TRACE_MARK macros in
+// Kernel64.h) recorded with RDTSCP into Global_Trace, a ring of TRACE_RING_SIZE events, and a dump of them as a timeline.
+//
+// Recording doesn't need anything set up first (no printf, no allocator, no per-CPU data), so probes work from the very start of
+// System_Init(). Any CPU can record; slots are claimed with an atomic increment, so the ring doesn't need a lock. Timestamps are only
+// converted to time when the timeline is printed, since the TSC frequency isn't known until later in boot.
+//
+// Probes cost one load and a not-taken branch when tracing is disabled with Trace_Enable(0), and nothing at all when the kernel is
+// built with TRACE_PROBES set to 0.
+//
+
+#include "Kernel64.h"
+
+#define TRACE_MAX_INDENT 8
+
+// Paired END position for each BEGIN while printing, ~0 if there isn't one
+static uint32_t trace_match[TRACE_RING_SIZE] __attribute__((aligned(64))) = {0};
+
+static TRACE_EVENT * trace_event_at(uint64_t first, uint64_t position);
+static uint8_t trace_name_equal(const char * a, const char * b);
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Trace_Event: Record a Trace Event
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Store a timestamped event in Global_Trace. Normally this gets called through TRACE_BEGIN/TRACE_END/TRACE_MARK, which check
+// Global_Trace.Enabled first.
+//
+// name: A string literal naming the event. BEGIN and END events with the same name on the same CPU get paired up.
+// type: TRACE_EVENT_BEGIN, TRACE_EVENT_END, or TRACE_EVENT_MARK
+//
+
+void Trace_Event(const char * name, uint32_t type)
+{
+  uint64_t high = 0, low = 0, aux = 0;
+  asm volatile("rdtscp"
+               : "=a" (low), "=d" (high), "=c" (aux) // Outputs
+               : // Inputs
+               : // Clobbers
+              );
+
+  uint64_t slot = __atomic_fetch_add(&Global_Trace.Next, 1, __ATOMIC_RELAXED) & (TRACE_RING_SIZE - 1);
+  TRACE_EVENT * event = &Global_Trace.Events[slot];
+
+  event->Name = name;
+  event->TSC = (high << 32) | low;
+  event->CPU = (uint32_t)aux;
+  event->Type = type;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Trace_Enable: Turn Recording On or Off
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// enable: 1 to record, 0 to make every probe a no-op. Tracing starts out enabled so that boot gets recorded.
+//
+
+void Trace_Enable(uint64_t enable)
+{
+  Global_Trace.Enabled = enable;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Trace_Ticks_To_ns: Convert TSC Ticks to Nanoseconds
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Uses the TSC frequency found by Setup_Clock(). Returns 0 if that hasn't run yet.
+//
+
+uint64_t Trace_Ticks_To_ns(uint64_t ticks)
+{
+  return cycles_to_ns(ticks);
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Trace_Print_Timeline: Print Recorded Events
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Print every event in the ring, oldest first, with its start time relative to the oldest event. BEGIN events are printed with the
+// time until their END, and are indented by how many other BEGINs on the same CPU are still open. Unmatched BEGINs are marked as
+// such and END events aren't printed on their own.
+//
+// Recording is paused while this runs. Events recorded by other CPUs at the same time may be missed.
+//
+
+void Trace_Print_Timeline(void)
+{
+  uint64_t was_enabled = Global_Trace.Enabled;
+  Global_Trace.Enabled = 0;
+
+  uint64_t total = Global_Trace.Next;
+  uint64_t count = (total > TRACE_RING_SIZE) ? TRACE_RING_SIZE : total;
+  uint64_t first = total - count;
+
+  if(count == 0)
+  {
+    printf("Trace: No events recorded.\r\n");
+    Global_Trace.Enabled = was_enabled;
+    return;
+  }
+
+  // Pair up BEGINs and ENDs
+  for(uint64_t p = 0; p < count; p++)
+  {
+    TRACE_EVENT * event = trace_event_at(first, p);
+    trace_match[p] = ~0U;
+
+    if(event->Type == TRACE_EVENT_BEGIN)
+    {
+      uint64_t nest = 0;
+      for(uint64_t q = p + 1; q < count; q++)
+      {
+        TRACE_EVENT * other = trace_event_at(first, q);
+        if((other->CPU == event->CPU) && trace_name_equal(other->Name, event->Name))
+        {
+          if(other->Type == TRACE_EVENT_BEGIN)
+          {
+            nest++;
+          }
+          else if(other->Type == TRACE_EVENT_END)
+          {
+            if(nest == 0)
+            {
+              trace_match[p] = (uint32_t)q;
+              break;
+            }
+            nest--;
+          }
+        }
+      }
+    }
+  }
+
+  uint64_t origin = trace_event_at(first, 0)->TSC;
+  uint64_t last = origin;
+
+  printf("Trace timeline: %qu events", count);
+  if(total > count)
+  {
+    printf(" (%qu older ones overwritten)", total - count);
+  }
+  if(Global_SMP_Info.TSC_MHz)
+  {
+    printf(", TSC %qu MHz\r\n", Global_SMP_Info.TSC_MHz);
+    printf("%14s %14s %4s  %s\r\n", "Start (us)", "Duration (us)", "CPU", "Event");
+  }
+  else
+  {
+    printf(", TSC frequency unknown\r\n");
+    printf("%14s %14s %4s  %s\r\n", "Start (ticks)", "Ticks", "CPU", "Event");
+  }
+
+  for(uint64_t p = 0; p < count; p++)
+  {
+    TRACE_EVENT * event = trace_event_at(first, p);
+
+    if(event->TSC > last)
+    {
+      last = event->TSC;
+    }
+
+    if(event->Type == TRACE_EVENT_END)
+    {
+      continue;
+    }
+
+    // Depth is the number of BEGINs on this CPU that are still open
+    int depth = 0;
+    for(uint64_t q = 0; q < p; q++)
+    {
+      TRACE_EVENT * other = trace_event_at(first, q);
+      if((other->Type == TRACE_EVENT_BEGIN) && (other->CPU == event->CPU) && ((trace_match[q] == ~0U) || (trace_match[q] > p)))
+      {
+        depth++;
+      }
+    }
+    if(depth > TRACE_MAX_INDENT)
+    {
+      depth = TRACE_MAX_INDENT;
+    }
+
+    uint64_t start = event->TSC - origin;
+
+    if(Global_SMP_Info.TSC_MHz)
+    {
+      uint64_t start_ns = Trace_Ticks_To_ns(start);
+      printf("%10qu.%03qu ", start_ns / 1000, start_ns % 1000);
+    }
+    else
+    {
+      printf("%14qu ", start);
+    }
+
+    if(event->Type == TRACE_EVENT_BEGIN)
+    {
+      if(trace_match[p] != ~0U)
+      {
+        uint64_t duration = trace_event_at(first, trace_match[p])->TSC - event->TSC;
+
+        if(Global_SMP_Info.TSC_MHz)
+        {
+          uint64_t duration_ns = Trace_Ticks_To_ns(duration);
+          printf("%10qu.%03qu ", duration_ns / 1000, duration_ns % 1000);
+        }
+        else
+        {
+          printf("%14qu ", duration);
+        }
+      }
+      else
+      {
+        printf("%14s ", "(no end)");
+      }
+    }
+    else
+    {
+      printf("%14s ", "-");
+    }
+
+    printf("%4u  %*s%s\r\n", event->CPU, depth * 2, "", event->Name);
+  }
+
+  uint64_t span = last - origin;
+  if(Global_SMP_Info.TSC_MHz)
+  {
+    uint64_t span_ns = Trace_Ticks_To_ns(span);
+    printf("Trace span: %qu.%03qu ms\r\n", span_ns / 1000000, (span_ns / 1000) % 1000);
+  }
+  else
+  {
+    printf("Trace span: %qu ticks\r\n", span);
+  }
+
+  Global_Trace.Enabled = was_enabled;
+}
+
+// Event at 'position' (0 = oldest) in the ring
+static TRACE_EVENT * trace_event_at(uint64_t first, uint64_t position)
+{
+  return &Global_Trace.Events[(first + position) & (TRACE_RING_SIZE - 1)];
+}
+
+// Names are usually the same literal, so the pointer check almost always settles it
+static uint8_t trace_name_equal(const char * a, const char * b)
+{
+  if(a == b)
+  {
+    return 1;
+  }
+
+  for(; (*a != '\0') && (*a == *b); a++, b++);
+
+  return *a == *b;
+}
@@ -0,0 +1,1107 @@
+//==================================================================================================================================
+//  Simple Kernel: Runtime Page Mapping
+//==================================================================================================================================
+//
+// Version 0.z
+//
+// Author:
+//  KNNSpeed
+//
+// Source Code:
+//  https://github.com/KNNSpeed/Simple-Kernel
+//
+// This file contains functions for changing the page tables after Setup_Paging() has built its identity map: map_range() maps a
+// virtual range to a physical one, unmap_range() takes a range out, and protect_range() changes the access rights or memory type of
+// a range that's already mapped.
+//
+// All CPUs share the one set of page tables that CR3 points to. Each change uses the biggest pages that fit the range (1GB, 2MB, or
+// 4kB, going by the alignment of both the virtual and physical addresses), splits large pages that only part of the range covers,
+// and folds a table back into one large page once all 512 of its entries line up again. New tables come from malloc4k(), and are
+// given back with freepages() once they're no longer used. Tables made by Setup_Paging(), or by Set_Memory_Type() before Setup_VMM(),
+// come from pagetable_alloc() instead, so those just stay where they are when they're emptied out.
+//
+// TLB entries are only dropped for what actually changed: one INVLPG per changed entry (which covers a whole large page), or a full
+// flush once there are more than VMM_FLUSH_MAX of them. Setup_VMM() turns on CR4.PCIDE so that everything here runs as PCID 0, and
+// full flushes use INVPCID when it's there instead of toggling CR4.PGE, which would also throw away every other PCID. Other online
+// CPUs are told to flush with an NMI, since APs run posted work and tasks with interrupts off. See VMM_Shootdown_NMI().
+//
+// Vmalloc() and friends hand out demand-paged memory from a window of otherwise unused virtual addresses above the identity map (see
+// Vmalloc_Reserve()). Reserving only records the range; each page gets backed by zeroed physical memory the first time it's touched,
+// when PF_EXC_handler() calls VMM_Page_Fault(). Large reservations can ask for VMALLOC_LARGE_PAGES, which backs them 2MB at a time.
+//
+// NOTE: None of these can be called from interrupt handlers, and the caller shouldn't be using anything it's unmapping or changing
+// on another CPU at the same time. VMM_Page_Fault() is the exception, since it's only called for faults on Vmalloc() memory, so
+// Vmalloc() memory must not be touched while holding Global_VMM.Lock, Global_Vmalloc.Lock, or the page allocator's lock.
+//
+
+#include "Kernel64.h"
+
+static uint64_t vmm_walk(uint64_t * table, uint64_t level, uint64_t table_base, uint64_t base, uint64_t end, uint64_t op, uint64_t delta, uint64_t flags);
+static uint64_t vmm_leaf_bits(uint64_t level, uint64_t flags);
+static uint64_t vmm_attribute_mask(uint64_t level);
+static uint8_t vmm_large_allowed(uint64_t level);
+static uint64_t * vmm_alloc_table(void);
+static uint64_t * vmm_split(uint64_t entry, uint64_t level);
+static void vmm_try_merge(uint64_t * table, uint64_t index, uint64_t level, uint64_t entry_base);
+static void vmm_free_tables(uint64_t entry, uint64_t level);
+static uint8_t vmm_table_empty(uint64_t * table);
+static uint8_t vmm_range_check(const char * caller, uint64_t * virt, uint64_t * size);
+static void vmm_flush_add(uint64_t linear);
+static void vmm_commit(void);
+ISR_GPR_ONLY static void vmm_flush_local(void);
+static void vmm_lock(void);
+static void vmm_unlock(void);
+static uint64_t vmm_lookup(uint64_t virt, uint64_t * level);
+static void vmm_release_page(uint64_t entry, uint64_t level);
+static void vmm_defer_free(uint64_t * address, uint64_t pages);
+static VMALLOC_AREA * vmalloc_find(uint64_t address);
+static void vmalloc_lock(void);
+static void vmalloc_unlock(void);
+
+// What vmm_walk() is doing
+#define VMM_OP_MAP     0
+#define VMM_OP_UNMAP   1
+#define VMM_OP_PROTECT 2
+#define VMM_OP_RELEASE 3 // VMM_OP_UNMAP, and the pages that were mapped go back to the page allocator
+
+// vmm_walk() results
+#define VMM_WALK_MISSING (1 << 0) // Part of the range isn't mapped
+#define VMM_WALK_NO_MEMORY (1 << 1) // Ran out of memory for tables
+
+// Address bits of a page table entry
+#define VMM_ADDRESS_MASK 0x000FFFFFFFFFF000ULL
+
+// Available (ignored) bit 9 in a non-leaf entry: the table it points to came from vmm_alloc_table()
+#define VMM_TABLE_OWNED (1ULL << 9)
+
+// Accessed and dirty bits, which the CPU sets on its own and so don't count when checking if entries can be merged
+#define VMM_ACCESSED_DIRTY ((1ULL << 5) | (1ULL << 6))
+
+// More changed entries than this in one call and it's cheaper to flush everything
+#define VMM_FLUSH_MAX 32
+
+// Unmapped space left after each Vmalloc() area, so running off the end of one faults instead of landing in the next
+#define VMALLOC_GUARD 0x1000
+
+// What to invalidate, only touched with Global_VMM.Lock held. Other CPUs read these from VMM_Shootdown_NMI().
+static volatile uint64_t vmm_flush_addresses[VMM_FLUSH_MAX] = {0};
+static volatile uint64_t vmm_flush_count = 0;
+static volatile uint64_t vmm_flush_all = 0;
+
+// Tables and pages taken out of the page tables, to be given back by vmm_commit() once no CPU can be using them anymore. Until the
+// shootdown is done another CPU may still be walking one of these tables (or have it cached), so nothing gets written into them;
+// they're kept here instead of being linked through their own contents. Only touched with Global_VMM.Lock held.
+#define VMM_PENDING_MAX 512
+
+typedef struct {
+  uint64_t * Address;
+  uint64_t   Pages;   // 0 for a page table, otherwise the size of a page taken out by VMM_OP_RELEASE
+} VMM_PENDING_FREE;
+
+static VMM_PENDING_FREE vmm_pending[VMM_PENDING_MAX] = {{0}};
+static uint64_t vmm_pending_count = 0;
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Setup_VMM: Set Up Runtime Page Mapping
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Check which page sizes and TLB instructions there are, and turn on CR4.PCIDE if PCIDs are supported.
+//
+// Requires: Setup_Paging() and Setup_Page_Allocator(). This has to run before Setup_SMP() so that the APs copy CR4.PCIDE from the BSP.
+//
+
+void Setup_VMM(void)
+{
+  uint64_t rax = 0, rbx = 0, rcx = 0, rdx = 0;
+
+  // CPUID leaf 1: %rcx bit 17 = PCID
+  asm volatile("cpuid"
+               : "=a" (rax), "=b" (rbx), "=c" (rcx), "=d" (rdx) // Outputs
+               : "a" (0x01) // The value to put into %rax
+               : // CPUID clobbers all abcd registers, which are all outputs here
+             );
+  uint64_t has_pcid = (rcx >> 17) & 1;
+
+  // CPUID leaf 7, sub-leaf 0: %rbx bit 10 = INVPCID
+  asm volatile("cpuid"
+               : "=a" (rax), "=b" (rbx), "=c" (rcx), "=d" (rdx) // Outputs
+               : "a" (0x07), "c" (0x00) // The values to put into %rax and %rcx
+               : // CPUID clobbers all abcd registers, which are all outputs here
+             );
+  Global_VMM.INVPCID = (rbx >> 10) & 1;
+
+  // CPUID leaf 0x80000001: %rdx bit 26 = 1GB pages
+  asm volatile("cpuid"
+               : "=a" (rax), "=b" (rbx), "=c" (rcx), "=d" (rdx) // Outputs
+               : "a" (0x80000001) // The value to put into %rax
+               : // CPUID clobbers all abcd registers, which are all outputs here
+             );
+  Global_VMM.Page_1GB = (rdx >> 26) & 1;
+
+  uint64_t cr4 = control_register_rw(4, 0, 0);
+  Global_VMM.Levels = (cr4 & (1 << 12)) ? 5 : 4; // CR4.LA57
+  Global_VMM.NX = (msr_rw(0xC0000080, 0, 0) >> 11) & 1; // IA32_EFER.NXE
+
+  // CR4.PCIDE can only be set while CR3's PCID field is 0, which it is for the tables from Setup_Paging()
+  if(has_pcid && !(control_register_rw(3, 0, 0) & 0xFFF))
+  {
+    control_register_rw(4, cr4 | (1 << 17), 1);
+    Global_VMM.PCID = (control_register_rw(4, 0, 0) >> 17) & 1;
+    if(!Global_VMM.PCID)
+    {
+      printf("Setup_VMM: Error setting CR4.PCIDE.\r\n");
+    }
+  }
+
+  printf("Page mapping: %qu-level, %s pages, PCID %s, INVPCID %s.\r\n", Global_VMM.Levels, Global_VMM.Page_1GB ? "1GB/2MB/4kB" : "2MB/4kB",
+         Global_VMM.PCID ? "on" : "off", Global_VMM.INVPCID ? "available" : "not available");
+
+  // Vmalloc() gets the upper half of the lower canonical half (64TB with 4 levels), as long as the identity map stays below it
+  uint64_t half = 1ULL << (11 + 9 * Global_VMM.Levels);
+  if(GetMaxMappedPhysicalAddress() <= (half >> 1))
+  {
+    Global_Vmalloc.Base = half >> 1;
+    Global_Vmalloc.End = half;
+    Global_Vmalloc.Large_Threshold = Global_Kernel_Options.Vmalloc_Large << 20; // In MB
+  }
+  else
+  {
+    printf("Setup_VMM: No room above the identity map for Vmalloc().\r\n");
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// map_range: Map a Virtual Range
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Map 'size' bytes at 'virt' to 'phys', replacing anything that was mapped there before. The biggest pages that both addresses are
+// aligned for get used, so e.g. a 2MB-aligned pair of addresses gets 2MB pages for as much of the range as fits.
+//
+// virt: Virtual address, rounded down to 4kB
+// phys: Physical address; it needs the same offset into a 4kB page as 'virt'
+// size: Size of the range in bytes, rounded up to 4kB
+// flags: 0 for read/write, executable, write-back, or any of VMM_READ_ONLY, VMM_NO_EXECUTE, VMM_GLOBAL, and VMM_TYPE(PAT_xx)
+//
+// Returns 1 on success, 0 on failure. If it runs out of memory for tables, part of the range may have been mapped.
+//
+
+uint8_t map_range(uint64_t virt, EFI_PHYSICAL_ADDRESS phys, uint64_t size, uint64_t flags)
+{
+  if((virt & 0xFFF) != (phys & 0xFFF))
+  {
+    printf("map_range: %#qx and %#qx aren't at the same offset into a page.\r\n", virt, phys);
+    return 0;
+  }
+
+  if(!vmm_range_check("map_range", &virt, &size))
+  {
+    return 0;
+  }
+  phys &= ~0xFFFULL;
+
+  vmm_lock();
+  uint64_t base = virt & ((1ULL << (12 + 9 * Global_VMM.Levels)) - 1); // vmm_walk() works without the sign extension
+  uint64_t result = vmm_walk((uint64_t*)(control_register_rw(3, 0, 0) & VMM_ADDRESS_MASK), Global_VMM.Levels, 0, base, base + size, VMM_OP_MAP, phys - base, flags);
+  vmm_commit();
+  vmm_unlock();
+
+  if(result & VMM_WALK_NO_MEMORY)
+  {
+    printf("map_range: Out of memory for page tables mapping %#qx-%#qx.\r\n", virt, virt + size - 1);
+    return 0;
+  }
+
+  return 1;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// unmap_range: Unmap a Virtual Range
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Take 'size' bytes at 'virt' out of the page tables, so that any access there page faults. Parts of the range that aren't mapped are
+// skipped. Tables that end up empty are freed.
+//
+// virt: Virtual address, rounded down to 4kB
+// size: Size of the range in bytes, rounded up to 4kB
+//
+// Returns 1 on success, 0 on failure. Failure only happens if a large page that the range starts or ends inside of can't be split.
+//
+
+uint8_t unmap_range(uint64_t virt, uint64_t size)
+{
+  if(!vmm_range_check("unmap_range", &virt, &size))
+  {
+    return 0;
+  }
+
+  vmm_lock();
+  uint64_t base = virt & ((1ULL << (12 + 9 * Global_VMM.Levels)) - 1);
+  uint64_t result = vmm_walk((uint64_t*)(control_register_rw(3, 0, 0) & VMM_ADDRESS_MASK), Global_VMM.Levels, 0, base, base + size, VMM_OP_UNMAP, 0, 0);
+  vmm_commit();
+  vmm_unlock();
+
+  if(result & VMM_WALK_NO_MEMORY)
+  {
+    printf("unmap_range: Out of memory for page tables unmapping %#qx-%#qx.\r\n", virt, virt + size - 1);
+    return 0;
+  }
+
+  return 1;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// protect_range: Change the Attributes of a Mapped Range
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Give 'size' bytes at 'virt' new access rights and memory type, keeping what they're mapped to. Large pages get split where the
+// range only covers part of them, and merged back where the new attributes make them match their neighbors again.
+//
+// Unlike Set_Memory_Type(), this doesn't flush any caches. Lines cached under the old type stay cached, so going from WB to UC or WC
+// needs a WBINVD (or CLFLUSH of the range) from the caller if that matters.
+//
+// virt: Virtual address, rounded down to 4kB
+// size: Size of the range in bytes, rounded up to 4kB
+// flags: Same as map_range()
+//
+// Returns 1 on success, 0 if part of the range isn't mapped (the rest still gets changed) or a large page couldn't be split.
+//
+
+uint8_t protect_range(uint64_t virt, uint64_t size, uint64_t flags)
+{
+  if(!vmm_range_check("protect_range", &virt, &size))
+  {
+    return 0;
+  }
+
+  vmm_lock();
+  uint64_t base = virt & ((1ULL << (12 + 9 * Global_VMM.Levels)) - 1);
+  uint64_t result = vmm_walk((uint64_t*)(control_register_rw(3, 0, 0) & VMM_ADDRESS_MASK), Global_VMM.Levels, 0, base, base + size, VMM_OP_PROTECT, 0, flags);
+  vmm_commit();
+  vmm_unlock();
+
+  if(result & VMM_WALK_NO_MEMORY)
+  {
+    printf("protect_range: Out of memory for page tables changing %#qx-%#qx.\r\n", virt, virt + size - 1);
+    return 0;
+  }
+  if(result & VMM_WALK_MISSING)
+  {
+    printf("protect_range: %#qx-%#qx isn't fully mapped.\r\n", virt, virt + size - 1);
+    return 0;
+  }
+
+  return 1;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// virt_to_phys: Look Up What a Virtual Address Maps To
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Returns the physical address that 'virt' maps to, or ~0ULL if it isn't mapped.
+//
+
+EFI_PHYSICAL_ADDRESS virt_to_phys(uint64_t virt)
+{
+  if(!Global_VMM.Levels)
+  {
+    return virt; // Still just the identity map from Setup_Paging()
+  }
+
+  uint64_t level = 0;
+
+  vmm_lock();
+  uint64_t entry = vmm_lookup(virt, &level);
+  vmm_unlock();
+
+  if(!(entry & 0x1))
+  {
+    return ~0ULL;
+  }
+
+  uint64_t page_mask = (1ULL << (12 + 9 * (level - 1))) - 1;
+  return (entry & VMM_ADDRESS_MASK & ~page_mask) | (virt & page_mask);
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Vmalloc_Reserve: Reserve Demand-Paged Virtual Memory
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Set aside 'size' bytes of virtual address space without backing any of it. Each page gets zeroed physical memory the first time it's
+// touched (see VMM_Page_Fault()), so big, sparsely used buffers only cost what actually gets used. Give it back with
+// Vmalloc_Release().
+//
+// size: Size of the reservation in bytes, rounded up to 4kB (2MB with VMALLOC_LARGE_PAGES)
+// flags: Same as map_range(), plus VMALLOC_LARGE_PAGES to back the area with 2MB pages. The area starts 2MB-aligned then, and each
+//        fault maps the whole 2MB around it (or just 4kB if there's no free 2MB block).
+//
+// Returns a page-aligned pointer to the reservation, or NULL if there's no room.
+//
+
+void * Vmalloc_Reserve(uint64_t size, uint64_t flags)
+{
+  if(!Global_Vmalloc.Base)
+  {
+    printf("Vmalloc_Reserve: No Vmalloc() address space, see Setup_VMM().\r\n");
+    return NULL;
+  }
+
+  uint64_t align = (flags & VMALLOC_LARGE_PAGES) ? (1ULL << 21) : 0x1000;
+  if((size == 0) || (size > (Global_Vmalloc.End - Global_Vmalloc.Base)))
+  {
+    return NULL;
+  }
+  size = (size + align - 1) & ~(align - 1);
+
+  vmalloc_lock();
+
+  if(Global_Vmalloc.Count == VMALLOC_MAX_AREAS)
+  {
+    vmalloc_unlock();
+    printf("Vmalloc_Reserve: All %u areas are in use.\r\n", VMALLOC_MAX_AREAS);
+    return NULL;
+  }
+
+  // First fit, going through the gaps between areas from the bottom
+  uint64_t candidate = Global_Vmalloc.Base;
+  uint64_t index = 0;
+  uint64_t base = 0;
+  for(; index <= Global_Vmalloc.Count; index++)
+  {
+    base = (candidate + align - 1) & ~(align - 1);
+    uint64_t limit = (index < Global_Vmalloc.Count) ? (Global_Vmalloc.Areas[index].Base - VMALLOC_GUARD) : Global_Vmalloc.End;
+    if((base <= limit) && (size <= (limit - base)))
+    {
+      break;
+    }
+    if(index < Global_Vmalloc.Count)
+    {
+      candidate = Global_Vmalloc.Areas[index].Base + Global_Vmalloc.Areas[index].Size + VMALLOC_GUARD;
+    }
+  }
+
+  if(index > Global_Vmalloc.Count)
+  {
+    vmalloc_unlock();
+    printf("Vmalloc_Reserve: No room for %#qx bytes.\r\n", size);
+    return NULL;
+  }
+
+  // Keep the areas sorted
+  for(uint64_t move = Global_Vmalloc.Count; move > index; move--)
+  {
+    Global_Vmalloc.Areas[move] = Global_Vmalloc.Areas[move - 1];
+  }
+  Global_Vmalloc.Areas[index].Base = base;
+  Global_Vmalloc.Areas[index].Size = size;
+  Global_Vmalloc.Areas[index].Flags = flags;
+  Global_Vmalloc.Areas[index].Committed = 0;
+  Global_Vmalloc.Count++;
+
+  vmalloc_unlock();
+
+  return (void*)base;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Vmalloc_Release: Give Back Demand-Paged Virtual Memory
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Unmap a reservation from Vmalloc_Reserve(), return the physical pages that were backing it to the page allocator, and make its
+// address space available again.
+//
+// address: What Vmalloc_Reserve() returned
+//
+// Returns 1 on success, 0 if 'address' isn't the start of a reservation.
+//
+
+uint8_t Vmalloc_Release(void * address)
+{
+  vmalloc_lock();
+
+  VMALLOC_AREA * area = vmalloc_find((uint64_t)address);
+  if((area == NULL) || (area->Base != (uint64_t)address))
+  {
+    vmalloc_unlock();
+    printf("Vmalloc_Release: %#qx isn't a Vmalloc() address.\r\n", (uint64_t)address);
+    return 0;
+  }
+
+  if(area->Committed)
+  {
+    vmm_lock();
+    uint64_t base = area->Base & ((1ULL << (12 + 9 * Global_VMM.Levels)) - 1);
+    vmm_walk((uint64_t*)(control_register_rw(3, 0, 0) & VMM_ADDRESS_MASK), Global_VMM.Levels, 0, base, base + area->Size, VMM_OP_RELEASE, 0, 0);
+    vmm_commit();
+    vmm_unlock();
+
+    Global_Vmalloc.Committed_Pages -= area->Committed;
+  }
+
+  uint64_t index = area - Global_Vmalloc.Areas;
+  Global_Vmalloc.Count--;
+  for(; index < Global_Vmalloc.Count; index++)
+  {
+    Global_Vmalloc.Areas[index] = Global_Vmalloc.Areas[index + 1];
+  }
+
+  vmalloc_unlock();
+
+  return 1;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// VMM_Page_Fault: Back a Vmalloc() Page on First Touch
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Called by PF_EXC_handler() with CR2 and the error code. If the fault is an access to a not-yet-backed page of a Vmalloc() area, map
+// zeroed memory there, and the faulting instruction can just run again.
+//
+// Returns 1 if the fault was handled, 0 if it's a real fault (or there was no memory left to back the page).
+//
+
+uint8_t VMM_Page_Fault(uint64_t address, uint64_t error_code)
+{
+  // Only not-present faults (P = bit 0) count, and not ones from reserved bits (RSVD = bit 3)
+  if((error_code & 0x9) || (address < Global_Vmalloc.Base) || (address >= Global_Vmalloc.End))
+  {
+    return 0;
+  }
+
+  vmalloc_lock();
+
+  VMALLOC_AREA * area = vmalloc_find(address);
+  if(area == NULL)
+  {
+    vmalloc_unlock();
+    return 0;
+  }
+
+  uint64_t level = 0;
+  vmm_lock();
+  uint64_t entry = vmm_lookup(address, &level);
+  vmm_unlock();
+
+  if(entry & 0x1)
+  {
+    // Another CPU backed it between the fault and getting the lock. Not-present entries are never cached, so just go again.
+    vmalloc_unlock();
+    return 1;
+  }
+
+  uint64_t page = address & ~0xFFFULL;
+  uint64_t pages = 1;
+  void * memory = MALLOC_FAILED;
+
+  // Nothing at all mapped in this 2MB yet means it can be one 2MB page
+  if((area->Flags & VMALLOC_LARGE_PAGES) && (level >= 2))
+  {
+    memory = malloc4k_zeroed(512); // Buddy blocks are aligned to their size, so this is 2MB-aligned
+    if(memory != MALLOC_FAILED)
+    {
+      page = address & ~0x1FFFFFULL;
+      pages = 512;
+    }
+  }
+
+  if(memory == MALLOC_FAILED)
+  {
+    memory = malloc4k_zeroed(1);
+  }
+
+  if(memory == MALLOC_FAILED)
+  {
+    vmalloc_unlock();
+    printf("VMM_Page_Fault: Out of memory backing %#qx.\r\n", address);
+    return 0;
+  }
+
+  if(!map_range(page, (EFI_PHYSICAL_ADDRESS)memory, EFI_PAGES_TO_SIZE(pages), area->Flags & ~VMALLOC_LARGE_PAGES))
+  {
+    freepages(memory, pages);
+    vmalloc_unlock();
+    return 0;
+  }
+
+  area->Committed += pages;
+  Global_Vmalloc.Committed_Pages += pages;
+  if(pages == 512)
+  {
+    Global_Vmalloc.Large_Faults++;
+  }
+  else
+  {
+    Global_Vmalloc.Faults++;
+  }
+
+  vmalloc_unlock();
+
+  return 1;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// VMM_Shootdown_NMI: Flush This CPU's TLB for Another CPU
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Called first thing by NMI_ISR_handler(). If another CPU asked this one to flush, do that and let it know.
+//
+// Returns 1 if the NMI was a shootdown, 0 if it was something else and still needs handling.
+//
+
+ISR_GPR_ONLY uint8_t VMM_Shootdown_NMI(void)
+{
+  PER_CPU_STRUCT * cpu = get_cpu_data();
+
+  if(!__atomic_load_n(&cpu->TLB_Shootdown, __ATOMIC_ACQUIRE))
+  {
+    return 0;
+  }
+
+  vmm_flush_local();
+
+  __atomic_store_n(&cpu->TLB_Shootdown, 0, __ATOMIC_RELAXED);
+  __atomic_sub_fetch(&Global_VMM.Shootdown_Pending, 1, __ATOMIC_RELEASE);
+
+  return 1;
+}
+
+// Apply 'op' to [base, end) in a table at 'level' (5 = PML5 ... 1 = PT) that maps from 'table_base'. 'delta' is physical minus virtual
+// for VMM_OP_MAP. Returns VMM_WALK_* bits.
+static uint64_t vmm_walk(uint64_t * table, uint64_t level, uint64_t table_base, uint64_t base, uint64_t end, uint64_t op, uint64_t delta, uint64_t flags)
+{
+  uint64_t shift = 12 + 9 * (level - 1);
+  uint64_t entry_size = 1ULL << shift;
+  uint64_t result = 0;
+
+  for(uint64_t index = (base - table_base) >> shift; index < 512; index++)
+  {
+    uint64_t entry_base = table_base + (index << shift);
+    if(entry_base >= end)
+    {
+      break;
+    }
+
+    uint64_t start = (base > entry_base) ? base : entry_base;
+    uint64_t stop = (end < (entry_base + entry_size)) ? end : (entry_base + entry_size);
+    uint8_t whole = (start == entry_base) && (stop == (entry_base + entry_size));
+
+    uint64_t entry = table[index];
+    uint8_t present = entry & 0x1;
+    uint8_t leaf = (level == 1) || (entry & (1 << 7));
+
+    if(op == VMM_OP_MAP)
+    {
+      if(whole && vmm_large_allowed(level) && !((entry_base + delta) & (entry_size - 1)))
+      {
+        uint64_t new_entry = (entry_base + delta) | vmm_leaf_bits(level, flags);
+        table[index] = new_entry;
+        if(present && ((entry & ~VMM_ACCESSED_DIRTY) != new_entry))
+        {
+          vmm_flush_add(entry_base);
+        }
+        if(present && !leaf)
+        {
+          vmm_free_tables(entry, level - 1); // Only once nothing points at them anymore
+        }
+        continue;
+      }
+    }
+    else if(!present)
+    {
+      if(op == VMM_OP_PROTECT)
+      {
+        result |= VMM_WALK_MISSING;
+      }
+      continue;
+    }
+    else if(whole && ((op == VMM_OP_UNMAP) || ((op == VMM_OP_RELEASE) && leaf)))
+    {
+      table[index] = 0;
+      vmm_flush_add(entry_base);
+      if(!leaf)
+      {
+        vmm_free_tables(entry, level - 1);
+      }
+      else if(op == VMM_OP_RELEASE)
+      {
+        vmm_release_page(entry, level);
+      }
+      continue;
+    }
+    else if(whole && leaf) // VMM_OP_PROTECT
+    {
+      uint64_t mask = vmm_attribute_mask(level);
+      uint64_t new_entry = (entry & ~mask) | (vmm_leaf_bits(level, flags) & mask);
+      if(new_entry != entry)
+      {
+        table[index] = new_entry;
+        vmm_flush_add(entry_base);
+      }
+      continue;
+    }
+
+    // The range needs a table under this entry: make one, or break a large page into one
+    if(!present)
+    {
+      uint64_t * child = vmm_alloc_table();
+      if(child == NULL)
+      {
+        return result | VMM_WALK_NO_MEMORY;
+      }
+      table[index] = (uint64_t)child | VMM_TABLE_OWNED | 0x3; // Flags: NX[63] = 0, A[5] = 0, PCD[4] = 0, PWT[3] = 0, U/S[2] = 0, R/W[1] = 1, P[0] = 1.
+    }
+    else if(leaf)
+    {
+      uint64_t * child = vmm_split(entry, level);
+      if(child == NULL)
+      {
+        return result | VMM_WALK_NO_MEMORY;
+      }
+      table[index] = (uint64_t)child | VMM_TABLE_OWNED | 0x3;
+      vmm_flush_add(entry_base); // The old large page may be cached alongside the new small ones
+      Global_VMM.Splits++;
+    }
+
+    result |= vmm_walk((uint64_t*)(table[index] & VMM_ADDRESS_MASK), level - 1, entry_base, start, stop, op, delta, flags);
+
+    if((op == VMM_OP_UNMAP) || (op == VMM_OP_RELEASE))
+    {
+      uint64_t child = table[index];
+      if(vmm_table_empty((uint64_t*)(child & VMM_ADDRESS_MASK)))
+      {
+        table[index] = 0;
+        vmm_free_tables(child, level - 1);
+      }
+    }
+    else
+    {
+      vmm_try_merge(table, index, level, entry_base);
+    }
+  }
+
+  return result;
+}
+
+// Present, and the R/W, PWT, PCD, PAT, G, NX, and PS bits that 'flags' asks for, for a page mapped at 'level'
+static uint64_t vmm_leaf_bits(uint64_t level, uint64_t flags)
+{
+  uint64_t bits = 0x1;
+  uint64_t pat_index = (flags >> 8) & 0x7;
+
+  if(!(flags & VMM_READ_ONLY))
+  {
+    bits |= (1 << 1);
+  }
+  if(flags & VMM_GLOBAL)
+  {
+    bits |= (1 << 8);
+  }
+  if((flags & VMM_NO_EXECUTE) && Global_VMM.NX)
+  {
+    bits |= (1ULL << 63);
+  }
+
+  // PAT index bit 0 is PWT, bit 1 is PCD, and bit 2 is PAT (bit 7 for 4kB pages, bit 12 for large ones, where bit 7 is PS)
+  bits |= ((pat_index & 1) << 3) | ((pat_index & 2) << 3);
+  if(level == 1)
+  {
+    bits |= (pat_index & 4) << 5;
+  }
+  else
+  {
+    bits |= ((pat_index & 4) << 10) | (1 << 7);
+  }
+
+  return bits;
+}
+
+// The bits of a page mapped at 'level' that protect_range() changes
+static uint64_t vmm_attribute_mask(uint64_t level)
+{
+  uint64_t pat_bit = (level == 1) ? (1ULL << 7) : (1ULL << 12);
+  return (1ULL << 63) | (1ULL << 8) | pat_bit | (1ULL << 4) | (1ULL << 3) | (1ULL << 1);
+}
+
+// Whether an entry at 'level' can map a page directly: always for 4kB and 2MB, 1GB only if supported
+static uint8_t vmm_large_allowed(uint64_t level)
+{
+  return (level <= 2) || ((level == 3) && Global_VMM.Page_1GB);
+}
+
+// One zeroed 4kB table from the page allocator, or NULL if there's no memory
+static uint64_t * vmm_alloc_table(void)
+{
+  uint64_t * table = malloc4k_zeroed(1);
+  if(table == MALLOC_FAILED)
+  {
+    return NULL;
+  }
+
+  Global_VMM.Table_Pages++;
+  return table;
+}
+
+// A new table whose 512 entries map the same thing as the large page 'entry' at 'level', or NULL if there's no memory
+static uint64_t * vmm_split(uint64_t entry, uint64_t level)
+{
+  uint64_t * table = vmm_alloc_table();
+  if(table == NULL)
+  {
+    return NULL;
+  }
+
+  uint64_t child_size = 1ULL << (12 + 9 * (level - 2));
+  uint64_t address = entry & VMM_ADDRESS_MASK & ~((child_size << 9) - 1);
+  uint64_t flags = entry & 0x8000000000001FFFULL; // NX and the low 13 bits, which include PAT for large pages
+
+  if(level == 2)
+  {
+    // 4kB pages have no PS bit, and their PAT bit is bit 7
+    flags = (flags & ~((1ULL << 12) | (1ULL << 7))) | ((flags & (1ULL << 12)) >> 5);
+  }
+
+  for(uint64_t child = 0; child < 512; child++)
+  {
+    table[child] = (address + child * child_size) | flags;
+  }
+
+  return table;
+}
+
+// If the table under table[index] maps one contiguous, aligned range with the same attributes throughout, replace it with a large page
+static void vmm_try_merge(uint64_t * table, uint64_t index, uint64_t level, uint64_t entry_base)
+{
+  if(!vmm_large_allowed(level))
+  {
+    return;
+  }
+
+  uint64_t * child = (uint64_t*)(table[index] & VMM_ADDRESS_MASK);
+  uint64_t child_size = 1ULL << (12 + 9 * (level - 2));
+  uint64_t address_mask = (level == 2) ? VMM_ADDRESS_MASK : (VMM_ADDRESS_MASK & ~(child_size - 1));
+
+  uint64_t first = child[0];
+  if(!(first & 0x1) || ((level > 2) && !(first & (1 << 7))))
+  {
+    return;
+  }
+
+  uint64_t address = first & address_mask;
+  if(address & ((child_size << 9) - 1))
+  {
+    return;
+  }
+
+  uint64_t attributes = first & ~(address_mask | VMM_ACCESSED_DIRTY);
+  for(uint64_t entry = 1; entry < 512; entry++)
+  {
+    if((child[entry] & ~(address_mask | VMM_ACCESSED_DIRTY)) != attributes)
+    {
+      return;
+    }
+    if((child[entry] & address_mask) != (address + entry * child_size))
+    {
+      return;
+    }
+  }
+
+  if(level == 2)
+  {
+    // Back to a 2MB page: PAT moves from bit 7 to bit 12, and PS gets set
+    attributes = (attributes & ~(1ULL << 7)) | ((attributes & (1ULL << 7)) << 5) | (1ULL << 7);
+  }
+
+  uint64_t old_entry = table[index];
+  table[index] = address | attributes;
+  vmm_flush_add(entry_base);
+  vmm_free_tables(old_entry, level - 1);
+  Global_VMM.Merges++;
+}
+
+// Queue the table 'entry' points to, and any tables under it, to be freed after the next flush. 'level' is the table's own level.
+// 'entry' has to be out of the page tables (and its address queued for flushing) already, since the queue may be flushed from here.
+static void vmm_free_tables(uint64_t entry, uint64_t level)
+{
+  uint64_t * table = (uint64_t*)(entry & VMM_ADDRESS_MASK);
+
+  if(level > 1)
+  {
+    for(uint64_t index = 0; index < 512; index++)
+    {
+      if((table[index] & 0x1) && !(table[index] & (1 << 7)))
+      {
+        vmm_free_tables(table[index], level - 1);
+      }
+    }
+  }
+
+  if(entry & VMM_TABLE_OWNED)
+  {
+    vmm_defer_free(table, 0);
+  }
+}
+
+// Whether all 512 entries of a table are 0
+static uint8_t vmm_table_empty(uint64_t * table)
+{
+  for(uint64_t index = 0; index < 512; index++)
+  {
+    if(table[index])
+    {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// Round a range to 4kB and make sure it's canonical and doesn't wrap. Returns 1 if it's OK.
+static uint8_t vmm_range_check(const char * caller, uint64_t * virt, uint64_t * size)
+{
+  if(!Global_VMM.Levels)
+  {
+    printf("%s: Setup_VMM() hasn't been run.\r\n", caller);
+    return 0;
+  }
+
+  uint64_t base = *virt & ~0xFFFULL;
+  uint64_t end = (*virt + *size + 0xFFF) & ~0xFFFULL;
+  uint64_t half = 1ULL << (11 + 9 * Global_VMM.Levels); // Size of each canonical half
+
+  if((*size == 0) || (end <= base))
+  {
+    printf("%s: Bad range %#qx, size %#qx.\r\n", caller, *virt, *size);
+    return 0;
+  }
+
+  // Both ends have to be in the lower half, or both in the upper half
+  uint8_t lower = (end <= half);
+  uint8_t upper = (base >= (0ULL - half));
+  if(!lower && !upper)
+  {
+    printf("%s: %#qx-%#qx isn't canonical.\r\n", caller, base, end - 1);
+    return 0;
+  }
+
+  *virt = base;
+  *size = end - base;
+  return 1;
+}
+
+// Remember that 'linear' (without its sign extension) needs to be invalidated
+static void vmm_flush_add(uint64_t linear)
+{
+  if(vmm_flush_count < VMM_FLUSH_MAX)
+  {
+    uint64_t sign_shift = 64 - (12 + 9 * Global_VMM.Levels);
+    vmm_flush_addresses[vmm_flush_count] = (uint64_t)(((int64_t)(linear << sign_shift)) >> sign_shift);
+    vmm_flush_count++;
+  }
+  else
+  {
+    vmm_flush_all = 1;
+  }
+}
+
+// Flush this CPU, have every other online CPU do the same, then free the tables that were taken out
+static void vmm_commit(void)
+{
+  if(vmm_pending_count && !vmm_flush_count)
+  {
+    vmm_flush_all = 1; // Nothing to INVLPG, but a paging-structure cache could still have one of the tables
+  }
+
+  if(vmm_flush_count || vmm_flush_all)
+  {
+    vmm_flush_local();
+
+    uint64_t self = get_cpu_data()->CPU_Index;
+    for(uint64_t cpu_index = 0; cpu_index < Global_SMP_Info.Number_of_CPUs; cpu_index++)
+    {
+      PER_CPU_STRUCT * cpu = &Global_Per_CPU_Data[cpu_index];
+      if((cpu_index == self) || !cpu->Online)
+      {
+        continue;
+      }
+
+      __atomic_add_fetch(&Global_VMM.Shootdown_Pending, 1, __ATOMIC_RELAXED);
+      __atomic_store_n(&cpu->TLB_Shootdown, 1, __ATOMIC_RELEASE);
+      lapic_send_ipi(cpu->APIC_ID, 0x00004400); // NMI, level assert
+      Global_VMM.Shootdowns++;
+    }
+
+    while(__atomic_load_n(&Global_VMM.Shootdown_Pending, __ATOMIC_ACQUIRE))
+    {
+      asm volatile("pause");
+    }
+
+    vmm_flush_count = 0;
+    vmm_flush_all = 0;
+  }
+
+  for(uint64_t i = 0; i < vmm_pending_count; i++)
+  {
+    if(vmm_pending[i].Pages == 0)
+    {
+      freepages(vmm_pending[i].Address, 1);
+      Global_VMM.Table_Pages--;
+    }
+    else
+    {
+      freepages(vmm_pending[i].Address, vmm_pending[i].Pages);
+    }
+  }
+  vmm_pending_count = 0;
+}
+
+// Invalidate what vmm_flush_addresses and vmm_flush_all say to on this CPU
+ISR_GPR_ONLY static void vmm_flush_local(void)
+{
+  if(vmm_flush_all)
+  {
+    if(Global_VMM.INVPCID)
+    {
+      // Type 2: all PCIDs, including global pages. The descriptor is ignored, but still has to be readable.
+      uint64_t descriptor[2] = {0, 0};
+      asm volatile("invpcid %[desc], %[type]"
+                   : // No outputs
+                   : [desc] "m" (descriptor), [type] "r" (2ULL) // Inputs
+                   : "memory" // Clobbers
+                 );
+    }
+    else
+    {
+      // Toggling CR4.PGE flushes everything, including global pages
+      uint64_t cr4 = 0;
+      asm volatile("movq %%cr4, %[cr4]"
+                   : [cr4] "=r" (cr4) // Outputs
+                   : // No inputs
+                   : // No clobbers
+                 );
+      if(cr4 & (1 << 7))
+      {
+        asm volatile("movq %[off], %%cr4\n\t"
+                     "movq %[on], %%cr4"
+                     : // No outputs
+                     : [off] "r" (cr4 & ~(1ULL << 7)), [on] "r" (cr4) // Inputs
+                     : "memory" // Clobbers
+                   );
+      }
+      else
+      {
+        asm volatile("movq %%cr3, %%rax\n\t"
+                     "movq %%rax, %%cr3"
+                     : // No outputs
+                     : // No inputs
+                     : "rax", "memory" // Clobbers
+                   );
+      }
+    }
+  }
+  else
+  {
+    // INVLPG also drops all paging-structure cache entries for the current PCID, which covers freed tables
+    for(uint64_t entry = 0; entry < vmm_flush_count; entry++)
+    {
+      asm volatile("invlpg (%[address])"
+                   : // No outputs
+                   : [address] "r" (vmm_flush_addresses[entry]) // Inputs
+                   : "memory" // Clobbers
+                 );
+    }
+  }
+}
+
+// Take Global_VMM.Lock. Shootdowns come in by NMI, so the holder can flush other CPUs even if they're spinning here.
+static void vmm_lock(void)
+{
+  while(__atomic_exchange_n(&Global_VMM.Lock, 1, __ATOMIC_ACQUIRE))
+  {
+    asm volatile("pause");
+  }
+}
+
+static void vmm_unlock(void)
+{
+  __atomic_store_n(&Global_VMM.Lock, 0, __ATOMIC_RELEASE);
+}
+
+// The entry that maps 'virt', or the first not-present entry on the way there. 'level' gets the level it was found at.
+static uint64_t vmm_lookup(uint64_t virt, uint64_t * level)
+{
+  uint64_t * table = (uint64_t*)(control_register_rw(3, 0, 0) & VMM_ADDRESS_MASK);
+
+  for(uint64_t current = Global_VMM.Levels; ; current--)
+  {
+    uint64_t entry = table[(virt >> (12 + 9 * (current - 1))) & 0x1FF];
+    if(!(entry & 0x1) || (current == 1) || (entry & (1 << 7)))
+    {
+      *level = current;
+      return entry;
+    }
+    table = (uint64_t*)(entry & VMM_ADDRESS_MASK);
+  }
+}
+
+// Queue the page that the leaf 'entry' at 'level' maps to be freed after the next flush
+static void vmm_release_page(uint64_t entry, uint64_t level)
+{
+  uint64_t pages = 1ULL << (9 * (level - 1));
+  uint64_t * page = (uint64_t*)(entry & VMM_ADDRESS_MASK & ~(EFI_PAGES_TO_SIZE(pages) - 1)); // Large pages have PAT at bit 12
+
+  vmm_defer_free(page, pages);
+}
+
+// Add a table ('pages' = 0) or a released page to vmm_pending. If it's full, everything changed so far gets flushed and freed first,
+// which is fine mid-walk since whatever got queued is already out of the page tables.
+static void vmm_defer_free(uint64_t * address, uint64_t pages)
+{
+  if(vmm_pending_count == VMM_PENDING_MAX)
+  {
+    vmm_commit();
+  }
+
+  vmm_pending[vmm_pending_count].Address = address;
+  vmm_pending[vmm_pending_count].Pages = pages;
+  vmm_pending_count++;
+}
+
+// The Vmalloc() area that 'address' is in, or NULL. Needs Global_Vmalloc.Lock.
+static VMALLOC_AREA * vmalloc_find(uint64_t address)
+{
+  uint64_t low = 0;
+  uint64_t high = Global_Vmalloc.Count;
+
+  while(low < high)
+  {
+    uint64_t middle = (low + high) >> 1;
+    VMALLOC_AREA * area = &Global_Vmalloc.Areas[middle];
+
+    if(address < area->Base)
+    {
+      high = middle;
+    }
+    else if(address >= (area->Base + area->Size))
+    {
+      low = middle + 1;
+    }
+    else
+    {
+      return area;
+    }
+  }
+
+  return NULL;
+}
+
+// Take Global_Vmalloc.Lock. VMM_Page_Fault() takes it with interrupts off, and then takes Global_VMM.Lock and the page allocator's lock.
+static void vmalloc_lock(void)
+{
+  while(__atomic_exchange_n(&Global_Vmalloc.Lock, 1, __ATOMIC_ACQUIRE))
+  {
+    asm volatile("pause");
+  }
+}
+
+static void vmalloc_unlock(void)
+{
+  __atomic_store_n(&Global_Vmalloc.Lock, 0, __ATOMIC_RELEASE);
+}
@@ -13,7 +13,12 @@
 // Minimum requirement:
 //  x86_64 CPU with SSE4.2, but AVX2 or later is *highly* recommended
 //
-// This file provides function prototypes for AVX_memmove, AVX_memcpy, AVX_memset, and AVX_memcmp
+// This file provides function prototypes for AVX_memmove, AVX_memcpy, AVX_memset, and AVX_memcmp, as well as the scanning
+// functions AVX_strlen, AVX_strnlen, AVX_memchr, AVX_memrchr, and AVX_is_all_zero
+//
+// Those functions pick the fastest implementation for the CPU at runtime once AVX_Mem_Bind() has been called. Until then they
+// use the versions compiled for whatever -march the build uses, which the Compile scripts keep at plain AVX. Those are also the
+// fallback afterwards, and runtime dispatch adds AVX2, ERMS, and AVX-512 on top of them when the CPU has them.
 //
 // NOTE: If you need to move/copy memory between overlapping regions, use AVX_memmove instead of AVX_memcpy.
 // AVX_memcpy does contain a redirect to AVX_memmove if an overlapping region is found, but it is disabled by default
@@ -29,8 +34,13 @@
 
 // Size limit (in bytes) before switching to non-temporal/streaming loads & stores
 // Applies to: AVX_memmove, AVX_memset, and AVX_memcpy
+// NOTE: This is only the default. AVX_Mem_Bind() replaces it with a value based on the CPU's caches, which goes in
+// AVX_Mem_Dispatch.NT_Threshold.
 #define CACHESIZELIMIT 3*1024*1024 // 3 MB
 
+// Default distance (in bytes) to prefetch ahead of the source in copy loops
+#define PREFETCHDISTANCE 512
+
 //-----------------------------------------------------------------------------
 // Main Functions:
 //-----------------------------------------------------------------------------
@@ -42,9 +52,90 @@ void * AVX_memcpy(void *dest, void *src, size_t numbytes);
 void * AVX_memset(void *dest, const uint8_t val, size_t numbytes);
 int AVX_memcmp(const void *str1, const void *str2, size_t numbytes, int equality);
 
+size_t AVX_strlen(const char *str);
+size_t AVX_strnlen(const char *str, size_t maxlen);
+void * AVX_memchr(const void *str, int c, size_t numbytes);
+void * AVX_memrchr(const void *str, int c, size_t numbytes);
+int AVX_is_all_zero(const void *str, size_t numbytes); // Returns 1 if every byte is 0, else 0
+
 // Numbytes_div_4 is total number of bytes / 4 (since they only do 4 at a time).
 void * AVX_memset_4B(void *dest, const uint32_t val, size_t numbytes_div_4);
 
+//-----------------------------------------------------------------------------
+// RUNTIME DISPATCH:
+//-----------------------------------------------------------------------------
+
+// The main functions above call through this table, which AVX_Mem_Bind()
+// fills in based on CPUID and XCR0 (see memdispatch.c).
+
+#define AVX_MEM_FEATURE_ERMS      (1 << 0) // Enhanced rep movsb/stosb
+#define AVX_MEM_FEATURE_FSRM      (1 << 1) // Fast short rep movsb
+#define AVX_MEM_FEATURE_AVX512F   (1 << 2) // CPUID and XCR0 both say yes
+#define AVX_MEM_FEATURE_AVX512BW  (1 << 3)
+#define AVX_MEM_FEATURE_AVX2      (1 << 4) // CPUID and XCR0 both say yes
+
+typedef struct {
+  void * (*memcpy)(void *dest, void *src, size_t numbytes);
+  void * (*memmove)(void *dest, void *src, size_t numbytes);
+  void * (*memset)(void *dest, const uint8_t val, size_t numbytes);
+  int (*memcmp)(const void *str1, const void *str2, size_t numbytes, int equality);
+  size_t (*strlen)(const char *str);
+  size_t (*strnlen)(const char *str, size_t maxlen);
+  void * (*memchr)(const void *str, int c, size_t numbytes);
+  void * (*memrchr)(const void *str, int c, size_t numbytes);
+  int (*is_all_zero)(const void *str, size_t numbytes);
+  uint64_t Features; // AVX_MEM_FEATURE_* bits
+  size_t ERMS_Threshold; // Smallest size worth using rep movsb/stosb for
+  // These are safe to change at runtime, e.g. for tuning
+  size_t NT_Threshold; // Sizes above this use streaming stores (starts as CACHESIZELIMIT)
+  size_t Prefetch_Distance; // Bytes ahead of the source to prefetch (starts as PREFETCHDISTANCE)
+  // What AVX_Mem_Bind() found via CPUID leaf 4 (Intel) or 0x8000001D (AMD). 0 if unknown.
+  uint64_t L1D_Size;
+  uint64_t L2_Size;
+  uint64_t LLC_Size; // Last level cache, usually L3
+  uint64_t LLC_Sharing; // Number of logical CPUs sharing the LLC
+  uint64_t Cache_Line_Size;
+} AVX_MEM_DISPATCH_STRUCT;
+
+extern AVX_MEM_DISPATCH_STRUCT AVX_Mem_Dispatch;
+
+void AVX_Mem_Bind(void);
+
+// Compiled for whatever -march allows
+void * AVX_memmove_native(void *dest, void *src, size_t numbytes);
+void * AVX_memcpy_native(void *dest, void *src, size_t numbytes);
+void * AVX_memset_native(void *dest, const uint8_t val, size_t numbytes);
+int AVX_memcmp_native(const void *str1, const void *str2, size_t numbytes, int equality);
+size_t AVX_strlen_native(const char *str);
+size_t AVX_strnlen_native(const char *str, size_t maxlen);
+void * AVX_memchr_native(const void *str, int c, size_t numbytes);
+void * AVX_memrchr_native(const void *str, int c, size_t numbytes);
+int AVX_is_all_zero_native(const void *str, size_t numbytes);
+
+// rep movsb/stosb for mid-sized buffers, native otherwise
+void * AVX_memmove_erms(void *dest, void *src, size_t numbytes);
+void * AVX_memcpy_erms(void *dest, void *src, size_t numbytes);
+void * AVX_memset_erms(void *dest, const uint8_t val, size_t numbytes);
+
+// AVX2, usable in any build (compare and scan only, since AVX already covers the rest)
+int AVX_memcmp_avx2(const void *str1, const void *str2, size_t numbytes, int equality);
+size_t AVX_strlen_avx2(const char *str);
+size_t AVX_strnlen_avx2(const char *str, size_t maxlen);
+void * AVX_memchr_avx2(const void *str, int c, size_t numbytes);
+void * AVX_memrchr_avx2(const void *str, int c, size_t numbytes);
+int AVX_is_all_zero_avx2(const void *str, size_t numbytes);
+
+// AVX-512, usable in any build (these also use rep movsb/stosb if it's faster)
+void * AVX_memmove_avx512(void *dest, void *src, size_t numbytes);
+void * AVX_memcpy_avx512(void *dest, void *src, size_t numbytes);
+void * AVX_memset_avx512(void *dest, const uint8_t val, size_t numbytes);
+int AVX_memcmp_avx512(const void *str1, const void *str2, size_t numbytes, int equality);
+size_t AVX_strlen_avx512(const char *str);
+size_t AVX_strnlen_avx512(const char *str, size_t maxlen);
+void * AVX_memchr_avx512(const void *str, int c, size_t numbytes);
+void * AVX_memrchr_avx512(const void *str, int c, size_t numbytes);
+int AVX_is_all_zero_avx512(const void *str, size_t numbytes);
+
 //-----------------------------------------------------------------------------
 // MEMSET:
 //-----------------------------------------------------------------------------
@@ -399,4 +490,79 @@ int memcmp_512bit_eq_a(const void *str1, const void *str2, size_t count);
 #endif
 // END MEMCMP
 
+//-----------------------------------------------------------------------------
+// MEMSCAN:
+//-----------------------------------------------------------------------------
+
+void * memchr_large(const void *str, int c, size_t numbytes);
+void * memrchr_large(const void *str, int c, size_t numbytes);
+int is_all_zero_large(const void *str, size_t numbytes);
+
+void * memchr_large_a(const void *str, int c, size_t numbytes);
+void * memrchr_large_a(const void *str, int c, size_t numbytes);
+int is_all_zero_large_a(const void *str, size_t numbytes);
+
+// Scalar
+size_t strlen (const char *str);
+size_t strnlen (const char *str, size_t maxlen);
+void * memchr (const void *str, int c, size_t count);
+void * memrchr (const void *str, int c, size_t count);
+int is_all_zero (const void *str, size_t count);
+int is_all_zero_64bit(const void *str, size_t count);
+
+// SSE4.2 (Unaligned)
+void * memchr_128bit_u(const void *str, int c, size_t count);
+void * memrchr_128bit_u(const void *str, int c, size_t count);
+int is_all_zero_128bit_u(const void *str, size_t count);
+size_t strlen_128bit_u(const char *str);
+size_t strnlen_128bit_u(const char *str, size_t maxlen);
+
+// SSE4.2 (Aligned)
+void * memchr_128bit_a(const void *str, int c, size_t count);
+void * memrchr_128bit_a(const void *str, int c, size_t count);
+int is_all_zero_128bit_a(const void *str, size_t count);
+size_t strlen_128bit_a(const char *str);
+size_t strnlen_128bit_a(const char *str, size_t maxlen);
+
+// AVX2
+#ifdef __AVX2__
+// Unaligned
+void * memchr_256bit_u(const void *str, int c, size_t count);
+void * memrchr_256bit_u(const void *str, int c, size_t count);
+int is_all_zero_256bit_u(const void *str, size_t count);
+size_t strlen_256bit_u(const char *str);
+size_t strnlen_256bit_u(const char *str, size_t maxlen);
+
+// Aligned
+void * memchr_256bit_a(const void *str, int c, size_t count);
+void * memrchr_256bit_a(const void *str, int c, size_t count);
+int is_all_zero_256bit_a(const void *str, size_t count);
+size_t strlen_256bit_a(const char *str);
+size_t strnlen_256bit_a(const char *str, size_t maxlen);
+#endif
+
+// AVX512
+#ifdef __AVX512F__
+// Unaligned
+int is_all_zero_512bit_u(const void *str, size_t count);
+
+// Aligned
+int is_all_zero_512bit_a(const void *str, size_t count);
+#endif
+
+#ifdef __AVX512BW__
+// Unaligned
+void * memchr_512bit_u(const void *str, int c, size_t count);
+void * memrchr_512bit_u(const void *str, int c, size_t count);
+size_t strlen_512bit_u(const char *str);
+size_t strnlen_512bit_u(const char *str, size_t maxlen);
+
+// Aligned
+void * memchr_512bit_a(const void *str, int c, size_t count);
+void * memrchr_512bit_a(const void *str, int c, size_t count);
+size_t strlen_512bit_a(const char *str);
+size_t strnlen_512bit_a(const char *str, size_t maxlen);
+#endif
+// END MEMSCAN
+
 #endif /* _avxmem_H */
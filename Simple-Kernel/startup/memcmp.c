@@ -1279,8 +1279,9 @@ int memcmp_large_eq_a(const void *str1, const void *str2, size_t numbytes) // Wo
 // Main Function:
 //-----------------------------------------------------------------------------
 
-// Main memcmp function
-int AVX_memcmp(const void *str1, const void *str2, size_t numbytes, int equality)
+// Main memcmp function, compiled for whatever -march allows. AVX_memcmp in
+// memdispatch.c decides at runtime whether to use this or something faster.
+int AVX_memcmp_native(const void *str1, const void *str2, size_t numbytes, int equality)
 {
   int returnval = 0;
 
@@ -2091,8 +2091,9 @@ void * memcpy_large_as(void *dest, void *src, size_t numbytes)
 // Main Function:
 //-----------------------------------------------------------------------------
 
-// General-purpose function to call
-void * AVX_memcpy(void *dest, void *src, size_t numbytes)
+// General-purpose function, compiled for whatever -march allows. AVX_memcpy in
+// memdispatch.c decides at runtime whether to use this or something faster.
+void * AVX_memcpy_native(void *dest, void *src, size_t numbytes)
 {
   void * returnval = dest;
 
@@ -2138,7 +2139,7 @@ void * AVX_memcpy(void *dest, void *src, size_t numbytes)
     ) // Check alignment
   {
     // This is the fastest case: src and dest are both cache line aligned.
-    if(numbytes > CACHESIZELIMIT)
+    if(numbytes > AVX_Mem_Dispatch.NT_Threshold)
     {
       memcpy_large_as(dest, src, numbytes);
     }
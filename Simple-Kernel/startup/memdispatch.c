@@ -0,0 +1,1018 @@
+//==============================================================================
+//  AVX Memory Functions: Runtime Dispatch
+//==============================================================================
+//
+// Version 1.0
+//
+// Author:
+//  KNNSpeed
+//
+// Source Code:
+//  https://github.com/KNNSpeed/Simple-Kernel
+//
+// This file provides AVX_memcpy, AVX_memmove, AVX_memset, and AVX_memcmp, and
+// the scanning functions AVX_strlen, AVX_strnlen, AVX_memchr, AVX_memrchr, and
+// AVX_is_all_zero. Each one calls through AVX_Mem_Dispatch, a table of function pointers that
+// AVX_Mem_Bind() fills in once CPUID and XCR0 have been checked. This is the
+// same idea as a glibc ifunc, just without needing a dynamic linker.
+//
+// The candidates are:
+//  - The *_native functions in memcpy.c, memmove.c, memset.c, memcmp.c, and
+//    memscan.c,
+//    which use whatever the compiler's -march allows (BYTE_ALIGNMENT & co.)
+//  - ERMS versions, which use 'rep movsb'/'rep stosb' for mid-sized buffers
+//  - AVX2 and AVX-512 versions, which are compiled with target attributes so
+//    that the same binary can carry them regardless of -march
+//
+// Until AVX_Mem_Bind() runs, everything goes to the *_native functions.
+//
+// NOTE: The Compile scripts build for -march=sandybridge, i.e. plain AVX, so
+// the *_native functions run on anything with AVX and the same image works on
+// every host. Anything newer than that (AVX2, ERMS, AVX-512) is only ever used
+// through this table, once AVX_Mem_Bind() has checked that it's there.
+//
+// AVX_Mem_Bind() also sizes up the caches with CPUID and picks the streaming
+// store threshold and prefetch distance from them (see mem_tune()).
+//
+// NOTE: The table is filled in at runtime instead of being statically
+// initialized, since a static table of function pointers would need relocating
+// by the bootloader. Plain numbers are fine, though.
+//
+
+#include "avxmem.h"
+
+#ifdef __clang__
+#define __m512i_u __m512i
+#endif
+
+// Anything smaller than this just goes to the native functions. Setting up a
+// 64-byte head/tail costs more than it saves below this.
+#define AVX512_MIN_SIZE 256
+
+AVX_MEM_DISPATCH_STRUCT AVX_Mem_Dispatch = {.NT_Threshold = CACHESIZELIMIT, .Prefetch_Distance = PREFETCHDISTANCE};
+
+static void mem_probe_caches(uint32_t max_leaf);
+static void mem_tune(void);
+
+//-----------------------------------------------------------------------------
+// ERMS:
+//-----------------------------------------------------------------------------
+
+static inline void memcpy_erms(void *dest, const void *src, size_t numbytes)
+{
+  asm volatile("rep movsb"
+               : "+D" (dest), "+S" (src), "+c" (numbytes) // Outputs
+               : // Inputs
+               : "memory" // Clobbers
+              );
+}
+
+static inline void memset_erms(void *dest, const uint8_t val, size_t numbytes)
+{
+  asm volatile("rep stosb"
+               : "+D" (dest), "+c" (numbytes) // Outputs
+               : "a" (val) // Inputs
+               : "memory" // Clobbers
+              );
+}
+
+// 'rep movsb' and 'rep stosb' lose to vector loops on short buffers (unless the
+// CPU has FSRM), and to streaming stores on buffers bigger than the cache.
+static inline int erms_profitable(size_t numbytes)
+{
+  return (AVX_Mem_Dispatch.Features & AVX_MEM_FEATURE_ERMS) && (numbytes >= AVX_Mem_Dispatch.ERMS_Threshold) && (numbytes <= AVX_Mem_Dispatch.NT_Threshold);
+}
+
+//-----------------------------------------------------------------------------
+// AVX2:
+//-----------------------------------------------------------------------------
+
+// AVX can load and store 256 bits, which is all memcpy/memmove/memset need, but
+// comparing 256-bit integers takes AVX2. So these are just the compare and scan
+// functions: they do whole 32-byte chunks and leave whatever's left over to the
+// native functions.
+
+static __attribute__((target("avx2"))) int memcmp_256(const void *str1, const void *str2, size_t numbytes, int equality)
+{
+  const unsigned char * s1 = (const unsigned char*)str1;
+  const unsigned char * s2 = (const unsigned char*)str2;
+
+  while(numbytes >= 32)
+  {
+    __m256i item1 = _mm256_loadu_si256((const __m256i_u*)s1);
+    __m256i item2 = _mm256_loadu_si256((const __m256i_u*)s2);
+    uint32_t result = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(item1, item2));
+
+    if(result)
+    {
+      if(equality == 0)
+      {
+        return -1; // Same as memcmp_eq
+      }
+
+      // First differing byte decides it
+      size_t index = __builtin_ctz(result);
+      return (s1[index] < s2[index]) ? -1 : 1;
+    }
+    s1 += 32;
+    s2 += 32;
+    numbytes -= 32;
+  }
+
+  return AVX_memcmp_native(s1, s2, numbytes, equality);
+}
+
+// Same aligned-chunk trick as strnlen_512
+static __attribute__((target("avx2"))) size_t strnlen_256(const char *str, size_t maxlen)
+{
+  size_t misalignment = (uintptr_t)str & 31;
+  const char * s = str - misalignment;
+  const __m256i zero = _mm256_setzero_si256();
+  uint32_t result = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_load_si256((const __m256i*)s), zero)) >> misalignment;
+  size_t length = 32 - misalignment;
+
+  if(result)
+  {
+    length = __builtin_ctz(result);
+  }
+  else
+  {
+    s += 32;
+    while(length < maxlen)
+    {
+      result = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_load_si256((const __m256i*)s), zero));
+      if(result)
+      {
+        length += __builtin_ctz(result);
+        break;
+      }
+      s += 32;
+      length += 32;
+    }
+  }
+
+  return (length < maxlen) ? length : maxlen;
+}
+
+static __attribute__((target("avx2"))) void * memchr_256(const void *str, int c, size_t numbytes)
+{
+  const unsigned char * s = (const unsigned char*)str;
+  const __m256i needle = _mm256_set1_epi8((char)c);
+
+  while(numbytes >= 32)
+  {
+    uint32_t result = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i_u*)s), needle));
+    if(result)
+    {
+      return (void*)(s + __builtin_ctz(result));
+    }
+    s += 32;
+    numbytes -= 32;
+  }
+
+  return AVX_memchr_native(s, c, numbytes);
+}
+
+// Works back from the end, so the leftover bytes are the ones at the start
+static __attribute__((target("avx2"))) void * memrchr_256(const void *str, int c, size_t numbytes)
+{
+  const unsigned char * s = (const unsigned char*)str;
+  const __m256i needle = _mm256_set1_epi8((char)c);
+
+  while(numbytes >= 32)
+  {
+    numbytes -= 32;
+    uint32_t result = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i_u*)(s + numbytes)), needle));
+    if(result)
+    {
+      return (void*)(s + numbytes + (31 - __builtin_clz(result)));
+    }
+  }
+
+  return AVX_memrchr_native(s, c, numbytes);
+}
+
+// Four vectors ORed together per test, like is_all_zero_512
+static __attribute__((target("avx2"))) int is_all_zero_256(const void *str, size_t numbytes)
+{
+  const unsigned char * s = (const unsigned char*)str;
+
+  while(numbytes >= 128)
+  {
+    __m256i item = _mm256_or_si256(
+                     _mm256_or_si256(_mm256_loadu_si256((const __m256i_u*)s), _mm256_loadu_si256((const __m256i_u*)(s + 32))),
+                     _mm256_or_si256(_mm256_loadu_si256((const __m256i_u*)(s + 64)), _mm256_loadu_si256((const __m256i_u*)(s + 96)))
+                   );
+    if(!_mm256_testz_si256(item, item))
+    {
+      return 0;
+    }
+    s += 128;
+    numbytes -= 128;
+  }
+
+  return AVX_is_all_zero_native(s, numbytes);
+}
+
+//-----------------------------------------------------------------------------
+// AVX-512:
+//-----------------------------------------------------------------------------
+
+// Numbytes must be at least AVX512_MIN_SIZE. The first and last 64 bytes are
+// done with unaligned accesses, and everything inbetween with aligned stores.
+// Prefetches past the end of src are harmless, since prefetches never fault.
+static __attribute__((target("avx512f"))) void memcpy_512(void *dest, const void *src, size_t numbytes, int streaming)
+{
+  char * d = (char*)dest;
+  const char * s = (const char*)src;
+  size_t prefetch = AVX_Mem_Dispatch.Prefetch_Distance;
+
+  __m512i head = _mm512_loadu_si512((const __m512i_u*)s);
+  __m512i tail = _mm512_loadu_si512((const __m512i_u*)(s + numbytes - 64));
+  _mm512_storeu_si512((__m512i_u*)d, head);
+
+  size_t numbytes_to_align = 64 - ((uintptr_t)d & 63);
+  char * end = d + numbytes - 64;
+  d += numbytes_to_align;
+  s += numbytes_to_align;
+
+  if(streaming)
+  {
+    while(d + 192 < end)
+    {
+      _mm_prefetch(s + prefetch, _MM_HINT_NTA);
+      _mm_prefetch(s + prefetch + 128, _MM_HINT_NTA);
+      __m512i a = _mm512_loadu_si512((const __m512i_u*)s);
+      __m512i b = _mm512_loadu_si512((const __m512i_u*)(s + 64));
+      __m512i c = _mm512_loadu_si512((const __m512i_u*)(s + 128));
+      __m512i e = _mm512_loadu_si512((const __m512i_u*)(s + 192));
+      _mm512_stream_si512((__m512i*)d, a);
+      _mm512_stream_si512((__m512i*)(d + 64), b);
+      _mm512_stream_si512((__m512i*)(d + 128), c);
+      _mm512_stream_si512((__m512i*)(d + 192), e);
+      d += 256;
+      s += 256;
+    }
+    while(d < end)
+    {
+      _mm512_stream_si512((__m512i*)d, _mm512_loadu_si512((const __m512i_u*)s));
+      d += 64;
+      s += 64;
+    }
+    _mm_sfence();
+  }
+  else
+  {
+    while(d + 192 < end)
+    {
+      _mm_prefetch(s + prefetch, _MM_HINT_T0);
+      _mm_prefetch(s + prefetch + 128, _MM_HINT_T0);
+      __m512i a = _mm512_loadu_si512((const __m512i_u*)s);
+      __m512i b = _mm512_loadu_si512((const __m512i_u*)(s + 64));
+      __m512i c = _mm512_loadu_si512((const __m512i_u*)(s + 128));
+      __m512i e = _mm512_loadu_si512((const __m512i_u*)(s + 192));
+      _mm512_store_si512((__m512i*)d, a);
+      _mm512_store_si512((__m512i*)(d + 64), b);
+      _mm512_store_si512((__m512i*)(d + 128), c);
+      _mm512_store_si512((__m512i*)(d + 192), e);
+      d += 256;
+      s += 256;
+    }
+    while(d < end)
+    {
+      _mm512_store_si512((__m512i*)d, _mm512_loadu_si512((const __m512i_u*)s));
+      d += 64;
+      s += 64;
+    }
+  }
+
+  // Whatever is left overlaps with the preloaded last 64 bytes
+  _mm512_storeu_si512((__m512i_u*)end, tail);
+}
+
+// Same deal as memcpy_512
+static __attribute__((target("avx512f"))) void memset_512(void *dest, const uint8_t val, size_t numbytes, int streaming)
+{
+  char * d = (char*)dest;
+  __m512i set = _mm512_set1_epi8((char)val);
+
+  _mm512_storeu_si512((__m512i_u*)d, set);
+  _mm512_storeu_si512((__m512i_u*)(d + numbytes - 64), set);
+
+  char * end = d + numbytes - 64;
+  d += 64 - ((uintptr_t)d & 63);
+
+  if(streaming)
+  {
+    while(d + 192 < end)
+    {
+      _mm512_stream_si512((__m512i*)d, set);
+      _mm512_stream_si512((__m512i*)(d + 64), set);
+      _mm512_stream_si512((__m512i*)(d + 128), set);
+      _mm512_stream_si512((__m512i*)(d + 192), set);
+      d += 256;
+    }
+    while(d < end)
+    {
+      _mm512_stream_si512((__m512i*)d, set);
+      d += 64;
+    }
+    _mm_sfence();
+  }
+  else
+  {
+    while(d + 192 < end)
+    {
+      _mm512_store_si512((__m512i*)d, set);
+      _mm512_store_si512((__m512i*)(d + 64), set);
+      _mm512_store_si512((__m512i*)(d + 128), set);
+      _mm512_store_si512((__m512i*)(d + 192), set);
+      d += 256;
+    }
+    while(d < end)
+    {
+      _mm512_store_si512((__m512i*)d, set);
+      d += 64;
+    }
+  }
+}
+
+// Byte-granular compare: a masked load handles the tail without reading past
+// the end of either buffer, so there are no size restrictions here.
+static __attribute__((target("avx512f,avx512bw"))) int memcmp_512(const void *str1, const void *str2, size_t numbytes, int equality)
+{
+  const unsigned char * s1 = (const unsigned char*)str1;
+  const unsigned char * s2 = (const unsigned char*)str2;
+  __mmask64 result = 0;
+
+  while(numbytes >= 64)
+  {
+    __m512i item1 = _mm512_loadu_si512((const __m512i_u*)s1);
+    __m512i item2 = _mm512_loadu_si512((const __m512i_u*)s2);
+    result = _mm512_cmpneq_epi8_mask(item1, item2);
+    if(result)
+    {
+      break;
+    }
+    s1 += 64;
+    s2 += 64;
+    numbytes -= 64;
+  }
+
+  if((!result) && numbytes)
+  {
+    __mmask64 mask = (1ULL << numbytes) - 1; // numbytes < 64 here
+    __m512i item1 = _mm512_maskz_loadu_epi8(mask, s1);
+    __m512i item2 = _mm512_maskz_loadu_epi8(mask, s2);
+    result = _mm512_mask_cmpneq_epi8_mask(mask, item1, item2);
+  }
+
+  if(!result)
+  {
+    return 0;
+  }
+  if(equality == 0)
+  {
+    return -1; // Same as memcmp_eq
+  }
+
+  // First differing byte decides it
+  size_t index = __builtin_ctzll(result);
+  return (s1[index] < s2[index]) ? -1 : 1;
+}
+
+// Same trick as the strlen functions in memscan.c: only ever load whole aligned
+// 64-byte chunks, since those can't cross into an unmapped page after the
+// terminating 0, and ignore whatever is before str in the first one.
+static __attribute__((target("avx512f,avx512bw"))) size_t strnlen_512(const char *str, size_t maxlen)
+{
+  size_t misalignment = (uintptr_t)str & 63;
+  const char * s = str - misalignment;
+  const __m512i zero = _mm512_setzero_si512();
+  uint64_t result = _mm512_cmpeq_epi8_mask(_mm512_load_si512((const __m512i*)s), zero) >> misalignment;
+  size_t length = 64 - misalignment;
+
+  if(result)
+  {
+    length = __builtin_ctzll(result);
+  }
+  else
+  {
+    s += 64;
+    while(length < maxlen)
+    {
+      result = _mm512_cmpeq_epi8_mask(_mm512_load_si512((const __m512i*)s), zero);
+      if(result)
+      {
+        length += __builtin_ctzll(result);
+        break;
+      }
+      s += 64;
+      length += 64;
+    }
+  }
+
+  return (length < maxlen) ? length : maxlen;
+}
+
+// Masked loads handle the tails like in memcmp_512, so these have no size
+// restrictions either.
+static __attribute__((target("avx512f,avx512bw"))) void * memchr_512(const void *str, int c, size_t numbytes)
+{
+  const unsigned char * s = (const unsigned char*)str;
+  const __m512i needle = _mm512_set1_epi8((char)c);
+  __mmask64 result;
+
+  while(numbytes >= 64)
+  {
+    result = _mm512_cmpeq_epi8_mask(_mm512_loadu_si512((const __m512i_u*)s), needle);
+    if(result)
+    {
+      return (void*)(s + __builtin_ctzll(result));
+    }
+    s += 64;
+    numbytes -= 64;
+  }
+
+  if(numbytes)
+  {
+    __mmask64 mask = (1ULL << numbytes) - 1; // numbytes < 64 here
+    result = _mm512_mask_cmpeq_epi8_mask(mask, _mm512_maskz_loadu_epi8(mask, s), needle);
+    if(result)
+    {
+      return (void*)(s + __builtin_ctzll(result));
+    }
+  }
+
+  return NULL;
+}
+
+static __attribute__((target("avx512f,avx512bw"))) void * memrchr_512(const void *str, int c, size_t numbytes)
+{
+  const unsigned char * s = (const unsigned char*)str;
+  const __m512i needle = _mm512_set1_epi8((char)c);
+  __mmask64 result;
+
+  while(numbytes >= 64)
+  {
+    numbytes -= 64;
+    result = _mm512_cmpeq_epi8_mask(_mm512_loadu_si512((const __m512i_u*)(s + numbytes)), needle);
+    if(result)
+    {
+      return (void*)(s + numbytes + (63 - __builtin_clzll(result)));
+    }
+  }
+
+  if(numbytes)
+  {
+    __mmask64 mask = (1ULL << numbytes) - 1;
+    result = _mm512_mask_cmpeq_epi8_mask(mask, _mm512_maskz_loadu_epi8(mask, s), needle);
+    if(result)
+    {
+      return (void*)(s + (63 - __builtin_clzll(result)));
+    }
+  }
+
+  return NULL;
+}
+
+// Four lines ORed together per test, which keeps up with memory bandwidth
+static __attribute__((target("avx512f,avx512bw"))) int is_all_zero_512(const void *str, size_t numbytes)
+{
+  const unsigned char * s = (const unsigned char*)str;
+
+  while(numbytes >= 256)
+  {
+    __m512i item = _mm512_or_si512(
+                     _mm512_or_si512(_mm512_loadu_si512((const __m512i_u*)s), _mm512_loadu_si512((const __m512i_u*)(s + 64))),
+                     _mm512_or_si512(_mm512_loadu_si512((const __m512i_u*)(s + 128)), _mm512_loadu_si512((const __m512i_u*)(s + 192)))
+                   );
+    if(_mm512_test_epi64_mask(item, item))
+    {
+      return 0;
+    }
+    s += 256;
+    numbytes -= 256;
+  }
+
+  while(numbytes >= 64)
+  {
+    __m512i item = _mm512_loadu_si512((const __m512i_u*)s);
+    if(_mm512_test_epi64_mask(item, item))
+    {
+      return 0;
+    }
+    s += 64;
+    numbytes -= 64;
+  }
+
+  if(numbytes)
+  {
+    __m512i item = _mm512_maskz_loadu_epi8((1ULL << numbytes) - 1, s);
+    if(_mm512_test_epi64_mask(item, item))
+    {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+//-----------------------------------------------------------------------------
+// Dispatch Targets:
+//-----------------------------------------------------------------------------
+
+// True if [dest, dest + numbytes) and [src, src + numbytes) overlap at all
+static inline int mem_overlap(const void *dest, const void *src, size_t numbytes)
+{
+  return ((const char*)dest < ((const char*)src + numbytes)) && ((const char*)src < ((const char*)dest + numbytes));
+}
+
+void * AVX_memcpy_erms(void *dest, void *src, size_t numbytes)
+{
+  if(erms_profitable(numbytes))
+  {
+    memcpy_erms(dest, src, numbytes);
+    return dest;
+  }
+  return AVX_memcpy_native(dest, src, numbytes);
+}
+
+void * AVX_memcpy_avx512(void *dest, void *src, size_t numbytes)
+{
+  if(numbytes < AVX512_MIN_SIZE)
+  {
+    return AVX_memcpy_native(dest, src, numbytes);
+  }
+  if(erms_profitable(numbytes))
+  {
+    memcpy_erms(dest, src, numbytes);
+  }
+  else
+  {
+    memcpy_512(dest, src, numbytes, (numbytes > AVX_Mem_Dispatch.NT_Threshold));
+  }
+  return dest;
+}
+
+// Overlapping moves stay with the native functions, which know how to go
+// backwards. Disjoint ones are just copies.
+void * AVX_memmove_erms(void *dest, void *src, size_t numbytes)
+{
+  if(mem_overlap(dest, src, numbytes))
+  {
+    return AVX_memmove_native(dest, src, numbytes);
+  }
+  return AVX_memcpy_erms(dest, src, numbytes);
+}
+
+void * AVX_memmove_avx512(void *dest, void *src, size_t numbytes)
+{
+  if(mem_overlap(dest, src, numbytes))
+  {
+    return AVX_memmove_native(dest, src, numbytes);
+  }
+  return AVX_memcpy_avx512(dest, src, numbytes);
+}
+
+void * AVX_memset_erms(void *dest, const uint8_t val, size_t numbytes)
+{
+  if(erms_profitable(numbytes))
+  {
+    memset_erms(dest, val, numbytes);
+    return dest;
+  }
+  return AVX_memset_native(dest, val, numbytes);
+}
+
+void * AVX_memset_avx512(void *dest, const uint8_t val, size_t numbytes)
+{
+  if(numbytes < AVX512_MIN_SIZE)
+  {
+    return AVX_memset_native(dest, val, numbytes);
+  }
+  if(erms_profitable(numbytes))
+  {
+    memset_erms(dest, val, numbytes);
+  }
+  else
+  {
+    memset_512(dest, val, numbytes, (numbytes > AVX_Mem_Dispatch.NT_Threshold));
+  }
+  return dest;
+}
+
+int AVX_memcmp_avx2(const void *str1, const void *str2, size_t numbytes, int equality)
+{
+  return memcmp_256(str1, str2, numbytes, equality);
+}
+
+size_t AVX_strlen_avx2(const char *str)
+{
+  return strnlen_256(str, SIZE_MAX);
+}
+
+size_t AVX_strnlen_avx2(const char *str, size_t maxlen)
+{
+  if(!maxlen)
+  {
+    return 0;
+  }
+  return strnlen_256(str, maxlen);
+}
+
+void * AVX_memchr_avx2(const void *str, int c, size_t numbytes)
+{
+  return memchr_256(str, c, numbytes);
+}
+
+void * AVX_memrchr_avx2(const void *str, int c, size_t numbytes)
+{
+  return memrchr_256(str, c, numbytes);
+}
+
+int AVX_is_all_zero_avx2(const void *str, size_t numbytes)
+{
+  return is_all_zero_256(str, numbytes);
+}
+
+int AVX_memcmp_avx512(const void *str1, const void *str2, size_t numbytes, int equality)
+{
+  return memcmp_512(str1, str2, numbytes, equality);
+}
+
+size_t AVX_strlen_avx512(const char *str)
+{
+  return strnlen_512(str, SIZE_MAX);
+}
+
+size_t AVX_strnlen_avx512(const char *str, size_t maxlen)
+{
+  if(!maxlen)
+  {
+    return 0;
+  }
+  return strnlen_512(str, maxlen);
+}
+
+void * AVX_memchr_avx512(const void *str, int c, size_t numbytes)
+{
+  return memchr_512(str, c, numbytes);
+}
+
+void * AVX_memrchr_avx512(const void *str, int c, size_t numbytes)
+{
+  return memrchr_512(str, c, numbytes);
+}
+
+int AVX_is_all_zero_avx512(const void *str, size_t numbytes)
+{
+  return is_all_zero_512(str, numbytes);
+}
+
+//-----------------------------------------------------------------------------
+// Main Functions:
+//-----------------------------------------------------------------------------
+
+void * AVX_memcpy(void *dest, void *src, size_t numbytes)
+{
+  if(__builtin_expect(AVX_Mem_Dispatch.memcpy != NULL, 1))
+  {
+    return AVX_Mem_Dispatch.memcpy(dest, src, numbytes);
+  }
+  return AVX_memcpy_native(dest, src, numbytes);
+}
+
+void * AVX_memmove(void *dest, void *src, size_t numbytes)
+{
+  if(__builtin_expect(AVX_Mem_Dispatch.memmove != NULL, 1))
+  {
+    return AVX_Mem_Dispatch.memmove(dest, src, numbytes);
+  }
+  return AVX_memmove_native(dest, src, numbytes);
+}
+
+void * AVX_memset(void *dest, const uint8_t val, size_t numbytes)
+{
+  if(__builtin_expect(AVX_Mem_Dispatch.memset != NULL, 1))
+  {
+    return AVX_Mem_Dispatch.memset(dest, val, numbytes);
+  }
+  return AVX_memset_native(dest, val, numbytes);
+}
+
+int AVX_memcmp(const void *str1, const void *str2, size_t numbytes, int equality)
+{
+  if(__builtin_expect(AVX_Mem_Dispatch.memcmp != NULL, 1))
+  {
+    return AVX_Mem_Dispatch.memcmp(str1, str2, numbytes, equality);
+  }
+  return AVX_memcmp_native(str1, str2, numbytes, equality);
+}
+
+size_t AVX_strlen(const char *str)
+{
+  if(__builtin_expect(AVX_Mem_Dispatch.strlen != NULL, 1))
+  {
+    return AVX_Mem_Dispatch.strlen(str);
+  }
+  return AVX_strlen_native(str);
+}
+
+size_t AVX_strnlen(const char *str, size_t maxlen)
+{
+  if(__builtin_expect(AVX_Mem_Dispatch.strnlen != NULL, 1))
+  {
+    return AVX_Mem_Dispatch.strnlen(str, maxlen);
+  }
+  return AVX_strnlen_native(str, maxlen);
+}
+
+void * AVX_memchr(const void *str, int c, size_t numbytes)
+{
+  if(__builtin_expect(AVX_Mem_Dispatch.memchr != NULL, 1))
+  {
+    return AVX_Mem_Dispatch.memchr(str, c, numbytes);
+  }
+  return AVX_memchr_native(str, c, numbytes);
+}
+
+void * AVX_memrchr(const void *str, int c, size_t numbytes)
+{
+  if(__builtin_expect(AVX_Mem_Dispatch.memrchr != NULL, 1))
+  {
+    return AVX_Mem_Dispatch.memrchr(str, c, numbytes);
+  }
+  return AVX_memrchr_native(str, c, numbytes);
+}
+
+int AVX_is_all_zero(const void *str, size_t numbytes)
+{
+  if(__builtin_expect(AVX_Mem_Dispatch.is_all_zero != NULL, 1))
+  {
+    return AVX_Mem_Dispatch.is_all_zero(str, numbytes);
+  }
+  return AVX_is_all_zero_native(str, numbytes);
+}
+
+//-----------------------------------------------------------------------------
+// Binding:
+//-----------------------------------------------------------------------------
+
+// Call this after AVX (and AVX-512, if there is any) has been enabled in XCR0.
+// It's fine to call it again later, but note that doing so also re-derives
+// NT_Threshold and Prefetch_Distance, undoing any manual tuning.
+void AVX_Mem_Bind(void)
+{
+  uint32_t eax = 0, ebx = 0, ecx = 0, edx = 0;
+  uint64_t features = 0;
+
+  asm volatile("cpuid"
+               : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) // Outputs
+               : "a" (0x00) // Inputs
+               : // Clobbers
+              );
+  uint32_t max_leaf = eax;
+
+  asm volatile("cpuid"
+               : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) // Outputs
+               : "a" (0x01) // Inputs
+               : // Clobbers
+              );
+  uint32_t leaf1_ecx = ecx;
+  uint32_t xcr0_lo = 0, xcr0_hi = 0;
+
+  if(leaf1_ecx & (1 << 27)) // OSXSAVE, so xgetbv works
+  {
+    asm volatile("xgetbv"
+                 : "=a" (xcr0_lo), "=d" (xcr0_hi) // Outputs
+                 : "c" (0) // Inputs
+                 : // Clobbers
+                );
+  }
+
+  if(max_leaf >= 0x07)
+  {
+    asm volatile("cpuid"
+                 : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) // Outputs
+                 : "a" (0x07), "c" (0x00) // Inputs
+                 : // Clobbers
+                );
+
+    if(ebx & (1 << 9))
+    {
+      features |= AVX_MEM_FEATURE_ERMS;
+    }
+    if(edx & (1 << 4))
+    {
+      features |= AVX_MEM_FEATURE_FSRM;
+    }
+
+    // AVX2 uses the same YMM state as AVX
+    if((ebx & (1 << 5)) && ((xcr0_lo & 0x6) == 0x6))
+    {
+      features |= AVX_MEM_FEATURE_AVX2;
+    }
+
+    // AVX-512 needs the OS (that's us) to have turned on opmask, ZMM_Hi256, and
+    // Hi16_ZMM state in XCR0 on top of x87/SSE/AVX
+    if((ebx & (1 << 16)) && ((xcr0_lo & 0xE6) == 0xE6))
+    {
+      features |= AVX_MEM_FEATURE_AVX512F;
+      if(ebx & (1 << 30))
+      {
+        features |= AVX_MEM_FEATURE_AVX512BW;
+      }
+    }
+  }
+
+  AVX_Mem_Dispatch.Features = features;
+  // Fast Short Rep Mov makes 'rep movsb' competitive with vector loops much earlier
+  AVX_Mem_Dispatch.ERMS_Threshold = (features & AVX_MEM_FEATURE_FSRM) ? 512 : 2048;
+
+  mem_probe_caches(max_leaf);
+  mem_tune();
+
+  if(features & AVX_MEM_FEATURE_AVX512F)
+  {
+    AVX_Mem_Dispatch.memcpy = AVX_memcpy_avx512;
+    AVX_Mem_Dispatch.memmove = AVX_memmove_avx512;
+    AVX_Mem_Dispatch.memset = AVX_memset_avx512;
+  }
+  else if(features & AVX_MEM_FEATURE_ERMS)
+  {
+    AVX_Mem_Dispatch.memcpy = AVX_memcpy_erms;
+    AVX_Mem_Dispatch.memmove = AVX_memmove_erms;
+    AVX_Mem_Dispatch.memset = AVX_memset_erms;
+  }
+  else
+  {
+    AVX_Mem_Dispatch.memcpy = AVX_memcpy_native;
+    AVX_Mem_Dispatch.memmove = AVX_memmove_native;
+    AVX_Mem_Dispatch.memset = AVX_memset_native;
+  }
+
+  if(features & AVX_MEM_FEATURE_AVX512BW)
+  {
+    AVX_Mem_Dispatch.memcmp = AVX_memcmp_avx512;
+    AVX_Mem_Dispatch.strlen = AVX_strlen_avx512;
+    AVX_Mem_Dispatch.strnlen = AVX_strnlen_avx512;
+    AVX_Mem_Dispatch.memchr = AVX_memchr_avx512;
+    AVX_Mem_Dispatch.memrchr = AVX_memrchr_avx512;
+    AVX_Mem_Dispatch.is_all_zero = AVX_is_all_zero_avx512;
+  }
+  else if(features & AVX_MEM_FEATURE_AVX2)
+  {
+    AVX_Mem_Dispatch.memcmp = AVX_memcmp_avx2;
+    AVX_Mem_Dispatch.strlen = AVX_strlen_avx2;
+    AVX_Mem_Dispatch.strnlen = AVX_strnlen_avx2;
+    AVX_Mem_Dispatch.memchr = AVX_memchr_avx2;
+    AVX_Mem_Dispatch.memrchr = AVX_memrchr_avx2;
+    AVX_Mem_Dispatch.is_all_zero = AVX_is_all_zero_avx2;
+  }
+  else
+  {
+    AVX_Mem_Dispatch.memcmp = AVX_memcmp_native;
+    AVX_Mem_Dispatch.strlen = AVX_strlen_native;
+    AVX_Mem_Dispatch.strnlen = AVX_strnlen_native;
+    AVX_Mem_Dispatch.memchr = AVX_memchr_native;
+    AVX_Mem_Dispatch.memrchr = AVX_memrchr_native;
+    AVX_Mem_Dispatch.is_all_zero = AVX_is_all_zero_native;
+  }
+}
+
+//-----------------------------------------------------------------------------
+// Cache Topology:
+//-----------------------------------------------------------------------------
+
+// Fill in the L1D/L2/LLC sizes. Intel's leaf 4 and AMD's leaf 0x8000001D have
+// the same layout, so the only difference is which one to ask. If neither exists
+// (very old CPUs), the sizes stay 0 and mem_tune() keeps the defaults.
+static void mem_probe_caches(uint32_t max_leaf)
+{
+  uint32_t eax = 0, ebx = 0, ecx = 0, edx = 0;
+  uint32_t cache_leaf = 0;
+
+  asm volatile("cpuid"
+               : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) // Outputs
+               : "a" (0x80000000) // Inputs
+               : // Clobbers
+              );
+  uint32_t max_extended_leaf = eax;
+
+  if(max_extended_leaf >= 0x8000001D)
+  {
+    asm volatile("cpuid"
+                 : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) // Outputs
+                 : "a" (0x80000001) // Inputs
+                 : // Clobbers
+                );
+
+    if(ecx & (1 << 22)) // TopologyExtensions
+    {
+      cache_leaf = 0x8000001D;
+    }
+  }
+
+  if((cache_leaf == 0) && (max_leaf >= 0x04))
+  {
+    cache_leaf = 0x04;
+  }
+
+  if(cache_leaf == 0)
+  {
+    return;
+  }
+
+  uint64_t llc_level = 0;
+
+  for(uint32_t subleaf = 0; subleaf < 16; subleaf++)
+  {
+    asm volatile("cpuid"
+                 : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) // Outputs
+                 : "a" (cache_leaf), "c" (subleaf) // Inputs
+                 : // Clobbers
+                );
+
+    uint32_t type = eax & 0x1F; // 0 = no more caches, 1 = data, 2 = instruction, 3 = unified
+    if(type == 0)
+    {
+      break;
+    }
+    if(type == 2)
+    {
+      continue;
+    }
+
+    uint64_t level = (eax >> 5) & 0x7;
+    uint64_t sharing = ((eax >> 14) & 0xFFF) + 1;
+    uint64_t line_size = (ebx & 0xFFF) + 1;
+    uint64_t partitions = ((ebx >> 12) & 0x3FF) + 1;
+    uint64_t ways = ((ebx >> 22) & 0x3FF) + 1;
+    uint64_t sets = (uint64_t)ecx + 1;
+    uint64_t size = ways * partitions * line_size * sets;
+
+    if(level == 1)
+    {
+      AVX_Mem_Dispatch.L1D_Size = size;
+      AVX_Mem_Dispatch.Cache_Line_Size = line_size;
+    }
+    else if(level == 2)
+    {
+      AVX_Mem_Dispatch.L2_Size = size;
+    }
+
+    if(level >= llc_level)
+    {
+      llc_level = level;
+      AVX_Mem_Dispatch.LLC_Size = size;
+      AVX_Mem_Dispatch.LLC_Sharing = sharing;
+    }
+  }
+}
+
+// Streaming stores are worth it once a buffer would push a big chunk of
+// everyone else's data out of the LLC. A quarter of the LLC is the cutoff, but
+// never less than the share of it that a single CPU can count on, and never
+// less than L2 (below that, the data is going to stay close to the core anyway).
+//
+// The prefetch distance is roughly how far ahead the loads need to be to cover
+// memory latency without thrashing L1: 1/64th of L1D, which is 512 bytes on a
+// 32kB L1D, rounded down to a cache line and kept between 256 bytes and 2kB.
+static void mem_tune(void)
+{
+  if(AVX_Mem_Dispatch.LLC_Size)
+  {
+    uint64_t sharing = AVX_Mem_Dispatch.LLC_Sharing ? AVX_Mem_Dispatch.LLC_Sharing : 1;
+    uint64_t threshold = AVX_Mem_Dispatch.LLC_Size / 4;
+    uint64_t per_cpu = (AVX_Mem_Dispatch.LLC_Size / sharing) * 3 / 4;
+
+    if(per_cpu > threshold)
+    {
+      threshold = per_cpu;
+    }
+    if(AVX_Mem_Dispatch.L2_Size > threshold)
+    {
+      threshold = AVX_Mem_Dispatch.L2_Size;
+    }
+
+    AVX_Mem_Dispatch.NT_Threshold = threshold;
+  }
+
+  if(AVX_Mem_Dispatch.L1D_Size)
+  {
+    uint64_t line_size = AVX_Mem_Dispatch.Cache_Line_Size ? AVX_Mem_Dispatch.Cache_Line_Size : 64;
+    uint64_t distance = (AVX_Mem_Dispatch.L1D_Size / 64) & ~(line_size - 1);
+
+    if(distance < 256)
+    {
+      distance = 256;
+    }
+    else if(distance > 2048)
+    {
+      distance = 2048;
+    }
+
+    AVX_Mem_Dispatch.Prefetch_Distance = distance;
+  }
+}
@@ -3985,8 +3985,9 @@ void * memmove_large_reverse_as(void *dest, void *src, size_t numbytes)
 // Main Function:
 //-----------------------------------------------------------------------------
 
-// General-purpose function to call
-void * AVX_memmove(void *dest, void *src, size_t numbytes)
+// General-purpose function, compiled for whatever -march allows. AVX_memmove in
+// memdispatch.c decides at runtime whether to use this or something faster.
+void * AVX_memmove_native(void *dest, void *src, size_t numbytes)
 {
   void * returnval = dest;
 
@@ -4004,7 +4005,7 @@ void * AVX_memmove(void *dest, void *src, size_t numbytes)
     if((char *)dest < (char *)src)
     {
       // This is the fastest case: src and dest are both cache line aligned.
-      if(numbytes > CACHESIZELIMIT)
+      if(numbytes > AVX_Mem_Dispatch.NT_Threshold)
       {
         memmove_large_as(dest, src, numbytes);
       }
@@ -4015,7 +4016,7 @@ void * AVX_memmove(void *dest, void *src, size_t numbytes)
     }
     else // src < dest
     { // Need to move ends first
-      if(numbytes > CACHESIZELIMIT)
+      if(numbytes > AVX_Mem_Dispatch.NT_Threshold)
       {
         memmove_large_reverse_as(dest, src, numbytes);
       }
@@ -0,0 +1,1363 @@
+// Compile with GCC -O3 for best performance
+// It pretty much entirely negates the need to write these by hand in asm.
+#include "avxmem.h"
+
+size_t strlen (const char *str)
+{
+  const char *s = str;
+
+  while (*s)
+  {
+    s++;
+  }
+  return (size_t)(s - str);
+}
+
+size_t strnlen (const char *str, size_t maxlen)
+{
+  size_t length = 0;
+
+  while ((length < maxlen) && str[length])
+  {
+    length++;
+  }
+  return length;
+}
+
+void * memchr (const void *str, int c, size_t count)
+{
+  const unsigned char *s = (unsigned char *)str;
+
+  while (count-- > 0)
+  {
+    if (*s == (unsigned char)c)
+    {
+      return (void *)s;
+    }
+    s++;
+  }
+  return NULL;
+}
+
+void * memrchr (const void *str, int c, size_t count)
+{
+  const unsigned char *s = (unsigned char *)str + count;
+
+  while (count-- > 0)
+  {
+    if (*--s == (unsigned char)c)
+    {
+      return (void *)s;
+    }
+  }
+  return NULL;
+}
+
+// Returns 1 if every byte is 0, else 0
+int is_all_zero (const void *str, size_t count)
+{
+  const unsigned char *s = (unsigned char *)str;
+
+  while (count-- > 0)
+  {
+    if (*s++)
+    {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+///=============================================================================
+/// LICENSING INFORMATION
+///=============================================================================
+//
+// The code above this comment is in the public domain.
+// The code below this comment is subject to the custom attribution license found
+// here: https://github.com/KNNSpeed/Simple-Kernel/blob/master/LICENSE_KERNEL
+//
+//==============================================================================
+//  AVX Memory Functions: AVX Memscan
+//==============================================================================
+//
+// Version 1.0
+//
+// Author:
+//  KNNSpeed
+//
+// Source Code:
+//  https://github.com/KNNSpeed/Simple-Kernel
+//
+// Minimum requirement:
+//  x86_64 CPU with SSE4.2, but AVX2 or later is recommended
+//
+// This file provides highly optimized versions of strlen, strnlen, memchr,
+// memrchr, and is_all_zero (returns 1 if a buffer is all zeroes, else 0).
+//
+// memchr, memrchr, and is_all_zero know how big their buffers are, so they work
+// like memcmp: vectors for as much as possible, then smaller and smaller pieces
+// for the tail.
+//
+// strlen and strnlen don't know where the end is, so they can't do that. An
+// unaligned vector load that runs past the terminating 0 could run into an
+// unmapped page, but an aligned one never crosses a page boundary. So these only
+// ever do aligned loads, starting from the vector that contains the first byte
+// of the string and ignoring any matches from before it. This is why their
+// "_u" versions never actually do unaligned loads.
+//
+
+#ifdef __clang__
+#define __m128i_u __m128i
+#define __m256i_u __m256i
+#define __m512i_u __m512i
+#endif
+
+#ifdef __AVX512F__
+#define BYTE_ALIGNMENT 0x3F // For 64-byte alignment
+#elif __AVX2__
+#define BYTE_ALIGNMENT 0x1F // For 32-byte alignment
+#else
+#define BYTE_ALIGNMENT 0x0F // For 16-byte alignment
+#endif
+
+//-----------------------------------------------------------------------------
+// Individual Functions:
+//-----------------------------------------------------------------------------
+//
+// The memchr/memrchr/is_all_zero functions below take a count of their
+// respective sizes, like memcmp's. The strlen/strnlen ones take the string
+// itself and return its length.
+//
+// Byte compares at 512 bits need AVX512BW, so those are only here if the build
+// allows it. memdispatch.c has versions for any build.
+//
+
+// 64-bit (8 bytes at a time)
+// Count is (# of total bytes/8), so it's "# of 64-bits"
+
+int is_all_zero_64bit(const void *str, size_t count)
+{
+  const uint64_t *s = (uint64_t *)str;
+
+  while (count--)
+  {
+    if (*s++)
+    {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+//-----------------------------------------------------------------------------
+// SSE4.2 Unaligned:
+//-----------------------------------------------------------------------------
+
+// SSE4.2 (128-bit, 16 bytes at a time - 4 pixels in a 32-bit linear frame buffer)
+// Count is (# of total bytes/16), so it's "# of 128-bits"
+
+void * memchr_128bit_u(const void *str, int c, size_t count)
+{
+  const __m128i_u *s = (__m128i_u*)str;
+  const __m128i needle = _mm_set1_epi8((char)c);
+
+  while (count--)
+  {
+    __m128i item = _mm_lddqu_si128(s);
+    unsigned int result = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(item, needle));
+    // One bit per byte, set where the byte matches
+
+    if(result)
+    {
+      return (char *)s + __builtin_ctz(result); // Lowest set bit is the first match
+    }
+    s++;
+  }
+  return NULL;
+}
+
+// Same as above, but goes from the end backwards
+void * memrchr_128bit_u(const void *str, int c, size_t count)
+{
+  const __m128i_u *s = (__m128i_u*)str + count;
+  const __m128i needle = _mm_set1_epi8((char)c);
+
+  while (count--)
+  {
+    s--;
+    __m128i item = _mm_lddqu_si128(s);
+    unsigned int result = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(item, needle));
+
+    if(result)
+    {
+      return (char *)s + (31 - __builtin_clz(result)); // Highest set bit is the last match
+    }
+  }
+  return NULL;
+}
+
+int is_all_zero_128bit_u(const void *str, size_t count)
+{
+  const __m128i_u *s = (__m128i_u*)str;
+
+  while (count--)
+  {
+    __m128i item = _mm_lddqu_si128(s++);
+
+    if(!_mm_testz_si128(item, item))
+    {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// Any alignment, see the top of this file
+size_t strlen_128bit_u(const char *str)
+{
+  size_t misalignment = (uintptr_t)str & 15;
+  const __m128i *s = (__m128i*)(str - misalignment);
+  unsigned int result = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128(s), _mm_setzero_si128())) >> misalignment;
+
+  if(result)
+  {
+    return __builtin_ctz(result);
+  }
+  return (16 - misalignment) + strlen_128bit_a((const char *)(s + 1));
+}
+
+size_t strnlen_128bit_u(const char *str, size_t maxlen)
+{
+  if(!maxlen)
+  {
+    return 0;
+  }
+
+  size_t misalignment = (uintptr_t)str & 15;
+  const __m128i *s = (__m128i*)(str - misalignment);
+  unsigned int result = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128(s), _mm_setzero_si128())) >> misalignment;
+  size_t head = 16 - misalignment;
+
+  if(result)
+  {
+    head = __builtin_ctz(result);
+  }
+  if(result || (head >= maxlen))
+  {
+    return (head < maxlen) ? head : maxlen;
+  }
+  return head + strnlen_128bit_a((const char *)(s + 1), maxlen - head);
+}
+
+//-----------------------------------------------------------------------------
+// AVX2+ Unaligned:
+//-----------------------------------------------------------------------------
+
+// AVX2 (256-bit, 32 bytes at a time - 8 pixels in a 32-bit linear frame buffer)
+// Count is (# of total bytes/32), so it's "# of 256-bits"
+// Haswell and Ryzen and up
+
+#ifdef __AVX2__
+void * memchr_256bit_u(const void *str, int c, size_t count)
+{
+  const __m256i_u *s = (__m256i_u*)str;
+  const __m256i needle = _mm256_set1_epi8((char)c);
+
+  while (count--)
+  {
+    __m256i item = _mm256_lddqu_si256(s);
+    unsigned int result = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(item, needle));
+
+    if(result)
+    {
+      return (char *)s + __builtin_ctz(result);
+    }
+    s++;
+  }
+  return NULL;
+}
+
+void * memrchr_256bit_u(const void *str, int c, size_t count)
+{
+  const __m256i_u *s = (__m256i_u*)str + count;
+  const __m256i needle = _mm256_set1_epi8((char)c);
+
+  while (count--)
+  {
+    s--;
+    __m256i item = _mm256_lddqu_si256(s);
+    unsigned int result = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(item, needle));
+
+    if(result)
+    {
+      return (char *)s + (31 - __builtin_clz(result));
+    }
+  }
+  return NULL;
+}
+
+// ORs together 4 vectors at a time and checks them with one vptest, which is
+// enough to keep up with memory bandwidth
+int is_all_zero_256bit_u(const void *str, size_t count)
+{
+  const __m256i_u *s = (__m256i_u*)str;
+
+  while (count >= 4)
+  {
+    __m256i item = _mm256_or_si256(
+                     _mm256_or_si256(_mm256_lddqu_si256(s), _mm256_lddqu_si256(s + 1)),
+                     _mm256_or_si256(_mm256_lddqu_si256(s + 2), _mm256_lddqu_si256(s + 3))
+                   );
+
+    if(!_mm256_testz_si256(item, item))
+    {
+      return 0;
+    }
+    s += 4;
+    count -= 4;
+  }
+
+  while (count--)
+  {
+    __m256i item = _mm256_lddqu_si256(s++);
+
+    if(!_mm256_testz_si256(item, item))
+    {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+size_t strlen_256bit_u(const char *str)
+{
+  size_t misalignment = (uintptr_t)str & 31;
+  const __m256i *s = (__m256i*)(str - misalignment);
+  unsigned int result = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_load_si256(s), _mm256_setzero_si256())) >> misalignment;
+
+  if(result)
+  {
+    return __builtin_ctz(result);
+  }
+  return (32 - misalignment) + strlen_256bit_a((const char *)(s + 1));
+}
+
+size_t strnlen_256bit_u(const char *str, size_t maxlen)
+{
+  if(!maxlen)
+  {
+    return 0;
+  }
+
+  size_t misalignment = (uintptr_t)str & 31;
+  const __m256i *s = (__m256i*)(str - misalignment);
+  unsigned int result = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_load_si256(s), _mm256_setzero_si256())) >> misalignment;
+  size_t head = 32 - misalignment;
+
+  if(result)
+  {
+    head = __builtin_ctz(result);
+  }
+  if(result || (head >= maxlen))
+  {
+    return (head < maxlen) ? head : maxlen;
+  }
+  return head + strnlen_256bit_a((const char *)(s + 1), maxlen - head);
+}
+#endif
+
+// AVX-512 (512-bit, 64 bytes at a time - 16 pixels in a 32-bit linear frame buffer)
+// Count is (# of total bytes/64), so it's "# of 512-bits"
+// is_all_zero requires AVX512F, the rest require AVX512BW
+
+#ifdef __AVX512BW__
+void * memchr_512bit_u(const void *str, int c, size_t count)
+{
+  const __m512i_u *s = (__m512i_u*)str;
+  const __m512i needle = _mm512_set1_epi8((char)c);
+
+  while (count--)
+  {
+    __m512i item = _mm512_loadu_si512(s);
+    uint64_t result = _mm512_cmpeq_epi8_mask(item, needle);
+
+    if(result)
+    {
+      return (char *)s + __builtin_ctzll(result);
+    }
+    s++;
+  }
+  return NULL;
+}
+
+void * memrchr_512bit_u(const void *str, int c, size_t count)
+{
+  const __m512i_u *s = (__m512i_u*)str + count;
+  const __m512i needle = _mm512_set1_epi8((char)c);
+
+  while (count--)
+  {
+    s--;
+    __m512i item = _mm512_loadu_si512(s);
+    uint64_t result = _mm512_cmpeq_epi8_mask(item, needle);
+
+    if(result)
+    {
+      return (char *)s + (63 - __builtin_clzll(result));
+    }
+  }
+  return NULL;
+}
+
+size_t strlen_512bit_u(const char *str)
+{
+  size_t misalignment = (uintptr_t)str & 63;
+  const __m512i *s = (__m512i*)(str - misalignment);
+  uint64_t result = _mm512_cmpeq_epi8_mask(_mm512_load_si512(s), _mm512_setzero_si512()) >> misalignment;
+
+  if(result)
+  {
+    return __builtin_ctzll(result);
+  }
+  return (64 - misalignment) + strlen_512bit_a((const char *)(s + 1));
+}
+
+size_t strnlen_512bit_u(const char *str, size_t maxlen)
+{
+  if(!maxlen)
+  {
+    return 0;
+  }
+
+  size_t misalignment = (uintptr_t)str & 63;
+  const __m512i *s = (__m512i*)(str - misalignment);
+  uint64_t result = _mm512_cmpeq_epi8_mask(_mm512_load_si512(s), _mm512_setzero_si512()) >> misalignment;
+  size_t head = 64 - misalignment;
+
+  if(result)
+  {
+    head = __builtin_ctzll(result);
+  }
+  if(result || (head >= maxlen))
+  {
+    return (head < maxlen) ? head : maxlen;
+  }
+  return head + strnlen_512bit_a((const char *)(s + 1), maxlen - head);
+}
+#endif
+
+#ifdef __AVX512F__
+int is_all_zero_512bit_u(const void *str, size_t count)
+{
+  const __m512i_u *s = (__m512i_u*)str;
+
+  while (count >= 4)
+  {
+    __m512i item = _mm512_or_si512(
+                     _mm512_or_si512(_mm512_loadu_si512(s), _mm512_loadu_si512(s + 1)),
+                     _mm512_or_si512(_mm512_loadu_si512(s + 2), _mm512_loadu_si512(s + 3))
+                   );
+
+    if(_mm512_test_epi64_mask(item, item))
+    {
+      return 0;
+    }
+    s += 4;
+    count -= 4;
+  }
+
+  while (count--)
+  {
+    __m512i item = _mm512_loadu_si512(s++);
+
+    if(_mm512_test_epi64_mask(item, item))
+    {
+      return 0;
+    }
+  }
+  return 1;
+}
+#endif
+
+//-----------------------------------------------------------------------------
+// SSE4.2 Aligned:
+//-----------------------------------------------------------------------------
+
+// SSE4.2 (128-bit, 16 bytes at a time - 4 pixels in a 32-bit linear frame buffer)
+// Count is (# of total bytes/16), so it's "# of 128-bits"
+
+void * memchr_128bit_a(const void *str, int c, size_t count)
+{
+  const __m128i *s = (__m128i*)str;
+  const __m128i needle = _mm_set1_epi8((char)c);
+
+  while (count--)
+  {
+    __m128i item = _mm_load_si128(s);
+    unsigned int result = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(item, needle));
+
+    if(result)
+    {
+      return (char *)s + __builtin_ctz(result);
+    }
+    s++;
+  }
+  return NULL;
+}
+
+void * memrchr_128bit_a(const void *str, int c, size_t count)
+{
+  const __m128i *s = (__m128i*)str + count;
+  const __m128i needle = _mm_set1_epi8((char)c);
+
+  while (count--)
+  {
+    s--;
+    __m128i item = _mm_load_si128(s);
+    unsigned int result = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(item, needle));
+
+    if(result)
+    {
+      return (char *)s + (31 - __builtin_clz(result));
+    }
+  }
+  return NULL;
+}
+
+int is_all_zero_128bit_a(const void *str, size_t count)
+{
+  const __m128i *s = (__m128i*)str;
+
+  while (count--)
+  {
+    __m128i item = _mm_load_si128(s++);
+
+    if(!_mm_testz_si128(item, item))
+    {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// Str must be 16-byte aligned
+size_t strlen_128bit_a(const char *str)
+{
+  const __m128i *s = (__m128i*)str;
+  unsigned int result;
+
+  while (!(result = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128(s), _mm_setzero_si128()))))
+  {
+    s++;
+  }
+  return (size_t)((const char *)s - str) + __builtin_ctz(result);
+}
+
+// The last load can go past maxlen, but it won't go past the page maxlen is in
+size_t strnlen_128bit_a(const char *str, size_t maxlen)
+{
+  const __m128i *s = (__m128i*)str;
+  size_t length = 0;
+
+  while (length < maxlen)
+  {
+    unsigned int result = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128(s++), _mm_setzero_si128()));
+
+    if(result)
+    {
+      length += __builtin_ctz(result);
+      break;
+    }
+    length += 16;
+  }
+  return (length < maxlen) ? length : maxlen;
+}
+
+//-----------------------------------------------------------------------------
+// AVX2+ Aligned:
+//-----------------------------------------------------------------------------
+
+// AVX2 (256-bit, 32 bytes at a time - 8 pixels in a 32-bit linear frame buffer)
+// Count is (# of total bytes/32), so it's "# of 256-bits"
+// Haswell and Ryzen and up
+
+#ifdef __AVX2__
+void * memchr_256bit_a(const void *str, int c, size_t count)
+{
+  const __m256i *s = (__m256i*)str;
+  const __m256i needle = _mm256_set1_epi8((char)c);
+
+  while (count--)
+  {
+    __m256i item = _mm256_load_si256(s);
+    unsigned int result = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(item, needle));
+
+    if(result)
+    {
+      return (char *)s + __builtin_ctz(result);
+    }
+    s++;
+  }
+  return NULL;
+}
+
+void * memrchr_256bit_a(const void *str, int c, size_t count)
+{
+  const __m256i *s = (__m256i*)str + count;
+  const __m256i needle = _mm256_set1_epi8((char)c);
+
+  while (count--)
+  {
+    s--;
+    __m256i item = _mm256_load_si256(s);
+    unsigned int result = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(item, needle));
+
+    if(result)
+    {
+      return (char *)s + (31 - __builtin_clz(result));
+    }
+  }
+  return NULL;
+}
+
+int is_all_zero_256bit_a(const void *str, size_t count)
+{
+  const __m256i *s = (__m256i*)str;
+
+  while (count >= 4)
+  {
+    __m256i item = _mm256_or_si256(
+                     _mm256_or_si256(_mm256_load_si256(s), _mm256_load_si256(s + 1)),
+                     _mm256_or_si256(_mm256_load_si256(s + 2), _mm256_load_si256(s + 3))
+                   );
+
+    if(!_mm256_testz_si256(item, item))
+    {
+      return 0;
+    }
+    s += 4;
+    count -= 4;
+  }
+
+  while (count--)
+  {
+    __m256i item = _mm256_load_si256(s++);
+
+    if(!_mm256_testz_si256(item, item))
+    {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+size_t strlen_256bit_a(const char *str)
+{
+  const __m256i *s = (__m256i*)str;
+  unsigned int result;
+
+  while (!(result = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_load_si256(s), _mm256_setzero_si256()))))
+  {
+    s++;
+  }
+  return (size_t)((const char *)s - str) + __builtin_ctz(result);
+}
+
+size_t strnlen_256bit_a(const char *str, size_t maxlen)
+{
+  const __m256i *s = (__m256i*)str;
+  size_t length = 0;
+
+  while (length < maxlen)
+  {
+    unsigned int result = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_load_si256(s++), _mm256_setzero_si256()));
+
+    if(result)
+    {
+      length += __builtin_ctz(result);
+      break;
+    }
+    length += 32;
+  }
+  return (length < maxlen) ? length : maxlen;
+}
+#endif
+
+// AVX-512 (512-bit, 64 bytes at a time - 16 pixels in a 32-bit linear frame buffer)
+// Count is (# of total bytes/64), so it's "# of 512-bits"
+// is_all_zero requires AVX512F, the rest require AVX512BW
+
+#ifdef __AVX512BW__
+void * memchr_512bit_a(const void *str, int c, size_t count)
+{
+  const __m512i *s = (__m512i*)str;
+  const __m512i needle = _mm512_set1_epi8((char)c);
+
+  while (count--)
+  {
+    __m512i item = _mm512_load_si512(s);
+    uint64_t result = _mm512_cmpeq_epi8_mask(item, needle);
+
+    if(result)
+    {
+      return (char *)s + __builtin_ctzll(result);
+    }
+    s++;
+  }
+  return NULL;
+}
+
+void * memrchr_512bit_a(const void *str, int c, size_t count)
+{
+  const __m512i *s = (__m512i*)str + count;
+  const __m512i needle = _mm512_set1_epi8((char)c);
+
+  while (count--)
+  {
+    s--;
+    __m512i item = _mm512_load_si512(s);
+    uint64_t result = _mm512_cmpeq_epi8_mask(item, needle);
+
+    if(result)
+    {
+      return (char *)s + (63 - __builtin_clzll(result));
+    }
+  }
+  return NULL;
+}
+
+size_t strlen_512bit_a(const char *str)
+{
+  const __m512i *s = (__m512i*)str;
+  uint64_t result;
+
+  while (!(result = _mm512_cmpeq_epi8_mask(_mm512_load_si512(s), _mm512_setzero_si512())))
+  {
+    s++;
+  }
+  return (size_t)((const char *)s - str) + __builtin_ctzll(result);
+}
+
+size_t strnlen_512bit_a(const char *str, size_t maxlen)
+{
+  const __m512i *s = (__m512i*)str;
+  size_t length = 0;
+
+  while (length < maxlen)
+  {
+    uint64_t result = _mm512_cmpeq_epi8_mask(_mm512_load_si512(s++), _mm512_setzero_si512());
+
+    if(result)
+    {
+      length += __builtin_ctzll(result);
+      break;
+    }
+    length += 64;
+  }
+  return (length < maxlen) ? length : maxlen;
+}
+#endif
+
+#ifdef __AVX512F__
+int is_all_zero_512bit_a(const void *str, size_t count)
+{
+  const __m512i *s = (__m512i*)str;
+
+  while (count >= 4)
+  {
+    __m512i item = _mm512_or_si512(
+                     _mm512_or_si512(_mm512_load_si512(s), _mm512_load_si512(s + 1)),
+                     _mm512_or_si512(_mm512_load_si512(s + 2), _mm512_load_si512(s + 3))
+                   );
+
+    if(_mm512_test_epi64_mask(item, item))
+    {
+      return 0;
+    }
+    s += 4;
+    count -= 4;
+  }
+
+  while (count--)
+  {
+    __m512i item = _mm512_load_si512(s++);
+
+    if(_mm512_test_epi64_mask(item, item))
+    {
+      return 0;
+    }
+  }
+  return 1;
+}
+#endif
+
+//-----------------------------------------------------------------------------
+// Dispatch Functions (Unaligned):
+//-----------------------------------------------------------------------------
+
+// memchr for large chunks of memory with arbitrary sizes
+void * memchr_large(const void *str, int c, size_t numbytes) // Worst-case scenario: 127 bytes.
+{
+  void * found = NULL; // Return value if not found... or numbytes is 0
+  size_t offset = 0;
+
+  while(numbytes)
+  // This loop will, at most, get evaluated 4 times, ending sooner each time.
+  // At minimum non-trivial case, once. Each memchr has its own loop.
+  {
+    if(numbytes < 16) // 1 byte
+    {
+      return memchr(str, c, numbytes);
+    }
+#ifdef __AVX512BW__
+    else if(numbytes < 32) // 16 bytes
+    {
+      found = memchr_128bit_u(str, c, numbytes >> 4);
+      if(found)
+      {
+        return found;
+      }
+      offset = numbytes & -16;
+      str = (char *)str + offset;
+      numbytes &= 15;
+    }
+    else if(numbytes < 64) // 32 bytes
+    {
+      found = memchr_256bit_u(str, c, numbytes >> 5);
+      if(found)
+      {
+        return found;
+      }
+      offset = numbytes & -32;
+      str = (char *)str + offset;
+      numbytes &= 31;
+    }
+    else // 64 bytes
+    {
+      found = memchr_512bit_u(str, c, numbytes >> 6);
+      if(found)
+      {
+        return found;
+      }
+      offset = numbytes & -64;
+      str = (char *)str + offset;
+      numbytes &= 63;
+    }
+#elif __AVX2__
+    else if(numbytes < 32) // 16 bytes
+    {
+      found = memchr_128bit_u(str, c, numbytes >> 4);
+      if(found)
+      {
+        return found;
+      }
+      offset = numbytes & -16;
+      str = (char *)str + offset;
+      numbytes &= 15;
+    }
+    else // 32 bytes
+    {
+      found = memchr_256bit_u(str, c, numbytes >> 5);
+      if(found)
+      {
+        return found;
+      }
+      offset = numbytes & -32;
+      str = (char *)str + offset;
+      numbytes &= 31;
+    }
+#else // SSE4.2 only
+    else // 16 bytes
+    {
+      found = memchr_128bit_u(str, c, numbytes >> 4);
+      if(found)
+      {
+        return found;
+      }
+      offset = numbytes & -16;
+      str = (char *)str + offset;
+      numbytes &= 15;
+    }
+#endif
+  }
+  return found;
+}
+
+// memrchr has to look at the end first, so this peels off the tail from the
+// smallest piece up. Done this way, each piece is aligned to its own size when
+// str is aligned, which is what lets memrchr_large_a use aligned loads.
+void * memrchr_large(const void *str, int c, size_t numbytes) // Worst-case scenario: 127 bytes.
+{
+  void * found = NULL; // Return value if not found... or numbytes is 0
+
+  while(numbytes)
+  {
+    if(numbytes & 15) // 1 byte
+    {
+      found = memrchr((char *)str + (numbytes & -16), c, numbytes & 15);
+      if(found)
+      {
+        return found;
+      }
+      numbytes &= -16;
+    }
+#ifdef __AVX512BW__
+    else if(numbytes & 16) // 16 bytes
+    {
+      found = memrchr_128bit_u((char *)str + numbytes - 16, c, 1);
+      if(found)
+      {
+        return found;
+      }
+      numbytes -= 16;
+    }
+    else if(numbytes & 32) // 32 bytes
+    {
+      found = memrchr_256bit_u((char *)str + numbytes - 32, c, 1);
+      if(found)
+      {
+        return found;
+      }
+      numbytes -= 32;
+    }
+    else // 64 bytes
+    {
+      return memrchr_512bit_u(str, c, numbytes >> 6);
+    }
+#elif __AVX2__
+    else if(numbytes & 16) // 16 bytes
+    {
+      found = memrchr_128bit_u((char *)str + numbytes - 16, c, 1);
+      if(found)
+      {
+        return found;
+      }
+      numbytes -= 16;
+    }
+    else // 32 bytes
+    {
+      return memrchr_256bit_u(str, c, numbytes >> 5);
+    }
+#else // SSE4.2 only
+    else // 16 bytes
+    {
+      return memrchr_128bit_u(str, c, numbytes >> 4);
+    }
+#endif
+  }
+  return found;
+}
+
+// is_all_zero for large chunks of memory with arbitrary sizes
+int is_all_zero_large(const void *str, size_t numbytes) // Worst-case scenario: 127 bytes.
+{
+  size_t offset = 0;
+
+  while(numbytes)
+  {
+    if(numbytes < 8) // 1 byte
+    {
+      return is_all_zero(str, numbytes);
+    }
+    else if(numbytes < 16) // 8 bytes
+    {
+      if(!is_all_zero_64bit(str, numbytes >> 3))
+      {
+        return 0;
+      }
+      offset = numbytes & -8;
+      str = (char *)str + offset;
+      numbytes &= 7;
+    }
+#ifdef __AVX512F__
+    else if(numbytes < 32) // 16 bytes
+    {
+      if(!is_all_zero_128bit_u(str, numbytes >> 4))
+      {
+        return 0;
+      }
+      offset = numbytes & -16;
+      str = (char *)str + offset;
+      numbytes &= 15;
+    }
+    else if(numbytes < 64) // 32 bytes
+    {
+      if(!is_all_zero_256bit_u(str, numbytes >> 5))
+      {
+        return 0;
+      }
+      offset = numbytes & -32;
+      str = (char *)str + offset;
+      numbytes &= 31;
+    }
+    else // 64 bytes
+    {
+      if(!is_all_zero_512bit_u(str, numbytes >> 6))
+      {
+        return 0;
+      }
+      offset = numbytes & -64;
+      str = (char *)str + offset;
+      numbytes &= 63;
+    }
+#elif __AVX2__
+    else if(numbytes < 32) // 16 bytes
+    {
+      if(!is_all_zero_128bit_u(str, numbytes >> 4))
+      {
+        return 0;
+      }
+      offset = numbytes & -16;
+      str = (char *)str + offset;
+      numbytes &= 15;
+    }
+    else // 32 bytes
+    {
+      if(!is_all_zero_256bit_u(str, numbytes >> 5))
+      {
+        return 0;
+      }
+      offset = numbytes & -32;
+      str = (char *)str + offset;
+      numbytes &= 31;
+    }
+#else // SSE4.2 only
+    else // 16 bytes
+    {
+      if(!is_all_zero_128bit_u(str, numbytes >> 4))
+      {
+        return 0;
+      }
+      offset = numbytes & -16;
+      str = (char *)str + offset;
+      numbytes &= 15;
+    }
+#endif
+  }
+  return 1;
+}
+
+//-----------------------------------------------------------------------------
+// Dispatch Functions (Aligned):
+//-----------------------------------------------------------------------------
+
+// memchr for large chunks of memory with arbitrary sizes
+// Aligned version
+void * memchr_large_a(const void *str, int c, size_t numbytes) // Worst-case scenario: 127 bytes.
+{
+  void * found = NULL; // Return value if not found... or numbytes is 0
+  size_t offset = 0;
+
+  while(numbytes)
+  // This loop will, at most, get evaluated 4 times, ending sooner each time.
+  // At minimum non-trivial case, once. Each memchr has its own loop.
+  {
+    if(numbytes < 16) // 1 byte
+    {
+      return memchr(str, c, numbytes);
+    }
+#ifdef __AVX512BW__
+    else if(numbytes < 32) // 16 bytes
+    {
+      found = memchr_128bit_a(str, c, numbytes >> 4);
+      if(found)
+      {
+        return found;
+      }
+      offset = numbytes & -16;
+      str = (char *)str + offset;
+      numbytes &= 15;
+    }
+    else if(numbytes < 64) // 32 bytes
+    {
+      found = memchr_256bit_a(str, c, numbytes >> 5);
+      if(found)
+      {
+        return found;
+      }
+      offset = numbytes & -32;
+      str = (char *)str + offset;
+      numbytes &= 31;
+    }
+    else // 64 bytes
+    {
+      found = memchr_512bit_a(str, c, numbytes >> 6);
+      if(found)
+      {
+        return found;
+      }
+      offset = numbytes & -64;
+      str = (char *)str + offset;
+      numbytes &= 63;
+    }
+#elif __AVX2__
+    else if(numbytes < 32) // 16 bytes
+    {
+      found = memchr_128bit_a(str, c, numbytes >> 4);
+      if(found)
+      {
+        return found;
+      }
+      offset = numbytes & -16;
+      str = (char *)str + offset;
+      numbytes &= 15;
+    }
+    else // 32 bytes
+    {
+      found = memchr_256bit_a(str, c, numbytes >> 5);
+      if(found)
+      {
+        return found;
+      }
+      offset = numbytes & -32;
+      str = (char *)str + offset;
+      numbytes &= 31;
+    }
+#else // SSE4.2 only
+    else // 16 bytes
+    {
+      found = memchr_128bit_a(str, c, numbytes >> 4);
+      if(found)
+      {
+        return found;
+      }
+      offset = numbytes & -16;
+      str = (char *)str + offset;
+      numbytes &= 15;
+    }
+#endif
+  }
+  return found;
+}
+
+// Aligned version
+void * memrchr_large_a(const void *str, int c, size_t numbytes) // Worst-case scenario: 127 bytes.
+{
+  void * found = NULL; // Return value if not found... or numbytes is 0
+
+  while(numbytes)
+  {
+    if(numbytes & 15) // 1 byte
+    {
+      found = memrchr((char *)str + (numbytes & -16), c, numbytes & 15);
+      if(found)
+      {
+        return found;
+      }
+      numbytes &= -16;
+    }
+#ifdef __AVX512BW__
+    else if(numbytes & 16) // 16 bytes
+    {
+      found = memrchr_128bit_a((char *)str + numbytes - 16, c, 1);
+      if(found)
+      {
+        return found;
+      }
+      numbytes -= 16;
+    }
+    else if(numbytes & 32) // 32 bytes
+    {
+      found = memrchr_256bit_a((char *)str + numbytes - 32, c, 1);
+      if(found)
+      {
+        return found;
+      }
+      numbytes -= 32;
+    }
+    else // 64 bytes
+    {
+      return memrchr_512bit_a(str, c, numbytes >> 6);
+    }
+#elif __AVX2__
+    else if(numbytes & 16) // 16 bytes
+    {
+      found = memrchr_128bit_a((char *)str + numbytes - 16, c, 1);
+      if(found)
+      {
+        return found;
+      }
+      numbytes -= 16;
+    }
+    else // 32 bytes
+    {
+      return memrchr_256bit_a(str, c, numbytes >> 5);
+    }
+#else // SSE4.2 only
+    else // 16 bytes
+    {
+      return memrchr_128bit_a(str, c, numbytes >> 4);
+    }
+#endif
+  }
+  return found;
+}
+
+// Aligned version
+int is_all_zero_large_a(const void *str, size_t numbytes) // Worst-case scenario: 127 bytes.
+{
+  size_t offset = 0;
+
+  while(numbytes)
+  {
+    if(numbytes < 8) // 1 byte
+    {
+      return is_all_zero(str, numbytes);
+    }
+    else if(numbytes < 16) // 8 bytes
+    {
+      if(!is_all_zero_64bit(str, numbytes >> 3))
+      {
+        return 0;
+      }
+      offset = numbytes & -8;
+      str = (char *)str + offset;
+      numbytes &= 7;
+    }
+#ifdef __AVX512F__
+    else if(numbytes < 32) // 16 bytes
+    {
+      if(!is_all_zero_128bit_a(str, numbytes >> 4))
+      {
+        return 0;
+      }
+      offset = numbytes & -16;
+      str = (char *)str + offset;
+      numbytes &= 15;
+    }
+    else if(numbytes < 64) // 32 bytes
+    {
+      if(!is_all_zero_256bit_a(str, numbytes >> 5))
+      {
+        return 0;
+      }
+      offset = numbytes & -32;
+      str = (char *)str + offset;
+      numbytes &= 31;
+    }
+    else // 64 bytes
+    {
+      if(!is_all_zero_512bit_a(str, numbytes >> 6))
+      {
+        return 0;
+      }
+      offset = numbytes & -64;
+      str = (char *)str + offset;
+      numbytes &= 63;
+    }
+#elif __AVX2__
+    else if(numbytes < 32) // 16 bytes
+    {
+      if(!is_all_zero_128bit_a(str, numbytes >> 4))
+      {
+        return 0;
+      }
+      offset = numbytes & -16;
+      str = (char *)str + offset;
+      numbytes &= 15;
+    }
+    else // 32 bytes
+    {
+      if(!is_all_zero_256bit_a(str, numbytes >> 5))
+      {
+        return 0;
+      }
+      offset = numbytes & -32;
+      str = (char *)str + offset;
+      numbytes &= 31;
+    }
+#else // SSE4.2 only
+    else // 16 bytes
+    {
+      if(!is_all_zero_128bit_a(str, numbytes >> 4))
+      {
+        return 0;
+      }
+      offset = numbytes & -16;
+      str = (char *)str + offset;
+      numbytes &= 15;
+    }
+#endif
+  }
+  return 1;
+}
+
+//-----------------------------------------------------------------------------
+// Main Functions:
+//-----------------------------------------------------------------------------
+
+// Main scan functions, compiled for whatever -march allows. The AVX_ versions
+// in memdispatch.c decide at runtime whether to use these or something faster.
+
+size_t AVX_strlen_native(const char *str)
+{
+  if(((uintptr_t)str & BYTE_ALIGNMENT) == 0)
+  {
+#ifdef __AVX512BW__
+    return strlen_512bit_a(str);
+#elif __AVX2__
+    return strlen_256bit_a(str);
+#else
+    return strlen_128bit_a(str);
+#endif
+  }
+
+#ifdef __AVX512BW__
+  return strlen_512bit_u(str);
+#elif __AVX2__
+  return strlen_256bit_u(str);
+#else
+  return strlen_128bit_u(str);
+#endif
+}
+
+size_t AVX_strnlen_native(const char *str, size_t maxlen)
+{
+  if(((uintptr_t)str & BYTE_ALIGNMENT) == 0)
+  {
+#ifdef __AVX512BW__
+    return strnlen_512bit_a(str, maxlen);
+#elif __AVX2__
+    return strnlen_256bit_a(str, maxlen);
+#else
+    return strnlen_128bit_a(str, maxlen);
+#endif
+  }
+
+#ifdef __AVX512BW__
+  return strnlen_512bit_u(str, maxlen);
+#elif __AVX2__
+  return strnlen_256bit_u(str, maxlen);
+#else
+  return strnlen_128bit_u(str, maxlen);
+#endif
+}
+
+void * AVX_memchr_native(const void *str, int c, size_t numbytes)
+{
+  if(((uintptr_t)str & BYTE_ALIGNMENT) == 0) // Check alignment
+  {
+    return memchr_large_a(str, c, numbytes);
+  }
+  return memchr_large(str, c, numbytes);
+}
+
+void * AVX_memrchr_native(const void *str, int c, size_t numbytes)
+{
+  if(((uintptr_t)str & BYTE_ALIGNMENT) == 0)
+  {
+    return memrchr_large_a(str, c, numbytes);
+  }
+  return memrchr_large(str, c, numbytes);
+}
+
+int AVX_is_all_zero_native(const void *str, size_t numbytes)
+{
+  if(((uintptr_t)str & BYTE_ALIGNMENT) == 0)
+  {
+    return is_all_zero_large_a(str, numbytes);
+  }
+  return is_all_zero_large(str, numbytes);
+}
+
+// AVX-1024+ support pending existence of the standard.
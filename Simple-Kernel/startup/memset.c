@@ -2957,7 +2957,9 @@ void * memset_large_4B_as(void *dest, const uint32_t val, size_t numbytes_div_4)
 
 // To set values of sizes > 1 byte, call the desired memset functions directly
 // instead. A 4-byte version exists below, however.
-void * AVX_memset(void *dest, const uint8_t val, size_t numbytes)
+// This is compiled for whatever -march allows. AVX_memset in memdispatch.c
+// decides at runtime whether to use this or something faster.
+void * AVX_memset_native(void *dest, const uint8_t val, size_t numbytes)
 {
   void * returnval = dest;
 
@@ -2965,7 +2967,7 @@ void * AVX_memset(void *dest, const uint8_t val, size_t numbytes)
   {
     if(val == 0)
     {
-      if(numbytes > CACHESIZELIMIT)
+      if(numbytes > AVX_Mem_Dispatch.NT_Threshold)
       {
         memset_zeroes_as(dest, numbytes);
       }
@@ -2976,7 +2978,7 @@ void * AVX_memset(void *dest, const uint8_t val, size_t numbytes)
     }
     else
     {
-      if(numbytes > CACHESIZELIMIT)
+      if(numbytes > AVX_Mem_Dispatch.NT_Threshold)
       {
         memset_large_as(dest, val, numbytes);
       }
@@ -3002,7 +3004,7 @@ void * AVX_memset(void *dest, const uint8_t val, size_t numbytes)
         // this process only needs to be done once per call if dest is unaligned.
         memset_zeroes(dest, numbytes_to_align);
         // Now this should be near the fastest possible since stores are aligned.
-        if((numbytes - numbytes_to_align) > CACHESIZELIMIT)
+        if((numbytes - numbytes_to_align) > AVX_Mem_Dispatch.NT_Threshold)
         {
           memset_zeroes_as(destoffset, numbytes - numbytes_to_align);
         }
@@ -3026,7 +3028,7 @@ void * AVX_memset(void *dest, const uint8_t val, size_t numbytes)
         // this process only needs to be done once per call if dest is unaligned.
         memset_large(dest, val, numbytes_to_align);
         // Now this should be near the fastest possible since stores are aligned.
-        if((numbytes - numbytes_to_align) > CACHESIZELIMIT)
+        if((numbytes - numbytes_to_align) > AVX_Mem_Dispatch.NT_Threshold)
         {
           memset_large_as(destoffset, val, numbytes - numbytes_to_align);
         }
@@ -3057,7 +3059,7 @@ void * AVX_memset_4B(void *dest, const uint32_t val, size_t numbytes_div_4)
 
   if( ((uintptr_t)dest & BYTE_ALIGNMENT) == 0 ) // Check alignment
   {
-    if((numbytes_div_4 * 4) > CACHESIZELIMIT)
+    if((numbytes_div_4 * 4) > AVX_Mem_Dispatch.NT_Threshold)
     {
       memset_large_4B_as(dest, val, numbytes_div_4);
     }
@@ -3082,7 +3084,7 @@ void * AVX_memset_4B(void *dest, const uint32_t val, size_t numbytes_div_4)
       memset_large_4B(dest, val, numbytes_to_align >> 2);
       // Now this should be near the fastest possible since stores are aligned.
       // ...and in memset there are only stores.
-      if((numbytes_div_4 * 4 - numbytes_to_align) > CACHESIZELIMIT)
+      if((numbytes_div_4 * 4 - numbytes_to_align) > AVX_Mem_Dispatch.NT_Threshold)
       {
         memset_large_4B_as(destoffset, val, numbytes_div_4 - (numbytes_to_align >> 2));
       }